@@ -0,0 +1,156 @@
+//--------------------------------------------------------------------------------------
+// File: DDSLayout.h
+//
+// The DDS file structures and the subresource layout of a DDS file in memory, split out
+// of DDSTextureLoader so CPU-side readers (the software rasterizer, tools and benchmarks)
+// can parse DDS files without the Direct3D headers.  Only dxgiformat.h is needed; off
+// Windows it comes from DirectX-Headers (include/directx).
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <dxgiformat.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//--------------------------------------------------------------------------------------
+// Macros
+//--------------------------------------------------------------------------------------
+#ifndef MAKEFOURCC
+    #define MAKEFOURCC(ch0, ch1, ch2, ch3)                              \
+                ((uint32_t)(uint8_t)(ch0) | ((uint32_t)(uint8_t)(ch1) << 8) |       \
+                ((uint32_t)(uint8_t)(ch2) << 16) | ((uint32_t)(uint8_t)(ch3) << 24 ))
+#endif /* defined(MAKEFOURCC) */
+
+//--------------------------------------------------------------------------------------
+// DDS file structure definitions
+//
+// See DDS.h in the 'Texconv' sample and the 'DirectXTex' library
+//--------------------------------------------------------------------------------------
+#pragma pack(push,1)
+
+const uint32_t DDS_MAGIC = 0x20534444; // "DDS "
+
+struct DDS_PIXELFORMAT
+{
+    uint32_t    size;
+    uint32_t    flags;
+    uint32_t    fourCC;
+    uint32_t    RGBBitCount;
+    uint32_t    RBitMask;
+    uint32_t    GBitMask;
+    uint32_t    BBitMask;
+    uint32_t    ABitMask;
+};
+
+#define DDS_FOURCC      0x00000004  // DDPF_FOURCC
+#define DDS_RGB         0x00000040  // DDPF_RGB
+#define DDS_LUMINANCE   0x00020000  // DDPF_LUMINANCE
+#define DDS_ALPHA       0x00000002  // DDPF_ALPHA
+
+#define DDS_HEADER_FLAGS_VOLUME         0x00800000  // DDSD_DEPTH
+
+#define DDS_HEIGHT 0x00000002 // DDSD_HEIGHT
+#define DDS_WIDTH  0x00000004 // DDSD_WIDTH
+
+#define DDS_CUBEMAP_POSITIVEX 0x00000600 // DDSCAPS2_CUBEMAP | DDSCAPS2_CUBEMAP_POSITIVEX
+#define DDS_CUBEMAP_NEGATIVEX 0x00000a00 // DDSCAPS2_CUBEMAP | DDSCAPS2_CUBEMAP_NEGATIVEX
+#define DDS_CUBEMAP_POSITIVEY 0x00001200 // DDSCAPS2_CUBEMAP | DDSCAPS2_CUBEMAP_POSITIVEY
+#define DDS_CUBEMAP_NEGATIVEY 0x00002200 // DDSCAPS2_CUBEMAP | DDSCAPS2_CUBEMAP_NEGATIVEY
+#define DDS_CUBEMAP_POSITIVEZ 0x00004200 // DDSCAPS2_CUBEMAP | DDSCAPS2_CUBEMAP_POSITIVEZ
+#define DDS_CUBEMAP_NEGATIVEZ 0x00008200 // DDSCAPS2_CUBEMAP | DDSCAPS2_CUBEMAP_NEGATIVEZ
+
+#define DDS_CUBEMAP_ALLFACES ( DDS_CUBEMAP_POSITIVEX | DDS_CUBEMAP_NEGATIVEX |\
+                               DDS_CUBEMAP_POSITIVEY | DDS_CUBEMAP_NEGATIVEY |\
+                               DDS_CUBEMAP_POSITIVEZ | DDS_CUBEMAP_NEGATIVEZ )
+
+#define DDS_CUBEMAP 0x00000200 // DDSCAPS2_CUBEMAP
+
+enum DDS_MISC_FLAGS2
+{
+    DDS_MISC_FLAGS2_ALPHA_MODE_MASK = 0x7L,
+};
+
+struct DDS_HEADER
+{
+    uint32_t        size;
+    uint32_t        flags;
+    uint32_t        height;
+    uint32_t        width;
+    uint32_t        pitchOrLinearSize;
+    uint32_t        depth; // only if DDS_HEADER_FLAGS_VOLUME is set in flags
+    uint32_t        mipMapCount;
+    uint32_t        reserved1[11];
+    DDS_PIXELFORMAT ddspf;
+    uint32_t        caps;
+    uint32_t        caps2;
+    uint32_t        caps3;
+    uint32_t        caps4;
+    uint32_t        reserved2;
+};
+
+struct DDS_HEADER_DXT10
+{
+    DXGI_FORMAT     dxgiFormat;
+    uint32_t        resourceDimension;
+    uint32_t        miscFlag; // see D3D11_RESOURCE_MISC_FLAG
+    uint32_t        arraySize;
+    uint32_t        miscFlags2;
+};
+
+#pragma pack(pop)
+
+#define DDS_DIMENSION_TEXTURE2D        3    // D3D11_RESOURCE_DIMENSION_TEXTURE2D
+#define DDS_RESOURCE_MISC_TEXTURECUBE  0x4  // D3D11_RESOURCE_MISC_TEXTURECUBE
+#define DDS_MAX_MIP_LEVELS             15   // D3D12_REQ_MIP_LEVELS
+
+namespace DirectX
+{
+	// Bits per pixel of fmt (per texel for block compressed formats), 0 if unknown.
+	size_t BitsPerPixel(DXGI_FORMAT fmt);
+
+	// Bytes, row pitch and row count of one width x height surface of fmt.  A row of a
+	// block compressed format is a row of 4x4 blocks.
+	void GetSurfaceInfo(size_t width, size_t height, DXGI_FORMAT fmt,
+		size_t* outNumBytes, size_t* outRowBytes, size_t* outNumRows);
+
+	// The format of a legacy (non-DX10) pixel format, DXGI_FORMAT_UNKNOWN if none matches.
+	DXGI_FORMAT GetDXGIFormat(const DDS_PIXELFORMAT& ddpf);
+
+	// One subresource of a DDS file, Offset bytes from the start of the file.
+	struct DDSSubresource
+	{
+		size_t Offset = 0;
+		size_t RowPitch = 0;
+		size_t SlicePitch = 0;
+	};
+
+	// What ParseDDSLayout returns when a file is rejected.
+	enum class DDSLayoutResult
+	{
+		Ok,
+		InvalidFile,   // Not a DDS file, or no subresource to return.
+		NotSupported,  // Volume textures, partial cube maps, unknown formats.
+		Truncated      // The pixel data ends before the last subresource.
+	};
+
+	// The layout of a 2D texture or cube map.  Subresources holds the mips no larger than
+	// maxsize (all mips if 0) of each array slice, slice-major; a cube map has six slices in
+	// +X, -X, +Y, -Y, +Z, -Z order.  Width, Height and MipCount describe those mips.
+	struct DDSLayout
+	{
+		DXGI_FORMAT Format = DXGI_FORMAT_UNKNOWN;
+		size_t Width = 0;
+		size_t Height = 0;
+		size_t MipCount = 0;
+		size_t ArraySize = 0;
+		bool IsCubeMap = false;
+
+		std::vector<DDSSubresource> Subresources;
+	};
+
+	// Validates the header of the ddsDataSize bytes at ddsData and fills layout.  Only the
+	// header is read; the pixel data is located, not touched.
+	DDSLayoutResult ParseDDSLayout(const uint8_t* ddsData, size_t ddsDataSize, size_t maxsize, DDSLayout& layout);
+}
@@ -24,6 +24,8 @@
 
 #include <wrl.h>
 #include <d3d11_1.h>
+#include <memory>
+#include <vector>
 #include "d3dx12.h"
 
 #pragma warning(push)
@@ -92,6 +94,38 @@ namespace DirectX
 		                               _Out_opt_ DDS_ALPHA_MODE* alphaMode = nullptr
 		                               );
 
+	// Reads a DDS file into system memory for CPU-side processing instead of creating a
+	// resource.  subresources receives the mips no larger than maxsize (all mips if 0) of
+	// each array slice, slice-major; a cube map has six slices in +X, -X, +Y, -Y, +Z, -Z
+	// order.  The pData pointers point into ddsData.  width, height and mipCount describe
+	// the returned mips.  Only 2D textures and cube maps are supported.
+	HRESULT LoadDDSTextureDataFromFile12(_In_z_ const wchar_t* szFileName,
+		                                 std::unique_ptr<uint8_t[]>& ddsData,
+		                                 std::vector<D3D12_SUBRESOURCE_DATA>& subresources,
+		                                 _Out_ size_t* width,
+		                                 _Out_ size_t* height,
+		                                 _Out_ size_t* mipCount,
+		                                 _Out_ size_t* arraySize,
+		                                 _Out_ DXGI_FORMAT* format,
+		                                 _Out_ bool* isCubeMap,
+		                                 _In_ size_t maxsize = 0
+		                                 );
+
+	// Same as LoadDDSTextureDataFromFile12 for a DDS file already in memory; the pData
+	// pointers point into ddsData.  Both wrap ParseDDSLayout (DDSLayout.h), which reads
+	// the same layout without Direct3D.
+	HRESULT LoadDDSTextureDataFromMemory12(_In_reads_bytes_(ddsDataSize) const uint8_t* ddsData,
+		                                   _In_ size_t ddsDataSize,
+		                                   std::vector<D3D12_SUBRESOURCE_DATA>& subresources,
+		                                   _Out_ size_t* width,
+		                                   _Out_ size_t* height,
+		                                   _Out_ size_t* mipCount,
+		                                   _Out_ size_t* arraySize,
+		                                   _Out_ DXGI_FORMAT* format,
+		                                   _Out_ bool* isCubeMap,
+		                                   _In_ size_t maxsize = 0
+		                                   );
+
     // Standard version with optional auto-gen mipmap support
     HRESULT CreateDDSTextureFromMemory( _In_ ID3D11Device* d3dDevice,
                                         _In_opt_ ID3D11DeviceContext* d3dContext,
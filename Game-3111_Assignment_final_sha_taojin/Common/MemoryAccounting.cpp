@@ -0,0 +1,178 @@
+#include "MemoryAccounting.h"
+#include <wrl.h>
+#include <algorithm>
+#include <cstdio>
+#include <mutex>
+
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+	std::mutex gTrackedLock;
+	MemoryTracked* gTrackedList = nullptr;
+
+	const char* const gCategoryNames[(int)MemoryCategory::Count] =
+	{
+		"geometry", "texture", "upload buffer", "frame resource"
+	};
+
+	const char* const gResidencyNames[(int)MemoryResidency::Count] =
+	{
+		"system", "upload heap", "default heap"
+	};
+
+	double MiB(std::uint64_t bytes)
+	{
+		return bytes / (1024.0 * 1024.0);
+	}
+}
+
+// The list links are only touched here, under gTrackedLock.
+struct MemoryTrackedList
+{
+	static void Link(MemoryTracked* object)
+	{
+		std::lock_guard<std::mutex> lock(gTrackedLock);
+		object->mNextTracked = gTrackedList;
+		if (gTrackedList != nullptr)
+			gTrackedList->mPrevTracked = object;
+		gTrackedList = object;
+	}
+
+	static void Unlink(MemoryTracked* object)
+	{
+		std::lock_guard<std::mutex> lock(gTrackedLock);
+		if (object->mPrevTracked != nullptr)
+			object->mPrevTracked->mNextTracked = object->mNextTracked;
+		else
+			gTrackedList = object->mNextTracked;
+		if (object->mNextTracked != nullptr)
+			object->mNextTracked->mPrevTracked = object->mPrevTracked;
+	}
+
+	static void Collect(std::vector<MemoryEntry>& entries)
+	{
+		std::lock_guard<std::mutex> lock(gTrackedLock);
+		for (const MemoryTracked* object = gTrackedList; object != nullptr; object = object->mNextTracked)
+			object->AccountMemory(entries);
+	}
+};
+
+MemoryTracked::MemoryTracked()
+{
+	MemoryTrackedList::Link(this);
+}
+
+MemoryTracked::MemoryTracked(const MemoryTracked&)
+{
+	MemoryTrackedList::Link(this);
+}
+
+MemoryTracked::~MemoryTracked()
+{
+	MemoryTrackedList::Unlink(this);
+}
+
+std::uint64_t MemorySummary::Total(MemoryCategory category)const
+{
+	std::uint64_t total = 0;
+	for (int r = 0; r < (int)MemoryResidency::Count; ++r)
+		total += Bytes[(int)category][r];
+	return total;
+}
+
+std::uint64_t MemorySummary::Total(MemoryResidency residency)const
+{
+	std::uint64_t total = 0;
+	for (int c = 0; c < (int)MemoryCategory::Count; ++c)
+		total += Bytes[c][(int)residency];
+	return total;
+}
+
+std::uint64_t MemorySummary::Total()const
+{
+	std::uint64_t total = 0;
+	for (int c = 0; c < (int)MemoryCategory::Count; ++c)
+		total += Total((MemoryCategory)c);
+	return total;
+}
+
+const char* MemoryAccounting::CategoryName(MemoryCategory category)
+{
+	return gCategoryNames[(int)category];
+}
+
+const char* MemoryAccounting::ResidencyName(MemoryResidency residency)
+{
+	return gResidencyNames[(int)residency];
+}
+
+void MemoryAccounting::Collect(std::vector<MemoryEntry>& entries)
+{
+	MemoryTrackedList::Collect(entries);
+}
+
+MemorySummary MemoryAccounting::Summarize()
+{
+	std::vector<MemoryEntry> entries;
+	Collect(entries);
+
+	MemorySummary summary;
+	for (const MemoryEntry& e : entries)
+		summary.Bytes[(int)e.Category][(int)e.Residency] += e.Bytes;
+	return summary;
+}
+
+std::string MemoryAccounting::Dump()
+{
+	std::vector<MemoryEntry> entries;
+	Collect(entries);
+
+	MemorySummary summary;
+	for (const MemoryEntry& e : entries)
+		summary.Bytes[(int)e.Category][(int)e.Residency] += e.Bytes;
+
+	char line[256];
+	std::string dump;
+
+	std::snprintf(line, sizeof(line), "%-16s %12s %12s %12s %12s\n", "MiB",
+		gResidencyNames[0], gResidencyNames[1], gResidencyNames[2], "total");
+	dump += line;
+	for (int c = 0; c < (int)MemoryCategory::Count; ++c)
+	{
+		std::snprintf(line, sizeof(line), "%-16s %12.2f %12.2f %12.2f %12.2f\n", gCategoryNames[c],
+			MiB(summary.Bytes[c][0]), MiB(summary.Bytes[c][1]), MiB(summary.Bytes[c][2]),
+			MiB(summary.Total((MemoryCategory)c)));
+		dump += line;
+	}
+	std::snprintf(line, sizeof(line), "%-16s %12.2f %12.2f %12.2f %12.2f\n\n", "total",
+		MiB(summary.Total(MemoryResidency::System)), MiB(summary.Total(MemoryResidency::UploadHeap)),
+		MiB(summary.Total(MemoryResidency::DefaultHeap)), MiB(summary.Total()));
+	dump += line;
+
+	std::stable_sort(entries.begin(), entries.end(), [](const MemoryEntry& a, const MemoryEntry& b)
+	{
+		return a.Bytes > b.Bytes;
+	});
+	for (const MemoryEntry& e : entries)
+	{
+		std::snprintf(line, sizeof(line), "%12llu  %-14s %-12s %s (%s)\n", (unsigned long long)e.Bytes,
+			gCategoryNames[(int)e.Category], gResidencyNames[(int)e.Residency], e.Asset.c_str(), e.Part);
+		dump += line;
+	}
+
+	return dump;
+}
+
+std::uint64_t MemoryAccounting::ResourceBytes(ID3D12Resource* resource)
+{
+	if (resource == nullptr)
+		return 0;
+
+	ComPtr<ID3D12Device> device;
+	if (FAILED(resource->GetDevice(IID_PPV_ARGS(&device))))
+		return 0;
+
+	const D3D12_RESOURCE_DESC desc = resource->GetDesc();
+	return device->GetResourceAllocationInfo(0, 1, &desc).SizeInBytes;
+}
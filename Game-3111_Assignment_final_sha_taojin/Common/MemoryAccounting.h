@@ -0,0 +1,98 @@
+//***************************************************************************************
+// MemoryAccounting.h
+//
+// Accounts the memory held by the geometry, texture, upload-buffer and frame-resource
+// layers.  MeshGeometry, Texture and UploadBuffer derive from MemoryTracked, which keeps
+// every live instance in a list; a summary or dump walks that list and asks each object
+// what it holds, so the numbers always match the objects that actually exist.
+//***************************************************************************************
+
+#pragma once
+
+#include <d3d12.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class MemoryCategory : int
+{
+	Geometry = 0,
+	Texture,
+	UploadBuffer,
+	FrameResource,
+	Count
+};
+
+// Where the bytes live.  System memory covers CPU copies (geometry blobs) and upload
+// buffers created without a device.
+enum class MemoryResidency : int
+{
+	System = 0,
+	UploadHeap,
+	DefaultHeap,
+	Count
+};
+
+struct MemoryEntry
+{
+	MemoryCategory Category = MemoryCategory::Geometry;
+	MemoryResidency Residency = MemoryResidency::System;
+
+	// The asset the bytes belong to (geometry or texture name, buffer tag) and which of
+	// its buffers they are ("vertices", "upload", ...).
+	std::string Asset;
+	const char* Part = "";
+
+	std::uint64_t Bytes = 0;
+};
+
+struct MemorySummary
+{
+	std::uint64_t Bytes[(int)MemoryCategory::Count][(int)MemoryResidency::Count] = {};
+
+	std::uint64_t Total(MemoryCategory category)const;
+	std::uint64_t Total(MemoryResidency residency)const;
+	std::uint64_t Total()const;
+};
+
+// Base of every object that owns accounted memory.  Registers itself for its lifetime;
+// copies register as separate objects.
+class MemoryTracked
+{
+public:
+	// Appends one entry per buffer the object holds.  Empty buffers may be skipped.
+	virtual void AccountMemory(std::vector<MemoryEntry>& entries)const = 0;
+
+protected:
+	MemoryTracked();
+	MemoryTracked(const MemoryTracked&);
+	MemoryTracked& operator=(const MemoryTracked&) { return *this; }
+	virtual ~MemoryTracked();
+
+private:
+	friend struct MemoryTrackedList;
+
+	MemoryTracked* mPrevTracked = nullptr;
+	MemoryTracked* mNextTracked = nullptr;
+};
+
+class MemoryAccounting
+{
+public:
+	static const char* CategoryName(MemoryCategory category);
+	static const char* ResidencyName(MemoryResidency residency);
+
+	// Entries of every live tracked object.  Call from the thread that creates and
+	// destroys the tracked objects; one under construction elsewhere cannot be asked.
+	static void Collect(std::vector<MemoryEntry>& entries);
+
+	// Totals by category and residency.
+	static MemorySummary Summarize();
+
+	// The summary table followed by every asset, largest first.
+	static std::string Dump();
+
+	// Bytes the resource occupies in its heap, including the placement alignment the
+	// device applies (64 KB for committed buffers).  0 for a null resource.
+	static std::uint64_t ResourceBytes(ID3D12Resource* resource);
+};
@@ -0,0 +1,158 @@
+#include "RenderStats.h"
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+
+namespace
+{
+	// D3D_PRIMITIVE_TOPOLOGY values, so this file does not need the D3D headers.
+	const int TopologyTriangleList = 4;
+	const int TopologyTriangleStrip = 5;
+
+	struct RenderStatsCounters
+	{
+		std::atomic<std::uint64_t> UploadBytes[(int)UploadKind::Count];
+		std::atomic<std::uint64_t> UploadCopies[(int)UploadKind::Count];
+		std::atomic<std::uint64_t> Draws;
+		std::atomic<std::uint64_t> Instances;
+		std::atomic<std::uint64_t> Indices;
+		std::atomic<std::uint64_t> Triangles;
+		std::atomic<std::uint64_t> StateChanges[(int)StateChange::Count];
+	};
+
+	// Zero-initialized before any dynamic initialization runs.
+	RenderStatsCounters gCounters;
+	RenderStatsFrame gLastFrame;
+
+	const char* const gUploadKindNames[(int)UploadKind::Count] =
+	{
+		"object constants", "material constants", "pass constants", "light data", "dynamic vertices", "dynamic indices", "other"
+	};
+
+	const char* const gStateChangeNames[(int)StateChange::Count] =
+	{
+		"pso", "vertex buffer", "index buffer", "topology", "descriptor table", "root cbv", "root srv"
+	};
+
+	std::uint64_t Take(std::atomic<std::uint64_t>& counter)
+	{
+		return counter.exchange(0, std::memory_order_relaxed);
+	}
+}
+
+std::uint64_t RenderStatsFrame::TotalUploadBytes()const
+{
+	std::uint64_t total = 0;
+	for (int i = 0; i < (int)UploadKind::Count; ++i)
+		total += UploadBytes[i];
+	return total;
+}
+
+std::uint64_t RenderStatsFrame::TotalStateChanges()const
+{
+	std::uint64_t total = 0;
+	for (int i = 0; i < (int)StateChange::Count; ++i)
+		total += StateChanges[i];
+	return total;
+}
+
+void RenderStats::AddUpload(UploadKind kind, std::uint64_t bytes, std::uint64_t copies)
+{
+	gCounters.UploadBytes[(int)kind].fetch_add(bytes, std::memory_order_relaxed);
+	gCounters.UploadCopies[(int)kind].fetch_add(copies, std::memory_order_relaxed);
+}
+
+void RenderStats::AddDraw(std::uint32_t indexCount, std::uint32_t instanceCount, int topology)
+{
+	std::uint64_t triangles = 0;
+	if (topology == TopologyTriangleList)
+		triangles = indexCount / 3;
+	else if (topology == TopologyTriangleStrip && indexCount >= 3)
+		triangles = indexCount - 2;
+
+	gCounters.Draws.fetch_add(1, std::memory_order_relaxed);
+	gCounters.Instances.fetch_add(instanceCount, std::memory_order_relaxed);
+	gCounters.Indices.fetch_add((std::uint64_t)indexCount*instanceCount, std::memory_order_relaxed);
+	gCounters.Triangles.fetch_add(triangles*instanceCount, std::memory_order_relaxed);
+}
+
+void RenderStats::AddStateChange(StateChange change, std::uint32_t count)
+{
+	gCounters.StateChanges[(int)change].fetch_add(count, std::memory_order_relaxed);
+}
+
+void RenderStats::EndFrame()
+{
+	RenderStatsFrame frame;
+	for (int i = 0; i < (int)UploadKind::Count; ++i)
+	{
+		frame.UploadBytes[i] = Take(gCounters.UploadBytes[i]);
+		frame.UploadCopies[i] = Take(gCounters.UploadCopies[i]);
+	}
+	frame.Draws = Take(gCounters.Draws);
+	frame.Instances = Take(gCounters.Instances);
+	frame.Indices = Take(gCounters.Indices);
+	frame.Triangles = Take(gCounters.Triangles);
+	for (int i = 0; i < (int)StateChange::Count; ++i)
+		frame.StateChanges[i] = Take(gCounters.StateChanges[i]);
+
+	gLastFrame = frame;
+}
+
+const RenderStatsFrame& RenderStats::LastFrame()
+{
+	return gLastFrame;
+}
+
+const char* RenderStats::UploadKindName(UploadKind kind)
+{
+	return gUploadKindNames[(int)kind];
+}
+
+const char* RenderStats::StateChangeName(StateChange change)
+{
+	return gStateChangeNames[(int)change];
+}
+
+std::string RenderStats::Format(const RenderStatsFrame& frame)
+{
+	char line[256];
+	std::string text;
+
+	std::snprintf(line, sizeof(line), "draws %llu, instances %llu, triangles %llu, indices %llu\n",
+		(unsigned long long)frame.Draws, (unsigned long long)frame.Instances,
+		(unsigned long long)frame.Triangles, (unsigned long long)frame.Indices);
+	text += line;
+
+	std::snprintf(line, sizeof(line), "uploads %llu bytes\n", (unsigned long long)frame.TotalUploadBytes());
+	text += line;
+	for (int i = 0; i < (int)UploadKind::Count; ++i)
+	{
+		if (frame.UploadCopies[i] == 0)
+			continue;
+		std::snprintf(line, sizeof(line), "  %-20s %12llu bytes %8llu copies\n", gUploadKindNames[i],
+			(unsigned long long)frame.UploadBytes[i], (unsigned long long)frame.UploadCopies[i]);
+		text += line;
+	}
+
+	std::snprintf(line, sizeof(line), "state changes %llu\n", (unsigned long long)frame.TotalStateChanges());
+	text += line;
+	for (int i = 0; i < (int)StateChange::Count; ++i)
+	{
+		std::snprintf(line, sizeof(line), "  %-20s %12llu\n", gStateChangeNames[i],
+			(unsigned long long)frame.StateChanges[i]);
+		text += line;
+	}
+
+	return text;
+}
+
+bool RenderStats::Write(const RenderStatsFrame& frame, const std::wstring& filename)
+{
+	std::ofstream fout(std::string(filename.begin(), filename.end()));
+	if (!fout)
+		return false;
+
+	fout << Format(frame);
+	return (bool)fout;
+}
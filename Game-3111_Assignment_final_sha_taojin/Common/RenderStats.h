@@ -0,0 +1,84 @@
+//***************************************************************************************
+// RenderStats.h
+//
+// Per-frame counters for upload bandwidth, draws and command list state changes.
+// The frame update code counts the bytes it writes to upload buffers (once per loop, see
+// UploadBuffer::CountUploads), the draw code counts what it records, and the app calls
+// EndFrame once per frame to publish the totals.  The counters are relaxed atomics, so
+// any thread may add to them.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// What an upload buffer holds, see UploadBuffer::SetUploadKind.
+enum class UploadKind : int
+{
+	ObjectConstants = 0,
+	MaterialConstants,
+	PassConstants,
+	LightData,
+	DynamicVertices,
+	DynamicIndices,
+	Other,
+	Count
+};
+
+// Command list calls that change state.
+enum class StateChange : int
+{
+	PipelineState = 0,
+	VertexBuffer,
+	IndexBuffer,
+	Topology,
+	DescriptorTable,
+	RootCbv,
+	RootSrv,
+	Count
+};
+
+struct RenderStatsFrame
+{
+	std::uint64_t UploadBytes[(int)UploadKind::Count] = {};
+	std::uint64_t UploadCopies[(int)UploadKind::Count] = {};
+
+	std::uint64_t Draws = 0;
+	std::uint64_t Instances = 0;
+	std::uint64_t Indices = 0;
+	std::uint64_t Triangles = 0;
+
+	std::uint64_t StateChanges[(int)StateChange::Count] = {};
+
+	std::uint64_t TotalUploadBytes()const;
+	std::uint64_t TotalStateChanges()const;
+};
+
+class RenderStats
+{
+public:
+	// copies buffer writes of bytes in all.
+	static void AddUpload(UploadKind kind, std::uint64_t bytes, std::uint64_t copies = 1);
+
+	// One DrawIndexedInstanced call.  topology is a D3D_PRIMITIVE_TOPOLOGY; only triangle
+	// lists and strips add triangles.
+	static void AddDraw(std::uint32_t indexCount, std::uint32_t instanceCount, int topology);
+
+	static void AddStateChange(StateChange change, std::uint32_t count = 1);
+
+	// Publishes the counters gathered since the last call as LastFrame and restarts them.
+	static void EndFrame();
+
+	// The totals of the last completed frame.
+	static const RenderStatsFrame& LastFrame();
+
+	static const char* UploadKindName(UploadKind kind);
+	static const char* StateChangeName(StateChange change);
+
+	// Multi-line report of a frame, for logs and captures.
+	static std::string Format(const RenderStatsFrame& frame);
+
+	// Writes Format(frame) to filename.  Returns false if the file could not be written.
+	static bool Write(const RenderStatsFrame& frame, const std::wstring& filename);
+};
@@ -1,12 +1,14 @@
 #pragma once
 
 #include "d3dUtil.h"
+#include "RenderStats.h"
 
 template<typename T>
-class UploadBuffer
+class UploadBuffer : public MemoryTracked
 {
 public:
     UploadBuffer(ID3D12Device* device, UINT elementCount, bool isConstantBuffer) : 
+        mElementCount(elementCount),
         mIsConstantBuffer(isConstantBuffer)
     {
         mElementByteSize = sizeof(T);
@@ -21,10 +23,21 @@ public:
         if(isConstantBuffer)
             mElementByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(T));
 
+        // Without a device (the headless stress loop) the buffer lives in system memory
+        // with the same layout, and Resource() returns null.
+        if(device == nullptr)
+        {
+            mSystemMemory.resize((size_t)mElementByteSize*elementCount);
+            mMappedData = mSystemMemory.data();
+            return;
+        }
+
+        const CD3DX12_HEAP_PROPERTIES uploadHeap(D3D12_HEAP_TYPE_UPLOAD);
+        const CD3DX12_RESOURCE_DESC bufferDesc = CD3DX12_RESOURCE_DESC::Buffer(mElementByteSize*elementCount);
         ThrowIfFailed(device->CreateCommittedResource(
-            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+            &uploadHeap,
             D3D12_HEAP_FLAG_NONE,
-            &CD3DX12_RESOURCE_DESC::Buffer(mElementByteSize*elementCount),
+            &bufferDesc,
 			D3D12_RESOURCE_STATE_GENERIC_READ,
             nullptr,
             IID_PPV_ARGS(&mUploadBuffer)));
@@ -50,15 +63,99 @@ public:
         return mUploadBuffer.Get();
     }
 
+    UINT64 ByteSize()const
+    {
+        return (UINT64)mElementByteSize*mElementCount;
+    }
+
+    // Bytes between consecutive elements: sizeof(T), or that rounded up to 256 for
+    // constant buffers.
+    UINT ElementByteSize()const
+    {
+        return mElementByteSize;
+    }
+
+    // The buffer contents, for frame capture.  Reading upload heap memory is slow; only
+    // FrameCapture does it, once per captured frame.
+    const BYTE* MappedBytes()const
+    {
+        return mMappedData;
+    }
+
+    // CopyData does not count what it writes; the caller reports it with CountUploads,
+    // once per loop rather than once per element.
     void CopyData(int elementIndex, const T& data)
     {
         memcpy(&mMappedData[elementIndex*mElementByteSize], &data, sizeof(T));
     }
 
+    // Copies count consecutive elements.  Only valid for non-constant buffers, whose
+    // elements are tightly packed.
+    void CopyData(int firstElement, const T* data, int count)
+    {
+        assert(!mIsConstantBuffer);
+        memcpy(&mMappedData[firstElement*mElementByteSize], data, sizeof(T)*count);
+    }
+
+    // Counts copies CopyData calls that wrote elementCount elements in all.
+    void CountUploads(int copies, int elementCount)const
+    {
+        RenderStats::AddUpload(mUploadKind, (std::uint64_t)sizeof(T)*elementCount, copies);
+    }
+
+    // Returns count consecutive elements for the caller to write in place, counted as
+    // uploaded.  Only valid for non-constant buffers.  Upload heap memory is
+    // write-combined: fill it sequentially and never read it back.
+    T* MappedElements(int firstElement, int count)
+    {
+        assert(!mIsConstantBuffer);
+        RenderStats::AddUpload(mUploadKind, (std::uint64_t)sizeof(T)*count);
+        return reinterpret_cast<T*>(&mMappedData[firstElement*mElementByteSize]);
+    }
+
+    // Kind the bytes reported by CountUploads and MappedElements are counted under in
+    // RenderStats.
+    void SetUploadKind(UploadKind kind)
+    {
+        mUploadKind = kind;
+    }
+
+    // Category and asset name the buffer is accounted under.
+    void SetMemoryTag(MemoryCategory category, const std::string& asset)
+    {
+        mMemoryCategory = category;
+        mMemoryAsset = asset;
+    }
+
+    void AccountMemory(std::vector<MemoryEntry>& entries)const override
+    {
+        MemoryEntry e;
+        e.Category = mMemoryCategory;
+        e.Asset = mMemoryAsset;
+        e.Part = mIsConstantBuffer ? "constants" : "elements";
+        if(mUploadBuffer != nullptr)
+        {
+            e.Residency = MemoryResidency::UploadHeap;
+            e.Bytes = MemoryAccounting::ResourceBytes(mUploadBuffer.Get());
+        }
+        else
+        {
+            e.Residency = MemoryResidency::System;
+            e.Bytes = mSystemMemory.size();
+        }
+        entries.push_back(e);
+    }
+
 private:
     Microsoft::WRL::ComPtr<ID3D12Resource> mUploadBuffer;
+    std::vector<BYTE> mSystemMemory;
     BYTE* mMappedData = nullptr;
 
     UINT mElementByteSize = 0;
+    UINT mElementCount = 0;
     bool mIsConstantBuffer = false;
+
+    UploadKind mUploadKind = UploadKind::Other;
+    MemoryCategory mMemoryCategory = MemoryCategory::UploadBuffer;
+    std::string mMemoryAsset = "upload buffer";
 };
\ No newline at end of file
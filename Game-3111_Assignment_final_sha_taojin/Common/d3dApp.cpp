@@ -613,14 +613,13 @@ void D3DApp::CalculateFrameStats()
 		float fps = (float)frameCnt; // fps = frameCnt / 1
 		float mspf = 1000.0f / fps;
 
-        wstring fpsStr = to_wstring(fps);
-        wstring mspfStr = to_wstring(mspf);
+        // Formatted into a fixed buffer so the frame loop does not allocate.
+        const wchar_t* overlay = CaptionOverlay();
+        wchar_t windowText[512];
+        swprintf_s(windowText, L"%s    fps: %f   mspf: %f%s", mMainWndCaption.c_str(), fps, mspf,
+            overlay != nullptr ? overlay : L"");
 
-        wstring windowText = mMainWndCaption +
-            L"    fps: " + fpsStr +
-            L"   mspf: " + mspfStr;
-
-        SetWindowText(mhMainWnd, windowText.c_str());
+        SetWindowText(mhMainWnd, windowText);
 		
 		// Reset for next average.
 		frameCnt = 0;
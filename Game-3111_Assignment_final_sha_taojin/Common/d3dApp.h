@@ -51,6 +51,9 @@ protected:
 	virtual void OnMouseUp(WPARAM btnState, int x, int y)  { }
 	virtual void OnMouseMove(WPARAM btnState, int x, int y){ }
 
+	// Extra text appended to the fps in the window caption, or null for none.
+	virtual const wchar_t* CaptionOverlay() { return nullptr; }
+
 protected:
 
 	bool InitMainWindow();
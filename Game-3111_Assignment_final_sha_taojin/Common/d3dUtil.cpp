@@ -44,11 +44,16 @@ Microsoft::WRL::ComPtr<ID3D12Resource> d3dUtil::CreateDefaultBuffer(
 {
     ComPtr<ID3D12Resource> defaultBuffer;
 
+    // Named so the addresses are taken of lvalues, which conformance mode requires.
+    const CD3DX12_HEAP_PROPERTIES defaultHeap(D3D12_HEAP_TYPE_DEFAULT);
+    const CD3DX12_HEAP_PROPERTIES uploadHeap(D3D12_HEAP_TYPE_UPLOAD);
+    const CD3DX12_RESOURCE_DESC bufferDesc = CD3DX12_RESOURCE_DESC::Buffer(byteSize);
+
     // Create the actual default buffer resource.
     ThrowIfFailed(device->CreateCommittedResource(
-        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+        &defaultHeap,
         D3D12_HEAP_FLAG_NONE,
-        &CD3DX12_RESOURCE_DESC::Buffer(byteSize),
+        &bufferDesc,
 		D3D12_RESOURCE_STATE_COMMON,
         nullptr,
         IID_PPV_ARGS(defaultBuffer.GetAddressOf())));
@@ -56,9 +61,9 @@ Microsoft::WRL::ComPtr<ID3D12Resource> d3dUtil::CreateDefaultBuffer(
     // In order to copy CPU memory data into our default buffer, we need to create
     // an intermediate upload heap. 
     ThrowIfFailed(device->CreateCommittedResource(
-        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+        &uploadHeap,
 		D3D12_HEAP_FLAG_NONE,
-        &CD3DX12_RESOURCE_DESC::Buffer(byteSize),
+        &bufferDesc,
 		D3D12_RESOURCE_STATE_GENERIC_READ,
         nullptr,
         IID_PPV_ARGS(uploadBuffer.GetAddressOf())));
@@ -73,11 +78,13 @@ Microsoft::WRL::ComPtr<ID3D12Resource> d3dUtil::CreateDefaultBuffer(
     // Schedule to copy the data to the default buffer resource.  At a high level, the helper function UpdateSubresources
     // will copy the CPU memory into the intermediate upload heap.  Then, using ID3D12CommandList::CopySubresourceRegion,
     // the intermediate upload heap data will be copied to mBuffer.
-	cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(defaultBuffer.Get(), 
-		D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_DEST));
+	const CD3DX12_RESOURCE_BARRIER toCopyDest = CD3DX12_RESOURCE_BARRIER::Transition(defaultBuffer.Get(),
+		D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_DEST);
+	cmdList->ResourceBarrier(1, &toCopyDest);
     UpdateSubresources<1>(cmdList, defaultBuffer.Get(), uploadBuffer.Get(), 0, 0, 1, &subResourceData);
-	cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(defaultBuffer.Get(),
-		D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_GENERIC_READ));
+	const CD3DX12_RESOURCE_BARRIER toGenericRead = CD3DX12_RESOURCE_BARRIER::Transition(defaultBuffer.Get(),
+		D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_GENERIC_READ);
+	cmdList->ResourceBarrier(1, &toGenericRead);
 
     // Note: uploadBuffer has to be kept alive after the above function calls because
     // the command list has not been executed yet that performs the actual copy.
@@ -126,3 +133,59 @@ std::wstring DxException::ToString()const
 
 
 
+
+namespace
+{
+	void AddBlobEntry(std::vector<MemoryEntry>& entries, MemoryCategory category, const std::string& asset,
+		const char* part, ID3DBlob* blob)
+	{
+		if (blob == nullptr)
+			return;
+
+		MemoryEntry e;
+		e.Category = category;
+		e.Residency = MemoryResidency::System;
+		e.Asset = asset;
+		e.Part = part;
+		e.Bytes = blob->GetBufferSize();
+		entries.push_back(e);
+	}
+
+	void AddResourceEntry(std::vector<MemoryEntry>& entries, MemoryCategory category, MemoryResidency residency,
+		const std::string& asset, const char* part, ID3D12Resource* resource)
+	{
+		if (resource == nullptr)
+			return;
+
+		MemoryEntry e;
+		e.Category = category;
+		e.Residency = residency;
+		e.Asset = asset;
+		e.Part = part;
+		e.Bytes = MemoryAccounting::ResourceBytes(resource);
+		entries.push_back(e);
+	}
+}
+
+void MeshGeometry::AccountMemory(std::vector<MemoryEntry>& entries)const
+{
+	const MemoryCategory c = MemoryCategory::Geometry;
+
+	AddBlobEntry(entries, c, Name, "vertices", VertexBufferCPU.Get());
+	AddBlobEntry(entries, c, Name, "indices", IndexBufferCPU.Get());
+	AddBlobEntry(entries, c, Name, "colors", ColorBufferCPU.Get());
+
+	AddResourceEntry(entries, c, MemoryResidency::DefaultHeap, Name, "vertices", VertexBufferGPU.Get());
+	AddResourceEntry(entries, c, MemoryResidency::DefaultHeap, Name, "indices", IndexBufferGPU.Get());
+	AddResourceEntry(entries, c, MemoryResidency::DefaultHeap, Name, "colors", ColorBufferGPU.Get());
+
+	AddResourceEntry(entries, c, MemoryResidency::UploadHeap, Name, "vertex uploader", VertexBufferUploader.Get());
+	AddResourceEntry(entries, c, MemoryResidency::UploadHeap, Name, "index uploader", IndexBufferUploader.Get());
+	AddResourceEntry(entries, c, MemoryResidency::UploadHeap, Name, "color uploader", ColorBufferUploader.Get());
+}
+
+void Texture::AccountMemory(std::vector<MemoryEntry>& entries)const
+{
+	AddResourceEntry(entries, MemoryCategory::Texture, MemoryResidency::DefaultHeap, Name, "texels", Resource.Get());
+	AddResourceEntry(entries, MemoryCategory::Texture, MemoryResidency::UploadHeap, Name, "upload heap", UploadHeap.Get());
+}
@@ -24,8 +24,8 @@
 #include "d3dx12.h"
 #include "DDSTextureLoader.h"
 #include "MathHelper.h"
-
-extern const int gNumFrameResources;
+#include "MemoryAccounting.h"
+#include "ShadingTypes.h"
 
 inline void d3dSetDebugName(IDXGIObject* obj, const char* name)
 {
@@ -153,7 +153,7 @@ struct SubmeshGeometry
 	DirectX::BoundingBox Bounds;
 };
 
-struct MeshGeometry
+struct MeshGeometry : public MemoryTracked
 
 {
 	// Give it a name so we can look it up by name.
@@ -234,64 +234,16 @@ struct MeshGeometry
 		IndexBufferUploader = nullptr;
 		ColorBufferUploader = nullptr;
 	}
-};
-
-
-
 
-
-struct Light
-{
-	DirectX::XMFLOAT3 Strength = { 0.5f, 0.5f, 0.5f };
-	float FalloffStart = 1.0f;                          // point/spot light only
-	DirectX::XMFLOAT3 Direction = { 0.0f, -1.0f, 0.0f };// directional/spot light only
-	float FalloffEnd = 10.0f;                           // point/spot light only
-	DirectX::XMFLOAT3 Position = { 0.0f, 0.0f, 0.0f };  // point/spot light only
-	float SpotPower = 64.0f;                            // spot light only
+	// The CPU blobs, GPU buffers and any uploaders not yet disposed, tagged with Name.
+	void AccountMemory(std::vector<MemoryEntry>& entries)const override;
 };
 
-#define MaxLights 16
 
-struct MaterialConstants
-{
-	DirectX::XMFLOAT4 DiffuseAlbedo = { 1.0f, 1.0f, 1.0f, 1.0f };
-	DirectX::XMFLOAT3 FresnelR0 = { 0.01f, 0.01f, 0.01f };
-	float Roughness = 0.25f;
 
-	// Used in texture mapping.
-	DirectX::XMFLOAT4X4 MatTransform = MathHelper::Identity4x4();
-};
 
-// Simple struct to represent a material for our demos.  A production 3D engine
-// would likely create a class hierarchy of Materials.
-struct Material
-{
-	// Unique material name for lookup.
-	std::string Name;
-
-	// Index into constant buffer corresponding to this material.
-	int MatCBIndex = -1;
-
-	// Index into SRV heap for diffuse texture.
-	int DiffuseSrvHeapIndex = -1;
-
-	// Index into SRV heap for normal texture.
-	int NormalSrvHeapIndex = -1;
 
-	// Dirty flag indicating the material has changed and we need to update the constant buffer.
-	// Because we have a material constant buffer for each FrameResource, we have to apply the
-	// update to each FrameResource.  Thus, when we modify a material we should set 
-	// NumFramesDirty = gNumFrameResources so that each frame resource gets the update.
-	int NumFramesDirty = gNumFrameResources;
-
-	// Material constant buffer data used for shading.
-	DirectX::XMFLOAT4 DiffuseAlbedo = { 1.0f, 1.0f, 1.0f, 1.0f };
-	DirectX::XMFLOAT3 FresnelR0 = { 0.01f, 0.01f, 0.01f };
-	float Roughness = .25f;
-	DirectX::XMFLOAT4X4 MatTransform = MathHelper::Identity4x4();
-};
-
-struct Texture
+struct Texture : public MemoryTracked
 {
 	// Unique material name for lookup.
 	std::string Name;
@@ -300,6 +252,8 @@ struct Texture
 
 	Microsoft::WRL::ComPtr<ID3D12Resource> Resource = nullptr;
 	Microsoft::WRL::ComPtr<ID3D12Resource> UploadHeap = nullptr;
+
+	void AccountMemory(std::vector<MemoryEntry>& entries)const override;
 };
 
 #ifndef ThrowIfFailed
@@ -0,0 +1,83 @@
+//***************************************************************************************
+// BenchMain.cpp
+//
+// Usage: Bench [--filter text] [--threads 1,2,4,0] [--samples N] [--min-time seconds]
+//              [--textures dir] [--out results.json] [--list]
+//***************************************************************************************
+
+#include "Benchmark.h"
+#include "../Tools/ToolCommands.h"
+#include <cstdio>
+#include <sstream>
+
+namespace
+{
+	typedef void(*RegisterFunc)(BenchmarkRegistry& registry, const BenchmarkOptions& options);
+
+	const RegisterFunc gGroups[] =
+	{
+		RegisterWavesBenchmarks,
+		RegisterGeometryBenchmarks,
+		RegisterCollisionBenchmarks,
+		RegisterObjectConstantsBenchmarks,
+		RegisterCameraBenchmarks,
+		RegisterParticleBenchmarks,
+		RegisterClothBenchmarks,
+		RegisterSkinningBenchmarks,
+		RegisterRigidBodyBenchmarks,
+		RegisterMeshImportBenchmarks,
+		RegisterMeshletBenchmarks,
+		RegisterHalfEdgeBenchmarks,
+		RegisterStaticBatchBenchmarks,
+		RegisterDdsBenchmarks,
+	};
+
+	std::vector<int> ParseThreadCounts(const std::string& list)
+	{
+		std::vector<int> counts;
+		std::stringstream ss(list);
+		std::string item;
+		while (std::getline(ss, item, ','))
+		{
+			if (!item.empty())
+				counts.push_back(std::atoi(item.c_str()));
+		}
+		return counts;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	ToolArgs args(argc - 1, argv + 1);
+
+	BenchmarkOptions options;
+	options.Filter = args.GetString("filter", "");
+	if (args.Has("threads"))
+		options.ThreadCounts = ParseThreadCounts(args.GetString("threads", ""));
+	options.Samples = args.GetInt("samples", options.Samples);
+	options.MinSampleSeconds = args.GetFloat("min-time", (float)options.MinSampleSeconds);
+	options.TextureDirectory = args.GetString("textures", options.TextureDirectory);
+
+	BenchmarkRegistry registry;
+	for (RegisterFunc group : gGroups)
+		group(registry, options);
+
+	if (args.Has("list"))
+	{
+		for (const BenchmarkCase& c : registry.Cases())
+			std::printf("%s%s\n", c.Name.c_str(), c.ThreadSweep ? " (thread sweep)" : "");
+		return 0;
+	}
+
+	std::vector<BenchmarkResult> results = RunBenchmarks(registry, options);
+
+	std::string out = args.GetString("out", "bench.json");
+	if (!WriteBenchmarkJson(out, options, results))
+	{
+		std::fprintf(stderr, "Failed to write %s\n", out.c_str());
+		return 1;
+	}
+	std::printf("wrote %s (%d results)\n", out.c_str(), (int)results.size());
+
+	return 0;
+}
@@ -0,0 +1,211 @@
+//***************************************************************************************
+// Benchmark.cpp
+//
+// Each case is calibrated until one batch of iterations takes MinSampleSeconds, then
+// timed for Samples batches.  Statistics are per iteration.
+//***************************************************************************************
+
+#include "Benchmark.h"
+#include "../Project1/ParallelFor.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <thread>
+
+namespace
+{
+	volatile const void* gSink = nullptr;
+
+	double TimeBatch(const BenchmarkBody& body, long long iterations)
+	{
+		auto start = std::chrono::steady_clock::now();
+		for (long long i = 0; i < iterations; ++i)
+			body();
+		auto end = std::chrono::steady_clock::now();
+		return std::chrono::duration<double>(end - start).count();
+	}
+
+	std::string CompilerName()
+	{
+#if defined(__clang__)
+		return std::string("clang ") + __clang_version__;
+#elif defined(_MSC_VER)
+		return "msvc " + std::to_string(_MSC_FULL_VER);
+#elif defined(__GNUC__)
+		return std::string("gcc ") + __VERSION__;
+#else
+		return "unknown";
+#endif
+	}
+
+	std::string PlatformName()
+	{
+#if defined(_WIN32)
+		return "windows";
+#elif defined(__linux__)
+		return "linux";
+#else
+		return "unknown";
+#endif
+	}
+
+	std::string CurrentTimeUtc()
+	{
+		std::time_t now = std::time(nullptr);
+		std::tm utc = {};
+#if defined(_MSC_VER)
+		gmtime_s(&utc, &now);
+#else
+		gmtime_r(&now, &utc);
+#endif
+		char text[32];
+		std::strftime(text, sizeof(text), "%Y-%m-%dT%H:%M:%SZ", &utc);
+		return text;
+	}
+
+	void WriteJsonString(std::ostream& out, const std::string& s)
+	{
+		out << '"';
+		for (char c : s)
+		{
+			if (c == '"' || c == '\\')
+				out << '\\' << c;
+			else if ((unsigned char)c < 0x20)
+				out << ' ';
+			else
+				out << c;
+		}
+		out << '"';
+	}
+}
+
+void BenchmarkSink(const void* p)
+{
+	gSink = p;
+}
+
+std::vector<BenchmarkResult> RunBenchmarks(const BenchmarkRegistry& registry, const BenchmarkOptions& options)
+{
+	std::vector<BenchmarkResult> results;
+	const int hardwareThreads = (int)std::max(std::thread::hardware_concurrency(), 1u);
+	const int samples = std::max(options.Samples, 1);
+
+	std::printf("%-44s %7s %12s %12s %12s %8s %14s\n",
+		"benchmark", "threads", "mean ns", "median ns", "min ns", "stddev", "items/s");
+
+	for (const BenchmarkCase& c : registry.Cases())
+	{
+		if (!options.Filter.empty() && c.Name.find(options.Filter) == std::string::npos)
+			continue;
+
+		const std::vector<int> threadCounts = c.ThreadSweep ? options.ThreadCounts : std::vector<int>(1, 0);
+		for (int threads : threadCounts)
+		{
+			if (threads > hardwareThreads)
+				continue;
+
+			// Declared before the body so the case state is released under the same limit.
+			std::unique_ptr<ScopedWorkerLimit> limit;
+			if (threads > 0)
+				limit = std::make_unique<ScopedWorkerLimit>(threads);
+
+			BenchmarkBody body = c.Setup();
+			if (!body)
+			{
+				std::printf("%-44s skipped\n", c.Name.c_str());
+				break;
+			}
+
+			// Warm up and grow the batch until it is long enough to time reliably.
+			long long batch = 1;
+			for (;;)
+			{
+				double seconds = TimeBatch(body, batch);
+				if (seconds >= options.MinSampleSeconds || batch >= (1LL << 30))
+					break;
+
+				long long next = seconds > 0.0 ?
+					(long long)(batch*options.MinSampleSeconds*1.2 / seconds) : batch * 10;
+				batch = std::min(std::max(next, batch + 1), batch * 10);
+			}
+
+			std::vector<double> ns(samples);
+			for (int s = 0; s < samples; ++s)
+				ns[s] = TimeBatch(body, batch)*1e9 / batch;
+
+			BenchmarkResult r;
+			r.Name = c.Name;
+			r.Threads = WorkerCount();
+			r.Iterations = batch*samples;
+
+			double sum = 0.0;
+			for (double v : ns)
+				sum += v;
+			r.MeanNs = sum / samples;
+
+			double variance = 0.0;
+			for (double v : ns)
+				variance += (v - r.MeanNs)*(v - r.MeanNs);
+			r.StdDevNs = samples > 1 ? std::sqrt(variance / (samples - 1)) : 0.0;
+
+			std::sort(ns.begin(), ns.end());
+			r.MinNs = ns.front();
+			r.MedianNs = samples % 2 ? ns[samples / 2] : 0.5*(ns[samples / 2 - 1] + ns[samples / 2]);
+			r.ItemsPerSecond = c.ItemsPerIteration > 0.0 ? c.ItemsPerIteration*1e9 / r.MedianNs : 0.0;
+
+			std::printf("%-44s %7d %12.0f %12.0f %12.0f %7.1f%% %14.0f\n", r.Name.c_str(), r.Threads,
+				r.MeanNs, r.MedianNs, r.MinNs, 100.0*r.StdDevNs / r.MeanNs, r.ItemsPerSecond);
+			results.push_back(r);
+		}
+	}
+
+	return results;
+}
+
+bool WriteBenchmarkJson(const std::string& filename, const BenchmarkOptions& options,
+	const std::vector<BenchmarkResult>& results)
+{
+	std::ofstream out(filename);
+	if (!out)
+		return false;
+
+	out << std::fixed << std::setprecision(3);
+	out << "{\n  \"context\": {\n";
+	out << "    \"date\": ";
+	WriteJsonString(out, CurrentTimeUtc());
+	out << ",\n    \"platform\": ";
+	WriteJsonString(out, PlatformName());
+	out << ",\n    \"compiler\": ";
+	WriteJsonString(out, CompilerName());
+#if defined(NDEBUG)
+	out << ",\n    \"build\": \"release\"";
+#else
+	out << ",\n    \"build\": \"debug\"";
+#endif
+	out << ",\n    \"hardware_threads\": " << std::thread::hardware_concurrency();
+	out << ",\n    \"samples\": " << options.Samples;
+	out << ",\n    \"min_sample_seconds\": " << options.MinSampleSeconds;
+	out << "\n  },\n  \"benchmarks\": [";
+
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		const BenchmarkResult& r = results[i];
+		out << (i == 0 ? "\n" : ",\n") << "    {\"name\": ";
+		WriteJsonString(out, r.Name);
+		out << ", \"threads\": " << r.Threads
+			<< ", \"iterations\": " << r.Iterations
+			<< ", \"mean_ns\": " << r.MeanNs
+			<< ", \"median_ns\": " << r.MedianNs
+			<< ", \"min_ns\": " << r.MinNs
+			<< ", \"stddev_ns\": " << r.StdDevNs
+			<< ", \"items_per_second\": " << r.ItemsPerSecond << "}";
+	}
+
+	out << "\n  ]\n}\n";
+	return (bool)out;
+}
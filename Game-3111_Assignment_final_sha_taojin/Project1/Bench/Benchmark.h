@@ -0,0 +1,109 @@
+//***************************************************************************************
+// Benchmark.h
+//
+// Minimal harness for the headless microbenchmarks of the engine's CPU hot paths.  Each
+// group of cases lives in its own translation unit and is registered in the table in
+// BenchMain.cpp.  Results are printed as a table and written as JSON so runs can be
+// compared over time.
+//***************************************************************************************
+
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// One timed iteration of a case.
+typedef std::function<void()> BenchmarkBody;
+
+struct BenchmarkCase
+{
+	// "group/case/params", e.g. "waves/update/256x256".
+	std::string Name;
+
+	// Work items per iteration (vertices, queries, ...), for the throughput column.
+	double ItemsPerIteration = 0.0;
+
+	// Run once per entry of --threads instead of once with all workers.
+	bool ThreadSweep = false;
+
+	// Builds the case state outside the timed region and returns the body to time.  An
+	// empty body skips the case (e.g. missing input files).
+	std::function<BenchmarkBody()> Setup;
+};
+
+struct BenchmarkResult
+{
+	std::string Name;
+	int Threads = 0;
+	long long Iterations = 0;
+
+	// Nanoseconds per iteration over the samples.
+	double MeanNs = 0.0;
+	double MedianNs = 0.0;
+	double MinNs = 0.0;
+	double StdDevNs = 0.0;
+
+	double ItemsPerSecond = 0.0;
+};
+
+class BenchmarkRegistry
+{
+public:
+	void Add(const std::string& name, double itemsPerIteration, bool threadSweep,
+		const std::function<BenchmarkBody()>& setup)
+	{
+		BenchmarkCase c;
+		c.Name = name;
+		c.ItemsPerIteration = itemsPerIteration;
+		c.ThreadSweep = threadSweep;
+		c.Setup = setup;
+		mCases.push_back(c);
+	}
+
+	const std::vector<BenchmarkCase>& Cases()const { return mCases; }
+
+private:
+	std::vector<BenchmarkCase> mCases;
+};
+
+struct BenchmarkOptions
+{
+	// Only cases whose name contains Filter run.
+	std::string Filter;
+
+	// Worker counts for ThreadSweep cases; 0 means all workers.
+	std::vector<int> ThreadCounts = { 1, 2, 4, 0 };
+
+	int Samples = 15;
+	double MinSampleSeconds = 0.01;
+
+	// Where the DDS cases read their inputs, relative to the working directory like
+	// the demo's texture paths.
+	std::string TextureDirectory = "../../Textures";
+};
+
+// Keeps the compiler from discarding a result that is otherwise unused.
+void BenchmarkSink(const void* p);
+
+std::vector<BenchmarkResult> RunBenchmarks(const BenchmarkRegistry& registry, const BenchmarkOptions& options);
+
+// Writes the results plus a description of the machine and build.
+bool WriteBenchmarkJson(const std::string& filename, const BenchmarkOptions& options,
+	const std::vector<BenchmarkResult>& results);
+
+// Case groups, one per translation unit.
+void RegisterWavesBenchmarks(BenchmarkRegistry& registry, const BenchmarkOptions& options);
+void RegisterGeometryBenchmarks(BenchmarkRegistry& registry, const BenchmarkOptions& options);
+void RegisterCollisionBenchmarks(BenchmarkRegistry& registry, const BenchmarkOptions& options);
+void RegisterObjectConstantsBenchmarks(BenchmarkRegistry& registry, const BenchmarkOptions& options);
+void RegisterCameraBenchmarks(BenchmarkRegistry& registry, const BenchmarkOptions& options);
+void RegisterParticleBenchmarks(BenchmarkRegistry& registry, const BenchmarkOptions& options);
+void RegisterClothBenchmarks(BenchmarkRegistry& registry, const BenchmarkOptions& options);
+void RegisterSkinningBenchmarks(BenchmarkRegistry& registry, const BenchmarkOptions& options);
+void RegisterRigidBodyBenchmarks(BenchmarkRegistry& registry, const BenchmarkOptions& options);
+void RegisterMeshImportBenchmarks(BenchmarkRegistry& registry, const BenchmarkOptions& options);
+void RegisterMeshletBenchmarks(BenchmarkRegistry& registry, const BenchmarkOptions& options);
+void RegisterHalfEdgeBenchmarks(BenchmarkRegistry& registry, const BenchmarkOptions& options);
+void RegisterStaticBatchBenchmarks(BenchmarkRegistry& registry, const BenchmarkOptions& options);
+void RegisterDdsBenchmarks(BenchmarkRegistry& registry, const BenchmarkOptions& options);
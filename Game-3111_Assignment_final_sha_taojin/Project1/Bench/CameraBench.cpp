@@ -0,0 +1,50 @@
+//***************************************************************************************
+// CameraBench.cpp
+//
+// Camera view matrix rebuilds after mouse look and movement, plus the view-projection
+// product UpdateMainPassCB computes every frame.
+//***************************************************************************************
+
+#include "Benchmark.h"
+#include "../../Common/Camera.h"
+#include <memory>
+
+using namespace DirectX;
+
+void RegisterCameraBenchmarks(BenchmarkRegistry& registry, const BenchmarkOptions&)
+{
+	// One "item" is one simulated frame.
+	registry.Add("camera/update-view", 1.0, false, []()
+	{
+		auto camera = std::make_shared<Camera>();
+		camera->SetPosition(0.0f, 2.0f, -15.0f);
+		camera->SetLens(0.25f*MathHelper::Pi, 16.0f / 9.0f, 1.0f, 1000.0f);
+
+		return BenchmarkBody([camera]()
+		{
+			camera->Pitch(0.001f);
+			camera->RotateY(0.002f);
+			camera->Walk(0.01f);
+			camera->Strafe(0.005f);
+			camera->UpdateViewMatrix();
+
+			XMFLOAT4X4 viewProj;
+			XMStoreFloat4x4(&viewProj, XMMatrixMultiply(camera->GetView(), camera->GetProj()));
+			BenchmarkSink(&viewProj);
+		});
+	});
+
+	registry.Add("camera/set-lens", 1.0, false, []()
+	{
+		auto camera = std::make_shared<Camera>();
+		auto aspect = std::make_shared<float>(1.0f);
+
+		// OnResize rebuilds the projection; vary the aspect so nothing is hoisted.
+		return BenchmarkBody([camera, aspect]()
+		{
+			*aspect = *aspect < 3.0f ? *aspect + 0.001f : 1.0f;
+			camera->SetLens(0.25f*MathHelper::Pi, *aspect, 1.0f, 1000.0f);
+			BenchmarkSink(camera.get());
+		});
+	});
+}
@@ -0,0 +1,88 @@
+//***************************************************************************************
+// ClothBench.cpp
+//
+// ClothSystem::Update (integration, wind, colored constraint solve, normals) and the
+// vertex stream written from it, for rows of the demo's 20x13 flags.  Items are flags,
+// so the per-flag cost can be compared across the sizes.
+//***************************************************************************************
+
+#include "Benchmark.h"
+#include "../Project1/ClothSystem.h"
+#include "../Project1/ParallelFor.h"
+#include <memory>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+	struct ClothScene
+	{
+		ClothSystem Cloth;
+		std::vector<ClothVertex> Stream;
+	};
+
+	std::shared_ptr<ClothScene> BuildScene(int flagCount)
+	{
+		std::vector<ClothFlagDesc> flags(flagCount);
+		for (int k = 0; k < flagCount; ++k)
+		{
+			flags[k].Width = 4.0f;
+			flags[k].Height = 2.6f;
+			flags[k].Columns = 20;
+			flags[k].Rows = 13;
+			flags[k].Position = XMFLOAT3(8.0f*(k % 16), 10.5f, 8.0f*(k / 16));
+			flags[k].Yaw = 0.3f;
+		}
+
+		auto scene = std::make_shared<ClothScene>();
+		if (!scene->Cloth.Create(flags))
+			return nullptr;
+
+		// Let the flags unfold so the solver works on a settled, moving cloth.
+		for (int frame = 0; frame < 60; ++frame)
+			scene->Cloth.Update(1.0f / 60.0f);
+
+		scene->Stream.resize(scene->Cloth.VertexCount());
+		return scene;
+	}
+}
+
+void RegisterClothBenchmarks(BenchmarkRegistry& registry, const BenchmarkOptions&)
+{
+	for (int flagCount : { 24, 96, 384 })
+	{
+		const std::string size = std::to_string(flagCount) + "flags";
+
+		registry.Add("cloth/update/" + size, (double)flagCount, true, [=]()
+		{
+			std::shared_ptr<ClothScene> scene = BuildScene(flagCount);
+			if (scene == nullptr)
+				return BenchmarkBody();
+
+			return BenchmarkBody([scene]()
+			{
+				scene->Cloth.Update(1.0f / 60.0f);
+				BenchmarkSink(&scene->Cloth);
+			});
+		});
+
+		// Same chunks as UpdateClothVertices, into system memory.
+		registry.Add("cloth/stream/" + size, (double)flagCount, true, [=]()
+		{
+			std::shared_ptr<ClothScene> scene = BuildScene(flagCount);
+			if (scene == nullptr)
+				return BenchmarkBody();
+
+			return BenchmarkBody([scene]()
+			{
+				const ClothSystem& cloth = scene->Cloth;
+				ParallelForRange(cloth.VertexCount(), ClothSystem::ChunkSize, [&](int begin, int end)
+				{
+					cloth.WriteVertices(begin, end - begin, &scene->Stream[begin]);
+				});
+				BenchmarkSink(scene->Stream.data());
+			});
+		});
+	}
+}
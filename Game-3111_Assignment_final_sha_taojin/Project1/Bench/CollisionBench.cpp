@@ -0,0 +1,101 @@
+//***************************************************************************************
+// CollisionBench.cpp
+//
+// Point-in-box queries against maze walls laid out like BuildRenderItems does, using
+// the same test as TreeBillboardsApp::CheckCollision.
+//***************************************************************************************
+
+#include "Benchmark.h"
+#include <DirectXMath.h>
+#include <memory>
+#include <random>
+#include <utility>
+
+using namespace DirectX;
+
+namespace
+{
+	typedef std::vector<std::pair<XMVECTOR, XMVECTOR>> WallList;
+
+	// Walls of 4x10x4 units on a 4 unit grid, filling about 40% of the cells.
+	WallList BuildMazeWalls(int cells, std::mt19937& rng)
+	{
+		std::uniform_real_distribution<float> fill(0.0f, 1.0f);
+
+		XMVECTOR maze_offset = XMVectorSet(-55.0f, -3.0f, 35.0f, 0.0);
+		XMVECTOR box_min = XMVectorSet(-0.5f, -0.5f, -0.5f, 1.0);
+		XMVECTOR box_max = XMVectorSet(0.5f, 0.5f, 0.5f, 1.0);
+
+		WallList walls;
+		for (int j = 0; j < cells; ++j)
+		{
+			for (int i = 0; i < cells; ++i)
+			{
+				if (fill(rng) >= 0.4f)
+					continue;
+
+				XMVECTOR wall_pos = XMVectorAdd(XMVectorSet(i * 4.0f, 4.0f, -j * 4.0f, 0.0), maze_offset);
+				XMMATRIX mat = XMMatrixMultiply(XMMatrixScaling(4.0f, 10.0f, 4.0f),
+					XMMatrixTranslation(XMVectorGetX(wall_pos), XMVectorGetY(wall_pos), XMVectorGetZ(wall_pos)));
+				walls.push_back(std::make_pair(XMVector4Transform(box_min, mat), XMVector4Transform(box_max, mat)));
+			}
+		}
+		return walls;
+	}
+
+	bool CheckCollision(const WallList& walls, FXMVECTOR new_camera_pos)
+	{
+		for (const auto& bounds : walls)
+		{
+			XMVECTOR d_min = XMVectorSubtract(new_camera_pos, bounds.first);
+			XMVECTOR d_max = XMVectorSubtract(bounds.second, new_camera_pos);
+
+			bool greater_min = XMVectorGetX(d_min) >= 0.0 && XMVectorGetY(d_min) >= 0.0 && XMVectorGetZ(d_min) >= 0.0;
+			bool less_max = XMVectorGetX(d_max) >= 0.0 && XMVectorGetY(d_max) >= 0.0 && XMVectorGetZ(d_max) >= 0.0;
+
+			if (greater_min && less_max)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	struct CollisionState
+	{
+		WallList Walls;
+		std::vector<XMFLOAT3> Queries;
+		int Hits = 0;
+	};
+}
+
+void RegisterCollisionBenchmarks(BenchmarkRegistry& registry, const BenchmarkOptions&)
+{
+	const int queryCount = 1024;
+
+	for (int cells : { 16, 30, 64 })
+	{
+		registry.Add("collision/maze/" + std::to_string(cells) + "x" + std::to_string(cells),
+			(double)queryCount, false, [=]()
+		{
+			auto state = std::make_shared<CollisionState>();
+			std::mt19937 rng(1234);
+			state->Walls = BuildMazeWalls(cells, rng);
+
+			// Camera positions over the maze at eye height, most of them in free cells.
+			std::uniform_real_distribution<float> x(-57.0f, -57.0f + 4.0f*cells);
+			std::uniform_real_distribution<float> z(37.0f - 4.0f*cells, 37.0f);
+			for (int q = 0; q < queryCount; ++q)
+				state->Queries.push_back(XMFLOAT3(x(rng), 2.0f, z(rng)));
+
+			return BenchmarkBody([state]()
+			{
+				int hits = 0;
+				for (const XMFLOAT3& q : state->Queries)
+					hits += CheckCollision(state->Walls, XMLoadFloat3(&q)) ? 1 : 0;
+				state->Hits = hits;
+				BenchmarkSink(&state->Hits);
+			});
+		});
+	}
+}
@@ -0,0 +1,56 @@
+//***************************************************************************************
+// DdsBench.cpp
+//
+// DDS header validation and subresource layout (ParseDDSLayout, which the D3D12 loaders
+// share) for the demo's textures, read into memory before timing so no file I/O is measured.
+//***************************************************************************************
+
+#include "Benchmark.h"
+#include "../../Common/DDSLayout.h"
+#include <fstream>
+#include <memory>
+
+namespace
+{
+	bool ReadFileBytes(const std::string& filename, std::vector<uint8_t>& bytes)
+	{
+		std::ifstream fin(filename, std::ios::binary | std::ios::ate);
+		if (!fin)
+			return false;
+
+		bytes.resize((size_t)fin.tellg());
+		fin.seekg(0, std::ios::beg);
+		fin.read(reinterpret_cast<char*>(bytes.data()), bytes.size());
+		return (bool)fin;
+	}
+}
+
+void RegisterDdsBenchmarks(BenchmarkRegistry& registry, const BenchmarkOptions& options)
+{
+	const char* const textures[] =
+	{
+		"grass.dds", "water1.dds", "WireFence.dds", "bricks.dds",
+		"door.dds", "treeArray.dds", "grasscube1024.dds"
+	};
+
+	for (const char* name : textures)
+	{
+		const std::string filename = options.TextureDirectory + "/" + name;
+		for (size_t maxsize : { (size_t)0, (size_t)128 })
+		{
+			registry.Add(std::string("dds/layout/") + name + (maxsize ? "/max128" : ""), 1.0, false, [=]()
+			{
+				auto bytes = std::make_shared<std::vector<uint8_t>>();
+				if (!ReadFileBytes(filename, *bytes))
+					return BenchmarkBody();
+
+				return BenchmarkBody([bytes, maxsize]()
+				{
+					DirectX::DDSLayout layout;
+					DirectX::ParseDDSLayout(bytes->data(), bytes->size(), maxsize, layout);
+					BenchmarkSink(layout.Subresources.data());
+				});
+			});
+		}
+	}
+}
@@ -0,0 +1,60 @@
+//***************************************************************************************
+// GeometryBench.cpp
+//
+// GeometryGenerator's procedural meshes, including Subdivide on its own.
+//***************************************************************************************
+
+#include "Benchmark.h"
+#include "../../Common/GeometryGenerator.h"
+#include <memory>
+
+namespace
+{
+	typedef GeometryGenerator::MeshData(*CreateFunc)(GeometryGenerator& geoGen);
+
+	void AddCreate(BenchmarkRegistry& registry, const std::string& name, CreateFunc create)
+	{
+		// Vertex count of one mesh, for throughput.
+		GeometryGenerator geoGen;
+		const double vertexCount = (double)create(geoGen).Vertices.size();
+
+		registry.Add("geometry/" + name, vertexCount, false, [create]()
+		{
+			auto geoGen = std::make_shared<GeometryGenerator>();
+			return BenchmarkBody([geoGen, create]()
+			{
+				GeometryGenerator::MeshData mesh = create(*geoGen);
+				BenchmarkSink(mesh.Vertices.data());
+			});
+		});
+	}
+}
+
+void RegisterGeometryBenchmarks(BenchmarkRegistry& registry, const BenchmarkOptions&)
+{
+	AddCreate(registry, "box/subdiv3", [](GeometryGenerator& g) { return g.CreateBox(1.0f, 1.0f, 1.0f, 3); });
+	AddCreate(registry, "sphere/64x64", [](GeometryGenerator& g) { return g.CreateSphere(0.5f, 64, 64); });
+	AddCreate(registry, "geosphere/subdiv5", [](GeometryGenerator& g) { return g.CreateGeosphere(0.5f, 5); });
+	AddCreate(registry, "cylinder/64x64", [](GeometryGenerator& g) { return g.CreateCylinder(0.5f, 0.3f, 3.0f, 64, 64); });
+	AddCreate(registry, "grid/256x256", [](GeometryGenerator& g) { return g.CreateGrid(160.0f, 160.0f, 256, 256); });
+
+	// Subdivide on its own.  The base mesh is built once; each iteration copies it.
+	for (int level : { 1, 2, 3 })
+	{
+		GeometryGenerator geoGen;
+		GeometryGenerator::MeshData base = geoGen.CreateGeosphere(0.5f, 3);
+		const double triangleCount = (double)base.Indices32.size() / 3;
+
+		registry.Add("geometry/subdivide/x" + std::to_string(level), triangleCount, false, [base, level]()
+		{
+			auto geoGen = std::make_shared<GeometryGenerator>();
+			return BenchmarkBody([geoGen, base, level]()
+			{
+				GeometryGenerator::MeshData mesh = base;
+				for (int i = 0; i < level; ++i)
+					geoGen->Subdivide(mesh);
+				BenchmarkSink(mesh.Vertices.data());
+			});
+		});
+	}
+}
@@ -0,0 +1,65 @@
+//***************************************************************************************
+// HalfEdgeBench.cpp
+//
+// Half-edge mesh building, welding a generated sphere's seam and finding the twins, and
+// one step of each subdivision scheme, next to GeometryGenerator::Subdivide's midpoint
+// split of the same triangles.  Items are input faces.
+//***************************************************************************************
+
+#include "Benchmark.h"
+#include "../Project1/HalfEdgeMesh.h"
+#include <memory>
+
+void RegisterHalfEdgeBenchmarks(BenchmarkRegistry& registry, const BenchmarkOptions&)
+{
+	for (int size : { 32, 128 })
+	{
+		GeometryGenerator geoGen;
+		auto sphere = std::make_shared<GeometryGenerator::MeshData>(geoGen.CreateSphere(10.0f, size, size));
+		auto mesh = std::make_shared<HalfEdgeMesh>();
+		mesh->Build(*sphere);
+		const std::string name = "sphere" + std::to_string(size);
+		const double faceCount = (double)mesh->FaceCount();
+
+		registry.Add("halfedge/build/" + name, faceCount, true, [sphere]()
+		{
+			return BenchmarkBody([sphere]()
+			{
+				HalfEdgeMesh built;
+				built.Build(*sphere);
+				BenchmarkSink(built.HalfEdges().data());
+			});
+		});
+
+		registry.Add("halfedge/loop/" + name, faceCount, true, [mesh]()
+		{
+			return BenchmarkBody([mesh]()
+			{
+				HalfEdgeMesh subdivided;
+				mesh->SubdivideLoop(subdivided);
+				BenchmarkSink(subdivided.Positions().data());
+			});
+		});
+
+		registry.Add("halfedge/catmull-clark/" + name, faceCount, true, [mesh]()
+		{
+			return BenchmarkBody([mesh]()
+			{
+				HalfEdgeMesh subdivided;
+				mesh->SubdivideCatmullClark(subdivided);
+				BenchmarkSink(subdivided.Positions().data());
+			});
+		});
+
+		registry.Add("halfedge/midpoint/" + name, faceCount, false, [sphere]()
+		{
+			return BenchmarkBody([sphere]()
+			{
+				GeometryGenerator geoGen;
+				GeometryGenerator::MeshData subdivided = *sphere;
+				geoGen.Subdivide(subdivided);
+				BenchmarkSink(subdivided.Vertices.data());
+			});
+		});
+	}
+}
@@ -0,0 +1,199 @@
+//***************************************************************************************
+// MeshImportBench.cpp
+//
+// MeshImporter on a 512x512 height field terrain built in memory, once as OBJ text (v,
+// vt and vn per grid point, quad faces) and once as a .glb with the same data in binary
+// accessors.  The OBJ case is bound by number parsing and corner welding, the GLB case
+// by accessor conversion.  Items are input bytes, so items/s reads as bytes/s; both
+// cases sweep worker threads.
+//***************************************************************************************
+
+#include "Benchmark.h"
+#include "../Project1/MeshImporter.h"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace
+{
+	const int GridSize = 512;
+	const float GridSpacing = 0.25f;
+
+	float TerrainHeight(float x, float z)
+	{
+		return 3.0f*std::sin(0.11f*x)*std::cos(0.07f*z) + 0.5f*std::sin(0.9f*x + 0.4f*z);
+	}
+
+	struct GridPoint
+	{
+		float Pos[3];
+		float Normal[3];
+		float TexC[2];
+	};
+
+	std::vector<GridPoint> BuildGrid()
+	{
+		std::vector<GridPoint> points(GridSize*GridSize);
+		const float half = 0.5f*GridSpacing*(GridSize - 1);
+		for (int j = 0; j < GridSize; ++j)
+		{
+			for (int i = 0; i < GridSize; ++i)
+			{
+				const float x = i*GridSpacing - half;
+				const float z = j*GridSpacing - half;
+				const float dx = TerrainHeight(x + 0.01f, z) - TerrainHeight(x - 0.01f, z);
+				const float dz = TerrainHeight(x, z + 0.01f) - TerrainHeight(x, z - 0.01f);
+				const float length = std::sqrt(dx*dx + 0.0004f + dz*dz);
+
+				GridPoint& p = points[j*GridSize + i];
+				p.Pos[0] = x;
+				p.Pos[1] = TerrainHeight(x, z);
+				p.Pos[2] = z;
+				p.Normal[0] = -dx / length;
+				p.Normal[1] = 0.02f / length;
+				p.Normal[2] = -dz / length;
+				p.TexC[0] = (float)i / (GridSize - 1);
+				p.TexC[1] = (float)j / (GridSize - 1);
+			}
+		}
+		return points;
+	}
+
+	std::shared_ptr<std::string> BuildObj()
+	{
+		const std::vector<GridPoint> points = BuildGrid();
+		auto text = std::make_shared<std::string>();
+		text->reserve(points.size()*150);
+
+		char line[128];
+		auto append = [&](int length) { text->append(line, (std::size_t)length); };
+		for (const GridPoint& p : points)
+			append(std::snprintf(line, sizeof(line), "v %.5f %.5f %.5f\n", p.Pos[0], p.Pos[1], p.Pos[2]));
+		for (const GridPoint& p : points)
+			append(std::snprintf(line, sizeof(line), "vt %.6f %.6f\n", p.TexC[0], p.TexC[1]));
+		for (const GridPoint& p : points)
+			append(std::snprintf(line, sizeof(line), "vn %.6f %.6f %.6f\n", p.Normal[0], p.Normal[1], p.Normal[2]));
+
+		text->append("usemtl terrain\n");
+		for (int j = 0; j + 1 < GridSize; ++j)
+		{
+			for (int i = 0; i + 1 < GridSize; ++i)
+			{
+				const int a = j*GridSize + i + 1;
+				const int b = a + 1;
+				const int c = a + GridSize + 1;
+				const int d = a + GridSize;
+				append(std::snprintf(line, sizeof(line), "f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d\n",
+					a, a, a, d, d, d, c, c, c, b, b, b));
+			}
+		}
+		return text;
+	}
+
+	void AppendBytes(std::vector<std::uint8_t>& out, const void* data, std::size_t size)
+	{
+		const std::uint8_t* bytes = static_cast<const std::uint8_t*>(data);
+		out.insert(out.end(), bytes, bytes + size);
+	}
+
+	void AppendU32(std::vector<std::uint8_t>& out, std::uint32_t value)
+	{
+		AppendBytes(out, &value, sizeof(value));
+	}
+
+	std::shared_ptr<std::vector<std::uint8_t>> BuildGlb()
+	{
+		const std::vector<GridPoint> points = BuildGrid();
+		const std::size_t count = points.size();
+
+		// Three tightly packed attribute views and one index view.
+		std::vector<std::uint8_t> bin;
+		for (const GridPoint& p : points)
+			AppendBytes(bin, p.Pos, sizeof(p.Pos));
+		for (const GridPoint& p : points)
+			AppendBytes(bin, p.Normal, sizeof(p.Normal));
+		for (const GridPoint& p : points)
+			AppendBytes(bin, p.TexC, sizeof(p.TexC));
+		const std::size_t indexOffset = bin.size();
+		for (int j = 0; j + 1 < GridSize; ++j)
+		{
+			for (int i = 0; i + 1 < GridSize; ++i)
+			{
+				const std::uint32_t a = j*GridSize + i;
+				const std::uint32_t quad[6] = { a, a + GridSize, a + GridSize + 1, a, a + GridSize + 1, a + 1 };
+				AppendBytes(bin, quad, sizeof(quad));
+			}
+		}
+		const std::size_t indexCount = (bin.size() - indexOffset) / sizeof(std::uint32_t);
+
+		char json[2048];
+		const int jsonLength = std::snprintf(json, sizeof(json),
+			"{\"asset\":{\"version\":\"2.0\"},\"scene\":0,\"scenes\":[{\"nodes\":[0]}],\"nodes\":[{\"mesh\":0}],"
+			"\"meshes\":[{\"name\":\"terrain\",\"primitives\":[{\"attributes\":{\"POSITION\":0,\"NORMAL\":1,"
+			"\"TEXCOORD_0\":2},\"indices\":3}]}],\"buffers\":[{\"byteLength\":%zu}],\"bufferViews\":["
+			"{\"buffer\":0,\"byteOffset\":0,\"byteLength\":%zu},{\"buffer\":0,\"byteOffset\":%zu,\"byteLength\":%zu},"
+			"{\"buffer\":0,\"byteOffset\":%zu,\"byteLength\":%zu},{\"buffer\":0,\"byteOffset\":%zu,\"byteLength\":%zu}],"
+			"\"accessors\":[{\"bufferView\":0,\"componentType\":5126,\"count\":%zu,\"type\":\"VEC3\"},"
+			"{\"bufferView\":1,\"componentType\":5126,\"count\":%zu,\"type\":\"VEC3\"},"
+			"{\"bufferView\":2,\"componentType\":5126,\"count\":%zu,\"type\":\"VEC2\"},"
+			"{\"bufferView\":3,\"componentType\":5125,\"count\":%zu,\"type\":\"SCALAR\"}]}",
+			bin.size(), count*12, count*12, count*12, count*24, count*8, indexOffset, bin.size() - indexOffset,
+			count, count, count, indexCount);
+
+		// Chunks are 4-byte aligned: JSON padded with spaces, the binary with zeros.
+		std::string jsonChunk(json, (std::size_t)jsonLength);
+		jsonChunk.resize((jsonChunk.size() + 3) & ~(std::size_t)3, ' ');
+		bin.resize((bin.size() + 3) & ~(std::size_t)3, 0);
+
+		auto glb = std::make_shared<std::vector<std::uint8_t>>();
+		AppendU32(*glb, 0x46546C67u);
+		AppendU32(*glb, 2);
+		AppendU32(*glb, (std::uint32_t)(12 + 8 + jsonChunk.size() + 8 + bin.size()));
+		AppendU32(*glb, (std::uint32_t)jsonChunk.size());
+		AppendU32(*glb, 0x4E4F534Au);
+		AppendBytes(*glb, jsonChunk.data(), jsonChunk.size());
+		AppendU32(*glb, (std::uint32_t)bin.size());
+		AppendU32(*glb, 0x004E4942u);
+		AppendBytes(*glb, bin.data(), bin.size());
+		return glb;
+	}
+}
+
+void RegisterMeshImportBenchmarks(BenchmarkRegistry& registry, const BenchmarkOptions&)
+{
+	// The sizes are the cases' items, so the inputs are built here and shared by the
+	// thread counts.
+	const std::shared_ptr<std::string> obj = BuildObj();
+	const std::shared_ptr<std::vector<std::uint8_t>> glb = BuildGlb();
+
+	registry.Add("mesh/import/obj", (double)obj->size(), true, [=]()
+	{
+		auto importer = std::make_shared<MeshImporter>();
+		auto mesh = std::make_shared<ImportedMesh>();
+		if (!importer->ParseObj(obj->data(), obj->size(), *mesh))
+			return BenchmarkBody();
+
+		return BenchmarkBody([=]()
+		{
+			importer->ParseObj(obj->data(), obj->size(), *mesh);
+			BenchmarkSink(mesh->Vertices.data());
+		});
+	});
+
+	registry.Add("mesh/import/glb", (double)glb->size(), true, [=]()
+	{
+		auto importer = std::make_shared<MeshImporter>();
+		auto mesh = std::make_shared<ImportedMesh>();
+		if (!importer->ParseGlb(glb->data(), glb->size(), *mesh))
+			return BenchmarkBody();
+
+		return BenchmarkBody([=]()
+		{
+			importer->ParseGlb(glb->data(), glb->size(), *mesh);
+			BenchmarkSink(mesh->Vertices.data());
+		});
+	});
+}
@@ -0,0 +1,53 @@
+//***************************************************************************************
+// MeshletBench.cpp
+//
+// Meshlet building of the land and water grids, and culling them from a camera on the
+// land looking across it, the demo's usual view.
+//***************************************************************************************
+
+#include "Benchmark.h"
+#include "../Project1/Meshlets.h"
+#include <memory>
+
+using namespace DirectX;
+
+void RegisterMeshletBenchmarks(BenchmarkRegistry& registry, const BenchmarkOptions&)
+{
+	// The land's 50x50 grid and the water's 128x128 one.
+	for (int size : { 50, 128 })
+	{
+		GeometryGenerator geoGen;
+		auto grid = std::make_shared<GeometryGenerator::MeshData>(geoGen.CreateGrid(120.0f, 120.0f, size, size));
+		const std::string name = std::to_string(size) + "x" + std::to_string(size);
+		const double triangleCount = (double)grid->Indices32.size() / 3;
+
+		registry.Add("meshlets/build/" + name, triangleCount, false, [grid]()
+		{
+			return BenchmarkBody([grid]()
+			{
+				MeshletMesh mesh;
+				BuildMeshlets(MeshletBuildDesc(), *grid, mesh);
+				BenchmarkSink(mesh.Meshlets.data());
+			});
+		});
+
+		registry.Add("meshlets/cull/" + name, triangleCount, false, [grid]()
+		{
+			auto mesh = std::make_shared<MeshletMesh>();
+			BuildMeshlets(MeshletBuildDesc(), *grid, *mesh);
+			auto indices = std::make_shared<std::vector<std::uint32_t>>(mesh->IndexCount());
+
+			// Camera start position of the demo.
+			const XMVECTOR eye = XMVectorSet(-55.0f, 2.5f, -40.0f, 1.0f);
+			const XMMATRIX view = XMMatrixLookAtLH(eye, XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+			const XMMATRIX proj = XMMatrixPerspectiveFovLH(0.25f*XM_PI, 16.0f / 9.0f, 1.0f, 1000.0f);
+			const MeshletCullView cullView = MakeMeshletCullView(XMMatrixIdentity(), XMMatrixMultiply(view, proj), eye);
+
+			return BenchmarkBody([mesh, indices, cullView]()
+			{
+				CullMeshlets(*mesh, cullView, indices->data());
+				BenchmarkSink(indices->data());
+			});
+		});
+	}
+}
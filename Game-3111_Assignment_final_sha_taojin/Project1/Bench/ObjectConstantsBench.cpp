@@ -0,0 +1,96 @@
+//***************************************************************************************
+// ObjectConstantsBench.cpp
+//
+// Per-object constant packing as TreeBillboardsApp::UpdateObjectCBs does it: load the
+// world and texture transforms, transpose them and copy the constants into a buffer
+// of 256 byte aligned elements like UploadBuffer<ObjectConstants>.
+//***************************************************************************************
+
+#include "Benchmark.h"
+#include <DirectXMath.h>
+#include <cstring>
+#include <memory>
+#include <random>
+
+using namespace DirectX;
+
+namespace
+{
+	// Layout of ObjectConstants in FrameResource.h, which needs the D3D12 headers.
+	struct ObjectConstants
+	{
+		XMFLOAT4X4 World;
+		XMFLOAT4X4 TexTransform;
+	};
+
+	// The subset of RenderItem the update reads.
+	struct ObjectItem
+	{
+		XMFLOAT4X4 World;
+		XMFLOAT4X4 TexTransform;
+		int NumFramesDirty = 0;
+		unsigned int ObjCBIndex = 0;
+	};
+
+	struct ObjectConstantsState
+	{
+		std::vector<ObjectItem> Items;
+		std::vector<unsigned char> MappedData;
+		size_t ElementByteSize = 0;
+	};
+
+	// d3dUtil::CalcConstantBufferByteSize.
+	size_t CalcConstantBufferByteSize(size_t byteSize)
+	{
+		return (byteSize + 255) & ~(size_t)255;
+	}
+}
+
+void RegisterObjectConstantsBenchmarks(BenchmarkRegistry& registry, const BenchmarkOptions&)
+{
+	for (int itemCount : { 256, 1024, 8192 })
+	{
+		registry.Add("objectcb/update/" + std::to_string(itemCount), (double)itemCount, false, [=]()
+		{
+			auto state = std::make_shared<ObjectConstantsState>();
+			std::mt19937 rng(7);
+			std::uniform_real_distribution<float> coord(-100.0f, 100.0f);
+
+			state->Items.resize(itemCount);
+			for (int i = 0; i < itemCount; ++i)
+			{
+				ObjectItem& e = state->Items[i];
+				XMStoreFloat4x4(&e.World, XMMatrixMultiply(XMMatrixScaling(4.0f, 10.0f, 4.0f),
+					XMMatrixTranslation(coord(rng), coord(rng), coord(rng))));
+				XMStoreFloat4x4(&e.TexTransform, XMMatrixScaling(2.0f, 2.0f, 1.0f));
+				e.ObjCBIndex = (unsigned int)i;
+			}
+
+			state->ElementByteSize = CalcConstantBufferByteSize(sizeof(ObjectConstants));
+			state->MappedData.resize(state->ElementByteSize*itemCount);
+
+			return BenchmarkBody([state]()
+			{
+				for (auto& e : state->Items)
+				{
+					// Every item is dirty, the worst case (e.g. the first frames).
+					e.NumFramesDirty = 1;
+					if (e.NumFramesDirty > 0)
+					{
+						XMMATRIX world = XMLoadFloat4x4(&e.World);
+						XMMATRIX texTransform = XMLoadFloat4x4(&e.TexTransform);
+
+						ObjectConstants objConstants;
+						XMStoreFloat4x4(&objConstants.World, XMMatrixTranspose(world));
+						XMStoreFloat4x4(&objConstants.TexTransform, XMMatrixTranspose(texTransform));
+
+						std::memcpy(&state->MappedData[e.ObjCBIndex*state->ElementByteSize], &objConstants, sizeof(objConstants));
+
+						e.NumFramesDirty--;
+					}
+				}
+				BenchmarkSink(state->MappedData.data());
+			});
+		});
+	}
+}
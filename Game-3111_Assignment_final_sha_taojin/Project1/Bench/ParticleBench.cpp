@@ -0,0 +1,103 @@
+//***************************************************************************************
+// ParticleBench.cpp
+//
+// ParticleSystem::Update (integration, terrain and water collision, compaction) and the
+// point stream written from it, for pools of up to a million particles.  The particles
+// bounce and never expire, so every iteration works on the full pool.
+//***************************************************************************************
+
+#include "Benchmark.h"
+#include "../Project1/Heightmap.h"
+#include "../Project1/ParallelFor.h"
+#include "../Project1/ParticleSystem.h"
+#include "../Project1/Waves.h"
+#include <memory>
+#include <random>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+	struct ParticleScene
+	{
+		Heightmap Terrain;
+		std::unique_ptr<Waves> Water;
+		ParticleSystem Particles;
+		std::vector<ParticleVertex> Stream;
+	};
+
+	// The demo's land and waves with count particles bouncing over them.
+	std::shared_ptr<ParticleScene> BuildScene(int count)
+	{
+		auto scene = std::make_shared<ParticleScene>();
+		scene->Terrain.Resize(101, 101, 120.0f, 120.0f);
+		scene->Terrain.Bake(Heightmap::HillsHeight4);
+		scene->Water = std::make_unique<Waves>(128, 128, 1.0f, 0.03f, 4.0f, 0.2f);
+
+		std::vector<ParticlePoolDesc> pools(1);
+		pools[0].Name = "bench";
+		pools[0].Capacity = count;
+		pools[0].Collision = ParticleCollision::Bounce;
+		pools[0].Drag = 0.1f;
+		if (!scene->Particles.Create(pools))
+			return nullptr;
+
+		std::mt19937 rng(7);
+		std::uniform_real_distribution<float> xz(-60.0f, 60.0f);
+		std::uniform_real_distribution<float> height(0.0f, 40.0f);
+		std::uniform_real_distribution<float> speed(-3.0f, 3.0f);
+		for (int i = 0; i < count; ++i)
+		{
+			const float x = xz(rng);
+			const float z = xz(rng);
+			scene->Particles.Spawn(0, XMFLOAT3(x, scene->Terrain.Height(x, z) + height(rng), z),
+				XMFLOAT3(speed(rng), speed(rng), speed(rng)), 1e9f);
+		}
+
+		scene->Stream.resize(count);
+		return scene;
+	}
+}
+
+void RegisterParticleBenchmarks(BenchmarkRegistry& registry, const BenchmarkOptions&)
+{
+	for (int count : { 64 * 1024, 256 * 1024, 1024 * 1024 })
+	{
+		const std::string size = std::to_string(count / 1024) + "k";
+
+		registry.Add("particles/update/" + size, (double)count, true, [=]()
+		{
+			std::shared_ptr<ParticleScene> scene = BuildScene(count);
+			if (scene == nullptr)
+				return BenchmarkBody();
+
+			return BenchmarkBody([scene]()
+			{
+				ParticleColliders colliders;
+				colliders.Terrain = &scene->Terrain;
+				colliders.Water = scene->Water.get();
+				scene->Particles.Update(1.0f / 60.0f, colliders);
+				BenchmarkSink(&scene->Particles);
+			});
+		});
+
+		// Same blocks as UpdateParticleVertices, into system memory.
+		registry.Add("particles/stream/" + size, (double)count, true, [=]()
+		{
+			std::shared_ptr<ParticleScene> scene = BuildScene(count);
+			if (scene == nullptr)
+				return BenchmarkBody();
+
+			return BenchmarkBody([scene]()
+			{
+				const ParticleSystem& particles = scene->Particles;
+				ParallelForRange(particles.LiveCount(0), ParticleSystem::ChunkSize, [&](int begin, int end)
+				{
+					particles.WriteVertices(0, begin, end - begin, &scene->Stream[begin]);
+				});
+				BenchmarkSink(scene->Stream.data());
+			});
+		});
+	}
+}
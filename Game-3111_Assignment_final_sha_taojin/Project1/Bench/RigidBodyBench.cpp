@@ -0,0 +1,105 @@
+//***************************************************************************************
+// RigidBodyBench.cpp
+//
+// RigidBodyWorld::Step on piles of crates, balls and capsules falling into a walled pen
+// on flat ground: 1000 and 5000 bodies with sleeping off, so every body stays in the
+// broadphase, narrowphase and solver, and a settled pile of 5000 where the islands have
+// gone to sleep.  Items are bodies; the step cases also sweep worker threads.
+//***************************************************************************************
+
+#include "Benchmark.h"
+#include "../Project1/Heightmap.h"
+#include "../Project1/RigidBodyWorld.h"
+#include <memory>
+#include <random>
+#include <string>
+
+using namespace DirectX;
+
+namespace
+{
+	struct PhysicsScene
+	{
+		Heightmap Ground;
+		RigidBodyWorld World;
+	};
+
+	// bodyCount bodies in layers over a square pen, dropped from just above each other
+	// and stepped for warmupSteps so the measured steps run on a settling pile.
+	std::shared_ptr<PhysicsScene> BuildScene(int bodyCount, bool allowSleeping, int warmupSteps)
+	{
+		auto scene = std::make_shared<PhysicsScene>();
+		scene->Ground.Resize(2, 2, 200.0f, 200.0f);
+		scene->Ground.SetHeights(std::vector<float>(4, 0.0f));
+
+		RigidBodyWorld& world = scene->World;
+		world.Settings().AllowSleeping = allowSleeping;
+		world.SetTerrain(&scene->Ground);
+
+		const int side = 32;
+		const float spacing = 1.6f;
+		const float half = 0.5f*side*spacing;
+		world.AddStaticBox(XMFLOAT3(-half - 1.0f, 5.0f, 0.0f), XMFLOAT3(1.0f, 5.0f, half + 2.0f));
+		world.AddStaticBox(XMFLOAT3(half + 1.0f, 5.0f, 0.0f), XMFLOAT3(1.0f, 5.0f, half + 2.0f));
+		world.AddStaticBox(XMFLOAT3(0.0f, 5.0f, -half - 1.0f), XMFLOAT3(half, 5.0f, 1.0f));
+		world.AddStaticBox(XMFLOAT3(0.0f, 5.0f, half + 1.0f), XMFLOAT3(half, 5.0f, 1.0f));
+
+		std::mt19937 rng(42);
+		std::uniform_real_distribution<float> tilt(0.0f, 0.3f);
+		std::uniform_real_distribution<float> yaw(0.0f, XM_PI);
+		for (int k = 0; k < bodyCount; ++k)
+		{
+			const int layer = k / (side*side);
+			const int row = (k / side) % side;
+			const int column = k % side;
+
+			RigidBodyDesc desc;
+			switch (k % 8)
+			{
+			case 6:
+				desc.Shape = RigidShape::Sphere(0.5f);
+				break;
+			case 7:
+				desc.Shape = RigidShape::Capsule(0.35f, 0.35f);
+				break;
+			default:
+				desc.Shape = RigidShape::Box(XMFLOAT3(0.5f, 0.5f, 0.5f));
+				break;
+			}
+			desc.Position = XMFLOAT3(-half + spacing*(column + 0.5f), 1.0f + 1.5f*layer, -half + spacing*(row + 0.5f));
+			XMStoreFloat4(&desc.Orientation, XMQuaternionRotationRollPitchYaw(tilt(rng), yaw(rng), tilt(rng)));
+			world.AddBody(desc);
+		}
+
+		for (int step = 0; step < warmupSteps; ++step)
+			world.Step(world.Settings().TimeStep);
+		return scene;
+	}
+}
+
+void RegisterRigidBodyBenchmarks(BenchmarkRegistry& registry, const BenchmarkOptions&)
+{
+	for (int bodyCount : { 1000, 5000 })
+	{
+		const std::string name = "physics/step/" + std::to_string(bodyCount) + "bodies";
+		registry.Add(name, (double)bodyCount, true, [=]()
+		{
+			std::shared_ptr<PhysicsScene> scene = BuildScene(bodyCount, false, 60);
+			return BenchmarkBody([scene]()
+			{
+				scene->World.Step(scene->World.Settings().TimeStep);
+				BenchmarkSink(&scene->World.Stats());
+			});
+		});
+	}
+
+	registry.Add("physics/step/5000bodies/asleep", 5000.0, false, []()
+	{
+		std::shared_ptr<PhysicsScene> scene = BuildScene(5000, true, 600);
+		return BenchmarkBody([scene]()
+		{
+			scene->World.Step(scene->World.Settings().TimeStep);
+			BenchmarkSink(&scene->World.Stats());
+		});
+	});
+}
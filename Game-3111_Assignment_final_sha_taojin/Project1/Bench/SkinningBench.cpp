@@ -0,0 +1,107 @@
+//***************************************************************************************
+// SkinningBench.cpp
+//
+// The crowd animation path for 1000 of the demo's characters: clip sampling alone, and
+// SkinnedCrowd::Skin (sample, local-to-model, palette, skin) with linear-blend and
+// dual-quaternion skinning on the AVX2 and XMVECTOR kernels.  Items are characters.
+//***************************************************************************************
+
+#include "Benchmark.h"
+#include "../Project1/Humanoid.h"
+#include "../Project1/Skinning.h"
+#include <memory>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+	const int CrowdSize = 1000;
+
+	struct CrowdScene
+	{
+		HumanoidAsset Humanoid;
+		SkinnedCrowd Crowd;
+		std::vector<SkinnedVertex> Stream;
+	};
+
+	// CrowdSize characters in a square, every other one walking, at staggered times.
+	std::shared_ptr<CrowdScene> BuildScene(SkinningMethod method)
+	{
+		auto scene = std::make_shared<CrowdScene>();
+		if (!BuildHumanoid(2.4f, scene->Humanoid))
+			return nullptr;
+
+		const HumanoidAsset& humanoid = scene->Humanoid;
+		SkinnedMesh mesh;
+		if (!mesh.Create(humanoid.Vertices, humanoid.Indices, humanoid.Bones.JointCount()) ||
+			!scene->Crowd.Create(humanoid.Bones, mesh, humanoid.Clips, CrowdSize))
+			return nullptr;
+
+		for (int c = 0; c < CrowdSize; ++c)
+		{
+			CrowdCharacter& character = scene->Crowd.Character(c);
+			XMStoreFloat4x4(&character.World, XMMatrixRotationY(0.1f*c) *
+				XMMatrixTranslation(3.0f*(c % 32), 0.0f, 3.0f*(c / 32)));
+			character.Clip = c % 2 == 0 ? HumanoidWalk : HumanoidIdle;
+			character.Time = 0.037f*c;
+		}
+
+		scene->Crowd.SetMethod(method);
+		scene->Stream.resize(scene->Crowd.VertexCount());
+		return scene;
+	}
+}
+
+void RegisterSkinningBenchmarks(BenchmarkRegistry& registry, const BenchmarkOptions&)
+{
+	for (ClipInterpolation interpolation : { ClipInterpolation::Nlerp, ClipInterpolation::Slerp })
+	{
+		const std::string name = interpolation == ClipInterpolation::Nlerp ? "nlerp" : "slerp";
+
+		registry.Add("animation/sample/" + name, (double)CrowdSize, false, [=]()
+		{
+			auto humanoid = std::make_shared<HumanoidAsset>();
+			if (!BuildHumanoid(2.4f, *humanoid))
+				return BenchmarkBody();
+
+			auto pose = std::make_shared<LocalPose>();
+			return BenchmarkBody([humanoid, pose, interpolation]()
+			{
+				const AnimationClip& walk = humanoid->Clips[HumanoidWalk];
+				for (int c = 0; c < CrowdSize; ++c)
+					walk.Sample(0.037f*c, interpolation, *pose);
+				BenchmarkSink(pose.get());
+			});
+		});
+	}
+
+	for (SkinningMethod method : { SkinningMethod::LinearBlend, SkinningMethod::DualQuaternion })
+	{
+		for (bool avx2 : { true, false })
+		{
+			const std::string name = std::string("skinning/crowd/") +
+				(method == SkinningMethod::LinearBlend ? "lbs/" : "dq/") + (avx2 ? "avx2/" : "scalar/") +
+				std::to_string(CrowdSize) + "chars";
+
+			registry.Add(name, (double)CrowdSize, true, [=]()
+			{
+				SkinnedMesh::SetAllowAvx2(true);
+				if (avx2 && !SkinnedMesh::UsesAvx2())
+					return BenchmarkBody();
+
+				std::shared_ptr<CrowdScene> scene = BuildScene(method);
+				if (scene == nullptr)
+					return BenchmarkBody();
+
+				return BenchmarkBody([scene, avx2]()
+				{
+					SkinnedMesh::SetAllowAvx2(avx2);
+					scene->Crowd.Skin(scene->Stream.data());
+					SkinnedMesh::SetAllowAvx2(true);
+					BenchmarkSink(scene->Stream.data());
+				});
+			});
+		}
+	}
+}
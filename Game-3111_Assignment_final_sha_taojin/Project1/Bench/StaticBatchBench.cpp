@@ -0,0 +1,108 @@
+//***************************************************************************************
+// StaticBatchBench.cpp
+//
+// Static batching of a field of wall blocks, a stand-in for the maze: building the merged
+// chunks, culling them from the demo's start camera, and picking against them.  Items are
+// source items for building and chunks for culling.
+//***************************************************************************************
+
+#include "Benchmark.h"
+#include "../Project1/Meshlets.h"
+#include "../Project1/StaticBatches.h"
+#include <memory>
+
+using namespace DirectX;
+
+namespace
+{
+	struct BlockField
+	{
+		std::vector<StaticBatchVertex> Vertices;
+		std::vector<std::uint32_t> Indices;
+		std::vector<StaticBatchSource> Sources;
+	};
+
+	// size x size unit boxes scaled into 4x4x2 blocks on a 4 unit grid centered on the
+	// origin, alternating between two keys like the maze's walls and floor tiles.
+	std::shared_ptr<BlockField> MakeBlockField(int size)
+	{
+		auto field = std::make_shared<BlockField>();
+		GeometryGenerator geoGen;
+		GeometryGenerator::MeshData box = geoGen.CreateBox(1.0f, 1.0f, 1.0f, 0);
+		for (const GeometryGenerator::Vertex& v : box.Vertices)
+			field->Vertices.push_back({ v.Position, v.Normal, v.TexC });
+		field->Indices = box.Indices32;
+
+		const float offset = -2.0f * (float)size;
+		for (int z = 0; z < size; ++z)
+		{
+			for (int x = 0; x < size; ++x)
+			{
+				StaticBatchSource source;
+				source.Vertices = field->Vertices.data();
+				source.Indices = field->Indices.data();
+				source.Indices32 = true;
+				source.IndexCount = (std::uint32_t)field->Indices.size();
+				XMStoreFloat4x4(&source.World, XMMatrixScaling(4.0f, 2.0f, 4.0f) *
+					XMMatrixTranslation(offset + 4.0f * (float)x, 1.0f, offset + 4.0f * (float)z));
+				source.Key = (std::uint32_t)((x + z) & 1);
+				field->Sources.push_back(source);
+			}
+		}
+		return field;
+	}
+}
+
+void RegisterStaticBatchBenchmarks(BenchmarkRegistry& registry, const BenchmarkOptions&)
+{
+	for (int size : { 16, 64 })
+	{
+		auto field = MakeBlockField(size);
+		const std::string name = std::to_string(size) + "x" + std::to_string(size);
+
+		registry.Add("staticbatch/build/" + name, (double)field->Sources.size(), true, [field]()
+		{
+			return BenchmarkBody([field]()
+			{
+				StaticBatches batches;
+				BuildStaticBatches(StaticBatchDesc(), field->Sources.data(), (std::uint32_t)field->Sources.size(), batches);
+				BenchmarkSink(batches.Vertices.data());
+			});
+		});
+
+		auto batches = std::make_shared<StaticBatches>();
+		BuildStaticBatches(StaticBatchDesc(), field->Sources.data(), (std::uint32_t)field->Sources.size(), *batches);
+
+		registry.Add("staticbatch/cull/" + name, (double)batches->Chunks.size(), false, [batches]()
+		{
+			// Camera start position of the demo.
+			const XMVECTOR eye = XMVectorSet(-55.0f, 2.5f, -40.0f, 1.0f);
+			const XMMATRIX view = XMMatrixLookAtLH(eye, XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+			const XMMATRIX proj = XMMatrixPerspectiveFovLH(0.25f*XM_PI, 16.0f / 9.0f, 1.0f, 1000.0f);
+			const MeshletCullView cullView = MakeMeshletCullView(XMMatrixIdentity(), XMMatrixMultiply(view, proj), eye);
+			auto visible = std::make_shared<std::vector<std::uint32_t>>();
+			visible->reserve(batches->Chunks.size());
+
+			return BenchmarkBody([batches, cullView, visible]()
+			{
+				visible->clear();
+				for (std::uint32_t c = 0; c < (std::uint32_t)batches->Chunks.size(); ++c)
+				{
+					if (StaticChunkVisible(batches->Chunks[c], cullView.Planes))
+						visible->push_back(c);
+				}
+				BenchmarkSink(visible->data());
+			});
+		});
+
+		registry.Add("staticbatch/pick/" + name, 1.0, false, [batches]()
+		{
+			return BenchmarkBody([batches]()
+			{
+				StaticBatchHit hit;
+				PickStaticBatches(*batches, XMVectorSet(-55.0f, 2.5f, -40.0f, 1.0f), XMVectorSet(55.0f, -1.5f, 40.0f, 0.0f), hit);
+				BenchmarkSink(&hit);
+			});
+		});
+	}
+}
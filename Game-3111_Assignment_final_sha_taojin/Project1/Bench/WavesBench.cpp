@@ -0,0 +1,33 @@
+//***************************************************************************************
+// WavesBench.cpp
+//
+// Waves::Update (height integration plus normals) across grid sizes and worker counts.
+//***************************************************************************************
+
+#include "Benchmark.h"
+#include "../Project1/Waves.h"
+#include <memory>
+
+void RegisterWavesBenchmarks(BenchmarkRegistry& registry, const BenchmarkOptions&)
+{
+	// Same constants as the demo's 128x128 grid.
+	const float timeStep = 0.03f;
+
+	for (int size : { 128, 256, 512, 1024 })
+	{
+		registry.Add("waves/update/" + std::to_string(size) + "x" + std::to_string(size),
+			(double)size*size, true, [=]()
+		{
+			auto waves = std::make_shared<Waves>(size, size, 1.0f, timeStep, 4.0f, 0.2f);
+			for (int k = 0; k < 16; ++k)
+				waves->Disturb(4 + k*(size - 8) / 16, size / 2, 0.5f);
+
+			// A dt of one time step advances the simulation on every call.
+			return BenchmarkBody([waves, timeStep]()
+			{
+				waves->Update(timeStep);
+				BenchmarkSink(&waves->Position(0));
+			});
+		});
+	}
+}
@@ -0,0 +1,496 @@
+#include "AllocationTracker.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <dbghelp.h>
+#pragma comment(lib, "dbghelp.lib")
+#elif defined(__GLIBC__)
+#include <execinfo.h>
+#endif
+
+const int AllocationTracker::MaxTags;
+const int AllocationTracker::MaxThreads;
+const int AllocationTracker::MaxSamples;
+const int AllocationTracker::MaxSampleFrames;
+const int AllocationTracker::UntaggedTag;
+const int AllocationTracker::IgnoredTag;
+
+namespace
+{
+	// Everything here is reached from operator new, possibly before main and on any
+	// thread, so it is constant initialized and never allocates.  Each thread owns a
+	// slot of counters; threads past MaxThreads share the last one, which is why the
+	// counters are atomic even though a slot normally has a single writer.
+	struct ThreadCounters
+	{
+		std::atomic<std::uint64_t> Allocations[AllocationTracker::MaxTags];
+		std::atomic<std::uint64_t> Bytes[AllocationTracker::MaxTags];
+		std::atomic<std::uint64_t> Frees[AllocationTracker::MaxTags];
+	};
+
+	ThreadCounters gThreads[AllocationTracker::MaxThreads];
+	std::atomic<int> gThreadCount(0);
+
+	thread_local int tSlot = -1;
+	thread_local int tTag = AllocationTracker::UntaggedTag;
+	thread_local bool tInsideTracker = false;
+
+	// Tag names are string literals owned by the caller.
+	const char* gTagNames[AllocationTracker::MaxTags] = { "untagged", "tracker" };
+	std::atomic<int> gTagCount(2);
+	std::atomic_flag gTagLock = ATOMIC_FLAG_INIT;
+
+	std::atomic<std::uint32_t> gSampleInterval(0);
+	std::atomic<std::uint64_t> gAllocationIndex(0);
+	AllocationTracker::Sample gSamples[AllocationTracker::MaxSamples];
+	std::uint64_t gSampleCount = 0;
+	std::atomic_flag gSampleLock = ATOMIC_FLAG_INIT;
+
+	class SpinLock
+	{
+	public:
+		explicit SpinLock(std::atomic_flag& flag) : mFlag(flag)
+		{
+			while (mFlag.test_and_set(std::memory_order_acquire))
+				;
+		}
+		~SpinLock() { mFlag.clear(std::memory_order_release); }
+
+	private:
+		std::atomic_flag& mFlag;
+	};
+
+	ThreadCounters& CurrentThreadCounters()
+	{
+		if (tSlot < 0)
+			tSlot = std::min(gThreadCount.fetch_add(1, std::memory_order_relaxed), AllocationTracker::MaxThreads - 1);
+		return gThreads[tSlot];
+	}
+
+	// The first frames of a stack are the tracker's own, down to operator new; how many
+	// depends on inlining, so they are kept rather than skipped by a guessed count.
+	int CaptureStack(void** frames, int maxFrames)
+	{
+#if defined(_WIN32)
+		return (int)RtlCaptureStackBackTrace(0, (DWORD)maxFrames, frames, nullptr);
+#elif defined(__GLIBC__)
+		return backtrace(frames, maxFrames);
+#else
+		(void)frames;
+		(void)maxFrames;
+		return 0;
+#endif
+	}
+
+	void RecordSample(int tag, std::size_t size)
+	{
+		AllocationTracker::Sample sample;
+		sample.Tag = tag;
+		sample.Size = size;
+		sample.FrameCount = CaptureStack(sample.Frames, AllocationTracker::MaxSampleFrames);
+
+		SpinLock lock(gSampleLock);
+		sample.Sequence = gSampleCount++;
+		gSamples[sample.Sequence % AllocationTracker::MaxSamples] = sample;
+	}
+
+	void CountAllocation(std::size_t size)
+	{
+		if (tInsideTracker)
+			return;
+
+		ThreadCounters& counters = CurrentThreadCounters();
+		const int tag = tTag;
+		counters.Allocations[tag].fetch_add(1, std::memory_order_relaxed);
+		counters.Bytes[tag].fetch_add(size, std::memory_order_relaxed);
+
+		const std::uint32_t interval = gSampleInterval.load(std::memory_order_relaxed);
+		if (interval != 0 && gAllocationIndex.fetch_add(1, std::memory_order_relaxed) % interval == 0)
+		{
+			// Capturing the stack may allocate (symbol tables on first use).
+			tInsideTracker = true;
+			RecordSample(tag, size);
+			tInsideTracker = false;
+		}
+	}
+
+	void CountFree(void* p)
+	{
+		if (p == nullptr || tInsideTracker)
+			return;
+		CurrentThreadCounters().Frees[tTag].fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void* TrackedAlloc(std::size_t size)
+	{
+		void* p = std::malloc(size == 0 ? 1 : size);
+		if (p != nullptr)
+			CountAllocation(size);
+		return p;
+	}
+
+	void TrackedFree(void* p)
+	{
+		CountFree(p);
+		std::free(p);
+	}
+
+#if defined(__cpp_aligned_new)
+	void* TrackedAlignedAlloc(std::size_t size, std::size_t alignment)
+	{
+		if (size == 0)
+			size = 1;
+#if defined(_MSC_VER)
+		void* p = _aligned_malloc(size, alignment);
+#else
+		void* p = nullptr;
+		if (posix_memalign(&p, std::max(alignment, sizeof(void*)), size) != 0)
+			p = nullptr;
+#endif
+		if (p != nullptr)
+			CountAllocation(size);
+		return p;
+	}
+
+	void TrackedAlignedFree(void* p)
+	{
+		CountFree(p);
+#if defined(_MSC_VER)
+		_aligned_free(p);
+#else
+		std::free(p);
+#endif
+	}
+#endif
+}
+
+int AllocationTracker::RegisterTag(const char* name)
+{
+	SpinLock lock(gTagLock);
+
+	const int count = gTagCount.load(std::memory_order_relaxed);
+	for (int i = 0; i < count; ++i)
+	{
+		if (std::strcmp(gTagNames[i], name) == 0)
+			return i;
+	}
+	if (count == MaxTags)
+		return UntaggedTag;
+
+	gTagNames[count] = name;
+	gTagCount.store(count + 1, std::memory_order_release);
+	return count;
+}
+
+const char* AllocationTracker::TagName(int tag)
+{
+	return tag >= 0 && tag < TagCount() ? gTagNames[tag] : "?";
+}
+
+int AllocationTracker::TagCount()
+{
+	return gTagCount.load(std::memory_order_acquire);
+}
+
+void AllocationTracker::SetSampleInterval(std::uint32_t interval)
+{
+	gSampleInterval.store(interval, std::memory_order_relaxed);
+}
+
+void AllocationTracker::Snapshot(AllocationCounts counts[MaxTags])
+{
+	const int threads = std::min(gThreadCount.load(std::memory_order_relaxed), MaxThreads);
+	for (int tag = 0; tag < MaxTags; ++tag)
+	{
+		AllocationCounts c;
+		for (int t = 0; t < threads; ++t)
+		{
+			c.Allocations += gThreads[t].Allocations[tag].load(std::memory_order_relaxed);
+			c.Bytes += gThreads[t].Bytes[tag].load(std::memory_order_relaxed);
+			c.Frees += gThreads[t].Frees[tag].load(std::memory_order_relaxed);
+		}
+		counts[tag] = c;
+	}
+}
+
+std::uint64_t AllocationTracker::SampleSequence()
+{
+	SpinLock lock(gSampleLock);
+	return gSampleCount;
+}
+
+int AllocationTracker::CopySamples(Sample* samples, int maxCount)
+{
+	SpinLock lock(gSampleLock);
+
+	const std::uint64_t available = std::min<std::uint64_t>(gSampleCount, MaxSamples);
+	const int count = (int)std::min<std::uint64_t>(available, (std::uint64_t)std::max(maxCount, 0));
+	for (int i = 0; i < count; ++i)
+		samples[i] = gSamples[(gSampleCount - count + i) % MaxSamples];
+	return count;
+}
+
+std::string AllocationTracker::DescribeAddress(void* address)
+{
+	AllocationScope scope(IgnoredTag);
+
+	char text[512];
+	std::snprintf(text, sizeof(text), "%p", address);
+
+#if defined(_WIN32)
+	static bool symbolsLoaded = false;
+	HANDLE process = GetCurrentProcess();
+	if (!symbolsLoaded)
+	{
+		SymSetOptions(SYMOPT_DEFERRED_LOADS | SYMOPT_LOAD_LINES | SYMOPT_UNDNAME);
+		symbolsLoaded = SymInitialize(process, nullptr, TRUE) != FALSE;
+	}
+
+	alignas(SYMBOL_INFO) char buffer[sizeof(SYMBOL_INFO) + 256];
+	SYMBOL_INFO* symbol = reinterpret_cast<SYMBOL_INFO*>(buffer);
+	symbol->SizeOfStruct = sizeof(SYMBOL_INFO);
+	symbol->MaxNameLen = 255;
+
+	DWORD64 displacement = 0;
+	if (symbolsLoaded && SymFromAddr(process, (DWORD64)address, &displacement, symbol))
+	{
+		IMAGEHLP_LINE64 line = {};
+		line.SizeOfStruct = sizeof(line);
+		DWORD lineDisplacement = 0;
+		if (SymGetLineFromAddr64(process, (DWORD64)address, &lineDisplacement, &line))
+			std::snprintf(text, sizeof(text), "%s (%s:%lu)", symbol->Name, line.FileName, line.LineNumber);
+		else
+			std::snprintf(text, sizeof(text), "%s+0x%llx", symbol->Name, (unsigned long long)displacement);
+	}
+#elif defined(__GLIBC__)
+	char** symbols = backtrace_symbols(&address, 1);
+	if (symbols != nullptr)
+	{
+		std::snprintf(text, sizeof(text), "%s", symbols[0]);
+		std::free(symbols);
+	}
+#endif
+
+	return text;
+}
+
+AllocationScope::AllocationScope(int tag)
+	: mPreviousTag(tTag)
+{
+	tTag = tag >= 0 && tag < AllocationTracker::MaxTags ? tag : AllocationTracker::UntaggedTag;
+}
+
+AllocationScope::~AllocationScope()
+{
+	tTag = mPreviousTag;
+}
+
+AllocationFrameCounter::AllocationFrameCounter()
+{
+	AllocationTracker::Snapshot(mPrevious);
+	mFrameEndSample = AllocationTracker::SampleSequence();
+}
+
+void AllocationFrameCounter::EndFrame()
+{
+	AllocationCounts current[AllocationTracker::MaxTags];
+	AllocationTracker::Snapshot(current);
+
+	for (int tag = 0; tag < AllocationTracker::MaxTags; ++tag)
+	{
+		mFrame[tag].Allocations = current[tag].Allocations - mPrevious[tag].Allocations;
+		mFrame[tag].Bytes = current[tag].Bytes - mPrevious[tag].Bytes;
+		mFrame[tag].Frees = current[tag].Frees - mPrevious[tag].Frees;
+		mPrevious[tag] = current[tag];
+	}
+
+	mFrameFirstSample = mFrameEndSample;
+	mFrameEndSample = AllocationTracker::SampleSequence();
+	++mFrameIndex;
+}
+
+AllocationCounts AllocationFrameCounter::FrameTotal()const
+{
+	AllocationCounts total;
+	for (int tag = 0; tag < AllocationTracker::MaxTags; ++tag)
+	{
+		if (tag == AllocationTracker::IgnoredTag)
+			continue;
+		total.Allocations += mFrame[tag].Allocations;
+		total.Bytes += mFrame[tag].Bytes;
+		total.Frees += mFrame[tag].Frees;
+	}
+	return total;
+}
+
+bool AllocationFrameCounter::CheckZeroAllocations(std::uint64_t warmupFrames)const
+{
+	return mFrameIndex <= warmupFrames || FrameTotal().Allocations == 0;
+}
+
+std::string AllocationFrameCounter::Report()const
+{
+	AllocationScope scope(AllocationTracker::IgnoredTag);
+
+	char line[256];
+	std::string report;
+
+	const AllocationCounts total = FrameTotal();
+	std::snprintf(line, sizeof(line), "frame %llu: %llu allocations, %llu bytes, %llu frees\n",
+		(unsigned long long)(mFrameIndex - 1), (unsigned long long)total.Allocations,
+		(unsigned long long)total.Bytes, (unsigned long long)total.Frees);
+	report += line;
+
+	for (int tag = 0; tag < AllocationTracker::TagCount(); ++tag)
+	{
+		const AllocationCounts& c = mFrame[tag];
+		if (tag == AllocationTracker::IgnoredTag || (c.Allocations == 0 && c.Frees == 0))
+			continue;
+		std::snprintf(line, sizeof(line), "  %-20s %8llu allocations %10llu bytes %8llu frees\n",
+			AllocationTracker::TagName(tag), (unsigned long long)c.Allocations,
+			(unsigned long long)c.Bytes, (unsigned long long)c.Frees);
+		report += line;
+	}
+
+	AllocationTracker::Sample samples[AllocationTracker::MaxSamples];
+	const int sampleCount = AllocationTracker::CopySamples(samples, AllocationTracker::MaxSamples);
+	for (int i = 0; i < sampleCount; ++i)
+	{
+		const AllocationTracker::Sample& s = samples[i];
+		if (s.Sequence < mFrameFirstSample || s.Sequence >= mFrameEndSample || s.Tag == AllocationTracker::IgnoredTag)
+			continue;
+
+		std::snprintf(line, sizeof(line), "  sampled %zu bytes in %s:\n", s.Size, AllocationTracker::TagName(s.Tag));
+		report += line;
+		for (int f = 0; f < s.FrameCount; ++f)
+			report += "    " + AllocationTracker::DescribeAddress(s.Frames[f]) + "\n";
+	}
+
+	return report;
+}
+
+#if !defined(DISABLE_ALLOCATION_TRACKING)
+
+void* operator new(std::size_t size)
+{
+	void* p = TrackedAlloc(size);
+	if (p == nullptr)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[](std::size_t size)
+{
+	void* p = TrackedAlloc(size);
+	if (p == nullptr)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+	return TrackedAlloc(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+	return TrackedAlloc(size);
+}
+
+void operator delete(void* p) noexcept
+{
+	TrackedFree(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+	TrackedFree(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+	TrackedFree(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept
+{
+	TrackedFree(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+	TrackedFree(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept
+{
+	TrackedFree(p);
+}
+
+#if defined(__cpp_aligned_new)
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+	void* p = TrackedAlignedAlloc(size, (std::size_t)alignment);
+	if (p == nullptr)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment)
+{
+	void* p = TrackedAlignedAlloc(size, (std::size_t)alignment);
+	if (p == nullptr)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	return TrackedAlignedAlloc(size, (std::size_t)alignment);
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	return TrackedAlignedAlloc(size, (std::size_t)alignment);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+	TrackedAlignedFree(p);
+}
+
+void operator delete[](void* p, std::align_val_t) noexcept
+{
+	TrackedAlignedFree(p);
+}
+
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept
+{
+	TrackedAlignedFree(p);
+}
+
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept
+{
+	TrackedAlignedFree(p);
+}
+
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept
+{
+	TrackedAlignedFree(p);
+}
+
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept
+{
+	TrackedAlignedFree(p);
+}
+
+#endif
+
+#endif
@@ -0,0 +1,121 @@
+//***************************************************************************************
+// AllocationTracker.h
+//
+// Counts heap allocations to find the ones hidden in the frame loop.  AllocationTracker.cpp
+// replaces the global operator new/delete of every program it is linked into (define
+// DISABLE_ALLOCATION_TRACKING to keep the CRT's) and counts each allocation on the calling
+// thread under the tag of the innermost AllocationScope.  Every SampleInterval-th allocation
+// also records its call stack, so a report can say where the allocations come from.
+//
+// AllocationFrameCounter turns the running totals into per-frame, per-tag numbers and
+// can check that steady-state frames do not allocate at all.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+struct AllocationCounts
+{
+	std::uint64_t Allocations = 0;
+	std::uint64_t Bytes = 0;
+	std::uint64_t Frees = 0;
+};
+
+class AllocationTracker
+{
+public:
+	static const int MaxTags = 32;
+	static const int MaxThreads = 64;
+	static const int MaxSamples = 64;
+	static const int MaxSampleFrames = 16;
+
+	// Allocations outside any scope.
+	static const int UntaggedTag = 0;
+
+	// Allocations of the tracker's own reporting; never counted toward a frame.
+	static const int IgnoredTag = 1;
+
+	struct Sample
+	{
+		// Position in the sequence of all samples, see SampleSequence.
+		std::uint64_t Sequence = 0;
+		int Tag = 0;
+		std::size_t Size = 0;
+		int FrameCount = 0;
+		void* Frames[MaxSampleFrames] = {};
+	};
+
+	// Returns the tag for name, registering it on first use.  Returns UntaggedTag once
+	// MaxTags names exist.  name must stay valid (a string literal); registering takes
+	// a lock, so do it outside the frame loop.
+	static int RegisterTag(const char* name);
+	static const char* TagName(int tag);
+	static int TagCount();
+
+	// Records the call stack of every interval-th allocation; 0 (the default) disables
+	// sampling.
+	static void SetSampleInterval(std::uint32_t interval);
+
+	// Totals since startup summed over all threads, indexed by tag.
+	static void Snapshot(AllocationCounts counts[MaxTags]);
+
+	// Number of samples recorded since startup.
+	static std::uint64_t SampleSequence();
+
+	// Copies up to maxCount of the most recent samples, oldest first.
+	static int CopySamples(Sample* samples, int maxCount);
+
+	// "module!function (file:line)" for a sampled return address, or the raw address.
+	static std::string DescribeAddress(void* address);
+};
+
+// Tags the allocations made by the current thread while in scope.  Work that ParallelFor
+// hands to other threads is counted under those threads' tags.
+class AllocationScope
+{
+public:
+	explicit AllocationScope(int tag);
+	AllocationScope(const AllocationScope& rhs) = delete;
+	AllocationScope& operator=(const AllocationScope& rhs) = delete;
+	~AllocationScope();
+
+private:
+	int mPreviousTag;
+};
+
+class AllocationFrameCounter
+{
+public:
+	AllocationFrameCounter();
+
+	// Closes the current frame: its counts become the difference to the previous call.
+	void EndFrame();
+
+	// Frames closed so far.
+	std::uint64_t FrameIndex()const { return mFrameIndex; }
+
+	const AllocationCounts& Frame(int tag)const { return mFrame[tag]; }
+
+	// All tags except IgnoredTag.
+	AllocationCounts FrameTotal()const;
+
+	// True if the last frame made no allocations, or if it is still within the first
+	// warmupFrames frames, where caches and scratch buffers are expected to grow.
+	bool CheckZeroAllocations(std::uint64_t warmupFrames)const;
+
+	// One line per tag that allocated in the last frame, followed by the sampled call
+	// stacks of those allocations.
+	std::string Report()const;
+
+private:
+	AllocationCounts mPrevious[AllocationTracker::MaxTags];
+	AllocationCounts mFrame[AllocationTracker::MaxTags];
+	std::uint64_t mFrameIndex = 0;
+
+	// Sample sequence at the start and end of the last frame.
+	std::uint64_t mFrameFirstSample = 0;
+	std::uint64_t mFrameEndSample = 0;
+};
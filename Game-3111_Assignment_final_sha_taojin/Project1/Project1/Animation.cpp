@@ -0,0 +1,177 @@
+#include "Animation.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+using namespace DirectX;
+
+namespace
+{
+	XMVECTOR LoadLanes(const float* p)
+	{
+		return XMLoadFloat4A(reinterpret_cast<const XMFLOAT4A*>(p));
+	}
+
+	void StoreLanes(float* p, FXMVECTOR v)
+	{
+		XMStoreFloat4A(reinterpret_cast<XMFLOAT4A*>(p), v);
+	}
+}
+
+int Skeleton::AddJoint(const std::string& name, int parent, const XMFLOAT3& translation, const XMFLOAT4& rotation)
+{
+	assert(parent < JointCount() && JointCount() < MaxJoints);
+
+	Parents.push_back(parent);
+	Names.push_back(name);
+	BindRotations.push_back(rotation);
+	BindTranslations.push_back(translation);
+	return JointCount() - 1;
+}
+
+void Skeleton::ComputeInverseBind()
+{
+	const int jointCount = JointCount();
+	std::vector<XMFLOAT4X4> model(jointCount);
+	InverseBind.resize(jointCount);
+
+	for (int j = 0; j < jointCount; ++j)
+	{
+		XMMATRIX local = XMMatrixRotationQuaternion(XMLoadFloat4(&BindRotations[j])) *
+			XMMatrixTranslationFromVector(XMLoadFloat3(&BindTranslations[j]));
+		if (Parents[j] >= 0)
+			local = local * XMLoadFloat4x4(&model[Parents[j]]);
+
+		XMStoreFloat4x4(&model[j], local);
+		XMVECTOR det = XMMatrixDeterminant(local);
+		XMStoreFloat4x4(&InverseBind[j], XMMatrixInverse(&det, local));
+	}
+}
+
+bool AnimationClip::Create(const std::string& name, int jointCount, int frameCount, float sampleRate)
+{
+	if (jointCount <= 0 || jointCount > MaxJoints || frameCount < 2 || sampleRate <= 0.0f)
+		return false;
+
+	mName = name;
+	mJointCount = jointCount;
+	mPaddedJoints = (jointCount + 3) & ~3;
+	mFrameCount = frameCount;
+	mSampleRate = sampleRate;
+
+	// Identity keys, including the padding lanes, so every lane holds a unit quaternion.
+	mKeys.assign((std::size_t)frameCount*ChannelCount*mPaddedJoints, 0.0f);
+	for (int frame = 0; frame < frameCount; ++frame)
+		std::fill_n(Key(frame, RotW), mPaddedJoints, 1.0f);
+
+	return true;
+}
+
+void AnimationClip::SetKey(int frame, int joint, const XMFLOAT4& rotation, const XMFLOAT3& translation)
+{
+	assert(frame >= 0 && frame < mFrameCount && joint >= 0 && joint < mJointCount);
+
+	Key(frame, RotX)[joint] = rotation.x;
+	Key(frame, RotY)[joint] = rotation.y;
+	Key(frame, RotZ)[joint] = rotation.z;
+	Key(frame, RotW)[joint] = rotation.w;
+	Key(frame, PosX)[joint] = translation.x;
+	Key(frame, PosY)[joint] = translation.y;
+	Key(frame, PosZ)[joint] = translation.z;
+}
+
+void AnimationClip::Sample(float time, ClipInterpolation interpolation, LocalPose& pose)const
+{
+	assert(mFrameCount >= 2);
+
+	const float duration = Duration();
+	time = std::fmod(time, duration);
+	if (time < 0.0f)
+		time += duration;
+
+	const float position = time*mSampleRate;
+	const int frame0 = std::min((int)position, mFrameCount - 2);
+	const float t = std::min(position - frame0, 1.0f);
+
+	const XMVECTOR vt = XMVectorReplicate(t);
+	const XMVECTOR vs = XMVectorReplicate(1.0f - t);
+	const XMVECTOR zero = XMVectorZero();
+	const XMVECTOR one = XMVectorSplatOne();
+	const XMVECTOR signBit = XMVectorReplicate(-0.0f);
+
+	for (int j = 0; j < mPaddedJoints; j += 4)
+	{
+		const XMVECTOR ax = LoadLanes(Key(frame0, RotX) + j);
+		const XMVECTOR ay = LoadLanes(Key(frame0, RotY) + j);
+		const XMVECTOR az = LoadLanes(Key(frame0, RotZ) + j);
+		const XMVECTOR aw = LoadLanes(Key(frame0, RotW) + j);
+		XMVECTOR bx = LoadLanes(Key(frame0 + 1, RotX) + j);
+		XMVECTOR by = LoadLanes(Key(frame0 + 1, RotY) + j);
+		XMVECTOR bz = LoadLanes(Key(frame0 + 1, RotZ) + j);
+		XMVECTOR bw = LoadLanes(Key(frame0 + 1, RotW) + j);
+
+		// Take the short way round: flip the second key where the two are over 180
+		// degrees apart.
+		XMVECTOR cosAngle = XMVectorMultiply(ax, bx);
+		cosAngle = XMVectorMultiplyAdd(ay, by, cosAngle);
+		cosAngle = XMVectorMultiplyAdd(az, bz, cosAngle);
+		cosAngle = XMVectorMultiplyAdd(aw, bw, cosAngle);
+		const XMVECTOR flip = XMVectorAndInt(XMVectorLess(cosAngle, zero), signBit);
+		bx = XMVectorXorInt(bx, flip);
+		by = XMVectorXorInt(by, flip);
+		bz = XMVectorXorInt(bz, flip);
+		bw = XMVectorXorInt(bw, flip);
+		cosAngle = XMVectorAbs(cosAngle);
+
+		XMVECTOR wa = vs;
+		XMVECTOR wb = vt;
+		if (interpolation == ClipInterpolation::Slerp)
+		{
+			// sin((1-t)a)/sin(a) and sin(ta)/sin(a); nearly equal keys keep the lerp weights.
+			const XMVECTOR angle = XMVectorACos(XMVectorMin(cosAngle, one));
+			const XMVECTOR sinAngle = XMVectorSin(angle);
+			const XMVECTOR invSin = XMVectorReciprocal(sinAngle);
+			const XMVECTOR useSlerp = XMVectorGreater(sinAngle, XMVectorReplicate(1e-4f));
+			wa = XMVectorSelect(wa, XMVectorMultiply(XMVectorSin(XMVectorMultiply(vs, angle)), invSin), useSlerp);
+			wb = XMVectorSelect(wb, XMVectorMultiply(XMVectorSin(XMVectorMultiply(vt, angle)), invSin), useSlerp);
+		}
+
+		XMVECTOR rx = XMVectorMultiplyAdd(bx, wb, XMVectorMultiply(ax, wa));
+		XMVECTOR ry = XMVectorMultiplyAdd(by, wb, XMVectorMultiply(ay, wa));
+		XMVECTOR rz = XMVectorMultiplyAdd(bz, wb, XMVectorMultiply(az, wa));
+		XMVECTOR rw = XMVectorMultiplyAdd(bw, wb, XMVectorMultiply(aw, wa));
+
+		// Slerp of unit keys is already unit length; the normalize fixes up the nlerp.
+		XMVECTOR lengthSq = XMVectorMultiply(rx, rx);
+		lengthSq = XMVectorMultiplyAdd(ry, ry, lengthSq);
+		lengthSq = XMVectorMultiplyAdd(rz, rz, lengthSq);
+		lengthSq = XMVectorMultiplyAdd(rw, rw, lengthSq);
+		const XMVECTOR invLength = XMVectorReciprocalSqrt(lengthSq);
+		StoreLanes(pose.Rotation[0] + j, XMVectorMultiply(rx, invLength));
+		StoreLanes(pose.Rotation[1] + j, XMVectorMultiply(ry, invLength));
+		StoreLanes(pose.Rotation[2] + j, XMVectorMultiply(rz, invLength));
+		StoreLanes(pose.Rotation[3] + j, XMVectorMultiply(rw, invLength));
+
+		for (int c = 0; c < 3; ++c)
+		{
+			const XMVECTOR pa = LoadLanes(Key(frame0, PosX + c) + j);
+			const XMVECTOR pb = LoadLanes(Key(frame0 + 1, PosX + c) + j);
+			StoreLanes(pose.Translation[c] + j, XMVectorLerpV(pa, pb, vt));
+		}
+	}
+}
+
+void LocalToModel(const Skeleton& skeleton, const LocalPose& pose, FXMMATRIX root, XMFLOAT4X4* model)
+{
+	for (int j = 0; j < skeleton.JointCount(); ++j)
+	{
+		const XMVECTOR rotation = XMVectorSet(pose.Rotation[0][j], pose.Rotation[1][j], pose.Rotation[2][j], pose.Rotation[3][j]);
+		const XMVECTOR translation = XMVectorSet(pose.Translation[0][j], pose.Translation[1][j], pose.Translation[2][j], 1.0f);
+
+		XMMATRIX local = XMMatrixRotationQuaternion(rotation);
+		local.r[3] = translation;
+
+		const int parent = skeleton.Parents[j];
+		XMStoreFloat4x4(&model[j], local * (parent >= 0 ? XMLoadFloat4x4(&model[parent]) : root));
+	}
+}
@@ -0,0 +1,110 @@
+//***************************************************************************************
+// Animation.h
+//
+// Skeletal animation: a joint hierarchy, clips of uniformly sampled rotation and
+// translation keys, and the local-to-model propagation of a sampled pose.  Keys and
+// poses are stored as structure-of-arrays over the joints, so a clip is sampled four
+// joints at a time in XMVECTOR lanes, including the quaternion nlerp/slerp.  Skinning.h
+// turns the model-space pose into skinned vertices.
+//***************************************************************************************
+
+#pragma once
+
+#include <DirectXMath.h>
+#include <string>
+#include <vector>
+
+// Joints a skeleton may have; poses are fixed-size so sampling never allocates.
+const int MaxJoints = 64;
+
+// Joint arrays padded for the four-wide sampling.
+const int MaxJointsPadded = (MaxJoints + 3) & ~3;
+
+struct Skeleton
+{
+	// Parents[j] < j, or -1 for a root.
+	std::vector<int> Parents;
+	std::vector<std::string> Names;
+
+	// Local bind pose of each joint relative to its parent.
+	std::vector<DirectX::XMFLOAT4> BindRotations;
+	std::vector<DirectX::XMFLOAT3> BindTranslations;
+
+	// Inverse of each joint's model-space bind transform, see ComputeInverseBind.
+	std::vector<DirectX::XMFLOAT4X4> InverseBind;
+
+	int JointCount()const { return (int)Parents.size(); }
+
+	// Appends a joint with its bind pose and returns its index.
+	int AddJoint(const std::string& name, int parent, const DirectX::XMFLOAT3& translation,
+		const DirectX::XMFLOAT4& rotation = DirectX::XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f));
+
+	// Fills InverseBind from the bind pose.
+	void ComputeInverseBind();
+};
+
+// A pose as local rotation (x, y, z, w) and translation channels over the joints.
+struct LocalPose
+{
+	alignas(16) float Rotation[4][MaxJointsPadded];
+	alignas(16) float Translation[3][MaxJointsPadded];
+};
+
+enum class ClipInterpolation : int
+{
+	// Normalized lerp: cheaper, slightly uneven angular speed between keys.
+	Nlerp = 0,
+	Slerp
+};
+
+class AnimationClip
+{
+public:
+	AnimationClip() = default;
+
+	// frameCount keys per joint at sampleRate keys per second.  The clip loops: make the
+	// last key equal to the first for a seamless cycle.  Returns false for an empty clip
+	// or more than MaxJoints joints.
+	bool Create(const std::string& name, int jointCount, int frameCount, float sampleRate);
+
+	void SetKey(int frame, int joint, const DirectX::XMFLOAT4& rotation, const DirectX::XMFLOAT3& translation);
+
+	const std::string& Name()const { return mName; }
+	int JointCount()const { return mJointCount; }
+	int FrameCount()const { return mFrameCount; }
+	float Duration()const { return (mFrameCount - 1) / mSampleRate; }
+
+	// Writes the pose at time (wrapped into the clip) for every joint.
+	void Sample(float time, ClipInterpolation interpolation, LocalPose& pose)const;
+
+private:
+	// Channels of a key frame, each mPaddedJoints floats.
+	enum Channel : int
+	{
+		RotX = 0,
+		RotY,
+		RotZ,
+		RotW,
+		PosX,
+		PosY,
+		PosZ,
+		ChannelCount
+	};
+
+	float* Key(int frame, int channel) { return &mKeys[((std::size_t)frame*ChannelCount + channel)*mPaddedJoints]; }
+	const float* Key(int frame, int channel)const { return &mKeys[((std::size_t)frame*ChannelCount + channel)*mPaddedJoints]; }
+
+private:
+	std::string mName;
+	int mJointCount = 0;
+	int mPaddedJoints = 0;
+	int mFrameCount = 0;
+	float mSampleRate = 30.0f;
+
+	std::vector<float> mKeys;
+};
+
+// model[j] = local[j] * model[parent[j]] for every joint, parents first, with root as
+// the parent of the root joints.
+void LocalToModel(const Skeleton& skeleton, const LocalPose& pose, DirectX::FXMMATRIX root,
+	DirectX::XMFLOAT4X4* model);
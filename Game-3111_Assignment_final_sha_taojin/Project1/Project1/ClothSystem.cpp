@@ -0,0 +1,403 @@
+#include "ClothSystem.h"
+#include "../../Common/GeometryGenerator.h"
+#include "ParallelFor.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+using namespace DirectX;
+
+namespace
+{
+	// Constraints per task when solving one color.
+	const int SolveGrainSize = 1024;
+
+	std::size_t PaddedCount(int count)
+	{
+		return ((std::size_t)std::max(count, 0) + 3) & ~(std::size_t)3;
+	}
+
+	XMVECTOR LoadLanes(const float* p)
+	{
+		return XMLoadFloat4A(reinterpret_cast<const XMFLOAT4A*>(p));
+	}
+
+	void StoreLanes(float* p, FXMVECTOR v)
+	{
+		XMStoreFloat4A(reinterpret_cast<XMFLOAT4A*>(p), v);
+	}
+
+	// Unaligned, for the neighbours of a group of four.
+	XMVECTOR LoadLanesU(const float* p)
+	{
+		return XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(p));
+	}
+
+	void StoreLanesU(float* p, FXMVECTOR v)
+	{
+		XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(p), v);
+	}
+}
+
+bool ClothSystem::Create(const std::vector<ClothFlagDesc>& flags, const ClothSettings& settings)
+{
+	mSettings = settings;
+	mFlags.clear();
+	mTexC.clear();
+	mIndices.clear();
+	mConstraints.clear();
+	mColorStart.assign(1, 0);
+	mVertexCount = 0;
+	mTime = 0.0f;
+
+	int vertexCount = 0;
+	for (const ClothFlagDesc& desc : flags)
+	{
+		if (desc.Rows < 2 || desc.Columns < 2)
+			return false;
+		vertexCount += desc.Rows*desc.Columns;
+	}
+
+	const std::size_t padded = PaddedCount(vertexCount);
+	if (!mArena.Create("cloth", StreamCount*(padded*sizeof(float) + 64) + 64))
+		return false;
+
+	// The padding lanes keep zero inverse mass, so they never move.
+	for (int s = 0; s < StreamCount; ++s)
+	{
+		mStreams[s] = static_cast<float*>(mArena.Allocate(padded*sizeof(float), 64));
+		std::memset(mStreams[s], 0, padded*sizeof(float));
+	}
+	mVertexCount = vertexCount;
+	mTexC.resize(vertexCount);
+
+	GeometryGenerator geoGen;
+	int firstVertex = 0;
+	for (const ClothFlagDesc& desc : flags)
+	{
+		Flag flag;
+		flag.Desc = desc;
+		flag.FirstVertex = firstVertex;
+		flag.FirstIndex = (int)mIndices.size();
+
+		// The grid lies in xz with row 0 at +z.  Stand it up so row 0 is the top edge and
+		// column 0 is the pole edge, then turn it about the pole.
+		GeometryGenerator::MeshData grid = geoGen.CreateGrid(desc.Width, desc.Height, desc.Rows, desc.Columns);
+		const float cosYaw = std::cos(desc.Yaw);
+		const float sinYaw = std::sin(desc.Yaw);
+		for (int v = 0; v < (int)grid.Vertices.size(); ++v)
+		{
+			const XMFLOAT3& p = grid.Vertices[v].Position;
+			const float along = p.x + 0.5f*desc.Width;
+			const float down = p.z - 0.5f*desc.Height;
+
+			const int i = flag.FirstVertex + v;
+			mStreams[PosX][i] = mStreams[PrevX][i] = desc.Position.x + along*cosYaw;
+			mStreams[PosY][i] = mStreams[PrevY][i] = desc.Position.y + down;
+			mStreams[PosZ][i] = mStreams[PrevZ][i] = desc.Position.z + along*sinYaw;
+			mStreams[InvMass][i] = v % desc.Columns == 0 ? 0.0f : 1.0f;
+			mTexC[i] = grid.Vertices[v].TexC;
+		}
+
+		mIndices.insert(mIndices.end(), grid.Indices32.begin(), grid.Indices32.end());
+		flag.IndexCount = (int)grid.Indices32.size();
+
+		// Structural and shear constraints between neighbours, bending ones across two.
+		const int rows = desc.Rows;
+		const int cols = desc.Columns;
+		auto index = [&](int i, int j) { return flag.FirstVertex + i*cols + j; };
+		for (int i = 0; i < rows; ++i)
+		{
+			for (int j = 0; j < cols; ++j)
+			{
+				if (j + 1 < cols)
+					AddConstraint(index(i, j), index(i, j + 1), desc.Stiffness);
+				if (i + 1 < rows)
+					AddConstraint(index(i, j), index(i + 1, j), desc.Stiffness);
+				if (i + 1 < rows && j + 1 < cols)
+				{
+					AddConstraint(index(i, j), index(i + 1, j + 1), desc.Stiffness);
+					AddConstraint(index(i, j + 1), index(i + 1, j), desc.Stiffness);
+				}
+				if (j + 2 < cols)
+					AddConstraint(index(i, j), index(i, j + 2), desc.BendStiffness);
+				if (i + 2 < rows)
+					AddConstraint(index(i, j), index(i + 2, j), desc.BendStiffness);
+			}
+		}
+
+		mFlags.push_back(flag);
+		firstVertex += rows*cols;
+	}
+
+	ColorConstraints();
+
+	for (const Flag& flag : mFlags)
+		UpdateNormals(flag);
+
+	return true;
+}
+
+void ClothSystem::AddConstraint(int a, int b, float stiffness)
+{
+	// Both ends pinned: nothing to solve.
+	if (mStreams[InvMass][a] + mStreams[InvMass][b] == 0.0f)
+		return;
+
+	const float dx = mStreams[PosX][b] - mStreams[PosX][a];
+	const float dy = mStreams[PosY][b] - mStreams[PosY][a];
+	const float dz = mStreams[PosZ][b] - mStreams[PosZ][a];
+
+	Constraint c;
+	c.A = a;
+	c.B = b;
+	c.RestLength = std::sqrt(dx*dx + dy*dy + dz*dz);
+	c.Stiffness = stiffness;
+	mConstraints.push_back(c);
+}
+
+void ClothSystem::ColorConstraints()
+{
+	// Greedy coloring: each constraint takes the lowest color neither of its particles
+	// has yet.  A particle has at most 12 constraints, so fewer than 23 colors are used.
+	std::vector<std::uint64_t> usedColors(mVertexCount, 0);
+	std::vector<int> colors(mConstraints.size());
+	int colorCount = 0;
+	for (std::size_t k = 0; k < mConstraints.size(); ++k)
+	{
+		const Constraint& c = mConstraints[k];
+		const std::uint64_t used = usedColors[c.A] | usedColors[c.B];
+
+		int color = 0;
+		while (used & (1ull << color))
+			++color;
+		assert(color < 64);
+
+		usedColors[c.A] |= 1ull << color;
+		usedColors[c.B] |= 1ull << color;
+		colors[k] = color;
+		colorCount = std::max(colorCount, color + 1);
+	}
+
+	// Counting sort by color.
+	mColorStart.assign(colorCount + 1, 0);
+	for (int color : colors)
+		++mColorStart[color + 1];
+	for (int c = 0; c < colorCount; ++c)
+		mColorStart[c + 1] += mColorStart[c];
+
+	std::vector<int> next(mColorStart.begin(), mColorStart.end() - 1);
+	std::vector<Constraint> sorted(mConstraints.size());
+	for (std::size_t k = 0; k < mConstraints.size(); ++k)
+		sorted[next[colors[k]]++] = mConstraints[k];
+	mConstraints.swap(sorted);
+}
+
+void ClothSystem::Update(float dt)
+{
+	dt = std::min(dt, mSettings.MaxStep);
+	if (mVertexCount == 0 || dt <= 0.0f)
+		return;
+
+	mTime += dt;
+
+	const int chunkCount = (mVertexCount + ChunkSize - 1) / ChunkSize;
+	ParallelFor(0, chunkCount, [&](int chunk)
+	{
+		IntegrateChunk(chunk, dt);
+	});
+
+	// Colors run one after the other; the constraints of a color touch disjoint particles.
+	for (int iteration = 0; iteration < mSettings.SolverIterations; ++iteration)
+	{
+		for (int color = 0; color < ColorCount(); ++color)
+		{
+			const int first = mColorStart[color];
+			ParallelForRange(mColorStart[color + 1] - first, SolveGrainSize, [&](int begin, int end)
+			{
+				SolveConstraints(first + begin, first + end);
+			});
+		}
+	}
+
+	ParallelFor(0, FlagCount(), [&](int flag)
+	{
+		UpdateNormals(mFlags[flag]);
+	});
+}
+
+void ClothSystem::IntegrateChunk(int chunk, float dt)
+{
+	const int begin = chunk*ChunkSize;
+	const int end = std::min(begin + ChunkSize, (int)PaddedCount(mVertexCount));
+
+	const XMVECTOR keep = XMVectorReplicate(1.0f - mSettings.Damping);
+	const XMVECTOR dt2 = XMVectorReplicate(dt*dt);
+	const XMVECTOR invDt = XMVectorReplicate(1.0f / dt);
+	const XMVECTOR gravity = XMVectorReplicate(mSettings.Gravity);
+	const XMVECTOR response = XMVectorReplicate(mSettings.WindResponse);
+	const XMVECTOR windX = XMVectorReplicate(mSettings.Wind.x);
+	const XMVECTOR windY = XMVectorReplicate(mSettings.Wind.y);
+	const XMVECTOR windZ = XMVectorReplicate(mSettings.Wind.z);
+	const XMVECTOR gust = XMVectorReplicate(mSettings.Gust);
+	const XMVECTOR gustPhase = XMVectorReplicate(mTime*mSettings.GustFrequency*XM_2PI);
+	const XMVECTOR gustScale = XMVectorReplicate(0.15f);
+	const XMVECTOR one = XMVectorSplatOne();
+
+	float* const* s = mStreams;
+	for (int i = begin; i < end; i += 4)
+	{
+		const XMVECTOR px = LoadLanes(&s[PosX][i]);
+		const XMVECTOR py = LoadLanes(&s[PosY][i]);
+		const XMVECTOR pz = LoadLanes(&s[PosZ][i]);
+		const XMVECTOR nx = LoadLanes(&s[NormX][i]);
+		const XMVECTOR ny = LoadLanes(&s[NormY][i]);
+		const XMVECTOR nz = LoadLanes(&s[NormZ][i]);
+		const XMVECTOR invMass = LoadLanes(&s[InvMass][i]);
+
+		// Displacement over the last step.
+		const XMVECTOR vx = XMVectorMultiply(XMVectorSubtract(px, LoadLanes(&s[PrevX][i])), keep);
+		const XMVECTOR vy = XMVectorMultiply(XMVectorSubtract(py, LoadLanes(&s[PrevY][i])), keep);
+		const XMVECTOR vz = XMVectorMultiply(XMVectorSubtract(pz, LoadLanes(&s[PrevZ][i])), keep);
+
+		// Gusts travel across the scene along x + z.
+		const XMVECTOR phase = XMVectorMultiplyAdd(XMVectorAdd(px, pz), gustScale, gustPhase);
+		const XMVECTOR strength = XMVectorMultiplyAdd(gust, XMVectorSin(phase), one);
+
+		// Push along the normal in proportion to the wind speed across the cloth,
+		// relative to the cloth's own velocity.
+		const XMVECTOR rx = XMVectorSubtract(XMVectorMultiply(windX, strength), XMVectorMultiply(vx, invDt));
+		const XMVECTOR ry = XMVectorSubtract(XMVectorMultiply(windY, strength), XMVectorMultiply(vy, invDt));
+		const XMVECTOR rz = XMVectorSubtract(XMVectorMultiply(windZ, strength), XMVectorMultiply(vz, invDt));
+		XMVECTOR across = XMVectorMultiply(nx, rx);
+		across = XMVectorMultiplyAdd(ny, ry, across);
+		across = XMVectorMultiplyAdd(nz, rz, across);
+		across = XMVectorMultiply(across, response);
+
+		const XMVECTOR ax = XMVectorMultiply(across, nx);
+		const XMVECTOR ay = XMVectorMultiplyAdd(across, ny, gravity);
+		const XMVECTOR az = XMVectorMultiply(across, nz);
+
+		// Pinned particles have zero inverse mass and stay put.
+		StoreLanes(&s[PrevX][i], px);
+		StoreLanes(&s[PrevY][i], py);
+		StoreLanes(&s[PrevZ][i], pz);
+		StoreLanes(&s[PosX][i], XMVectorMultiplyAdd(XMVectorMultiplyAdd(ax, dt2, vx), invMass, px));
+		StoreLanes(&s[PosY][i], XMVectorMultiplyAdd(XMVectorMultiplyAdd(ay, dt2, vy), invMass, py));
+		StoreLanes(&s[PosZ][i], XMVectorMultiplyAdd(XMVectorMultiplyAdd(az, dt2, vz), invMass, pz));
+	}
+}
+
+void ClothSystem::SolveConstraints(int begin, int end)
+{
+	float* x = mStreams[PosX];
+	float* y = mStreams[PosY];
+	float* z = mStreams[PosZ];
+	const float* invMass = mStreams[InvMass];
+
+	for (int k = begin; k < end; ++k)
+	{
+		const Constraint& c = mConstraints[k];
+		const float wa = invMass[c.A];
+		const float wb = invMass[c.B];
+
+		const float dx = x[c.B] - x[c.A];
+		const float dy = y[c.B] - y[c.A];
+		const float dz = z[c.B] - z[c.A];
+		const float length = std::sqrt(dx*dx + dy*dy + dz*dz);
+		if (length < 1e-6f)
+			continue;
+
+		const float t = c.Stiffness*(length - c.RestLength) / (length*(wa + wb));
+		x[c.A] += wa*t*dx;
+		y[c.A] += wa*t*dy;
+		z[c.A] += wa*t*dz;
+		x[c.B] -= wb*t*dx;
+		y[c.B] -= wb*t*dy;
+		z[c.B] -= wb*t*dz;
+	}
+}
+
+void ClothSystem::UpdateNormals(const Flag& flag)
+{
+	const int rows = flag.Desc.Rows;
+	const int cols = flag.Desc.Columns;
+	const float* x = mStreams[PosX];
+	const float* y = mStreams[PosY];
+	const float* z = mStreams[PosZ];
+	float* nx = mStreams[NormX];
+	float* ny = mStreams[NormY];
+	float* nz = mStreams[NormZ];
+
+	for (int i = 0; i < rows; ++i)
+	{
+		const int row = flag.FirstVertex + i*cols;
+		const int up = flag.FirstVertex + std::max(i - 1, 0)*cols;
+		const int down = flag.FirstVertex + std::min(i + 1, rows - 1)*cols;
+
+		// Central differences along the row (du) and down the column (dv), one-sided at
+		// the edges; the normal is du x dv.
+		auto scalarNormal = [&](int j)
+		{
+			const int left = row + std::max(j - 1, 0);
+			const int right = row + std::min(j + 1, cols - 1);
+			const XMVECTOR du = XMVectorSet(x[right] - x[left], y[right] - y[left], z[right] - z[left], 0.0f);
+			const XMVECTOR dv = XMVectorSet(x[down + j] - x[up + j], y[down + j] - y[up + j], z[down + j] - z[up + j], 0.0f);
+
+			XMFLOAT3 n;
+			XMStoreFloat3(&n, XMVector3Normalize(XMVector3Cross(du, dv)));
+			nx[row + j] = n.x;
+			ny[row + j] = n.y;
+			nz[row + j] = n.z;
+		};
+
+		scalarNormal(0);
+
+		// Interior columns four at a time, as long as the right neighbours are in the row.
+		int j = 1;
+		for (; j + 4 <= cols - 1; j += 4)
+		{
+			const int c = row + j;
+			const XMVECTOR dux = XMVectorSubtract(LoadLanesU(&x[c + 1]), LoadLanesU(&x[c - 1]));
+			const XMVECTOR duy = XMVectorSubtract(LoadLanesU(&y[c + 1]), LoadLanesU(&y[c - 1]));
+			const XMVECTOR duz = XMVectorSubtract(LoadLanesU(&z[c + 1]), LoadLanesU(&z[c - 1]));
+			const XMVECTOR dvx = XMVectorSubtract(LoadLanesU(&x[down + j]), LoadLanesU(&x[up + j]));
+			const XMVECTOR dvy = XMVectorSubtract(LoadLanesU(&y[down + j]), LoadLanesU(&y[up + j]));
+			const XMVECTOR dvz = XMVectorSubtract(LoadLanesU(&z[down + j]), LoadLanesU(&z[up + j]));
+
+			const XMVECTOR cx = XMVectorNegativeMultiplySubtract(duz, dvy, XMVectorMultiply(duy, dvz));
+			const XMVECTOR cy = XMVectorNegativeMultiplySubtract(dux, dvz, XMVectorMultiply(duz, dvx));
+			const XMVECTOR cz = XMVectorNegativeMultiplySubtract(duy, dvx, XMVectorMultiply(dux, dvy));
+
+			XMVECTOR lengthSq = XMVectorMultiply(cx, cx);
+			lengthSq = XMVectorMultiplyAdd(cy, cy, lengthSq);
+			lengthSq = XMVectorMultiplyAdd(cz, cz, lengthSq);
+			const XMVECTOR invLength = XMVectorReciprocalSqrt(XMVectorMax(lengthSq, XMVectorReplicate(1e-12f)));
+
+			StoreLanesU(&nx[c], XMVectorMultiply(cx, invLength));
+			StoreLanesU(&ny[c], XMVectorMultiply(cy, invLength));
+			StoreLanesU(&nz[c], XMVectorMultiply(cz, invLength));
+		}
+
+		for (; j < cols; ++j)
+			scalarNormal(j);
+	}
+}
+
+void ClothSystem::WriteVertices(int first, int count, ClothVertex* out)const
+{
+	assert(first >= 0 && first + count <= mVertexCount);
+
+	for (int k = 0; k < count; ++k)
+	{
+		const int i = first + k;
+
+		// Built whole and stored once: out may be write-combined upload memory.
+		ClothVertex v;
+		v.Pos = XMFLOAT3(mStreams[PosX][i], mStreams[PosY][i], mStreams[PosZ][i]);
+		v.Normal = XMFLOAT3(mStreams[NormX][i], mStreams[NormY][i], mStreams[NormZ][i]);
+		v.TexC = mTexC[i];
+		out[k] = v;
+	}
+}
@@ -0,0 +1,162 @@
+//***************************************************************************************
+// ClothSystem.h
+//
+// Verlet cloth for the demo's flags.  Every flag is a GeometryGenerator::CreateGrid
+// sheet hanging from its pole edge, and all flags share one set of structure-of-arrays
+// particle streams, so integration, wind and the per-frame normals run four particles
+// at a time in XMVECTOR lanes regardless of how many flags there are.  The distance
+// constraints of all flags are graph-colored once at creation: no two constraints of a
+// color share a particle, so each color is solved in parallel without locks.
+//***************************************************************************************
+
+#pragma once
+
+#include <DirectXMath.h>
+#include <cstdint>
+#include <vector>
+#include "MemoryArena.h"
+
+// One vertex of the cloth stream, laid out like Vertex (FrameResource.h) so the standard
+// input layout and the software rasterizer read it.
+struct ClothVertex
+{
+	DirectX::XMFLOAT3 Pos;
+	DirectX::XMFLOAT3 Normal;
+	DirectX::XMFLOAT2 TexC;
+};
+
+struct ClothFlagDesc
+{
+	// Size of the cloth and particles along each side (CreateGrid's n and m).
+	float Width = 6.0f;
+	float Height = 4.0f;
+	int Columns = 24;
+	int Rows = 16;
+
+	// Top of the pole edge in world space, and the direction the flag extends from the
+	// pole, as an angle from +x towards +z.
+	DirectX::XMFLOAT3 Position = { 0.0f, 0.0f, 0.0f };
+	float Yaw = 0.0f;
+
+	// Fraction of the error of the structural/shear and the bending constraints removed
+	// per solver iteration.
+	float Stiffness = 1.0f;
+	float BendStiffness = 0.25f;
+};
+
+struct ClothSettings
+{
+	float Gravity = -9.8f;
+
+	// Part of the velocity lost per step.
+	float Damping = 0.01f;
+
+	// Acceleration per unit of wind speed across the cloth.
+	float WindResponse = 0.6f;
+
+	// Wind velocity, and how strongly it gusts: the speed is scaled by 1 +/- Gust in a
+	// wave of GustFrequency travelling across the flags.
+	DirectX::XMFLOAT3 Wind = { 6.0f, 0.0f, 2.0f };
+	float Gust = 0.4f;
+	float GustFrequency = 1.3f;
+
+	int SolverIterations = 4;
+
+	// Longer frames are simulated as this step, so a hitch does not blow up the cloth.
+	float MaxStep = 1.0f / 30.0f;
+};
+
+class ClothSystem
+{
+public:
+	// Particles per task of the parallel integration; a multiple of the SIMD width.
+	static const int ChunkSize = 1024;
+
+	ClothSystem() = default;
+	ClothSystem(const ClothSystem& rhs) = delete;
+	ClothSystem& operator=(const ClothSystem& rhs) = delete;
+	~ClothSystem() = default;
+
+	// Builds the flags at rest and colors their constraints.  Returns false if a flag has
+	// fewer than 2x2 particles or the memory could not be reserved.
+	bool Create(const std::vector<ClothFlagDesc>& flags, const ClothSettings& settings = ClothSettings());
+
+	ClothSettings& Settings() { return mSettings; }
+
+	// Integrates, applies the wind, solves the constraints and recomputes the normals.
+	void Update(float dt);
+
+	int FlagCount()const { return (int)mFlags.size(); }
+	int VertexCount()const { return mVertexCount; }
+
+	// Every flag's vertices and triangles follow the previous flag's.  The indices of a
+	// flag are relative to its first vertex (draw with BaseVertexLocation).
+	int FlagFirstVertex(int flag)const { return mFlags[flag].FirstVertex; }
+	int FlagFirstIndex(int flag)const { return mFlags[flag].FirstIndex; }
+	int FlagIndexCount(int flag)const { return mFlags[flag].IndexCount; }
+	const std::vector<std::uint32_t>& Indices()const { return mIndices; }
+
+	int ConstraintCount()const { return (int)mConstraints.size(); }
+	int ColorCount()const { return (int)mColorStart.size() - 1; }
+
+	// Writes vertices [first, first + count) with their current normals.
+	void WriteVertices(int first, int count, ClothVertex* out)const;
+
+private:
+	// The per-particle arrays.
+	enum Stream : int
+	{
+		PosX = 0,
+		PosY,
+		PosZ,
+		PrevX,
+		PrevY,
+		PrevZ,
+		NormX,
+		NormY,
+		NormZ,
+		InvMass,
+		StreamCount
+	};
+
+	struct Flag
+	{
+		ClothFlagDesc Desc;
+		int FirstVertex = 0;
+		int FirstIndex = 0;
+		int IndexCount = 0;
+	};
+
+	struct Constraint
+	{
+		int A = 0;
+		int B = 0;
+		float RestLength = 0.0f;
+		float Stiffness = 1.0f;
+	};
+
+	void AddConstraint(int a, int b, float stiffness);
+	void ColorConstraints();
+
+	void IntegrateChunk(int chunk, float dt);
+	void SolveConstraints(int begin, int end);
+	void UpdateNormals(const Flag& flag);
+
+private:
+	MemoryArena mArena;
+	ClothSettings mSettings;
+
+	std::vector<Flag> mFlags;
+	int mVertexCount = 0;
+
+	// One array per Stream, padded to a multiple of four and cache-line aligned.
+	float* mStreams[StreamCount] = {};
+	std::vector<DirectX::XMFLOAT2> mTexC;
+	std::vector<std::uint32_t> mIndices;
+
+	// Sorted by color; color c is [mColorStart[c], mColorStart[c + 1]).
+	std::vector<Constraint> mConstraints;
+	std::vector<int> mColorStart;
+
+	float mTime = 0.0f;
+};
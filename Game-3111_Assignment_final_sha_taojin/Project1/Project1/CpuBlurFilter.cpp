@@ -0,0 +1,189 @@
+#include "CpuBlurFilter.h"
+#include "CpuFeatures.h"
+#include "ParallelFor.h"
+#include <cassert>
+#include <cmath>
+#include <immintrin.h>
+
+#if defined(_MSC_VER)
+#define BLUR_AVX2_TARGET
+#else
+#define BLUR_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+
+using namespace DirectX;
+
+const int CpuBlurFilter::MaxBlurRadius;
+
+namespace
+{
+	// Pixels per transpose block; a 16x16 block of float4 is 4 KB.
+	const int TransposeBlock = 16;
+
+	// out[x] = sum_i weights[i]*padded[x + i] for a row padded with radius clamped
+	// pixels on each side.  Two pixels per register, two registers per iteration.
+	BLUR_AVX2_TARGET void BlurRowAvx2(const XMFLOAT4* padded, XMFLOAT4* out, int width,
+		const float* weights, int taps)
+	{
+		const float* src = &padded[0].x;
+		float* dst = &out[0].x;
+
+		int x = 0;
+		for (; x + 4 <= width; x += 4)
+		{
+			__m256 acc0 = _mm256_setzero_ps();
+			__m256 acc1 = _mm256_setzero_ps();
+			for (int i = 0; i < taps; ++i)
+			{
+				const __m256 w = _mm256_set1_ps(weights[i]);
+				acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(w, _mm256_loadu_ps(src + 4 * (x + i))));
+				acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(w, _mm256_loadu_ps(src + 4 * (x + i) + 8)));
+			}
+			_mm256_storeu_ps(dst + 4 * x, acc0);
+			_mm256_storeu_ps(dst + 4 * x + 8, acc1);
+		}
+
+		for (; x < width; ++x)
+		{
+			__m128 acc = _mm_setzero_ps();
+			for (int i = 0; i < taps; ++i)
+				acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(weights[i]), _mm_loadu_ps(src + 4 * (x + i))));
+			_mm_storeu_ps(dst + 4 * x, acc);
+		}
+	}
+
+	void BlurRowScalar(const XMFLOAT4* padded, XMFLOAT4* out, int width, const float* weights, int taps)
+	{
+		for (int x = 0; x < width; ++x)
+		{
+			XMVECTOR acc = XMVectorZero();
+			for (int i = 0; i < taps; ++i)
+				acc = XMVectorAdd(acc, XMVectorScale(XMLoadFloat4(&padded[x + i]), weights[i]));
+			XMStoreFloat4(&out[x], acc);
+		}
+	}
+}
+
+std::vector<float> CpuBlurFilter::CalcGaussWeights(float sigma)
+{
+	float twoSigma2 = 2.0f*sigma*sigma;
+
+	// Estimate the blur radius based on sigma since sigma controls the "width" of the bell curve.
+	int blurRadius = (int)ceil(2.0f * sigma);
+
+	assert(blurRadius <= MaxBlurRadius);
+
+	std::vector<float> weights;
+	weights.resize(2 * blurRadius + 1);
+
+	float weightSum = 0.0f;
+
+	for (int i = -blurRadius; i <= blurRadius; ++i)
+	{
+		float x = (float)i;
+
+		weights[i + blurRadius] = expf(-x*x / twoSigma2);
+
+		weightSum += weights[i + blurRadius];
+	}
+
+	// Divide by the sum so all the weights add up to 1.0.
+	for (size_t i = 0; i < weights.size(); ++i)
+	{
+		weights[i] /= weightSum;
+	}
+
+	return weights;
+}
+
+bool CpuBlurFilter::UsesAvx2()
+{
+	static const bool avx2 = CpuSupportsAvx2();
+	return avx2;
+}
+
+void CpuBlurFilter::Execute(XMFLOAT4* image, int width, int height, int rowPitch, float sigma, int blurCount)
+{
+	Execute(image, width, height, rowPitch, CalcGaussWeights(sigma), blurCount);
+}
+
+void CpuBlurFilter::Execute(XMFLOAT4* image, int width, int height, int rowPitch,
+	const std::vector<float>& weights, int blurCount)
+{
+	assert(weights.size() % 2 == 1 && (int)weights.size() <= 2 * MaxBlurRadius + 1);
+	if (image == nullptr || width <= 0 || height <= 0 || weights.size() % 2 == 0)
+		return;
+
+	const size_t pixelCount = (size_t)width*height;
+	mRows.resize(pixelCount);
+	mColumns.resize(pixelCount);
+	mBlurredColumns.resize(pixelCount);
+
+	for (int i = 0; i < blurCount; ++i)
+	{
+		// Horizontal blur pass.
+		BlurRows(image, rowPitch, mRows.data(), width, width, height, weights);
+
+		// Vertical blur pass: the columns are blurred as the rows of the transposed image.
+		Transpose(mRows.data(), width, mColumns.data(), height, width, height);
+		BlurRows(mColumns.data(), height, mBlurredColumns.data(), height, height, width, weights);
+		Transpose(mBlurredColumns.data(), height, image, rowPitch, height, width);
+	}
+}
+
+void CpuBlurFilter::BlurRows(const XMFLOAT4* src, int srcPitch, XMFLOAT4* dst, int dstPitch,
+	int width, int height, const std::vector<float>& weights)
+{
+	const int taps = (int)weights.size();
+	const int blurRadius = taps / 2;
+	const bool avx2 = UsesAvx2();
+
+	const int bandCount = WorkerCount() * 4;
+	const int bandSize = std::max((height + bandCount - 1) / bandCount, 1);
+
+	ParallelForRange(height, bandSize, [&](int begin, int end)
+	{
+		// Row plus the clamped border pixels, like the groupshared cache.
+		std::vector<XMFLOAT4> padded((size_t)width + 2 * blurRadius);
+
+		for (int y = begin; y < end; ++y)
+		{
+			const XMFLOAT4* row = src + (size_t)y*srcPitch;
+			for (int i = 0; i < blurRadius; ++i)
+			{
+				padded[i] = row[0];
+				padded[(size_t)blurRadius + width + i] = row[width - 1];
+			}
+			std::copy(row, row + width, padded.begin() + blurRadius);
+
+			XMFLOAT4* out = dst + (size_t)y*dstPitch;
+			if (avx2)
+				BlurRowAvx2(padded.data(), out, width, weights.data(), taps);
+			else
+				BlurRowScalar(padded.data(), out, width, weights.data(), taps);
+		}
+	});
+}
+
+void CpuBlurFilter::Transpose(const XMFLOAT4* src, int srcPitch, XMFLOAT4* dst, int dstPitch,
+	int width, int height)
+{
+	const int blockRows = (height + TransposeBlock - 1) / TransposeBlock;
+
+	ParallelFor(0, blockRows, [&](int blockRow)
+	{
+		const int y0 = blockRow*TransposeBlock;
+		const int y1 = std::min(y0 + TransposeBlock, height);
+
+		for (int x0 = 0; x0 < width; x0 += TransposeBlock)
+		{
+			const int x1 = std::min(x0 + TransposeBlock, width);
+			for (int y = y0; y < y1; ++y)
+			{
+				const XMFLOAT4* srcRow = src + (size_t)y*srcPitch;
+				for (int x = x0; x < x1; ++x)
+					dst[(size_t)x*dstPitch + y] = srcRow[x];
+			}
+		}
+	});
+}
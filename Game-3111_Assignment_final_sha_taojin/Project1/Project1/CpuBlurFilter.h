@@ -0,0 +1,55 @@
+//***************************************************************************************
+// CpuBlurFilter.h
+//
+// CPU version of the separable Gaussian blur in Shaders/Blur.hlsl.  It uses the same
+// weights as BlurFilter::CalcGaussWeights and clamps at the image borders the way
+// HorzBlurCS/VertBlurCS fill their groupshared cache, so its output is a reference for
+// the compute shaders and the blur stage of the software renderer.
+//
+// Rows are blurred in bands across the workers, two pixels per AVX2 register when the
+// CPU supports it.  The vertical pass transposes the image in cache sized blocks and
+// reuses the row kernel instead of striding down columns.
+//***************************************************************************************
+
+#pragma once
+
+#include <DirectXMath.h>
+#include <vector>
+
+class CpuBlurFilter
+{
+public:
+	// Same limit as gMaxBlurRadius in Blur.hlsl.
+	static const int MaxBlurRadius = 5;
+
+	CpuBlurFilter() = default;
+	CpuBlurFilter(const CpuBlurFilter& rhs) = delete;
+	CpuBlurFilter& operator=(const CpuBlurFilter& rhs) = delete;
+	~CpuBlurFilter() = default;
+
+	// 2*radius + 1 normalized weights with radius = ceil(2*sigma), as on the GPU side.
+	static std::vector<float> CalcGaussWeights(float sigma);
+
+	// Blurs the width x height image in place, blurCount times horizontally then
+	// vertically.  rowPitch is in pixels.
+	void Execute(DirectX::XMFLOAT4* image, int width, int height, int rowPitch, float sigma, int blurCount);
+	void Execute(DirectX::XMFLOAT4* image, int width, int height, int rowPitch,
+		const std::vector<float>& weights, int blurCount);
+
+	// True if the rows are blurred with AVX2.
+	static bool UsesAvx2();
+
+private:
+	// Runs the HorzBlurCS kernel over every row of src into dst.
+	static void BlurRows(const DirectX::XMFLOAT4* src, int srcPitch, DirectX::XMFLOAT4* dst, int dstPitch,
+		int width, int height, const std::vector<float>& weights);
+
+	// dst[x][y] = src[y][x] for a width x height src.
+	static void Transpose(const DirectX::XMFLOAT4* src, int srcPitch, DirectX::XMFLOAT4* dst, int dstPitch,
+		int width, int height);
+
+private:
+	std::vector<DirectX::XMFLOAT4> mRows;
+	std::vector<DirectX::XMFLOAT4> mColumns;
+	std::vector<DirectX::XMFLOAT4> mBlurredColumns;
+};
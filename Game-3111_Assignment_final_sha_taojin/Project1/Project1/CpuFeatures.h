@@ -0,0 +1,37 @@
+//***************************************************************************************
+// CpuFeatures.h
+//
+// Run-time checks for the instruction sets the CPU modules have paths for.  A module
+// compiles its AVX2 functions for that target alone and calls them only when the check
+// passes, so the rest of the engine keeps the baseline instruction set.
+//***************************************************************************************
+
+#pragma once
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// True if the CPU has AVX2 and the OS saves the YMM registers.
+inline bool CpuSupportsAvx2()
+{
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+
+	__cpuid(info, 1);
+	const bool osxsave = (info[2] & (1 << 27)) != 0;
+	const bool avx = (info[2] & (1 << 28)) != 0;
+
+	// The OS must also save the YMM registers.
+	if (!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+		return false;
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
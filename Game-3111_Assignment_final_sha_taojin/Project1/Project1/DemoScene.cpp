@@ -0,0 +1,917 @@
+//***************************************************************************************
+// DemoScene.cpp
+//***************************************************************************************
+
+#include "DemoScene.h"
+#include "../../Common/Camera.h"
+#include "../../Common/DDSLayout.h"
+#include "../../Common/GeometryGenerator.h"
+#include "LightClusters.h"
+#include "MappedFile.h"
+#include "MeshImporter.h"
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <cstring>
+
+using namespace DirectX;
+
+const DemoTexture gDemoTextures[DemoTextureCount] =
+{
+	//A2
+	{ "grassTex", "grass" },
+	{ "waterTex", "water1" },
+	{ "fenceTex", "WireFence" },
+	{ "iceTex", "ice" },
+	{ "bricksTex", "bricks" },
+	{ "testcolorTex", "testcolor" },
+	{ "doorTex", "door" },
+	{ "wallsTex", "walls" },
+	{ "checkboardTex", "checkboard" },
+	{ "treeArrayTex", "treeArray" },
+	{ "usFlagTex", "us" },
+	{ "ukFlagTex", "uk" },
+	{ "canadaFlagTex", "canada" },
+
+	// The character's diffuse maps, one per HumanoidPart, then the crates'.
+	{ "headTex", "head_diff" },
+	{ "upBodyTex", "upBody_diff" },
+	{ "jacketTex", "jacket_diff" },
+	{ "pantsTex", "pants_diff" },
+
+	// And the physics crates.
+	{ "crate01Tex", "WoodCrate01" },
+	{ "crate02Tex", "WoodCrate02" }
+};
+
+const char* const gDemoFlagMaterials[3] = { "usFlag", "ukFlag", "canadaFlag" };
+const char* const gDemoCrowdParts[HumanoidPartCount] = { "head", "body", "arms", "legs" };
+const char* const gDemoCrowdMaterials[HumanoidPartCount] = { "characterHead", "characterBody", "characterJacket", "characterPants" };
+
+void BuildDemoHeightmap(Heightmap& heightmap)
+{
+	// Bake the land heightfield at twice the land grid resolution.
+	heightmap.Resize(101, 101, 120.0f, 120.0f);
+	heightmap.Bake(Heightmap::HillsHeight4);
+}
+
+std::unique_ptr<Waves> BuildDemoWaves()
+{
+	return std::make_unique<Waves>(128, 128, 1.0f, 0.03f, 4.0f, 0.2f);
+}
+
+DemoMesh BuildLandMesh(const Heightmap& heightmap)
+{
+	GeometryGenerator geoGen;
+	//ground size and location
+	GeometryGenerator::MeshData grid = geoGen.CreateGrid(120.0f, 120.0f, 50, 50);
+
+	// The land is drawn flat; the normals still follow the hills.
+	std::vector<Vertex> vertices(grid.Vertices.size());
+	for (size_t i = 0; i < grid.Vertices.size(); ++i)
+	{
+		auto& p = grid.Vertices[i].Position;
+		vertices[i].Pos = p;
+		vertices[i].Pos.y = 0.5;/*heightmap.Height(p.x, p.z);*/
+		vertices[i].Normal = heightmap.Normal(p.x, p.z);
+		vertices[i].TexC = grid.Vertices[i].TexC;
+	}
+
+	std::vector<std::uint16_t> indices = grid.GetIndices16();
+
+	DemoMesh mesh;
+	mesh.Name = "landGeo";
+	mesh.SetVertices(vertices.data(), vertices.size());
+	mesh.SetIndices(indices.data(), indices.size());
+
+	DemoSubmesh submesh;
+	submesh.IndexCount = (std::uint32_t)indices.size();
+	mesh.DrawArgs["grid"] = submesh;
+
+	return mesh;
+}
+
+DemoMesh BuildWavesMesh(const Waves& waves)
+{
+	std::vector<std::uint16_t> indices(3 * waves.TriangleCount()); // 3 indices per face
+	assert(waves.VertexCount() < 0x0000ffff);
+
+	// Iterate over each quad.
+	int m = waves.RowCount();
+	int n = waves.ColumnCount();
+	int k = 0;
+	for (int i = 0; i < m - 1; ++i)
+	{
+		for (int j = 0; j < n - 1; ++j)
+		{
+			indices[k] = i * n + j;
+			indices[k + 1] = i * n + j + 1;
+			indices[k + 2] = (i + 1) * n + j;
+
+			indices[k + 3] = (i + 1) * n + j;
+			indices[k + 4] = i * n + j + 1;
+			indices[k + 5] = (i + 1) * n + j + 1;
+
+			k += 6; // next quad
+		}
+	}
+
+	DemoMesh mesh;
+	mesh.Name = "waterGeo";
+	mesh.VertexByteStride = sizeof(Vertex);
+	mesh.VertexCount = (std::uint32_t)waves.VertexCount();
+	mesh.SetIndices(indices.data(), indices.size());
+
+	DemoSubmesh submesh;
+	submesh.IndexCount = (std::uint32_t)indices.size();
+	mesh.DrawArgs["grid"] = submesh;
+
+	return mesh;
+}
+
+DemoMesh BuildShapesMesh()
+{
+	GeometryGenerator geoGen;
+	GeometryGenerator::MeshData box = geoGen.CreateBox(1.0f, 1.0f, 1.0f, 0);//box
+	GeometryGenerator::MeshData sphere = geoGen.CreateSphere(0.5f, 20, 20);//ball
+	GeometryGenerator::MeshData cylinder = geoGen.CreateCylinder(0.5f, 0.3f, 3.0f, 20, 20);//Cylinder
+	GeometryGenerator::MeshData cone = geoGen.CreateCone(0.5f, 1.0f, 20, 20);
+	GeometryGenerator::MeshData Pyramid_flat_head = geoGen.CreatePyramid_flat_head(1.5f, 2.0f, 1.0f, 0);
+	GeometryGenerator::MeshData Pyramid_pointed_head = geoGen.CreatePyramid_pointed_head(1.5f, 0.5f, 0);
+	GeometryGenerator::MeshData wedge = geoGen.CreateWedge(1.0, 1.0f, 1.0, 3);
+	GeometryGenerator::MeshData pointed_cylinder = geoGen.Createpointed_cylinder(5.0f, 5.0f, 1);
+
+	// Vertex Cache
+	std::uint32_t boxVertexOffset = 0;
+	std::uint32_t sphereVertexOffset = boxVertexOffset + (std::uint32_t)box.Vertices.size();
+	std::uint32_t cylinderVertexOffset = sphereVertexOffset + (std::uint32_t)sphere.Vertices.size();
+	std::uint32_t coneVertexOffset = cylinderVertexOffset + (std::uint32_t)cylinder.Vertices.size();
+	std::uint32_t Pyramid_flat_headVertexOffset = coneVertexOffset + (std::uint32_t)cone.Vertices.size();
+	std::uint32_t Pyramid_pointed_headVertexOffset = Pyramid_flat_headVertexOffset + (std::uint32_t)Pyramid_flat_head.Vertices.size();
+	std::uint32_t wedgeVertexOffset = Pyramid_pointed_headVertexOffset + (std::uint32_t)Pyramid_pointed_head.Vertices.size();
+	std::uint32_t pointed_cylinderVertexOffset = wedgeVertexOffset + (std::uint32_t)wedge.Vertices.size();
+
+	//Index Cache
+	std::uint32_t boxIndexOffset = 0;
+	std::uint32_t sphereIndexOffset = boxIndexOffset + (std::uint32_t)box.Indices32.size();
+	std::uint32_t cylinderIndexOffset = sphereIndexOffset + (std::uint32_t)sphere.Indices32.size();
+	std::uint32_t coneIndexOffset = cylinderIndexOffset + (std::uint32_t)cylinder.Indices32.size();
+	std::uint32_t Pyramid_flat_headIndexOffset = coneIndexOffset + (std::uint32_t)cone.Indices32.size();
+	std::uint32_t Pyramid_pointed_headIndexOffset = Pyramid_flat_headIndexOffset + (std::uint32_t)Pyramid_flat_head.Indices32.size();
+	std::uint32_t wedgeIndexOffset = Pyramid_pointed_headIndexOffset + (std::uint32_t)Pyramid_pointed_head.Indices32.size();
+	std::uint32_t pointed_cylinderIndexOffset = wedgeIndexOffset + (std::uint32_t)wedge.Indices32.size();
+
+	DemoSubmesh boxSubmesh;
+	boxSubmesh.IndexCount = (std::uint32_t)box.Indices32.size();
+	boxSubmesh.StartIndexLocation = boxIndexOffset;
+	boxSubmesh.BaseVertexLocation = boxVertexOffset;
+
+	DemoSubmesh sphereSubmesh;
+	sphereSubmesh.IndexCount = (std::uint32_t)sphere.Indices32.size();
+	sphereSubmesh.StartIndexLocation = sphereIndexOffset;
+	sphereSubmesh.BaseVertexLocation = sphereVertexOffset;
+
+	DemoSubmesh cylinderSubmesh;
+	cylinderSubmesh.IndexCount = (std::uint32_t)cylinder.Indices32.size();
+	cylinderSubmesh.StartIndexLocation = cylinderIndexOffset;
+	cylinderSubmesh.BaseVertexLocation = cylinderVertexOffset;
+
+	DemoSubmesh coneSubmesh;
+	coneSubmesh.IndexCount = (std::uint32_t)cone.Indices32.size();
+	coneSubmesh.StartIndexLocation = coneIndexOffset;
+	coneSubmesh.BaseVertexLocation = coneVertexOffset;
+
+	DemoSubmesh Pyramid_flat_headSubmesh;
+	Pyramid_flat_headSubmesh.IndexCount = (std::uint32_t)Pyramid_flat_head.Indices32.size();
+	Pyramid_flat_headSubmesh.StartIndexLocation = Pyramid_flat_headIndexOffset;
+	Pyramid_flat_headSubmesh.BaseVertexLocation = Pyramid_flat_headVertexOffset;
+
+	DemoSubmesh Pyramid_pointed_headSubmesh;
+	Pyramid_pointed_headSubmesh.IndexCount = (std::uint32_t)Pyramid_pointed_head.Indices32.size();
+	Pyramid_pointed_headSubmesh.StartIndexLocation = Pyramid_pointed_headIndexOffset;
+	Pyramid_pointed_headSubmesh.BaseVertexLocation = Pyramid_pointed_headVertexOffset;
+
+	DemoSubmesh wedgeSubmesh;
+	wedgeSubmesh.IndexCount = (std::uint32_t)wedge.Indices32.size();
+	wedgeSubmesh.StartIndexLocation = wedgeIndexOffset;
+	wedgeSubmesh.BaseVertexLocation = wedgeVertexOffset;
+
+	DemoSubmesh pointed_cylinderSubmesh;
+	pointed_cylinderSubmesh.IndexCount = (std::uint32_t)pointed_cylinder.Indices32.size();
+	pointed_cylinderSubmesh.StartIndexLocation = pointed_cylinderIndexOffset;
+	pointed_cylinderSubmesh.BaseVertexLocation = pointed_cylinderVertexOffset;
+
+	auto totalVertexCount =
+		box.Vertices.size() +
+		sphere.Vertices.size() +
+		cylinder.Vertices.size() +
+		cone.Vertices.size() +
+		Pyramid_flat_head.Vertices.size() +
+		Pyramid_pointed_head.Vertices.size() +
+		wedge.Vertices.size() +
+		pointed_cylinder.Vertices.size()
+		;
+
+	std::vector<Vertex> vertices(totalVertexCount);
+
+	std::uint32_t k = 0;
+	for (size_t i = 0; i < box.Vertices.size(); ++i, ++k)
+	{
+		auto& p = box.Vertices[i].Position;
+		vertices[k].Pos = p;
+		vertices[k].Normal = box.Vertices[i].Normal;
+		vertices[k].TexC = box.Vertices[i].TexC;
+	}
+	for (size_t i = 0; i < sphere.Vertices.size(); ++i, ++k)
+	{
+		vertices[k].Pos = sphere.Vertices[i].Position;
+		vertices[k].Normal = sphere.Vertices[i].Normal;
+		vertices[k].TexC = sphere.Vertices[i].TexC;
+	}
+
+	for (size_t i = 0; i < cylinder.Vertices.size(); ++i, ++k)
+	{
+		vertices[k].Pos = cylinder.Vertices[i].Position;
+		vertices[k].Normal = cylinder.Vertices[i].Normal;
+		vertices[k].TexC = cylinder.Vertices[i].TexC;
+	}
+	for (size_t i = 0; i < cone.Vertices.size(); ++i, ++k)
+	{
+		vertices[k].Pos = cone.Vertices[i].Position;
+		vertices[k].Normal = cone.Vertices[i].Normal;
+		vertices[k].TexC = cone.Vertices[i].TexC;
+	}
+
+	for (size_t i = 0; i < wedge.Vertices.size(); ++i, ++k)
+	{
+		vertices[k].Pos = wedge.Vertices[i].Position;
+		vertices[k].Normal = wedge.Vertices[i].Normal;
+		vertices[k].TexC = wedge.Vertices[i].TexC;
+	}
+
+	for (size_t i = 0; i < Pyramid_flat_head.Vertices.size(); ++i, ++k)
+	{
+		vertices[k].Pos = Pyramid_flat_head.Vertices[i].Position;
+		vertices[k].Normal = Pyramid_flat_head.Vertices[i].Normal;
+		vertices[k].TexC = Pyramid_flat_head.Vertices[i].TexC;
+	}
+	for (size_t i = 0; i < Pyramid_pointed_head.Vertices.size(); ++i, ++k)
+	{
+		vertices[k].Pos = Pyramid_pointed_head.Vertices[i].Position;
+		vertices[k].Normal = Pyramid_flat_head.Vertices[i].Normal;
+		vertices[k].TexC = Pyramid_flat_head.Vertices[i].TexC;
+	}
+
+	for (size_t i = 0; i < pointed_cylinder.Vertices.size(); ++i, ++k)
+	{
+		vertices[k].Pos = pointed_cylinder.Vertices[i].Position;
+		vertices[k].Normal = pointed_cylinder.Vertices[i].Normal;
+		vertices[k].TexC = pointed_cylinder.Vertices[i].TexC;
+	}
+
+	std::vector<std::uint16_t> indices;
+	indices.insert(indices.end(), std::begin(box.GetIndices16()), std::end(box.GetIndices16()));
+	indices.insert(indices.end(), std::begin(sphere.GetIndices16()), std::end(sphere.GetIndices16()));
+	indices.insert(indices.end(), std::begin(cylinder.GetIndices16()), std::end(cylinder.GetIndices16()));
+	indices.insert(indices.end(), std::begin(cone.GetIndices16()), std::end(cone.GetIndices16()));
+	indices.insert(indices.end(), std::begin(Pyramid_flat_head.GetIndices16()), std::end(Pyramid_flat_head.GetIndices16()));
+	indices.insert(indices.end(), std::begin(Pyramid_pointed_head.GetIndices16()), std::end(Pyramid_pointed_head.GetIndices16()));
+	indices.insert(indices.end(), std::begin(wedge.GetIndices16()), std::end(wedge.GetIndices16()));
+	indices.insert(indices.end(), std::begin(pointed_cylinder.GetIndices16()), std::end(pointed_cylinder.GetIndices16()));
+
+	DemoMesh mesh;
+	mesh.Name = "boxGeo";
+	mesh.SetVertices(vertices.data(), vertices.size());
+	mesh.SetIndices(indices.data(), indices.size());
+
+	mesh.DrawArgs["box"] = boxSubmesh;
+	mesh.DrawArgs["sphere"] = sphereSubmesh;
+	mesh.DrawArgs["cylinder"] = cylinderSubmesh;
+	mesh.DrawArgs["cone"] = coneSubmesh;
+	mesh.DrawArgs["Pyramid_flat_head"] = Pyramid_flat_headSubmesh;
+	mesh.DrawArgs["Pyramid_pointed_head"] = Pyramid_pointed_headSubmesh;
+	mesh.DrawArgs["wedge"] = wedgeSubmesh;
+	mesh.DrawArgs["pointed_cylinder"] = pointed_cylinderSubmesh;
+
+	return mesh;
+}
+
+DemoMesh BuildTreeSpritesMesh()
+{
+	//A2
+	//step5
+	static const int treeCount = 20;
+	std::array<TreeSpriteVertex, 20> vertices;
+	for (std::uint32_t i = 0; i < treeCount; ++i)
+	{
+		float x = MathHelper::RandF(-40.0f, 40.0f);
+		float z = MathHelper::RandF(-50.0f, -40.0f);
+
+		// Move tree slightly above land height.
+		float y = 9.5f;
+		if (i <= 10)
+		{
+			vertices[i].Pos = XMFLOAT3(x, y, z);
+			vertices[i].Size = XMFLOAT2(20.0f, 20.0f);
+		}
+
+		else if (10 < i && i <= 20)
+		{
+			vertices[i].Pos = XMFLOAT3(x, y, -z);
+			vertices[i].Size = XMFLOAT2(20.0f, 20.0f);
+		}
+	}
+
+	std::array<std::uint16_t, 20> indices =
+	{
+		0, 1, 2, 3, 4, 5, 6, 7,
+		8, 9, 10, 11, 12, 13, 14, 15,16,17,18,19
+	};
+
+	DemoMesh mesh;
+	mesh.Name = "treeSpritesGeo";
+	mesh.SetVertices(vertices.data(), vertices.size());
+	mesh.SetIndices(indices.data(), indices.size());
+
+	DemoSubmesh submesh;
+	submesh.IndexCount = (std::uint32_t)indices.size();
+	mesh.DrawArgs["points"] = submesh;
+
+	return mesh;
+}
+
+DemoMesh BuildCapsuleMesh()
+{
+	// A unit sphere split at the equator, the halves pulled a unit apart: a capsule of
+	// radius 0.5 around a segment of length 1 along y.  The odd stack count leaves no
+	// ring on the equator, so the band across it becomes the side.
+	GeometryGenerator geoGen;
+	GeometryGenerator::MeshData sphere = geoGen.CreateSphere(0.5f, 20, 19);
+
+	std::vector<Vertex> vertices(sphere.Vertices.size());
+	for (size_t i = 0; i < sphere.Vertices.size(); ++i)
+	{
+		vertices[i].Pos = sphere.Vertices[i].Position;
+		vertices[i].Pos.y += vertices[i].Pos.y > 0.0f ? 0.5f : -0.5f;
+		vertices[i].Normal = sphere.Vertices[i].Normal;
+		vertices[i].TexC = sphere.Vertices[i].TexC;
+	}
+
+	std::vector<std::uint16_t> indices = sphere.GetIndices16();
+
+	DemoMesh mesh;
+	mesh.Name = "capsuleGeo";
+	mesh.SetVertices(vertices.data(), vertices.size());
+	mesh.SetIndices(indices.data(), indices.size());
+
+	DemoSubmesh submesh;
+	submesh.IndexCount = (std::uint32_t)indices.size();
+	mesh.DrawArgs["capsule"] = submesh;
+
+	return mesh;
+}
+
+DemoMesh BuildClothMesh(const ClothSystem& cloth)
+{
+	const std::vector<std::uint32_t>& indices = cloth.Indices();
+
+	// The flags' draws come from the ClothSystem, so there are no draw args.
+	DemoMesh mesh;
+	mesh.Name = "clothGeo";
+	mesh.VertexByteStride = sizeof(ClothVertex);
+	mesh.VertexCount = (std::uint32_t)cloth.VertexCount();
+	mesh.SetIndices(indices.data(), indices.size());
+
+	return mesh;
+}
+
+DemoMesh BuildCrowdMesh(const HumanoidAsset& humanoid, const SkinnedCrowd& crowd)
+{
+	// One draw per part for the whole crowd: the part's indices are repeated for every
+	// character, offset to the character's vertices in SkinnedVB.
+	const std::uint32_t vertexCount = (std::uint32_t)crowd.Mesh().VertexCount();
+	std::vector<std::uint32_t> indices;
+	indices.reserve(humanoid.Indices.size()*crowd.CharacterCount());
+
+	DemoMesh mesh;
+	mesh.Name = "crowdGeo";
+
+	for (int part = 0; part < HumanoidPartCount; ++part)
+	{
+		DemoSubmesh submesh;
+		submesh.StartIndexLocation = (std::uint32_t)indices.size();
+
+		const int first = humanoid.PartFirstIndex[part];
+		const int count = humanoid.PartIndexCount[part];
+		for (int c = 0; c < crowd.CharacterCount(); ++c)
+		{
+			for (int i = first; i < first + count; ++i)
+				indices.push_back(humanoid.Indices[i] + c*vertexCount);
+		}
+
+		submesh.IndexCount = (std::uint32_t)indices.size() - submesh.StartIndexLocation;
+		mesh.DrawArgs[gDemoCrowdParts[part]] = submesh;
+	}
+
+	mesh.VertexByteStride = sizeof(SkinnedVertex);
+	mesh.VertexCount = (std::uint32_t)crowd.VertexCount();
+	mesh.SetIndices(indices.data(), indices.size());
+
+	return mesh;
+}
+
+bool BuildImportedMesh(const std::string& name, const std::wstring& filename, DemoMesh& mesh, std::string& error)
+{
+	static_assert(sizeof(MeshVertex) == sizeof(Vertex), "MeshVertex is copied into the vertex buffer as is");
+
+	// Tools' mesh command times the import of a file.
+	MeshImporter importer;
+	ImportedMesh imported;
+	if (!importer.Import(filename, imported))
+	{
+		error = name + ": " + importer.Error();
+		return false;
+	}
+
+	mesh.Name = name;
+	mesh.SetVertices(imported.Vertices.data(), imported.Vertices.size());
+	mesh.SetIndices(imported.Indices.data(), imported.Indices.size());
+	mesh.DrawArgs.clear();
+
+	// One draw arg per material (OBJ) or primitive (glTF), named as in the file.
+	for (const ImportedSubmesh& part : imported.Submeshes)
+	{
+		DemoSubmesh submesh;
+		submesh.IndexCount = part.IndexCount;
+		submesh.StartIndexLocation = part.StartIndex;
+		const XMVECTOR lo = XMLoadFloat3(&part.BoundsMin);
+		const XMVECTOR hi = XMLoadFloat3(&part.BoundsMax);
+		XMStoreFloat3(&submesh.Bounds.Center, 0.5f*(lo + hi));
+		XMStoreFloat3(&submesh.Bounds.Extents, 0.5f*(hi - lo));
+
+		mesh.DrawArgs[part.Name] = submesh;
+	}
+
+	return true;
+}
+
+void WriteWavesVertices(const Waves& waves, Vertex* out)
+{
+	for (int i = 0; i < waves.VertexCount(); ++i)
+	{
+		Vertex& v = out[i];
+		v.Pos = waves.Position(i);
+		v.Normal = waves.Normal(i);
+		v.TexC.x = 0.5f + v.Pos.x / waves.Width();
+		v.TexC.y = 0.5f - v.Pos.z / waves.Depth();
+	}
+}
+
+bool BuildDemoFlags(ClothSystem& cloth)
+{
+	// Twelve poles in each of two rows; the flags start downwind of their poles.
+	std::vector<ClothFlagDesc> flags;
+	for (int row = 0; row < 2; ++row)
+	{
+		for (int k = 0; k < 12; ++k)
+		{
+			ClothFlagDesc flag;
+			flag.Width = 4.0f;
+			flag.Height = 2.6f;
+			flag.Columns = 20;
+			flag.Rows = 13;
+			flag.Position = XMFLOAT3(-44.0f + 8.0f*k, 10.5f, -50.0f + 8.0f*row);
+			flag.Yaw = 0.3f;
+			flags.push_back(flag);
+		}
+	}
+
+	return cloth.Create(flags);
+}
+
+bool BuildDemoCrowd(HumanoidAsset& humanoid, SkinnedCrowd& crowd)
+{
+	if (!BuildHumanoid(2.4f, humanoid))
+		return false;
+
+	SkinnedMesh mesh;
+	if (!mesh.Create(humanoid.Vertices, humanoid.Indices, humanoid.Bones.JointCount()))
+		return false;
+
+	// Four rows of 24: the outer two walk east and west, the inner two stand idle
+	// facing the flags.  Speeds and clip times are staggered so no two move in step.
+	const int rows = 4;
+	const int columns = 24;
+	if (!crowd.Create(humanoid.Bones, mesh, humanoid.Clips, rows*columns))
+		return false;
+
+	for (int row = 0; row < rows; ++row)
+	{
+		const bool walking = row == 0 || row == rows - 1;
+		const float yaw = walking ? (row == 0 ? XM_PIDIV2 : -XM_PIDIV2) : XM_PI;
+
+		for (int k = 0; k < columns; ++k)
+		{
+			CrowdCharacter& character = crowd.Character(row*columns + k);
+			const float x = -46.0f + (92.0f / columns)*(k + 0.5f*(row & 1));
+			XMStoreFloat4x4(&character.World, XMMatrixRotationY(yaw) * XMMatrixTranslation(x, 0.5f, -36.0f + 4.0f*row));
+
+			character.Clip = walking ? HumanoidWalk : HumanoidIdle;
+			character.Speed = 0.85f + 0.3f*MathHelper::RandF();
+			character.Time = MathHelper::RandF()*humanoid.Clips[character.Clip].Duration();
+		}
+	}
+
+	return true;
+}
+
+void BuildDemoMaterials(std::unordered_map<std::string, std::unique_ptr<Material>>& materials)
+{
+	int i = 0;
+	auto grass = std::make_unique<Material>();
+	grass->Name = "grass";
+	grass->MatCBIndex = i;
+	grass->DiffuseSrvHeapIndex = i;
+	grass->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
+	grass->FresnelR0 = XMFLOAT3(0.01f, 0.01f, 0.01f);
+	grass->Roughness = 0.125f;
+	i++;
+	// This is not a good water material definition, but we do not have all the rendering
+	// tools we need (transparency, environment reflection), so we fake it for now.
+	auto water = std::make_unique<Material>();
+	water->Name = "water";
+	water->MatCBIndex = i;
+	water->DiffuseSrvHeapIndex = i;
+	water->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 0.5f);
+	water->FresnelR0 = XMFLOAT3(0.1f, 0.1f, 0.1f);
+	water->Roughness = 0.0f;
+	i++;
+	auto wirefence = std::make_unique<Material>();
+	wirefence->Name = "wirefence";
+	wirefence->MatCBIndex = i;
+	wirefence->DiffuseSrvHeapIndex = i;
+	wirefence->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
+	wirefence->FresnelR0 = XMFLOAT3(0.02f, 0.02f, 0.02f);
+	wirefence->Roughness = 0.25f;
+	i++;
+
+	auto ice = std::make_unique<Material>();
+	ice->Name = "ice";
+	ice->MatCBIndex = i;
+	ice->DiffuseSrvHeapIndex = i;
+	ice->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
+	ice->FresnelR0 = XMFLOAT3(0.02f, 0.02f, 0.02f);
+	ice->Roughness = 0.2f;
+	i++;
+
+	auto bricks = std::make_unique<Material>();
+	bricks->Name = "bricks";
+	bricks->MatCBIndex = i;
+	bricks->DiffuseSrvHeapIndex = i;
+	bricks->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
+	bricks->FresnelR0 = XMFLOAT3(0.02f, 0.02f, 0.02f);
+	bricks->Roughness = 0.2f;
+	i++;
+
+	auto testcolor = std::make_unique<Material>();
+	testcolor->Name = "testcolor";
+	testcolor->MatCBIndex = i;
+	testcolor->DiffuseSrvHeapIndex = i;
+	testcolor->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
+	testcolor->FresnelR0 = XMFLOAT3(0.02f, 0.02f, 0.02f);
+	testcolor->Roughness = 0.2f;
+	i++;
+
+	auto door = std::make_unique<Material>();
+	door->Name = "door";
+	door->MatCBIndex = i;
+	door->DiffuseSrvHeapIndex = i;
+	door->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
+	door->FresnelR0 = XMFLOAT3(0.02f, 0.02f, 0.02f);
+	door->Roughness = 0.2f;
+	i++;
+
+	auto walls = std::make_unique<Material>();
+	walls->Name = "walls";
+	walls->MatCBIndex = i;
+	walls->DiffuseSrvHeapIndex = i;
+	walls->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
+	walls->FresnelR0 = XMFLOAT3(0.02f, 0.02f, 0.02f);
+	walls->Roughness = 0.2f;
+	i++;
+
+	auto checkboard = std::make_unique<Material>();
+	checkboard->Name = "checkboard";
+	checkboard->MatCBIndex = i;
+	checkboard->DiffuseSrvHeapIndex = i;
+	checkboard->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
+	checkboard->FresnelR0 = XMFLOAT3(0.02f, 0.02f, 0.02f);
+	checkboard->Roughness = 0.2f;
+	i++;
+
+	auto treeSprites = std::make_unique<Material>();
+	treeSprites->Name = "treeSprites";
+	treeSprites->MatCBIndex = i;
+	treeSprites->DiffuseSrvHeapIndex = i;
+	treeSprites->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
+	treeSprites->FresnelR0 = XMFLOAT3(0.01f, 0.01f, 0.01f);
+	treeSprites->Roughness = 0.125f;
+	i++;
+
+	// The particle PS does not sample its texture, but the descriptor table still needs
+	// a Texture2DArray, so the particles point at the tree array.
+	const int treeArraySrvIndex = treeSprites->DiffuseSrvHeapIndex;
+	const char* const particleMaterials[] = { "splashParticle", "snowParticle", "sparkParticle" };
+	const XMFLOAT4 particleColors[] =
+	{
+		XMFLOAT4(0.7f, 0.85f, 1.0f, 0.8f),
+		XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f),
+		XMFLOAT4(1.0f, 0.6f, 0.15f, 1.0f)
+	};
+	for (int p = 0; p < 3; ++p)
+	{
+		auto particle = std::make_unique<Material>();
+		particle->Name = particleMaterials[p];
+		particle->MatCBIndex = i++;
+		particle->DiffuseSrvHeapIndex = treeArraySrvIndex;
+		particle->DiffuseAlbedo = particleColors[p];
+		particle->FresnelR0 = XMFLOAT3(0.02f, 0.02f, 0.02f);
+		particle->Roughness = 0.5f;
+		materials[particle->Name] = std::move(particle);
+	}
+
+	// The flag textures follow the tree array in the SRV heap.
+	for (int f = 0; f < 3; ++f)
+	{
+		auto flag = std::make_unique<Material>();
+		flag->Name = gDemoFlagMaterials[f];
+		flag->MatCBIndex = i++;
+		flag->DiffuseSrvHeapIndex = treeArraySrvIndex + 1 + f;
+		flag->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
+		flag->FresnelR0 = XMFLOAT3(0.02f, 0.02f, 0.02f);
+		flag->Roughness = 0.8f;
+		materials[flag->Name] = std::move(flag);
+	}
+
+	// The character parts follow the flags, in HumanoidPart order.
+	for (int part = 0; part < HumanoidPartCount; ++part)
+	{
+		auto character = std::make_unique<Material>();
+		character->Name = gDemoCrowdMaterials[part];
+		character->MatCBIndex = i++;
+		character->DiffuseSrvHeapIndex = treeArraySrvIndex + 4 + part;
+		character->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
+		character->FresnelR0 = XMFLOAT3(0.04f, 0.04f, 0.04f);
+		character->Roughness = 0.7f;
+		materials[character->Name] = std::move(character);
+	}
+
+	// Then the crates.
+	const char* const crateMaterials[] = { "crate01", "crate02" };
+	for (int c = 0; c < 2; ++c)
+	{
+		auto crate = std::make_unique<Material>();
+		crate->Name = crateMaterials[c];
+		crate->MatCBIndex = i++;
+		crate->DiffuseSrvHeapIndex = treeArraySrvIndex + 4 + HumanoidPartCount + c;
+		crate->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
+		crate->FresnelR0 = XMFLOAT3(0.02f, 0.02f, 0.02f);
+		crate->Roughness = 0.6f;
+		materials[crate->Name] = std::move(crate);
+	}
+
+	materials["grass"] = std::move(grass);
+	materials["water"] = std::move(water);
+	materials["wirefence"] = std::move(wirefence);
+	materials["ice"] = std::move(ice);
+	materials["bricks"] = std::move(bricks);
+	materials["testcolor"] = std::move(testcolor);
+	materials["door"] = std::move(door);
+	materials["walls"] = std::move(walls);
+	materials["checkboard"] = std::move(checkboard);
+	materials["treeSprites"] = std::move(treeSprites);
+}
+
+void BuildDemoLights(DemoLighting& lighting)
+{
+	lighting.DirLights[0].Direction = { 0.57735f, -0.57735f, 0.57735f };
+	lighting.DirLights[0].Strength = { 0.6f, 0.6f, 0.6f };
+	lighting.DirLights[1].Direction = { -0.57735f, -0.57735f, 0.57735f };
+	lighting.DirLights[1].Strength = { 0.3f, 0.3f, 0.3f };
+	lighting.DirLights[2].Direction = { 0.0f, -0.707f, -0.707f };
+	lighting.DirLights[2].Strength = { 0.15f, 0.15f, 0.15f };
+
+	// Lanterns scattered over the maze floor.
+	for (int i = 0; i < 512; ++i)
+	{
+		Light light;
+		light.Position = { MathHelper::RandF(-55.0f, 57.0f), MathHelper::RandF(1.0f, 3.0f), MathHelper::RandF(-33.0f, 35.0f) };
+		light.Strength = { MathHelper::RandF(0.2f, 0.8f), MathHelper::RandF(0.2f, 0.6f), MathHelper::RandF(0.1f, 0.4f) };
+		light.FalloffStart = 1.0f;
+		light.FalloffEnd = MathHelper::RandF(4.0f, 8.0f);
+		lighting.PointLights.push_back(light);
+	}
+
+	// Spot lights shining down on the gate and the maze corners.
+	const XMFLOAT3 spotPositions[] =
+	{
+		{ 20.0f, 12.0f, 0.0f }, { -55.0f, 12.0f, 35.0f }, { 57.0f, 12.0f, 35.0f },
+		{ -55.0f, 12.0f, -33.0f }, { 57.0f, 12.0f, -33.0f }
+	};
+	for (const auto& p : spotPositions)
+	{
+		Light light;
+		light.Position = p;
+		light.Direction = { 0.0f, -1.0f, 0.0f };
+		light.Strength = { 1.0f, 1.0f, 0.9f };
+		light.FalloffStart = 2.0f;
+		light.FalloffEnd = 20.0f;
+		light.SpotPower = 16.0f;
+		lighting.SpotLights.push_back(light);
+	}
+}
+
+bool BuildDemoAmbientSH(const std::wstring& cubeMapFile, DemoLighting& lighting)
+{
+	const XMFLOAT4& ambient = lighting.AmbientLight;
+	lighting.AmbientSH = SH9::Constant(XMFLOAT3(ambient.x, ambient.y, ambient.z));
+
+	MappedFile file;
+	DDSLayout dds;
+	if (!file.Open(cubeMapFile) || ParseDDSLayout(file.Data(), file.Size(), 128, dds) != DDSLayoutResult::Ok)
+		return false;
+	if (!dds.IsCubeMap || dds.ArraySize < 6 || dds.Width != dds.Height)
+		return false;
+
+	CubemapSH::TexelFormat texelFormat;
+	switch (dds.Format)
+	{
+	case DXGI_FORMAT_BC1_UNORM:
+	case DXGI_FORMAT_BC1_UNORM_SRGB:
+		texelFormat = CubemapSH::TexelFormat::BC1;
+		break;
+	case DXGI_FORMAT_R8G8B8A8_UNORM:
+	case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+		texelFormat = CubemapSH::TexelFormat::R8G8B8A8;
+		break;
+	case DXGI_FORMAT_B8G8R8A8_UNORM:
+	case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+		texelFormat = CubemapSH::TexelFormat::B8G8R8A8;
+		break;
+	default:
+		return false;
+	}
+
+	// Subresources are face major; the top returned mip of face f is at f*MipCount.
+	CubemapSH::Face faces[6];
+	for (size_t f = 0; f < 6; ++f)
+	{
+		const DDSSubresource& sub = dds.Subresources[f*dds.MipCount];
+		faces[f].Data = file.Data() + sub.Offset;
+		faces[f].RowPitch = sub.RowPitch;
+	}
+
+	SH9 radiance;
+	if (!CubemapSH::Project(texelFormat, faces, (int)dds.Width, radiance))
+		return false;
+
+	lighting.AmbientSH = radiance.RadianceToIrradiance();
+
+	// Forward shaders without a normal (and anything still using gAmbientLight) see the average.
+	XMFLOAT3 average = lighting.AmbientSH.Average();
+	lighting.AmbientLight = XMFLOAT4(average.x, average.y, average.z, 1.0f);
+	return true;
+}
+
+bool LoadDemoScene(const std::wstring& sceneFile, const std::wstring& compiledFile,
+	SceneFile& scene, std::vector<DemoMesh>& models, std::string& error)
+{
+	if (!scene.Load(sceneFile, compiledFile))
+	{
+		error = scene.Error();
+		return false;
+	}
+
+	const size_t slash = sceneFile.find_last_of(L"/\\");
+	const std::wstring sceneDir = slash == std::wstring::npos ? std::wstring() : sceneFile.substr(0, slash + 1);
+
+	models.resize(scene.MeshCount());
+	for (int i = 0; i < scene.MeshCount(); ++i)
+	{
+		const std::string file = scene.String(scene.Mesh(i).File);
+		if (!BuildImportedMesh(scene.String(scene.Mesh(i).Geometry), sceneDir + std::wstring(file.begin(), file.end()),
+			models[i], error))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+RenderLayer FindRenderLayer(const char* name)
+{
+	const char* const layerNames[(int)RenderLayer::Count] =
+	{
+		"Opaque", "OpaqueBaked", "Transparent", "AlphaTested", "AlphaTestedTreeSprites", "Particles"
+	};
+
+	int layer = 0;
+	while (layer < (int)RenderLayer::Count && std::strcmp(layerNames[layer], name) != 0)
+		++layer;
+	return (RenderLayer)layer;
+}
+
+void SetDemoPassConstants(const Camera& camera, int width, int height, const DemoLighting& lighting,
+	const LightClusterGrid& clusters, PassConstants& pass)
+{
+	XMMATRIX view = camera.GetView();
+	XMMATRIX proj = camera.GetProj();
+
+	XMMATRIX viewProj = XMMatrixMultiply(view, proj);
+	XMVECTOR viewDet = XMMatrixDeterminant(view);
+	XMVECTOR projDet = XMMatrixDeterminant(proj);
+	XMVECTOR viewProjDet = XMMatrixDeterminant(viewProj);
+	XMMATRIX invView = XMMatrixInverse(&viewDet, view);
+	XMMATRIX invProj = XMMatrixInverse(&projDet, proj);
+	XMMATRIX invViewProj = XMMatrixInverse(&viewProjDet, viewProj);
+
+	XMStoreFloat4x4(&pass.View, XMMatrixTranspose(view));
+	XMStoreFloat4x4(&pass.InvView, XMMatrixTranspose(invView));
+	XMStoreFloat4x4(&pass.Proj, XMMatrixTranspose(proj));
+	XMStoreFloat4x4(&pass.InvProj, XMMatrixTranspose(invProj));
+	XMStoreFloat4x4(&pass.ViewProj, XMMatrixTranspose(viewProj));
+	XMStoreFloat4x4(&pass.InvViewProj, XMMatrixTranspose(invViewProj));
+	pass.EyePosW = camera.GetPosition3f();
+	pass.RenderTargetSize = XMFLOAT2((float)width, (float)height);
+	pass.InvRenderTargetSize = XMFLOAT2(1.0f / width, 1.0f / height);
+	pass.NearZ = camera.GetNearZ();
+	pass.FarZ = camera.GetFarZ();
+	pass.AmbientLight = lighting.AmbientLight;
+	for (size_t i = 0; i < lighting.DirLights.size(); ++i)
+		pass.Lights[i] = lighting.DirLights[i];
+	pass.ClusterDims = clusters.Dims();
+	pass.ClusterZParams = clusters.ZParams();
+	for (int i = 0; i < 9; ++i)
+		pass.AmbientSH[i] = XMFLOAT4(lighting.AmbientSH.C[i].x, lighting.AmbientSH.C[i].y, lighting.AmbientSH.C[i].z, 0.0f);
+}
+
+void BakeDemoGeometry(const LightBaker& baker, const LightBakeDesc& desc, const Vertex* vertices,
+	const std::uint16_t* indices, std::vector<DemoBakeItem>& items, DemoBakedGeometry& baked)
+{
+	std::vector<XMFLOAT3>& positions = baked.Positions;
+	std::vector<XMFLOAT3>& normals = baked.Normals;
+	std::vector<XMFLOAT4>& colors = baked.Colors;
+
+	size_t runStart = 0;
+
+	for (size_t n = 0; n < items.size(); ++n)
+	{
+		DemoBakeItem& item = items[n];
+
+		// Vertex range referenced by the item's submesh.
+		std::uint32_t first = UINT_MAX;
+		std::uint32_t last = 0;
+		for (std::uint32_t k = 0; k < item.IndexCount; ++k)
+		{
+			std::uint32_t v = item.BaseVertexLocation + indices[item.StartIndexLocation + k];
+			first = std::min(first, v);
+			last = std::max(last, v);
+		}
+
+		// The item's color view starts `first` colors before its block so vertex
+		// indices line up with slot 0.
+		const std::uint32_t blockStart = std::max((std::uint32_t)positions.size(), first);
+		positions.resize(blockStart, XMFLOAT3(0.0f, 0.0f, 0.0f));
+		normals.resize(blockStart, XMFLOAT3(0.0f, 1.0f, 0.0f));
+		item.BakedLightOffset = (int)(blockStart - first);
+		if (n == 0 || items[n - 1].Mat != item.Mat)
+			runStart = blockStart;
+
+		XMMATRIX world = XMLoadFloat4x4(&item.World);
+		XMMATRIX worldInvTranspose = MathHelper::InverseTranspose(world);
+		for (std::uint32_t v = first; v <= last; ++v)
+		{
+			XMFLOAT3 p, nrm;
+			XMStoreFloat3(&p, XMVector3TransformCoord(XMLoadFloat3(&vertices[v].Pos), world));
+			XMStoreFloat3(&nrm, XMVector3Normalize(XMVector3TransformNormal(XMLoadFloat3(&vertices[v].Normal), worldInvTranspose)));
+			positions.push_back(p);
+			normals.push_back(nrm);
+		}
+
+		if (n + 1 < items.size() && items[n + 1].Mat == item.Mat)
+			continue;
+
+		// The baked color is multiplied by the albedo in the shader.
+		DemoBakedGeometry::Run run;
+		run.Start = runStart;
+		run.End = positions.size();
+		run.Mat.FresnelR0 = item.Mat->FresnelR0;
+		run.Mat.Shininess = 1.0f - item.Mat->Roughness;
+		baked.Runs.push_back(run);
+
+		colors.resize(positions.size());
+		baker.Bake(desc, run.Mat, &positions[run.Start], &normals[run.Start],
+			run.End - run.Start, &colors[run.Start]);
+	}
+}
@@ -0,0 +1,220 @@
+//***************************************************************************************
+// DemoScene.h
+//
+// The CPU side of the tree billboards scene: its textures, geometry, materials, lights,
+// flags and crowd, the items of Scenes/TreeBillboards.scene and the static light bake.
+// The demo builds these at startup and uploads them; Tools' render command builds the
+// same scene and draws it with the software rasterizer, so reference images can be
+// rendered without Direct3D.  Nothing here includes the Direct3D headers.
+//***************************************************************************************
+
+#pragma once
+
+#include "../../Common/ShadingTypes.h"
+#include "ClothSystem.h"
+#include "Heightmap.h"
+#include "Humanoid.h"
+#include "LightBaker.h"
+#include "RenderTypes.h"
+#include "SceneFile.h"
+#include "Skinning.h"
+#include "SphericalHarmonics.h"
+#include "Waves.h"
+#include <DirectXCollision.h>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Camera;
+class LightClusterGrid;
+
+// A diffuse texture: its name in the demo's texture table and its file, <File>.dds in
+// the Textures directory.
+struct DemoTexture
+{
+	const char* Name;
+	const char* File;
+};
+
+// In SRV heap order; Material::DiffuseSrvHeapIndex indexes this table.
+const int DemoTextureCount = 19;
+extern const DemoTexture gDemoTextures[DemoTextureCount];
+
+// Flag f has the material gDemoFlagMaterials[f % 3].  Crowd part p draws the draw arg
+// gDemoCrowdParts[p] of crowdGeo with the material gDemoCrowdMaterials[p].
+extern const char* const gDemoFlagMaterials[3];
+extern const char* const gDemoCrowdParts[HumanoidPartCount];
+extern const char* const gDemoCrowdMaterials[HumanoidPartCount];
+
+// A draw arg of a DemoMesh, as SubmeshGeometry.  Bounds is only set for imported models.
+struct DemoSubmesh
+{
+	std::uint32_t IndexCount = 0;
+	std::uint32_t StartIndexLocation = 0;
+	int BaseVertexLocation = 0;
+	DirectX::BoundingBox Bounds;
+};
+
+// A geometry as MeshGeometry holds it in system memory.  Geometry whose vertices are
+// streamed every frame (the waves, the flags and the crowd) has no Vertices, only their
+// count and stride.
+struct DemoMesh
+{
+	std::string Name;
+
+	std::vector<std::uint8_t> Vertices;
+	std::uint32_t VertexByteStride = 0;
+	std::uint32_t VertexCount = 0;
+
+	std::vector<std::uint8_t> Indices;
+	bool Index32 = false;
+
+	std::unordered_map<std::string, DemoSubmesh> DrawArgs;
+
+	template<typename T>
+	void SetVertices(const T* vertices, size_t count)
+	{
+		VertexByteStride = (std::uint32_t)sizeof(T);
+		VertexCount = (std::uint32_t)count;
+		Vertices.resize(count*sizeof(T));
+		if (count > 0)
+			std::memcpy(Vertices.data(), vertices, count*sizeof(T));
+	}
+
+	// T is std::uint16_t or std::uint32_t.
+	template<typename T>
+	void SetIndices(const T* indices, size_t count)
+	{
+		Index32 = sizeof(T) == sizeof(std::uint32_t);
+		Indices.resize(count*sizeof(T));
+		if (count > 0)
+			std::memcpy(Indices.data(), indices, count*sizeof(T));
+	}
+
+	std::uint32_t IndexCount()const { return (std::uint32_t)(Indices.size() / (Index32 ? 4 : 2)); }
+};
+
+// The point list vertex of TreeSprite.hlsl.
+struct TreeSpriteVertex
+{
+	DirectX::XMFLOAT3 Pos;
+	DirectX::XMFLOAT2 Size;
+};
+
+// The lights of the scene.  The directional lights and the ambient are shared by the
+// pass constants and the light baker; the point and spot lights are culled into the
+// light clusters every frame.
+struct DemoLighting
+{
+	std::array<Light, 3> DirLights;
+	DirectX::XMFLOAT4 AmbientLight = { 0.25f, 0.25f, 0.35f, 1.0f };
+
+	// Irradiance of the environment cube map; AmbientLight becomes its average.
+	SH9 AmbientSH;
+
+	std::vector<Light> PointLights;
+	std::vector<Light> SpotLights;
+};
+
+// The land's heights and normals, baked from the hills function.
+void BuildDemoHeightmap(Heightmap& heightmap);
+
+// The water: a 128 x 128 grid of vertices one unit apart.
+std::unique_ptr<Waves> BuildDemoWaves();
+
+// The geometries of the scene, named as the scene file refers to them.  The land is a
+// flat grid with the hills' normals, the shapes are the box geometry's eight draw args
+// and the capsule a sphere split at the equator.  Only the indices of the waves, the
+// flags and the crowd are built; their vertices are written every frame.  The tree
+// sprites draw their positions from rand().
+DemoMesh BuildLandMesh(const Heightmap& heightmap);
+DemoMesh BuildWavesMesh(const Waves& waves);
+DemoMesh BuildShapesMesh();
+DemoMesh BuildTreeSpritesMesh();
+DemoMesh BuildCapsuleMesh();
+DemoMesh BuildClothMesh(const ClothSystem& cloth);
+DemoMesh BuildCrowdMesh(const HumanoidAsset& humanoid, const SkinnedCrowd& crowd);
+
+// Imports a model file with one draw arg per material (OBJ) or primitive (glTF), named
+// as in the file.  Returns false and sets error if the file cannot be imported.
+bool BuildImportedMesh(const std::string& name, const std::wstring& filename, DemoMesh& mesh, std::string& error);
+
+// The waves' current vertices, with texture coordinates from the position as
+// UpdateWavesVertices writes them.
+void WriteWavesVertices(const Waves& waves, Vertex* out);
+
+// Two rows of flags on the poles of the scene's flagPoles group.
+bool BuildDemoFlags(ClothSystem& cloth);
+
+// Rows of characters north of the flags, walking or idling.  Draws from rand().
+bool BuildDemoCrowd(HumanoidAsset& humanoid, SkinnedCrowd& crowd);
+
+// The materials by name.  MatCBIndex counts up from zero and DiffuseSrvHeapIndex
+// indexes gDemoTextures.
+void BuildDemoMaterials(std::unordered_map<std::string, std::unique_ptr<Material>>& materials);
+
+// The directional lights, and the point and spot lights over the maze.  Draws from rand().
+void BuildDemoLights(DemoLighting& lighting);
+
+// Projects a small mip of the environment cube map into lighting.AmbientSH and sets
+// AmbientLight to its average.  The sky is never drawn, so only its light is needed.
+// Without a readable cube map AmbientSH is the constant AmbientLight and this returns
+// false.
+bool BuildDemoAmbientSH(const std::wstring& cubeMapFile, DemoLighting& lighting);
+
+// Loads the scene, through its compiled copy while that is current, and imports the
+// model files it names, which are relative to the scene's directory.  Returns false and
+// sets error on the first failure.
+bool LoadDemoScene(const std::wstring& sceneFile, const std::wstring& compiledFile,
+	SceneFile& scene, std::vector<DemoMesh>& models, std::string& error);
+
+// The layer a scene item names, or RenderLayer::Count if there is none by that name.
+RenderLayer FindRenderLayer(const char* name);
+
+// The main pass constants for the camera and a width x height target: the matrices
+// (transposed for HLSL), the lights and the cluster grid.  Time is left to the caller.
+void SetDemoPassConstants(const Camera& camera, int width, int height, const DemoLighting& lighting,
+	const LightClusterGrid& clusters, PassConstants& pass);
+
+// One item of a geometry with baked lighting.
+struct DemoBakeItem
+{
+	DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
+	const Material* Mat = nullptr;
+	std::uint32_t IndexCount = 0;
+	std::uint32_t StartIndexLocation = 0;
+	int BaseVertexLocation = 0;
+
+	// Set by BakeDemoGeometry: vertex v of the item reads color BakedLightOffset + v, as
+	// RenderItem::BakedLightOffset.
+	int BakedLightOffset = -1;
+};
+
+// The world space vertices of one geometry's baked items and their colors, kept so the
+// bake can be refined.
+struct DemoBakedGeometry
+{
+	std::vector<DirectX::XMFLOAT3> Positions;
+	std::vector<DirectX::XMFLOAT3> Normals;
+	std::vector<DirectX::XMFLOAT4> Colors;
+
+	// Vertices [Start, End) have the material Mat.
+	struct Run
+	{
+		size_t Start;
+		size_t End;
+		LightingUtil::SurfaceMaterial Mat;
+	};
+	std::vector<Run> Runs;
+};
+
+// Moves the vertices each item references to world space, one block per item, and bakes
+// them with desc.  Consecutive items with the same material are baked in one call so
+// small meshes still spread across the workers.  indices are the geometry's 16-bit
+// indices.
+void BakeDemoGeometry(const LightBaker& baker, const LightBakeDesc& desc, const Vertex* vertices,
+	const std::uint16_t* indices, std::vector<DemoBakeItem>& items, DemoBakedGeometry& baked);
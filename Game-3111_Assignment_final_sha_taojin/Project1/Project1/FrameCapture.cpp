@@ -0,0 +1,242 @@
+#include "FrameCapture.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+using namespace FrameTraceFormat;
+
+static_assert(CaptureTopologyPointList == D3D_PRIMITIVE_TOPOLOGY_POINTLIST &&
+	CaptureTopologyTriangleList == D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST, "topologies are stored as is");
+static_assert(CaptureIndexFormat16 == DXGI_FORMAT_R16_UINT && CaptureIndexFormat32 == DXGI_FORMAT_R32_UINT,
+	"index formats are stored as is");
+
+namespace
+{
+	// Buffers are compared in blocks of this many bytes; a changed block is stored whole.
+	const std::size_t ChangeBlockBytes = 64;
+
+	std::size_t BlobBytes(const Microsoft::WRL::ComPtr<ID3DBlob>& blob)
+	{
+		return blob != nullptr ? blob->GetBufferSize() : 0;
+	}
+}
+
+FrameCapture::~FrameCapture()
+{
+	End();
+}
+
+bool FrameCapture::Begin(const std::wstring& filename, const std::vector<std::wstring>& textures)
+{
+	End();
+
+	mFile.open(std::string(filename.begin(), filename.end()), std::ios::binary);
+	if (!mFile)
+		return false;
+
+	mFrameCount = 0;
+	mBytes = 0;
+	mGeometries.clear();
+	mDraws.clear();
+	for (auto& shadow : mShadow)
+		shadow.clear();
+
+	Header header = {};
+	std::memcpy(header.Magic, Magic, sizeof(Magic));
+	header.Version = Version;
+	mFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	mBytes += sizeof(header);
+
+	for (size_t i = 0; i < textures.size(); ++i)
+	{
+		const std::string name(textures[i].begin(), textures[i].end());
+		TextureRecord record = {};
+		record.SrvHeapIndex = (std::int32_t)i;
+		WriteRecord(RecordTexture, &record, sizeof(record), name.data(), name.size());
+	}
+
+	return (bool)mFile;
+}
+
+bool FrameCapture::End()
+{
+	if (!mFile.is_open())
+		return true;
+
+	// The frame count is known now.
+	mFile.seekp(offsetof(Header, FrameCount));
+	mFile.write(reinterpret_cast<const char*>(&mFrameCount), sizeof(mFrameCount));
+
+	const bool ok = (bool)mFile;
+	mFile.close();
+	return ok;
+}
+
+void FrameCapture::SetDynamicGeometry(const MeshGeometry* geo, CaptureBuffer buffer)
+{
+	mDynamicGeometries[geo] = buffer;
+}
+
+void FrameCapture::SetDynamicIndices(const RenderItem* item, CaptureBuffer buffer)
+{
+	mDynamicIndices[item] = buffer;
+}
+
+void FrameCapture::WriteRecord(std::uint32_t type, const void* header, std::size_t headerBytes,
+	const void* data, std::size_t dataBytes)
+{
+	Record record;
+	record.Type = type;
+	record.Size = (std::uint32_t)(headerBytes + dataBytes);
+	mFile.write(reinterpret_cast<const char*>(&record), sizeof(record));
+	mFile.write(reinterpret_cast<const char*>(header), (std::streamsize)headerBytes);
+	if (dataBytes > 0)
+		mFile.write(reinterpret_cast<const char*>(data), (std::streamsize)dataBytes);
+	mBytes += sizeof(record) + headerBytes + dataBytes;
+}
+
+std::uint32_t FrameCapture::GeometryIndex(const MeshGeometry* geo)
+{
+	auto it = mGeometries.find(geo);
+	if (it != mGeometries.end())
+		return it->second;
+
+	const std::uint32_t index = (std::uint32_t)mGeometries.size();
+	mGeometries[geo] = index;
+
+	// A dynamic geometry's vertices are captured with the frame resource.
+	const bool dynamic = mDynamicGeometries.count(geo) != 0;
+
+	GeometryRecord record = {};
+	record.VertexByteStride = geo->VertexByteStride;
+	record.VertexBufferByteSize = geo->VertexBufferByteSize;
+	record.IndexFormat = (std::uint32_t)geo->IndexFormat;
+	record.IndexBufferByteSize = geo->IndexBufferByteSize;
+	record.ColorByteStride = geo->ColorByteStride;
+	record.ColorBufferByteSize = geo->ColorBufferByteSize;
+	record.NameBytes = (std::uint32_t)geo->Name.size();
+	record.VertexBytes = dynamic ? 0 : (std::uint32_t)BlobBytes(geo->VertexBufferCPU);
+	record.IndexBytes = (std::uint32_t)BlobBytes(geo->IndexBufferCPU);
+	record.ColorBytes = (std::uint32_t)BlobBytes(geo->ColorBufferCPU);
+
+	std::vector<std::uint8_t> data(record.NameBytes + record.VertexBytes + record.IndexBytes + record.ColorBytes);
+	std::uint8_t* out = data.data();
+	std::memcpy(out, geo->Name.data(), record.NameBytes);
+	out += record.NameBytes;
+	if (record.VertexBytes > 0)
+		std::memcpy(out, geo->VertexBufferCPU->GetBufferPointer(), record.VertexBytes);
+	out += record.VertexBytes;
+	if (record.IndexBytes > 0)
+		std::memcpy(out, geo->IndexBufferCPU->GetBufferPointer(), record.IndexBytes);
+	out += record.IndexBytes;
+	if (record.ColorBytes > 0)
+		std::memcpy(out, geo->ColorBufferCPU->GetBufferPointer(), record.ColorBytes);
+
+	WriteRecord(RecordGeometry, &record, sizeof(record), data.data(), data.size());
+	return index;
+}
+
+void FrameCapture::AddDraws(RenderLayer layer, const std::vector<RenderItem*>& ritems)
+{
+	if (!IsCapturing())
+		return;
+
+	for (const RenderItem* ri : ritems)
+	{
+		CaptureDraw draw = {};
+		draw.Layer = (std::uint32_t)layer;
+		draw.Geometry = GeometryIndex(ri->Geo);
+		draw.PrimitiveType = (std::uint32_t)ri->PrimitiveType;
+		draw.ObjCBIndex = ri->ObjCBIndex;
+		draw.MatCBIndex = (std::uint32_t)ri->Mat->MatCBIndex;
+		draw.DiffuseSrvHeapIndex = ri->Mat->DiffuseSrvHeapIndex;
+		draw.IndexCount = ri->IndexCount;
+		draw.StartIndexLocation = ri->StartIndexLocation;
+		draw.BaseVertexLocation = ri->BaseVertexLocation;
+		draw.BakedLightOffset = ri->BakedLightOffset;
+
+		auto dynamic = mDynamicGeometries.find(ri->Geo);
+		draw.VertexSource = (std::uint32_t)(dynamic != mDynamicGeometries.end() ? dynamic->second : CaptureBuffer::Count);
+		auto dynamicIndices = mDynamicIndices.find(ri);
+		draw.IndexSource = (std::uint32_t)(dynamicIndices != mDynamicIndices.end() && ri->IndexBufferOverride.SizeInBytes != 0 ?
+			dynamicIndices->second : CaptureBuffer::Count);
+		mDraws.push_back(draw);
+	}
+}
+
+void FrameCapture::WriteBuffer(CaptureBuffer buffer, const std::uint8_t* data, std::uint64_t byteSize,
+	UINT elementByteSize)
+{
+	std::vector<std::uint8_t>& shadow = mShadow[(int)buffer];
+	if (shadow.size() != byteSize)
+		shadow.assign((size_t)byteSize, 0);
+
+	// Runs of changed blocks, each a BufferRange and its bytes.  The buffer is read in
+	// one sequential pass, which is what upload heap memory tolerates best.
+	mRanges.clear();
+	std::uint32_t rangeCount = 0;
+	auto addRange = [&](size_t begin, size_t end)
+	{
+		BufferRange range;
+		range.Offset = (std::uint32_t)begin;
+		range.Size = (std::uint32_t)(end - begin);
+		const size_t at = mRanges.size();
+		mRanges.resize(at + sizeof(range) + range.Size);
+		std::memcpy(&mRanges[at], &range, sizeof(range));
+		std::memcpy(&mRanges[at + sizeof(range)], data + begin, range.Size);
+		std::memcpy(shadow.data() + begin, data + begin, range.Size);
+		++rangeCount;
+	};
+
+	const size_t bytes = (size_t)byteSize;
+	size_t runStart = bytes;
+	for (size_t offset = 0; offset < bytes; offset += ChangeBlockBytes)
+	{
+		const size_t blockBytes = std::min(ChangeBlockBytes, bytes - offset);
+		const bool changed = std::memcmp(data + offset, shadow.data() + offset, blockBytes) != 0;
+		if (changed && runStart == bytes)
+		{
+			runStart = offset;
+		}
+		else if (!changed && runStart != bytes)
+		{
+			addRange(runStart, offset);
+			runStart = bytes;
+		}
+	}
+	if (runStart != bytes)
+		addRange(runStart, bytes);
+
+	BufferRecord record = {};
+	record.Buffer = (std::uint32_t)buffer;
+	record.ElementByteSize = elementByteSize;
+	record.ByteSize = byteSize;
+	record.RangeCount = rangeCount;
+	WriteRecord(RecordBuffer, &record, sizeof(record), mRanges.data(), mRanges.size());
+}
+
+void FrameCapture::EndFrame(std::uint32_t frame, const FrameResource& frameResource)
+{
+	if (!IsCapturing())
+		return;
+
+	FrameRecord record = {};
+	record.Frame = frame;
+	WriteRecord(RecordFrame, &record, sizeof(record));
+
+	WriteBuffer(CaptureBuffer::PassCB, frameResource.PassCB);
+	WriteBuffer(CaptureBuffer::ObjectCB, frameResource.ObjectCB);
+	WriteBuffer(CaptureBuffer::MaterialCB, frameResource.MaterialCB);
+	WriteBuffer(CaptureBuffer::WavesVB, frameResource.WavesVB);
+	WriteBuffer(CaptureBuffer::ParticleVB, frameResource.ParticleVB);
+	WriteBuffer(CaptureBuffer::ClothVB, frameResource.ClothVB);
+	WriteBuffer(CaptureBuffer::SkinnedVB, frameResource.SkinnedVB);
+	WriteBuffer(CaptureBuffer::ClusterLights, frameResource.ClusterLights);
+	WriteBuffer(CaptureBuffer::ClusterRanges, frameResource.ClusterRanges);
+	WriteBuffer(CaptureBuffer::ClusterLightIndices, frameResource.ClusterLightIndices);
+	WriteBuffer(CaptureBuffer::MeshletIB, frameResource.MeshletIB);
+
+	WriteRecord(RecordDraws, mDraws.data(), mDraws.size()*sizeof(CaptureDraw));
+	mDraws.clear();
+	++mFrameCount;
+}
@@ -0,0 +1,90 @@
+//***************************************************************************************
+// FrameCapture.h
+//
+// Records what the CPU produced for a range of frames so a spike or a regression can be
+// reproduced offline.  Per frame a trace holds the contents of every upload buffer of the
+// frame resource (pass, object and material constants, the dynamic vertex buffers and
+// the light clusters, the meshlet-culled indices) and the ordered draw list with the state each draw binds.  Buffers
+// are stored as the byte ranges that changed since the previous captured frame, so a
+// frame where little moved costs little.  The static geometry the draws use and the
+// texture files of the SRV heap are written once, the first time they are needed, so a
+// trace replays without the app or its assets' build steps.
+//
+// FrameTrace (FrameTrace.h) reads a trace back one frame at a time.  The Tools replay
+// command re-executes it on the null device or the software rasterizer and diffs two
+// traces.
+//***************************************************************************************
+
+#pragma once
+
+#include "FrameTrace.h"
+#include "FrameUpdate.h"
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class FrameCapture
+{
+public:
+	FrameCapture() = default;
+	FrameCapture(const FrameCapture& rhs) = delete;
+	FrameCapture& operator=(const FrameCapture& rhs) = delete;
+	~FrameCapture();
+
+	// Starts a trace.  textures are the files of the SRV heap, in heap order.  Returns
+	// false if the file cannot be created.
+	bool Begin(const std::wstring& filename, const std::vector<std::wstring>& textures);
+
+	// Finishes the trace.  Returns false if a write failed.
+	bool End();
+
+	bool IsCapturing()const { return mFile.is_open(); }
+
+	// The vertices of geo are the frame resource's buffer, not geo's own.
+	void SetDynamicGeometry(const MeshGeometry* geo, CaptureBuffer buffer);
+
+	// The indices of item, while it has an IndexBufferOverride, are the frame resource's
+	// buffer, not its geometry's.
+	void SetDynamicIndices(const RenderItem* item, CaptureBuffer buffer);
+
+	// Appends the draws of one layer, in submission order.
+	void AddDraws(RenderLayer layer, const std::vector<RenderItem*>& ritems);
+
+	// Writes a frame: the buffers of frameResource as they are now and the draws added
+	// since the last call.
+	void EndFrame(std::uint32_t frame, const FrameResource& frameResource);
+
+	int FrameCount()const { return (int)mFrameCount; }
+	std::uint64_t Bytes()const { return mBytes; }
+
+private:
+	void WriteRecord(std::uint32_t type, const void* header, std::size_t headerBytes,
+		const void* data = nullptr, std::size_t dataBytes = 0);
+	std::uint32_t GeometryIndex(const MeshGeometry* geo);
+	void WriteBuffer(CaptureBuffer buffer, const std::uint8_t* data, std::uint64_t byteSize, UINT elementByteSize);
+
+	template<typename T>
+	void WriteBuffer(CaptureBuffer buffer, const std::unique_ptr<UploadBuffer<T>>& uploadBuffer)
+	{
+		if (uploadBuffer != nullptr)
+			WriteBuffer(buffer, uploadBuffer->MappedBytes(), uploadBuffer->ByteSize(), uploadBuffer->ElementByteSize());
+	}
+
+private:
+	std::ofstream mFile;
+	std::uint32_t mFrameCount = 0;
+	std::uint64_t mBytes = 0;
+
+	std::unordered_map<const MeshGeometry*, std::uint32_t> mGeometries;
+	std::unordered_map<const MeshGeometry*, CaptureBuffer> mDynamicGeometries;
+	std::unordered_map<const RenderItem*, CaptureBuffer> mDynamicIndices;
+	std::vector<CaptureDraw> mDraws;
+
+	// Each buffer as last written, to find the ranges that changed.
+	std::vector<std::uint8_t> mShadow[(int)CaptureBuffer::Count];
+
+	// Scratch for the changed ranges of one buffer.
+	std::vector<std::uint8_t> mRanges;
+};
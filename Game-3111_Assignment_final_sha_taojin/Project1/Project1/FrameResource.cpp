@@ -1,34 +1,112 @@
 #include "FrameResource.h"
 
-FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount, UINT waveVertCount)
+FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount, UINT waveVertCount,
+	UINT particleCount, UINT clothVertCount, UINT skinnedVertCount, UINT meshletIndexCount)
 {
-	ThrowIfFailed(device->CreateCommandAllocator(
-		D3D12_COMMAND_LIST_TYPE_DIRECT,
-		IID_PPV_ARGS(CmdListAlloc.GetAddressOf())));
+	// A null device (headless stress loop) gets system memory buffers and no allocator.
+	if (device != nullptr)
+	{
+		ThrowIfFailed(device->CreateCommandAllocator(
+			D3D12_COMMAND_LIST_TYPE_DIRECT,
+			IID_PPV_ARGS(CmdListAlloc.GetAddressOf())));
+	}
 
 	//  FrameCB = std::make_unique<UploadBuffer<FrameConstants>>(device, 1, true);
 	PassCB = std::make_unique<UploadBuffer<PassConstants>>(device, passCount, true);
 	MaterialCB = std::make_unique<UploadBuffer<MaterialConstants>>(device, materialCount, true);
 	ObjectCB = std::make_unique<UploadBuffer<ObjectConstants>>(device, objectCount, true);
 
+	ClusterLights = std::make_unique<UploadBuffer<Light>>(device, LightClusterGrid::MaxClusterLights, false);
+	ClusterRanges = std::make_unique<UploadBuffer<DirectX::XMUINT2>>(device, LightClusterGrid::ClusterCount, false);
+	ClusterLightIndices = std::make_unique<UploadBuffer<UINT>>(device, LightClusterGrid::MaxLightIndices, false);
+
 	WavesVB = std::make_unique<UploadBuffer<Vertex>>(device, waveVertCount, false);
+
+	if (particleCount > 0)
+		ParticleVB = std::make_unique<UploadBuffer<ParticleVertex>>(device, particleCount, false);
+
+	if (clothVertCount > 0)
+		ClothVB = std::make_unique<UploadBuffer<ClothVertex>>(device, clothVertCount, false);
+
+	if (skinnedVertCount > 0)
+		SkinnedVB = std::make_unique<UploadBuffer<SkinnedVertex>>(device, skinnedVertCount, false);
+
+	if (meshletIndexCount > 0)
+		MeshletIB = std::make_unique<UploadBuffer<std::uint16_t>>(device, meshletIndexCount, false);
+
+	TagBuffers();
 }
 
 FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount)
 {
-	ThrowIfFailed(device->CreateCommandAllocator(
-		D3D12_COMMAND_LIST_TYPE_DIRECT,
-		IID_PPV_ARGS(CmdListAlloc.GetAddressOf())));
+	if (device != nullptr)
+	{
+		ThrowIfFailed(device->CreateCommandAllocator(
+			D3D12_COMMAND_LIST_TYPE_DIRECT,
+			IID_PPV_ARGS(CmdListAlloc.GetAddressOf())));
+	}
 
 	//  FrameCB = std::make_unique<UploadBuffer<FrameConstants>>(device, 1, true);
 	PassCB = std::make_unique<UploadBuffer<PassConstants>>(device, passCount, true);
 	MaterialCB = std::make_unique<UploadBuffer<MaterialConstants>>(device, materialCount, true);
 	ObjectCB = std::make_unique<UploadBuffer<ObjectConstants>>(device, objectCount, true);
 
+	ClusterLights = std::make_unique<UploadBuffer<Light>>(device, LightClusterGrid::MaxClusterLights, false);
+	ClusterRanges = std::make_unique<UploadBuffer<DirectX::XMUINT2>>(device, LightClusterGrid::ClusterCount, false);
+	ClusterLightIndices = std::make_unique<UploadBuffer<UINT>>(device, LightClusterGrid::MaxLightIndices, false);
+
+	TagBuffers();
 }
 
 
 FrameResource::~FrameResource()
 {
 
+}
+
+void FrameResource::TagBuffers()
+{
+	PassCB->SetMemoryTag(MemoryCategory::FrameResource, "pass cb");
+	MaterialCB->SetMemoryTag(MemoryCategory::FrameResource, "material cb");
+	ObjectCB->SetMemoryTag(MemoryCategory::FrameResource, "object cb");
+	ClusterLights->SetMemoryTag(MemoryCategory::FrameResource, "cluster lights");
+	ClusterRanges->SetMemoryTag(MemoryCategory::FrameResource, "cluster ranges");
+	ClusterLightIndices->SetMemoryTag(MemoryCategory::FrameResource, "cluster light indices");
+
+	PassCB->SetUploadKind(UploadKind::PassConstants);
+	MaterialCB->SetUploadKind(UploadKind::MaterialConstants);
+	ObjectCB->SetUploadKind(UploadKind::ObjectConstants);
+	ClusterLights->SetUploadKind(UploadKind::LightData);
+	ClusterRanges->SetUploadKind(UploadKind::LightData);
+	ClusterLightIndices->SetUploadKind(UploadKind::LightData);
+
+	if (WavesVB != nullptr)
+	{
+		WavesVB->SetMemoryTag(MemoryCategory::FrameResource, "waves vb");
+		WavesVB->SetUploadKind(UploadKind::DynamicVertices);
+	}
+
+	if (ParticleVB != nullptr)
+	{
+		ParticleVB->SetMemoryTag(MemoryCategory::FrameResource, "particle vb");
+		ParticleVB->SetUploadKind(UploadKind::DynamicVertices);
+	}
+
+	if (ClothVB != nullptr)
+	{
+		ClothVB->SetMemoryTag(MemoryCategory::FrameResource, "cloth vb");
+		ClothVB->SetUploadKind(UploadKind::DynamicVertices);
+	}
+
+	if (SkinnedVB != nullptr)
+	{
+		SkinnedVB->SetMemoryTag(MemoryCategory::FrameResource, "skinned vb");
+		SkinnedVB->SetUploadKind(UploadKind::DynamicVertices);
+	}
+
+	if (MeshletIB != nullptr)
+	{
+		MeshletIB->SetMemoryTag(MemoryCategory::FrameResource, "meshlet ib");
+		MeshletIB->SetUploadKind(UploadKind::DynamicIndices);
+	}
 }
\ No newline at end of file
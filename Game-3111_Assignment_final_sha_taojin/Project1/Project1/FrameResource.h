@@ -3,51 +3,11 @@
 #include "../../Common/d3dUtil.h"
 #include "../../Common/MathHelper.h"
 #include "../../Common/UploadBuffer.h"
-
-struct ObjectConstants
-{
-    DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
-    DirectX::XMFLOAT4X4 TexTransform = MathHelper::Identity4x4();
-};
-
-struct PassConstants
-{
-    DirectX::XMFLOAT4X4 View = MathHelper::Identity4x4();
-    DirectX::XMFLOAT4X4 InvView = MathHelper::Identity4x4();
-    DirectX::XMFLOAT4X4 Proj = MathHelper::Identity4x4();
-    DirectX::XMFLOAT4X4 InvProj = MathHelper::Identity4x4();
-    DirectX::XMFLOAT4X4 ViewProj = MathHelper::Identity4x4();
-    DirectX::XMFLOAT4X4 InvViewProj = MathHelper::Identity4x4();
-    DirectX::XMFLOAT3 EyePosW = { 0.0f, 0.0f, 0.0f };
-    float cbPerObjectPad1 = 0.0f;
-    DirectX::XMFLOAT2 RenderTargetSize = { 0.0f, 0.0f };
-    DirectX::XMFLOAT2 InvRenderTargetSize = { 0.0f, 0.0f };
-    float NearZ = 0.0f;
-    float FarZ = 0.0f;
-    float TotalTime = 0.0f;
-    float DeltaTime = 0.0f;
-
-    DirectX::XMFLOAT4 AmbientLight = { 0.0f, 0.0f, 0.0f, 1.0f };
-
-    DirectX::XMFLOAT4 FogColor = { 0.8f, 0.8f, 0.8f, 1.0f };
-    float gFogStart = 5.0f;
-    float gFogRange = 200.0f;
-    DirectX::XMFLOAT2 cbPerObjectPad2;
-
-    // Indices [0, NUM_DIR_LIGHTS) are directional lights;
-    // indices [NUM_DIR_LIGHTS, NUM_DIR_LIGHTS+NUM_POINT_LIGHTS) are point lights;
-    // indices [NUM_DIR_LIGHTS+NUM_POINT_LIGHTS, NUM_DIR_LIGHTS+NUM_POINT_LIGHT+NUM_SPOT_LIGHTS)
-    // are spot lights for a maximum of MaxLights per object.
-    Light Lights[MaxLights];
-};
-
-struct Vertex
-{
-    //DirectX::XMFLOAT4 Color;
-    DirectX::XMFLOAT3 Pos;
-    DirectX::XMFLOAT3 Normal;
-    DirectX::XMFLOAT2 TexC;
-};
+#include "ClothSystem.h"
+#include "LightClusters.h"
+#include "ParticleSystem.h"
+#include "RenderTypes.h"
+#include "Skinning.h"
 
 // Stores the resources needed for the CPU to build the command lists
 // for a frame.  
@@ -55,7 +15,11 @@ struct FrameResource
 {
 public:
 
-    FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount, UINT waveVertCount);
+    // device may be null, see UploadBuffer.  particleCount, clothVertCount,
+    // skinnedVertCount and meshletIndexCount size ParticleVB, ClothVB, SkinnedVB and
+    // MeshletIB; 0 creates none.
+    FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount, UINT waveVertCount,
+        UINT particleCount = 0, UINT clothVertCount = 0, UINT skinnedVertCount = 0, UINT meshletIndexCount = 0);
     FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount);
     FrameResource(const FrameResource& rhs) = delete;
     FrameResource& operator=(const FrameResource& rhs) = delete;
@@ -76,7 +40,31 @@ public:
     // the commands that reference it.  So each frame needs their own.
     std::unique_ptr<UploadBuffer<Vertex>> WavesVB = nullptr;
 
+    // The compacted particle point stream, see UpdateParticleVertices.
+    std::unique_ptr<UploadBuffer<ParticleVertex>> ParticleVB = nullptr;
+
+    // Every flag's cloth vertices, written in place by UpdateClothVertices.
+    std::unique_ptr<UploadBuffer<ClothVertex>> ClothVB = nullptr;
+
+    // The skinned vertices of every crowd character, see UpdateSkinnedVertices.
+    std::unique_ptr<UploadBuffer<SkinnedVertex>> SkinnedVB = nullptr;
+
+    // The triangles of the meshlets that survived culling, for every meshlet-culled
+    // render item, see UpdateMeshletCulling.
+    std::unique_ptr<UploadBuffer<std::uint16_t>> MeshletIB = nullptr;
+
+    // Clustered light list, per-cluster (offset, count) ranges and light indices,
+    // bound as root SRVs.
+    std::unique_ptr<UploadBuffer<Light>> ClusterLights = nullptr;
+    std::unique_ptr<UploadBuffer<DirectX::XMUINT2>> ClusterRanges = nullptr;
+    std::unique_ptr<UploadBuffer<UINT>> ClusterLightIndices = nullptr;
+
     // Fence value to mark commands up to this fence point.  This lets us
     // check if these frame resources are still in use by the GPU.
     UINT64 Fence = 0;
+
+private:
+    // Accounts the buffers under MemoryCategory::FrameResource and sets the kind their
+    // uploads are counted under.
+    void TagBuffers();
 };
\ No newline at end of file
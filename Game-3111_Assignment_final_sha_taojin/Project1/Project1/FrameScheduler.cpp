@@ -0,0 +1,155 @@
+#include "FrameScheduler.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+
+FrameScheduler::FrameScheduler()
+	: mStart(Clock::now())
+{
+}
+
+FrameScheduler::TaskId FrameScheduler::Add(const FrameTaskDesc& desc, TaskStep step)
+{
+	Task task;
+	task.Desc = desc;
+	task.Step = std::move(step);
+	task.Stats.SliceEstimate = desc.SliceMilliseconds;
+	task.Queued = true;
+	task.QueueTime = Milliseconds(Clock::now());
+
+	mTasks.push_back(std::move(task));
+	return (TaskId)mTasks.size() - 1;
+}
+
+void FrameScheduler::Queue(TaskId id)
+{
+	assert(id >= 0 && id < (TaskId)mTasks.size());
+
+	Task& task = mTasks[id];
+	if (task.Queued)
+		return;
+
+	task.Queued = true;
+	task.QueueTime = Milliseconds(Clock::now());
+}
+
+void FrameScheduler::RunFrame()
+{
+	const double frameStart = Milliseconds(Clock::now());
+
+	// Periodic tasks whose period is over.
+	for (Task& task : mTasks)
+	{
+		if (!task.Queued && task.Desc.PeriodMilliseconds > 0.0 && frameStart >= task.QueueTime)
+			task.Queued = true;
+	}
+
+	double spent = 0.0;
+	bool ranAny = false;
+
+	// Visit the queued tasks oldest first: each pass picks the oldest task after the one
+	// visited last, ties broken by id.
+	double lastTime = -1.0;
+	TaskId lastId = -1;
+	for (;;)
+	{
+		TaskId id = -1;
+		for (TaskId t = 0; t < (TaskId)mTasks.size(); ++t)
+		{
+			const Task& task = mTasks[t];
+			if (!task.Queued)
+				continue;
+			if (task.QueueTime < lastTime || (task.QueueTime == lastTime && t <= lastId))
+				continue;
+			if (id < 0 || task.QueueTime < mTasks[id].QueueTime)
+				id = t;
+		}
+		if (id < 0)
+			break;
+
+		Task& task = mTasks[id];
+		lastTime = task.QueueTime;
+		lastId = id;
+
+		const bool late = frameStart - task.QueueTime > task.Desc.DeadlineMilliseconds;
+		int slices = 0;
+		while (task.Queued)
+		{
+			// A slice that does not fit waits, unless the task is late and has not had
+			// one this frame.
+			bool forced = false;
+			if (spent + task.Stats.SliceEstimate > mBudget)
+			{
+				if (!late || slices > 0)
+					break;
+				forced = true;
+			}
+
+			const Clock::time_point sliceStart = Clock::now();
+			const bool finished = task.Step();
+			const Clock::time_point sliceEnd = Clock::now();
+
+			const double ms = std::chrono::duration<double, std::milli>(sliceEnd - sliceStart).count();
+			spent = Milliseconds(sliceEnd) - frameStart;
+			ranAny = true;
+			++slices;
+
+			FrameTaskStats& stats = task.Stats;
+			++stats.Slices;
+			if (forced)
+				++stats.ForcedSlices;
+			stats.Milliseconds += ms;
+			stats.MaxSliceMilliseconds = std::max(stats.MaxSliceMilliseconds, ms);
+			stats.SliceEstimate = 0.75*stats.SliceEstimate + 0.25*ms;
+
+			if (finished)
+			{
+				const double now = Milliseconds(sliceEnd);
+				++stats.Completions;
+				if (now - task.QueueTime > task.Desc.DeadlineMilliseconds)
+					++stats.LateCompletions;
+
+				task.Queued = false;
+				task.QueueTime = now + task.Desc.PeriodMilliseconds;
+			}
+		}
+	}
+
+	++mStats.Frames;
+	if (ranAny)
+		++mStats.BusyFrames;
+	if (spent > mBudget)
+	{
+		++mStats.OverrunFrames;
+		mStats.OverrunMilliseconds += spent - mBudget;
+		mStats.MaxOverrunMilliseconds = std::max(mStats.MaxOverrunMilliseconds, spent - mBudget);
+	}
+	mStats.LastMilliseconds = spent;
+}
+
+std::string FrameScheduler::Report()const
+{
+	std::string report;
+	char line[192];
+	std::snprintf(line, sizeof(line), "Frame scheduler: %d tasks, budget %.2f ms\n",
+		(int)mTasks.size(), mBudget);
+	report += line;
+
+	for (const Task& task : mTasks)
+	{
+		const FrameTaskStats& stats = task.Stats;
+		std::snprintf(line, sizeof(line),
+			"  %-24s %8llu slices %9.2f ms  max %6.2f ms  est %6.2f ms  done %llu (%llu late)  forced %llu%s\n",
+			task.Desc.Name, (unsigned long long)stats.Slices, stats.Milliseconds,
+			stats.MaxSliceMilliseconds, stats.SliceEstimate,
+			(unsigned long long)stats.Completions, (unsigned long long)stats.LateCompletions,
+			(unsigned long long)stats.ForcedSlices, task.Queued ? "  (queued)" : "");
+		report += line;
+	}
+
+	std::snprintf(line, sizeof(line), "  %llu frames, %llu busy, %llu over budget by %.2f ms total, %.2f ms worst\n",
+		(unsigned long long)mStats.Frames, (unsigned long long)mStats.BusyFrames,
+		(unsigned long long)mStats.OverrunFrames, mStats.OverrunMilliseconds, mStats.MaxOverrunMilliseconds);
+	report += line;
+	return report;
+}
@@ -0,0 +1,133 @@
+//***************************************************************************************
+// FrameScheduler.h
+//
+// Maintenance work spread over frames.  A task is resumable: each call of its step does
+// one slice of work and returns whether the task is finished, so a long job (a rebake, a
+// rebuild of a spatial index) costs a little every frame instead of one long frame.
+// RunFrame runs slices until the frame's budget is spent, oldest task first.  A task
+// declares what one slice costs and how soon after it is queued it must be done; a slice
+// that does not fit in what is left of the budget waits for a later frame, unless its
+// task is past its deadline, which gets one slice a frame whatever the budget.  The
+// declared cost is only the first guess: the scheduler keeps a running average of the
+// measured slices.  Periodic tasks are queued again a period after they finish.
+//
+// The stats count the frames that went over the budget and by how much, and the tasks
+// that finished late.
+//***************************************************************************************
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct FrameTaskDesc
+{
+	const char* Name = "";
+
+	// Expected milliseconds of one step.
+	double SliceMilliseconds = 0.5;
+
+	// The task should finish this long after it is queued.
+	double DeadlineMilliseconds = 1000.0;
+
+	// Queued again this long after it finishes, or 0 to run once.
+	double PeriodMilliseconds = 0.0;
+};
+
+struct FrameTaskStats
+{
+	std::uint64_t Slices = 0;
+	std::uint64_t Completions = 0;
+	std::uint64_t LateCompletions = 0;
+
+	// Slices run past the budget because the task was late.
+	std::uint64_t ForcedSlices = 0;
+
+	double Milliseconds = 0.0;
+	double MaxSliceMilliseconds = 0.0;
+
+	// Running average of the slices, starting at the declared cost.
+	double SliceEstimate = 0.0;
+};
+
+struct FrameSchedulerStats
+{
+	std::uint64_t Frames = 0;
+
+	// Frames that ran at least one slice, and those that went over the budget.
+	std::uint64_t BusyFrames = 0;
+	std::uint64_t OverrunFrames = 0;
+
+	// Milliseconds past the budget, summed over the overrun frames, and the worst.
+	double OverrunMilliseconds = 0.0;
+	double MaxOverrunMilliseconds = 0.0;
+
+	// Of the last RunFrame.
+	double LastMilliseconds = 0.0;
+};
+
+class FrameScheduler
+{
+public:
+	typedef int TaskId;
+
+	// Does one slice of work; returns true when the task is finished.
+	typedef std::function<bool()> TaskStep;
+
+	FrameScheduler();
+	FrameScheduler(const FrameScheduler& rhs) = delete;
+	FrameScheduler& operator=(const FrameScheduler& rhs) = delete;
+	~FrameScheduler() = default;
+
+	// Milliseconds RunFrame may spend.
+	void SetBudget(double milliseconds) { mBudget = milliseconds; }
+	double Budget()const { return mBudget; }
+
+	// Adds a task and queues it.
+	TaskId Add(const FrameTaskDesc& desc, TaskStep step);
+
+	// Queues a task that has finished, e.g. to redo work whose inputs changed.  Its age
+	// and deadline count from now.  Does nothing if it is queued already.
+	void Queue(TaskId id);
+	bool IsQueued(TaskId id)const { return mTasks[id].Queued; }
+
+	// Runs slices of the queued tasks within the budget.  Call once per frame.
+	void RunFrame();
+
+	int TaskCount()const { return (int)mTasks.size(); }
+	const char* TaskName(TaskId id)const { return mTasks[id].Desc.Name; }
+	const FrameTaskStats& TaskStats(TaskId id)const { return mTasks[id].Stats; }
+	const FrameSchedulerStats& Stats()const { return mStats; }
+
+	// One line per task with its stats, then the frame totals.
+	std::string Report()const;
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	double Milliseconds(Clock::time_point t)const
+	{
+		return std::chrono::duration<double, std::milli>(t - mStart).count();
+	}
+
+	struct Task
+	{
+		FrameTaskDesc Desc;
+		TaskStep Step;
+		FrameTaskStats Stats;
+
+		bool Queued = false;
+
+		// When it was queued or, for a finished periodic task, is due to be queued, in
+		// milliseconds since construction.
+		double QueueTime = 0.0;
+	};
+
+	std::vector<Task> mTasks;
+	double mBudget = 2.0;
+	Clock::time_point mStart;
+	FrameSchedulerStats mStats;
+};
@@ -0,0 +1,216 @@
+#include "FrameTrace.h"
+#include <cstring>
+
+using namespace FrameTraceFormat;
+
+const char* CaptureBufferName(CaptureBuffer buffer)
+{
+	static const char* const names[(int)CaptureBuffer::Count] =
+	{
+		"PassCB", "ObjectCB", "MaterialCB", "WavesVB", "ParticleVB", "ClothVB", "SkinnedVB",
+		"ClusterLights", "ClusterRanges", "ClusterLightIndices", "MeshletIB"
+	};
+	return buffer < CaptureBuffer::Count ? names[(int)buffer] : "?";
+}
+
+bool FrameTrace::Fail(const std::string& message)
+{
+	mError = message;
+	return false;
+}
+
+bool FrameTrace::Open(const std::wstring& filename)
+{
+	mPosition = 0;
+	mFrameCount = 0;
+	mFrame = 0;
+	mDraws.clear();
+	for (int b = 0; b < (int)CaptureBuffer::Count; ++b)
+	{
+		mBuffers[b].clear();
+		mElementByteSizes[b] = 0;
+		mChangedBytes[b] = 0;
+	}
+	mGeometries.clear();
+	mTextures.clear();
+	mError.clear();
+
+	if (!mFile.Open(filename))
+		return Fail("cannot open the trace");
+
+	Header header;
+	if (mFile.Size() < sizeof(header))
+		return Fail("not a frame trace");
+	std::memcpy(&header, mFile.Data(), sizeof(header));
+	if (std::memcmp(header.Magic, Magic, sizeof(Magic)) != 0)
+		return Fail("not a frame trace");
+	if (header.Version != Version)
+		return Fail("unsupported trace version " + std::to_string(header.Version));
+
+	mFrameCount = header.FrameCount;
+	mPosition = sizeof(header);
+	return true;
+}
+
+bool FrameTrace::ReadGeometry(const std::uint8_t* data, std::size_t size)
+{
+	GeometryRecord record;
+	if (size < sizeof(record))
+		return Fail("truncated geometry record");
+	std::memcpy(&record, data, sizeof(record));
+	if ((std::uint64_t)record.NameBytes + record.VertexBytes + record.IndexBytes + record.ColorBytes !=
+		size - sizeof(record))
+	{
+		return Fail("geometry record size mismatch");
+	}
+
+	CaptureGeometry geo;
+	const std::uint8_t* in = data + sizeof(record);
+	geo.Name.assign(reinterpret_cast<const char*>(in), record.NameBytes);
+	in += record.NameBytes;
+
+	geo.VertexByteStride = record.VertexByteStride;
+	geo.VertexBufferByteSize = record.VertexBufferByteSize;
+	geo.IndexFormat = record.IndexFormat;
+	geo.IndexBufferByteSize = record.IndexBufferByteSize;
+	geo.ColorByteStride = record.ColorByteStride;
+	geo.ColorBufferByteSize = record.ColorBufferByteSize;
+
+	geo.Vertices.assign(in, in + record.VertexBytes);
+	in += record.VertexBytes;
+	geo.Indices.assign(in, in + record.IndexBytes);
+	in += record.IndexBytes;
+	geo.Colors.assign(in, in + record.ColorBytes);
+
+	mGeometries.push_back(std::move(geo));
+	return true;
+}
+
+bool FrameTrace::ReadBuffer(const std::uint8_t* data, std::size_t size)
+{
+	BufferRecord record;
+	if (size < sizeof(record))
+		return Fail("truncated buffer record");
+	std::memcpy(&record, data, sizeof(record));
+	if (record.Buffer >= (std::uint32_t)CaptureBuffer::Count || record.ByteSize > size_t(-1) / 2)
+		return Fail("bad buffer record");
+
+	std::vector<std::uint8_t>& buffer = mBuffers[record.Buffer];
+	if (buffer.size() != record.ByteSize)
+		buffer.assign((size_t)record.ByteSize, 0);
+	mElementByteSizes[record.Buffer] = record.ElementByteSize;
+
+	std::size_t at = sizeof(record);
+	for (std::uint32_t r = 0; r < record.RangeCount; ++r)
+	{
+		BufferRange range;
+		if (size - at < sizeof(range))
+			return Fail("truncated buffer record");
+		std::memcpy(&range, data + at, sizeof(range));
+		at += sizeof(range);
+
+		if (range.Size > size - at || range.Offset > buffer.size() || range.Size > buffer.size() - range.Offset)
+			return Fail(std::string("bad range in ") + CaptureBufferName((CaptureBuffer)record.Buffer));
+		std::memcpy(buffer.data() + range.Offset, data + at, range.Size);
+		mChangedBytes[record.Buffer] += range.Size;
+		at += range.Size;
+	}
+	return at == size || Fail("buffer record size mismatch");
+}
+
+bool FrameTrace::NextFrame()
+{
+	mDraws.clear();
+	for (auto& changed : mChangedBytes)
+		changed = 0;
+
+	const std::uint8_t* data = mFile.Data();
+	const std::size_t size = mFile.Size();
+	bool started = false;
+	while (mPosition < size)
+	{
+		Record record;
+		if (size - mPosition < sizeof(record))
+			return Fail("truncated record");
+		std::memcpy(&record, data + mPosition, sizeof(record));
+		if (record.Size > size - mPosition - sizeof(record))
+			return Fail("truncated record");
+
+		// The next frame starts here.
+		if (record.Type == RecordFrame && started)
+			break;
+
+		const std::uint8_t* body = data + mPosition + sizeof(record);
+		switch (record.Type)
+		{
+		case RecordTexture:
+		{
+			TextureRecord texture;
+			if (record.Size < sizeof(texture))
+				return Fail("truncated texture record");
+			std::memcpy(&texture, body, sizeof(texture));
+			if (texture.SrvHeapIndex < 0 || texture.SrvHeapIndex > 65535)
+				return Fail("bad texture record");
+			if ((size_t)texture.SrvHeapIndex >= mTextures.size())
+				mTextures.resize(texture.SrvHeapIndex + 1);
+			const char* name = reinterpret_cast<const char*>(body + sizeof(texture));
+			mTextures[texture.SrvHeapIndex].assign(name, name + (record.Size - sizeof(texture)));
+			break;
+		}
+		case RecordGeometry:
+			if (!ReadGeometry(body, record.Size))
+				return false;
+			break;
+		case RecordFrame:
+		{
+			FrameRecord frame;
+			if (record.Size < sizeof(frame))
+				return Fail("truncated frame record");
+			std::memcpy(&frame, body, sizeof(frame));
+			mFrame = frame.Frame;
+			started = true;
+			break;
+		}
+		case RecordBuffer:
+			if (!started)
+				return Fail("buffer record outside a frame");
+			if (!ReadBuffer(body, record.Size))
+				return false;
+			break;
+		case RecordDraws:
+		{
+			if (!started || record.Size % sizeof(CaptureDraw) != 0)
+				return Fail("bad draws record");
+			const size_t first = mDraws.size();
+			mDraws.resize(first + record.Size / sizeof(CaptureDraw));
+			std::memcpy(mDraws.data() + first, body, record.Size);
+			for (size_t i = first; i < mDraws.size(); ++i)
+			{
+				if (mDraws[i].Geometry >= mGeometries.size() || mDraws[i].Layer >= (std::uint32_t)RenderLayer::Count ||
+					mDraws[i].VertexSource > (std::uint32_t)CaptureBuffer::Count ||
+					mDraws[i].IndexSource > (std::uint32_t)CaptureBuffer::Count)
+				{
+					return Fail("draw " + std::to_string(i) + " references an undefined geometry or buffer");
+				}
+			}
+			break;
+		}
+		default:
+			// Unknown records are skipped, so older readers can step over newer ones.
+			break;
+		}
+
+		mPosition += sizeof(record) + record.Size;
+	}
+
+	return started;
+}
+
+const void* FrameTrace::Element(CaptureBuffer buffer, std::uint32_t index)const
+{
+	const std::vector<std::uint8_t>& bytes = mBuffers[(int)buffer];
+	const std::uint32_t stride = mElementByteSizes[(int)buffer];
+	if (stride == 0 || (std::uint64_t)index*stride + stride > bytes.size())
+		return nullptr;
+	return bytes.data() + (size_t)index*stride;
+}
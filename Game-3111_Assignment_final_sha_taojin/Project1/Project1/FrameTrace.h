@@ -0,0 +1,225 @@
+//***************************************************************************************
+// FrameTrace.h
+//
+// The frame trace format FrameCapture writes, and FrameTrace, which reads a trace back
+// one frame at a time for the Tools replay command.  The format holds plain integers and
+// bytes: topologies and index formats are stored as the values of their Direct3D enums,
+// and this header includes no Direct3D headers, so traces captured on Windows replay and
+// diff on Linux.
+//
+// Layout: a header, then records, each a type and size followed by that many bytes.  A
+// Frame record starts a frame; its Buffer and Draws records follow.  Texture and
+// Geometry records come before the first draw that uses them.
+//***************************************************************************************
+
+#pragma once
+
+#include "MappedFile.h"
+#include "RenderTypes.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// The upload buffers of a FrameResource, as captured.
+enum class CaptureBuffer : std::uint32_t
+{
+	PassCB = 0,
+	ObjectCB,
+	MaterialCB,
+	WavesVB,
+	ParticleVB,
+	ClothVB,
+	SkinnedVB,
+	ClusterLights,
+	ClusterRanges,
+	ClusterLightIndices,
+	MeshletIB,
+	Count
+};
+
+const char* CaptureBufferName(CaptureBuffer buffer);
+
+// The D3D_PRIMITIVE_TOPOLOGY and DXGI_FORMAT values the demo's draws use; FrameCapture.cpp
+// checks them against the Direct3D headers.
+const std::uint32_t CaptureTopologyPointList = 1;
+const std::uint32_t CaptureTopologyTriangleList = 4;
+const std::uint32_t CaptureIndexFormat32 = 42;
+const std::uint32_t CaptureIndexFormat16 = 57;
+
+// One draw of the ordered list, stored as is.
+struct CaptureDraw
+{
+	std::uint32_t Layer;               // RenderLayer, which selects the PSO.
+	std::uint32_t Geometry;            // Index of the geometry, in the order the trace defines them.
+	std::uint32_t PrimitiveType;       // D3D_PRIMITIVE_TOPOLOGY.
+	std::uint32_t ObjCBIndex;
+	std::uint32_t MatCBIndex;
+	std::int32_t DiffuseSrvHeapIndex;
+	std::uint32_t IndexCount;
+	std::uint32_t StartIndexLocation;
+	std::int32_t BaseVertexLocation;
+	std::int32_t BakedLightOffset;
+
+	// CaptureBuffer the vertices are read from, or CaptureBuffer::Count for the
+	// geometry's own vertex buffer.
+	std::uint32_t VertexSource;
+
+	// Likewise for the indices.
+	std::uint32_t IndexSource;
+};
+
+// A geometry as the trace stores it: the sizes of MeshGeometry's buffers and the CPU
+// copies of its vertices, indices and baked light colors.  A copy is empty where the
+// geometry has none, and Vertices is empty for dynamic geometry, whose vertices are
+// captured with the frame resource.
+struct CaptureGeometry
+{
+	std::string Name;
+
+	std::uint32_t VertexByteStride = 0;
+	std::uint32_t VertexBufferByteSize = 0;
+	std::uint32_t IndexFormat = CaptureIndexFormat16;  // DXGI_FORMAT.
+	std::uint32_t IndexBufferByteSize = 0;
+	std::uint32_t ColorByteStride = 0;
+	std::uint32_t ColorBufferByteSize = 0;
+
+	std::vector<std::uint8_t> Vertices;
+	std::vector<std::uint8_t> Indices;
+	std::vector<std::uint8_t> Colors;
+
+	std::uint32_t IndexByteSize()const { return IndexFormat == CaptureIndexFormat32 ? 4 : 2; }
+};
+
+// The stored records, shared by FrameCapture and FrameTrace.
+namespace FrameTraceFormat
+{
+	const char Magic[4] = { 'F', 'C', 'A', 'P' };
+	const std::uint32_t Version = 2;
+
+	struct Header
+	{
+		char Magic[4];
+		std::uint32_t Version;
+		std::uint32_t FrameCount;
+		std::uint32_t Reserved;
+	};
+
+	enum RecordType : std::uint32_t
+	{
+		RecordTexture = 1,
+		RecordGeometry,
+		RecordFrame,
+		RecordBuffer,
+		RecordDraws
+	};
+
+	struct Record
+	{
+		std::uint32_t Type;
+		std::uint32_t Size;
+	};
+
+	// Followed by the file name.
+	struct TextureRecord
+	{
+		std::int32_t SrvHeapIndex;
+		std::uint32_t Reserved;
+	};
+
+	// Followed by the name and the vertex, index and color bytes.  The byte counts are
+	// those stored, which are zero for a buffer the geometry has no CPU copy of.
+	struct GeometryRecord
+	{
+		std::uint32_t VertexByteStride;
+		std::uint32_t VertexBufferByteSize;
+		std::uint32_t IndexFormat;
+		std::uint32_t IndexBufferByteSize;
+		std::uint32_t ColorByteStride;
+		std::uint32_t ColorBufferByteSize;
+		std::uint32_t NameBytes;
+		std::uint32_t VertexBytes;
+		std::uint32_t IndexBytes;
+		std::uint32_t ColorBytes;
+	};
+
+	struct FrameRecord
+	{
+		std::uint32_t Frame;
+		std::uint32_t Reserved;
+	};
+
+	// Followed by RangeCount ranges, each a BufferRange and its bytes.
+	struct BufferRecord
+	{
+		std::uint32_t Buffer;
+		std::uint32_t ElementByteSize;
+		std::uint64_t ByteSize;
+		std::uint32_t RangeCount;
+		std::uint32_t Reserved;
+	};
+
+	struct BufferRange
+	{
+		std::uint32_t Offset;
+		std::uint32_t Size;
+	};
+
+	static_assert(sizeof(Header) == 16, "Header is stored as is");
+	static_assert(sizeof(GeometryRecord) == 40, "GeometryRecord is stored as is");
+	static_assert(sizeof(BufferRecord) == 24, "BufferRecord is stored as is");
+	static_assert(sizeof(CaptureDraw) == 48, "CaptureDraw is stored as is");
+}
+
+// Reads a trace frame by frame.  The buffers and draws are those of the current frame;
+// geometry and textures accumulate as the trace defines them.
+class FrameTrace
+{
+public:
+	// Returns false if the file cannot be read or is not a trace, see Error.
+	bool Open(const std::wstring& filename);
+
+	// Moves to the next frame.  Returns false after the last one or if a record is
+	// malformed, in which case Error is set.
+	bool NextFrame();
+
+	int FrameCount()const { return (int)mFrameCount; }
+
+	// Of the current frame.
+	std::uint32_t Frame()const { return mFrame; }
+	const std::vector<CaptureDraw>& Draws()const { return mDraws; }
+	const std::vector<std::uint8_t>& Buffer(CaptureBuffer buffer)const { return mBuffers[(int)buffer]; }
+	std::uint32_t ElementByteSize(CaptureBuffer buffer)const { return mElementByteSizes[(int)buffer]; }
+	std::uint64_t ChangedBytes(CaptureBuffer buffer)const { return mChangedBytes[(int)buffer]; }
+
+	// Element index of buffer, or nullptr past its end.
+	const void* Element(CaptureBuffer buffer, std::uint32_t index)const;
+
+	int GeometryCount()const { return (int)mGeometries.size(); }
+	const CaptureGeometry& Geometry(int index)const { return mGeometries[index]; }
+
+	// By SRV heap index; empty where the trace defines none.
+	const std::vector<std::wstring>& Textures()const { return mTextures; }
+
+	const std::string& Error()const { return mError; }
+
+private:
+	bool ReadGeometry(const std::uint8_t* data, std::size_t size);
+	bool ReadBuffer(const std::uint8_t* data, std::size_t size);
+	bool Fail(const std::string& message);
+
+private:
+	MappedFile mFile;
+	std::size_t mPosition = 0;
+	std::uint32_t mFrameCount = 0;
+
+	std::uint32_t mFrame = 0;
+	std::vector<CaptureDraw> mDraws;
+	std::vector<std::uint8_t> mBuffers[(int)CaptureBuffer::Count];
+	std::uint32_t mElementByteSizes[(int)CaptureBuffer::Count] = {};
+	std::uint64_t mChangedBytes[(int)CaptureBuffer::Count] = {};
+
+	std::vector<CaptureGeometry> mGeometries;
+	std::vector<std::wstring> mTextures;
+
+	std::string mError;
+};
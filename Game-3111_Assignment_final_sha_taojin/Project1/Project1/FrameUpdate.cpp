@@ -0,0 +1,229 @@
+#include "FrameUpdate.h"
+#include "ParallelFor.h"
+#include "../../Common/RenderStats.h"
+
+using namespace DirectX;
+
+namespace
+{
+	D3D12_GPU_VIRTUAL_ADDRESS GpuAddress(ID3D12Resource* resource)
+	{
+		return resource != nullptr ? resource->GetGPUVirtualAddress() : 0;
+	}
+}
+
+void UpdateObjectConstants(const std::vector<std::unique_ptr<RenderItem>>& ritems,
+	UploadBuffer<ObjectConstants>& objectCB)
+{
+	int copies = 0;
+	for (auto& e : ritems)
+	{
+		// Only update the cbuffer data if the constants have changed.
+		// This needs to be tracked per frame resource.
+		if (e->NumFramesDirty > 0)
+		{
+			XMMATRIX world = XMLoadFloat4x4(&e->World);
+			XMMATRIX texTransform = XMLoadFloat4x4(&e->TexTransform);
+
+			ObjectConstants objConstants;
+			XMStoreFloat4x4(&objConstants.World, XMMatrixTranspose(world));
+			XMStoreFloat4x4(&objConstants.TexTransform, XMMatrixTranspose(texTransform));
+
+			objectCB.CopyData(e->ObjCBIndex, objConstants);
+			++copies;
+
+			// Next FrameResource need to be updated too.
+			e->NumFramesDirty--;
+		}
+	}
+	objectCB.CountUploads(copies, copies);
+}
+
+void UpdateMaterialConstants(const std::unordered_map<std::string, std::unique_ptr<Material>>& materials,
+	UploadBuffer<MaterialConstants>& materialCB)
+{
+	int copies = 0;
+	for (auto& e : materials)
+	{
+		// Only update the cbuffer data if the constants have changed.  If the cbuffer
+		// data changes, it needs to be updated for each FrameResource.
+		Material* mat = e.second.get();
+		if (mat->NumFramesDirty > 0)
+		{
+			XMMATRIX matTransform = XMLoadFloat4x4(&mat->MatTransform);
+
+			MaterialConstants matConstants;
+			matConstants.DiffuseAlbedo = mat->DiffuseAlbedo;
+			matConstants.FresnelR0 = mat->FresnelR0;
+			matConstants.Roughness = mat->Roughness;
+			XMStoreFloat4x4(&matConstants.MatTransform, XMMatrixTranspose(matTransform));
+
+			materialCB.CopyData(mat->MatCBIndex, matConstants);
+			++copies;
+
+			// Next FrameResource need to be updated too.
+			mat->NumFramesDirty--;
+		}
+	}
+	materialCB.CountUploads(copies, copies);
+}
+
+void UpdateWavesVertices(const Waves& waves, UploadBuffer<Vertex>& wavesVB)
+{
+	for (int i = 0; i < waves.VertexCount(); ++i)
+	{
+		Vertex v;
+
+		v.Pos = waves.Position(i);
+		v.Normal = waves.Normal(i);
+
+		// Derive tex-coords from position by
+		// mapping [-w/2,w/2] --> [0,1]
+		v.TexC.x = 0.5f + v.Pos.x / waves.Width();
+		v.TexC.y = 0.5f - v.Pos.z / waves.Depth();
+
+		wavesVB.CopyData(i, v);
+	}
+	wavesVB.CountUploads(waves.VertexCount(), waves.VertexCount());
+}
+
+void UpdateParticleVertices(const ParticleSystem& particles, UploadBuffer<ParticleVertex>& particleVB)
+{
+	// Each block is packed on the stack and copied with one CopyData, so the upload heap
+	// sees long sequential writes.
+	const int blockSize = 256;
+
+	int offset = 0;
+	int copies = 0;
+	for (int pool = 0; pool < particles.PoolCount(); ++pool)
+	{
+		const int count = particles.LiveCount(pool);
+		ParallelForRange(count, ParticleSystem::ChunkSize, [&](int begin, int end)
+		{
+			ParticleVertex block[blockSize];
+			for (int first = begin; first < end; first += blockSize)
+			{
+				const int n = std::min(blockSize, end - first);
+				particles.WriteVertices(pool, first, n, block);
+				particleVB.CopyData(offset + first, block, n);
+			}
+		});
+		offset += count;
+
+		// ChunkSize is a multiple of blockSize, so only the last block is partial.
+		copies += (count + blockSize - 1) / blockSize;
+	}
+	particleVB.CountUploads(copies, offset);
+}
+
+void UpdateClothVertices(const ClothSystem& cloth, UploadBuffer<ClothVertex>& clothVB)
+{
+	ParallelForRange(cloth.VertexCount(), ClothSystem::ChunkSize, [&](int begin, int end)
+	{
+		cloth.WriteVertices(begin, end - begin, clothVB.MappedElements(begin, end - begin));
+	});
+}
+
+void UpdateSkinnedVertices(const SkinnedCrowd& crowd, UploadBuffer<SkinnedVertex>& skinnedVB)
+{
+	crowd.Skin(skinnedVB.MappedElements(0, crowd.VertexCount()));
+}
+
+void UpdateBodyRenderItems(const RigidBodyWorld& world, const std::vector<BodyRenderItem>& items)
+{
+	for (const BodyRenderItem& item : items)
+	{
+		if (!world.Moved(item.Body))
+			continue;
+
+		XMStoreFloat4x4(&item.Item->World,
+			XMMatrixScaling(item.Scale.x, item.Scale.y, item.Scale.z) * world.Transform(item.Body));
+		item.Item->NumFramesDirty = gNumFrameResources;
+	}
+}
+
+DrawCommand* BuildDrawList(const std::vector<RenderItem*>& ritems, D3D12_GPU_VIRTUAL_ADDRESS objectCB,
+	D3D12_GPU_VIRTUAL_ADDRESS materialCB, MemoryArena& arena)
+{
+	const UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
+	const UINT matCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(MaterialConstants));
+
+	DrawCommand* drawList = arena.AllocateArray<DrawCommand>(ritems.size());
+	if (drawList == nullptr)
+		return nullptr;
+
+	for (size_t i = 0; i < ritems.size(); ++i)
+	{
+		const RenderItem* ri = ritems[i];
+		const MeshGeometry* geo = ri->Geo;
+
+		DrawCommand& cmd = drawList[i];
+		cmd.VertexBuffer.BufferLocation = GpuAddress(geo->VertexBufferGPU.Get());
+		cmd.VertexBuffer.StrideInBytes = geo->VertexByteStride;
+		cmd.VertexBuffer.SizeInBytes = geo->VertexBufferByteSize;
+
+		if (ri->BakedLightOffset >= 0)
+		{
+			const UINT offset = ri->BakedLightOffset * geo->ColorByteStride;
+			cmd.BakedColors.BufferLocation = GpuAddress(geo->ColorBufferGPU.Get()) + offset;
+			cmd.BakedColors.StrideInBytes = geo->ColorByteStride;
+			cmd.BakedColors.SizeInBytes = geo->ColorBufferByteSize - offset;
+		}
+
+		if (ri->IndexBufferOverride.SizeInBytes != 0)
+		{
+			cmd.IndexBuffer = ri->IndexBufferOverride;
+		}
+		else
+		{
+			cmd.IndexBuffer.BufferLocation = GpuAddress(geo->IndexBufferGPU.Get());
+			cmd.IndexBuffer.Format = geo->IndexFormat;
+			cmd.IndexBuffer.SizeInBytes = geo->IndexBufferByteSize;
+		}
+
+		cmd.PrimitiveType = ri->PrimitiveType;
+		cmd.DiffuseSrvHeapIndex = ri->Mat->DiffuseSrvHeapIndex;
+		cmd.ObjectCBAddress = objectCB + (UINT64)ri->ObjCBIndex * objCBByteSize;
+		cmd.MaterialCBAddress = materialCB + (UINT64)ri->Mat->MatCBIndex * matCBByteSize;
+
+		cmd.IndexCount = ri->IndexCount;
+		cmd.StartIndexLocation = ri->StartIndexLocation;
+		cmd.BaseVertexLocation = ri->BaseVertexLocation;
+	}
+
+	return drawList;
+}
+
+void SubmitDrawList(ID3D12GraphicsCommandList* cmdList, const DrawCommand* drawList, std::size_t count,
+	D3D12_GPU_DESCRIPTOR_HANDLE srvHeapStart, UINT srvDescriptorSize)
+{
+	UINT bakedCount = 0;
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		const DrawCommand& cmd = drawList[i];
+		cmdList->IASetVertexBuffers(0, 1, &cmd.VertexBuffer);
+		if (cmd.BakedColors.SizeInBytes != 0)
+		{
+			cmdList->IASetVertexBuffers(1, 1, &cmd.BakedColors);
+			++bakedCount;
+		}
+		cmdList->IASetIndexBuffer(&cmd.IndexBuffer);
+		cmdList->IASetPrimitiveTopology(cmd.PrimitiveType);
+
+		CD3DX12_GPU_DESCRIPTOR_HANDLE tex(srvHeapStart);
+		tex.Offset(cmd.DiffuseSrvHeapIndex, srvDescriptorSize);
+
+		cmdList->SetGraphicsRootDescriptorTable(0, tex);
+		cmdList->SetGraphicsRootConstantBufferView(1, cmd.ObjectCBAddress);
+		cmdList->SetGraphicsRootConstantBufferView(3, cmd.MaterialCBAddress);
+
+		cmdList->DrawIndexedInstanced(cmd.IndexCount, 1, cmd.StartIndexLocation, cmd.BaseVertexLocation, 0);
+		RenderStats::AddDraw(cmd.IndexCount, 1, cmd.PrimitiveType);
+	}
+
+	RenderStats::AddStateChange(StateChange::VertexBuffer, (UINT)count + bakedCount);
+	RenderStats::AddStateChange(StateChange::IndexBuffer, (UINT)count);
+	RenderStats::AddStateChange(StateChange::Topology, (UINT)count);
+	RenderStats::AddStateChange(StateChange::DescriptorTable, (UINT)count);
+	RenderStats::AddStateChange(StateChange::RootCbv, 2 * (UINT)count);
+}
@@ -0,0 +1,129 @@
+//***************************************************************************************
+// FrameUpdate.h
+//
+// The per-frame CPU work of the tree billboards demo: packing the dirty object and
+// material constants into the current frame resource, refreshing the dynamic waves,
+// particle, cloth and skinned vertex buffers, moving the render items of rigid bodies
+// and turning a render layer into a list of draw
+// commands.  The demo calls these from Update/Draw, and the headless stress command
+// (Tools stress) runs the same functions against a FrameResource created without a
+// device.
+//***************************************************************************************
+
+#pragma once
+
+#include "FrameResource.h"
+#include "MemoryArena.h"
+#include "RigidBodyWorld.h"
+#include "Waves.h"
+
+// Lightweight structure stores parameters to draw a shape.  This will
+// vary from app-to-app.
+struct RenderItem
+{
+	RenderItem() = default;
+
+	// World matrix of the shape that describes the object's local space
+	// relative to the world space, which defines the position, orientation,
+	// and scale of the object in the world.
+	DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
+
+	DirectX::XMFLOAT4X4 TexTransform = MathHelper::Identity4x4();
+
+	// Dirty flag indicating the object data has changed and we need to update the constant buffer.
+	// Because we have an object cbuffer for each FrameResource, we have to apply the
+	// update to each FrameResource.  Thus, when we modify obect data we should set
+	// NumFramesDirty = gNumFrameResources so that each frame resource gets the update.
+	int NumFramesDirty = gNumFrameResources;
+
+	// Index into GPU constant buffer corresponding to the ObjectCB for this render item.
+	UINT ObjCBIndex = -1;
+
+	Material* Mat = nullptr;
+	MeshGeometry* Geo = nullptr;
+
+	// Primitive topology.
+	D3D12_PRIMITIVE_TOPOLOGY PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+
+	// DrawIndexedInstanced parameters.
+	UINT IndexCount = 0;
+	UINT StartIndexLocation = 0;
+	int BaseVertexLocation = 0;
+
+	// Vertex offset of this item's baked lighting in Geo->ColorBufferGPU, or -1 when the
+	// item is lit dynamically.  Vertex v of the item reads color BakedLightOffset + v.
+	int BakedLightOffset = -1;
+
+	// The buffer of the item's indices when they are not in Geo's own, as the meshlet
+	// culled items' are in the frame's MeshletIB.  Unused while SizeInBytes is zero.
+	D3D12_INDEX_BUFFER_VIEW IndexBufferOverride = {};
+
+	// Chunk of the app's static batches this item draws, or -1.
+	int StaticChunk = -1;
+};
+
+// A render item that follows a rigid body.  Scale sizes the item's unit mesh to the
+// body's shape.
+struct BodyRenderItem
+{
+	int Body = -1;
+	DirectX::XMFLOAT3 Scale = { 1.0f, 1.0f, 1.0f };
+	RenderItem* Item = nullptr;
+};
+
+// Everything DrawRenderItems binds for one render item.  Buffer locations are zero for
+// geometry without GPU buffers (null device).
+struct DrawCommand
+{
+	D3D12_VERTEX_BUFFER_VIEW VertexBuffer = {};
+
+	// Slot 1 baked light colors; SizeInBytes is zero for dynamically lit items.
+	D3D12_VERTEX_BUFFER_VIEW BakedColors = {};
+
+	D3D12_INDEX_BUFFER_VIEW IndexBuffer = {};
+	D3D12_PRIMITIVE_TOPOLOGY PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+
+	int DiffuseSrvHeapIndex = 0;
+	D3D12_GPU_VIRTUAL_ADDRESS ObjectCBAddress = 0;
+	D3D12_GPU_VIRTUAL_ADDRESS MaterialCBAddress = 0;
+
+	UINT IndexCount = 0;
+	UINT StartIndexLocation = 0;
+	int BaseVertexLocation = 0;
+};
+
+// Copies the constants of every item with NumFramesDirty > 0 and decrements the count.
+void UpdateObjectConstants(const std::vector<std::unique_ptr<RenderItem>>& ritems,
+	UploadBuffer<ObjectConstants>& objectCB);
+
+// Same for the materials.
+void UpdateMaterialConstants(const std::unordered_map<std::string, std::unique_ptr<Material>>& materials,
+	UploadBuffer<MaterialConstants>& materialCB);
+
+// Writes the current wave solution with tex-coords derived from the position.
+void UpdateWavesVertices(const Waves& waves, UploadBuffer<Vertex>& wavesVB);
+
+// Streams the live particles of every pool into particleVB, pool after pool starting at
+// ParticleSystem::StreamOffset, in parallel blocks.
+void UpdateParticleVertices(const ParticleSystem& particles, UploadBuffer<ParticleVertex>& particleVB);
+
+// Writes every flag's vertices straight into the mapped clothVB, in parallel chunks.
+void UpdateClothVertices(const ClothSystem& cloth, UploadBuffer<ClothVertex>& clothVB);
+
+// Poses and skins every crowd character straight into the mapped skinnedVB.
+void UpdateSkinnedVertices(const SkinnedCrowd& crowd, UploadBuffer<SkinnedVertex>& skinnedVB);
+
+// Sets the world matrix of the items whose bodies moved in the last Update and marks them
+// dirty, so UpdateObjectConstants picks up the new transforms.
+void UpdateBodyRenderItems(const RigidBodyWorld& world, const std::vector<BodyRenderItem>& items);
+
+// Builds one command per item in arena (normally the thread's frame arena) and returns
+// them, or nullptr if the arena is full.  The constant buffer addresses are those of the
+// frame resource's ObjectCB and MaterialCB, or zero without a device.
+DrawCommand* BuildDrawList(const std::vector<RenderItem*>& ritems, D3D12_GPU_VIRTUAL_ADDRESS objectCB,
+	D3D12_GPU_VIRTUAL_ADDRESS materialCB, MemoryArena& arena);
+
+// Records the commands with the demo's root signature layout (table 0 = diffuse SRV,
+// CBV 1 = object, CBV 3 = material) and counts them in RenderStats.
+void SubmitDrawList(ID3D12GraphicsCommandList* cmdList, const DrawCommand* drawList, std::size_t count,
+	D3D12_GPU_DESCRIPTOR_HANDLE srvHeapStart, UINT srvDescriptorSize);
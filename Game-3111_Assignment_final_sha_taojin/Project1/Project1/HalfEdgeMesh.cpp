@@ -0,0 +1,713 @@
+#include "HalfEdgeMesh.h"
+#include "ParallelFor.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <unordered_map>
+
+using namespace DirectX;
+
+const std::uint32_t HalfEdgeMesh::Invalid;
+
+namespace
+{
+	const int GrainSize = 4096;
+
+	XMFLOAT2 MidTexC(const XMFLOAT2& a, const XMFLOAT2& b)
+	{
+		return XMFLOAT2(0.5f*(a.x + b.x), 0.5f*(a.y + b.y));
+	}
+
+	// Angle between a and b, which need not be normalized.
+	float AngleBetween(FXMVECTOR a, FXMVECTOR b)
+	{
+		const float lengths = XMVectorGetX(XMVector3Length(a))*XMVectorGetX(XMVector3Length(b));
+		if (lengths <= 0.0f)
+			return 0.0f;
+		const float c = XMVectorGetX(XMVector3Dot(a, b)) / lengths;
+		return std::acos(std::min(std::max(c, -1.0f), 1.0f));
+	}
+}
+
+void HalfEdgeMesh::Clear()
+{
+	mPositions.clear();
+	mNormals.clear();
+	mVertexHalfEdges.clear();
+	mFaceStarts.clear();
+	mHalfEdges.clear();
+	mCornerTexC.clear();
+	mEdgeHalfEdges.clear();
+	mBoundaryEdgeCount = 0;
+	mNonManifoldEdgeCount = 0;
+	mError.clear();
+}
+
+bool HalfEdgeMesh::Build(const XMFLOAT3* positions, std::uint32_t vertexCount, const std::uint32_t* indices,
+	const std::uint32_t* faceStarts, std::uint32_t faceCount, const XMFLOAT2* cornerTexC)
+{
+	Clear();
+
+	if (faceStarts[0] != 0)
+	{
+		mError = "the first face does not start at index 0";
+		return false;
+	}
+	for (std::uint32_t f = 0; f < faceCount; ++f)
+	{
+		const std::uint32_t begin = faceStarts[f];
+		const std::uint32_t end = faceStarts[f + 1];
+		if (end < begin + 3)
+		{
+			mError = "face " + std::to_string(f) + " has fewer than three vertices";
+			return false;
+		}
+		for (std::uint32_t k = begin; k < end; ++k)
+		{
+			const std::uint32_t next = k + 1 < end ? k + 1 : begin;
+			if (indices[k] >= vertexCount)
+			{
+				mError = "face " + std::to_string(f) + " indexes past the vertices";
+				return false;
+			}
+			if (indices[k] == indices[next])
+			{
+				mError = "face " + std::to_string(f) + " repeats a vertex";
+				return false;
+			}
+		}
+	}
+
+	const std::uint32_t halfEdgeCount = faceStarts[faceCount];
+	mPositions.assign(positions, positions + vertexCount);
+	mFaceStarts.assign(faceStarts, faceStarts + faceCount + 1);
+	if (cornerTexC != nullptr)
+		mCornerTexC.assign(cornerTexC, cornerTexC + halfEdgeCount);
+
+	mHalfEdges.resize(halfEdgeCount);
+	ParallelForRange((int)faceCount, GrainSize / 4, [&](int begin, int end)
+	{
+		for (std::uint32_t f = (std::uint32_t)begin; f < (std::uint32_t)end; ++f)
+		{
+			for (std::uint32_t h = mFaceStarts[f]; h < mFaceStarts[f + 1]; ++h)
+				mHalfEdges[h] = { indices[h], Invalid, f, Invalid };
+		}
+	});
+
+	// Outgoing half-edges of each vertex, grouped by vertex and in half-edge order.
+	std::vector<std::uint32_t> outStarts(vertexCount + 1, 0);
+	for (const HalfEdge& he : mHalfEdges)
+		++outStarts[he.Origin + 1];
+	for (std::uint32_t v = 0; v < vertexCount; ++v)
+		outStarts[v + 1] += outStarts[v];
+	std::vector<std::uint32_t> outgoing(halfEdgeCount);
+	{
+		std::vector<std::uint32_t> cursor(outStarts.begin(), outStarts.end() - 1);
+		for (std::uint32_t h = 0; h < halfEdgeCount; ++h)
+			outgoing[cursor[mHalfEdges[h].Origin]++] = h;
+	}
+
+	// The twin of a->b is the only b->a, provided a->b is the only a->b.  Each half-edge
+	// decides its own twin, so the result does not depend on the order they run in.
+	std::atomic<std::uint32_t> nonManifold(0);
+	ParallelForRange((int)halfEdgeCount, GrainSize, [&](int begin, int end)
+	{
+		std::uint32_t localNonManifold = 0;
+		for (std::uint32_t h = (std::uint32_t)begin; h < (std::uint32_t)end; ++h)
+		{
+			const std::uint32_t a = mHalfEdges[h].Origin;
+			const std::uint32_t b = Dest(h);
+
+			// The lowest half-edge between a and b, either way, counts a non-manifold edge.
+			int forward = 0;
+			std::uint32_t lowest = h;
+			for (std::uint32_t k = outStarts[a]; k < outStarts[a + 1]; ++k)
+			{
+				if (Dest(outgoing[k]) == b)
+				{
+					++forward;
+					lowest = std::min(lowest, outgoing[k]);
+				}
+			}
+
+			int backward = 0;
+			std::uint32_t twin = Invalid;
+			for (std::uint32_t k = outStarts[b]; k < outStarts[b + 1]; ++k)
+			{
+				if (Dest(outgoing[k]) == a)
+				{
+					++backward;
+					twin = outgoing[k];
+					lowest = std::min(lowest, twin);
+				}
+			}
+
+			if (forward == 1 && backward == 1)
+				mHalfEdges[h].Twin = twin;
+			else if ((forward > 1 || backward > 0) && lowest == h)
+				++localNonManifold;
+		}
+		nonManifold += localNonManifold;
+	});
+
+	// Number the undirected edges.
+	for (std::uint32_t h = 0; h < halfEdgeCount; ++h)
+	{
+		HalfEdge& he = mHalfEdges[h];
+		if (he.Twin == Invalid || h < he.Twin)
+		{
+			he.Edge = (std::uint32_t)mEdgeHalfEdges.size();
+			mEdgeHalfEdges.push_back(h);
+			mBoundaryEdgeCount += he.Twin == Invalid;
+		}
+	}
+	ParallelForRange((int)halfEdgeCount, GrainSize, [&](int begin, int end)
+	{
+		for (std::uint32_t h = (std::uint32_t)begin; h < (std::uint32_t)end; ++h)
+		{
+			if (mHalfEdges[h].Twin != Invalid && mHalfEdges[h].Twin < h)
+				mHalfEdges[h].Edge = mHalfEdges[mHalfEdges[h].Twin].Edge;
+		}
+	});
+	mNonManifoldEdgeCount = nonManifold;
+
+	// Rotations start after the boundary, if the vertex is on one.
+	mVertexHalfEdges.assign(vertexCount, Invalid);
+	ParallelForRange((int)vertexCount, GrainSize, [&](int begin, int end)
+	{
+		for (std::uint32_t v = (std::uint32_t)begin; v < (std::uint32_t)end; ++v)
+		{
+			for (std::uint32_t k = outStarts[v]; k < outStarts[v + 1]; ++k)
+			{
+				const std::uint32_t h = outgoing[k];
+				if (mVertexHalfEdges[v] == Invalid)
+					mVertexHalfEdges[v] = h;
+				if (mHalfEdges[Prev(h)].Twin == Invalid)
+				{
+					mVertexHalfEdges[v] = h;
+					break;
+				}
+			}
+		}
+	});
+
+	ComputeNormals();
+	return true;
+}
+
+bool HalfEdgeMesh::Build(const GeometryGenerator::MeshData& meshData, float weldDistance)
+{
+	const std::vector<GeometryGenerator::Vertex>& vertices = meshData.Vertices;
+	const std::uint32_t sourceCount = (std::uint32_t)vertices.size();
+
+	// Weld on a grid of weldDistance cells: a vertex joins the first earlier one within
+	// reach in its own or a neighboring cell.
+	std::vector<std::uint32_t> remap(sourceCount);
+	std::vector<XMFLOAT3> positions;
+	if (weldDistance > 0.0f)
+	{
+		auto cellOf = [weldDistance](const XMFLOAT3& p, int axis)
+		{
+			const float c = axis == 0 ? p.x : axis == 1 ? p.y : p.z;
+			return (std::int64_t)std::floor(c / weldDistance);
+		};
+		auto key = [](std::int64_t x, std::int64_t y, std::int64_t z)
+		{
+			return ((std::uint64_t)(x & 0x1fffff) << 42) | ((std::uint64_t)(y & 0x1fffff) << 21) | (std::uint64_t)(z & 0x1fffff);
+		};
+
+		// First welded vertex of each cell, chained through nextInCell.
+		std::unordered_map<std::uint64_t, std::uint32_t> cells;
+		std::vector<std::uint32_t> nextInCell;
+		const float weldDistanceSq = weldDistance*weldDistance;
+
+		for (std::uint32_t i = 0; i < sourceCount; ++i)
+		{
+			const XMFLOAT3& p = vertices[i].Position;
+			const std::int64_t cx = cellOf(p, 0);
+			const std::int64_t cy = cellOf(p, 1);
+			const std::int64_t cz = cellOf(p, 2);
+
+			std::uint32_t match = Invalid;
+			for (int dx = -1; dx <= 1 && match == Invalid; ++dx)
+			{
+				for (int dy = -1; dy <= 1 && match == Invalid; ++dy)
+				{
+					for (int dz = -1; dz <= 1 && match == Invalid; ++dz)
+					{
+						auto cell = cells.find(key(cx + dx, cy + dy, cz + dz));
+						for (std::uint32_t w = cell != cells.end() ? cell->second : Invalid; w != Invalid; w = nextInCell[w])
+						{
+							const XMVECTOR d = XMVectorSubtract(XMLoadFloat3(&positions[w]), XMLoadFloat3(&p));
+							if (XMVectorGetX(XMVector3LengthSq(d)) <= weldDistanceSq)
+							{
+								match = w;
+								break;
+							}
+						}
+					}
+				}
+			}
+
+			if (match == Invalid)
+			{
+				match = (std::uint32_t)positions.size();
+				positions.push_back(p);
+				auto inserted = cells.insert({ key(cx, cy, cz), match });
+				nextInCell.push_back(inserted.second ? Invalid : inserted.first->second);
+				inserted.first->second = match;
+			}
+			remap[i] = match;
+		}
+	}
+	else
+	{
+		for (std::uint32_t i = 0; i < sourceCount; ++i)
+		{
+			remap[i] = i;
+			positions.push_back(vertices[i].Position);
+		}
+	}
+
+	std::vector<std::uint32_t> indices;
+	std::vector<std::uint32_t> faceStarts(1, 0);
+	std::vector<XMFLOAT2> texC;
+	indices.reserve(meshData.Indices32.size());
+	texC.reserve(meshData.Indices32.size());
+	for (size_t t = 0; t + 2 < meshData.Indices32.size(); t += 3)
+	{
+		const std::uint32_t* corners = &meshData.Indices32[t];
+		if (corners[0] >= sourceCount || corners[1] >= sourceCount || corners[2] >= sourceCount)
+		{
+			Clear();
+			mError = "triangle " + std::to_string(t / 3) + " indexes past the vertices";
+			return false;
+		}
+
+		const std::uint32_t a = remap[corners[0]];
+		const std::uint32_t b = remap[corners[1]];
+		const std::uint32_t c = remap[corners[2]];
+		if (a == b || b == c || c == a)
+			continue;
+
+		for (int k = 0; k < 3; ++k)
+		{
+			indices.push_back(remap[corners[k]]);
+			texC.push_back(vertices[corners[k]].TexC);
+		}
+		faceStarts.push_back((std::uint32_t)indices.size());
+	}
+
+	return Build(positions.data(), (std::uint32_t)positions.size(), indices.data(), faceStarts.data(),
+		(std::uint32_t)faceStarts.size() - 1, texC.data());
+}
+
+std::uint32_t HalfEdgeMesh::Valence(std::uint32_t v)const
+{
+	std::uint32_t valence = 0;
+	ForEachVertexNeighbor(v, [&valence](std::uint32_t) { ++valence; });
+	return valence;
+}
+
+void HalfEdgeMesh::ComputeNormals()
+{
+	const std::uint32_t faceCount = FaceCount();
+	std::vector<XMFLOAT3> faceNormals(faceCount);
+
+	// Newell's method, which also handles polygons that are not quite planar.
+	ParallelForRange((int)faceCount, GrainSize, [&](int begin, int end)
+	{
+		for (std::uint32_t f = (std::uint32_t)begin; f < (std::uint32_t)end; ++f)
+		{
+			XMVECTOR n = XMVectorZero();
+			for (std::uint32_t h = mFaceStarts[f]; h < mFaceStarts[f + 1]; ++h)
+			{
+				const XMVECTOR p = XMLoadFloat3(&mPositions[mHalfEdges[h].Origin]);
+				const XMVECTOR q = XMLoadFloat3(&mPositions[Dest(h)]);
+				n = XMVectorAdd(n, XMVector3Cross(p, q));
+			}
+			XMStoreFloat3(&faceNormals[f], XMVector3Normalize(n));
+		}
+	});
+
+	mNormals.resize(mPositions.size());
+	ParallelForRange((int)mPositions.size(), GrainSize, [&](int begin, int end)
+	{
+		for (std::uint32_t v = (std::uint32_t)begin; v < (std::uint32_t)end; ++v)
+		{
+			const XMVECTOR p = XMLoadFloat3(&mPositions[v]);
+			XMVECTOR n = XMVectorZero();
+			ForEachOutgoing(v, [&](std::uint32_t h)
+			{
+				const XMVECTOR toNext = XMVectorSubtract(XMLoadFloat3(&mPositions[Dest(h)]), p);
+				const XMVECTOR toPrev = XMVectorSubtract(XMLoadFloat3(&mPositions[mHalfEdges[Prev(h)].Origin]), p);
+				const float angle = AngleBetween(toNext, toPrev);
+				n = XMVectorAdd(n, XMVectorScale(XMLoadFloat3(&faceNormals[mHalfEdges[h].Face]), angle));
+			});
+			XMStoreFloat3(&mNormals[v], XMVector3Normalize(n));
+		}
+	});
+}
+
+XMVECTOR XM_CALLCONV HalfEdgeMesh::BoundaryVertexPoint(std::uint32_t v)const
+{
+	// The neighbors across the boundary edges: the end of the last outgoing half-edge
+	// and the start of the one coming in before the first.
+	std::uint32_t last = Invalid;
+	ForEachOutgoing(v, [&last](std::uint32_t h) { last = h; });
+	const std::uint32_t before = mHalfEdges[Prev(mVertexHalfEdges[v])].Origin;
+
+	const XMVECTOR p = XMLoadFloat3(&mPositions[v]);
+	const XMVECTOR neighbors = XMVectorAdd(XMLoadFloat3(&mPositions[Dest(last)]), XMLoadFloat3(&mPositions[before]));
+	return XMVectorAdd(XMVectorScale(p, 0.75f), XMVectorScale(neighbors, 0.125f));
+}
+
+bool HalfEdgeMesh::SubdivideLoop(HalfEdgeMesh& out)const
+{
+	const std::uint32_t vertexCount = VertexCount();
+	const std::uint32_t edgeCount = EdgeCount();
+	const std::uint32_t faceCount = FaceCount();
+	for (std::uint32_t f = 0; f < faceCount; ++f)
+	{
+		if (FaceSize(f) != 3)
+		{
+			out.Clear();
+			out.mError = "Loop subdivision needs triangles; face " + std::to_string(f) + " is not one";
+			return false;
+		}
+	}
+
+	// The old vertices, moved, then one new vertex per edge.
+	std::vector<XMFLOAT3> positions(vertexCount + edgeCount);
+	ParallelForRange((int)vertexCount, GrainSize, [&](int begin, int end)
+	{
+		for (std::uint32_t v = (std::uint32_t)begin; v < (std::uint32_t)end; ++v)
+		{
+			if (mVertexHalfEdges[v] == Invalid)
+			{
+				positions[v] = mPositions[v];
+				continue;
+			}
+			if (IsBoundaryVertex(v))
+			{
+				XMStoreFloat3(&positions[v], BoundaryVertexPoint(v));
+				continue;
+			}
+
+			std::uint32_t n = 0;
+			XMVECTOR sum = XMVectorZero();
+			ForEachOutgoing(v, [&](std::uint32_t h)
+			{
+				sum = XMVectorAdd(sum, XMLoadFloat3(&mPositions[Dest(h)]));
+				++n;
+			});
+
+			// Warren's weights.
+			const float beta = n == 3 ? 3.0f / 16.0f : 3.0f / (8.0f*n);
+			XMStoreFloat3(&positions[v], XMVectorAdd(XMVectorScale(XMLoadFloat3(&mPositions[v]), 1.0f - n*beta),
+				XMVectorScale(sum, beta)));
+		}
+	});
+
+	ParallelForRange((int)edgeCount, GrainSize, [&](int begin, int end)
+	{
+		for (std::uint32_t e = (std::uint32_t)begin; e < (std::uint32_t)end; ++e)
+		{
+			const std::uint32_t h = mEdgeHalfEdges[e];
+			const std::uint32_t twin = mHalfEdges[h].Twin;
+			const XMVECTOR ends = XMVectorAdd(XMLoadFloat3(&mPositions[mHalfEdges[h].Origin]), XMLoadFloat3(&mPositions[Dest(h)]));
+			if (twin == Invalid)
+			{
+				XMStoreFloat3(&positions[vertexCount + e], XMVectorScale(ends, 0.5f));
+				continue;
+			}
+
+			// The vertices across the edge in the two triangles.
+			const XMVECTOR opposite = XMVectorAdd(XMLoadFloat3(&mPositions[mHalfEdges[Prev(h)].Origin]),
+				XMLoadFloat3(&mPositions[mHalfEdges[Prev(twin)].Origin]));
+			XMStoreFloat3(&positions[vertexCount + e], XMVectorAdd(XMVectorScale(ends, 0.375f), XMVectorScale(opposite, 0.125f)));
+		}
+	});
+
+	// Triangle abc becomes (a, ab, ca), (ab, b, bc), (ca, bc, c) and (ab, bc, ca), in the
+	// same winding.
+	std::vector<std::uint32_t> indices(12*(size_t)faceCount);
+	std::vector<XMFLOAT2> texC(HasTexC() ? indices.size() : 0);
+	ParallelForRange((int)faceCount, GrainSize, [&](int begin, int end)
+	{
+		for (std::uint32_t f = (std::uint32_t)begin; f < (std::uint32_t)end; ++f)
+		{
+			const std::uint32_t h = mFaceStarts[f];
+			const std::uint32_t a = mHalfEdges[h].Origin;
+			const std::uint32_t b = mHalfEdges[h + 1].Origin;
+			const std::uint32_t c = mHalfEdges[h + 2].Origin;
+			const std::uint32_t ab = vertexCount + mHalfEdges[h].Edge;
+			const std::uint32_t bc = vertexCount + mHalfEdges[h + 1].Edge;
+			const std::uint32_t ca = vertexCount + mHalfEdges[h + 2].Edge;
+
+			const std::uint32_t corners[12] = { a, ab, ca, ab, b, bc, ca, bc, c, ab, bc, ca };
+			std::copy(corners, corners + 12, &indices[12*(size_t)f]);
+
+			if (!texC.empty())
+			{
+				const XMFLOAT2& ta = mCornerTexC[h];
+				const XMFLOAT2& tb = mCornerTexC[h + 1];
+				const XMFLOAT2& tc = mCornerTexC[h + 2];
+				const XMFLOAT2 tab = MidTexC(ta, tb);
+				const XMFLOAT2 tbc = MidTexC(tb, tc);
+				const XMFLOAT2 tca = MidTexC(tc, ta);
+				const XMFLOAT2 cornerTexC[12] = { ta, tab, tca, tab, tb, tbc, tca, tbc, tc, tab, tbc, tca };
+				std::copy(cornerTexC, cornerTexC + 12, &texC[12*(size_t)f]);
+			}
+		}
+	});
+
+	std::vector<std::uint32_t> faceStarts(4*(size_t)faceCount + 1);
+	for (size_t i = 0; i < faceStarts.size(); ++i)
+		faceStarts[i] = (std::uint32_t)(3*i);
+
+	return out.Build(positions.data(), (std::uint32_t)positions.size(), indices.data(), faceStarts.data(),
+		4*faceCount, texC.empty() ? nullptr : texC.data());
+}
+
+void HalfEdgeMesh::SubdivideCatmullClark(HalfEdgeMesh& out)const
+{
+	const std::uint32_t vertexCount = VertexCount();
+	const std::uint32_t edgeCount = EdgeCount();
+	const std::uint32_t faceCount = FaceCount();
+	const std::uint32_t halfEdgeCount = HalfEdgeCount();
+	const std::uint32_t firstEdgePoint = vertexCount;
+	const std::uint32_t firstFacePoint = vertexCount + edgeCount;
+
+	// The old vertices, moved, then one new vertex per edge and one per face.
+	std::vector<XMFLOAT3> positions(vertexCount + edgeCount + faceCount);
+	ParallelForRange((int)faceCount, GrainSize, [&](int begin, int end)
+	{
+		for (std::uint32_t f = (std::uint32_t)begin; f < (std::uint32_t)end; ++f)
+		{
+			XMVECTOR sum = XMVectorZero();
+			for (std::uint32_t h = mFaceStarts[f]; h < mFaceStarts[f + 1]; ++h)
+				sum = XMVectorAdd(sum, XMLoadFloat3(&mPositions[mHalfEdges[h].Origin]));
+			XMStoreFloat3(&positions[firstFacePoint + f], XMVectorScale(sum, 1.0f / FaceSize(f)));
+		}
+	});
+
+	ParallelForRange((int)edgeCount, GrainSize, [&](int begin, int end)
+	{
+		for (std::uint32_t e = (std::uint32_t)begin; e < (std::uint32_t)end; ++e)
+		{
+			const std::uint32_t h = mEdgeHalfEdges[e];
+			const std::uint32_t twin = mHalfEdges[h].Twin;
+			const XMVECTOR ends = XMVectorAdd(XMLoadFloat3(&mPositions[mHalfEdges[h].Origin]), XMLoadFloat3(&mPositions[Dest(h)]));
+			if (twin == Invalid)
+			{
+				XMStoreFloat3(&positions[firstEdgePoint + e], XMVectorScale(ends, 0.5f));
+				continue;
+			}
+
+			const XMVECTOR faces = XMVectorAdd(XMLoadFloat3(&positions[firstFacePoint + mHalfEdges[h].Face]),
+				XMLoadFloat3(&positions[firstFacePoint + mHalfEdges[twin].Face]));
+			XMStoreFloat3(&positions[firstEdgePoint + e], XMVectorScale(XMVectorAdd(ends, faces), 0.25f));
+		}
+	});
+
+	ParallelForRange((int)vertexCount, GrainSize, [&](int begin, int end)
+	{
+		for (std::uint32_t v = (std::uint32_t)begin; v < (std::uint32_t)end; ++v)
+		{
+			if (mVertexHalfEdges[v] == Invalid)
+			{
+				positions[v] = mPositions[v];
+				continue;
+			}
+			if (IsBoundaryVertex(v))
+			{
+				XMStoreFloat3(&positions[v], BoundaryVertexPoint(v));
+				continue;
+			}
+
+			// (Q + 2R + (n - 3)P)/n, Q the average of the face points around the vertex
+			// and R that of the midpoints of its edges.
+			const XMVECTOR p = XMLoadFloat3(&mPositions[v]);
+			std::uint32_t n = 0;
+			XMVECTOR faceSum = XMVectorZero();
+			XMVECTOR edgeSum = XMVectorZero();
+			ForEachOutgoing(v, [&](std::uint32_t h)
+			{
+				faceSum = XMVectorAdd(faceSum, XMLoadFloat3(&positions[firstFacePoint + mHalfEdges[h].Face]));
+				edgeSum = XMVectorAdd(edgeSum, XMVectorScale(XMVectorAdd(p, XMLoadFloat3(&mPositions[Dest(h)])), 0.5f));
+				++n;
+			});
+
+			const float invN = 1.0f / n;
+			const XMVECTOR q = XMVectorScale(faceSum, invN);
+			const XMVECTOR r = XMVectorScale(edgeSum, invN);
+			XMStoreFloat3(&positions[v], XMVectorScale(
+				XMVectorAdd(XMVectorAdd(q, XMVectorScale(r, 2.0f)), XMVectorScale(p, (float)n - 3.0f)), invN));
+		}
+	});
+
+	// Each corner becomes a quad: the corner, the point of the edge leaving it, the face
+	// point and the point of the edge coming in, in the face's winding.  Quad h comes from
+	// half-edge h.
+	std::vector<std::uint32_t> indices(4*(size_t)halfEdgeCount);
+	std::vector<XMFLOAT2> texC(HasTexC() ? indices.size() : 0);
+	ParallelForRange((int)faceCount, GrainSize / 4, [&](int begin, int end)
+	{
+		for (std::uint32_t f = (std::uint32_t)begin; f < (std::uint32_t)end; ++f)
+		{
+			XMFLOAT2 faceTexC(0.0f, 0.0f);
+			if (!texC.empty())
+			{
+				for (std::uint32_t h = mFaceStarts[f]; h < mFaceStarts[f + 1]; ++h)
+				{
+					faceTexC.x += mCornerTexC[h].x / FaceSize(f);
+					faceTexC.y += mCornerTexC[h].y / FaceSize(f);
+				}
+			}
+
+			for (std::uint32_t h = mFaceStarts[f]; h < mFaceStarts[f + 1]; ++h)
+			{
+				const std::uint32_t prev = Prev(h);
+				std::uint32_t* quad = &indices[4*(size_t)h];
+				quad[0] = mHalfEdges[h].Origin;
+				quad[1] = firstEdgePoint + mHalfEdges[h].Edge;
+				quad[2] = firstFacePoint + f;
+				quad[3] = firstEdgePoint + mHalfEdges[prev].Edge;
+
+				if (!texC.empty())
+				{
+					XMFLOAT2* quadTexC = &texC[4*(size_t)h];
+					quadTexC[0] = mCornerTexC[h];
+					quadTexC[1] = MidTexC(mCornerTexC[h], mCornerTexC[Next(h)]);
+					quadTexC[2] = faceTexC;
+					quadTexC[3] = MidTexC(mCornerTexC[prev], mCornerTexC[h]);
+				}
+			}
+		}
+	});
+
+	std::vector<std::uint32_t> faceStarts((size_t)halfEdgeCount + 1);
+	for (size_t i = 0; i < faceStarts.size(); ++i)
+		faceStarts[i] = (std::uint32_t)(4*i);
+
+	// The input was valid, so the subdivided mesh is too.
+	out.Build(positions.data(), (std::uint32_t)positions.size(), indices.data(), faceStarts.data(),
+		halfEdgeCount, texC.empty() ? nullptr : texC.data());
+}
+
+GeometryGenerator::MeshData HalfEdgeMesh::ToMeshData()const
+{
+	GeometryGenerator::MeshData meshData;
+	const std::uint32_t vertexCount = VertexCount();
+	const std::uint32_t halfEdgeCount = HalfEdgeCount();
+
+	// Output vertex of each corner.  Corners of a vertex with equal texture coordinates
+	// share one; the output vertices of a vertex are chained through nextOfVertex.
+	std::vector<std::uint32_t> cornerVertex(halfEdgeCount);
+	std::vector<std::uint32_t> sourceVertex;
+	if (HasTexC())
+	{
+		std::vector<std::uint32_t> firstOfVertex(vertexCount, Invalid);
+		std::vector<std::uint32_t> nextOfVertex;
+		std::vector<XMFLOAT2> outTexC;
+		for (std::uint32_t h = 0; h < halfEdgeCount; ++h)
+		{
+			const std::uint32_t v = mHalfEdges[h].Origin;
+			const XMFLOAT2& t = mCornerTexC[h];
+			std::uint32_t match = firstOfVertex[v];
+			while (match != Invalid && (outTexC[match].x != t.x || outTexC[match].y != t.y))
+				match = nextOfVertex[match];
+
+			if (match == Invalid)
+			{
+				match = (std::uint32_t)sourceVertex.size();
+				sourceVertex.push_back(v);
+				outTexC.push_back(t);
+				nextOfVertex.push_back(firstOfVertex[v]);
+				firstOfVertex[v] = match;
+			}
+			cornerVertex[h] = match;
+		}
+
+		meshData.Vertices.resize(sourceVertex.size());
+		for (size_t i = 0; i < sourceVertex.size(); ++i)
+			meshData.Vertices[i].TexC = outTexC[i];
+	}
+	else
+	{
+		sourceVertex.resize(vertexCount);
+		for (std::uint32_t v = 0; v < vertexCount; ++v)
+			sourceVertex[v] = v;
+		for (std::uint32_t h = 0; h < halfEdgeCount; ++h)
+			cornerVertex[h] = mHalfEdges[h].Origin;
+
+		meshData.Vertices.resize(vertexCount);
+		for (GeometryGenerator::Vertex& vertex : meshData.Vertices)
+			vertex.TexC = XMFLOAT2(0.0f, 0.0f);
+	}
+
+	for (size_t i = 0; i < sourceVertex.size(); ++i)
+	{
+		GeometryGenerator::Vertex& vertex = meshData.Vertices[i];
+		vertex.Position = mPositions[sourceVertex[i]];
+		vertex.Normal = mNormals[sourceVertex[i]];
+		vertex.TangentU = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	}
+
+	// Fans from each face's first corner.
+	for (std::uint32_t f = 0; f < FaceCount(); ++f)
+	{
+		const std::uint32_t first = mFaceStarts[f];
+		for (std::uint32_t h = first + 1; h + 1 < mFaceStarts[f + 1]; ++h)
+		{
+			meshData.Indices32.push_back(cornerVertex[first]);
+			meshData.Indices32.push_back(cornerVertex[h]);
+			meshData.Indices32.push_back(cornerVertex[h + 1]);
+		}
+	}
+
+	// Tangents: the direction of increasing u over each triangle, summed per vertex and
+	// made perpendicular to the normal.
+	std::vector<XMFLOAT3> tangents(meshData.Vertices.size(), XMFLOAT3(0.0f, 0.0f, 0.0f));
+	for (size_t t = 0; t < meshData.Indices32.size(); t += 3)
+	{
+		const GeometryGenerator::Vertex& v0 = meshData.Vertices[meshData.Indices32[t]];
+		const GeometryGenerator::Vertex& v1 = meshData.Vertices[meshData.Indices32[t + 1]];
+		const GeometryGenerator::Vertex& v2 = meshData.Vertices[meshData.Indices32[t + 2]];
+		const XMVECTOR e1 = XMVectorSubtract(XMLoadFloat3(&v1.Position), XMLoadFloat3(&v0.Position));
+		const XMVECTOR e2 = XMVectorSubtract(XMLoadFloat3(&v2.Position), XMLoadFloat3(&v0.Position));
+		const float du1 = v1.TexC.x - v0.TexC.x;
+		const float dv1 = v1.TexC.y - v0.TexC.y;
+		const float du2 = v2.TexC.x - v0.TexC.x;
+		const float dv2 = v2.TexC.y - v0.TexC.y;
+		const float det = du1*dv2 - du2*dv1;
+		if (std::fabs(det) < 1e-12f)
+			continue;
+
+		const XMVECTOR tangent = XMVectorScale(XMVectorSubtract(XMVectorScale(e1, dv2), XMVectorScale(e2, dv1)), 1.0f / det);
+		for (int k = 0; k < 3; ++k)
+		{
+			XMFLOAT3& sum = tangents[meshData.Indices32[t + k]];
+			XMStoreFloat3(&sum, XMVectorAdd(XMLoadFloat3(&sum), tangent));
+		}
+	}
+
+	for (size_t i = 0; i < meshData.Vertices.size(); ++i)
+	{
+		GeometryGenerator::Vertex& vertex = meshData.Vertices[i];
+		const XMVECTOR n = XMLoadFloat3(&vertex.Normal);
+		XMVECTOR t = XMLoadFloat3(&tangents[i]);
+		t = XMVectorSubtract(t, XMVectorScale(n, XMVectorGetX(XMVector3Dot(n, t))));
+
+		// No texture gradient here: any direction perpendicular to the normal.
+		if (XMVectorGetX(XMVector3LengthSq(t)) < 1e-12f)
+		{
+			const XMVECTOR axis = std::fabs(vertex.Normal.x) < 0.9f ? XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f) : XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+			t = XMVector3Cross(n, axis);
+		}
+		XMStoreFloat3(&vertex.TangentU, XMVector3Normalize(t));
+	}
+
+	return meshData;
+}
@@ -0,0 +1,198 @@
+//***************************************************************************************
+// HalfEdgeMesh.h
+//
+// Polygon mesh with half-edge connectivity, for the operations GeometryGenerator's
+// triangle soup cannot do: subdivision that shares the new vertices between faces and
+// smooths them (Loop for triangles, Catmull-Clark for any polygons), vertex normals
+// averaged over the faces around a vertex, and adjacency queries.
+//
+// Everything is stored in flat arrays addressed by index.  A face's half-edges are
+// consecutive, so the next and previous half-edge follow from the face's range and only
+// the origin, twin, face and undirected edge of each half-edge are stored.  The build
+// and the subdivision steps run over faces, edges and vertices in parallel.
+//
+// Rotation around a vertex goes from outgoing half-edge h to Next(Twin(h)).  Each
+// vertex keeps the outgoing half-edge a rotation starts from, on a boundary the one
+// after the boundary, so one pass visits every outgoing half-edge.  An edge shared by
+// more than two faces, or by two faces of the same orientation, is left as a boundary
+// on each side and counted in NonManifoldEdgeCount.  A vertex where separate fans meet
+// is only rotated around its first fan.
+//***************************************************************************************
+
+#pragma once
+
+#include "../../Common/GeometryGenerator.h"
+#include <DirectXMath.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class HalfEdgeMesh
+{
+public:
+	static const std::uint32_t Invalid = 0xffffffff;
+
+	struct HalfEdge
+	{
+		std::uint32_t Origin;   // Vertex the half-edge leaves from.
+		std::uint32_t Twin;     // Opposite half-edge of the neighboring face, or Invalid.
+		std::uint32_t Face;
+		std::uint32_t Edge;     // Undirected edge, shared with the twin.
+	};
+
+	// Builds from indexed polygons: face f has the vertices
+	// indices[faceStarts[f], faceStarts[f + 1]), faceStarts[0] is 0 and every face has
+	// at least three distinct consecutive vertices.  cornerTexC may be null or hold a
+	// texture coordinate per index.  Computes the vertex normals.  Returns false if the
+	// input is malformed, see Error.
+	bool Build(const DirectX::XMFLOAT3* positions, std::uint32_t vertexCount, const std::uint32_t* indices,
+		const std::uint32_t* faceStarts, std::uint32_t faceCount, const DirectX::XMFLOAT2* cornerTexC = nullptr);
+
+	// Builds from a triangle list.  Vertices closer than weldDistance become one, so the
+	// copies GeometryGenerator makes along texture seams and box edges are joined; their
+	// texture coordinates are kept per corner.  Triangles that collapse are dropped.
+	bool Build(const GeometryGenerator::MeshData& meshData, float weldDistance = 1e-5f);
+
+	// One step of Loop subdivision into out: every triangle becomes four and every
+	// vertex moves toward its neighbors.  Boundaries use the curve rules, so they stay on
+	// the boundary.  Returns false, with out.Error set, if a face is not a triangle.
+	bool SubdivideLoop(HalfEdgeMesh& out)const;
+
+	// One step of Catmull-Clark subdivision into out: every face of n sides becomes n
+	// quads.  Boundaries use the curve rules.
+	void SubdivideCatmullClark(HalfEdgeMesh& out)const;
+
+	// Angle-weighted average of the normals of the faces around each vertex.  Called by
+	// Build; again after moving positions.
+	void ComputeNormals();
+
+	// Triangle list with one vertex per distinct (vertex, texture coordinate) pair.
+	// Polygons are split into fans.  Tangents follow the texture's u axis.
+	GeometryGenerator::MeshData ToMeshData()const;
+
+	std::uint32_t VertexCount()const { return (std::uint32_t)mPositions.size(); }
+	std::uint32_t FaceCount()const { return (std::uint32_t)mFaceStarts.size() - (mFaceStarts.empty() ? 0 : 1); }
+	std::uint32_t HalfEdgeCount()const { return (std::uint32_t)mHalfEdges.size(); }
+	std::uint32_t EdgeCount()const { return (std::uint32_t)mEdgeHalfEdges.size(); }
+	std::uint32_t BoundaryEdgeCount()const { return mBoundaryEdgeCount; }
+	std::uint32_t NonManifoldEdgeCount()const { return mNonManifoldEdgeCount; }
+	bool HasTexC()const { return !mCornerTexC.empty(); }
+
+	const std::vector<DirectX::XMFLOAT3>& Positions()const { return mPositions; }
+	std::vector<DirectX::XMFLOAT3>& Positions() { return mPositions; }
+	const std::vector<DirectX::XMFLOAT3>& Normals()const { return mNormals; }
+	const std::vector<HalfEdge>& HalfEdges()const { return mHalfEdges; }
+
+	// Texture coordinate of the corner where half-edge h leaves its origin.
+	const DirectX::XMFLOAT2& CornerTexC(std::uint32_t h)const { return mCornerTexC[h]; }
+
+	//
+	// Connectivity.
+	//
+
+	std::uint32_t FaceHalfEdge(std::uint32_t f)const { return mFaceStarts[f]; }
+	std::uint32_t FaceSize(std::uint32_t f)const { return mFaceStarts[f + 1] - mFaceStarts[f]; }
+	std::uint32_t VertexHalfEdge(std::uint32_t v)const { return mVertexHalfEdges[v]; }
+	std::uint32_t EdgeHalfEdge(std::uint32_t e)const { return mEdgeHalfEdges[e]; }
+
+	std::uint32_t Next(std::uint32_t h)const
+	{
+		const std::uint32_t f = mHalfEdges[h].Face;
+		return h + 1 < mFaceStarts[f + 1] ? h + 1 : mFaceStarts[f];
+	}
+
+	std::uint32_t Prev(std::uint32_t h)const
+	{
+		const std::uint32_t f = mHalfEdges[h].Face;
+		return h > mFaceStarts[f] ? h - 1 : mFaceStarts[f + 1] - 1;
+	}
+
+	std::uint32_t Dest(std::uint32_t h)const { return mHalfEdges[Next(h)].Origin; }
+
+	bool IsBoundaryEdge(std::uint32_t e)const { return mHalfEdges[mEdgeHalfEdges[e]].Twin == Invalid; }
+
+	// False for a vertex no face uses.
+	bool IsBoundaryVertex(std::uint32_t v)const
+	{
+		const std::uint32_t h = mVertexHalfEdges[v];
+		return h != Invalid && mHalfEdges[Prev(h)].Twin == Invalid;
+	}
+
+	// Number of edges at v.
+	std::uint32_t Valence(std::uint32_t v)const;
+
+	// Calls func(h) for every half-edge leaving v, in rotation order.
+	template<typename Func>
+	void ForEachOutgoing(std::uint32_t v, const Func& func)const
+	{
+		const std::uint32_t start = mVertexHalfEdges[v];
+		if (start == Invalid)
+			return;
+
+		std::uint32_t h = start;
+		do
+		{
+			func(h);
+			const std::uint32_t twin = mHalfEdges[h].Twin;
+			if (twin == Invalid)
+				break;
+			h = Next(twin);
+		} while (h != start);
+	}
+
+	// Calls func(u) for every vertex u sharing an edge with v.
+	template<typename Func>
+	void ForEachVertexNeighbor(std::uint32_t v, const Func& func)const
+	{
+		ForEachOutgoing(v, [&](std::uint32_t h) { func(Dest(h)); });
+		if (IsBoundaryVertex(v))
+			func(mHalfEdges[Prev(mVertexHalfEdges[v])].Origin);
+	}
+
+	// Calls func(f) for every face using v.
+	template<typename Func>
+	void ForEachVertexFace(std::uint32_t v, const Func& func)const
+	{
+		ForEachOutgoing(v, [&](std::uint32_t h) { func(mHalfEdges[h].Face); });
+	}
+
+	// Calls func(g) for every face sharing an edge with f.
+	template<typename Func>
+	void ForEachFaceNeighbor(std::uint32_t f, const Func& func)const
+	{
+		for (std::uint32_t h = mFaceStarts[f]; h < mFaceStarts[f + 1]; ++h)
+		{
+			if (mHalfEdges[h].Twin != Invalid)
+				func(mHalfEdges[mHalfEdges[h].Twin].Face);
+		}
+	}
+
+	const std::string& Error()const { return mError; }
+
+private:
+	void Clear();
+
+	// Boundary vertex rule shared by both schemes: 3/4 of the vertex, 1/8 of each of its
+	// two boundary neighbors.
+	DirectX::XMVECTOR XM_CALLCONV BoundaryVertexPoint(std::uint32_t v)const;
+
+private:
+	std::vector<DirectX::XMFLOAT3> mPositions;
+	std::vector<DirectX::XMFLOAT3> mNormals;
+	std::vector<std::uint32_t> mVertexHalfEdges;
+
+	// FaceCount() + 1 entries; face f owns half-edges [mFaceStarts[f], mFaceStarts[f + 1]).
+	std::vector<std::uint32_t> mFaceStarts;
+
+	std::vector<HalfEdge> mHalfEdges;
+	std::vector<DirectX::XMFLOAT2> mCornerTexC;
+
+	// The half-edge each undirected edge was numbered from: the one without a twin, or
+	// the lower of the two.
+	std::vector<std::uint32_t> mEdgeHalfEdges;
+
+	std::uint32_t mBoundaryEdgeCount = 0;
+	std::uint32_t mNonManifoldEdgeCount = 0;
+
+	std::string mError;
+};
@@ -0,0 +1,374 @@
+#include "Heightmap.h"
+#include "MappedFile.h"
+#include "ParallelFor.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <fstream>
+
+using namespace DirectX;
+
+namespace
+{
+	template<typename T>
+	T ReadLE(const std::uint8_t* p)
+	{
+		T value;
+		std::memcpy(&value, p, sizeof(T));
+		return value;
+	}
+}
+
+Heightmap::Heightmap(int m, int n, float width, float depth)
+{
+	Resize(m, n, width, depth);
+}
+
+void Heightmap::Resize(int m, int n, float width, float depth)
+{
+	assert(m >= 2 && n >= 2);
+
+	mNumRows = m;
+	mNumCols = n;
+	mWidth = width;
+	mDepth = depth;
+	mDx = width / (n - 1);
+	mDz = depth / (m - 1);
+	mInvDx = 1.0f / mDx;
+	mInvDz = 1.0f / mDz;
+
+	mHeights.assign((size_t)m*n, 0.0f);
+	mNormals.assign((size_t)m*n, XMFLOAT3(0.0f, 1.0f, 0.0f));
+}
+
+XMVECTOR XM_CALLCONV Heightmap::HillsHeight4(FXMVECTOR x, FXMVECTOR z)
+{
+	const XMVECTOR tenth = XMVectorReplicate(0.1f);
+	XMVECTOR a = XMVectorMultiply(z, XMVectorSin(XMVectorMultiply(tenth, x)));
+	XMVECTOR b = XMVectorMultiply(x, XMVectorCos(XMVectorMultiply(tenth, z)));
+	return XMVectorMultiply(XMVectorReplicate(0.3f), XMVectorAdd(a, b));
+}
+
+void Heightmap::Bake(BatchHeightFunc func)
+{
+	assert(!mHeights.empty());
+
+	const float halfWidth = 0.5f*mWidth;
+	const float halfDepth = 0.5f*mDepth;
+	const XMVECTOR laneOffsets = XMVectorSet(0.0f, 1.0f, 2.0f, 3.0f);
+	const XMVECTOR dx = XMVectorReplicate(mDx);
+
+	ParallelFor(0, mNumRows, [&](int i)
+	{
+		const XMVECTOR z = XMVectorReplicate(halfDepth - i*mDz);
+		float* row = &mHeights[(size_t)i*mNumCols];
+
+		for (int j = 0; j < mNumCols; j += 4)
+		{
+			XMVECTOR x = XMVectorMultiplyAdd(
+				XMVectorAdd(XMVectorReplicate((float)j), laneOffsets), dx,
+				XMVectorReplicate(-halfWidth));
+
+			XMFLOAT4 h;
+			XMStoreFloat4(&h, func(x, z));
+
+			// The last group of a row may be partial.
+			const float lanes[4] = { h.x, h.y, h.z, h.w };
+			const int count = std::min(4, mNumCols - j);
+			for (int k = 0; k < count; ++k)
+				row[j + k] = lanes[k];
+		}
+	});
+
+	ComputeNormals();
+}
+
+void Heightmap::SetHeights(std::vector<float> heights)
+{
+	assert(heights.size() == (size_t)mNumRows*mNumCols);
+
+	mHeights = std::move(heights);
+	ComputeNormals();
+}
+
+void Heightmap::ComputeNormals()
+{
+	ParallelFor(0, mNumRows, [&](int i)
+	{
+		// Row i-1 lies at larger z than row i.
+		const int iUp = std::max(i - 1, 0);
+		const int iDown = std::min(i + 1, mNumRows - 1);
+		const float invSpanZ = 1.0f / ((iDown - iUp)*mDz);
+
+		for (int j = 0; j < mNumCols; ++j)
+		{
+			const int jLeft = std::max(j - 1, 0);
+			const int jRight = std::min(j + 1, mNumCols - 1);
+
+			float dhdx = (SampleHeight(i, jRight) - SampleHeight(i, jLeft)) / ((jRight - jLeft)*mDx);
+			float dhdz = (SampleHeight(iUp, j) - SampleHeight(iDown, j)) * invSpanZ;
+
+			// n = (-dh/dx, 1, -dh/dz)
+			XMVECTOR n = XMVector3Normalize(XMVectorSet(-dhdx, 1.0f, -dhdz, 0.0f));
+			XMStoreFloat3(&mNormals[(size_t)i*mNumCols + j], n);
+		}
+	});
+}
+
+void Heightmap::Locate(float x, float z, int& i, int& j, float& s, float& t)const
+{
+	float fx = (x + 0.5f*mWidth) * mInvDx;
+	float fz = (0.5f*mDepth - z) * mInvDz;
+
+	fx = std::min(std::max(fx, 0.0f), (float)(mNumCols - 1));
+	fz = std::min(std::max(fz, 0.0f), (float)(mNumRows - 1));
+
+	j = std::min((int)fx, mNumCols - 2);
+	i = std::min((int)fz, mNumRows - 2);
+
+	s = fx - j;
+	t = fz - i;
+}
+
+float Heightmap::Height(float x, float z)const
+{
+	int i, j;
+	float s, t;
+	Locate(x, z, i, j, s, t);
+
+	const float* r0 = &mHeights[(size_t)i*mNumCols + j];
+	const float* r1 = r0 + mNumCols;
+
+	float top = r0[0] + (r0[1] - r0[0])*s;
+	float bottom = r1[0] + (r1[1] - r1[0])*s;
+	return top + (bottom - top)*t;
+}
+
+XMFLOAT3 Heightmap::Normal(float x, float z)const
+{
+	int i, j;
+	float s, t;
+	Locate(x, z, i, j, s, t);
+
+	const XMFLOAT3* r0 = &mNormals[(size_t)i*mNumCols + j];
+	const XMFLOAT3* r1 = r0 + mNumCols;
+
+	XMVECTOR top = XMVectorLerp(XMLoadFloat3(&r0[0]), XMLoadFloat3(&r0[1]), s);
+	XMVECTOR bottom = XMVectorLerp(XMLoadFloat3(&r1[0]), XMLoadFloat3(&r1[1]), s);
+
+	XMFLOAT3 n;
+	XMStoreFloat3(&n, XMVector3Normalize(XMVectorLerp(top, bottom, t)));
+	return n;
+}
+
+void Heightmap::Sample(const XMFLOAT2* xz, std::size_t count, float* outHeights, XMFLOAT3* outNormals)const
+{
+	auto sampleRange = [&](int begin, int end)
+	{
+		for (int k = begin; k < end; ++k)
+		{
+			if (outHeights != nullptr)
+				outHeights[k] = Height(xz[k].x, xz[k].y);
+			if (outNormals != nullptr)
+				outNormals[k] = Normal(xz[k].x, xz[k].y);
+		}
+	};
+
+	// Small batches are cheaper to do inline than to wake the workers.
+	const int grainSize = 2048;
+	if (count <= (std::size_t)grainSize)
+		sampleRange(0, (int)count);
+	else
+		ParallelForRange((int)count, grainSize, sampleRange);
+}
+
+void Heightmap::SnapToGround(XMFLOAT3* positions, std::size_t count, float yOffset)const
+{
+	auto snapRange = [&](int begin, int end)
+	{
+		for (int k = begin; k < end; ++k)
+			positions[k].y = Height(positions[k].x, positions[k].z) + yOffset;
+	};
+
+	const int grainSize = 2048;
+	if (count <= (std::size_t)grainSize)
+		snapRange(0, (int)count);
+	else
+		ParallelForRange((int)count, grainSize, snapRange);
+}
+
+void Heightmap::FromSamples(const std::vector<float>& samples, int m, int n, float heightScale, float heightOffset)
+{
+	// Keep the current world extent; otherwise use one unit per sample.
+	float width = mWidth > 0.0f ? mWidth : (float)(n - 1);
+	float depth = mDepth > 0.0f ? mDepth : (float)(m - 1);
+	Resize(m, n, width, depth);
+
+	for (size_t k = 0; k < samples.size(); ++k)
+		mHeights[k] = heightOffset + heightScale*samples[k];
+
+	ComputeNormals();
+}
+
+bool Heightmap::LoadRaw16(const std::wstring& filename, int m, int n, float heightScale, float heightOffset)
+{
+	MappedFile file;
+	if (!file.Open(filename) || m < 2 || n < 2)
+		return false;
+
+	const size_t sampleCount = (size_t)m*n;
+	if (file.Size() < sampleCount*sizeof(std::uint16_t))
+		return false;
+
+	std::vector<float> samples(sampleCount);
+	const std::uint8_t* src = file.Data();
+	ParallelForRange((int)sampleCount, 16384, [&](int begin, int end)
+	{
+		for (int k = begin; k < end; ++k)
+			samples[k] = ReadLE<std::uint16_t>(src + 2*(size_t)k) / 65535.0f;
+	});
+
+	FromSamples(samples, m, n, heightScale, heightOffset);
+	return true;
+}
+
+bool Heightmap::LoadBmp(const std::wstring& filename, float heightScale, float heightOffset)
+{
+	MappedFile file;
+	if (!file.Open(filename) || file.Size() < 54)
+		return false;
+
+	const std::uint8_t* data = file.Data();
+	if (data[0] != 'B' || data[1] != 'M')
+		return false;
+
+	// BITMAPFILEHEADER followed by BITMAPINFOHEADER or one of its longer versions.
+	const std::uint32_t pixelOffset = ReadLE<std::uint32_t>(data + 10);
+	const std::uint32_t infoSize = ReadLE<std::uint32_t>(data + 14);
+	if (infoSize < 40 || infoSize > file.Size() - 14)
+		return false;
+
+	const std::int32_t width = ReadLE<std::int32_t>(data + 18);
+	const std::int32_t height = ReadLE<std::int32_t>(data + 22);
+	const std::uint16_t bitCount = ReadLE<std::uint16_t>(data + 28);
+	const std::uint32_t compression = ReadLE<std::uint32_t>(data + 30);
+	const std::uint32_t paletteSize = ReadLE<std::uint32_t>(data + 46);
+
+	// Only uncompressed (BI_RGB) or bitfield (BI_BITFIELDS) layouts.
+	if (compression != 0 && compression != 3)
+		return false;
+	if (bitCount != 8 && bitCount != 16 && bitCount != 24 && bitCount != 32)
+		return false;
+
+	// 16 and 32 bit pixels hold their channels under masks.  BI_RGB uses 5-5-5 and 8-8-8;
+	// BI_BITFIELDS reads the masks from the longer headers or the three words after the
+	// 40 byte one.
+	std::uint32_t masks[3] = { 0x7C00, 0x03E0, 0x001F };
+	if (bitCount == 32)
+	{
+		masks[0] = 0x00FF0000;
+		masks[1] = 0x0000FF00;
+		masks[2] = 0x000000FF;
+	}
+	if (compression == 3)
+	{
+		if (bitCount != 16 && bitCount != 32)
+			return false;
+		const size_t maskOffset = 14 + 40;
+		if (maskOffset + 12 > file.Size())
+			return false;
+		for (int c = 0; c < 3; ++c)
+			masks[c] = ReadLE<std::uint32_t>(data + maskOffset + 4*c);
+	}
+
+	// Shift and scale that turn a masked channel into [0, 1].
+	int maskShift[3];
+	float maskScale[3];
+	for (int c = 0; c < 3; ++c)
+	{
+		if (masks[c] == 0)
+			return false;
+		maskShift[c] = 0;
+		while (((masks[c] >> maskShift[c]) & 1) == 0)
+			++maskShift[c];
+		maskScale[c] = 1.0f / (float)(masks[c] >> maskShift[c]);
+	}
+
+	const int n = width;
+	const int m = height < 0 ? -height : height;
+	const bool bottomUp = height > 0;
+	if (m < 2 || n < 2)
+		return false;
+
+	const size_t stride = (((size_t)n*bitCount + 31) / 32) * 4;
+	if (pixelOffset > file.Size() || stride*m > file.Size() - pixelOffset)
+		return false;
+
+	// 8-bit images index a palette; map each entry to its luminance.
+	float palette[256] = {};
+	if (bitCount == 8)
+	{
+		const size_t entryCount = std::min<size_t>(paletteSize == 0 ? 256 : paletteSize, 256);
+		if (14 + (size_t)infoSize + entryCount*4 > file.Size())
+			return false;
+		const std::uint8_t* entries = data + 14 + infoSize;
+
+		for (size_t k = 0; k < entryCount; ++k)
+			palette[k] = (0.114f*entries[4*k] + 0.587f*entries[4*k + 1] + 0.299f*entries[4*k + 2]) / 255.0f;
+	}
+
+	std::vector<float> samples((size_t)m*n);
+	ParallelFor(0, m, [&](int i)
+	{
+		// Grid row 0 is the top (far +z) edge of the image.
+		const int fileRow = bottomUp ? m - 1 - i : i;
+		const std::uint8_t* src = data + pixelOffset + fileRow*stride;
+		float* dst = &samples[(size_t)i*n];
+
+		for (int j = 0; j < n; ++j)
+		{
+			switch (bitCount)
+			{
+			case 8:
+				dst[j] = palette[src[j]];
+				break;
+			case 24:
+			{
+				const std::uint8_t* p = src + 3*j;
+				dst[j] = (0.114f*p[0] + 0.587f*p[1] + 0.299f*p[2]) / 255.0f;
+				break;
+			}
+			default:
+			{
+				const std::uint32_t pixel = bitCount == 16 ? ReadLE<std::uint16_t>(src + 2*j) : ReadLE<std::uint32_t>(src + 4*j);
+				float rgb[3];
+				for (int c = 0; c < 3; ++c)
+					rgb[c] = ((pixel & masks[c]) >> maskShift[c])*maskScale[c];
+				dst[j] = 0.299f*rgb[0] + 0.587f*rgb[1] + 0.114f*rgb[2];
+				break;
+			}
+			}
+		}
+	});
+
+	FromSamples(samples, m, n, heightScale, heightOffset);
+	return true;
+}
+
+bool Heightmap::SaveRaw16(const std::wstring& filename, float heightScale, float heightOffset)const
+{
+	std::ofstream fout(std::string(filename.begin(), filename.end()), std::ios::binary);
+	if (!fout || heightScale == 0.0f)
+		return false;
+
+	std::vector<std::uint16_t> samples(mHeights.size());
+	for (size_t k = 0; k < mHeights.size(); ++k)
+	{
+		float s = (mHeights[k] - heightOffset) / heightScale;
+		s = std::min(std::max(s, 0.0f), 1.0f);
+		samples[k] = (std::uint16_t)(s*65535.0f + 0.5f);
+	}
+
+	fout.write(reinterpret_cast<const char*>(samples.data()), samples.size()*sizeof(std::uint16_t));
+	return (bool)fout;
+}
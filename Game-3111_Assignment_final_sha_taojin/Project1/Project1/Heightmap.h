@@ -0,0 +1,102 @@
+//***************************************************************************************
+// Heightmap.h
+//
+// Baked heightfield over a regular xz-grid laid out exactly like
+// GeometryGenerator::CreateGrid (row i runs along -z, column j along +x, centered at
+// the origin).  Heights and normals are evaluated once when the field is baked or
+// imported, so Height(x,z) and Normal(x,z) are constant-time bilinear lookups instead
+// of re-evaluating the analytic hills function.
+//***************************************************************************************
+
+#pragma once
+
+#include <DirectXMath.h>
+#include <string>
+#include <vector>
+
+class Heightmap
+{
+public:
+	// Evaluates the height for four (x, z) sample pairs at once.
+	typedef DirectX::XMVECTOR(XM_CALLCONV* BatchHeightFunc)(DirectX::FXMVECTOR x, DirectX::FXMVECTOR z);
+
+	Heightmap() = default;
+	Heightmap(int m, int n, float width, float depth);
+	Heightmap(const Heightmap& rhs) = default;
+	Heightmap& operator=(const Heightmap& rhs) = default;
+	~Heightmap() = default;
+
+	// Resizes the grid to m rows by n columns covering width x depth.  Heights are reset to 0.
+	void Resize(int m, int n, float width, float depth);
+
+	// Fills the grid by evaluating func four samples at a time, rows in parallel,
+	// and then rebuilds the normals.
+	void Bake(BatchHeightFunc func);
+
+	// The hills function used by the land demos: 0.3*(z*sin(0.1x) + x*cos(0.1z)).
+	static DirectX::XMVECTOR XM_CALLCONV HillsHeight4(DirectX::FXMVECTOR x, DirectX::FXMVECTOR z);
+
+	// Imports a headerless little-endian 16-bit RAW heightmap of m rows by n columns.
+	// Each sample maps to heightOffset + heightScale*(value/65535).  The world extent
+	// set by the constructor/Resize is kept; an empty map uses one unit per sample.
+	bool LoadRaw16(const std::wstring& filename, int m, int n, float heightScale, float heightOffset);
+
+	// Imports an uncompressed 8, 16, 24 or 32 bit BMP, 16 and 32 bit ones with or without
+	// BI_BITFIELDS masks.  The grid takes the image dimensions; colour images use their
+	// luminance.
+	bool LoadBmp(const std::wstring& filename, float heightScale, float heightOffset);
+
+	// Writes the heights as little-endian 16-bit RAW, mapping [heightOffset, heightOffset+heightScale]
+	// to [0, 65535] (the inverse of LoadRaw16).
+	bool SaveRaw16(const std::wstring& filename, float heightScale, float heightOffset)const;
+
+	// Replaces the heights (row-major, RowCount() x ColumnCount()) and rebuilds the normals.
+	void SetHeights(std::vector<float> heights);
+
+	// Recomputes per-sample normals from the baked heights with central differences.
+	void ComputeNormals();
+
+	int RowCount()const { return mNumRows; }
+	int ColumnCount()const { return mNumCols; }
+	float Width()const { return mWidth; }
+	float Depth()const { return mDepth; }
+	bool IsEmpty()const { return mHeights.empty(); }
+
+	// Grid sample access, i indexes rows (z) and j indexes columns (x).
+	float SampleHeight(int i, int j)const { return mHeights[i*mNumCols + j]; }
+	const DirectX::XMFLOAT3& SampleNormal(int i, int j)const { return mNormals[i*mNumCols + j]; }
+	const std::vector<float>& Heights()const { return mHeights; }
+
+	// Bilinearly filtered height at world (x, z); clamps to the grid border.
+	float Height(float x, float z)const;
+
+	// Bilinearly filtered unit normal at world (x, z); clamps to the grid border.
+	DirectX::XMFLOAT3 Normal(float x, float z)const;
+
+	// Batch queries for scattering and agents.  xz[k] holds the world (x, z) of sample k.
+	// Either output pointer may be null.  Large batches are split across worker threads.
+	void Sample(const DirectX::XMFLOAT2* xz, std::size_t count, float* outHeights, DirectX::XMFLOAT3* outNormals)const;
+
+	// Snaps the y of each position to the terrain height plus yOffset.
+	void SnapToGround(DirectX::XMFLOAT3* positions, std::size_t count, float yOffset)const;
+
+private:
+	// Maps world (x, z) to the cell (i, j) and the fractional offsets inside it.
+	void Locate(float x, float z, int& i, int& j, float& s, float& t)const;
+
+	void FromSamples(const std::vector<float>& samples, int m, int n, float heightScale, float heightOffset);
+
+private:
+	int mNumRows = 0;
+	int mNumCols = 0;
+
+	float mWidth = 0.0f;
+	float mDepth = 0.0f;
+	float mDx = 0.0f;
+	float mDz = 0.0f;
+	float mInvDx = 0.0f;
+	float mInvDz = 0.0f;
+
+	std::vector<float> mHeights;
+	std::vector<DirectX::XMFLOAT3> mNormals;
+};
@@ -0,0 +1,274 @@
+#include "Humanoid.h"
+#include "../../Common/GeometryGenerator.h"
+#include "../../Common/MathHelper.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX;
+
+namespace
+{
+	// The joints, in the order BuildSkeleton adds them.
+	enum Joint : int
+	{
+		Hips = 0,
+		Spine,
+		Chest,
+		Neck,
+		Head,
+		LeftUpperArm,
+		LeftForearm,
+		RightUpperArm,
+		RightForearm,
+		LeftThigh,
+		LeftShin,
+		RightThigh,
+		RightShin,
+		JointCount
+	};
+
+	// Heights of the joints as fractions of the character's height.
+	const float HipsHeight = 0.52f;
+	const float ShoulderHeight = 0.84f;
+	const float ShoulderWidth = 0.15f;
+	const float LegSpacing = 0.06f;
+
+	const int WalkFrames = 33;
+	const int IdleFrames = 61;
+	const float SampleRate = 30.0f;
+
+	// Swing of the thighs in the walk, in radians.
+	const float StrideAngle = 0.4f;
+
+	void BuildSkeleton(float h, Skeleton& skeleton)
+	{
+		skeleton.AddJoint("hips", -1, XMFLOAT3(0.0f, HipsHeight*h, 0.0f));
+		skeleton.AddJoint("spine", Hips, XMFLOAT3(0.0f, 0.08f*h, 0.0f));
+		skeleton.AddJoint("chest", Spine, XMFLOAT3(0.0f, 0.12f*h, 0.0f));
+		skeleton.AddJoint("neck", Chest, XMFLOAT3(0.0f, 0.14f*h, 0.0f));
+		skeleton.AddJoint("head", Neck, XMFLOAT3(0.0f, 0.05f*h, 0.0f));
+		skeleton.AddJoint("leftUpperArm", Chest, XMFLOAT3(-ShoulderWidth*h, ShoulderHeight*h - 0.72f*h, 0.0f));
+		skeleton.AddJoint("leftForearm", LeftUpperArm, XMFLOAT3(0.0f, -0.17f*h, 0.0f));
+		skeleton.AddJoint("rightUpperArm", Chest, XMFLOAT3(ShoulderWidth*h, ShoulderHeight*h - 0.72f*h, 0.0f));
+		skeleton.AddJoint("rightForearm", RightUpperArm, XMFLOAT3(0.0f, -0.17f*h, 0.0f));
+		skeleton.AddJoint("leftThigh", Hips, XMFLOAT3(-LegSpacing*h, -0.02f*h, 0.0f));
+		skeleton.AddJoint("leftShin", LeftThigh, XMFLOAT3(0.0f, -0.24f*h, 0.0f));
+		skeleton.AddJoint("rightThigh", Hips, XMFLOAT3(LegSpacing*h, -0.02f*h, 0.0f));
+		skeleton.AddJoint("rightShin", RightThigh, XMFLOAT3(0.0f, -0.24f*h, 0.0f));
+		skeleton.ComputeInverseBind();
+	}
+
+	// Model-space bind height of a joint; the bind pose has no rotations.
+	float BindHeight(const Skeleton& skeleton, int joint)
+	{
+		float y = 0.0f;
+		for (; joint >= 0; joint = skeleton.Parents[joint])
+			y += skeleton.BindTranslations[joint].y;
+		return y;
+	}
+
+	// Appends a GeometryGenerator part, moved by offset, to the asset.  chain lists the
+	// joints along the part from parent to child; each vertex follows the joint whose
+	// section it lies in, blended with the neighbouring one within band of the joint
+	// between them.
+	void AppendPart(HumanoidAsset& asset, HumanoidPart part, const GeometryGenerator::MeshData& mesh,
+		const XMFLOAT3& offset, const std::vector<int>& chain, float band)
+	{
+		const std::uint32_t firstVertex = (std::uint32_t)asset.Vertices.size();
+
+		// Distance of each joint along the chain from the first.
+		const float y0 = BindHeight(asset.Bones, chain[0]);
+		const float direction = chain.size() > 1 && BindHeight(asset.Bones, chain[1]) < y0 ? -1.0f : 1.0f;
+		std::vector<float> along(chain.size());
+		for (std::size_t k = 0; k < chain.size(); ++k)
+			along[k] = (BindHeight(asset.Bones, chain[k]) - y0)*direction;
+
+		for (const GeometryGenerator::Vertex& src : mesh.Vertices)
+		{
+			SkinnedBindVertex v;
+			v.Pos = XMFLOAT3(src.Position.x + offset.x, src.Position.y + offset.y, src.Position.z + offset.z);
+			v.Normal = src.Normal;
+			v.TexC = src.TexC;
+			v.Joints[0] = chain[0];
+
+			if (chain.size() > 1)
+			{
+				const float s = (v.Pos.y - y0)*direction;
+
+				// The joint boundary nearest the vertex.
+				std::size_t nearest = 1;
+				for (std::size_t k = 2; k < chain.size(); ++k)
+				{
+					if (std::fabs(s - along[k]) < std::fabs(s - along[nearest]))
+						nearest = k;
+				}
+
+				const float t = MathHelper::Clamp((s - along[nearest] + band) / (2.0f*band), 0.0f, 1.0f);
+				v.Joints[0] = chain[nearest - 1];
+				v.Joints[1] = chain[nearest];
+				v.Weights[0] = 1.0f - t;
+				v.Weights[1] = t;
+			}
+
+			asset.Vertices.push_back(v);
+		}
+
+		asset.PartFirstIndex[part] = (int)asset.Indices.size();
+		asset.PartIndexCount[part] = (int)mesh.Indices32.size();
+		for (std::uint32_t index : mesh.Indices32)
+			asset.Indices.push_back(firstVertex + index);
+	}
+
+	void BuildMesh(float h, HumanoidAsset& asset)
+	{
+		GeometryGenerator geoGen;
+
+		GeometryGenerator::MeshData head = geoGen.CreateSphere(0.075f*h, 16, 12);
+		AppendPart(asset, HumanoidHead, head, XMFLOAT3(0.0f, 0.93f*h, 0.0f), { Neck, Head }, 0.02f*h);
+
+		GeometryGenerator::MeshData body = geoGen.CreateCylinder(0.10f*h, 0.12f*h, 0.38f*h, 16, 8);
+		AppendPart(asset, HumanoidBody, body, XMFLOAT3(0.0f, 0.67f*h, 0.0f), { Hips, Spine, Chest }, 0.03f*h);
+
+		// Both sleeves and both legs go into one range each, so a part is a single draw.
+		GeometryGenerator::MeshData arm = geoGen.CreateCylinder(0.03f*h, 0.04f*h, 0.36f*h, 10, 8);
+		GeometryGenerator::MeshData leg = geoGen.CreateCylinder(0.045f*h, 0.055f*h, 0.50f*h, 12, 10);
+
+		HumanoidAsset sides;
+		sides.Bones = asset.Bones;
+		for (int side = 0; side < 2; ++side)
+		{
+			const float sign = side == 0 ? -1.0f : 1.0f;
+			const int upperArm = side == 0 ? LeftUpperArm : RightUpperArm;
+			const int thigh = side == 0 ? LeftThigh : RightThigh;
+
+			AppendPart(sides, HumanoidArms, arm, XMFLOAT3(sign*ShoulderWidth*h, (ShoulderHeight + 0.02f - 0.18f)*h, 0.0f),
+				{ upperArm, upperArm + 1 }, 0.03f*h);
+			AppendPart(sides, HumanoidLegs, leg, XMFLOAT3(sign*LegSpacing*h, 0.25f*h, 0.0f),
+				{ thigh, thigh + 1 }, 0.04f*h);
+		}
+
+		// sides holds left arm, left leg, right arm, right leg; regroup them by part.
+		const std::uint32_t firstVertex = (std::uint32_t)asset.Vertices.size();
+		asset.Vertices.insert(asset.Vertices.end(), sides.Vertices.begin(), sides.Vertices.end());
+
+		const int armIndices = (int)arm.Indices32.size();
+		const int legIndices = (int)leg.Indices32.size();
+		const int sideIndices = armIndices + legIndices;
+
+		asset.PartFirstIndex[HumanoidArms] = (int)asset.Indices.size();
+		asset.PartIndexCount[HumanoidArms] = 2*armIndices;
+		for (int side = 0; side < 2; ++side)
+		{
+			for (int i = 0; i < armIndices; ++i)
+				asset.Indices.push_back(firstVertex + sides.Indices[side*sideIndices + i]);
+		}
+
+		asset.PartFirstIndex[HumanoidLegs] = (int)asset.Indices.size();
+		asset.PartIndexCount[HumanoidLegs] = 2*legIndices;
+		for (int side = 0; side < 2; ++side)
+		{
+			for (int i = 0; i < legIndices; ++i)
+				asset.Indices.push_back(firstVertex + sides.Indices[side*sideIndices + armIndices + i]);
+		}
+	}
+
+	XMFLOAT4 Rotation(float pitch, float yaw, float roll)
+	{
+		XMFLOAT4 q;
+		XMStoreFloat4(&q, XMQuaternionRotationRollPitchYaw(pitch, yaw, roll));
+		return q;
+	}
+
+	// Keys every joint of frame with its rotation and its bind translation, the hips raised
+	// by hipsLift.
+	void SetFrame(const Skeleton& skeleton, AnimationClip& clip, int frame, const XMFLOAT4 (&rotations)[JointCount],
+		float hipsLift)
+	{
+		for (int j = 0; j < JointCount; ++j)
+		{
+			XMFLOAT3 translation = skeleton.BindTranslations[j];
+			if (j == Hips)
+				translation.y += hipsLift;
+			clip.SetKey(frame, j, rotations[j], translation);
+		}
+	}
+
+	bool BuildWalkClip(float h, const Skeleton& skeleton, AnimationClip& clip)
+	{
+		if (!clip.Create("walk", JointCount, WalkFrames, SampleRate))
+			return false;
+
+		// Positive pitch swings a hanging limb backwards (-z).
+		for (int frame = 0; frame < WalkFrames; ++frame)
+		{
+			const float phase = XM_2PI*frame / (WalkFrames - 1);
+			const float swing = std::sin(phase);
+
+			XMFLOAT4 rotations[JointCount];
+			for (XMFLOAT4& r : rotations)
+				r = XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f);
+
+			rotations[Hips] = Rotation(0.0f, 0.08f*swing, 0.0f);
+			rotations[Chest] = Rotation(0.05f, -0.12f*swing, 0.0f);
+			rotations[Head] = Rotation(-0.05f, 0.04f*swing, 0.0f);
+			rotations[LeftThigh] = Rotation(-StrideAngle*swing, 0.0f, 0.0f);
+			rotations[RightThigh] = Rotation(StrideAngle*swing, 0.0f, 0.0f);
+			rotations[LeftShin] = Rotation(0.3f + 0.3f*std::cos(phase), 0.0f, 0.0f);
+			rotations[RightShin] = Rotation(0.3f - 0.3f*std::cos(phase), 0.0f, 0.0f);
+			rotations[LeftUpperArm] = Rotation(0.35f*swing, 0.0f, -0.08f);
+			rotations[RightUpperArm] = Rotation(-0.35f*swing, 0.0f, 0.08f);
+			rotations[LeftForearm] = Rotation(-0.25f - 0.1f*swing, 0.0f, 0.0f);
+			rotations[RightForearm] = Rotation(-0.25f + 0.1f*swing, 0.0f, 0.0f);
+
+			// The hips rise twice per cycle, over each planted foot.
+			SetFrame(skeleton, clip, frame, rotations, 0.015f*h*std::cos(2.0f*phase) - 0.015f*h);
+		}
+
+		return true;
+	}
+
+	bool BuildIdleClip(float h, const Skeleton& skeleton, AnimationClip& clip)
+	{
+		if (!clip.Create("idle", JointCount, IdleFrames, SampleRate))
+			return false;
+
+		for (int frame = 0; frame < IdleFrames; ++frame)
+		{
+			const float phase = XM_2PI*frame / (IdleFrames - 1);
+			const float breath = std::sin(phase);
+
+			XMFLOAT4 rotations[JointCount];
+			for (XMFLOAT4& r : rotations)
+				r = XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f);
+
+			rotations[Chest] = Rotation(-0.03f*breath, 0.0f, 0.0f);
+			rotations[Head] = Rotation(0.04f*breath, 0.35f*std::sin(0.5f*phase), 0.0f);
+			rotations[LeftUpperArm] = Rotation(0.04f*breath, 0.0f, -0.1f - 0.03f*breath);
+			rotations[RightUpperArm] = Rotation(0.04f*breath, 0.0f, 0.1f + 0.03f*breath);
+			rotations[LeftForearm] = Rotation(-0.15f, 0.0f, 0.0f);
+			rotations[RightForearm] = Rotation(-0.15f, 0.0f, 0.0f);
+
+			SetFrame(skeleton, clip, frame, rotations, 0.004f*h*breath);
+		}
+
+		return true;
+	}
+}
+
+bool BuildHumanoid(float height, HumanoidAsset& asset)
+{
+	asset = HumanoidAsset();
+
+	BuildSkeleton(height, asset.Bones);
+	BuildMesh(height, asset);
+
+	asset.Clips.resize(HumanoidClipCount);
+	if (!BuildWalkClip(height, asset.Bones, asset.Clips[HumanoidWalk]) ||
+		!BuildIdleClip(height, asset.Bones, asset.Clips[HumanoidIdle]))
+		return false;
+
+	// Each foot is planted for half the cycle while the body passes over it.
+	const float legLength = (HipsHeight - 0.02f)*height;
+	asset.WalkSpeed = 4.0f*legLength*std::sin(StrideAngle) / asset.Clips[HumanoidWalk].Duration();
+	return true;
+}
@@ -0,0 +1,52 @@
+//***************************************************************************************
+// Humanoid.h
+//
+// The demo's animated character.  The project ships the character's textures but no
+// mesh, so the body is assembled from GeometryGenerator parts (one per texture: head,
+// upper body, jacket sleeves, pants), each vertex weighted to the one or two joints
+// nearest it along its limb, and the walk and idle cycles are keyed procedurally.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "Animation.h"
+#include "Skinning.h"
+
+// The parts of the mesh, in index buffer order; each is drawn with its own material.
+enum HumanoidPart : int
+{
+	HumanoidHead = 0,
+	HumanoidBody,
+	HumanoidArms,
+	HumanoidLegs,
+	HumanoidPartCount
+};
+
+enum HumanoidClip : int
+{
+	HumanoidWalk = 0,
+	HumanoidIdle,
+	HumanoidClipCount
+};
+
+struct HumanoidAsset
+{
+	Skeleton Bones;
+	std::vector<SkinnedBindVertex> Vertices;
+	std::vector<std::uint32_t> Indices;
+
+	// Index range of each HumanoidPart.
+	int PartFirstIndex[HumanoidPartCount] = {};
+	int PartIndexCount[HumanoidPartCount] = {};
+
+	std::vector<AnimationClip> Clips;
+
+	// Ground covered per second by the walk clip played at speed 1.
+	float WalkSpeed = 0.0f;
+};
+
+// Builds a character standing on y = 0, facing +z, height units tall.  Returns false if
+// a clip could not be created.
+bool BuildHumanoid(float height, HumanoidAsset& asset);
@@ -0,0 +1,153 @@
+#include "ImageFile.h"
+#include <algorithm>
+#include <array>
+#include <cwctype>
+#include <fstream>
+#include <vector>
+
+namespace
+{
+	std::uint32_t Crc32(const std::uint8_t* data, size_t size, std::uint32_t crc = 0)
+	{
+		static const std::array<std::uint32_t, 256> table = []()
+		{
+			std::array<std::uint32_t, 256> t;
+			for (std::uint32_t n = 0; n < 256; ++n)
+			{
+				std::uint32_t c = n;
+				for (int k = 0; k < 8; ++k)
+					c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+				t[n] = c;
+			}
+			return t;
+		}();
+
+		crc = ~crc;
+		for (size_t i = 0; i < size; ++i)
+			crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+		return ~crc;
+	}
+
+	void PutU32(std::vector<std::uint8_t>& out, std::uint32_t v)
+	{
+		out.push_back((std::uint8_t)(v >> 24));
+		out.push_back((std::uint8_t)(v >> 16));
+		out.push_back((std::uint8_t)(v >> 8));
+		out.push_back((std::uint8_t)v);
+	}
+
+	void PutChunk(std::vector<std::uint8_t>& out, const char type[4], const std::vector<std::uint8_t>& data)
+	{
+		PutU32(out, (std::uint32_t)data.size());
+		const size_t typeStart = out.size();
+		out.insert(out.end(), type, type + 4);
+		out.insert(out.end(), data.begin(), data.end());
+		PutU32(out, Crc32(&out[typeStart], data.size() + 4));
+	}
+
+	std::string NarrowName(const std::wstring& filename)
+	{
+		return std::string(filename.begin(), filename.end());
+	}
+}
+
+bool ImageFile::SavePng(const std::wstring& filename, int width, int height, const std::uint8_t* rgba)
+{
+	if (width <= 0 || height <= 0 || rgba == nullptr)
+		return false;
+
+	// Scanlines with filter type 0 (none).
+	const size_t rowBytes = (size_t)width * 4;
+	std::vector<std::uint8_t> raw;
+	raw.reserve((rowBytes + 1)*height);
+	for (int y = 0; y < height; ++y)
+	{
+		raw.push_back(0);
+		raw.insert(raw.end(), rgba + y*rowBytes, rgba + (y + 1)*rowBytes);
+	}
+
+	// zlib stream of stored deflate blocks.
+	std::vector<std::uint8_t> zlib = { 0x78, 0x01 };
+	const size_t maxBlock = 65535;
+	for (size_t pos = 0;; pos += maxBlock)
+	{
+		const size_t len = std::min(maxBlock, raw.size() - pos);
+		const bool last = pos + len >= raw.size();
+		zlib.push_back(last ? 1 : 0);
+		zlib.push_back((std::uint8_t)len);
+		zlib.push_back((std::uint8_t)(len >> 8));
+		zlib.push_back((std::uint8_t)~len);
+		zlib.push_back((std::uint8_t)(~len >> 8));
+		zlib.insert(zlib.end(), raw.begin() + pos, raw.begin() + pos + len);
+		if (last)
+			break;
+	}
+
+	std::uint32_t a = 1, b = 0;
+	for (std::uint8_t v : raw)
+	{
+		a = (a + v) % 65521;
+		b = (b + a) % 65521;
+	}
+	PutU32(zlib, (b << 16) | a);
+
+	std::vector<std::uint8_t> header;
+	PutU32(header, (std::uint32_t)width);
+	PutU32(header, (std::uint32_t)height);
+	header.push_back(8); // bit depth
+	header.push_back(6); // RGBA
+	header.push_back(0); // deflate
+	header.push_back(0); // adaptive filtering
+	header.push_back(0); // no interlace
+
+	std::vector<std::uint8_t> file = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	PutChunk(file, "IHDR", header);
+	PutChunk(file, "IDAT", zlib);
+	PutChunk(file, "IEND", std::vector<std::uint8_t>());
+
+	std::ofstream fout(NarrowName(filename), std::ios::binary);
+	if (!fout)
+		return false;
+
+	fout.write(reinterpret_cast<const char*>(file.data()), file.size());
+	return (bool)fout;
+}
+
+bool ImageFile::SavePpm(const std::wstring& filename, int width, int height, const std::uint8_t* rgba)
+{
+	if (width <= 0 || height <= 0 || rgba == nullptr)
+		return false;
+
+	std::ofstream fout(NarrowName(filename), std::ios::binary);
+	if (!fout)
+		return false;
+
+	fout << "P6\n" << width << " " << height << "\n255\n";
+
+	std::vector<std::uint8_t> row((size_t)width * 3);
+	for (int y = 0; y < height; ++y)
+	{
+		const std::uint8_t* src = rgba + (size_t)y*width * 4;
+		for (int x = 0; x < width; ++x)
+		{
+			row[3 * x + 0] = src[4 * x + 0];
+			row[3 * x + 1] = src[4 * x + 1];
+			row[3 * x + 2] = src[4 * x + 2];
+		}
+		fout.write(reinterpret_cast<const char*>(row.data()), row.size());
+	}
+
+	return (bool)fout;
+}
+
+bool ImageFile::Save(const std::wstring& filename, int width, int height, const std::uint8_t* rgba)
+{
+	const size_t dot = filename.find_last_of(L'.');
+	std::wstring ext = dot == std::wstring::npos ? std::wstring() : filename.substr(dot + 1);
+	std::transform(ext.begin(), ext.end(), ext.begin(), [](wchar_t c) { return (wchar_t)std::towlower(c); });
+
+	if (ext == L"ppm")
+		return SavePpm(filename, width, height, rgba);
+
+	return SavePng(filename, width, height, rgba);
+}
@@ -0,0 +1,22 @@
+//***************************************************************************************
+// ImageFile.h
+//
+// Writes 8-bit RGBA images to disk for the CPU renderers and tools.  PNG output uses
+// stored (uncompressed) deflate blocks, so no compression library is needed; PPM drops
+// the alpha channel.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace ImageFile
+{
+	// rgba holds width*height pixels, rows top to bottom, 4 bytes per pixel.
+	bool SavePng(const std::wstring& filename, int width, int height, const std::uint8_t* rgba);
+	bool SavePpm(const std::wstring& filename, int width, int height, const std::uint8_t* rgba);
+
+	// Picks the format from the extension (.ppm, anything else is PNG).
+	bool Save(const std::wstring& filename, int width, int height, const std::uint8_t* rgba);
+}
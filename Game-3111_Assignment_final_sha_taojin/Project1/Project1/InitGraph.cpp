@@ -0,0 +1,207 @@
+#include "InitGraph.h"
+#include "ParallelFor.h"
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <mutex>
+
+InitGraph::TaskId InitGraph::Add(const char* name, std::function<void()> work,
+	std::initializer_list<TaskId> dependencies, InitLane lane)
+{
+	const TaskId id = (TaskId)mTasks.size();
+
+	Task task;
+	task.Name = name;
+	task.Work = std::move(work);
+	task.Lane = lane;
+	for (TaskId dependency : dependencies)
+	{
+		assert(dependency >= 0 && dependency < id);
+		task.Dependencies.push_back(dependency);
+	}
+
+	// The Caller lane keeps its order by depending on the task added before.
+	if (lane == InitLane::Caller)
+	{
+		if (mLastCallerTask >= 0)
+			task.Dependencies.push_back(mLastCallerTask);
+		mLastCallerTask = id;
+	}
+
+	mTasks.push_back(std::move(task));
+	return id;
+}
+
+void InitGraph::Run()
+{
+	typedef std::chrono::steady_clock Clock;
+	const Clock::time_point start = Clock::now();
+	auto milliseconds = [start]()
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	};
+
+	const int taskCount = (int)mTasks.size();
+	std::vector<std::vector<TaskId>> dependents(taskCount);
+	std::vector<int> waiting(taskCount, 0);
+	int anyTasks = 0;
+	int callerTasks = 0;
+	for (TaskId id = 0; id < taskCount; ++id)
+	{
+		for (TaskId dependency : mTasks[id].Dependencies)
+			dependents[dependency].push_back(id);
+		waiting[id] = (int)mTasks[id].Dependencies.size();
+		(mTasks[id].Lane == InitLane::Caller ? callerTasks : anyTasks)++;
+	}
+
+	// Ready tasks by lane, in the order they became ready.
+	std::deque<TaskId> readyAny;
+	std::deque<TaskId> readyCaller;
+	for (TaskId id = 0; id < taskCount; ++id)
+	{
+		if (waiting[id] == 0)
+			(mTasks[id].Lane == InitLane::Caller ? readyCaller : readyAny).push_back(id);
+	}
+
+	std::mutex lock;
+	std::condition_variable wake;
+	int unfinished = taskCount;
+	int startedWorkers = 0;
+	std::exception_ptr error;
+
+	mWorkerCount = std::max(std::min(WorkerCount() - 1, anyTasks), 0);
+
+	auto runTask = [&](TaskId id, bool onCaller, std::unique_lock<std::mutex>& held)
+	{
+		Task& task = mTasks[id];
+		held.unlock();
+
+		task.Timing.OnCaller = onCaller;
+		task.Timing.Start = milliseconds();
+		std::exception_ptr taskError;
+		try
+		{
+			task.Work();
+		}
+		catch (...)
+		{
+			taskError = std::current_exception();
+		}
+		task.Timing.End = milliseconds();
+
+		held.lock();
+		if (taskError && !error)
+			error = taskError;
+		if (task.Lane == InitLane::Caller)
+			--callerTasks;
+		--unfinished;
+		for (TaskId next : dependents[id])
+		{
+			if (--waiting[next] == 0)
+				(mTasks[next].Lane == InitLane::Caller ? readyCaller : readyAny).push_back(next);
+		}
+		wake.notify_all();
+	};
+
+	// The caller runs its lane first.  It only helps with the other tasks when no worker
+	// is running (yet) or its lane is done, so a caller task never waits behind a long
+	// one.
+	auto callerLoop = [&]()
+	{
+		std::unique_lock<std::mutex> held(lock);
+		while (unfinished > 0 && !error)
+		{
+			if (!readyCaller.empty())
+			{
+				const TaskId id = readyCaller.front();
+				readyCaller.pop_front();
+				runTask(id, true, held);
+			}
+			else if (!readyAny.empty() && (startedWorkers == 0 || callerTasks == 0))
+			{
+				const TaskId id = readyAny.front();
+				readyAny.pop_front();
+				runTask(id, true, held);
+			}
+			else
+			{
+				wake.wait(held);
+			}
+		}
+	};
+
+	auto workerLoop = [&](int)
+	{
+		std::unique_lock<std::mutex> held(lock);
+		++startedWorkers;
+		while (unfinished > 0 && !error)
+		{
+			if (!readyAny.empty())
+			{
+				const TaskId id = readyAny.front();
+				readyAny.pop_front();
+				runTask(id, false, held);
+			}
+			else
+			{
+				wake.wait(held);
+			}
+		}
+	};
+
+	ParallelForAlongside(0, mWorkerCount, workerLoop, callerLoop);
+	mMilliseconds = milliseconds();
+
+	if (error)
+		std::rethrow_exception(error);
+}
+
+double InitGraph::WorkMilliseconds()const
+{
+	double total = 0.0;
+	for (const Task& task : mTasks)
+		total += task.Timing.End - task.Timing.Start;
+	return total;
+}
+
+double InitGraph::CriticalPathMilliseconds()const
+{
+	// Dependencies come before their dependents, so one pass in id order suffices.
+	std::vector<double> finish(mTasks.size(), 0.0);
+	double longest = 0.0;
+	for (size_t id = 0; id < mTasks.size(); ++id)
+	{
+		double ready = 0.0;
+		for (TaskId dependency : mTasks[id].Dependencies)
+			ready = std::max(ready, finish[dependency]);
+		finish[id] = ready + (mTasks[id].Timing.End - mTasks[id].Timing.Start);
+		longest = std::max(longest, finish[id]);
+	}
+	return longest;
+}
+
+std::string InitGraph::Report()const
+{
+	std::string report;
+	char line[160];
+	std::snprintf(line, sizeof(line), "Init graph: %d tasks, %d workers and the caller\n",
+		(int)mTasks.size(), mWorkerCount);
+	report += line;
+
+	for (const Task& task : mTasks)
+	{
+		std::snprintf(line, sizeof(line), "  %-28s %9.2f - %9.2f ms  %8.2f ms%s\n", task.Name,
+			task.Timing.Start, task.Timing.End, task.Timing.End - task.Timing.Start,
+			task.Timing.OnCaller ? "  (caller)" : "");
+		report += line;
+	}
+
+	std::snprintf(line, sizeof(line), "  wall %.2f ms, work %.2f ms, critical path %.2f ms\n",
+		mMilliseconds, WorkMilliseconds(), CriticalPathMilliseconds());
+	report += line;
+	return report;
+}
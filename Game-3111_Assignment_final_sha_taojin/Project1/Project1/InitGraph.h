@@ -0,0 +1,77 @@
+//***************************************************************************************
+// InitGraph.h
+//
+// Startup work as a dependency graph.  A task lists the tasks it needs, which must have
+// been added before it, so the graph cannot have cycles.  Run starts each task once its
+// dependencies have finished, on the ParallelFor workers or, for tasks in the Caller
+// lane, on the thread that called Run in the order they were added: the demo keeps the
+// build steps that draw from rand() there, so the scene comes out as when the steps ran
+// one after another.  Run times every task for the startup report.
+//***************************************************************************************
+
+#pragma once
+
+#include <functional>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+enum class InitLane
+{
+	// Any worker, concurrently with other tasks.
+	Any = 0,
+
+	// The thread that calls Run, one task at a time in the order they were added.
+	Caller
+};
+
+struct InitTaskTiming
+{
+	// Milliseconds since Run started.
+	double Start = 0.0;
+	double End = 0.0;
+
+	bool OnCaller = false;
+};
+
+class InitGraph
+{
+public:
+	typedef int TaskId;
+
+	// Adds a task that runs after dependencies, which are ids returned by earlier calls.
+	TaskId Add(const char* name, std::function<void()> work,
+		std::initializer_list<TaskId> dependencies = {}, InitLane lane = InitLane::Any);
+
+	// Runs every task and returns when all have finished.  If a task throws, no more
+	// tasks start, and the first exception is rethrown once the running ones are done.
+	void Run();
+
+	int TaskCount()const { return (int)mTasks.size(); }
+	const char* TaskName(TaskId id)const { return mTasks[id].Name; }
+	const InitTaskTiming& Timing(TaskId id)const { return mTasks[id].Timing; }
+
+	// Of the last Run: wall time, the sum of the task times, and the longest chain of
+	// dependent tasks, which bounds the wall time however many workers there are.
+	double Milliseconds()const { return mMilliseconds; }
+	double WorkMilliseconds()const;
+	double CriticalPathMilliseconds()const;
+
+	// One line per task with its start and end, then the totals above.
+	std::string Report()const;
+
+private:
+	struct Task
+	{
+		const char* Name;
+		std::function<void()> Work;
+		InitLane Lane;
+		std::vector<TaskId> Dependencies;
+		InitTaskTiming Timing;
+	};
+
+	std::vector<Task> mTasks;
+	TaskId mLastCallerTask = -1;
+	int mWorkerCount = 0;
+	double mMilliseconds = 0.0;
+};
@@ -0,0 +1,224 @@
+#include "LightBaker.h"
+#include "ParallelFor.h"
+
+using namespace DirectX;
+
+namespace
+{
+	// Padding boxes sit out of reach of any ray the baker casts.
+	const float PadPosition = 1e30f;
+
+	float RadicalInverse(std::uint32_t bits)
+	{
+		bits = (bits << 16u) | (bits >> 16u);
+		bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+		bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+		bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+		bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+		return bits * 2.3283064365386963e-10f;
+	}
+
+	float HashToUnit(std::uint32_t x)
+	{
+		x ^= x >> 16;
+		x *= 0x7feb352dU;
+		x ^= x >> 15;
+		x *= 0x846ca68bU;
+		x ^= x >> 16;
+		return (x >> 8) * (1.0f / 16777216.0f);
+	}
+}
+
+void LightBaker::BoxSoA::Resize(size_t count)
+{
+	const size_t padded = (count + 3) & ~size_t(3);
+	MinX.resize(padded);
+	MinY.resize(padded);
+	MinZ.resize(padded);
+	MaxX.resize(padded);
+	MaxY.resize(padded);
+	MaxZ.resize(padded);
+
+	for (size_t k = count; k < padded; ++k)
+		MinX[k] = MinY[k] = MinZ[k] = MaxX[k] = MaxY[k] = MaxZ[k] = PadPosition;
+}
+
+void LightBaker::BoxSoA::Set(size_t k, const BoxSoA& src, size_t srcIndex)
+{
+	MinX[k] = src.MinX[srcIndex];
+	MinY[k] = src.MinY[srcIndex];
+	MinZ[k] = src.MinZ[srcIndex];
+	MaxX[k] = src.MaxX[srcIndex];
+	MaxY[k] = src.MaxY[srcIndex];
+	MaxZ[k] = src.MaxZ[srcIndex];
+}
+
+void LightBaker::AddOccluder(FXMVECTOR boxMin, FXMVECTOR boxMax)
+{
+	XMFLOAT3 lo, hi;
+	XMStoreFloat3(&lo, XMVectorMin(boxMin, boxMax));
+	XMStoreFloat3(&hi, XMVectorMax(boxMin, boxMax));
+
+	const size_t k = mOccluderCount++;
+	mBoxes.Resize(mOccluderCount);
+	mBoxes.MinX[k] = lo.x;
+	mBoxes.MinY[k] = lo.y;
+	mBoxes.MinZ[k] = lo.z;
+	mBoxes.MaxX[k] = hi.x;
+	mBoxes.MaxY[k] = hi.y;
+	mBoxes.MaxZ[k] = hi.z;
+}
+
+void LightBaker::ClearOccluders()
+{
+	mOccluderCount = 0;
+	mBoxes.Resize(0);
+}
+
+bool LightBaker::RayHitsAny(const BoxSoA& boxes, FXMVECTOR origin, FXMVECTOR dir, float maxDist)
+{
+	// Keep the slab test free of 0*inf when a direction component is zero.
+	const XMVECTOR eps = XMVectorReplicate(1e-12f);
+	XMVECTOR d = XMVectorSelect(dir, eps, XMVectorLess(XMVectorAbs(dir), eps));
+	XMVECTOR invDir = XMVectorReciprocal(d);
+
+	const XMVECTOR ox = XMVectorSplatX(origin);
+	const XMVECTOR oy = XMVectorSplatY(origin);
+	const XMVECTOR oz = XMVectorSplatZ(origin);
+	const XMVECTOR ix = XMVectorSplatX(invDir);
+	const XMVECTOR iy = XMVectorSplatY(invDir);
+	const XMVECTOR iz = XMVectorSplatZ(invDir);
+	const XMVECTOR zero = XMVectorZero();
+	const XMVECTOR tLimit = XMVectorReplicate(maxDist);
+
+	const size_t count = boxes.MinX.size();
+	for (size_t k = 0; k < count; k += 4)
+	{
+		XMVECTOR t1x = XMVectorMultiply(XMVectorSubtract(XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&boxes.MinX[k])), ox), ix);
+		XMVECTOR t2x = XMVectorMultiply(XMVectorSubtract(XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&boxes.MaxX[k])), ox), ix);
+		XMVECTOR t1y = XMVectorMultiply(XMVectorSubtract(XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&boxes.MinY[k])), oy), iy);
+		XMVECTOR t2y = XMVectorMultiply(XMVectorSubtract(XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&boxes.MaxY[k])), oy), iy);
+		XMVECTOR t1z = XMVectorMultiply(XMVectorSubtract(XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&boxes.MinZ[k])), oz), iz);
+		XMVECTOR t2z = XMVectorMultiply(XMVectorSubtract(XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&boxes.MaxZ[k])), oz), iz);
+
+		XMVECTOR tEnter = XMVectorMax(XMVectorMax(XMVectorMin(t1x, t2x), XMVectorMin(t1y, t2y)),
+			XMVectorMax(XMVectorMin(t1z, t2z), zero));
+		XMVECTOR tExit = XMVectorMin(XMVectorMin(XMVectorMax(t1x, t2x), XMVectorMax(t1y, t2y)),
+			XMVectorMin(XMVectorMax(t1z, t2z), tLimit));
+
+		std::uint32_t hit[4];
+		XMStoreInt4(hit, XMVectorLessOrEqual(tEnter, tExit));
+		if ((hit[0] | hit[1] | hit[2] | hit[3]) != 0)
+			return true;
+	}
+
+	return false;
+}
+
+bool LightBaker::Occluded(FXMVECTOR origin, FXMVECTOR dir, float maxDist)const
+{
+	return RayHitsAny(mBoxes, origin, dir, maxDist);
+}
+
+void LightBaker::GatherNearby(FXMVECTOR center, float radius, BoxSoA& out)const
+{
+	XMFLOAT3 c;
+	XMStoreFloat3(&c, center);
+	const float radiusSq = radius*radius;
+
+	out.Resize(0);
+	size_t n = 0;
+	for (size_t k = 0; k < mOccluderCount; ++k)
+	{
+		float dx = std::max(std::max(mBoxes.MinX[k] - c.x, c.x - mBoxes.MaxX[k]), 0.0f);
+		float dy = std::max(std::max(mBoxes.MinY[k] - c.y, c.y - mBoxes.MaxY[k]), 0.0f);
+		float dz = std::max(std::max(mBoxes.MinZ[k] - c.z, c.z - mBoxes.MaxZ[k]), 0.0f);
+		if (dx*dx + dy*dy + dz*dz > radiusSq)
+			continue;
+
+		out.Resize(n + 1);
+		out.Set(n++, mBoxes, k);
+	}
+}
+
+float LightBaker::AmbientOcclusion(const BoxSoA& nearby, FXMVECTOR pos, FXMVECTOR normal,
+	int rayCount, float radius, std::uint32_t seed)const
+{
+	if (rayCount <= 0 || nearby.MinX.empty())
+		return 1.0f;
+
+	// Orthonormal basis around the normal.
+	XMVECTOR up = std::fabs(XMVectorGetY(normal)) < 0.999f ? XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f) : XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f);
+	XMVECTOR tangent = XMVector3Normalize(XMVector3Cross(up, normal));
+	XMVECTOR bitangent = XMVector3Cross(normal, tangent);
+
+	// Hammersley points rotated per vertex so neighbouring vertices do not band.
+	const float rotation = HashToUnit(seed);
+
+	int escaped = 0;
+	for (int i = 0; i < rayCount; ++i)
+	{
+		float u1 = (i + 0.5f) / rayCount;
+		float u2 = RadicalInverse((std::uint32_t)i) + rotation;
+		u2 -= std::floor(u2);
+
+		// Cosine weighted direction in the local frame.
+		float r = std::sqrt(u1);
+		float phi = XM_2PI*u2;
+		float x = r*std::cos(phi);
+		float y = r*std::sin(phi);
+		float z = std::sqrt(std::max(1.0f - u1, 0.0f));
+
+		XMVECTOR dir = XMVectorAdd(XMVectorAdd(XMVectorScale(tangent, x), XMVectorScale(bitangent, y)),
+			XMVectorScale(normal, z));
+
+		if (!RayHitsAny(nearby, pos, dir, radius))
+			++escaped;
+	}
+
+	return (float)escaped / rayCount;
+}
+
+void LightBaker::Bake(const LightBakeDesc& desc, const LightingUtil::SurfaceMaterial& mat,
+	const XMFLOAT3* positions, const XMFLOAT3* normals, size_t count, XMFLOAT4* colors)const
+{
+	const XMVECTOR ambient = XMLoadFloat4(&desc.AmbientLight);
+
+	ParallelForRange((int)count, 64, [&](int begin, int end)
+	{
+		BoxSoA nearby;
+		std::vector<float> shadow(std::max(desc.NumDirLights, 1), 1.0f);
+
+		for (int k = begin; k < end; ++k)
+		{
+			XMVECTOR normal = XMVector3Normalize(XMLoadFloat3(&normals[k]));
+			XMVECTOR pos = XMLoadFloat3(&positions[k]);
+			XMVECTOR origin = XMVectorAdd(pos, XMVectorScale(normal, desc.RayBias));
+
+			GatherNearby(origin, desc.AoRadius, nearby);
+			float ao = AmbientOcclusion(nearby, origin, normal, desc.AoRayCount, desc.AoRadius, (std::uint32_t)k);
+
+			for (int i = 0; i < desc.NumDirLights; ++i)
+			{
+				XMVECTOR toLight = XMVectorNegate(XMLoadFloat3(&desc.Lights[i].Direction));
+				bool facing = XMVectorGetX(XMVector3Dot(toLight, normal)) > 0.0f;
+				shadow[i] = desc.Shadows && facing && Occluded(origin, toLight, desc.ShadowDistance) ? 0.0f : 1.0f;
+			}
+
+			// With the viewer along the normal the specular term depends only on the light.
+			XMVECTOR direct = LightingUtil::ComputeLighting(desc.Lights,
+				desc.NumDirLights, desc.NumPointLights, desc.NumSpotLights,
+				mat, pos, normal, normal, shadow.data());
+
+			XMVECTOR vertexAmbient = ambient;
+			if (desc.AmbientSH != nullptr)
+			{
+				XMFLOAT3 sh = desc.AmbientSH->Evaluate(normal);
+				vertexAmbient = XMLoadFloat3(&sh);
+			}
+
+			XMVECTOR color = XMVectorMultiplyAdd(vertexAmbient, XMVectorReplicate(ao), direct);
+			XMStoreFloat4(&colors[k], XMVectorSetW(color, ao));
+		}
+	});
+}
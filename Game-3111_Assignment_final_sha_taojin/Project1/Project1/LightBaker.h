@@ -0,0 +1,86 @@
+//***************************************************************************************
+// LightBaker.h
+//
+// Bakes static lighting into per-vertex colors.  Direct light comes from the CPU port of
+// ComputeLighting (LightingUtil.h) with ray traced shadows for the directional lights,
+// and the ambient term is scaled by ray traced ambient occlusion.  Occluders are world
+// space boxes, which is all the maze is made of.  Vertices are baked across workers.
+//***************************************************************************************
+
+#pragma once
+
+#include "LightingUtil.h"
+#include "SphericalHarmonics.h"
+#include <vector>
+
+struct LightBakeDesc
+{
+	// NumDirLights directional lights, then NumPointLights point lights, then NumSpotLights
+	// spot lights.  Only the directional lights cast shadows.
+	const Light* Lights = nullptr;
+	int NumDirLights = 0;
+	int NumPointLights = 0;
+	int NumSpotLights = 0;
+
+	DirectX::XMFLOAT4 AmbientLight = { 0.0f, 0.0f, 0.0f, 1.0f };
+
+	// Irradiance SH evaluated per vertex normal in place of AmbientLight when set.
+	const SH9* AmbientSH = nullptr;
+
+	// Cosine weighted occlusion rays per vertex and how far they look.
+	int AoRayCount = 32;
+	float AoRadius = 6.0f;
+
+	bool Shadows = true;
+	float ShadowDistance = 500.0f;
+
+	// Ray origins are pushed this far along the normal off the surface.
+	float RayBias = 0.02f;
+};
+
+class LightBaker
+{
+public:
+	LightBaker() = default;
+	LightBaker(const LightBaker& rhs) = delete;
+	LightBaker& operator=(const LightBaker& rhs) = delete;
+	~LightBaker() = default;
+
+	void AddOccluder(DirectX::FXMVECTOR boxMin, DirectX::FXMVECTOR boxMax);
+	void ClearOccluders();
+	size_t OccluderCount()const { return mOccluderCount; }
+
+	// Bakes count world space vertices.  colors[k].rgb is the light reaching vertex k,
+	// ambient*AO plus the direct light for mat evaluated with the viewer along the normal,
+	// so a pixel shader only multiplies it by the albedo.  colors[k].a is the AO term.
+	void Bake(const LightBakeDesc& desc, const LightingUtil::SurfaceMaterial& mat,
+		const DirectX::XMFLOAT3* positions, const DirectX::XMFLOAT3* normals, size_t count,
+		DirectX::XMFLOAT4* colors)const;
+
+	// True if the ray hits any occluder with 0 <= t <= maxDist.  dir need not be normalized.
+	bool Occluded(DirectX::FXMVECTOR origin, DirectX::FXMVECTOR dir, float maxDist)const;
+
+private:
+	// Boxes in SoA layout, padded to a multiple of four.
+	struct BoxSoA
+	{
+		std::vector<float> MinX, MinY, MinZ;
+		std::vector<float> MaxX, MaxY, MaxZ;
+
+		void Resize(size_t count);
+		void Set(size_t k, const BoxSoA& src, size_t srcIndex);
+	};
+
+	static bool RayHitsAny(const BoxSoA& boxes, DirectX::FXMVECTOR origin, DirectX::FXMVECTOR dir, float maxDist);
+
+	// Fraction of cosine weighted hemisphere rays that escape within radius.
+	float AmbientOcclusion(const BoxSoA& nearby, DirectX::FXMVECTOR pos, DirectX::FXMVECTOR normal,
+		int rayCount, float radius, std::uint32_t seed)const;
+
+	// Gathers the occluders touching the sphere (center, radius) into out.
+	void GatherNearby(DirectX::FXMVECTOR center, float radius, BoxSoA& out)const;
+
+private:
+	BoxSoA mBoxes;
+	size_t mOccluderCount = 0;
+};
@@ -0,0 +1,325 @@
+#include "LightClusters.h"
+#include "ParallelFor.h"
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+
+using namespace DirectX;
+
+const std::uint32_t LightClusterGrid::TilesX;
+const std::uint32_t LightClusterGrid::TilesY;
+const std::uint32_t LightClusterGrid::SlicesZ;
+const std::uint32_t LightClusterGrid::ClusterCount;
+const std::uint32_t LightClusterGrid::MaxClusterLights;
+const std::uint32_t LightClusterGrid::MaxLightIndices;
+
+namespace
+{
+	// Lanes of a padded group never intersect anything.
+	const float PadPosition = 1e30f;
+
+	// Returns a 4-bit mask of the lights k..k+3 whose spheres touch the box.
+	int XM_CALLCONV SphereBoxMask(const float* x, const float* y, const float* z, const float* r,
+		FXMVECTOR boxMin, FXMVECTOR boxMax)
+	{
+		const XMVECTOR zero = XMVectorZero();
+
+		XMVECTOR cx = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(x));
+		XMVECTOR cy = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(y));
+		XMVECTOR cz = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(z));
+		XMVECTOR radius = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(r));
+
+		// Distance from each center to the box along each axis; zero inside the slab.
+		XMVECTOR dx = XMVectorAdd(XMVectorMax(XMVectorSubtract(XMVectorSplatX(boxMin), cx), zero),
+			XMVectorMax(XMVectorSubtract(cx, XMVectorSplatX(boxMax)), zero));
+		XMVECTOR dy = XMVectorAdd(XMVectorMax(XMVectorSubtract(XMVectorSplatY(boxMin), cy), zero),
+			XMVectorMax(XMVectorSubtract(cy, XMVectorSplatY(boxMax)), zero));
+		XMVECTOR dz = XMVectorAdd(XMVectorMax(XMVectorSubtract(XMVectorSplatZ(boxMin), cz), zero),
+			XMVectorMax(XMVectorSubtract(cz, XMVectorSplatZ(boxMax)), zero));
+
+		XMVECTOR distSq = XMVectorMultiplyAdd(dx, dx, XMVectorMultiplyAdd(dy, dy, XMVectorMultiply(dz, dz)));
+
+		std::uint32_t hit[4];
+		XMStoreInt4(hit, XMVectorLessOrEqual(distSq, XMVectorMultiply(radius, radius)));
+		return (hit[0] & 1) | (hit[1] & 2) | (hit[2] & 4) | (hit[3] & 8);
+	}
+}
+
+void LightClusterGrid::LightSoA::Resize(size_t count)
+{
+	// Pad to a whole group of four so the SIMD loops need no tail.
+	const size_t padded = (count + 3) & ~size_t(3);
+	X.resize(padded);
+	Y.resize(padded);
+	Z.resize(padded);
+	Radius.resize(padded);
+
+	for (size_t k = count; k < padded; ++k)
+	{
+		X[k] = Y[k] = Z[k] = PadPosition;
+		Radius[k] = 0.0f;
+	}
+}
+
+void LightClusterGrid::SetProjection(float fovY, float aspect, float nearZ, float farZ)
+{
+	assert(nearZ > 0.0f && farZ > nearZ);
+
+	// Exponential slices keep the clusters roughly cubical in view space.
+	const float logRatio = std::log(farZ / nearZ);
+	mZParams = XMFLOAT4(SlicesZ / logRatio, SlicesZ*std::log(nearZ) / logRatio, 0.0f, 0.0f);
+
+	mSliceDepths.resize(SlicesZ + 1);
+	for (std::uint32_t k = 0; k <= SlicesZ; ++k)
+		mSliceDepths[k] = nearZ*std::pow(farZ / nearZ, (float)k / SlicesZ);
+
+	const float tanHalfY = std::tan(0.5f*fovY);
+	const float tanHalfX = tanHalfY*aspect;
+
+	mClusterMin.resize(ClusterCount);
+	mClusterMax.resize(ClusterCount);
+	mClusterSpheres.resize(ClusterCount);
+
+	for (std::uint32_t slice = 0; slice < SlicesZ; ++slice)
+	{
+		const float depths[2] = { mSliceDepths[slice], mSliceDepths[slice + 1] };
+
+		for (std::uint32_t y = 0; y < TilesY; ++y)
+		{
+			// Tile rows run top to bottom, NDC y runs bottom to top.
+			const float ndcY0 = 1.0f - 2.0f*y / TilesY;
+			const float ndcY1 = 1.0f - 2.0f*(y + 1) / TilesY;
+
+			for (std::uint32_t x = 0; x < TilesX; ++x)
+			{
+				const float ndcX0 = -1.0f + 2.0f*x / TilesX;
+				const float ndcX1 = -1.0f + 2.0f*(x + 1) / TilesX;
+
+				XMVECTOR boxMin = XMVectorReplicate(FLT_MAX);
+				XMVECTOR boxMax = XMVectorReplicate(-FLT_MAX);
+				for (float depth : depths)
+				{
+					const float vx[2] = { ndcX0*depth*tanHalfX, ndcX1*depth*tanHalfX };
+					const float vy[2] = { ndcY0*depth*tanHalfY, ndcY1*depth*tanHalfY };
+					for (float cx : vx)
+					{
+						for (float cy : vy)
+						{
+							XMVECTOR corner = XMVectorSet(cx, cy, depth, 0.0f);
+							boxMin = XMVectorMin(boxMin, corner);
+							boxMax = XMVectorMax(boxMax, corner);
+						}
+					}
+				}
+
+				const std::uint32_t c = (slice*TilesY + y)*TilesX + x;
+				XMStoreFloat3(&mClusterMin[c], boxMin);
+				XMStoreFloat3(&mClusterMax[c], boxMax);
+
+				XMVECTOR center = XMVectorScale(XMVectorAdd(boxMin, boxMax), 0.5f);
+				XMVECTOR radius = XMVectorScale(XMVector3Length(XMVectorSubtract(boxMax, boxMin)), 0.5f);
+				XMStoreFloat4(&mClusterSpheres[c], XMVectorSelect(radius, center, g_XMSelect1110));
+			}
+		}
+	}
+
+	const std::uint32_t rowCount = SlicesZ*TilesY;
+	mRowCandidates.resize(rowCount);
+	mRowIndices.resize(rowCount);
+	mRowScratch.resize(rowCount);
+	mClusterCounts.assign(ClusterCount, 0);
+	mRanges.assign(ClusterCount, XMUINT2(0, 0));
+}
+
+void LightClusterGrid::Build(FXMMATRIX view,
+	const Light* pointLights, std::uint32_t pointCount,
+	const Light* spotLights, std::uint32_t spotCount)
+{
+	assert(!mClusterMin.empty());
+
+	pointCount = std::min(pointCount, MaxClusterLights);
+	spotCount = std::min(spotCount, MaxClusterLights - pointCount);
+
+	mLights.assign(pointLights, pointLights + pointCount);
+	mLights.insert(mLights.end(), spotLights, spotLights + spotCount);
+	mPointCount = pointCount;
+
+	const std::uint32_t lightCount = (std::uint32_t)mLights.size();
+
+	//
+	// Move the lights to view space.
+	//
+	mViewLights.Resize(lightCount);
+	mViewSpotDirs.resize(spotCount);
+	mSpotCosSin.resize(2 * (size_t)spotCount);
+
+	for (std::uint32_t l = 0; l < lightCount; ++l)
+	{
+		const Light& light = mLights[l];
+
+		XMFLOAT3 p;
+		XMStoreFloat3(&p, XMVector3TransformCoord(XMLoadFloat3(&light.Position), view));
+		mViewLights.X[l] = p.x;
+		mViewLights.Y[l] = p.y;
+		mViewLights.Z[l] = p.z;
+		mViewLights.Radius[l] = light.FalloffEnd;
+
+		if (l >= pointCount)
+		{
+			const std::uint32_t s = l - pointCount;
+			XMVECTOR dir = XMVector3TransformNormal(XMLoadFloat3(&light.Direction), view);
+			XMStoreFloat3(&mViewSpotDirs[s], XMVector3Normalize(dir));
+
+			// The cone ends where the spot factor cos^SpotPower falls below 1/256.
+			const float cosAngle = light.SpotPower > 0.0f ? std::pow(1.0f / 256.0f, 1.0f / light.SpotPower) : 0.0f;
+			mSpotCosSin[2 * s] = cosAngle;
+			mSpotCosSin[2 * s + 1] = std::sqrt(std::max(1.0f - cosAngle*cosAngle, 0.0f));
+		}
+	}
+
+	//
+	// Bin each row of clusters independently.
+	//
+	const std::uint32_t rowCount = SlicesZ*TilesY;
+	const std::uint32_t paddedCount = (std::uint32_t)mViewLights.X.size();
+
+	ParallelFor(0, (int)rowCount, [&](int row)
+	{
+		const std::uint32_t slice = row / TilesY;
+		const std::uint32_t y = row % TilesY;
+		const std::uint32_t first = (std::uint32_t)row*TilesX;
+
+		// Bounds of the whole row.
+		XMVECTOR rowMin = XMLoadFloat3(&mClusterMin[first]);
+		XMVECTOR rowMax = XMLoadFloat3(&mClusterMax[first]);
+		for (std::uint32_t x = 1; x < TilesX; ++x)
+		{
+			rowMin = XMVectorMin(rowMin, XMLoadFloat3(&mClusterMin[first + x]));
+			rowMax = XMVectorMax(rowMax, XMLoadFloat3(&mClusterMax[first + x]));
+		}
+
+		std::vector<std::uint32_t>& candidates = mRowCandidates[row];
+		candidates.clear();
+		for (std::uint32_t k = 0; k < paddedCount; k += 4)
+		{
+			int mask = SphereBoxMask(&mViewLights.X[k], &mViewLights.Y[k], &mViewLights.Z[k],
+				&mViewLights.Radius[k], rowMin, rowMax);
+			for (int lane = 0; mask != 0; ++lane, mask >>= 1)
+			{
+				if (mask & 1)
+					candidates.push_back(k + lane);
+			}
+		}
+
+		BinRow(slice, y, candidates, mRowScratch[row], mRowIndices[row], &mClusterCounts[first]);
+	});
+
+	//
+	// Concatenate the rows into the flat index list.
+	//
+	mIndices.clear();
+	mOverflowCount = 0;
+
+	for (std::uint32_t row = 0; row < rowCount; ++row)
+	{
+		const std::vector<std::uint32_t>& rowIndices = mRowIndices[row];
+		std::uint32_t read = 0;
+
+		for (std::uint32_t x = 0; x < TilesX; ++x)
+		{
+			const std::uint32_t c = row*TilesX + x;
+			const std::uint32_t count = mClusterCounts[c];
+			const std::uint32_t kept = std::min(count, MaxLightIndices - (std::uint32_t)mIndices.size());
+
+			mRanges[c] = XMUINT2((std::uint32_t)mIndices.size(), kept);
+			mIndices.insert(mIndices.end(), rowIndices.begin() + read, rowIndices.begin() + read + kept);
+
+			mOverflowCount += count - kept;
+			read += count;
+		}
+	}
+}
+
+void LightClusterGrid::BinRow(std::uint32_t slice, std::uint32_t y, const std::vector<std::uint32_t>& candidates,
+	LightSoA& scratch, std::vector<std::uint32_t>& out, std::uint32_t* counts)const
+{
+	out.clear();
+
+	// Gather the candidates so the cluster loop reads contiguous groups of four.
+	scratch.Resize(candidates.size());
+	for (size_t k = 0; k < candidates.size(); ++k)
+	{
+		const std::uint32_t l = candidates[k];
+		scratch.X[k] = mViewLights.X[l];
+		scratch.Y[k] = mViewLights.Y[l];
+		scratch.Z[k] = mViewLights.Z[l];
+		scratch.Radius[k] = mViewLights.Radius[l];
+	}
+
+	const std::uint32_t paddedCount = (std::uint32_t)scratch.X.size();
+	for (std::uint32_t x = 0; x < TilesX; ++x)
+	{
+		const std::uint32_t c = (slice*TilesY + y)*TilesX + x;
+		const XMVECTOR boxMin = XMLoadFloat3(&mClusterMin[c]);
+		const XMVECTOR boxMax = XMLoadFloat3(&mClusterMax[c]);
+		const size_t begin = out.size();
+
+		for (std::uint32_t k = 0; k < paddedCount; k += 4)
+		{
+			int mask = SphereBoxMask(&scratch.X[k], &scratch.Y[k], &scratch.Z[k], &scratch.Radius[k], boxMin, boxMax);
+			for (int lane = 0; mask != 0; ++lane, mask >>= 1)
+			{
+				if ((mask & 1) == 0)
+					continue;
+
+				const std::uint32_t l = candidates[k + lane];
+				if (l >= mPointCount && !ConeIntersects(l, mClusterSpheres[c]))
+					continue;
+
+				out.push_back(l);
+			}
+		}
+
+		counts[x] = (std::uint32_t)(out.size() - begin);
+	}
+}
+
+bool LightClusterGrid::ConeIntersects(std::uint32_t light, const XMFLOAT4& sphere)const
+{
+	const std::uint32_t s = light - mPointCount;
+	const float cosAngle = mSpotCosSin[2 * s];
+	const float sinAngle = mSpotCosSin[2 * s + 1];
+	const float range = mViewLights.Radius[light];
+
+	XMVECTOR v = XMVectorSubtract(XMLoadFloat4(&sphere),
+		XMVectorSet(mViewLights.X[light], mViewLights.Y[light], mViewLights.Z[light], 0.0f));
+	v = XMVectorSelect(XMVectorZero(), v, g_XMSelect1110);
+
+	const float lenSq = XMVectorGetX(XMVector3LengthSq(v));
+	const float axial = XMVectorGetX(XMVector3Dot(v, XMLoadFloat3(&mViewSpotDirs[s])));
+	const float radial = std::sqrt(std::max(lenSq - axial*axial, 0.0f));
+
+	// Distance from the sphere center to the cone surface, behind and beyond the cone.
+	const float distToCone = cosAngle*radial - axial*sinAngle;
+	if (distToCone > sphere.w)
+		return false;
+	if (axial > sphere.w + range || axial < -sphere.w)
+		return false;
+
+	return true;
+}
+
+XMUINT4 LightClusterGrid::Dims()const
+{
+	return XMUINT4(TilesX, TilesY, SlicesZ, mPointCount);
+}
+
+void LightClusterGrid::SetLists(const Light* lights, std::uint32_t lightCount, std::uint32_t pointCount,
+	const XMUINT2* ranges, const std::uint32_t* indices, std::uint32_t indexCount)
+{
+	mLights.assign(lights, lights + lightCount);
+	mPointCount = pointCount;
+	mRanges.assign(ranges, ranges + ClusterCount);
+	mIndices.assign(indices, indices + indexCount);
+	mOverflowCount = 0;
+}
@@ -0,0 +1,111 @@
+//***************************************************************************************
+// LightClusters.h
+//
+// CPU clustered light culling.  The view frustum is split into TilesX x TilesY screen
+// tiles and SlicesZ exponentially spaced depth slices.  Every frame the point and spot
+// lights are moved to view space and tested against the cluster bounds, producing a
+// compact light list, an (offset, count) range per cluster and a flat light index list
+// that the pixel shader walks (see ComputeClusteredLighting in LightingUtil.hlsl).
+//
+// Point light spheres are tested four lights at a time against each cluster AABB with
+// DirectXMath vectors; spot lights that pass are refined with a cone test.  Rows of
+// clusters are binned in parallel.
+//***************************************************************************************
+
+#pragma once
+
+#include "../../Common/ShadingTypes.h"
+#include <cstdint>
+#include <vector>
+
+class LightClusterGrid
+{
+public:
+	static const std::uint32_t TilesX = 16;
+	static const std::uint32_t TilesY = 9;
+	static const std::uint32_t SlicesZ = 24;
+	static const std::uint32_t ClusterCount = TilesX*TilesY*SlicesZ;
+
+	// Capacities of the per-frame upload buffers.  Lights past MaxClusterLights are ignored and
+	// cluster entries past MaxLightIndices are dropped (see OverflowCount).
+	static const std::uint32_t MaxClusterLights = 4096;
+	static const std::uint32_t MaxLightIndices = ClusterCount*64;
+
+	LightClusterGrid() = default;
+	LightClusterGrid(const LightClusterGrid& rhs) = delete;
+	LightClusterGrid& operator=(const LightClusterGrid& rhs) = delete;
+	~LightClusterGrid() = default;
+
+	// Rebuilds the view-space cluster bounds.  Call when the projection changes.
+	void SetProjection(float fovY, float aspect, float nearZ, float farZ);
+
+	// Bins the lights into the clusters for the given view matrix.  Lights() holds the
+	// point lights followed by the spot lights.  A spot light's cone ends where
+	// cos^SpotPower drops below 1/256.
+	void Build(DirectX::FXMMATRIX view,
+		const Light* pointLights, std::uint32_t pointCount,
+		const Light* spotLights, std::uint32_t spotCount);
+
+	const std::vector<Light>& Lights()const { return mLights; }
+	std::uint32_t PointLightCount()const { return mPointCount; }
+
+	// Per cluster (offset, count) into LightIndices(), indexed by (z*TilesY + y)*TilesX + x
+	// with tile (0, 0) in the top left corner of the screen.
+	const std::vector<DirectX::XMUINT2>& ClusterRanges()const { return mRanges; }
+	const std::vector<std::uint32_t>& LightIndices()const { return mIndices; }
+
+	// (TilesX, TilesY, SlicesZ, point light count) for the pass constants.
+	DirectX::XMUINT4 Dims()const;
+
+	// slice = log(viewZ)*x - y.
+	DirectX::XMFLOAT4 ZParams()const { return mZParams; }
+
+	// Replaces the lists with ones built elsewhere, e.g. by a captured frame (see
+	// FrameTrace), for the software rasterizer to read.
+	void SetLists(const Light* lights, std::uint32_t lightCount, std::uint32_t pointCount,
+		const DirectX::XMUINT2* ranges, const std::uint32_t* indices, std::uint32_t indexCount);
+
+	// Cluster entries dropped by the last Build because the index list was full.
+	std::uint32_t OverflowCount()const { return mOverflowCount; }
+
+private:
+	// View-space light data in SoA layout, padded to a multiple of four.
+	struct LightSoA
+	{
+		std::vector<float> X, Y, Z, Radius;
+
+		void Resize(size_t count);
+	};
+
+	// Appends the lights of candidates that touch the clusters of row (slice, y).
+	void BinRow(std::uint32_t slice, std::uint32_t y, const std::vector<std::uint32_t>& candidates,
+		LightSoA& scratch, std::vector<std::uint32_t>& out, std::uint32_t* counts)const;
+
+	bool ConeIntersects(std::uint32_t light, const DirectX::XMFLOAT4& sphere)const;
+
+private:
+	DirectX::XMFLOAT4 mZParams = { 0.0f, 0.0f, 0.0f, 0.0f };
+	std::vector<float> mSliceDepths;
+
+	// Cluster bounds in view space.
+	std::vector<DirectX::XMFLOAT3> mClusterMin;
+	std::vector<DirectX::XMFLOAT3> mClusterMax;
+	std::vector<DirectX::XMFLOAT4> mClusterSpheres;
+
+	std::vector<Light> mLights;
+	std::uint32_t mPointCount = 0;
+
+	LightSoA mViewLights;
+	std::vector<DirectX::XMFLOAT3> mViewSpotDirs;
+	std::vector<float> mSpotCosSin;
+
+	std::vector<DirectX::XMUINT2> mRanges;
+	std::vector<std::uint32_t> mIndices;
+	std::uint32_t mOverflowCount = 0;
+
+	// Per (slice, y) row scratch, kept between frames to avoid reallocating.
+	std::vector<std::vector<std::uint32_t>> mRowCandidates;
+	std::vector<std::vector<std::uint32_t>> mRowIndices;
+	std::vector<LightSoA> mRowScratch;
+	std::vector<std::uint32_t> mClusterCounts;
+};
@@ -0,0 +1,201 @@
+//***************************************************************************************
+// LightingUtil.h
+//
+// CPU port of Shaders/LightingUtil.hlsl, used by the light baker and CPU reference
+// renderers.  Every function mirrors its HLSL namesake; keep the two files in sync.
+//***************************************************************************************
+
+#pragma once
+
+#include "../../Common/ShadingTypes.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace LightingUtil
+{
+	// The shader's Material struct (named differently to avoid clashing with ::Material).
+	struct SurfaceMaterial
+	{
+		DirectX::XMFLOAT4 DiffuseAlbedo = { 1.0f, 1.0f, 1.0f, 1.0f };
+		DirectX::XMFLOAT3 FresnelR0 = { 0.01f, 0.01f, 0.01f };
+		float Shininess = 0.75f;
+	};
+
+	inline float CalcAttenuation(float d, float falloffStart, float falloffEnd)
+	{
+		// Linear falloff.
+		float att = (falloffEnd - d) / (falloffEnd - falloffStart);
+		return att < 0.0f ? 0.0f : (att > 1.0f ? 1.0f : att);
+	}
+
+	// Schlick gives an approximation to Fresnel reflectance (see pg. 233 "Real-Time Rendering 3rd Ed.").
+	inline DirectX::XMVECTOR XM_CALLCONV SchlickFresnel(DirectX::FXMVECTOR R0, DirectX::FXMVECTOR normal, DirectX::FXMVECTOR lightVec)
+	{
+		using namespace DirectX;
+
+		float cosIncidentAngle = XMVectorGetX(XMVectorSaturate(XMVector3Dot(normal, lightVec)));
+
+		float f0 = 1.0f - cosIncidentAngle;
+		return XMVectorAdd(R0, XMVectorScale(XMVectorSubtract(XMVectorSplatOne(), R0), f0*f0*f0*f0*f0));
+	}
+
+	inline DirectX::XMVECTOR XM_CALLCONV BlinnPhong(DirectX::FXMVECTOR lightStrength, DirectX::FXMVECTOR lightVec,
+		DirectX::FXMVECTOR normal, DirectX::GXMVECTOR toEye, const SurfaceMaterial& mat)
+	{
+		using namespace DirectX;
+
+		const float m = mat.Shininess * 256.0f;
+		XMVECTOR halfVec = XMVector3Normalize(XMVectorAdd(toEye, lightVec));
+
+		float nDotH = std::max(XMVectorGetX(XMVector3Dot(halfVec, normal)), 0.0f);
+		float roughnessFactor = (m + 8.0f)*std::pow(nDotH, m) / 8.0f;
+		XMVECTOR fresnelFactor = SchlickFresnel(XMLoadFloat3(&mat.FresnelR0), halfVec, lightVec);
+
+		XMVECTOR specAlbedo = XMVectorScale(fresnelFactor, roughnessFactor);
+
+		// Our spec formula goes outside [0,1] range, but we are
+		// doing LDR rendering.  So scale it down a bit.
+		specAlbedo = XMVectorDivide(specAlbedo, XMVectorAdd(specAlbedo, XMVectorSplatOne()));
+
+		return XMVectorMultiply(XMVectorAdd(XMLoadFloat4(&mat.DiffuseAlbedo), specAlbedo), lightStrength);
+	}
+
+	inline DirectX::XMVECTOR XM_CALLCONV ComputeDirectionalLight(const Light& L, const SurfaceMaterial& mat,
+		DirectX::FXMVECTOR normal, DirectX::FXMVECTOR toEye)
+	{
+		using namespace DirectX;
+
+		// The light vector aims opposite the direction the light rays travel.
+		XMVECTOR lightVec = XMVectorNegate(XMLoadFloat3(&L.Direction));
+
+		// Scale light down by Lambert's cosine law.
+		float ndotl = std::max(XMVectorGetX(XMVector3Dot(lightVec, normal)), 0.0f);
+		XMVECTOR lightStrength = XMVectorScale(XMLoadFloat3(&L.Strength), ndotl);
+
+		return BlinnPhong(lightStrength, lightVec, normal, toEye, mat);
+	}
+
+	inline DirectX::XMVECTOR XM_CALLCONV ComputePointLight(const Light& L, const SurfaceMaterial& mat,
+		DirectX::FXMVECTOR pos, DirectX::FXMVECTOR normal, DirectX::FXMVECTOR toEye)
+	{
+		using namespace DirectX;
+
+		// The vector from the surface to the light.
+		XMVECTOR lightVec = XMVectorSubtract(XMLoadFloat3(&L.Position), pos);
+
+		// The distance from surface to light.
+		float d = XMVectorGetX(XMVector3Length(lightVec));
+
+		// Range test.
+		if (d > L.FalloffEnd)
+			return XMVectorZero();
+
+		// Normalize the light vector.
+		lightVec = XMVectorScale(lightVec, 1.0f / d);
+
+		// Scale light down by Lambert's cosine law.
+		float ndotl = std::max(XMVectorGetX(XMVector3Dot(lightVec, normal)), 0.0f);
+
+		// Attenuate light by distance.
+		float att = CalcAttenuation(d, L.FalloffStart, L.FalloffEnd);
+		XMVECTOR lightStrength = XMVectorScale(XMLoadFloat3(&L.Strength), ndotl*att);
+
+		return BlinnPhong(lightStrength, lightVec, normal, toEye, mat);
+	}
+
+	inline DirectX::XMVECTOR XM_CALLCONV ComputeSpotLight(const Light& L, const SurfaceMaterial& mat,
+		DirectX::FXMVECTOR pos, DirectX::FXMVECTOR normal, DirectX::FXMVECTOR toEye)
+	{
+		using namespace DirectX;
+
+		// The vector from the surface to the light.
+		XMVECTOR lightVec = XMVectorSubtract(XMLoadFloat3(&L.Position), pos);
+
+		// The distance from surface to light.
+		float d = XMVectorGetX(XMVector3Length(lightVec));
+
+		// Range test.
+		if (d > L.FalloffEnd)
+			return XMVectorZero();
+
+		// Normalize the light vector.
+		lightVec = XMVectorScale(lightVec, 1.0f / d);
+
+		// Scale light down by Lambert's cosine law.
+		float ndotl = std::max(XMVectorGetX(XMVector3Dot(lightVec, normal)), 0.0f);
+
+		// Attenuate light by distance.
+		float att = CalcAttenuation(d, L.FalloffStart, L.FalloffEnd);
+
+		// Scale by spotlight
+		float spotDot = std::max(-XMVectorGetX(XMVector3Dot(lightVec, XMLoadFloat3(&L.Direction))), 0.0f);
+		float spotFactor = std::pow(spotDot, L.SpotPower);
+
+		XMVECTOR lightStrength = XMVectorScale(XMLoadFloat3(&L.Strength), ndotl*att*spotFactor);
+
+		return BlinnPhong(lightStrength, lightVec, normal, toEye, mat);
+	}
+
+	// lights holds numDirLights directional lights, then numPointLights point lights, then
+	// numSpotLights spot lights, matching the NUM_*_LIGHTS layout of the shaders.
+	// shadowFactor has one entry per directional light and may be null.
+	inline DirectX::XMVECTOR XM_CALLCONV ComputeLighting(const Light* lights,
+		int numDirLights, int numPointLights, int numSpotLights,
+		const SurfaceMaterial& mat, DirectX::FXMVECTOR pos, DirectX::FXMVECTOR normal, DirectX::FXMVECTOR toEye,
+		const float* shadowFactor)
+	{
+		using namespace DirectX;
+
+		XMVECTOR result = XMVectorZero();
+
+		int i = 0;
+		for (; i < numDirLights; ++i)
+		{
+			float shadow = shadowFactor != nullptr ? shadowFactor[i] : 1.0f;
+			result = XMVectorAdd(result, XMVectorScale(ComputeDirectionalLight(lights[i], mat, normal, toEye), shadow));
+		}
+
+		for (; i < numDirLights + numPointLights; ++i)
+			result = XMVectorAdd(result, ComputePointLight(lights[i], mat, pos, normal, toEye));
+
+		for (; i < numDirLights + numPointLights + numSpotLights; ++i)
+			result = XMVectorAdd(result, ComputeSpotLight(lights[i], mat, pos, normal, toEye));
+
+		return XMVectorSetW(result, 0.0f);
+	}
+
+	// Point and spot lights binned into the cluster of screen position (screenU, screenV)
+	// in [0,1] at view depth viewZ.  The arguments mirror the cluster shader resources
+	// and pass constants (see LightClusters.h).
+	inline DirectX::XMVECTOR XM_CALLCONV ComputeClusteredLighting(const Light* lights,
+		const DirectX::XMUINT2* clusterRanges, const std::uint32_t* lightIndices,
+		const DirectX::XMUINT4& clusterDims, const DirectX::XMFLOAT4& clusterZParams,
+		float screenU, float screenV, float viewZ, const SurfaceMaterial& mat,
+		DirectX::FXMVECTOR pos, DirectX::FXMVECTOR normal, DirectX::FXMVECTOR toEye)
+	{
+		using namespace DirectX;
+
+		if (clusterDims.x == 0 || clusterDims.y == 0 || clusterDims.z == 0 || viewZ <= 0.0f)
+			return XMVectorZero();
+
+		std::uint32_t cx = std::min((std::uint32_t)std::max(screenU*clusterDims.x, 0.0f), clusterDims.x - 1);
+		std::uint32_t cy = std::min((std::uint32_t)std::max(screenV*clusterDims.y, 0.0f), clusterDims.y - 1);
+		float slice = std::log(viewZ)*clusterZParams.x - clusterZParams.y;
+		std::uint32_t cz = (std::uint32_t)std::min(std::max(slice, 0.0f), clusterDims.z - 1.0f);
+
+		const XMUINT2& range = clusterRanges[(cz*clusterDims.y + cy)*clusterDims.x + cx];
+
+		XMVECTOR result = XMVectorZero();
+		for (std::uint32_t i = 0; i < range.y; ++i)
+		{
+			std::uint32_t index = lightIndices[range.x + i];
+			if (index < clusterDims.w)
+				result = XMVectorAdd(result, ComputePointLight(lights[index], mat, pos, normal, toEye));
+			else
+				result = XMVectorAdd(result, ComputeSpotLight(lights[index], mat, pos, normal, toEye));
+		}
+
+		return XMVectorSetW(result, 0.0f);
+	}
+}
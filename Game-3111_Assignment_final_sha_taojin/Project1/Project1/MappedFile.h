@@ -0,0 +1,39 @@
+//***************************************************************************************
+// MappedFile.h
+//
+// Read-only memory mapped view of a file.  Loaders use this instead of streaming the
+// file through an ifstream so large assets are paged in by the OS on demand.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	explicit MappedFile(const std::wstring& filename);
+	MappedFile(const MappedFile& rhs) = delete;
+	MappedFile& operator=(const MappedFile& rhs) = delete;
+	~MappedFile();
+
+	// Maps the whole file.  Returns false if the file could not be opened or is empty.
+	bool Open(const std::wstring& filename);
+	void Close();
+
+	bool IsOpen()const { return mData != nullptr; }
+	const std::uint8_t* Data()const { return mData; }
+	std::size_t Size()const { return mSize; }
+
+private:
+	const std::uint8_t* mData = nullptr;
+	std::size_t mSize = 0;
+
+#if defined(_WIN32)
+	void* mFile = nullptr;
+	void* mMapping = nullptr;
+#endif
+};
@@ -0,0 +1,350 @@
+#include "MemoryArena.h"
+#include <algorithm>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace
+{
+	// Normal pages are committed in steps of this size as an arena grows.
+	const std::size_t CommitGranularity = 256 * 1024;
+
+	std::size_t AlignUp(std::size_t value, std::size_t alignment)
+	{
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+
+	// Live arenas, for SnapshotAll.
+	std::mutex gArenaListLock;
+	MemoryArena* gArenaList = nullptr;
+
+#if defined(_WIN32)
+	// Large pages need SeLockMemoryPrivilege enabled in the process token.  Returns the
+	// large page size, or 0 if they are unavailable.
+	std::size_t EnableLargePages()
+	{
+		static const std::size_t pageSize = []() -> std::size_t
+		{
+			const std::size_t minimum = GetLargePageMinimum();
+			if (minimum == 0)
+				return 0;
+
+			HANDLE token = nullptr;
+			if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token))
+				return 0;
+
+			TOKEN_PRIVILEGES privileges = {};
+			privileges.PrivilegeCount = 1;
+			privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+			bool enabled = LookupPrivilegeValueW(nullptr, SE_LOCK_MEMORY_NAME, &privileges.Privileges[0].Luid) &&
+				AdjustTokenPrivileges(token, FALSE, &privileges, 0, nullptr, nullptr) &&
+				GetLastError() == ERROR_SUCCESS;
+			CloseHandle(token);
+
+			return enabled ? minimum : 0;
+		}();
+		return pageSize;
+	}
+#else
+	const std::size_t HugePageSize = 2 * 1024 * 1024;
+#endif
+}
+
+MemoryArena::MemoryArena(const char* name, std::size_t capacity, unsigned flags)
+{
+	Create(name, capacity, flags);
+}
+
+MemoryArena::~MemoryArena()
+{
+	Release();
+}
+
+bool MemoryArena::Create(const char* name, std::size_t capacity, unsigned flags)
+{
+	Release();
+
+	if (capacity == 0)
+		return false;
+
+	std::uint8_t* base = nullptr;
+	bool largePages = false;
+
+#if defined(_WIN32)
+	// Large pages cannot be committed on demand, so the whole arena is committed now.
+	// Only worth it for arenas of at least one large page.
+	const std::size_t largePageSize = (flags & LargePages) ? EnableLargePages() : 0;
+	if (largePageSize != 0 && capacity >= largePageSize)
+	{
+		capacity = AlignUp(capacity, largePageSize);
+		base = static_cast<std::uint8_t*>(VirtualAlloc(nullptr, capacity,
+			MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE));
+		largePages = base != nullptr;
+	}
+
+	if (base == nullptr)
+	{
+		capacity = AlignUp(capacity, CommitGranularity);
+		base = static_cast<std::uint8_t*>(VirtualAlloc(nullptr, capacity, MEM_RESERVE, PAGE_READWRITE));
+		if (base == nullptr)
+			return false;
+	}
+
+	mCommitted = largePages ? capacity : 0;
+#else
+	// Linux commits anonymous pages on first touch, so reserving is all there is to do.
+	if ((flags & LargePages) && capacity >= HugePageSize)
+	{
+		capacity = AlignUp(capacity, HugePageSize);
+		void* p = MAP_FAILED;
+
+#if defined(MAP_HUGETLB)
+		// Preallocated huge pages (vm.nr_hugepages), if the pool has enough left.  Without
+		// MAP_NORESERVE the pages are reserved now, so touching them cannot fault later.
+		p = mmap(nullptr, capacity, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (p != MAP_FAILED)
+		{
+			base = static_cast<std::uint8_t*>(p);
+			largePages = true;
+		}
+#endif
+
+#if defined(MADV_HUGEPAGE)
+		// Otherwise ask for transparent huge pages on a 2 MB aligned range.
+		if (base == nullptr)
+		{
+			const std::size_t padded = capacity + HugePageSize;
+			p = mmap(nullptr, padded, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+			if (p != MAP_FAILED)
+			{
+				std::uint8_t* start = static_cast<std::uint8_t*>(p);
+				std::uint8_t* aligned = reinterpret_cast<std::uint8_t*>(
+					AlignUp(reinterpret_cast<std::size_t>(start), HugePageSize));
+				if (aligned != start)
+					munmap(start, aligned - start);
+				const std::size_t tail = (start + padded) - (aligned + capacity);
+				if (tail != 0)
+					munmap(aligned + capacity, tail);
+
+				base = aligned;
+				largePages = madvise(base, capacity, MADV_HUGEPAGE) == 0;
+			}
+		}
+#endif
+	}
+
+	if (base == nullptr)
+	{
+		void* p = mmap(nullptr, capacity, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if (p == MAP_FAILED)
+			return false;
+		base = static_cast<std::uint8_t*>(p);
+	}
+
+	mCommitted = capacity;
+#endif
+
+	mName = name;
+	mBase = base;
+	mCapacity = capacity;
+	mUsed = 0;
+	mHighWaterMark = 0;
+	mLargePages = largePages;
+
+	std::lock_guard<std::mutex> lock(gArenaListLock);
+	mNextArena = gArenaList;
+	if (gArenaList != nullptr)
+		gArenaList->mPrevArena = this;
+	gArenaList = this;
+
+	return true;
+}
+
+void MemoryArena::Release()
+{
+	if (mBase == nullptr)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(gArenaListLock);
+		if (mPrevArena != nullptr)
+			mPrevArena->mNextArena = mNextArena;
+		else
+			gArenaList = mNextArena;
+		if (mNextArena != nullptr)
+			mNextArena->mPrevArena = mPrevArena;
+		mPrevArena = nullptr;
+		mNextArena = nullptr;
+	}
+
+#if defined(_WIN32)
+	VirtualFree(mBase, 0, MEM_RELEASE);
+#else
+	munmap(mBase, mCapacity);
+#endif
+
+	mBase = nullptr;
+	mCapacity = 0;
+	mCommitted = 0;
+	mUsed = 0;
+	mLargePages = false;
+}
+
+void* MemoryArena::Allocate(std::size_t size, std::size_t alignment)
+{
+	const std::size_t offset = AlignUp(mUsed, alignment);
+	if (offset > mCapacity || size > mCapacity - offset)
+		return nullptr;
+
+	const std::size_t end = offset + size;
+	if (end > mCommitted && !Commit(end))
+		return nullptr;
+
+	mUsed = end;
+	mHighWaterMark = std::max(mHighWaterMark, mUsed);
+	return mBase + offset;
+}
+
+bool MemoryArena::Commit(std::size_t end)
+{
+#if defined(_WIN32)
+	const std::size_t committed = std::min(AlignUp(end, CommitGranularity), mCapacity);
+	if (VirtualAlloc(mBase + mCommitted, committed - mCommitted, MEM_COMMIT, PAGE_READWRITE) == nullptr)
+		return false;
+	mCommitted = committed;
+	return true;
+#else
+	// Pages are committed on first touch.
+	(void)end;
+	return true;
+#endif
+}
+
+MemoryArenaStats MemoryArena::Stats()const
+{
+	MemoryArenaStats stats;
+	stats.Name = mName;
+	stats.Capacity = mCapacity;
+	stats.Used = mUsed;
+	stats.HighWaterMark = mHighWaterMark;
+	stats.LargePages = mLargePages;
+	return stats;
+}
+
+int MemoryArena::SnapshotAll(MemoryArenaStats* stats, int maxCount)
+{
+	std::lock_guard<std::mutex> lock(gArenaListLock);
+
+	int count = 0;
+	for (const MemoryArena* arena = gArenaList; arena != nullptr; arena = arena->mNextArena)
+	{
+		if (count < maxCount)
+			stats[count] = arena->Stats();
+		++count;
+	}
+	return count;
+}
+
+std::string MemoryArena::ReportAll()
+{
+	std::vector<MemoryArenaStats> stats(64);
+	int count = SnapshotAll(stats.data(), (int)stats.size());
+	if (count > (int)stats.size())
+	{
+		stats.resize(count);
+		count = std::min(SnapshotAll(stats.data(), count), count);
+	}
+
+	// Arenas with the same name (the frame arenas) are summed into one line.
+	std::vector<MemoryArenaStats> merged;
+	std::vector<int> instances;
+	for (int i = 0; i < count; ++i)
+	{
+		size_t j = 0;
+		while (j < merged.size() && std::string(merged[j].Name) != stats[i].Name)
+			++j;
+		if (j == merged.size())
+		{
+			merged.push_back(stats[i]);
+			instances.push_back(1);
+			continue;
+		}
+		merged[j].Capacity += stats[i].Capacity;
+		merged[j].Used += stats[i].Used;
+		merged[j].HighWaterMark += stats[i].HighWaterMark;
+		merged[j].LargePages = merged[j].LargePages && stats[i].LargePages;
+		++instances[j];
+	}
+
+	const double MiB = 1.0 / (1024.0 * 1024.0);
+	char line[256];
+	std::string report;
+	for (size_t i = 0; i < merged.size(); ++i)
+	{
+		std::snprintf(line, sizeof(line), "  arena %-16s x%-3d %9.2f MiB reserved %9.2f MiB used %9.2f MiB peak%s\n",
+			merged[i].Name, instances[i], merged[i].Capacity * MiB, merged[i].Used * MiB,
+			merged[i].HighWaterMark * MiB, merged[i].LargePages ? "  (large pages)" : "");
+		report += line;
+	}
+	return report;
+}
+
+namespace
+{
+	// Frame arenas outlive their threads: a thread that exits hands its arena back and
+	// the next new thread reuses it, so short-lived workers do not pile up arenas.
+	std::mutex gFrameArenaLock;
+	std::vector<MemoryArena*> gFrameArenas;
+	std::vector<MemoryArena*> gFreeFrameArenas;
+
+	struct FrameArenaOwner
+	{
+		MemoryArena* Arena = nullptr;
+
+		~FrameArenaOwner()
+		{
+			if (Arena == nullptr)
+				return;
+			std::lock_guard<std::mutex> lock(gFrameArenaLock);
+			Arena->Reset();
+			gFreeFrameArenas.push_back(Arena);
+		}
+	};
+
+	thread_local FrameArenaOwner tFrameArena;
+}
+
+MemoryArena& ThreadFrameArena()
+{
+	if (tFrameArena.Arena == nullptr)
+	{
+		std::lock_guard<std::mutex> lock(gFrameArenaLock);
+		if (!gFreeFrameArenas.empty())
+		{
+			tFrameArena.Arena = gFreeFrameArenas.back();
+			gFreeFrameArenas.pop_back();
+		}
+		else
+		{
+			tFrameArena.Arena = new MemoryArena("frame", FrameArenaCapacity);
+			gFrameArenas.push_back(tFrameArena.Arena);
+		}
+	}
+	return *tFrameArena.Arena;
+}
+
+void ResetFrameArenas()
+{
+	std::lock_guard<std::mutex> lock(gFrameArenaLock);
+	for (MemoryArena* arena : gFrameArenas)
+		arena->Reset();
+}
@@ -0,0 +1,115 @@
+//***************************************************************************************
+// MemoryArena.h
+//
+// Bump-pointer arenas.  A MemoryArena reserves its whole capacity up front and hands out
+// memory by advancing an offset; nothing is freed individually, Reset releases everything
+// at once.  Long-lived subsystems (the waves grid, mesh building) own an arena sized for
+// their data and may ask for large pages (2 MB on x64) to cut TLB misses on big arrays.
+//
+// Every thread also has a frame arena for data that only lives until the frame ends
+// (draw lists, sort keys, query results).  ResetFrameArenas rewinds all of them.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <string>
+#include <type_traits>
+
+struct MemoryArenaStats
+{
+	const char* Name = "";
+	std::size_t Capacity = 0;
+	std::size_t Used = 0;
+	std::size_t HighWaterMark = 0;
+	bool LargePages = false;
+};
+
+class MemoryArena
+{
+public:
+	enum Flags : unsigned
+	{
+		None = 0,
+
+		// Back the arena with large pages if the OS grants them: MEM_LARGE_PAGES on Windows
+		// (needs the "Lock pages in memory" privilege), MAP_HUGETLB or else transparent huge
+		// pages through madvise on Linux.  Falls back to normal pages silently.
+		LargePages = 1,
+	};
+
+	MemoryArena() = default;
+	MemoryArena(const char* name, std::size_t capacity, unsigned flags = None);
+	MemoryArena(const MemoryArena& rhs) = delete;
+	MemoryArena& operator=(const MemoryArena& rhs) = delete;
+	~MemoryArena();
+
+	// Reserves capacity bytes of address space; normal pages are committed as the arena
+	// grows.  name must stay valid (a string literal).  Returns false if the address
+	// space could not be reserved.
+	bool Create(const char* name, std::size_t capacity, unsigned flags = None);
+	void Release();
+
+	// Returns nullptr if the arena is full.  alignment must be a power of two.
+	void* Allocate(std::size_t size, std::size_t alignment = alignof(std::max_align_t));
+
+	// Value-initialized array of count Ts, or nullptr if the arena is full.  The arena
+	// never runs destructors, so T must be trivially destructible.
+	template<typename T>
+	T* AllocateArray(std::size_t count)
+	{
+		static_assert(std::is_trivially_destructible<T>::value, "arena memory is never destroyed");
+		void* p = Allocate(count * sizeof(T), alignof(T));
+		if (p == nullptr)
+			return nullptr;
+		T* items = static_cast<T*>(p);
+		for (std::size_t i = 0; i < count; ++i)
+			new (&items[i]) T();
+		return items;
+	}
+
+	// Releases every allocation; the pages stay committed for reuse.
+	void Reset() { mUsed = 0; }
+
+	const char* Name()const { return mName; }
+	std::size_t Capacity()const { return mCapacity; }
+	std::size_t Used()const { return mUsed; }
+	std::size_t HighWaterMark()const { return mHighWaterMark; }
+	bool UsesLargePages()const { return mLargePages; }
+	MemoryArenaStats Stats()const;
+
+	// Stats of every arena alive in the process, frame arenas included.  Returns the
+	// number of arenas; at most maxCount are written.
+	static int SnapshotAll(MemoryArenaStats* stats, int maxCount);
+
+	// One line per arena: name, capacity, current use and high-water mark.
+	static std::string ReportAll();
+
+private:
+	bool Commit(std::size_t end);
+
+	const char* mName = "";
+	std::uint8_t* mBase = nullptr;
+	std::size_t mCapacity = 0;
+	std::size_t mCommitted = 0;
+	std::size_t mUsed = 0;
+	std::size_t mHighWaterMark = 0;
+	bool mLargePages = false;
+
+	// Links in the list of live arenas SnapshotAll walks.
+	MemoryArena* mPrevArena = nullptr;
+	MemoryArena* mNextArena = nullptr;
+};
+
+// Address space each thread's frame arena reserves; pages are committed on first use.
+const std::size_t FrameArenaCapacity = 64 * 1024 * 1024;
+
+// The calling thread's frame arena, created on first use.  Only the owning thread may
+// allocate from it.
+MemoryArena& ThreadFrameArena();
+
+// Rewinds the frame arena of every thread.  Call once per frame after all work that
+// allocated from them is done, e.g. at the end of Draw.
+void ResetFrameArenas();
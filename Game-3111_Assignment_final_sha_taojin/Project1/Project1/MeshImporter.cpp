@@ -0,0 +1,1807 @@
+#include "MeshImporter.h"
+#include "MappedFile.h"
+#include "ParallelFor.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <cwctype>
+#include <memory>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define MESH_IMPORTER_SSE2 1
+#else
+#define MESH_IMPORTER_SSE2 0
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+using namespace DirectX;
+
+namespace
+{
+	// OBJ text per parse task; a chunk ends at the first line break past this size.
+	const std::size_t ObjChunkBytes = 256 * 1024;
+
+	// Elements per task of the parallel passes over corners and vertices.
+	const int Grain = 16384;
+
+	const double DoublePowersOfTen[] =
+	{
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+
+	const std::uint64_t IntegerPowersOfTen[] =
+	{
+		1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull,
+		100000000ull, 1000000000ull, 10000000000ull, 100000000000ull, 1000000000000ull,
+		10000000000000ull, 100000000000000ull, 1000000000000000ull, 10000000000000000ull,
+		100000000000000000ull, 1000000000000000000ull, 10000000000000000000ull
+	};
+
+	// Digits a uint64 always holds.
+	const int MaxKeptDigits = 19;
+
+	bool IsDigit(char c)
+	{
+		return c >= '0' && c <= '9';
+	}
+
+	bool IsBlank(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	// The whole mapped input.  Vector loads may read past the current line as long as
+	// they stay inside it.
+	struct TextRange
+	{
+		const char* Begin;
+		const char* End;
+	};
+
+#if MESH_IMPORTER_SSE2
+	unsigned CountTrailingZeros(unsigned mask)
+	{
+#if defined(_MSC_VER)
+		unsigned long index;
+		_BitScanForward(&index, mask);
+		return (unsigned)index;
+#else
+		return (unsigned)__builtin_ctz(mask);
+#endif
+	}
+
+	// Value of the last count bytes of the 16 at p, which are digits.  The bytes before
+	// them are masked off, so the sixteen lanes weigh as a zero-padded 16-digit number:
+	// digit pairs, then quads, then two halves of eight, each a multiply-add.
+	std::uint64_t DigitsValueSse2(const char* p, int count)
+	{
+		static const std::int8_t window[32] =
+		{
+			0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+			-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+		};
+		const __m128i keep = _mm_loadu_si128(reinterpret_cast<const __m128i*>(window + count));
+		const __m128i digits = _mm_and_si128(keep,
+			_mm_sub_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), _mm_set1_epi8('0')));
+
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i tens = _mm_set_epi16(1, 10, 1, 10, 1, 10, 1, 10);
+		const __m128i pairs = _mm_packs_epi32(
+			_mm_madd_epi16(_mm_unpacklo_epi8(digits, zero), tens),
+			_mm_madd_epi16(_mm_unpackhi_epi8(digits, zero), tens));
+
+		__m128i quads = _mm_madd_epi16(pairs, _mm_set_epi16(1, 100, 1, 100, 1, 100, 1, 100));
+		quads = _mm_packs_epi32(quads, quads);
+
+		const __m128i halves = _mm_madd_epi16(quads, _mm_set_epi16(1, 10000, 1, 10000, 1, 10000, 1, 10000));
+		const std::uint32_t high = (std::uint32_t)_mm_cvtsi128_si32(halves);
+		const std::uint32_t low = (std::uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(halves, 4));
+		return (std::uint64_t)high*100000000ull + low;
+	}
+#endif
+
+	// Reads the run of decimal digits at p, keeping the first MaxKeptDigits of them in
+	// value.  Returns the length of the run; kept is how many digits value holds.
+	int ReadDigits(const char* p, const char* lineEnd, const TextRange& text, std::uint64_t& value, int& kept)
+	{
+#if MESH_IMPORTER_SSE2
+		// A run shorter than 16 found in one load is re-read so it ends at the top of
+		// the register.  Needs 16 readable bytes each way, which all but the first and
+		// last few numbers of a file have.
+		if (text.End - p >= 16)
+		{
+			const __m128i digits = _mm_sub_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), _mm_set1_epi8('0'));
+			const __m128i isDigit = _mm_cmpeq_epi8(_mm_min_epu8(digits, _mm_set1_epi8(9)), digits);
+			const int count = (int)CountTrailingZeros(~(unsigned)_mm_movemask_epi8(isDigit));
+			if (count < 16 && p - text.Begin >= 16 - count)
+			{
+				value = count > 0 ? DigitsValueSse2(p + count - 16, count) : 0;
+				kept = count;
+				return count;
+			}
+		}
+#else
+		(void)text;
+#endif
+
+		int count = 0;
+		value = 0;
+		kept = 0;
+		for (; p + count < lineEnd && IsDigit(p[count]); ++count)
+		{
+			if (kept < MaxKeptDigits)
+			{
+				value = value*10 + (std::uint64_t)(p[count] - '0');
+				++kept;
+			}
+		}
+		return count;
+	}
+
+	double ScaleByPowerOfTen(double value, int exponent)
+	{
+		if (exponent == 0 || value == 0.0)
+			return value;
+		if (exponent > 0 && exponent <= 22)
+			return value*DoublePowersOfTen[exponent];
+		if (exponent < 0 && exponent >= -22)
+			return value / DoublePowersOfTen[-exponent];
+		return value*std::pow(10.0, exponent);
+	}
+
+	// [+-]digits[.digits][(e|E)[+-]digits], advancing p past it.  Up to 19 significant
+	// digits are combined into one integer and scaled by an exact power of ten, so the
+	// float is within an ulp of the correctly rounded value.
+	bool ReadFloat(const char*& p, const char* lineEnd, const TextRange& text, float& out)
+	{
+		const char* q = p;
+		bool negative = false;
+		if (q < lineEnd && (*q == '-' || *q == '+'))
+			negative = *q++ == '-';
+
+		std::uint64_t whole = 0;
+		std::uint64_t fraction = 0;
+		int wholeKept = 0;
+		int fractionKept = 0;
+		int fractionDigits = 0;
+		const int wholeDigits = ReadDigits(q, lineEnd, text, whole, wholeKept);
+		q += wholeDigits;
+		if (q < lineEnd && *q == '.')
+		{
+			++q;
+			fractionDigits = ReadDigits(q, lineEnd, text, fraction, fractionKept);
+			q += fractionDigits;
+		}
+		if (wholeDigits + fractionDigits == 0)
+			return false;
+
+		int exponent = wholeDigits - wholeKept;
+		if (q < lineEnd && (*q == 'e' || *q == 'E'))
+		{
+			++q;
+			bool negativeExponent = false;
+			if (q < lineEnd && (*q == '-' || *q == '+'))
+				negativeExponent = *q++ == '-';
+
+			std::uint64_t e;
+			int eKept;
+			const int eDigits = ReadDigits(q, lineEnd, text, e, eKept);
+			if (eDigits == 0)
+				return false;
+			q += eDigits;
+			const int magnitude = eDigits > 4 ? 10000 : (int)e;
+			exponent += negativeExponent ? -magnitude : magnitude;
+		}
+
+		double value;
+		if (wholeKept + fractionKept <= MaxKeptDigits)
+		{
+			const std::uint64_t mantissa = whole*IntegerPowersOfTen[fractionKept] + fraction;
+			value = ScaleByPowerOfTen((double)mantissa, exponent - fractionKept);
+		}
+		else
+		{
+			value = ScaleByPowerOfTen((double)whole, exponent) +
+				ScaleByPowerOfTen((double)fraction, exponent - (wholeDigits - wholeKept) - fractionKept);
+		}
+
+		out = (float)(negative ? -value : value);
+		p = q;
+		return true;
+	}
+
+	bool ReadInt(const char*& p, const char* lineEnd, const TextRange& text, int& out)
+	{
+		const char* q = p;
+		bool negative = false;
+		if (q < lineEnd && (*q == '-' || *q == '+'))
+			negative = *q++ == '-';
+
+		std::uint64_t value;
+		int kept;
+		const int digits = ReadDigits(q, lineEnd, text, value, kept);
+		if (digits == 0 || digits > 9)
+			return false;
+
+		out = negative ? -(int)value : (int)value;
+		p = q + digits;
+		return true;
+	}
+
+	const char* SkipBlanks(const char* p, const char* lineEnd)
+	{
+		while (p < lineEnd && IsBlank(*p))
+			++p;
+		return p;
+	}
+
+	//
+	// OBJ
+	//
+
+	// Index of an attribute that a corner does not have.
+	const int MissingIndex = INT_MIN;
+
+	// Zero-based indices of a face corner.  Relative (negative) indices are resolved
+	// against the chunk's own counts while parsing and rebased once the counts of the
+	// earlier chunks are known; Relative has bit 0, 1, 2 set for P, T, N.
+	struct ObjCorner
+	{
+		int P;
+		int T;
+		int N;
+	};
+
+	// An o, g or usemtl line, at the first corner after it.
+	struct ObjNameEvent
+	{
+		int Corner;
+		bool Material;
+		std::string Name;
+	};
+
+	struct ObjChunk
+	{
+		const char* Begin = nullptr;
+		const char* End = nullptr;
+
+		std::vector<XMFLOAT3> Positions;
+		std::vector<XMFLOAT2> TexCoords;
+		std::vector<XMFLOAT3> Normals;
+
+		// Three per triangle; polygons are split into fans.
+		std::vector<ObjCorner> Corners;
+		std::vector<std::uint8_t> Relative;
+		bool AnyRelative = false;
+
+		std::vector<ObjNameEvent> Names;
+
+		int LineCount = 0;
+		const char* Error = nullptr;
+		int ErrorLine = 0;
+	};
+
+	std::string RestOfLine(const char* p, const char* lineEnd)
+	{
+		p = SkipBlanks(p, lineEnd);
+		const char* last = lineEnd;
+		while (last > p && IsBlank(last[-1]))
+			--last;
+		return std::string(p, last);
+	}
+
+	bool KeywordIs(const char* word, const char* wordEnd, const char* keyword)
+	{
+		const std::size_t length = std::strlen(keyword);
+		return (std::size_t)(wordEnd - word) == length && std::memcmp(word, keyword, length) == 0;
+	}
+
+	// Reads one v/vt/vn index of a face corner.
+	bool ReadCornerIndex(const char*& p, const char* lineEnd, const TextRange& text, int localCount,
+		int& index, std::uint8_t& relative, std::uint8_t bit)
+	{
+		int value;
+		if (!ReadInt(p, lineEnd, text, value) || value == 0)
+			return false;
+
+		if (value > 0)
+		{
+			index = value - 1;
+		}
+		else
+		{
+			index = localCount + value;
+			relative |= bit;
+		}
+		return true;
+	}
+
+	void ParseObjChunk(ObjChunk& chunk, const TextRange& text)
+	{
+		std::vector<ObjCorner> polygon;
+		std::vector<std::uint8_t> polygonRelative;
+
+		const char* p = chunk.Begin;
+		while (p < chunk.End)
+		{
+			++chunk.LineCount;
+			const char* lineEnd = static_cast<const char*>(std::memchr(p, '\n', chunk.End - p));
+			if (lineEnd == nullptr)
+				lineEnd = chunk.End;
+			const char* next = lineEnd < chunk.End ? lineEnd + 1 : chunk.End;
+
+			p = SkipBlanks(p, lineEnd);
+			const char* word = p;
+			while (p < lineEnd && !IsBlank(*p))
+				++p;
+
+			auto fail = [&](const char* message)
+			{
+				chunk.Error = message;
+				chunk.ErrorLine = chunk.LineCount;
+			};
+
+			auto readFloats = [&](int count, float* out)
+			{
+				for (int i = 0; i < count; ++i)
+				{
+					p = SkipBlanks(p, lineEnd);
+					if (!ReadFloat(p, lineEnd, text, out[i]))
+						return false;
+				}
+				return true;
+			};
+
+			if (word == p || *word == '#')
+			{
+			}
+			else if (KeywordIs(word, p, "v"))
+			{
+				// Extra values (w or vertex colors) are ignored.
+				XMFLOAT3 v;
+				if (!readFloats(3, &v.x))
+					return fail("v expects 3 numbers");
+				chunk.Positions.push_back(v);
+			}
+			else if (KeywordIs(word, p, "vt"))
+			{
+				XMFLOAT2 t;
+				if (!readFloats(1, &t.x))
+					return fail("vt expects a number");
+				p = SkipBlanks(p, lineEnd);
+				t.y = 0.0f;
+				if (p < lineEnd && !readFloats(1, &t.y))
+					return fail("vt expects numbers");
+				chunk.TexCoords.push_back(t);
+			}
+			else if (KeywordIs(word, p, "vn"))
+			{
+				XMFLOAT3 n;
+				if (!readFloats(3, &n.x))
+					return fail("vn expects 3 numbers");
+				chunk.Normals.push_back(n);
+			}
+			else if (KeywordIs(word, p, "f"))
+			{
+				polygon.clear();
+				polygonRelative.clear();
+				for (p = SkipBlanks(p, lineEnd); p < lineEnd; p = SkipBlanks(p, lineEnd))
+				{
+					ObjCorner corner = { MissingIndex, MissingIndex, MissingIndex };
+					std::uint8_t relative = 0;
+					if (!ReadCornerIndex(p, lineEnd, text, (int)chunk.Positions.size(), corner.P, relative, 1))
+						return fail("bad face corner");
+					if (p < lineEnd && *p == '/')
+					{
+						++p;
+						if (p < lineEnd && *p != '/' &&
+							!ReadCornerIndex(p, lineEnd, text, (int)chunk.TexCoords.size(), corner.T, relative, 2))
+							return fail("bad face corner");
+						if (p < lineEnd && *p == '/')
+						{
+							++p;
+							if (!ReadCornerIndex(p, lineEnd, text, (int)chunk.Normals.size(), corner.N, relative, 4))
+								return fail("bad face corner");
+						}
+					}
+					if (p < lineEnd && !IsBlank(*p))
+						return fail("bad face corner");
+
+					polygon.push_back(corner);
+					polygonRelative.push_back(relative);
+					chunk.AnyRelative |= relative != 0;
+				}
+				if (polygon.size() < 3)
+					return fail("a face needs 3 corners");
+
+				for (std::size_t i = 1; i + 1 < polygon.size(); ++i)
+				{
+					const std::size_t fan[3] = { 0, i, i + 1 };
+					for (std::size_t k : fan)
+					{
+						chunk.Corners.push_back(polygon[k]);
+						chunk.Relative.push_back(polygonRelative[k]);
+					}
+				}
+			}
+			else if (KeywordIs(word, p, "o") || KeywordIs(word, p, "g") || KeywordIs(word, p, "usemtl"))
+			{
+				ObjNameEvent name;
+				name.Corner = (int)chunk.Corners.size();
+				name.Material = KeywordIs(word, p, "usemtl");
+				name.Name = RestOfLine(p, lineEnd);
+				chunk.Names.push_back(name);
+			}
+			// Smoothing groups, lines, points, material libraries and the like are ignored.
+
+			p = next;
+		}
+	}
+
+	//
+	// Welding
+	//
+
+	// A corner's key packs its position, texcoord + 1 and normal + 1 indices (0 for a
+	// missing attribute) into 22, 21 and 21 bits.  The largest position index is one
+	// less than the field's maximum, so no key is all ones.
+	const int MaxWeldPositions = (1 << 22) - 1;
+	const int MaxWeldAttributes = (1 << 21) - 2;
+	const std::uint64_t EmptyKey = ~0ull;
+
+	std::uint64_t CornerKey(const ObjCorner& c)
+	{
+		const std::uint64_t t = c.T == MissingIndex ? 0 : (std::uint64_t)c.T + 1;
+		const std::uint64_t n = c.N == MissingIndex ? 0 : (std::uint64_t)c.N + 1;
+		return (std::uint64_t)c.P << 42 | t << 21 | n;
+	}
+
+	struct WeldSlot
+	{
+		std::atomic<std::uint64_t> Key;
+
+		// The first corner with the key, which makes the vertex numbering independent of
+		// the order the workers claim the slots in.
+		std::atomic<std::uint32_t> FirstCorner;
+		std::uint32_t Vertex;
+	};
+
+	// Open addressing with linear probing; a worker claims an empty slot with a CAS and
+	// a lost race to the same key finds it on the retry.
+	std::uint32_t InsertKey(WeldSlot* slots, std::uint32_t mask, std::uint64_t key)
+	{
+		std::uint32_t slot = (std::uint32_t)((key*0x9E3779B97F4A7C15ull) >> 32) & mask;
+		for (;;)
+		{
+			std::uint64_t current = slots[slot].Key.load(std::memory_order_acquire);
+			if (current == EmptyKey &&
+				slots[slot].Key.compare_exchange_strong(current, key, std::memory_order_acq_rel))
+			{
+				return slot;
+			}
+			if (current == key)
+				return slot;
+			slot = (slot + 1) & mask;
+		}
+	}
+
+	void AtomicMin(std::atomic<std::uint32_t>& target, std::uint32_t value)
+	{
+		std::uint32_t current = target.load(std::memory_order_relaxed);
+		while (value < current && !target.compare_exchange_weak(current, value, std::memory_order_relaxed))
+		{
+		}
+	}
+
+	// Gives every distinct corner a vertex, numbered in order of first use, and writes
+	// each corner's vertex to indices.  firstCorners[v] is the first corner of vertex v.
+	void WeldCorners(const std::vector<ObjCorner>& corners, std::vector<std::uint32_t>& indices,
+		std::vector<std::uint32_t>& firstCorners)
+	{
+		const int cornerCount = (int)corners.size();
+		std::uint32_t capacity = 16;
+		while (capacity < (std::uint32_t)cornerCount + (std::uint32_t)cornerCount / 2)
+			capacity *= 2;
+		const std::uint32_t mask = capacity - 1;
+
+		std::unique_ptr<WeldSlot[]> slots(new WeldSlot[capacity]);
+		ParallelForRange((int)capacity, Grain, [&](int begin, int end)
+		{
+			for (int i = begin; i < end; ++i)
+			{
+				slots[i].Key.store(EmptyKey, std::memory_order_relaxed);
+				slots[i].FirstCorner.store(UINT32_MAX, std::memory_order_relaxed);
+			}
+		});
+
+		std::vector<std::uint32_t> cornerSlots(cornerCount);
+		ParallelForRange(cornerCount, Grain, [&](int begin, int end)
+		{
+			for (int c = begin; c < end; ++c)
+			{
+				const std::uint32_t slot = InsertKey(slots.get(), mask, CornerKey(corners[c]));
+				AtomicMin(slots[slot].FirstCorner, (std::uint32_t)c);
+				cornerSlots[c] = slot;
+			}
+		});
+
+		// Number the first corners block by block: count, scan, then assign.
+		const int blockCount = (cornerCount + Grain - 1) / Grain;
+		std::vector<std::uint32_t> blockVertices(blockCount + 1, 0);
+		auto isFirst = [&](int c)
+		{
+			return slots[cornerSlots[c]].FirstCorner.load(std::memory_order_relaxed) == (std::uint32_t)c;
+		};
+		ParallelFor(0, blockCount, [&](int block)
+		{
+			const int end = std::min((block + 1)*Grain, cornerCount);
+			std::uint32_t count = 0;
+			for (int c = block*Grain; c < end; ++c)
+				count += isFirst(c) ? 1 : 0;
+			blockVertices[block + 1] = count;
+		});
+		for (int block = 0; block < blockCount; ++block)
+			blockVertices[block + 1] += blockVertices[block];
+
+		firstCorners.resize(blockVertices[blockCount]);
+		ParallelFor(0, blockCount, [&](int block)
+		{
+			const int end = std::min((block + 1)*Grain, cornerCount);
+			std::uint32_t vertex = blockVertices[block];
+			for (int c = block*Grain; c < end; ++c)
+			{
+				if (isFirst(c))
+				{
+					slots[cornerSlots[c]].Vertex = vertex;
+					firstCorners[vertex++] = (std::uint32_t)c;
+				}
+			}
+		});
+
+		indices.resize(cornerCount);
+		ParallelForRange(cornerCount, Grain, [&](int begin, int end)
+		{
+			for (int c = begin; c < end; ++c)
+				indices[c] = slots[cornerSlots[c]].Vertex;
+		});
+	}
+
+	XMFLOAT3 FaceNormal(const XMFLOAT3& a, const XMFLOAT3& b, const XMFLOAT3& c)
+	{
+		// Area weighted, so large faces dominate the vertex normal.
+		const XMFLOAT3 e1(b.x - a.x, b.y - a.y, b.z - a.z);
+		const XMFLOAT3 e2(c.x - a.x, c.y - a.y, c.z - a.z);
+		return XMFLOAT3(e1.y*e2.z - e1.z*e2.y, e1.z*e2.x - e1.x*e2.z, e1.x*e2.y - e1.y*e2.x);
+	}
+
+	XMFLOAT3 NormalizeOrUp(const XMFLOAT3& n)
+	{
+		// Divided by the largest component first, since the sums of area-weighted
+		// normals of a large model overflow when squared.
+		const float largest = std::max(std::fabs(n.x), std::max(std::fabs(n.y), std::fabs(n.z)));
+		if (!(largest > 0.0f) || largest > FLT_MAX)
+			return XMFLOAT3(0.0f, 1.0f, 0.0f);
+
+		const XMFLOAT3 s(n.x / largest, n.y / largest, n.z / largest);
+		const float length = std::sqrt(s.x*s.x + s.y*s.y + s.z*s.z);
+		return XMFLOAT3(s.x / length, s.y / length, s.z / length);
+	}
+
+	// Mirrors and scales into the demo's space and computes the bounds.  Vertices and
+	// indices are otherwise final.
+	void FinishMesh(ImportedMesh& mesh, const MeshImportOptions& options)
+	{
+		const float scale = options.Scale;
+		const float mirror = options.ConvertToLeftHanded ? -1.0f : 1.0f;
+		ParallelForRange((int)mesh.Vertices.size(), Grain, [&](int begin, int end)
+		{
+			for (int i = begin; i < end; ++i)
+			{
+				MeshVertex& v = mesh.Vertices[i];
+				v.Pos = XMFLOAT3(v.Pos.x*scale, v.Pos.y*scale, v.Pos.z*scale*mirror);
+				v.Normal.z *= mirror;
+			}
+		});
+
+		if (options.ConvertToLeftHanded)
+		{
+			ParallelForRange((int)mesh.Indices.size() / 3, Grain, [&](int begin, int end)
+			{
+				for (int t = begin; t < end; ++t)
+					std::swap(mesh.Indices[3*t + 1], mesh.Indices[3*t + 2]);
+			});
+		}
+
+		ParallelFor(0, (int)mesh.Submeshes.size(), [&](int s)
+		{
+			ImportedSubmesh& submesh = mesh.Submeshes[s];
+			XMFLOAT3 lo(FLT_MAX, FLT_MAX, FLT_MAX);
+			XMFLOAT3 hi(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+			for (std::uint32_t k = 0; k < submesh.IndexCount; ++k)
+			{
+				const XMFLOAT3& p = mesh.Vertices[mesh.Indices[submesh.StartIndex + k]].Pos;
+				lo = XMFLOAT3(std::min(lo.x, p.x), std::min(lo.y, p.y), std::min(lo.z, p.z));
+				hi = XMFLOAT3(std::max(hi.x, p.x), std::max(hi.y, p.y), std::max(hi.z, p.z));
+			}
+			if (submesh.IndexCount == 0)
+				lo = hi = XMFLOAT3(0.0f, 0.0f, 0.0f);
+			submesh.BoundsMin = lo;
+			submesh.BoundsMax = hi;
+		});
+
+		mesh.BoundsMin = mesh.BoundsMax = XMFLOAT3(0.0f, 0.0f, 0.0f);
+		for (std::size_t s = 0; s < mesh.Submeshes.size(); ++s)
+		{
+			const ImportedSubmesh& submesh = mesh.Submeshes[s];
+			if (s == 0)
+			{
+				mesh.BoundsMin = submesh.BoundsMin;
+				mesh.BoundsMax = submesh.BoundsMax;
+				continue;
+			}
+			mesh.BoundsMin = XMFLOAT3(std::min(mesh.BoundsMin.x, submesh.BoundsMin.x),
+				std::min(mesh.BoundsMin.y, submesh.BoundsMin.y), std::min(mesh.BoundsMin.z, submesh.BoundsMin.z));
+			mesh.BoundsMax = XMFLOAT3(std::max(mesh.BoundsMax.x, submesh.BoundsMax.x),
+				std::max(mesh.BoundsMax.y, submesh.BoundsMax.y), std::max(mesh.BoundsMax.z, submesh.BoundsMax.z));
+		}
+	}
+
+	//
+	// glTF
+	//
+
+	// A parsed JSON document.  Every value is an entry of Values and containers list the
+	// indices of their members; glTF's JSON is small next to its buffers.
+	class JsonDocument
+	{
+	public:
+		enum class Type : std::uint8_t { Null, Bool, Number, String, Array, Object };
+
+		struct Value
+		{
+			Type Kind = Type::Null;
+			double Number = 0.0;
+			std::string Text;
+			std::vector<int> Members;
+			std::vector<std::string> Keys;
+		};
+
+		bool Parse(const char* text, std::size_t size)
+		{
+			mP = text;
+			mEnd = text + size;
+			mValues.clear();
+			mError.clear();
+			if (ParseValue(0) < 0)
+				return false;
+			SkipWhitespace();
+			if (mP != mEnd)
+				return Fail("trailing characters");
+			return true;
+		}
+
+		const std::string& Error()const { return mError; }
+
+		// Index of object's member key, or -1.
+		int Find(int object, const char* key)const
+		{
+			if (object < 0 || mValues[object].Kind != Type::Object)
+				return -1;
+			const Value& v = mValues[object];
+			for (std::size_t i = 0; i < v.Keys.size(); ++i)
+			{
+				if (v.Keys[i] == key)
+					return v.Members[i];
+			}
+			return -1;
+		}
+
+		int Size(int array)const
+		{
+			return array >= 0 && mValues[array].Kind == Type::Array ? (int)mValues[array].Members.size() : 0;
+		}
+
+		int At(int array, int i)const
+		{
+			return i >= 0 && i < Size(array) ? mValues[array].Members[i] : -1;
+		}
+
+		bool IsNumber(int value)const
+		{
+			return value >= 0 && mValues[value].Kind == Type::Number;
+		}
+
+		double Number(int value, double fallback)const
+		{
+			return IsNumber(value) ? mValues[value].Number : fallback;
+		}
+
+		// A non-negative integer member, fallback if it is missing, -2 if malformed.
+		long long Index(int object, const char* key, long long fallback)const
+		{
+			const int value = Find(object, key);
+			if (value < 0)
+				return fallback;
+			const double n = Number(value, -1.0);
+			return n >= 0.0 && n == std::floor(n) && n < 9e15 ? (long long)n : -2;
+		}
+
+		const std::string* String(int value)const
+		{
+			return value >= 0 && mValues[value].Kind == Type::String ? &mValues[value].Text : nullptr;
+		}
+
+	private:
+		bool Fail(const char* message)
+		{
+			if (mError.empty())
+				mError = message;
+			return false;
+		}
+
+		void SkipWhitespace()
+		{
+			while (mP < mEnd && (*mP == ' ' || *mP == '\t' || *mP == '\r' || *mP == '\n'))
+				++mP;
+		}
+
+		bool ParseString(std::string& out)
+		{
+			// mP is at the opening quote.
+			++mP;
+			out.clear();
+			while (mP < mEnd && *mP != '"')
+			{
+				char c = *mP++;
+				if (c != '\\')
+				{
+					out.push_back(c);
+					continue;
+				}
+				if (mP == mEnd)
+					break;
+				c = *mP++;
+				switch (c)
+				{
+				case 'b': out.push_back('\b'); break;
+				case 'f': out.push_back('\f'); break;
+				case 'n': out.push_back('\n'); break;
+				case 'r': out.push_back('\r'); break;
+				case 't': out.push_back('\t'); break;
+				case 'u':
+				{
+					unsigned code = 0;
+					for (int i = 0; i < 4; ++i, ++mP)
+					{
+						if (mP == mEnd || !std::isxdigit((unsigned char)*mP))
+							return Fail("bad \\u escape");
+						code = code*16 + (unsigned)(IsDigit(*mP) ? *mP - '0' : (std::tolower((unsigned char)*mP) - 'a' + 10));
+					}
+					// Names only; surrogate pairs are not reassembled.
+					if (code < 0x80)
+					{
+						out.push_back((char)code);
+					}
+					else if (code < 0x800)
+					{
+						out.push_back((char)(0xC0 | code >> 6));
+						out.push_back((char)(0x80 | (code & 0x3F)));
+					}
+					else
+					{
+						out.push_back((char)(0xE0 | code >> 12));
+						out.push_back((char)(0x80 | ((code >> 6) & 0x3F)));
+						out.push_back((char)(0x80 | (code & 0x3F)));
+					}
+					break;
+				}
+				default:
+					out.push_back(c);
+					break;
+				}
+			}
+			if (mP == mEnd)
+				return Fail("unterminated string");
+			++mP;
+			return true;
+		}
+
+		// Appends the value at mP and returns its index, or -1.
+		int ParseValue(int depth)
+		{
+			if (depth > 64)
+				return Fail("nested too deeply"), -1;
+
+			SkipWhitespace();
+			if (mP == mEnd)
+				return Fail("unexpected end"), -1;
+
+			const int index = (int)mValues.size();
+			mValues.emplace_back();
+
+			const char c = *mP;
+			if (c == '{' || c == '[')
+			{
+				const bool object = c == '{';
+				const char close = object ? '}' : ']';
+				mValues[index].Kind = object ? Type::Object : Type::Array;
+				++mP;
+				SkipWhitespace();
+				if (mP < mEnd && *mP == close)
+				{
+					++mP;
+					return index;
+				}
+				for (;;)
+				{
+					std::string key;
+					if (object)
+					{
+						SkipWhitespace();
+						if (mP == mEnd || *mP != '"' || !ParseString(key))
+							return Fail("expected a key"), -1;
+						SkipWhitespace();
+						if (mP == mEnd || *mP++ != ':')
+							return Fail("expected ':'"), -1;
+					}
+
+					const int member = ParseValue(depth + 1);
+					if (member < 0)
+						return -1;
+					mValues[index].Members.push_back(member);
+					if (object)
+						mValues[index].Keys.push_back(std::move(key));
+
+					SkipWhitespace();
+					if (mP == mEnd)
+						return Fail("unexpected end"), -1;
+					const char separator = *mP++;
+					if (separator == close)
+						return index;
+					if (separator != ',')
+						return Fail("expected ',' or a closing bracket"), -1;
+				}
+			}
+
+			if (c == '"')
+			{
+				std::string text;
+				if (!ParseString(text))
+					return -1;
+				mValues[index].Kind = Type::String;
+				mValues[index].Text = std::move(text);
+				return index;
+			}
+
+			auto literal = [&](const char* word)
+			{
+				const std::size_t length = std::strlen(word);
+				if ((std::size_t)(mEnd - mP) < length || std::memcmp(mP, word, length) != 0)
+					return false;
+				mP += length;
+				return true;
+			};
+			if (literal("true") || literal("false"))
+			{
+				mValues[index].Kind = Type::Bool;
+				mValues[index].Number = mP[-1] == 'e' && mP[-2] == 'u' ? 1.0 : 0.0;
+				return index;
+			}
+			if (literal("null"))
+				return index;
+
+			// Numbers are copied out, strtod needs a terminator.
+			char number[64];
+			std::size_t length = 0;
+			while (mP + length < mEnd && length + 1 < sizeof(number) &&
+				(IsDigit(mP[length]) || mP[length] == '-' || mP[length] == '+' || mP[length] == '.' ||
+				mP[length] == 'e' || mP[length] == 'E'))
+			{
+				number[length] = mP[length];
+				++length;
+			}
+			number[length] = '\0';
+			char* parsedEnd = nullptr;
+			const double value = std::strtod(number, &parsedEnd);
+			if (length == 0 || parsedEnd != number + length)
+				return Fail("bad value"), -1;
+			mP += length;
+			mValues[index].Kind = Type::Number;
+			mValues[index].Number = value;
+			return index;
+		}
+
+	private:
+		const char* mP = nullptr;
+		const char* mEnd = nullptr;
+		std::vector<Value> mValues;
+		std::string mError;
+	};
+
+	struct GltfBuffer
+	{
+		const std::uint8_t* Data;
+		std::size_t Size;
+	};
+
+	// A resolved accessor: element i starts at Data + i*Stride.
+	struct GltfAccessor
+	{
+		const std::uint8_t* Data = nullptr;
+		std::size_t Stride = 0;
+		int Count = 0;
+		int ComponentType = 0;
+		int Components = 0;
+		bool Normalized = false;
+	};
+
+	const int GltfByte = 5120;
+	const int GltfUnsignedByte = 5121;
+	const int GltfShort = 5122;
+	const int GltfUnsignedShort = 5123;
+	const int GltfUnsignedInt = 5125;
+	const int GltfFloat = 5126;
+	const int GltfTriangles = 4;
+
+	int ComponentBytes(int componentType)
+	{
+		switch (componentType)
+		{
+		case GltfByte:
+		case GltfUnsignedByte:
+			return 1;
+		case GltfShort:
+		case GltfUnsignedShort:
+			return 2;
+		case GltfUnsignedInt:
+		case GltfFloat:
+			return 4;
+		default:
+			return 0;
+		}
+	}
+
+	float ReadComponent(const std::uint8_t* p, int componentType, bool normalized)
+	{
+		switch (componentType)
+		{
+		case GltfFloat:
+		{
+			float f;
+			std::memcpy(&f, p, sizeof(f));
+			return f;
+		}
+		case GltfUnsignedByte:
+			return normalized ? p[0] / 255.0f : (float)p[0];
+		case GltfByte:
+		{
+			const float v = (float)(std::int8_t)p[0];
+			return normalized ? std::max(v / 127.0f, -1.0f) : v;
+		}
+		case GltfUnsignedShort:
+		{
+			std::uint16_t v;
+			std::memcpy(&v, p, sizeof(v));
+			return normalized ? v / 65535.0f : (float)v;
+		}
+		case GltfShort:
+		{
+			std::int16_t v;
+			std::memcpy(&v, p, sizeof(v));
+			return normalized ? std::max(v / 32767.0f, -1.0f) : (float)v;
+		}
+		default:
+		{
+			std::uint32_t v;
+			std::memcpy(&v, p, sizeof(v));
+			return (float)v;
+		}
+		}
+	}
+
+	std::uint32_t ReadIndex(const std::uint8_t* p, int componentType)
+	{
+		if (componentType == GltfUnsignedByte)
+			return p[0];
+		if (componentType == GltfUnsignedShort)
+		{
+			std::uint16_t v;
+			std::memcpy(&v, p, sizeof(v));
+			return v;
+		}
+		std::uint32_t v;
+		std::memcpy(&v, p, sizeof(v));
+		return v;
+	}
+
+	// Resolves accessor index through its buffer view and checks every element lies in
+	// the buffer.  Returns an error message or nullptr.
+	const char* ResolveAccessor(const JsonDocument& doc, const std::vector<GltfBuffer>& buffers,
+		int index, GltfAccessor& out)
+	{
+		const int accessor = doc.At(doc.Find(0, "accessors"), index);
+		if (accessor < 0)
+			return "missing accessor";
+
+		const long long viewIndex = doc.Index(accessor, "bufferView", -1);
+		if (viewIndex < 0)
+			return "accessors without a buffer view (sparse or zero) are not supported";
+		const int view = doc.At(doc.Find(0, "bufferViews"), (int)std::min(viewIndex, (long long)INT_MAX));
+		if (view < 0)
+			return "missing buffer view";
+
+		const long long bufferIndex = doc.Index(view, "buffer", -2);
+		if (bufferIndex < 0 || bufferIndex >= (long long)buffers.size())
+			return "buffer view names a missing buffer";
+		const GltfBuffer& buffer = buffers[(std::size_t)bufferIndex];
+
+		const std::string* type = doc.String(doc.Find(accessor, "type"));
+		const char* const typeNames[] = { "SCALAR", "VEC2", "VEC3", "VEC4" };
+		out.Components = 0;
+		for (int i = 0; i < 4 && type != nullptr; ++i)
+		{
+			if (*type == typeNames[i])
+				out.Components = i + 1;
+		}
+
+		out.ComponentType = (int)doc.Index(accessor, "componentType", -2);
+		const int componentBytes = ComponentBytes(out.ComponentType);
+		if (out.Components == 0 || componentBytes == 0)
+			return "unsupported accessor type";
+
+		const long long count = doc.Index(accessor, "count", -2);
+		const long long accessorOffset = doc.Index(accessor, "byteOffset", 0);
+		const long long viewOffset = doc.Index(view, "byteOffset", 0);
+		const long long viewLength = doc.Index(view, "byteLength", -2);
+		const long long elementBytes = (long long)out.Components*componentBytes;
+		const long long stride = doc.Index(view, "byteStride", elementBytes);
+		if (count < 0 || count > INT_MAX || accessorOffset < 0 || viewOffset < 0 || viewLength < 0 || stride < elementBytes)
+			return "malformed accessor";
+		if (viewOffset + viewLength > (long long)buffer.Size ||
+			(count > 0 && accessorOffset + stride*(count - 1) + elementBytes > viewLength))
+			return "accessor runs past its buffer";
+
+		out.Data = buffer.Data + viewOffset + accessorOffset;
+		out.Stride = (std::size_t)stride;
+		out.Count = (int)count;
+		out.Normalized = doc.Find(accessor, "normalized") >= 0 &&
+			doc.Number(doc.Find(accessor, "normalized"), 0.0) != 0.0;
+		return nullptr;
+	}
+
+	XMMATRIX NodeTransform(const JsonDocument& doc, int node)
+	{
+		const int matrix = doc.Find(node, "matrix");
+		if (doc.Size(matrix) == 16)
+		{
+			// Column-major with column vectors is row-major with row vectors.
+			XMFLOAT4X4 m;
+			for (int i = 0; i < 16; ++i)
+				m.m[i / 4][i % 4] = (float)doc.Number(doc.At(matrix, i), 0.0);
+			return XMLoadFloat4x4(&m);
+		}
+
+		float s[3] = { 1.0f, 1.0f, 1.0f };
+		float r[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+		float t[3] = { 0.0f, 0.0f, 0.0f };
+		auto read = [&](const char* key, float* out, int n)
+		{
+			const int array = doc.Find(node, key);
+			if (doc.Size(array) == n)
+			{
+				for (int i = 0; i < n; ++i)
+					out[i] = (float)doc.Number(doc.At(array, i), out[i]);
+			}
+		};
+		read("scale", s, 3);
+		read("rotation", r, 4);
+		read("translation", t, 3);
+		return XMMatrixScaling(s[0], s[1], s[2]) *
+			XMMatrixRotationQuaternion(XMVectorSet(r[0], r[1], r[2], r[3])) *
+			XMMatrixTranslation(t[0], t[1], t[2]);
+	}
+
+	// One triangle primitive of one mesh instance, and where it goes in the output.
+	struct GltfPrimitive
+	{
+		GltfAccessor Positions;
+		GltfAccessor Normals;
+		GltfAccessor TexCoords;
+		GltfAccessor Indices;
+		bool HasNormals = false;
+		bool HasTexCoords = false;
+		bool HasIndices = false;
+
+		XMFLOAT4X4 World;
+		XMFLOAT4X4 NormalMatrix;
+
+		// A mirroring transform turns the faces inside out, so their winding is reversed.
+		bool Mirrored = false;
+
+		std::uint32_t FirstVertex = 0;
+		std::uint32_t FirstIndex = 0;
+		std::uint32_t IndexCount = 0;
+	};
+
+	// A range of one primitive's vertices or indices for one task.
+	struct GltfJob
+	{
+		int Primitive;
+		int Begin;
+		int End;
+	};
+
+	void AddJobs(std::vector<GltfJob>& jobs, int primitive, int count, int grain)
+	{
+		for (int begin = 0; begin < count; begin += grain)
+			jobs.push_back({ primitive, begin, std::min(begin + grain, count) });
+	}
+
+	std::wstring DirectoryOf(const std::wstring& filename)
+	{
+		const std::size_t slash = filename.find_last_of(L"/\\");
+		return slash == std::wstring::npos ? std::wstring() : filename.substr(0, slash + 1);
+	}
+}
+
+bool MeshImporter::Fail(const std::string& message, ImportedMesh& mesh)
+{
+	mError = message;
+	mesh = ImportedMesh();
+	return false;
+}
+
+bool MeshImporter::Import(const std::wstring& filename, ImportedMesh& mesh)
+{
+	mStats = MeshImportStats();
+	mError.clear();
+
+	std::wstring extension;
+	const std::size_t dot = filename.find_last_of(L'.');
+	if (dot != std::wstring::npos)
+	{
+		for (std::size_t i = dot; i < filename.size(); ++i)
+			extension.push_back((wchar_t)std::towlower(filename[i]));
+	}
+
+	MappedFile file;
+	if (!file.Open(filename))
+		return Fail("cannot open the file", mesh);
+
+	const char* text = reinterpret_cast<const char*>(file.Data());
+	if (extension == L".obj")
+		return ParseObj(text, file.Size(), mesh);
+	if (extension == L".glb")
+		return ParseGlb(file.Data(), file.Size(), mesh);
+	if (extension == L".gltf")
+		return ParseGltf(text, file.Size(), DirectoryOf(filename), mesh);
+	return Fail("unknown mesh format; expected .obj, .glb or .gltf", mesh);
+}
+
+bool MeshImporter::ParseObj(const char* text, std::size_t size, ImportedMesh& mesh)
+{
+	mStats = MeshImportStats();
+	mStats.InputBytes = size;
+	mError.clear();
+	mesh = ImportedMesh();
+
+	const TextRange range = { text, text + size };
+
+	// Cut the text at line breaks into chunks, parse them in parallel.
+	std::vector<ObjChunk> chunks;
+	for (const char* p = text; p < range.End;)
+	{
+		const char* end = p + std::min(ObjChunkBytes, (std::size_t)(range.End - p));
+		if (end < range.End)
+		{
+			const char* lineBreak = static_cast<const char*>(std::memchr(end, '\n', range.End - end));
+			end = lineBreak != nullptr ? lineBreak + 1 : range.End;
+		}
+		chunks.emplace_back();
+		chunks.back().Begin = p;
+		chunks.back().End = end;
+		p = end;
+	}
+
+	ParallelFor(0, (int)chunks.size(), [&](int c)
+	{
+		ParseObjChunk(chunks[c], range);
+	});
+
+	int line = 0;
+	for (const ObjChunk& chunk : chunks)
+	{
+		if (chunk.Error != nullptr)
+			return Fail("line " + std::to_string(line + chunk.ErrorLine) + ": " + chunk.Error, mesh);
+		line += chunk.LineCount;
+	}
+
+	// Where each chunk's attributes and corners start in the whole file.
+	const std::size_t chunkCount = chunks.size();
+	std::vector<int> positionBase(chunkCount + 1, 0);
+	std::vector<int> texCoordBase(chunkCount + 1, 0);
+	std::vector<int> normalBase(chunkCount + 1, 0);
+	std::vector<long long> cornerBase(chunkCount + 1, 0);
+	for (std::size_t c = 0; c < chunkCount; ++c)
+	{
+		positionBase[c + 1] = positionBase[c] + (int)chunks[c].Positions.size();
+		texCoordBase[c + 1] = texCoordBase[c] + (int)chunks[c].TexCoords.size();
+		normalBase[c + 1] = normalBase[c] + (int)chunks[c].Normals.size();
+		cornerBase[c + 1] = cornerBase[c] + (long long)chunks[c].Corners.size();
+	}
+
+	const int positionCount = positionBase[chunkCount];
+	const int texCoordCount = texCoordBase[chunkCount];
+	const int normalCount = normalBase[chunkCount];
+	if (cornerBase[chunkCount] > INT_MAX / 2)
+		return Fail("too many faces", mesh);
+	const int cornerCount = (int)cornerBase[chunkCount];
+	if (positionCount > MaxWeldPositions || texCoordCount > MaxWeldAttributes || normalCount > MaxWeldAttributes)
+		return Fail("too many vertex positions, texcoords or normals", mesh);
+
+	// Gather the attributes and rebase the corners, checking every index.
+	std::vector<XMFLOAT3> positions(positionCount);
+	std::vector<XMFLOAT2> texCoords(texCoordCount);
+	std::vector<XMFLOAT3> normals(normalCount);
+	std::vector<ObjCorner> corners(cornerCount);
+	std::atomic<bool> badIndex(false);
+	ParallelFor(0, (int)chunkCount, [&](int c)
+	{
+		const ObjChunk& chunk = chunks[c];
+		std::copy(chunk.Positions.begin(), chunk.Positions.end(), positions.begin() + positionBase[c]);
+		std::copy(chunk.TexCoords.begin(), chunk.TexCoords.end(), texCoords.begin() + texCoordBase[c]);
+		std::copy(chunk.Normals.begin(), chunk.Normals.end(), normals.begin() + normalBase[c]);
+
+		bool bad = false;
+		ObjCorner* out = corners.data() + cornerBase[c];
+		for (std::size_t k = 0; k < chunk.Corners.size(); ++k)
+		{
+			ObjCorner corner = chunk.Corners[k];
+			const std::uint8_t relative = chunk.Relative[k];
+			if (relative & 1)
+				corner.P += positionBase[c];
+			if ((relative & 2) && corner.T != MissingIndex)
+				corner.T += texCoordBase[c];
+			if ((relative & 4) && corner.N != MissingIndex)
+				corner.N += normalBase[c];
+
+			bad |= corner.P < 0 || corner.P >= positionCount ||
+				(corner.T != MissingIndex && (corner.T < 0 || corner.T >= texCoordCount)) ||
+				(corner.N != MissingIndex && (corner.N < 0 || corner.N >= normalCount));
+			out[k] = corner;
+		}
+		if (bad)
+			badIndex = true;
+	});
+	if (badIndex)
+		return Fail("a face refers to a vertex, texcoord or normal that does not exist", mesh);
+
+	// Name the corner ranges: by material, or by object or group before the first usemtl.
+	struct NamedRange
+	{
+		int Submesh;
+		int Begin;
+		int End;
+	};
+	std::vector<NamedRange> ranges;
+	{
+		std::string group;
+		std::string material;
+		bool hasMaterial = false;
+		int rangeBegin = 0;
+
+		auto submeshNamed = [&](const std::string& name)
+		{
+			for (std::size_t s = 0; s < mesh.Submeshes.size(); ++s)
+			{
+				if (mesh.Submeshes[s].Name == name)
+					return (int)s;
+			}
+			mesh.Submeshes.emplace_back();
+			mesh.Submeshes.back().Name = name;
+			return (int)mesh.Submeshes.size() - 1;
+		};
+		auto closeRange = [&](int end)
+		{
+			if (end > rangeBegin)
+			{
+				const std::string& name = hasMaterial ? material : group;
+				ranges.push_back({ submeshNamed(name.empty() ? std::string("default") : name), rangeBegin, end });
+			}
+			rangeBegin = end;
+		};
+
+		for (std::size_t c = 0; c < chunkCount; ++c)
+		{
+			for (const ObjNameEvent& event : chunks[c].Names)
+			{
+				closeRange((int)cornerBase[c] + event.Corner);
+				if (event.Material)
+				{
+					material = event.Name;
+					hasMaterial = true;
+				}
+				else
+				{
+					group = event.Name;
+				}
+			}
+		}
+		closeRange(cornerCount);
+	}
+	chunks.clear();
+
+	if (cornerCount == 0)
+		return Fail("the file has no faces", mesh);
+
+	// Lay each submesh's ranges end to end, submeshes in order of first use.
+	std::vector<int> rangeTargets(ranges.size());
+	{
+		std::vector<std::uint32_t> cursor(mesh.Submeshes.size(), 0);
+		for (const NamedRange& range : ranges)
+			mesh.Submeshes[range.Submesh].IndexCount += (std::uint32_t)(range.End - range.Begin);
+		std::uint32_t start = 0;
+		for (std::size_t s = 0; s < mesh.Submeshes.size(); ++s)
+		{
+			mesh.Submeshes[s].StartIndex = start;
+			cursor[s] = start;
+			start += mesh.Submeshes[s].IndexCount;
+		}
+		for (std::size_t r = 0; r < ranges.size(); ++r)
+		{
+			rangeTargets[r] = (int)cursor[ranges[r].Submesh];
+			cursor[ranges[r].Submesh] += (std::uint32_t)(ranges[r].End - ranges[r].Begin);
+		}
+	}
+	if (ranges.size() > mesh.Submeshes.size())
+	{
+		std::vector<ObjCorner> sorted(cornerCount);
+		ParallelFor(0, (int)ranges.size(), [&](int r)
+		{
+			std::copy(corners.begin() + ranges[r].Begin, corners.begin() + ranges[r].End, sorted.begin() + rangeTargets[r]);
+		});
+		corners.swap(sorted);
+	}
+
+	std::vector<std::uint32_t> firstCorners;
+	WeldCorners(corners, mesh.Indices, firstCorners);
+
+	const int vertexCount = (int)firstCorners.size();
+	mesh.Vertices.resize(vertexCount);
+	std::atomic<bool> missingNormals(false);
+	ParallelForRange(vertexCount, Grain, [&](int begin, int end)
+	{
+		bool missing = false;
+		for (int v = begin; v < end; ++v)
+		{
+			const ObjCorner& corner = corners[firstCorners[v]];
+			MeshVertex& out = mesh.Vertices[v];
+			out.Pos = positions[corner.P];
+			out.Normal = corner.N != MissingIndex ? normals[corner.N] : XMFLOAT3(0.0f, 0.0f, 0.0f);
+
+			// OBJ texture space has v up.
+			out.TexC = corner.T != MissingIndex ?
+				XMFLOAT2(texCoords[corner.T].x, 1.0f - texCoords[corner.T].y) : XMFLOAT2(0.0f, 0.0f);
+			missing |= corner.N == MissingIndex;
+		}
+		if (missing)
+			missingNormals = true;
+	});
+
+	if (missingNormals)
+	{
+		// Smoothed over the faces sharing a position, so texture seams do not show.  A
+		// serial pass, only taken for files exported without normals.
+		std::vector<XMFLOAT3> accumulated(positionCount, XMFLOAT3(0.0f, 0.0f, 0.0f));
+		for (int c = 0; c + 2 < cornerCount; c += 3)
+		{
+			const int p[3] = { corners[c].P, corners[c + 1].P, corners[c + 2].P };
+			const XMFLOAT3 n = FaceNormal(positions[p[0]], positions[p[1]], positions[p[2]]);
+			for (int k : p)
+				accumulated[k] = XMFLOAT3(accumulated[k].x + n.x, accumulated[k].y + n.y, accumulated[k].z + n.z);
+		}
+		ParallelForRange(vertexCount, Grain, [&](int begin, int end)
+		{
+			for (int v = begin; v < end; ++v)
+			{
+				const ObjCorner& corner = corners[firstCorners[v]];
+				if (corner.N == MissingIndex)
+					mesh.Vertices[v].Normal = NormalizeOrUp(accumulated[corner.P]);
+			}
+		});
+		mStats.GeneratedNormals = true;
+	}
+
+	mStats.Corners = cornerCount;
+	mStats.Vertices = vertexCount;
+	mStats.Triangles = cornerCount / 3;
+	FinishMesh(mesh, mOptions);
+	return true;
+}
+
+bool MeshImporter::ParseGlb(const std::uint8_t* data, std::size_t size, ImportedMesh& mesh)
+{
+	mStats = MeshImportStats();
+	mStats.InputBytes = size;
+	mError.clear();
+
+	// A 12-byte header, then chunks of length, type and data padded to 4 bytes: the JSON
+	// first, then optionally the binary buffer.
+	auto read32 = [data](std::size_t offset)
+	{
+		std::uint32_t value;
+		std::memcpy(&value, data + offset, sizeof(value));
+		return value;
+	};
+	if (size < 20 || read32(0) != 0x46546C67 || read32(4) != 2)
+		return Fail("not a glTF 2.0 binary", mesh);
+
+	const std::size_t length = std::min((std::size_t)read32(8), size);
+	const std::size_t jsonLength = read32(12);
+	if (length < 20 || read32(16) != 0x4E4F534A || jsonLength > length - 20)
+		return Fail("the first chunk of a .glb must be its JSON", mesh);
+
+	const std::uint8_t* binary = nullptr;
+	std::size_t binarySize = 0;
+	const std::size_t binaryChunk = 20 + ((jsonLength + 3) & ~(std::size_t)3);
+	if (binaryChunk + 8 <= length && read32(binaryChunk + 4) == 0x004E4942)
+	{
+		binarySize = read32(binaryChunk);
+		if (binarySize > length - binaryChunk - 8)
+			return Fail("truncated binary chunk", mesh);
+		binary = data + binaryChunk + 8;
+	}
+
+	return ImportGltf(reinterpret_cast<const char*>(data + 20), jsonLength, binary, binarySize, std::wstring(), mesh);
+}
+
+bool MeshImporter::ParseGltf(const char* json, std::size_t size, const std::wstring& directory, ImportedMesh& mesh)
+{
+	mStats = MeshImportStats();
+	mStats.InputBytes = size;
+	mError.clear();
+	return ImportGltf(json, size, nullptr, 0, directory, mesh);
+}
+
+bool MeshImporter::ImportGltf(const char* json, std::size_t jsonSize, const std::uint8_t* binary,
+	std::size_t binarySize, const std::wstring& directory, ImportedMesh& mesh)
+{
+	mesh = ImportedMesh();
+
+	JsonDocument doc;
+	if (!doc.Parse(json, jsonSize))
+		return Fail("glTF JSON: " + doc.Error(), mesh);
+
+	const std::string* version = doc.String(doc.Find(doc.Find(0, "asset"), "version"));
+	if (version == nullptr || version->empty() || (*version)[0] != '2')
+		return Fail("only glTF 2.0 is supported", mesh);
+
+	// The .glb's binary chunk, or files next to the document.
+	std::vector<std::unique_ptr<MappedFile>> files;
+	std::vector<GltfBuffer> buffers;
+	const int bufferArray = doc.Find(0, "buffers");
+	for (int i = 0; i < doc.Size(bufferArray); ++i)
+	{
+		const int buffer = doc.At(bufferArray, i);
+		const long long byteLength = doc.Index(buffer, "byteLength", -2);
+		const std::string* uri = doc.String(doc.Find(buffer, "uri"));
+
+		GltfBuffer span = { nullptr, 0 };
+		if (uri == nullptr)
+		{
+			if (i != 0 || binary == nullptr)
+				return Fail("buffer " + std::to_string(i) + " has no uri", mesh);
+			span = { binary, binarySize };
+		}
+		else
+		{
+			if (uri->compare(0, 5, "data:") == 0)
+				return Fail("embedded base64 buffers are not supported; export binary buffers", mesh);
+
+			files.push_back(std::make_unique<MappedFile>());
+			if (!files.back()->Open(directory + std::wstring(uri->begin(), uri->end())))
+				return Fail("cannot open buffer " + *uri, mesh);
+			span = { files.back()->Data(), files.back()->Size() };
+			mStats.InputBytes += span.Size;
+		}
+
+		if (byteLength < 0 || (unsigned long long)byteLength > span.Size)
+			return Fail("buffer " + std::to_string(i) + " is shorter than its byteLength", mesh);
+		span.Size = (std::size_t)byteLength;
+		buffers.push_back(span);
+	}
+
+	// The mesh instances of the default scene with their world transforms; without
+	// scenes every root node, without nodes every mesh once.
+	struct MeshInstance
+	{
+		int Mesh;
+		XMFLOAT4X4 World;
+	};
+	std::vector<MeshInstance> instances;
+
+	XMFLOAT4X4 identity;
+	XMStoreFloat4x4(&identity, XMMatrixIdentity());
+
+	const int nodes = doc.Find(0, "nodes");
+	const int meshes = doc.Find(0, "meshes");
+	const int scenes = doc.Find(0, "scenes");
+	std::vector<int> roots;
+	if (doc.Size(scenes) > 0)
+	{
+		const long long sceneIndex = doc.Index(0, "scene", 0);
+		const int scene = sceneIndex >= 0 && sceneIndex < doc.Size(scenes) ? doc.At(scenes, (int)sceneIndex) : -1;
+		if (scene < 0)
+			return Fail("missing scene", mesh);
+		const int sceneNodes = doc.Find(scene, "nodes");
+		for (int i = 0; i < doc.Size(sceneNodes); ++i)
+			roots.push_back((int)doc.Number(doc.At(sceneNodes, i), -1.0));
+	}
+	else if (doc.Size(nodes) > 0)
+	{
+		std::vector<bool> isChild(doc.Size(nodes), false);
+		for (int n = 0; n < doc.Size(nodes); ++n)
+		{
+			const int children = doc.Find(doc.At(nodes, n), "children");
+			for (int i = 0; i < doc.Size(children); ++i)
+			{
+				const int child = (int)doc.Number(doc.At(children, i), -1.0);
+				if (child >= 0 && child < doc.Size(nodes))
+					isChild[child] = true;
+			}
+		}
+		for (int n = 0; n < doc.Size(nodes); ++n)
+		{
+			if (!isChild[n])
+				roots.push_back(n);
+		}
+	}
+	else
+	{
+		for (int m = 0; m < doc.Size(meshes); ++m)
+			instances.push_back({ m, identity });
+	}
+
+	struct NodeVisit
+	{
+		int Node;
+		XMFLOAT4X4 ParentWorld;
+		int Depth;
+	};
+	std::vector<NodeVisit> stack;
+	for (auto root = roots.rbegin(); root != roots.rend(); ++root)
+		stack.push_back({ *root, identity, 0 });
+
+	int visits = 0;
+	while (!stack.empty())
+	{
+		const NodeVisit visit = stack.back();
+		stack.pop_back();
+
+		const int node = doc.At(nodes, visit.Node);
+		if (node < 0 || visit.Depth > 64 || ++visits > (1 << 20))
+			return Fail("bad or cyclic node hierarchy", mesh);
+
+		XMFLOAT4X4 world;
+		XMStoreFloat4x4(&world, NodeTransform(doc, node) * XMLoadFloat4x4(&visit.ParentWorld));
+
+		const long long meshIndex = doc.Index(node, "mesh", -1);
+		if (meshIndex >= 0)
+			instances.push_back({ (int)std::min(meshIndex, (long long)INT_MAX), world });
+
+		const int children = doc.Find(node, "children");
+		for (int i = doc.Size(children) - 1; i >= 0; --i)
+			stack.push_back({ (int)doc.Number(doc.At(children, i), -1.0), world, visit.Depth + 1 });
+	}
+
+	// Plan: resolve every triangle primitive of every instance and give it its range of
+	// the output.
+	std::vector<GltfPrimitive> primitives;
+	long long vertexTotal = 0;
+	long long indexTotal = 0;
+	for (const MeshInstance& instance : instances)
+	{
+		const int meshValue = doc.At(meshes, instance.Mesh);
+		if (meshValue < 0)
+			return Fail("a node names a missing mesh", mesh);
+
+		const int primitiveArray = doc.Find(meshValue, "primitives");
+		const std::string* meshName = doc.String(doc.Find(meshValue, "name"));
+		for (int p = 0; p < doc.Size(primitiveArray); ++p)
+		{
+			const int primitive = doc.At(primitiveArray, p);
+			if (doc.Index(primitive, "mode", GltfTriangles) != GltfTriangles)
+			{
+				++mStats.SkippedPrimitives;
+				continue;
+			}
+
+			const int attributes = doc.Find(primitive, "attributes");
+			const long long position = doc.Index(attributes, "POSITION", -1);
+			const long long normal = doc.Index(attributes, "NORMAL", -1);
+			const long long texCoord = doc.Index(attributes, "TEXCOORD_0", -1);
+			const long long indices = doc.Index(primitive, "indices", -1);
+			if (position < 0 || position > INT_MAX || normal > INT_MAX || texCoord > INT_MAX || indices > INT_MAX)
+				return Fail("a primitive has no POSITION", mesh);
+
+			GltfPrimitive prim;
+			prim.HasNormals = normal >= 0;
+			prim.HasTexCoords = texCoord >= 0;
+			prim.HasIndices = indices >= 0;
+			const char* error = ResolveAccessor(doc, buffers, (int)position, prim.Positions);
+			if (error == nullptr && prim.HasNormals)
+				error = ResolveAccessor(doc, buffers, (int)normal, prim.Normals);
+			if (error == nullptr && prim.HasTexCoords)
+				error = ResolveAccessor(doc, buffers, (int)texCoord, prim.TexCoords);
+			if (error == nullptr && prim.HasIndices)
+				error = ResolveAccessor(doc, buffers, (int)indices, prim.Indices);
+			if (error != nullptr)
+				return Fail(error, mesh);
+
+			const int count = prim.Positions.Count;
+			if (prim.Positions.Components != 3 ||
+				(prim.HasNormals && (prim.Normals.Components != 3 || prim.Normals.Count != count)) ||
+				(prim.HasTexCoords && (prim.TexCoords.Components != 2 || prim.TexCoords.Count != count)) ||
+				(prim.HasIndices && (prim.Indices.Components != 1 || prim.Indices.ComponentType == GltfByte ||
+					prim.Indices.ComponentType == GltfShort || prim.Indices.ComponentType == GltfFloat)))
+			{
+				return Fail("a primitive's accessors have the wrong types or counts", mesh);
+			}
+
+			prim.IndexCount = (std::uint32_t)(prim.HasIndices ? prim.Indices.Count : count);
+			if (prim.IndexCount % 3 != 0)
+				return Fail("a triangle list's index count is not a multiple of 3", mesh);
+
+			prim.World = instance.World;
+			XMVECTOR determinant;
+			const XMMATRIX inverse = XMMatrixInverse(&determinant, XMLoadFloat4x4(&prim.World));
+			XMStoreFloat4x4(&prim.NormalMatrix, XMMatrixTranspose(inverse));
+			prim.Mirrored = XMVectorGetX(determinant) < 0.0f;
+
+			prim.FirstVertex = (std::uint32_t)vertexTotal;
+			prim.FirstIndex = (std::uint32_t)indexTotal;
+			vertexTotal += count;
+			indexTotal += prim.IndexCount;
+			if (vertexTotal > INT_MAX || indexTotal > INT_MAX)
+				return Fail("too many vertices", mesh);
+
+			// Named after the mesh, numbered for more than one primitive or instance.
+			std::string name = meshName != nullptr && !meshName->empty() ? *meshName : "mesh" + std::to_string(instance.Mesh);
+			if (doc.Size(primitiveArray) > 1)
+				name += "/" + std::to_string(p);
+			std::string unique = name;
+			for (int k = 2; std::any_of(mesh.Submeshes.begin(), mesh.Submeshes.end(),
+				[&](const ImportedSubmesh& s) { return s.Name == unique; }); ++k)
+			{
+				unique = name + "#" + std::to_string(k);
+			}
+
+			ImportedSubmesh submesh;
+			submesh.Name = unique;
+			submesh.StartIndex = prim.FirstIndex;
+			submesh.IndexCount = prim.IndexCount;
+			mesh.Submeshes.push_back(submesh);
+			primitives.push_back(prim);
+		}
+	}
+	if (primitives.empty())
+		return Fail("no triangle primitives", mesh);
+
+	mesh.Vertices.resize((std::size_t)vertexTotal);
+	mesh.Indices.resize((std::size_t)indexTotal);
+
+	std::vector<GltfJob> vertexJobs;
+	std::vector<GltfJob> triangleJobs;
+	for (int i = 0; i < (int)primitives.size(); ++i)
+	{
+		AddJobs(vertexJobs, i, primitives[i].Positions.Count, Grain);
+		AddJobs(triangleJobs, i, (int)primitives[i].IndexCount / 3, Grain);
+	}
+
+	ParallelFor(0, (int)vertexJobs.size(), [&](int j)
+	{
+		const GltfJob& job = vertexJobs[j];
+		const GltfPrimitive& prim = primitives[job.Primitive];
+		const XMMATRIX world = XMLoadFloat4x4(&prim.World);
+		const XMMATRIX normalMatrix = XMLoadFloat4x4(&prim.NormalMatrix);
+
+		auto read = [](const GltfAccessor& accessor, int i, float* out)
+		{
+			const std::uint8_t* p = accessor.Data + (std::size_t)i*accessor.Stride;
+			const int bytes = ComponentBytes(accessor.ComponentType);
+			for (int k = 0; k < accessor.Components; ++k)
+				out[k] = ReadComponent(p + k*bytes, accessor.ComponentType, accessor.Normalized);
+		};
+
+		for (int i = job.Begin; i < job.End; ++i)
+		{
+			MeshVertex& v = mesh.Vertices[prim.FirstVertex + i];
+
+			XMFLOAT3 position;
+			read(prim.Positions, i, &position.x);
+			XMStoreFloat3(&v.Pos, XMVector3TransformCoord(XMLoadFloat3(&position), world));
+
+			v.Normal = XMFLOAT3(0.0f, 0.0f, 0.0f);
+			if (prim.HasNormals)
+			{
+				XMFLOAT3 normal;
+				read(prim.Normals, i, &normal.x);
+				XMStoreFloat3(&v.Normal, XMVector3Normalize(XMVector3TransformNormal(XMLoadFloat3(&normal), normalMatrix)));
+			}
+
+			v.TexC = XMFLOAT2(0.0f, 0.0f);
+			if (prim.HasTexCoords)
+				read(prim.TexCoords, i, &v.TexC.x);
+		}
+	});
+
+	std::atomic<bool> badIndex(false);
+	ParallelFor(0, (int)triangleJobs.size(), [&](int j)
+	{
+		const GltfJob& job = triangleJobs[j];
+		const GltfPrimitive& prim = primitives[job.Primitive];
+		const std::uint32_t vertexCount = (std::uint32_t)prim.Positions.Count;
+
+		bool bad = false;
+		for (int t = job.Begin; t < job.End; ++t)
+		{
+			std::uint32_t corner[3];
+			for (int k = 0; k < 3; ++k)
+			{
+				const int i = 3*t + k;
+				corner[k] = prim.HasIndices ?
+					ReadIndex(prim.Indices.Data + (std::size_t)i*prim.Indices.Stride, prim.Indices.ComponentType) : (std::uint32_t)i;
+				bad |= corner[k] >= vertexCount;
+			}
+			if (prim.Mirrored)
+				std::swap(corner[1], corner[2]);
+
+			std::uint32_t* out = &mesh.Indices[prim.FirstIndex + 3*t];
+			for (int k = 0; k < 3; ++k)
+				out[k] = prim.FirstVertex + corner[k];
+		}
+		if (bad)
+			badIndex = true;
+	});
+	if (badIndex)
+		return Fail("an index is past the end of its primitive's vertices", mesh);
+
+	// Primitives exported without normals get smooth ones over their own triangles.
+	std::atomic<bool> generatedNormals(false);
+	ParallelFor(0, (int)primitives.size(), [&](int i)
+	{
+		const GltfPrimitive& prim = primitives[i];
+		if (prim.HasNormals)
+			return;
+
+		MeshVertex* vertices = mesh.Vertices.data();
+		const std::uint32_t* indices = mesh.Indices.data() + prim.FirstIndex;
+		for (std::uint32_t k = 0; k + 2 < prim.IndexCount; k += 3)
+		{
+			MeshVertex* corner[3] = { &vertices[indices[k]], &vertices[indices[k + 1]], &vertices[indices[k + 2]] };
+			const XMFLOAT3 n = FaceNormal(corner[0]->Pos, corner[1]->Pos, corner[2]->Pos);
+			for (MeshVertex* v : corner)
+				v->Normal = XMFLOAT3(v->Normal.x + n.x, v->Normal.y + n.y, v->Normal.z + n.z);
+		}
+		for (int v = 0; v < prim.Positions.Count; ++v)
+			vertices[prim.FirstVertex + v].Normal = NormalizeOrUp(vertices[prim.FirstVertex + v].Normal);
+		generatedNormals = true;
+	});
+
+	mStats.Corners = (int)indexTotal;
+	mStats.Vertices = (int)vertexTotal;
+	mStats.Triangles = (int)indexTotal / 3;
+	mStats.GeneratedNormals = generatedNormals;
+	FinishMesh(mesh, mOptions);
+	return true;
+}
@@ -0,0 +1,110 @@
+//***************************************************************************************
+// MeshImporter.h
+//
+// Loads artist meshes into the demo's vertex layout: Wavefront OBJ, and glTF 2.0 with
+// binary buffers (a .glb, or a .gltf next to its .bin files).  Files are memory mapped.
+// OBJ text is cut into line-aligned chunks parsed in parallel, numbers are read sixteen
+// digits at a time with SSE2, and the position/texcoord/normal triplets of the face
+// corners are welded into vertices through a lock-free hash table shared by the workers.
+// glTF accessors are converted in parallel ranges, through the node transforms of the
+// default scene.
+//
+// The result is one vertex buffer and one 32-bit index buffer (triangle lists, indices
+// relative to the first vertex) with a named, bounded submesh per OBJ material (or group
+// when there are no materials) and per glTF primitive: what a MeshGeometry and its
+// DrawArgs need.
+//***************************************************************************************
+
+#pragma once
+
+#include <DirectXMath.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Same layout as Vertex in FrameResource.h.
+struct MeshVertex
+{
+	DirectX::XMFLOAT3 Pos;
+	DirectX::XMFLOAT3 Normal;
+	DirectX::XMFLOAT2 TexC;
+};
+
+struct ImportedSubmesh
+{
+	std::string Name;
+	std::uint32_t StartIndex = 0;
+	std::uint32_t IndexCount = 0;
+	DirectX::XMFLOAT3 BoundsMin = { 0.0f, 0.0f, 0.0f };
+	DirectX::XMFLOAT3 BoundsMax = { 0.0f, 0.0f, 0.0f };
+};
+
+struct ImportedMesh
+{
+	std::vector<MeshVertex> Vertices;
+	std::vector<std::uint32_t> Indices;
+	std::vector<ImportedSubmesh> Submeshes;
+	DirectX::XMFLOAT3 BoundsMin = { 0.0f, 0.0f, 0.0f };
+	DirectX::XMFLOAT3 BoundsMax = { 0.0f, 0.0f, 0.0f };
+};
+
+struct MeshImportOptions
+{
+	// OBJ and glTF are right-handed: mirror z and reverse the winding for the demo.
+	bool ConvertToLeftHanded = true;
+
+	// Uniform scale applied to the positions, after the glTF node transforms.
+	float Scale = 1.0f;
+};
+
+struct MeshImportStats
+{
+	// The file plus any external buffers it loaded.
+	std::size_t InputBytes = 0;
+
+	// OBJ face corners after triangulation, or glTF indices.
+	int Corners = 0;
+	int Vertices = 0;
+	int Triangles = 0;
+
+	// glTF primitives that are not triangle lists.
+	int SkippedPrimitives = 0;
+
+	// Some vertices had no normal, so smooth normals were computed for them.
+	bool GeneratedNormals = false;
+};
+
+class MeshImporter
+{
+public:
+	MeshImportOptions& Options() { return mOptions; }
+
+	// Picks the format from the extension: .obj, .glb or .gltf.  Returns false if the
+	// file cannot be read or is malformed, see Error.
+	bool Import(const std::wstring& filename, ImportedMesh& mesh);
+
+	bool ParseObj(const char* text, std::size_t size, ImportedMesh& mesh);
+
+	// A .glb container; its first buffer is the container's binary chunk.
+	bool ParseGlb(const std::uint8_t* data, std::size_t size, ImportedMesh& mesh);
+
+	// A .gltf document; its buffers are read from files relative to directory, which
+	// ends in a separator or is empty.
+	bool ParseGltf(const char* json, std::size_t size, const std::wstring& directory, ImportedMesh& mesh);
+
+	// Of the last import.
+	const MeshImportStats& Stats()const { return mStats; }
+	const std::string& Error()const { return mError; }
+
+private:
+	bool ImportGltf(const char* json, std::size_t jsonSize, const std::uint8_t* binary,
+		std::size_t binarySize, const std::wstring& directory, ImportedMesh& mesh);
+
+	bool Fail(const std::string& message, ImportedMesh& mesh);
+
+private:
+	MeshImportOptions mOptions;
+	MeshImportStats mStats;
+	std::string mError;
+};
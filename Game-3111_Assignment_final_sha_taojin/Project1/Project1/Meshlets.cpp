@@ -0,0 +1,386 @@
+#include "Meshlets.h"
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+
+using namespace DirectX;
+
+namespace
+{
+	const std::uint8_t NoSlot = 0xff;
+
+	// Spreads the low 10 bits of v to every third bit.
+	std::uint32_t Part1By2(std::uint32_t v)
+	{
+		v &= 0x3ff;
+		v = (v | (v << 16)) & 0x030000ff;
+		v = (v | (v << 8)) & 0x0300f00f;
+		v = (v | (v << 4)) & 0x030c30c3;
+		v = (v | (v << 2)) & 0x09249249;
+		return v;
+	}
+
+	void ComputeBounds(const MeshletBuildDesc& desc, const MeshletMesh& mesh, const Meshlet& meshlet,
+		const std::uint8_t* positions, std::uint32_t stride, const std::vector<XMFLOAT3>& triangleNormals,
+		const std::vector<std::uint32_t>& meshletTriangles, MeshletBounds& bounds)
+	{
+		auto position = [&](std::uint32_t v)
+		{
+			return XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(positions + (size_t)v*stride));
+		};
+
+		XMVECTOR lo = XMVectorReplicate(FLT_MAX);
+		XMVECTOR hi = XMVectorReplicate(-FLT_MAX);
+		for (std::uint32_t k = 0; k < meshlet.VertexCount; ++k)
+		{
+			XMVECTOR p = position(mesh.Vertices[meshlet.VertexOffset + k]);
+			lo = XMVectorMin(lo, p);
+			hi = XMVectorMax(hi, p);
+		}
+
+		XMVECTOR center = XMVectorScale(XMVectorAdd(lo, hi), 0.5f);
+		float radius = 0.0f;
+		for (std::uint32_t k = 0; k < meshlet.VertexCount; ++k)
+		{
+			XMVECTOR p = position(mesh.Vertices[meshlet.VertexOffset + k]);
+			radius = std::max(radius, XMVectorGetX(XMVector3Length(XMVectorSubtract(p, center))));
+		}
+
+		XMStoreFloat3(&bounds.Center, center);
+		bounds.Radius = radius + desc.BoundsMargin;
+
+		// The cone axis is the average normal.  Triangles spread mindp = cos(a) around it;
+		// the eye directions from which all of them face away form the cone of half
+		// angle 90 - a around the axis, whose cosine is sin(a).
+		bounds.ConeAxis = XMFLOAT3(0.0f, 0.0f, 0.0f);
+		bounds.ConeCutoff = 1.0f;
+		if (!desc.NormalCones)
+			return;
+
+		XMVECTOR axis = XMVectorZero();
+		for (std::uint32_t t : meshletTriangles)
+			axis = XMVectorAdd(axis, XMLoadFloat3(&triangleNormals[t]));
+		if (XMVectorGetX(XMVector3LengthSq(axis)) < 1e-12f)
+			return;
+		axis = XMVector3Normalize(axis);
+
+		float mindp = 1.0f;
+		for (std::uint32_t t : meshletTriangles)
+		{
+			XMVECTOR n = XMLoadFloat3(&triangleNormals[t]);
+			if (XMVectorGetX(XMVector3LengthSq(n)) == 0.0f)
+				continue;
+			mindp = std::min(mindp, XMVectorGetX(XMVector3Dot(n, axis)));
+		}
+
+		XMStoreFloat3(&bounds.ConeAxis, axis);
+		if (mindp > 0.1f)
+			bounds.ConeCutoff = std::sqrt(1.0f - mindp*mindp);
+	}
+
+	template<typename Index>
+	void Build(const MeshletBuildDesc& desc, const void* positionData, std::uint32_t stride,
+		std::uint32_t vertexCount, const Index* indices, std::uint32_t indexCount, MeshletMesh& mesh)
+	{
+		assert(indexCount % 3 == 0);
+		assert(desc.MaxVertices >= 3 && desc.MaxVertices < NoSlot && desc.MaxTriangles >= 1);
+
+		const std::uint8_t* positions = static_cast<const std::uint8_t*>(positionData);
+		const std::uint32_t triangleCount = indexCount / 3;
+
+		mesh = MeshletMesh();
+		mesh.VertexCount = vertexCount;
+		mesh.Triangles.reserve(indexCount);
+
+		auto position = [&](std::uint32_t v)
+		{
+			return XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(positions + (size_t)v*stride));
+		};
+
+		// Centers and unit normals (zero for degenerate triangles).
+		std::vector<XMFLOAT3> centers(triangleCount);
+		std::vector<XMFLOAT3> normals(triangleCount);
+		XMVECTOR lo = XMVectorReplicate(FLT_MAX);
+		XMVECTOR hi = XMVectorReplicate(-FLT_MAX);
+		for (std::uint32_t t = 0; t < triangleCount; ++t)
+		{
+			assert(indices[3*t] < vertexCount && indices[3*t + 1] < vertexCount && indices[3*t + 2] < vertexCount);
+			XMVECTOR p0 = position(indices[3*t]);
+			XMVECTOR p1 = position(indices[3*t + 1]);
+			XMVECTOR p2 = position(indices[3*t + 2]);
+
+			XMVECTOR c = XMVectorScale(XMVectorAdd(XMVectorAdd(p0, p1), p2), 1.0f / 3.0f);
+			XMStoreFloat3(&centers[t], c);
+			lo = XMVectorMin(lo, c);
+			hi = XMVectorMax(hi, c);
+
+			XMVECTOR n = XMVector3Cross(XMVectorSubtract(p1, p0), XMVectorSubtract(p2, p0));
+			const float length = XMVectorGetX(XMVector3Length(n));
+			XMStoreFloat3(&normals[t], length > 1e-12f ? XMVectorScale(n, 1.0f / length) : XMVectorZero());
+		}
+
+		// Triangles of each vertex.
+		std::vector<std::uint32_t> adjacencyStart(vertexCount + 1, 0);
+		for (std::uint32_t i = 0; i < indexCount; ++i)
+			++adjacencyStart[indices[i] + 1];
+		for (std::uint32_t v = 0; v < vertexCount; ++v)
+			adjacencyStart[v + 1] += adjacencyStart[v];
+		std::vector<std::uint32_t> adjacency(indexCount);
+		{
+			std::vector<std::uint32_t> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+			for (std::uint32_t i = 0; i < indexCount; ++i)
+				adjacency[fill[indices[i]]++] = i / 3;
+		}
+
+		// Triangles along a Morton curve through their centers.
+		std::vector<std::pair<std::uint32_t, std::uint32_t>> order(triangleCount);
+		{
+			XMFLOAT3 origin, extent;
+			XMStoreFloat3(&origin, lo);
+			XMStoreFloat3(&extent, XMVectorMax(XMVectorSubtract(hi, lo), XMVectorReplicate(1e-6f)));
+			for (std::uint32_t t = 0; t < triangleCount; ++t)
+			{
+				auto cell = [](float x, float o, float e)
+				{
+					return (std::uint32_t)std::min(std::max((x - o) / e*1023.0f, 0.0f), 1023.0f);
+				};
+				const std::uint32_t code =
+					Part1By2(cell(centers[t].x, origin.x, extent.x)) |
+					(Part1By2(cell(centers[t].y, origin.y, extent.y)) << 1) |
+					(Part1By2(cell(centers[t].z, origin.z, extent.z)) << 2);
+				order[t] = std::make_pair(code, t);
+			}
+			std::sort(order.begin(), order.end());
+		}
+		std::uint32_t cursor = 0;
+
+		std::vector<std::uint8_t> used(triangleCount, 0);
+		std::vector<std::uint8_t> slot(vertexCount, NoSlot);
+		std::vector<std::uint32_t> meshletTriangles;
+		meshletTriangles.reserve(desc.MaxTriangles);
+
+		Meshlet meshlet;
+		XMVECTOR centerSum = XMVectorZero();
+
+		auto newVertices = [&](std::uint32_t t)
+		{
+			const Index a = indices[3*t], b = indices[3*t + 1], c = indices[3*t + 2];
+			std::uint32_t count = (slot[a] == NoSlot) + (slot[b] == NoSlot && b != a) +
+				(slot[c] == NoSlot && c != a && c != b);
+			return count;
+		};
+
+		auto finish = [&]()
+		{
+			if (meshlet.TriangleCount == 0)
+				return;
+			for (std::uint32_t k = 0; k < meshlet.VertexCount; ++k)
+				slot[mesh.Vertices[meshlet.VertexOffset + k]] = NoSlot;
+
+			MeshletBounds bounds;
+			ComputeBounds(desc, mesh, meshlet, positions, stride, normals, meshletTriangles, bounds);
+			mesh.Meshlets.push_back(meshlet);
+			mesh.Bounds.push_back(bounds);
+
+			meshlet = Meshlet();
+			meshlet.VertexOffset = (std::uint32_t)mesh.Vertices.size();
+			meshlet.TriangleOffset = (std::uint32_t)(mesh.Triangles.size() / 3);
+			meshletTriangles.clear();
+			centerSum = XMVectorZero();
+		};
+
+		auto add = [&](std::uint32_t t)
+		{
+			for (int k = 0; k < 3; ++k)
+			{
+				const Index v = indices[3*t + k];
+				if (slot[v] == NoSlot)
+				{
+					slot[v] = (std::uint8_t)meshlet.VertexCount++;
+					mesh.Vertices.push_back(v);
+				}
+				mesh.Triangles.push_back(slot[v]);
+			}
+			used[t] = 1;
+			++meshlet.TriangleCount;
+			meshletTriangles.push_back(t);
+			centerSum = XMVectorAdd(centerSum, XMLoadFloat3(&centers[t]));
+		};
+
+		for (std::uint32_t added = 0; added < triangleCount; )
+		{
+			if (meshlet.TriangleCount == desc.MaxTriangles)
+				finish();
+
+			// The neighbor needing the fewest new vertices, then nearest the center.
+			std::uint32_t best = UINT32_MAX;
+			std::uint32_t bestNew = UINT32_MAX;
+			float bestDistance = FLT_MAX;
+			bool anyNeighbor = false;
+			if (meshlet.TriangleCount > 0)
+			{
+				const XMVECTOR center = XMVectorScale(centerSum, 1.0f / meshlet.TriangleCount);
+				for (std::uint32_t k = 0; k < meshlet.VertexCount; ++k)
+				{
+					const std::uint32_t v = mesh.Vertices[meshlet.VertexOffset + k];
+					for (std::uint32_t a = adjacencyStart[v]; a < adjacencyStart[v + 1]; ++a)
+					{
+						const std::uint32_t t = adjacency[a];
+						if (used[t])
+							continue;
+						anyNeighbor = true;
+
+						const std::uint32_t extra = newVertices(t);
+						if (meshlet.VertexCount + extra > desc.MaxVertices || extra > bestNew)
+							continue;
+						const float distance = XMVectorGetX(XMVector3LengthSq(
+							XMVectorSubtract(XMLoadFloat3(&centers[t]), center)));
+						if (extra < bestNew || distance < bestDistance)
+						{
+							best = t;
+							bestNew = extra;
+							bestDistance = distance;
+						}
+					}
+				}
+			}
+
+			if (best == UINT32_MAX)
+			{
+				// Neighbors that do not fit mean the meshlet is full.  Otherwise it
+				// continues, or a new one starts, at the next triangle along the curve.
+				if (anyNeighbor)
+				{
+					finish();
+					continue;
+				}
+
+				while (used[order[cursor].second])
+					++cursor;
+				best = order[cursor].second;
+				if (meshlet.VertexCount + newVertices(best) > desc.MaxVertices)
+				{
+					finish();
+					continue;
+				}
+			}
+
+			add(best);
+			++added;
+		}
+		finish();
+	}
+
+	template<typename Index>
+	std::uint32_t Cull(const MeshletMesh& mesh, const MeshletCullView& view, Index* out, MeshletCullStats* stats)
+	{
+		MeshletCullStats local;
+		std::uint32_t written = 0;
+		for (size_t m = 0; m < mesh.Meshlets.size(); ++m)
+		{
+			++local.Meshlets;
+
+			bool coneCulled = false;
+			if (!MeshletVisible(mesh.Bounds[m], view, &coneCulled))
+			{
+				++(coneCulled ? local.ConeCulled : local.FrustumCulled);
+				continue;
+			}
+
+			const Meshlet& meshlet = mesh.Meshlets[m];
+			const std::uint32_t* vertices = &mesh.Vertices[meshlet.VertexOffset];
+			const std::uint8_t* triangles = &mesh.Triangles[(size_t)meshlet.TriangleOffset*3];
+			for (std::uint32_t i = 0; i < meshlet.TriangleCount*3; ++i)
+				out[written++] = (Index)vertices[triangles[i]];
+			local.Triangles += meshlet.TriangleCount;
+		}
+
+		if (stats != nullptr)
+			stats->Add(local);
+		return written;
+	}
+}
+
+void BuildMeshlets(const MeshletBuildDesc& desc, const void* positions, std::uint32_t stride,
+	std::uint32_t vertexCount, const std::uint32_t* indices, std::uint32_t indexCount, MeshletMesh& mesh)
+{
+	Build(desc, positions, stride, vertexCount, indices, indexCount, mesh);
+}
+
+void BuildMeshlets(const MeshletBuildDesc& desc, const void* positions, std::uint32_t stride,
+	std::uint32_t vertexCount, const std::uint16_t* indices, std::uint32_t indexCount, MeshletMesh& mesh)
+{
+	Build(desc, positions, stride, vertexCount, indices, indexCount, mesh);
+}
+
+void BuildMeshlets(const MeshletBuildDesc& desc, const GeometryGenerator::MeshData& meshData, MeshletMesh& mesh)
+{
+	Build(desc, meshData.Vertices.empty() ? nullptr : &meshData.Vertices[0].Position,
+		(std::uint32_t)sizeof(GeometryGenerator::Vertex), (std::uint32_t)meshData.Vertices.size(),
+		meshData.Indices32.data(), (std::uint32_t)meshData.Indices32.size(), mesh);
+}
+
+MeshletCullView MakeMeshletCullView(FXMMATRIX world, CXMMATRIX viewProj, FXMVECTOR eyeW)
+{
+	// Clip space is p*M for M = world*viewProj; the rows of M's transpose are its
+	// columns, and each plane is a sum of two of them (D3D depth runs 0 to w).
+	const XMMATRIX columns = XMMatrixTranspose(XMMatrixMultiply(world, viewProj));
+	const XMVECTOR planes[6] =
+	{
+		XMVectorAdd(columns.r[3], columns.r[0]),
+		XMVectorSubtract(columns.r[3], columns.r[0]),
+		XMVectorAdd(columns.r[3], columns.r[1]),
+		XMVectorSubtract(columns.r[3], columns.r[1]),
+		columns.r[2],
+		XMVectorSubtract(columns.r[3], columns.r[2])
+	};
+
+	MeshletCullView view;
+	for (int k = 0; k < 6; ++k)
+		XMStoreFloat4(&view.Planes[k], XMPlaneNormalize(planes[k]));
+
+	XMVECTOR determinant;
+	const XMMATRIX invWorld = XMMatrixInverse(&determinant, world);
+	XMStoreFloat3(&view.Eye, XMVector3TransformCoord(eyeW, invWorld));
+	return view;
+}
+
+bool MeshletVisible(const MeshletBounds& bounds, const MeshletCullView& view, bool* coneCulled)
+{
+	if (coneCulled != nullptr)
+		*coneCulled = false;
+
+	const XMVECTOR center = XMLoadFloat3(&bounds.Center);
+	for (int k = 0; k < 6; ++k)
+	{
+		if (XMVectorGetX(XMPlaneDotCoord(XMLoadFloat4(&view.Planes[k]), center)) < -bounds.Radius)
+			return false;
+	}
+
+	if (bounds.ConeCutoff < 1.0f)
+	{
+		const XMVECTOR toCenter = XMVectorSubtract(center, XMLoadFloat3(&view.Eye));
+		const float along = XMVectorGetX(XMVector3Dot(toCenter, XMLoadFloat3(&bounds.ConeAxis)));
+		if (along >= bounds.ConeCutoff*XMVectorGetX(XMVector3Length(toCenter)) + bounds.Radius)
+		{
+			if (coneCulled != nullptr)
+				*coneCulled = true;
+			return false;
+		}
+	}
+	return true;
+}
+
+std::uint32_t CullMeshlets(const MeshletMesh& mesh, const MeshletCullView& view, std::uint16_t* out,
+	MeshletCullStats* stats)
+{
+	assert(mesh.VertexCount <= 0x10000);
+	return Cull(mesh, view, out, stats);
+}
+
+std::uint32_t CullMeshlets(const MeshletMesh& mesh, const MeshletCullView& view, std::uint32_t* out,
+	MeshletCullStats* stats)
+{
+	return Cull(mesh, view, out, stats);
+}
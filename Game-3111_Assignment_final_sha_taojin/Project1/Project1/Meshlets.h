@@ -0,0 +1,125 @@
+//***************************************************************************************
+// Meshlets.h
+//
+// Splits an indexed triangle mesh into meshlets: clusters of at most MaxVertices vertices
+// and MaxTriangles triangles, each triangle indexing the meshlet's own vertex list, the
+// layout a mesh shader consumes.  Every meshlet gets a bounding sphere and a normal cone,
+// so a whole cluster can be skipped when it is outside the frustum or all its triangles
+// face away from the eye.  Until there is a mesh shader path, CullMeshlets writes the
+// triangles of the surviving meshlets as a compacted index list for an ordinary indexed
+// draw.
+//
+// A meshlet grows from a seed triangle by adding the adjacent triangle that needs the
+// fewest new vertices, nearest the meshlet's center first.  When no unused neighbor is
+// left, the next unused triangle along a Morton curve through the triangle centers seeds
+// or continues it, which keeps meshlets compact on meshes of disconnected pieces too.
+//***************************************************************************************
+
+#pragma once
+
+#include "../../Common/GeometryGenerator.h"
+#include <DirectXMath.h>
+#include <cstdint>
+#include <vector>
+
+struct Meshlet
+{
+	// Into MeshletMesh::Vertices, and into MeshletMesh::Triangles in whole triangles.
+	std::uint32_t VertexOffset = 0;
+	std::uint32_t VertexCount = 0;
+	std::uint32_t TriangleOffset = 0;
+	std::uint32_t TriangleCount = 0;
+};
+
+struct MeshletBounds
+{
+	DirectX::XMFLOAT3 Center = { 0.0f, 0.0f, 0.0f };
+	float Radius = 0.0f;
+
+	// Every triangle faces away from an eye e when
+	//   dot(Center - e, ConeAxis) >= ConeCutoff*|Center - e| + Radius.
+	// ConeCutoff is 1, which never culls, when the normals spread too far.
+	DirectX::XMFLOAT3 ConeAxis = { 0.0f, 0.0f, 0.0f };
+	float ConeCutoff = 1.0f;
+};
+
+struct MeshletBuildDesc
+{
+	// Local vertex indices are bytes, so MaxVertices is at most 255.
+	std::uint32_t MaxVertices = 64;
+	std::uint32_t MaxTriangles = 124;
+
+	// Added to every radius, for vertices that move up to this far from where they were
+	// at build time (the waves).
+	float BoundsMargin = 0.0f;
+
+	// False gives every meshlet a cone that never culls, for meshes whose normals change.
+	bool NormalCones = true;
+};
+
+struct MeshletMesh
+{
+	std::vector<Meshlet> Meshlets;
+	std::vector<MeshletBounds> Bounds;
+
+	// The mesh's vertex indices, meshlet after meshlet.
+	std::vector<std::uint32_t> Vertices;
+
+	// Three local indices per triangle, each below its meshlet's VertexCount.
+	std::vector<std::uint8_t> Triangles;
+
+	std::uint32_t VertexCount = 0;
+
+	std::uint32_t TriangleCount()const { return (std::uint32_t)(Triangles.size() / 3); }
+	std::uint32_t IndexCount()const { return (std::uint32_t)Triangles.size(); }
+};
+
+// Builds the meshlets of a triangle list.  positions holds vertexCount positions stride
+// bytes apart; indices holds indexCount indices, a multiple of three.  Vertex indices in
+// the result are the mesh's.
+void BuildMeshlets(const MeshletBuildDesc& desc, const void* positions, std::uint32_t stride,
+	std::uint32_t vertexCount, const std::uint32_t* indices, std::uint32_t indexCount, MeshletMesh& mesh);
+void BuildMeshlets(const MeshletBuildDesc& desc, const void* positions, std::uint32_t stride,
+	std::uint32_t vertexCount, const std::uint16_t* indices, std::uint32_t indexCount, MeshletMesh& mesh);
+void BuildMeshlets(const MeshletBuildDesc& desc, const GeometryGenerator::MeshData& meshData, MeshletMesh& mesh);
+
+// The frustum and eye in a mesh's object space, where the culling happens so it is exact
+// under any affine world matrix.  A point p is inside plane k when
+// dot(Planes[k].xyz, p) + Planes[k].w >= 0.
+struct MeshletCullView
+{
+	DirectX::XMFLOAT4 Planes[6];
+	DirectX::XMFLOAT3 Eye = { 0.0f, 0.0f, 0.0f };
+};
+
+// From the mesh's world matrix and the camera's view-projection (D3D depth range) and
+// world space eye position.
+MeshletCullView MakeMeshletCullView(DirectX::FXMMATRIX world, DirectX::CXMMATRIX viewProj, DirectX::FXMVECTOR eyeW);
+
+struct MeshletCullStats
+{
+	std::uint32_t Meshlets = 0;
+	std::uint32_t FrustumCulled = 0;
+	std::uint32_t ConeCulled = 0;
+	std::uint32_t Triangles = 0;
+
+	void Add(const MeshletCullStats& rhs)
+	{
+		Meshlets += rhs.Meshlets;
+		FrustumCulled += rhs.FrustumCulled;
+		ConeCulled += rhs.ConeCulled;
+		Triangles += rhs.Triangles;
+	}
+};
+
+// True if the meshlet with these bounds may be visible.
+bool MeshletVisible(const MeshletBounds& bounds, const MeshletCullView& view, bool* coneCulled = nullptr);
+
+// Writes the triangles of the meshlets that may be visible to out, which has room for
+// mesh.IndexCount() indices, as the mesh's vertex indices.  Writes are sequential, so out
+// can be mapped upload memory.  Returns the number of indices written; stats, if given,
+// is added to.  The 16-bit version requires fewer than 65536 vertices.
+std::uint32_t CullMeshlets(const MeshletMesh& mesh, const MeshletCullView& view, std::uint16_t* out,
+	MeshletCullStats* stats = nullptr);
+std::uint32_t CullMeshlets(const MeshletMesh& mesh, const MeshletCullView& view, std::uint32_t* out,
+	MeshletCullStats* stats = nullptr);
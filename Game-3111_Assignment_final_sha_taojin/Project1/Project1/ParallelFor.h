@@ -0,0 +1,341 @@
+//***************************************************************************************
+// ParallelFor.h
+//
+// Thin wrapper over concurrency::parallel_for.  The engine-side CPU modules go through
+// this so they can also be compiled into the headless tools on platforms without the PPL,
+// where the calls run on a pool of worker threads created once (WorkerPool).
+//***************************************************************************************
+
+#pragma once
+
+#include <algorithm>
+#include <thread>
+
+#if defined(_MSC_VER)
+#include <ppl.h>
+#else
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <vector>
+#endif
+
+namespace ParallelForDetail
+{
+	// Upper bound set by ScopedWorkerLimit; 0 means no limit.
+	inline int& WorkerLimit()
+	{
+		static int limit = 0;
+		return limit;
+	}
+
+#if !defined(_MSC_VER)
+	// One ParallelFor or ParallelForAlongside call.  Indices up to Last are handed
+	// out through Next to the posting thread and up to MaxHelpers pool workers.
+	struct Job
+	{
+		void(*Invoke)(const void* func, int i) = nullptr;
+		const void* Func = nullptr;
+		int Last = 0;
+		int MaxHelpers = 0;
+		std::atomic<int> Next{ 0 };
+
+		// Guarded by the pool's lock.
+		int Helpers = 0;
+		std::exception_ptr Error;
+	};
+
+	template<typename Func>
+	void InvokeFunc(const void* func, int i)
+	{
+		(*static_cast<const Func*>(func))(i);
+	}
+
+	// hardware_concurrency()-1 threads started on first use and kept for the life of the
+	// process, so a ParallelFor costs a wake-up instead of creating and joining threads.
+	// The posting thread always works on its own job too and finishes it alone if every
+	// worker is busy, so nested and concurrent calls cannot deadlock.
+	class WorkerPool
+	{
+	public:
+		static WorkerPool& Instance()
+		{
+			static WorkerPool pool;
+			return pool;
+		}
+
+		WorkerPool(const WorkerPool& rhs) = delete;
+		WorkerPool& operator=(const WorkerPool& rhs) = delete;
+
+		~WorkerPool()
+		{
+			{
+				std::lock_guard<std::mutex> held(mLock);
+				mStop = true;
+			}
+			mWake.notify_all();
+			for (auto& t : mThreads)
+				t.join();
+		}
+
+		int ThreadCount()const { return (int)mThreads.size(); }
+
+		// Makes job's indices available to the workers.
+		void Post(Job& job)
+		{
+			{
+				std::lock_guard<std::mutex> held(mLock);
+				mJobs.push_back(&job);
+			}
+			mWake.notify_all();
+		}
+
+		// Runs the indices of job nobody has claimed yet, waits for the workers still on it
+		// and rethrows the first exception thrown by its calls.
+		void Finish(Job& job)
+		{
+			Execute(job);
+
+			std::unique_lock<std::mutex> held(mLock);
+			mJobs.erase(std::find(mJobs.begin(), mJobs.end(), &job));
+			mDone.wait(held, [&]() { return job.Helpers == 0; });
+			if (job.Error)
+				std::rethrow_exception(job.Error);
+		}
+
+		// Stops handing out the indices of job and waits for the workers still on it.
+		void Cancel(Job& job)
+		{
+			job.Next = job.Last;
+
+			std::unique_lock<std::mutex> held(mLock);
+			mJobs.erase(std::find(mJobs.begin(), mJobs.end(), &job));
+			mDone.wait(held, [&]() { return job.Helpers == 0; });
+		}
+
+	private:
+		WorkerPool()
+		{
+			unsigned int n = std::thread::hardware_concurrency();
+			int count = n > 1 ? (int)n - 1 : 0;
+			mThreads.reserve(count);
+			for (int t = 0; t < count; ++t)
+				mThreads.emplace_back([this]() { WorkerMain(); });
+		}
+
+		void Execute(Job& job)
+		{
+			for (int i = job.Next++; i < job.Last; i = job.Next++)
+			{
+				try
+				{
+					job.Invoke(job.Func, i);
+				}
+				catch (...)
+				{
+					job.Next = job.Last;
+					std::lock_guard<std::mutex> held(mLock);
+					if (!job.Error)
+						job.Error = std::current_exception();
+				}
+			}
+		}
+
+		Job* FindJob()const
+		{
+			for (Job* job : mJobs)
+			{
+				if (job->Helpers < job->MaxHelpers && job->Next.load() < job->Last)
+					return job;
+			}
+			return nullptr;
+		}
+
+		void WorkerMain()
+		{
+			std::unique_lock<std::mutex> held(mLock);
+			for (;;)
+			{
+				Job* job = nullptr;
+				mWake.wait(held, [&]() { return mStop || (job = FindJob()) != nullptr; });
+				if (mStop)
+					return;
+
+				++job->Helpers;
+				held.unlock();
+				Execute(*job);
+				held.lock();
+				if (--job->Helpers == 0)
+					mDone.notify_all();
+			}
+		}
+
+	private:
+		std::mutex mLock;
+		std::condition_variable mWake;
+		std::condition_variable mDone;
+		std::vector<Job*> mJobs;
+		std::vector<std::thread> mThreads;
+		bool mStop = false;
+	};
+#endif
+}
+
+// Number of worker threads the CPU modules should plan for (at least 1).
+inline int WorkerCount()
+{
+	unsigned int n = std::thread::hardware_concurrency();
+	int count = n == 0 ? 1 : (int)n;
+	int limit = ParallelForDetail::WorkerLimit();
+	return limit > 0 ? std::min(count, limit) : count;
+}
+
+// Caps the number of workers used by ParallelFor while in scope, e.g. to measure
+// scaling.  Create it on the thread that issues the ParallelFor calls and do not nest
+// it across threads.
+class ScopedWorkerLimit
+{
+public:
+	explicit ScopedWorkerLimit(int maxWorkers)
+		: mPreviousLimit(ParallelForDetail::WorkerLimit())
+	{
+		ParallelForDetail::WorkerLimit() = std::max(maxWorkers, 1);
+
+#if defined(_MSC_VER)
+		// parallel_for runs on the current scheduler, so give this thread one of its own.
+		concurrency::CurrentScheduler::Create(concurrency::SchedulerPolicy(2,
+			concurrency::MinConcurrency, 1u,
+			concurrency::MaxConcurrency, (unsigned int)ParallelForDetail::WorkerLimit()));
+#endif
+	}
+
+	ScopedWorkerLimit(const ScopedWorkerLimit& rhs) = delete;
+	ScopedWorkerLimit& operator=(const ScopedWorkerLimit& rhs) = delete;
+
+	~ScopedWorkerLimit()
+	{
+#if defined(_MSC_VER)
+		concurrency::CurrentScheduler::Detach();
+#endif
+		ParallelForDetail::WorkerLimit() = mPreviousLimit;
+	}
+
+private:
+	int mPreviousLimit;
+};
+
+// Calls func(i) for every i in [first, last), possibly in parallel.
+template<typename Func>
+inline void ParallelFor(int first, int last, const Func& func)
+{
+	if (last <= first)
+		return;
+
+#if defined(_MSC_VER)
+	concurrency::parallel_for(first, last, func);
+#else
+	const int count = last - first;
+	const int threadCount = std::min(WorkerCount(), count);
+	if (threadCount <= 1)
+	{
+		for (int i = first; i < last; ++i)
+			func(i);
+		return;
+	}
+
+	// Hand out indices dynamically so uneven work still balances.
+	ParallelForDetail::Job job;
+	job.Invoke = &ParallelForDetail::InvokeFunc<Func>;
+	job.Func = &func;
+	job.Last = last;
+	job.MaxHelpers = threadCount - 1;
+	job.Next = first;
+
+	ParallelForDetail::WorkerPool& pool = ParallelForDetail::WorkerPool::Instance();
+	pool.Post(job);
+	pool.Finish(job);
+#endif
+}
+
+// Splits [0, count) into contiguous ranges of at most grainSize elements and calls
+// func(begin, end) for each range, possibly in parallel.
+template<typename Func>
+inline void ParallelForRange(int count, int grainSize, const Func& func)
+{
+	if (count <= 0)
+		return;
+
+	grainSize = std::max(grainSize, 1);
+	const int chunkCount = (count + grainSize - 1) / grainSize;
+	ParallelFor(0, chunkCount, [&](int chunk)
+	{
+		int begin = chunk * grainSize;
+		func(begin, std::min(begin + grainSize, count));
+	});
+}
+
+// Calls func(i) for every i in [first, last) on other threads while the calling thread
+// runs callerFunc, and returns when all of them have finished.  For work where the
+// calling thread has a part of its own, e.g. InitGraph's Caller lane.  func must not
+// wait for callerFunc to finish: with a single hardware thread the calls to func run
+// after it.
+template<typename Func, typename CallerFunc>
+inline void ParallelForAlongside(int first, int last, const Func& func, const CallerFunc& callerFunc)
+{
+#if defined(_MSC_VER)
+	concurrency::task_group helpers;
+	helpers.run([&]() { concurrency::parallel_for(first, last, func); });
+	try
+	{
+		callerFunc();
+	}
+	catch (...)
+	{
+		helpers.wait();
+		throw;
+	}
+	helpers.wait();
+#else
+	if (last <= first)
+	{
+		callerFunc();
+		return;
+	}
+
+	// Every call to func may need a thread of its own, so only post them when the pool
+	// has a worker for each; otherwise they run on the caller after callerFunc.
+	ParallelForDetail::WorkerPool& pool = ParallelForDetail::WorkerPool::Instance();
+	ParallelForDetail::Job job;
+	job.Invoke = &ParallelForDetail::InvokeFunc<Func>;
+	job.Func = &func;
+	job.Last = last;
+	job.MaxHelpers = WorkerCount() > 1 ? last - first : 0;
+	job.Next = first;
+
+	const bool posted = job.MaxHelpers > 0 && job.MaxHelpers <= pool.ThreadCount();
+	if (posted)
+		pool.Post(job);
+
+	try
+	{
+		callerFunc();
+	}
+	catch (...)
+	{
+		if (posted)
+			pool.Cancel(job);
+		throw;
+	}
+
+	if (posted)
+	{
+		pool.Finish(job);
+	}
+	else
+	{
+		for (int i = first; i < last; ++i)
+			func(i);
+	}
+#endif
+}
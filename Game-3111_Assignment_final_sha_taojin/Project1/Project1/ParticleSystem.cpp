@@ -0,0 +1,335 @@
+#include "ParticleSystem.h"
+#include "Heightmap.h"
+#include "ParallelFor.h"
+#include "Waves.h"
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+using namespace DirectX;
+
+namespace
+{
+	std::size_t PaddedCapacity(int capacity)
+	{
+		return ((std::size_t)std::max(capacity, 0) + 3) & ~(std::size_t)3;
+	}
+
+	// Height of what a particle at (x, z) lands on: the terrain, or the water where it
+	// is higher.
+	float FloorHeight(const ParticleColliders& colliders, float x, float z)
+	{
+		float floor = -FLT_MAX;
+		if (colliders.Terrain != nullptr && !colliders.Terrain->IsEmpty())
+			floor = colliders.Terrain->Height(x, z);
+
+		float water = 0.0f;
+		if (colliders.Water != nullptr && colliders.Water->Height(x, z, water))
+			floor = std::max(floor, water);
+		return floor;
+	}
+
+	XMVECTOR LoadLanes(const float* p)
+	{
+		return XMLoadFloat4A(reinterpret_cast<const XMFLOAT4A*>(p));
+	}
+
+	void StoreLanes(float* p, FXMVECTOR v)
+	{
+		XMStoreFloat4A(reinterpret_cast<XMFLOAT4A*>(p), v);
+	}
+}
+
+bool ParticleSystem::Create(const std::vector<ParticlePoolDesc>& pools, std::uint32_t seed)
+{
+	mPools.clear();
+	mEmitters.clear();
+	mSeenDisturbEvents = 0;
+	mDropped = 0;
+	mRng.seed(seed);
+
+	std::size_t bytes = 64;
+	for (const ParticlePoolDesc& desc : pools)
+	{
+		const std::size_t padded = PaddedCapacity(desc.Capacity);
+		const std::size_t chunkCount = (padded + ChunkSize - 1) / ChunkSize;
+		bytes += StreamCount*(padded*sizeof(float) + 64) + chunkCount*sizeof(int) + 64;
+	}
+	if (!mArena.Create("particles", bytes, MemoryArena::LargePages))
+		return false;
+
+	for (const ParticlePoolDesc& desc : pools)
+	{
+		Pool pool;
+		pool.Desc = desc;
+		pool.Capacity = std::max(desc.Capacity, 0);
+
+		// The lanes past Count are loaded with the live ones, so they must hold numbers.
+		const std::size_t padded = PaddedCapacity(desc.Capacity);
+		for (int s = 0; s < StreamCount; ++s)
+		{
+			pool.Streams[s] = static_cast<float*>(mArena.Allocate(padded*sizeof(float), 64));
+			std::memset(pool.Streams[s], 0, padded*sizeof(float));
+		}
+		pool.ChunkLive = mArena.AllocateArray<int>((padded + ChunkSize - 1) / ChunkSize);
+
+		mPools.push_back(pool);
+	}
+
+	return true;
+}
+
+int ParticleSystem::AddEmitter(const ParticleEmitter& emitter)
+{
+	mEmitters.push_back(emitter);
+	return (int)mEmitters.size() - 1;
+}
+
+bool ParticleSystem::Spawn(int poolIndex, const XMFLOAT3& pos, const XMFLOAT3& vel, float life)
+{
+	assert(poolIndex >= 0 && poolIndex < (int)mPools.size());
+
+	Pool& pool = mPools[poolIndex];
+	if (pool.Count == pool.Capacity)
+	{
+		++mDropped;
+		return false;
+	}
+
+	const int i = pool.Count++;
+	pool.Streams[PosX][i] = pos.x;
+	pool.Streams[PosY][i] = pos.y;
+	pool.Streams[PosZ][i] = pos.z;
+	pool.Streams[VelX][i] = vel.x;
+	pool.Streams[VelY][i] = vel.y;
+	pool.Streams[VelZ][i] = vel.z;
+	pool.Streams[Age][i] = 0.0f;
+	pool.Streams[Life][i] = std::max(life, 1e-3f);
+	return true;
+}
+
+void ParticleSystem::Clear()
+{
+	for (Pool& pool : mPools)
+		pool.Count = 0;
+}
+
+int ParticleSystem::LiveCount()const
+{
+	int count = 0;
+	for (const Pool& pool : mPools)
+		count += pool.Count;
+	return count;
+}
+
+int ParticleSystem::Capacity()const
+{
+	int capacity = 0;
+	for (const Pool& pool : mPools)
+		capacity += pool.Capacity;
+	return capacity;
+}
+
+int ParticleSystem::StreamOffset(int pool)const
+{
+	int offset = 0;
+	for (int p = 0; p < pool; ++p)
+		offset += mPools[p].Count;
+	return offset;
+}
+
+void ParticleSystem::Update(float dt, const ParticleColliders& colliders)
+{
+	Emit(dt, colliders);
+
+	for (Pool& pool : mPools)
+	{
+		if (pool.Count == 0)
+			continue;
+
+		const int chunkCount = (pool.Count + ChunkSize - 1) / ChunkSize;
+		ParallelFor(0, chunkCount, [&](int chunk)
+		{
+			UpdateChunk(pool, chunk, dt, colliders);
+		});
+
+		// Each chunk compacted its own survivors; close the gaps between the chunks.
+		int live = pool.ChunkLive[0];
+		for (int chunk = 1; chunk < chunkCount; ++chunk)
+		{
+			const int begin = chunk*ChunkSize;
+			const int count = pool.ChunkLive[chunk];
+			if (live != begin && count > 0)
+			{
+				for (int s = 0; s < StreamCount; ++s)
+					std::memmove(&pool.Streams[s][live], &pool.Streams[s][begin], count*sizeof(float));
+			}
+			live += count;
+		}
+		pool.Count = live;
+	}
+}
+
+void ParticleSystem::UpdateChunk(Pool& pool, int chunk, float dt, const ParticleColliders& colliders)
+{
+	const ParticlePoolDesc& desc = pool.Desc;
+	const int begin = chunk*ChunkSize;
+	const int end = std::min(begin + ChunkSize, pool.Count);
+
+	const XMVECTOR vdt = XMVectorReplicate(dt);
+	const XMVECTOR gravity = XMVectorReplicate(desc.Gravity*dt);
+	const XMVECTOR drag = XMVectorReplicate(std::exp(-desc.Drag*dt));
+	const XMVECTOR restitution = XMVectorReplicate(-desc.Restitution);
+	const XMVECTOR friction = XMVectorReplicate(desc.Friction);
+	const bool bounce = desc.Collision == ParticleCollision::Bounce;
+
+	float* const* streams = pool.Streams;
+	alignas(16) float lanes[StreamCount][4];
+	alignas(16) float floor[4];
+	std::uint32_t alive[4];
+
+	int live = begin;
+	for (int i = begin; i < end; i += 4)
+	{
+		XMVECTOR px = LoadLanes(&streams[PosX][i]);
+		XMVECTOR py = LoadLanes(&streams[PosY][i]);
+		XMVECTOR pz = LoadLanes(&streams[PosZ][i]);
+		XMVECTOR vx = LoadLanes(&streams[VelX][i]);
+		XMVECTOR vy = LoadLanes(&streams[VelY][i]);
+		XMVECTOR vz = LoadLanes(&streams[VelZ][i]);
+		XMVECTOR age = LoadLanes(&streams[Age][i]);
+		const XMVECTOR life = LoadLanes(&streams[Life][i]);
+
+		vy = XMVectorAdd(vy, gravity);
+		vx = XMVectorMultiply(vx, drag);
+		vy = XMVectorMultiply(vy, drag);
+		vz = XMVectorMultiply(vz, drag);
+
+		px = XMVectorMultiplyAdd(vx, vdt, px);
+		py = XMVectorMultiplyAdd(vy, vdt, py);
+		pz = XMVectorMultiplyAdd(vz, vdt, pz);
+		age = XMVectorAdd(age, vdt);
+
+		// The surface under each lane; the terrain and water lookups are scalar.
+		StoreLanes(lanes[PosX], px);
+		StoreLanes(lanes[PosZ], pz);
+		for (int k = 0; k < 4; ++k)
+			floor[k] = FloorHeight(colliders, lanes[PosX][k], lanes[PosZ][k]);
+		const XMVECTOR floorY = LoadLanes(floor);
+		const XMVECTOR hit = XMVectorLess(py, floorY);
+
+		XMVECTOR keep = XMVectorLess(age, life);
+		if (bounce)
+		{
+			// Put the lanes that went through the surface back on it, moving up.
+			py = XMVectorSelect(py, floorY, hit);
+			vy = XMVectorSelect(vy, XMVectorMultiply(XMVectorMin(vy, XMVectorZero()), restitution), hit);
+			vx = XMVectorSelect(vx, XMVectorMultiply(vx, friction), hit);
+			vz = XMVectorSelect(vz, XMVectorMultiply(vz, friction), hit);
+		}
+		else
+		{
+			keep = XMVectorAndCInt(keep, hit);
+		}
+
+		StoreLanes(lanes[PosY], py);
+		StoreLanes(lanes[VelX], vx);
+		StoreLanes(lanes[VelY], vy);
+		StoreLanes(lanes[VelZ], vz);
+		StoreLanes(lanes[Age], age);
+		StoreLanes(lanes[Life], life);
+		XMStoreInt4(alive, keep);
+
+		// Write the survivors back packed.  live never passes i, so nothing unread is
+		// overwritten.
+		const int laneCount = std::min(4, end - i);
+		for (int k = 0; k < laneCount; ++k)
+		{
+			if (alive[k] == 0)
+				continue;
+			for (int s = 0; s < StreamCount; ++s)
+				streams[s][live] = lanes[s][k];
+			++live;
+		}
+	}
+
+	pool.ChunkLive[chunk] = live - begin;
+}
+
+void ParticleSystem::Emit(float dt, const ParticleColliders& colliders)
+{
+	for (ParticleEmitter& e : mEmitters)
+	{
+		e.Accumulator += e.Rate*dt;
+		const int count = (int)e.Accumulator;
+		e.Accumulator -= count;
+
+		for (int k = 0; k < count; ++k)
+		{
+			const XMFLOAT3 pos(
+				e.Position.x + RandF(-e.Extents.x, e.Extents.x),
+				e.Position.y + RandF(-e.Extents.y, e.Extents.y),
+				e.Position.z + RandF(-e.Extents.z, e.Extents.z));
+			const XMFLOAT3 vel(
+				e.Velocity.x + RandF(-e.VelocitySpread.x, e.VelocitySpread.x),
+				e.Velocity.y + RandF(-e.VelocitySpread.y, e.VelocitySpread.y),
+				e.Velocity.z + RandF(-e.VelocitySpread.z, e.VelocitySpread.z));
+			Spawn(e.Pool, pos, vel, RandF(e.MinLife, e.MaxLife));
+		}
+	}
+
+	if (colliders.Water == nullptr)
+		return;
+
+	// Disturb calls since the last update, as far back as the waves remember them.
+	const std::uint64_t eventCount = colliders.Water->DisturbEventCount();
+	const std::uint64_t oldest = eventCount > (std::uint64_t)Waves::MaxDisturbEvents ?
+		eventCount - Waves::MaxDisturbEvents : 0;
+	const std::uint64_t first = std::max(mSeenDisturbEvents, oldest);
+	mSeenDisturbEvents = eventCount;
+
+	if (mSplash.Pool < 0)
+		return;
+
+	for (std::uint64_t k = first; k < eventCount; ++k)
+	{
+		const Waves::DisturbEvent& d = colliders.Water->GetDisturbEvent(k);
+		const float y = FloorHeight(colliders, d.X, d.Z);
+
+		const int count = (int)(mSplash.ParticlesPerUnit*d.Magnitude);
+		for (int n = 0; n < count; ++n)
+		{
+			const float angle = RandF(0.0f, XM_2PI);
+			const float spread = RandF(0.0f, mSplash.Spread);
+			const XMFLOAT3 vel(spread*std::cos(angle), RandF(mSplash.MinSpeed, mSplash.MaxSpeed), spread*std::sin(angle));
+
+			// Start just above the surface so the first step does not count as a landing.
+			Spawn(mSplash.Pool, XMFLOAT3(d.X, y + 0.05f, d.Z), vel, RandF(mSplash.MinLife, mSplash.MaxLife));
+		}
+	}
+}
+
+void ParticleSystem::WriteVertices(int poolIndex, int first, int count, ParticleVertex* out)const
+{
+	const Pool& pool = mPools[poolIndex];
+	assert(first >= 0 && first + count <= pool.Count);
+
+	const float startSize = pool.Desc.StartSize;
+	const float sizeDelta = pool.Desc.EndSize - pool.Desc.StartSize;
+	for (int k = 0; k < count; ++k)
+	{
+		const int i = first + k;
+		const float t = std::min(pool.Streams[Age][i] / pool.Streams[Life][i], 1.0f);
+		const float size = startSize + sizeDelta*t;
+
+		out[k].Pos = XMFLOAT3(pool.Streams[PosX][i], pool.Streams[PosY][i], pool.Streams[PosZ][i]);
+		out[k].Size = XMFLOAT2(size, size);
+	}
+}
+
+float ParticleSystem::RandF(float a, float b)
+{
+	return a + (b - a)*std::uniform_real_distribution<float>(0.0f, 1.0f)(mRng);
+}
@@ -0,0 +1,186 @@
+//***************************************************************************************
+// ParticleSystem.h
+//
+// CPU particles for splashes, snow and sparks.  Each kind lives in a fixed-capacity pool
+// stored as structure-of-arrays, so gravity, drag and the collision against the terrain
+// and the water surface run on four particles at a time in XMVECTOR lanes.  Pools are
+// updated in parallel chunks and kept dense: the live particles of a pool are always
+// [0, LiveCount), ready to be streamed as points into a dynamic vertex buffer that the
+// TreeSprite.hlsl geometry shader expands into billboards.
+//***************************************************************************************
+
+#pragma once
+
+#include <DirectXMath.h>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+#include "MemoryArena.h"
+
+class Heightmap;
+class Waves;
+
+// One point of the particle stream, laid out like TreeSprite.hlsl's VertexIn.
+struct ParticleVertex
+{
+	DirectX::XMFLOAT3 Pos;
+	DirectX::XMFLOAT2 Size;
+};
+
+// What a particle does when it reaches the terrain or the water surface.
+enum class ParticleCollision : int
+{
+	Kill = 0,
+	Bounce
+};
+
+struct ParticlePoolDesc
+{
+	std::string Name;
+	int Capacity = 0;
+
+	// Acceleration along y.  The velocity decays as exp(-Drag*t).
+	float Gravity = -9.8f;
+	float Drag = 0.0f;
+
+	ParticleCollision Collision = ParticleCollision::Kill;
+
+	// Bounce only: the part of the vertical speed kept on impact and of the horizontal
+	// speed kept while sliding.
+	float Restitution = 0.5f;
+	float Friction = 0.8f;
+
+	// Billboard size at birth and at the end of the particle's life.
+	float StartSize = 0.2f;
+	float EndSize = 0.2f;
+};
+
+// Spawns Rate particles per second into Pool, uniformly in the box Position +/- Extents,
+// moving at Velocity +/- VelocitySpread.
+struct ParticleEmitter
+{
+	int Pool = 0;
+	DirectX::XMFLOAT3 Position = { 0.0f, 0.0f, 0.0f };
+	DirectX::XMFLOAT3 Extents = { 0.0f, 0.0f, 0.0f };
+	DirectX::XMFLOAT3 Velocity = { 0.0f, 0.0f, 0.0f };
+	DirectX::XMFLOAT3 VelocitySpread = { 0.0f, 0.0f, 0.0f };
+	float MinLife = 1.0f;
+	float MaxLife = 1.0f;
+	float Rate = 0.0f;
+
+	// Fractional particle carried to the next update.
+	float Accumulator = 0.0f;
+};
+
+// Answers every Waves::Disturb with a burst of ParticlesPerUnit*magnitude particles in
+// Pool, thrown up from the surface at the disturbed point at MinSpeed..MaxSpeed, within
+// Spread horizontally.
+struct ParticleSplashEmitter
+{
+	int Pool = -1;
+	float ParticlesPerUnit = 1000.0f;
+	float MinSpeed = 2.0f;
+	float MaxSpeed = 5.0f;
+	float Spread = 1.5f;
+	float MinLife = 0.5f;
+	float MaxLife = 1.5f;
+};
+
+// What the particles collide with; either may be null.  The water grid is taken to be
+// at the world origin, like the demo's waves render item, and its Disturb events feed
+// the splash emitter.
+struct ParticleColliders
+{
+	const Heightmap* Terrain = nullptr;
+	const Waves* Water = nullptr;
+};
+
+class ParticleSystem
+{
+public:
+	// Particles per task of the parallel update; a multiple of the SIMD width.
+	static const int ChunkSize = 4096;
+
+	ParticleSystem() = default;
+	ParticleSystem(const ParticleSystem& rhs) = delete;
+	ParticleSystem& operator=(const ParticleSystem& rhs) = delete;
+	~ParticleSystem() = default;
+
+	// Reserves the pools in one arena.  Returns false if the memory could not be reserved.
+	bool Create(const std::vector<ParticlePoolDesc>& pools, std::uint32_t seed = 1);
+
+	// Returns the index of the emitter, for Emitter().
+	int AddEmitter(const ParticleEmitter& emitter);
+	ParticleEmitter& Emitter(int index) { return mEmitters[index]; }
+
+	void SetSplashEmitter(const ParticleSplashEmitter& splash) { mSplash = splash; }
+
+	// Emits, integrates, collides and compacts every pool.
+	void Update(float dt, const ParticleColliders& colliders);
+
+	// Adds one particle.  Returns false (and counts a drop) when the pool is full.
+	bool Spawn(int pool, const DirectX::XMFLOAT3& pos, const DirectX::XMFLOAT3& vel, float life);
+
+	// Kills every particle.
+	void Clear();
+
+	int PoolCount()const { return (int)mPools.size(); }
+	const ParticlePoolDesc& PoolDesc(int pool)const { return mPools[pool].Desc; }
+	int LiveCount(int pool)const { return mPools[pool].Count; }
+	int LiveCount()const;
+
+	// Sum of the pool capacities: the largest stream WriteVertices can produce.
+	int Capacity()const;
+
+	// First vertex of pool in the stream of all pools back to back.
+	int StreamOffset(int pool)const;
+
+	// Particles that could not be spawned because their pool was full.
+	std::uint64_t DroppedCount()const { return mDropped; }
+
+	// Writes live particles [first, first + count) of pool as points.
+	void WriteVertices(int pool, int first, int count, ParticleVertex* out)const;
+
+private:
+	// The per-particle arrays of a pool.
+	enum Stream : int
+	{
+		PosX = 0,
+		PosY,
+		PosZ,
+		VelX,
+		VelY,
+		VelZ,
+		Age,
+		Life,
+		StreamCount
+	};
+
+	struct Pool
+	{
+		ParticlePoolDesc Desc;
+		int Capacity = 0;
+		int Count = 0;
+
+		// One array per Stream, padded to a multiple of four and cache-line aligned.
+		float* Streams[StreamCount] = {};
+
+		// Survivors of each chunk after the last update.
+		int* ChunkLive = nullptr;
+	};
+
+	void Emit(float dt, const ParticleColliders& colliders);
+	void UpdateChunk(Pool& pool, int chunk, float dt, const ParticleColliders& colliders);
+	float RandF(float a, float b);
+
+private:
+	MemoryArena mArena;
+	std::vector<Pool> mPools;
+	std::vector<ParticleEmitter> mEmitters;
+	ParticleSplashEmitter mSplash;
+
+	std::mt19937 mRng;
+	std::uint64_t mSeenDisturbEvents = 0;
+	std::uint64_t mDropped = 0;
+};
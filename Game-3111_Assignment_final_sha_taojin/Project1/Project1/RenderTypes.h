@@ -0,0 +1,78 @@
+//***************************************************************************************
+// RenderTypes.h
+//
+// What the D3D12 path and the software rasterizer of the tree billboards demo share: the
+// vertex and constant buffer layouts of the shaders and the render layers, one pipeline
+// state each.  No Direct3D headers, so Tools and the software rasterizer build anywhere
+// DirectXMath does.
+//***************************************************************************************
+
+#pragma once
+
+#include "../../Common/ShadingTypes.h"
+
+struct ObjectConstants
+{
+    DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
+    DirectX::XMFLOAT4X4 TexTransform = MathHelper::Identity4x4();
+};
+
+struct PassConstants
+{
+    DirectX::XMFLOAT4X4 View = MathHelper::Identity4x4();
+    DirectX::XMFLOAT4X4 InvView = MathHelper::Identity4x4();
+    DirectX::XMFLOAT4X4 Proj = MathHelper::Identity4x4();
+    DirectX::XMFLOAT4X4 InvProj = MathHelper::Identity4x4();
+    DirectX::XMFLOAT4X4 ViewProj = MathHelper::Identity4x4();
+    DirectX::XMFLOAT4X4 InvViewProj = MathHelper::Identity4x4();
+    DirectX::XMFLOAT3 EyePosW = { 0.0f, 0.0f, 0.0f };
+    float cbPerObjectPad1 = 0.0f;
+    DirectX::XMFLOAT2 RenderTargetSize = { 0.0f, 0.0f };
+    DirectX::XMFLOAT2 InvRenderTargetSize = { 0.0f, 0.0f };
+    float NearZ = 0.0f;
+    float FarZ = 0.0f;
+    float TotalTime = 0.0f;
+    float DeltaTime = 0.0f;
+
+    DirectX::XMFLOAT4 AmbientLight = { 0.0f, 0.0f, 0.0f, 1.0f };
+
+    DirectX::XMFLOAT4 FogColor = { 0.8f, 0.8f, 0.8f, 1.0f };
+    float gFogStart = 5.0f;
+    float gFogRange = 200.0f;
+    DirectX::XMFLOAT2 cbPerObjectPad2;
+
+    // Indices [0, NUM_DIR_LIGHTS) are directional lights;
+    // indices [NUM_DIR_LIGHTS, NUM_DIR_LIGHTS+NUM_POINT_LIGHTS) are point lights;
+    // indices [NUM_DIR_LIGHTS+NUM_POINT_LIGHTS, NUM_DIR_LIGHTS+NUM_POINT_LIGHT+NUM_SPOT_LIGHTS)
+    // are spot lights for a maximum of MaxLights per object.
+    Light Lights[MaxLights];
+
+    // Clustered point/spot lights, see LightClusterGrid.  ClusterDims is
+    // (tiles x, tiles y, slices z, point light count); ClusterZParams.xy map
+    // view depth to a slice: slice = log(z)*x - y.
+    DirectX::XMUINT4 ClusterDims = { 0, 0, 0, 0 };
+    DirectX::XMFLOAT4 ClusterZParams = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+    // Irradiance SH of the environment (SH9 in SphericalHarmonics.h), one
+    // float4 per coefficient to match HLSL array packing.
+    DirectX::XMFLOAT4 AmbientSH[9];
+};
+
+struct Vertex
+{
+    //DirectX::XMFLOAT4 Color;
+    DirectX::XMFLOAT3 Pos;
+    DirectX::XMFLOAT3 Normal;
+    DirectX::XMFLOAT2 TexC;
+};
+
+enum class RenderLayer : int
+{
+	Opaque = 0,
+	OpaqueBaked,
+	Transparent,
+	AlphaTested,
+	AlphaTestedTreeSprites,
+	Particles,
+	Count
+};
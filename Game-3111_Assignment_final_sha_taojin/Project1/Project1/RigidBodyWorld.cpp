@@ -0,0 +1,1547 @@
+#include "RigidBodyWorld.h"
+#include "Heightmap.h"
+#include "ParallelFor.h"
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+
+using namespace DirectX;
+
+const int RigidBodyWorld::ChunkSize;
+
+namespace
+{
+	// Contacts are created this far before the shapes touch, so resting bodies keep
+	// theirs from step to step.
+	const float ContactMargin = 0.02f;
+
+	// A contact matches last step's if its point on body A moved less than this.
+	const float WarmStartDistance = 0.05f;
+
+	const int GjkMaxIterations = 32;
+
+	struct OrientedBox
+	{
+		XMVECTOR Center;
+		XMVECTOR Axis[3];
+		float Half[3];
+	};
+
+	// Up to eight candidate contacts sharing one normal (from A to B), before they are
+	// reduced to the four kept in a manifold.
+	struct ContactSet
+	{
+		XMFLOAT3 Normal = { 0.0f, 1.0f, 0.0f };
+		int Count = 0;
+		XMFLOAT3 Position[8];
+		float Depth[8];
+
+		void Add(FXMVECTOR position, float depth)
+		{
+			if (Count < 8)
+			{
+				XMStoreFloat3(&Position[Count], position);
+				Depth[Count] = depth;
+				++Count;
+			}
+		}
+	};
+
+	OrientedBox MakeBox(const XMFLOAT3& position, const XMFLOAT4& orientation, const XMFLOAT3& halfExtents)
+	{
+		const XMMATRIX rotation = XMMatrixRotationQuaternion(XMLoadFloat4(&orientation));
+
+		OrientedBox box;
+		box.Center = XMLoadFloat3(&position);
+		box.Axis[0] = rotation.r[0];
+		box.Axis[1] = rotation.r[1];
+		box.Axis[2] = rotation.r[2];
+		box.Half[0] = halfExtents.x;
+		box.Half[1] = halfExtents.y;
+		box.Half[2] = halfExtents.z;
+		return box;
+	}
+
+	float Clamp01(float x)
+	{
+		return x < 0.0f ? 0.0f : (x > 1.0f ? 1.0f : x);
+	}
+
+	float Dot(FXMVECTOR a, FXMVECTOR b)
+	{
+		return XMVectorGetX(XMVector3Dot(a, b));
+	}
+
+	// The ends of a capsule's segment.
+	void CapsuleSegment(const XMFLOAT3& position, const XMFLOAT4& orientation, float halfHeight, XMVECTOR& p, XMVECTOR& q)
+	{
+		const XMVECTOR center = XMLoadFloat3(&position);
+		const XMVECTOR axis = XMVectorScale(XMMatrixRotationQuaternion(XMLoadFloat4(&orientation)).r[1], halfHeight);
+		p = XMVectorSubtract(center, axis);
+		q = XMVectorAdd(center, axis);
+	}
+
+	XMVECTOR ClosestPointOnSegment(FXMVECTOR point, FXMVECTOR p, FXMVECTOR q)
+	{
+		const XMVECTOR d = XMVectorSubtract(q, p);
+		const float lengthSq = Dot(d, d);
+		const float t = lengthSq > 1e-12f ? Clamp01(Dot(XMVectorSubtract(point, p), d) / lengthSq) : 0.0f;
+		return XMVectorMultiplyAdd(d, XMVectorReplicate(t), p);
+	}
+
+	// Closest points c1 on [p1, q1] and c2 on [p2, q2] (Ericson, Real-Time Collision
+	// Detection 5.1.9).
+	void ClosestPointsSegments(FXMVECTOR p1, FXMVECTOR q1, FXMVECTOR p2, GXMVECTOR q2, XMVECTOR& c1, XMVECTOR& c2)
+	{
+		const XMVECTOR d1 = XMVectorSubtract(q1, p1);
+		const XMVECTOR d2 = XMVectorSubtract(q2, p2);
+		const XMVECTOR r = XMVectorSubtract(p1, p2);
+		const float a = Dot(d1, d1);
+		const float e = Dot(d2, d2);
+		const float f = Dot(d2, r);
+
+		float s = 0.0f;
+		float t = 0.0f;
+		if (a <= 1e-12f && e <= 1e-12f)
+		{
+			// Both segments are points.
+		}
+		else if (a <= 1e-12f)
+		{
+			t = Clamp01(f / e);
+		}
+		else
+		{
+			const float c = Dot(d1, r);
+			if (e <= 1e-12f)
+			{
+				s = Clamp01(-c / a);
+			}
+			else
+			{
+				const float b = Dot(d1, d2);
+				const float denom = a*e - b*b;
+				s = denom > 1e-12f ? Clamp01((b*f - c*e) / denom) : 0.0f;
+				t = (b*s + f) / e;
+				if (t < 0.0f)
+				{
+					t = 0.0f;
+					s = Clamp01(-c / a);
+				}
+				else if (t > 1.0f)
+				{
+					t = 1.0f;
+					s = Clamp01((b - c) / a);
+				}
+			}
+		}
+
+		c1 = XMVectorMultiplyAdd(d1, XMVectorReplicate(s), p1);
+		c2 = XMVectorMultiplyAdd(d2, XMVectorReplicate(t), p2);
+	}
+
+	void CollideSpheres(FXMVECTOR ca, float ra, FXMVECTOR cb, float rb, ContactSet& set)
+	{
+		const XMVECTOR d = XMVectorSubtract(cb, ca);
+		const float distance = XMVectorGetX(XMVector3Length(d));
+		if (distance > ra + rb + ContactMargin)
+			return;
+
+		const XMVECTOR normal = distance > 1e-6f ? XMVectorScale(d, 1.0f / distance) : XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+		const float depth = ra + rb - distance;
+		XMStoreFloat3(&set.Normal, normal);
+		set.Add(XMVectorMultiplyAdd(normal, XMVectorReplicate(ra - 0.5f*depth), ca), depth);
+	}
+
+	// Contacts of the sphere (center, radius) with the box, normal from the box.
+	void CollideBoxSphere(const OrientedBox& box, FXMVECTOR center, float radius, ContactSet& set)
+	{
+		const XMVECTOR d = XMVectorSubtract(center, box.Center);
+
+		float local[3];
+		bool inside = true;
+		XMVECTOR closest = box.Center;
+		for (int i = 0; i < 3; ++i)
+		{
+			local[i] = Dot(d, box.Axis[i]);
+			const float clamped = std::max(-box.Half[i], std::min(local[i], box.Half[i]));
+			inside = inside && clamped == local[i];
+			closest = XMVectorMultiplyAdd(box.Axis[i], XMVectorReplicate(clamped), closest);
+		}
+
+		if (inside)
+		{
+			// The center is in the box: push out through the nearest face.
+			int axis = 0;
+			float nearest = FLT_MAX;
+			for (int i = 0; i < 3; ++i)
+			{
+				const float gap = box.Half[i] - std::fabs(local[i]);
+				if (gap < nearest)
+				{
+					nearest = gap;
+					axis = i;
+				}
+			}
+
+			const XMVECTOR normal = XMVectorScale(box.Axis[axis], local[axis] < 0.0f ? -1.0f : 1.0f);
+			const float depth = nearest + radius;
+			XMStoreFloat3(&set.Normal, normal);
+			set.Add(XMVectorMultiplyAdd(normal, XMVectorReplicate(nearest - 0.5f*depth), center), depth);
+			return;
+		}
+
+		const XMVECTOR offset = XMVectorSubtract(center, closest);
+		const float distance = XMVectorGetX(XMVector3Length(offset));
+		if (distance > radius + ContactMargin)
+			return;
+
+		const XMVECTOR normal = XMVectorScale(offset, 1.0f / std::max(distance, 1e-6f));
+		const float depth = radius - distance;
+		XMStoreFloat3(&set.Normal, normal);
+		set.Add(XMVectorMultiplyAdd(normal, XMVectorReplicate(-0.5f*depth), closest), depth);
+	}
+
+	void CollideSphereCapsule(FXMVECTOR center, float ra, FXMVECTOR p, FXMVECTOR q, float rb, ContactSet& set)
+	{
+		CollideSpheres(center, ra, ClosestPointOnSegment(center, p, q), rb, set);
+	}
+
+	void CollideCapsules(FXMVECTOR p1, FXMVECTOR q1, float r1, FXMVECTOR p2, GXMVECTOR q2, float r2, ContactSet& set)
+	{
+		XMVECTOR c1, c2;
+		ClosestPointsSegments(p1, q1, p2, q2, c1, c2);
+		CollideSpheres(c1, r1, c2, r2, set);
+		if (set.Count == 0)
+			return;
+
+		// Side by side capsules touch along a line; add its ends so they do not roll.
+		const XMVECTOR d1 = XMVector3Normalize(XMVectorSubtract(q1, p1));
+		const XMVECTOR d2 = XMVector3Normalize(XMVectorSubtract(q2, p2));
+		if (std::fabs(Dot(d1, d2)) < 0.98f)
+			return;
+
+		const XMVECTOR normal = XMLoadFloat3(&set.Normal);
+		const XMVECTOR ends[2] = { p2, q2 };
+		for (const XMVECTOR& end : ends)
+		{
+			const XMVECTOR onFirst = ClosestPointOnSegment(end, p1, q1);
+			const float depth = r1 + r2 - Dot(XMVectorSubtract(end, onFirst), normal);
+			if (depth > -ContactMargin)
+				set.Add(XMVectorMultiplyAdd(normal, XMVectorReplicate(r1 - 0.5f*depth), onFirst), depth);
+		}
+	}
+
+	XMVECTOR BoxSupport(const OrientedBox& box, FXMVECTOR direction)
+	{
+		XMVECTOR support = box.Center;
+		for (int i = 0; i < 3; ++i)
+		{
+			const float extent = Dot(direction, box.Axis[i]) < 0.0f ? -box.Half[i] : box.Half[i];
+			support = XMVectorMultiplyAdd(box.Axis[i], XMVectorReplicate(extent), support);
+		}
+		return support;
+	}
+
+	struct SimplexVertex
+	{
+		XMVECTOR A;
+		XMVECTOR B;
+		XMVECTOR W;
+	};
+
+	// Closest point to the origin on triangle (a, b, c) as weights of its vertices (Ericson
+	// 5.1.5).  Writes the vertices of the feature it lies on to keep; returns their count.
+	int ClosestOnTriangle(FXMVECTOR a, FXMVECTOR b, FXMVECTOR c, int* keep, float* weights)
+	{
+		const XMVECTOR ab = XMVectorSubtract(b, a);
+		const XMVECTOR ac = XMVectorSubtract(c, a);
+		const XMVECTOR ap = XMVectorNegate(a);
+		const float d1 = Dot(ab, ap);
+		const float d2 = Dot(ac, ap);
+		if (d1 <= 0.0f && d2 <= 0.0f)
+		{
+			keep[0] = 0; weights[0] = 1.0f;
+			return 1;
+		}
+
+		const XMVECTOR bp = XMVectorNegate(b);
+		const float d3 = Dot(ab, bp);
+		const float d4 = Dot(ac, bp);
+		if (d3 >= 0.0f && d4 <= d3)
+		{
+			keep[0] = 1; weights[0] = 1.0f;
+			return 1;
+		}
+
+		const float vc = d1*d4 - d3*d2;
+		if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+		{
+			const float v = d1 / (d1 - d3);
+			keep[0] = 0; weights[0] = 1.0f - v;
+			keep[1] = 1; weights[1] = v;
+			return 2;
+		}
+
+		const XMVECTOR cp = XMVectorNegate(c);
+		const float d5 = Dot(ab, cp);
+		const float d6 = Dot(ac, cp);
+		if (d6 >= 0.0f && d5 <= d6)
+		{
+			keep[0] = 2; weights[0] = 1.0f;
+			return 1;
+		}
+
+		const float vb = d5*d2 - d1*d6;
+		if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+		{
+			const float w = d2 / (d2 - d6);
+			keep[0] = 0; weights[0] = 1.0f - w;
+			keep[1] = 2; weights[1] = w;
+			return 2;
+		}
+
+		const float va = d3*d6 - d5*d4;
+		if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f)
+		{
+			const float w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+			keep[0] = 1; weights[0] = 1.0f - w;
+			keep[1] = 2; weights[1] = w;
+			return 2;
+		}
+
+		const float denom = 1.0f / (va + vb + vc);
+		keep[0] = 0; weights[0] = va*denom;
+		keep[1] = 1; weights[1] = vb*denom;
+		keep[2] = 2; weights[2] = vc*denom;
+		return 3;
+	}
+
+	// Reduces the simplex to the feature closest to the origin and returns that point.
+	// Returns false if the origin is inside the tetrahedron (the shapes overlap).
+	bool ReduceSimplex(SimplexVertex* simplex, int& count, float* weights, XMVECTOR& closest)
+	{
+		int keep[3] = { 0, 0, 0 };
+		float keepWeights[3] = { 1.0f, 0.0f, 0.0f };
+		int keepCount = 1;
+
+		if (count == 2)
+		{
+			const XMVECTOR a = simplex[0].W;
+			const XMVECTOR ab = XMVectorSubtract(simplex[1].W, a);
+			const float lengthSq = Dot(ab, ab);
+			const float t = lengthSq > 1e-12f ? -Dot(a, ab) / lengthSq : 0.0f;
+			if (t >= 1.0f)
+			{
+				keep[0] = 1;
+			}
+			else if (t > 0.0f)
+			{
+				keep[1] = 1;
+				keepWeights[0] = 1.0f - t;
+				keepWeights[1] = t;
+				keepCount = 2;
+			}
+		}
+		else if (count == 3)
+		{
+			keepCount = ClosestOnTriangle(simplex[0].W, simplex[1].W, simplex[2].W, keep, keepWeights);
+		}
+		else if (count == 4)
+		{
+			// The closest of the faces the origin is in front of.
+			static const int faces[4][4] = { { 0, 1, 2, 3 }, { 0, 2, 3, 1 }, { 0, 3, 1, 2 }, { 1, 3, 2, 0 } };
+			float bestDistanceSq = FLT_MAX;
+			bool outside = false;
+			for (const auto& face : faces)
+			{
+				const XMVECTOR a = simplex[face[0]].W;
+				const XMVECTOR normal = XMVector3Cross(XMVectorSubtract(simplex[face[1]].W, a), XMVectorSubtract(simplex[face[2]].W, a));
+				const float originSide = -Dot(normal, a);
+				const float oppositeSide = Dot(normal, XMVectorSubtract(simplex[face[3]].W, a));
+				if (originSide*oppositeSide >= 0.0f)
+					continue;
+
+				outside = true;
+				int faceKeep[3];
+				float faceWeights[3];
+				const int faceCount = ClosestOnTriangle(a, simplex[face[1]].W, simplex[face[2]].W, faceKeep, faceWeights);
+
+				XMVECTOR point = XMVectorZero();
+				for (int k = 0; k < faceCount; ++k)
+					point = XMVectorMultiplyAdd(simplex[face[faceKeep[k]]].W, XMVectorReplicate(faceWeights[k]), point);
+
+				const float distanceSq = Dot(point, point);
+				if (distanceSq < bestDistanceSq)
+				{
+					bestDistanceSq = distanceSq;
+					keepCount = faceCount;
+					for (int k = 0; k < faceCount; ++k)
+					{
+						keep[k] = face[faceKeep[k]];
+						keepWeights[k] = faceWeights[k];
+					}
+				}
+			}
+
+			if (!outside)
+				return false;
+		}
+
+		SimplexVertex reduced[3];
+		closest = XMVectorZero();
+		for (int k = 0; k < keepCount; ++k)
+		{
+			reduced[k] = simplex[keep[k]];
+			weights[k] = keepWeights[k];
+			closest = XMVectorMultiplyAdd(reduced[k].W, XMVectorReplicate(keepWeights[k]), closest);
+		}
+		for (int k = 0; k < keepCount; ++k)
+			simplex[k] = reduced[k];
+		count = keepCount;
+		return true;
+	}
+
+	// GJK distance between the box and segment [p, q].  Returns false if they overlap,
+	// else the closest points on each.
+	bool GjkBoxSegment(const OrientedBox& box, FXMVECTOR p, FXMVECTOR q, XMVECTOR& onBox, XMVECTOR& onSegment)
+	{
+		SimplexVertex simplex[4];
+		float weights[4] = { 1.0f, 0.0f, 0.0f, 0.0f };
+		int count = 1;
+		simplex[0].A = BoxSupport(box, XMVectorSubtract(p, box.Center));
+		simplex[0].B = p;
+		simplex[0].W = XMVectorSubtract(simplex[0].A, simplex[0].B);
+		XMVECTOR v = simplex[0].W;
+
+		for (int iteration = 0; iteration < GjkMaxIterations; ++iteration)
+		{
+			const float vLengthSq = Dot(v, v);
+			if (vLengthSq < 1e-10f)
+				return false;
+
+			// Support of the difference A - B in direction -v.
+			const XMVECTOR direction = XMVectorNegate(v);
+			SimplexVertex next;
+			next.A = BoxSupport(box, direction);
+			next.B = Dot(p, v) > Dot(q, v) ? p : q;
+			next.W = XMVectorSubtract(next.A, next.B);
+
+			// No vertex gets meaningfully closer than v: converged.
+			if (vLengthSq - Dot(v, next.W) <= 1e-6f*vLengthSq)
+				break;
+
+			simplex[count++] = next;
+			if (!ReduceSimplex(simplex, count, weights, v))
+				return false;
+		}
+
+		onBox = XMVectorZero();
+		onSegment = XMVectorZero();
+		for (int k = 0; k < count; ++k)
+		{
+			onBox = XMVectorMultiplyAdd(simplex[k].A, XMVectorReplicate(weights[k]), onBox);
+			onSegment = XMVectorMultiplyAdd(simplex[k].B, XMVectorReplicate(weights[k]), onSegment);
+		}
+		return true;
+	}
+
+	// Capsule against box: the end spheres give the contacts of a capsule lying on a
+	// face; otherwise GJK finds the closest point of the segment, e.g. across an edge.
+	void CollideBoxCapsule(const OrientedBox& box, FXMVECTOR p, FXMVECTOR q, float radius, ContactSet& set)
+	{
+		ContactSet ends[2];
+		CollideBoxSphere(box, p, radius, ends[0]);
+		CollideBoxSphere(box, q, radius, ends[1]);
+
+		const int deeper = ends[1].Count > 0 && (ends[0].Count == 0 || ends[1].Depth[0] > ends[0].Depth[0]) ? 1 : 0;
+		if (ends[deeper].Count > 0)
+		{
+			set.Normal = ends[deeper].Normal;
+			const XMVECTOR normal = XMLoadFloat3(&set.Normal);
+			for (const ContactSet& end : ends)
+			{
+				if (end.Count > 0 && Dot(XMLoadFloat3(&end.Normal), normal) > 0.7f)
+					set.Add(XMLoadFloat3(&end.Position[0]), end.Depth[0]);
+			}
+			return;
+		}
+
+		XMVECTOR onBox, onSegment;
+		if (GjkBoxSegment(box, p, q, onBox, onSegment))
+		{
+			const XMVECTOR offset = XMVectorSubtract(onSegment, onBox);
+			const float distance = XMVectorGetX(XMVector3Length(offset));
+			if (distance > radius + ContactMargin || distance < 1e-6f)
+				return;
+
+			const XMVECTOR normal = XMVectorScale(offset, 1.0f / distance);
+			const float depth = radius - distance;
+			XMStoreFloat3(&set.Normal, normal);
+			set.Add(XMVectorMultiplyAdd(normal, XMVectorReplicate(-0.5f*depth), onBox), depth);
+			return;
+		}
+
+		// The segment passes through the box: push out the point of it nearest the center.
+		CollideBoxSphere(box, ClosestPointOnSegment(box.Center, p, q), radius, set);
+	}
+
+	// Keeps the points of polygon (count vertices) with dot(normal, p) <= offset.
+	int ClipPolygon(const XMVECTOR* in, int count, FXMVECTOR normal, float offset, XMVECTOR* out)
+	{
+		int outCount = 0;
+		for (int i = 0; i < count; ++i)
+		{
+			const XMVECTOR a = in[i];
+			const XMVECTOR b = in[(i + 1) % count];
+			const float da = Dot(normal, a) - offset;
+			const float db = Dot(normal, b) - offset;
+
+			if (da <= 0.0f)
+				out[outCount++] = a;
+			if ((da < 0.0f) != (db < 0.0f) && da != db)
+				out[outCount++] = XMVectorLerp(a, b, da / (da - db));
+		}
+		return outCount;
+	}
+
+	// Box against box by the separating axis test over the 15 axes.  A face axis clips the
+	// other box's most anti-parallel face against the reference face; an edge axis gives
+	// the closest points of the two edges.
+	void CollideBoxes(const OrientedBox& a, const OrientedBox& b, ContactSet& set)
+	{
+		const XMVECTOR t = XMVectorSubtract(b.Center, a.Center);
+
+		float absR[3][3];
+		for (int i = 0; i < 3; ++i)
+		{
+			for (int j = 0; j < 3; ++j)
+				absR[i][j] = std::fabs(Dot(a.Axis[i], b.Axis[j])) + 1e-6f;
+		}
+
+		float faceSeparation = -FLT_MAX;
+		int faceAxis = 0;
+		for (int i = 0; i < 3; ++i)
+		{
+			const float separation = std::fabs(Dot(t, a.Axis[i])) -
+				(a.Half[i] + b.Half[0]*absR[i][0] + b.Half[1]*absR[i][1] + b.Half[2]*absR[i][2]);
+			if (separation > ContactMargin)
+				return;
+			if (separation > faceSeparation)
+			{
+				faceSeparation = separation;
+				faceAxis = i;
+			}
+		}
+
+		// Prefer A's faces unless B's are clearly better, so the choice does not flicker.
+		for (int j = 0; j < 3; ++j)
+		{
+			const float separation = std::fabs(Dot(t, b.Axis[j])) -
+				(b.Half[j] + a.Half[0]*absR[0][j] + a.Half[1]*absR[1][j] + a.Half[2]*absR[2][j]);
+			if (separation > ContactMargin)
+				return;
+			if (separation > 0.95f*faceSeparation + 0.01f)
+			{
+				faceSeparation = separation;
+				faceAxis = 3 + j;
+			}
+		}
+
+		float edgeSeparation = -FLT_MAX;
+		int edgeA = 0;
+		int edgeB = 0;
+		XMVECTOR edgeNormal = XMVectorZero();
+		for (int i = 0; i < 3; ++i)
+		{
+			for (int j = 0; j < 3; ++j)
+			{
+				XMVECTOR axis = XMVector3Cross(a.Axis[i], b.Axis[j]);
+				const float length = XMVectorGetX(XMVector3Length(axis));
+				if (length < 1e-4f)
+					continue;
+				axis = XMVectorScale(axis, 1.0f / length);
+
+				float ra = 0.0f;
+				float rb = 0.0f;
+				for (int k = 0; k < 3; ++k)
+				{
+					ra += a.Half[k]*std::fabs(Dot(a.Axis[k], axis));
+					rb += b.Half[k]*std::fabs(Dot(b.Axis[k], axis));
+				}
+
+				const float separation = std::fabs(Dot(t, axis)) - (ra + rb);
+				if (separation > ContactMargin)
+					return;
+				if (separation > edgeSeparation)
+				{
+					edgeSeparation = separation;
+					edgeA = i;
+					edgeB = j;
+					edgeNormal = axis;
+				}
+			}
+		}
+
+		if (edgeSeparation > 0.95f*faceSeparation + 0.01f)
+		{
+			const XMVECTOR normal = Dot(edgeNormal, t) < 0.0f ? XMVectorNegate(edgeNormal) : edgeNormal;
+
+			// The edge of A furthest along the normal and the edge of B furthest against it.
+			XMVECTOR pa = a.Center;
+			XMVECTOR pb = b.Center;
+			for (int k = 0; k < 3; ++k)
+			{
+				if (k != edgeA)
+					pa = XMVectorMultiplyAdd(a.Axis[k], XMVectorReplicate(Dot(normal, a.Axis[k]) < 0.0f ? -a.Half[k] : a.Half[k]), pa);
+				if (k != edgeB)
+					pb = XMVectorMultiplyAdd(b.Axis[k], XMVectorReplicate(Dot(normal, b.Axis[k]) < 0.0f ? b.Half[k] : -b.Half[k]), pb);
+			}
+
+			const XMVECTOR da = XMVectorScale(a.Axis[edgeA], a.Half[edgeA]);
+			const XMVECTOR db = XMVectorScale(b.Axis[edgeB], b.Half[edgeB]);
+			XMVECTOR ca, cb;
+			ClosestPointsSegments(XMVectorSubtract(pa, da), XMVectorAdd(pa, da), XMVectorSubtract(pb, db), XMVectorAdd(pb, db), ca, cb);
+
+			XMStoreFloat3(&set.Normal, normal);
+			set.Add(XMVectorScale(XMVectorAdd(ca, cb), 0.5f), -edgeSeparation);
+			return;
+		}
+
+		// Reference face on one box, normal pointing at the other (the incident box).
+		const bool referenceIsA = faceAxis < 3;
+		const OrientedBox& reference = referenceIsA ? a : b;
+		const OrientedBox& incident = referenceIsA ? b : a;
+		const int refAxis = faceAxis % 3;
+		const XMVECTOR toIncident = referenceIsA ? t : XMVectorNegate(t);
+		const XMVECTOR refNormal = XMVectorScale(reference.Axis[refAxis], Dot(toIncident, reference.Axis[refAxis]) < 0.0f ? -1.0f : 1.0f);
+
+		// The incident face is the one facing the reference face the most.
+		int incAxis = 0;
+		float incDot = 0.0f;
+		for (int k = 0; k < 3; ++k)
+		{
+			const float d = Dot(incident.Axis[k], refNormal);
+			if (std::fabs(d) > std::fabs(incDot))
+			{
+				incDot = d;
+				incAxis = k;
+			}
+		}
+
+		const XMVECTOR faceCenter = XMVectorMultiplyAdd(incident.Axis[incAxis],
+			XMVectorReplicate(incDot > 0.0f ? -incident.Half[incAxis] : incident.Half[incAxis]), incident.Center);
+		const int u = (incAxis + 1) % 3;
+		const int v = (incAxis + 2) % 3;
+		const XMVECTOR du = XMVectorScale(incident.Axis[u], incident.Half[u]);
+		const XMVECTOR dv = XMVectorScale(incident.Axis[v], incident.Half[v]);
+
+		XMVECTOR polygon[8];
+		XMVECTOR clipped[8];
+		polygon[0] = XMVectorAdd(XMVectorAdd(faceCenter, du), dv);
+		polygon[1] = XMVectorAdd(XMVectorSubtract(faceCenter, du), dv);
+		polygon[2] = XMVectorSubtract(XMVectorSubtract(faceCenter, du), dv);
+		polygon[3] = XMVectorSubtract(XMVectorAdd(faceCenter, du), dv);
+		int count = 4;
+
+		// Clip against the four side planes of the reference face.
+		for (int side = 1; side <= 2 && count > 0; ++side)
+		{
+			const int k = (refAxis + side) % 3;
+			const float center = Dot(reference.Center, reference.Axis[k]);
+			count = ClipPolygon(polygon, count, reference.Axis[k], center + reference.Half[k], clipped);
+			count = ClipPolygon(clipped, count, XMVectorNegate(reference.Axis[k]), reference.Half[k] - center, polygon);
+		}
+
+		const float faceOffset = Dot(refNormal, reference.Center) + reference.Half[refAxis];
+		for (int i = 0; i < count; ++i)
+		{
+			const float depth = faceOffset - Dot(refNormal, polygon[i]);
+			if (depth >= -ContactMargin)
+				set.Add(XMVectorMultiplyAdd(refNormal, XMVectorReplicate(0.5f*depth), polygon[i]), depth);
+		}
+
+		XMStoreFloat3(&set.Normal, referenceIsA ? refNormal : XMVectorNegate(refNormal));
+	}
+
+	// Picks up to four points of the set that keep the contact area: the deepest, the
+	// one furthest from it, and the two spanning the largest triangles either side.
+	int ReduceContacts(const ContactSet& set, int* keep)
+	{
+		if (set.Count <= 4)
+		{
+			for (int i = 0; i < set.Count; ++i)
+				keep[i] = i;
+			return set.Count;
+		}
+
+		int deepest = 0;
+		for (int i = 1; i < set.Count; ++i)
+		{
+			if (set.Depth[i] > set.Depth[deepest])
+				deepest = i;
+		}
+
+		const XMVECTOR p0 = XMLoadFloat3(&set.Position[deepest]);
+		int furthest = deepest == 0 ? 1 : 0;
+		float furthestSq = -1.0f;
+		for (int i = 0; i < set.Count; ++i)
+		{
+			const XMVECTOR d = XMVectorSubtract(XMLoadFloat3(&set.Position[i]), p0);
+			const float distanceSq = Dot(d, d);
+			if (i != deepest && distanceSq > furthestSq)
+			{
+				furthestSq = distanceSq;
+				furthest = i;
+			}
+		}
+
+		const XMVECTOR normal = XMLoadFloat3(&set.Normal);
+		const XMVECTOR edge = XMVectorSubtract(XMLoadFloat3(&set.Position[furthest]), p0);
+		int positive = -1;
+		int negative = -1;
+		float maxArea = 0.0f;
+		float minArea = 0.0f;
+		for (int i = 0; i < set.Count; ++i)
+		{
+			if (i == deepest || i == furthest)
+				continue;
+
+			const float area = Dot(XMVector3Cross(edge, XMVectorSubtract(XMLoadFloat3(&set.Position[i]), p0)), normal);
+			if (area > maxArea)
+			{
+				maxArea = area;
+				positive = i;
+			}
+			if (area < minArea)
+			{
+				minArea = area;
+				negative = i;
+			}
+		}
+
+		int count = 0;
+		keep[count++] = deepest;
+		keep[count++] = furthest;
+		if (positive >= 0)
+			keep[count++] = positive;
+		if (negative >= 0)
+			keep[count++] = negative;
+		return count;
+	}
+
+	// Orthonormal tangents of a unit normal, chosen the same way every step so the
+	// friction impulses carry over.
+	void TangentBasis(FXMVECTOR normal, XMVECTOR& t1, XMVECTOR& t2)
+	{
+		XMFLOAT3 n;
+		XMStoreFloat3(&n, normal);
+		if (std::fabs(n.x) >= 0.57735f)
+			t1 = XMVector3Normalize(XMVectorSet(n.y, -n.x, 0.0f, 0.0f));
+		else
+			t1 = XMVector3Normalize(XMVectorSet(0.0f, n.z, -n.y, 0.0f));
+		t2 = XMVector3Cross(normal, t1);
+	}
+
+	XMVECTOR MulInertia(const XMFLOAT3X3& inertia, FXMVECTOR v)
+	{
+		return XMVector3TransformNormal(v, XMLoadFloat3x3(&inertia));
+	}
+}
+
+RigidShape RigidShape::Box(const XMFLOAT3& halfExtents)
+{
+	RigidShape shape;
+	shape.Type = RigidShapeType::Box;
+	shape.HalfExtents = halfExtents;
+	return shape;
+}
+
+RigidShape RigidShape::Sphere(float radius)
+{
+	RigidShape shape;
+	shape.Type = RigidShapeType::Sphere;
+	shape.Radius = radius;
+	return shape;
+}
+
+RigidShape RigidShape::Capsule(float radius, float halfHeight)
+{
+	RigidShape shape;
+	shape.Type = RigidShapeType::Capsule;
+	shape.Radius = radius;
+	shape.HalfHeight = halfHeight;
+	return shape;
+}
+
+int RigidBodyWorld::AddBody(const RigidBodyDesc& desc)
+{
+	Body body;
+	body.Shape = desc.Shape;
+	body.Position = desc.Position;
+	XMStoreFloat4(&body.Orientation, XMQuaternionNormalize(XMLoadFloat4(&desc.Orientation)));
+	body.Friction = desc.Friction;
+	body.Restitution = desc.Restitution;
+
+	if (desc.Mass > 0.0f)
+	{
+		body.InvMass = 1.0f / desc.Mass;
+		body.LinearVelocity = desc.LinearVelocity;
+		body.AngularVelocity = desc.AngularVelocity;
+		body.Awake = true;
+
+		// Principal moments of the solid shape.
+		const float m = desc.Mass;
+		XMFLOAT3 inertia;
+		switch (desc.Shape.Type)
+		{
+		case RigidShapeType::Box:
+		{
+			const XMFLOAT3& e = desc.Shape.HalfExtents;
+			inertia = XMFLOAT3(m*(e.y*e.y + e.z*e.z) / 3.0f, m*(e.x*e.x + e.z*e.z) / 3.0f, m*(e.x*e.x + e.y*e.y) / 3.0f);
+			break;
+		}
+		case RigidShapeType::Sphere:
+		{
+			const float i = 0.4f*m*desc.Shape.Radius*desc.Shape.Radius;
+			inertia = XMFLOAT3(i, i, i);
+			break;
+		}
+		default:
+		{
+			// A cylinder as long as the segment plus one radius approximates the caps.
+			const float r = desc.Shape.Radius;
+			const float length = 2.0f*desc.Shape.HalfHeight + r;
+			const float across = m*(3.0f*r*r + length*length) / 12.0f;
+			inertia = XMFLOAT3(across, 0.5f*m*r*r, across);
+			break;
+		}
+		}
+		body.InvInertiaLocal = XMFLOAT3(1.0f / inertia.x, 1.0f / inertia.y, 1.0f / inertia.z);
+	}
+
+	UpdateBodyBounds(body);
+	mBodies.push_back(body);
+	mMoved.push_back(0);
+	return (int)mBodies.size() - 1;
+}
+
+int RigidBodyWorld::AddStaticBox(const XMFLOAT3& center, const XMFLOAT3& halfExtents)
+{
+	RigidBodyDesc desc;
+	desc.Shape = RigidShape::Box(halfExtents);
+	desc.Position = center;
+	desc.Mass = 0.0f;
+	return AddBody(desc);
+}
+
+XMMATRIX XM_CALLCONV RigidBodyWorld::Transform(int body)const
+{
+	const Body& b = mBodies[body];
+	XMMATRIX transform = XMMatrixRotationQuaternion(XMLoadFloat4(&b.Orientation));
+	transform.r[3] = XMVectorSetW(XMLoadFloat3(&b.Position), 1.0f);
+	return transform;
+}
+
+void RigidBodyWorld::ApplyImpulse(int body, const XMFLOAT3& impulse)
+{
+	Body& b = mBodies[body];
+	if (b.InvMass == 0.0f)
+		return;
+
+	b.Awake = true;
+	b.SleepTime = 0.0f;
+	XMStoreFloat3(&b.LinearVelocity, XMVectorMultiplyAdd(XMLoadFloat3(&impulse), XMVectorReplicate(b.InvMass),
+		XMLoadFloat3(&b.LinearVelocity)));
+}
+
+void RigidBodyWorld::Update(float dt)
+{
+	std::fill(mMoved.begin(), mMoved.end(), (std::uint8_t)0);
+
+	mAccumulator += dt;
+	int steps = 0;
+	while (mAccumulator >= mSettings.TimeStep && steps < mSettings.MaxSubSteps)
+	{
+		Step(mSettings.TimeStep);
+		mAccumulator -= mSettings.TimeStep;
+		++steps;
+	}
+
+	if (steps == mSettings.MaxSubSteps)
+		mAccumulator = 0.0f;
+	mStats.Steps = steps;
+}
+
+void RigidBodyWorld::UpdateBodyBounds(Body& body)const
+{
+	const RigidShape& shape = body.Shape;
+	const XMMATRIX rotation = XMMatrixRotationQuaternion(XMLoadFloat4(&body.Orientation));
+
+	XMVECTOR extent;
+	switch (shape.Type)
+	{
+	case RigidShapeType::Box:
+		extent = XMVectorAbs(XMVectorScale(rotation.r[0], shape.HalfExtents.x));
+		extent = XMVectorAdd(extent, XMVectorAbs(XMVectorScale(rotation.r[1], shape.HalfExtents.y)));
+		extent = XMVectorAdd(extent, XMVectorAbs(XMVectorScale(rotation.r[2], shape.HalfExtents.z)));
+		break;
+	case RigidShapeType::Sphere:
+		extent = XMVectorReplicate(shape.Radius);
+		break;
+	default:
+		extent = XMVectorAdd(XMVectorAbs(XMVectorScale(rotation.r[1], shape.HalfHeight)), XMVectorReplicate(shape.Radius));
+		break;
+	}
+	extent = XMVectorAdd(extent, XMVectorReplicate(ContactMargin));
+
+	// Widen by this step's motion so fast bodies find their contacts before they pass.
+	const XMVECTOR position = XMLoadFloat3(&body.Position);
+	const XMVECTOR motion = XMVectorScale(XMLoadFloat3(&body.LinearVelocity), mSettings.TimeStep);
+	XMStoreFloat3(&body.AabbMin, XMVectorSubtract(XMVectorMin(position, XMVectorAdd(position, motion)), extent));
+	XMStoreFloat3(&body.AabbMax, XMVectorAdd(XMVectorMax(position, XMVectorAdd(position, motion)), extent));
+}
+
+void RigidBodyWorld::Step(float h)
+{
+	const int bodyCount = BodyCount();
+	const XMVECTOR gravity = XMVectorScale(XMLoadFloat3(&mSettings.Gravity), h);
+
+	// Gravity, world inertia and bounds of the awake bodies.
+	mAwakeBodies.clear();
+	for (int i = 0; i < bodyCount; ++i)
+	{
+		if (mBodies[i].Awake)
+			mAwakeBodies.push_back(i);
+	}
+
+	ParallelForRange((int)mAwakeBodies.size(), ChunkSize, [&](int begin, int end)
+	{
+		for (int k = begin; k < end; ++k)
+		{
+			Body& body = mBodies[mAwakeBodies[k]];
+			XMStoreFloat3(&body.LinearVelocity, XMVectorAdd(XMLoadFloat3(&body.LinearVelocity), gravity));
+
+			const XMMATRIX rotation = XMMatrixRotationQuaternion(XMLoadFloat4(&body.Orientation));
+			const XMMATRIX diagonal = XMMatrixScaling(body.InvInertiaLocal.x, body.InvInertiaLocal.y, body.InvInertiaLocal.z);
+			XMStoreFloat3x3(&body.InvInertiaWorld, XMMatrixTranspose(rotation) * diagonal * rotation);
+
+			UpdateBodyBounds(body);
+		}
+	});
+
+	FindPairs();
+
+	// Narrowphase: one manifold slot per pair, then one per awake body for the terrain.
+	const int pairCount = (int)mPairs.size();
+	const int terrainCount = mTerrain != nullptr ? (int)mAwakeBodies.size() : 0;
+	mManifolds.resize(pairCount + terrainCount);
+	ParallelForRange(pairCount + terrainCount, ChunkSize, [&](int begin, int end)
+	{
+		for (int k = begin; k < end; ++k)
+		{
+			Manifold& manifold = mManifolds[k];
+			if (k < pairCount)
+				Collide(mPairs[k].first, mPairs[k].second, manifold);
+			else
+				CollideTerrain(mAwakeBodies[k - pairCount], manifold);
+
+			if (manifold.Count > 0)
+				WarmStart(manifold);
+		}
+	});
+
+	// Drop the empty slots and wake sleeping bodies that something awake touches.
+	int manifoldCount = 0;
+	int contactCount = 0;
+	for (int k = 0; k < (int)mManifolds.size(); ++k)
+	{
+		const Manifold& manifold = mManifolds[k];
+		if (manifold.Count == 0)
+			continue;
+
+		const int bodies[2] = { manifold.A, manifold.B };
+		for (int body : bodies)
+		{
+			if (body >= 0 && !mBodies[body].Awake && mBodies[body].InvMass > 0.0f)
+			{
+				Body& woken = mBodies[body];
+				woken.Awake = true;
+				woken.SleepTime = 0.0f;
+				const XMMATRIX rotation = XMMatrixRotationQuaternion(XMLoadFloat4(&woken.Orientation));
+				const XMMATRIX diagonal = XMMatrixScaling(woken.InvInertiaLocal.x, woken.InvInertiaLocal.y, woken.InvInertiaLocal.z);
+				XMStoreFloat3x3(&woken.InvInertiaWorld, XMMatrixTranspose(rotation) * diagonal * rotation);
+				mAwakeBodies.push_back(body);
+			}
+		}
+
+		if (manifoldCount != k)
+			mManifolds[manifoldCount] = manifold;
+		++manifoldCount;
+		contactCount += manifold.Count;
+	}
+	mManifolds.resize(manifoldCount);
+
+	BuildIslands();
+
+	const int islandCount = (int)mIslandBodyStart.size() - 1;
+	ParallelFor(0, islandCount, [&](int island)
+	{
+		SolveIsland(island, h);
+	});
+
+	// Keep the impulses for the next step's warm start.
+	std::swap(mPreviousManifolds, mManifolds);
+	mPreviousKeys.resize(mPreviousManifolds.size());
+	for (int k = 0; k < (int)mPreviousManifolds.size(); ++k)
+		mPreviousKeys[k] = std::make_pair(mPreviousManifolds[k].Key(), k);
+	std::sort(mPreviousKeys.begin(), mPreviousKeys.end());
+
+	mStats.ActiveBodies = 0;
+	for (int body : mAwakeBodies)
+		mStats.ActiveBodies += mBodies[body].Awake ? 1 : 0;
+	mStats.Pairs = pairCount;
+	mStats.Manifolds = manifoldCount;
+	mStats.Contacts = contactCount;
+	mStats.Islands = islandCount;
+}
+
+void RigidBodyWorld::FindPairs()
+{
+	const int bodyCount = BodyCount();
+
+	// Bodies move little between steps, so an insertion sort of last step's order is
+	// close to linear; rebuild it when bodies were added.
+	if ((int)mSortedBodies.size() != bodyCount)
+	{
+		mSortedBodies.resize(bodyCount);
+		for (int i = 0; i < bodyCount; ++i)
+			mSortedBodies[i] = i;
+		std::sort(mSortedBodies.begin(), mSortedBodies.end(), [&](int a, int b)
+		{
+			return mBodies[a].AabbMin.x < mBodies[b].AabbMin.x;
+		});
+	}
+	else
+	{
+		for (int i = 1; i < bodyCount; ++i)
+		{
+			const int body = mSortedBodies[i];
+			const float key = mBodies[body].AabbMin.x;
+			int j = i - 1;
+			for (; j >= 0 && mBodies[mSortedBodies[j]].AabbMin.x > key; --j)
+				mSortedBodies[j + 1] = mSortedBodies[j];
+			mSortedBodies[j + 1] = body;
+		}
+	}
+
+	// Sweep: each body pairs with the bodies after it that start before it ends.  The
+	// sweeps from different bodies are independent, so chunks of them run in parallel.
+	const int chunkCount = (bodyCount + ChunkSize - 1) / ChunkSize;
+	if ((int)mChunkPairs.size() < chunkCount)
+		mChunkPairs.resize(chunkCount);
+
+	ParallelForRange(bodyCount, ChunkSize, [&](int begin, int end)
+	{
+		std::vector<BodyPair>& pairs = mChunkPairs[begin / ChunkSize];
+		pairs.clear();
+		for (int i = begin; i < end; ++i)
+		{
+			const int a = mSortedBodies[i];
+			const Body& bodyA = mBodies[a];
+			for (int j = i + 1; j < bodyCount; ++j)
+			{
+				const int b = mSortedBodies[j];
+				const Body& bodyB = mBodies[b];
+				if (bodyB.AabbMin.x > bodyA.AabbMax.x)
+					break;
+
+				// Something in the pair must be awake.
+				if (!bodyA.Awake && !bodyB.Awake)
+					continue;
+
+				if (bodyA.AabbMin.y > bodyB.AabbMax.y || bodyB.AabbMin.y > bodyA.AabbMax.y ||
+					bodyA.AabbMin.z > bodyB.AabbMax.z || bodyB.AabbMin.z > bodyA.AabbMax.z)
+					continue;
+
+				pairs.push_back(a < b ? BodyPair(a, b) : BodyPair(b, a));
+			}
+		}
+	});
+
+	mPairs.clear();
+	for (int chunk = 0; chunk < chunkCount; ++chunk)
+		mPairs.insert(mPairs.end(), mChunkPairs[chunk].begin(), mChunkPairs[chunk].end());
+}
+
+void RigidBodyWorld::Collide(int a, int b, Manifold& manifold)const
+{
+	manifold.Count = 0;
+
+	// Order the shapes as box, sphere, capsule and flip the normal back afterwards.
+	bool flipped = false;
+	if ((int)mBodies[a].Shape.Type > (int)mBodies[b].Shape.Type)
+	{
+		std::swap(a, b);
+		flipped = true;
+	}
+
+	const Body& bodyA = mBodies[a];
+	const Body& bodyB = mBodies[b];
+	const RigidShape& shapeA = bodyA.Shape;
+	const RigidShape& shapeB = bodyB.Shape;
+
+	ContactSet set;
+	if (shapeA.Type == RigidShapeType::Box)
+	{
+		const OrientedBox box = MakeBox(bodyA.Position, bodyA.Orientation, shapeA.HalfExtents);
+		if (shapeB.Type == RigidShapeType::Box)
+		{
+			CollideBoxes(box, MakeBox(bodyB.Position, bodyB.Orientation, shapeB.HalfExtents), set);
+		}
+		else if (shapeB.Type == RigidShapeType::Sphere)
+		{
+			CollideBoxSphere(box, XMLoadFloat3(&bodyB.Position), shapeB.Radius, set);
+		}
+		else
+		{
+			XMVECTOR p, q;
+			CapsuleSegment(bodyB.Position, bodyB.Orientation, shapeB.HalfHeight, p, q);
+			CollideBoxCapsule(box, p, q, shapeB.Radius, set);
+		}
+	}
+	else if (shapeA.Type == RigidShapeType::Sphere)
+	{
+		const XMVECTOR center = XMLoadFloat3(&bodyA.Position);
+		if (shapeB.Type == RigidShapeType::Sphere)
+		{
+			CollideSpheres(center, shapeA.Radius, XMLoadFloat3(&bodyB.Position), shapeB.Radius, set);
+		}
+		else
+		{
+			XMVECTOR p, q;
+			CapsuleSegment(bodyB.Position, bodyB.Orientation, shapeB.HalfHeight, p, q);
+			CollideSphereCapsule(center, shapeA.Radius, p, q, shapeB.Radius, set);
+		}
+	}
+	else
+	{
+		XMVECTOR p1, q1, p2, q2;
+		CapsuleSegment(bodyA.Position, bodyA.Orientation, shapeA.HalfHeight, p1, q1);
+		CapsuleSegment(bodyB.Position, bodyB.Orientation, shapeB.HalfHeight, p2, q2);
+		CollideCapsules(p1, q1, shapeA.Radius, p2, q2, shapeB.Radius, set);
+	}
+
+	if (set.Count == 0)
+		return;
+
+	XMVECTOR normal = XMLoadFloat3(&set.Normal);
+	if (flipped)
+	{
+		std::swap(a, b);
+		normal = XMVectorNegate(normal);
+	}
+
+	int keep[4];
+	const int count = ReduceContacts(set, keep);
+
+	const Body& first = mBodies[a];
+	const XMVECTOR positionA = XMLoadFloat3(&first.Position);
+	const XMVECTOR inverseA = XMQuaternionConjugate(XMLoadFloat4(&first.Orientation));
+
+	manifold.A = a;
+	manifold.B = b;
+	manifold.Count = count;
+	XMStoreFloat3(&manifold.Normal, normal);
+	manifold.Friction = std::sqrt(bodyA.Friction*bodyB.Friction);
+	manifold.Restitution = std::max(bodyA.Restitution, bodyB.Restitution);
+	for (int k = 0; k < count; ++k)
+	{
+		ContactPoint& point = manifold.Points[k];
+		point = ContactPoint();
+		point.Position = set.Position[keep[k]];
+		point.Depth = set.Depth[keep[k]];
+		XMStoreFloat3(&point.LocalA, XMVector3Rotate(XMVectorSubtract(XMLoadFloat3(&point.Position), positionA), inverseA));
+	}
+}
+
+void RigidBodyWorld::CollideTerrain(int a, Manifold& manifold)const
+{
+	manifold.Count = 0;
+
+	// Skip bodies well above the ground; the slack covers slopes up to 45 degrees.
+	const Body& body = mBodies[a];
+	if (body.AabbMin.y > mTerrain->Height(0.5f*(body.AabbMin.x + body.AabbMax.x), 0.5f*(body.AabbMin.z + body.AabbMax.z)) +
+		(body.AabbMax.x - body.AabbMin.x) + (body.AabbMax.z - body.AabbMin.z))
+		return;
+
+	// The points of the body that can touch the ground, each with the radius around it.
+	XMVECTOR points[8];
+	int pointCount = 0;
+	float radius = 0.0f;
+	const RigidShape& shape = body.Shape;
+	if (shape.Type == RigidShapeType::Box)
+	{
+		const OrientedBox box = MakeBox(body.Position, body.Orientation, shape.HalfExtents);
+		for (int corner = 0; corner < 8; ++corner)
+		{
+			XMVECTOR p = box.Center;
+			for (int k = 0; k < 3; ++k)
+				p = XMVectorMultiplyAdd(box.Axis[k], XMVectorReplicate(corner & (1 << k) ? box.Half[k] : -box.Half[k]), p);
+			points[pointCount++] = p;
+		}
+	}
+	else if (shape.Type == RigidShapeType::Sphere)
+	{
+		points[pointCount++] = XMLoadFloat3(&body.Position);
+		radius = shape.Radius;
+	}
+	else
+	{
+		CapsuleSegment(body.Position, body.Orientation, shape.HalfHeight, points[0], points[1]);
+		pointCount = 2;
+		radius = shape.Radius;
+	}
+
+	ContactSet set;
+	float deepest = -FLT_MAX;
+	for (int k = 0; k < pointCount; ++k)
+	{
+		XMFLOAT3 p;
+		XMStoreFloat3(&p, points[k]);
+		const float height = mTerrain->Height(p.x, p.z);
+		const XMFLOAT3 groundNormal = mTerrain->Normal(p.x, p.z);
+
+		// Distance above the local tangent plane.
+		const float distance = (p.y - height)*groundNormal.y - radius;
+		if (distance > ContactMargin)
+			continue;
+
+		const XMVECTOR normal = XMLoadFloat3(&groundNormal);
+		set.Add(XMVectorNegativeMultiplySubtract(normal, XMVectorReplicate(radius + 0.5f*distance), points[k]), -distance);
+		if (-distance > deepest)
+		{
+			deepest = -distance;
+			XMStoreFloat3(&set.Normal, XMVectorNegate(normal));
+		}
+	}
+
+	if (set.Count == 0)
+		return;
+
+	int keep[4];
+	const int count = ReduceContacts(set, keep);
+
+	const XMVECTOR positionA = XMLoadFloat3(&body.Position);
+	const XMVECTOR inverseA = XMQuaternionConjugate(XMLoadFloat4(&body.Orientation));
+
+	manifold.A = a;
+	manifold.B = -1;
+	manifold.Count = count;
+	manifold.Normal = set.Normal;
+	manifold.Friction = body.Friction;
+	manifold.Restitution = body.Restitution;
+	for (int k = 0; k < count; ++k)
+	{
+		ContactPoint& point = manifold.Points[k];
+		point = ContactPoint();
+		point.Position = set.Position[keep[k]];
+		point.Depth = set.Depth[keep[k]];
+		XMStoreFloat3(&point.LocalA, XMVector3Rotate(XMVectorSubtract(XMLoadFloat3(&point.Position), positionA), inverseA));
+	}
+}
+
+void RigidBodyWorld::WarmStart(Manifold& manifold)const
+{
+	const std::uint64_t key = manifold.Key();
+	auto found = std::lower_bound(mPreviousKeys.begin(), mPreviousKeys.end(), std::make_pair(key, 0));
+	if (found == mPreviousKeys.end() || found->first != key)
+		return;
+
+	// Carry over the impulses of the contacts that stayed at the same place on body A.
+	const Manifold& previous = mPreviousManifolds[found->second];
+	for (int k = 0; k < manifold.Count; ++k)
+	{
+		ContactPoint& point = manifold.Points[k];
+		const XMVECTOR local = XMLoadFloat3(&point.LocalA);
+		for (int p = 0; p < previous.Count; ++p)
+		{
+			const XMVECTOR d = XMVectorSubtract(XMLoadFloat3(&previous.Points[p].LocalA), local);
+			if (Dot(d, d) < WarmStartDistance*WarmStartDistance)
+			{
+				point.NormalImpulse = previous.Points[p].NormalImpulse;
+				point.TangentImpulse[0] = previous.Points[p].TangentImpulse[0];
+				point.TangentImpulse[1] = previous.Points[p].TangentImpulse[1];
+				break;
+			}
+		}
+	}
+}
+
+int RigidBodyWorld::FindRoot(int body)
+{
+	while (mIslandParent[body] != body)
+	{
+		mIslandParent[body] = mIslandParent[mIslandParent[body]];
+		body = mIslandParent[body];
+	}
+	return body;
+}
+
+void RigidBodyWorld::BuildIslands()
+{
+	const int bodyCount = BodyCount();
+	mIslandParent.resize(bodyCount);
+	mIslandOf.resize(bodyCount);
+
+	for (int body : mAwakeBodies)
+		mIslandParent[body] = body;
+
+	// Static bodies and the terrain do not join islands: what rests on the same wall
+	// can still be solved separately.
+	for (const Manifold& manifold : mManifolds)
+	{
+		if (manifold.B < 0 || mBodies[manifold.A].InvMass == 0.0f || mBodies[manifold.B].InvMass == 0.0f)
+			continue;
+
+		const int rootA = FindRoot(manifold.A);
+		const int rootB = FindRoot(manifold.B);
+		if (rootA != rootB)
+			mIslandParent[rootB] = rootA;
+	}
+
+	// Number the islands, then counting-sort the bodies and manifolds into them.
+	for (int body : mAwakeBodies)
+		mIslandOf[body] = -1;
+
+	int islandCount = 0;
+	for (int body : mAwakeBodies)
+	{
+		const int root = FindRoot(body);
+		if (mIslandOf[root] < 0)
+			mIslandOf[root] = islandCount++;
+	}
+
+	mIslandBodyStart.assign(islandCount + 1, 0);
+	mIslandManifoldStart.assign(islandCount + 1, 0);
+	for (int body : mAwakeBodies)
+		++mIslandBodyStart[mIslandOf[FindRoot(body)] + 1];
+
+	auto manifoldIsland = [&](const Manifold& manifold)
+	{
+		const int body = mBodies[manifold.A].InvMass > 0.0f ? manifold.A : manifold.B;
+		return mIslandOf[FindRoot(body)];
+	};
+	for (const Manifold& manifold : mManifolds)
+		++mIslandManifoldStart[manifoldIsland(manifold) + 1];
+
+	for (int island = 0; island < islandCount; ++island)
+	{
+		mIslandBodyStart[island + 1] += mIslandBodyStart[island];
+		mIslandManifoldStart[island + 1] += mIslandManifoldStart[island];
+	}
+
+	mIslandBodies.resize(mAwakeBodies.size());
+	mIslandManifolds.resize(mManifolds.size());
+	// The starts double as insertion cursors and are restored afterwards.
+	for (int body : mAwakeBodies)
+		mIslandBodies[mIslandBodyStart[mIslandOf[FindRoot(body)]]++] = body;
+	for (int k = 0; k < (int)mManifolds.size(); ++k)
+		mIslandManifolds[mIslandManifoldStart[manifoldIsland(mManifolds[k])]++] = k;
+
+	for (int island = islandCount; island > 0; --island)
+	{
+		mIslandBodyStart[island] = mIslandBodyStart[island - 1];
+		mIslandManifoldStart[island] = mIslandManifoldStart[island - 1];
+	}
+	mIslandBodyStart[0] = 0;
+	mIslandManifoldStart[0] = 0;
+}
+
+void RigidBodyWorld::SolveIsland(int island, float h)
+{
+	const int* bodies = &mIslandBodies[0] + mIslandBodyStart[island];
+	const int bodyCount = mIslandBodyStart[island + 1] - mIslandBodyStart[island];
+	const int* manifolds = mIslandManifolds.empty() ? nullptr : &mIslandManifolds[0] + mIslandManifoldStart[island];
+	const int manifoldCount = mIslandManifoldStart[island + 1] - mIslandManifoldStart[island];
+
+	// Static bodies and the terrain take part through this stand-in.
+	Body ground;
+	auto bodyOf = [&](int index) -> Body&
+	{
+		return index >= 0 && mBodies[index].InvMass > 0.0f ? mBodies[index] : ground;
+	};
+
+	const float biasFactor = mSettings.Baumgarte / h;
+
+	// Contact Jacobians, effective masses and biases, then the warm start.
+	for (int m = 0; m < manifoldCount; ++m)
+	{
+		Manifold& manifold = mManifolds[manifolds[m]];
+		Body& a = bodyOf(manifold.A);
+		Body& b = bodyOf(manifold.B);
+
+		const XMVECTOR normal = XMLoadFloat3(&manifold.Normal);
+		XMVECTOR tangents[2];
+		TangentBasis(normal, tangents[0], tangents[1]);
+		XMStoreFloat3(&manifold.Tangent[0], tangents[0]);
+		XMStoreFloat3(&manifold.Tangent[1], tangents[1]);
+
+		const XMVECTOR positionA = manifold.A >= 0 ? XMLoadFloat3(&mBodies[manifold.A].Position) : XMVectorZero();
+		const XMVECTOR positionB = manifold.B >= 0 ? XMLoadFloat3(&mBodies[manifold.B].Position) : XMVectorZero();
+		XMVECTOR va = XMLoadFloat3(&a.LinearVelocity);
+		XMVECTOR wa = XMLoadFloat3(&a.AngularVelocity);
+		XMVECTOR vb = XMLoadFloat3(&b.LinearVelocity);
+		XMVECTOR wb = XMLoadFloat3(&b.AngularVelocity);
+
+		for (int k = 0; k < manifold.Count; ++k)
+		{
+			ContactPoint& point = manifold.Points[k];
+			const XMVECTOR position = XMLoadFloat3(&point.Position);
+			const XMVECTOR ra = XMVectorSubtract(position, positionA);
+			const XMVECTOR rb = XMVectorSubtract(position, positionB);
+			XMStoreFloat3(&point.RA, ra);
+			XMStoreFloat3(&point.RB, rb);
+
+			auto effectiveMass = [&](FXMVECTOR direction)
+			{
+				const XMVECTOR rna = XMVector3Cross(ra, direction);
+				const XMVECTOR rnb = XMVector3Cross(rb, direction);
+				const float k = a.InvMass + b.InvMass + Dot(MulInertia(a.InvInertiaWorld, rna), rna) +
+					Dot(MulInertia(b.InvInertiaWorld, rnb), rnb);
+				return k > 0.0f ? 1.0f / k : 0.0f;
+			};
+			point.NormalMass = effectiveMass(normal);
+			point.TangentMass[0] = effectiveMass(tangents[0]);
+			point.TangentMass[1] = effectiveMass(tangents[1]);
+
+			const XMVECTOR dv = XMVectorSubtract(XMVectorAdd(vb, XMVector3Cross(wb, rb)), XMVectorAdd(va, XMVector3Cross(wa, ra)));
+			const float vn = Dot(dv, normal);
+			point.Bias = biasFactor*std::max(point.Depth - mSettings.Slop, 0.0f);
+			if (vn < -1.0f)
+				point.Bias = std::max(point.Bias, -manifold.Restitution*vn);
+
+			const XMVECTOR impulse = XMVectorAdd(XMVectorScale(normal, point.NormalImpulse),
+				XMVectorAdd(XMVectorScale(tangents[0], point.TangentImpulse[0]), XMVectorScale(tangents[1], point.TangentImpulse[1])));
+			va = XMVectorNegativeMultiplySubtract(impulse, XMVectorReplicate(a.InvMass), va);
+			wa = XMVectorSubtract(wa, MulInertia(a.InvInertiaWorld, XMVector3Cross(ra, impulse)));
+			vb = XMVectorMultiplyAdd(impulse, XMVectorReplicate(b.InvMass), vb);
+			wb = XMVectorAdd(wb, MulInertia(b.InvInertiaWorld, XMVector3Cross(rb, impulse)));
+		}
+
+		if (&a != &ground)
+		{
+			XMStoreFloat3(&a.LinearVelocity, va);
+			XMStoreFloat3(&a.AngularVelocity, wa);
+		}
+		if (&b != &ground)
+		{
+			XMStoreFloat3(&b.LinearVelocity, vb);
+			XMStoreFloat3(&b.AngularVelocity, wb);
+		}
+	}
+
+	// Sequential impulses: friction, then the non-penetration constraint, per contact.
+	for (int iteration = 0; iteration < mSettings.VelocityIterations; ++iteration)
+	{
+		for (int m = 0; m < manifoldCount; ++m)
+		{
+			Manifold& manifold = mManifolds[manifolds[m]];
+			Body& a = bodyOf(manifold.A);
+			Body& b = bodyOf(manifold.B);
+
+			const XMVECTOR normal = XMLoadFloat3(&manifold.Normal);
+			const XMVECTOR tangents[2] = { XMLoadFloat3(&manifold.Tangent[0]), XMLoadFloat3(&manifold.Tangent[1]) };
+			XMVECTOR va = XMLoadFloat3(&a.LinearVelocity);
+			XMVECTOR wa = XMLoadFloat3(&a.AngularVelocity);
+			XMVECTOR vb = XMLoadFloat3(&b.LinearVelocity);
+			XMVECTOR wb = XMLoadFloat3(&b.AngularVelocity);
+
+			for (int k = 0; k < manifold.Count; ++k)
+			{
+				ContactPoint& point = manifold.Points[k];
+				const XMVECTOR ra = XMLoadFloat3(&point.RA);
+				const XMVECTOR rb = XMLoadFloat3(&point.RB);
+
+				auto apply = [&](FXMVECTOR impulse)
+				{
+					va = XMVectorNegativeMultiplySubtract(impulse, XMVectorReplicate(a.InvMass), va);
+					wa = XMVectorSubtract(wa, MulInertia(a.InvInertiaWorld, XMVector3Cross(ra, impulse)));
+					vb = XMVectorMultiplyAdd(impulse, XMVectorReplicate(b.InvMass), vb);
+					wb = XMVectorAdd(wb, MulInertia(b.InvInertiaWorld, XMVector3Cross(rb, impulse)));
+				};
+				auto relativeVelocity = [&]()
+				{
+					return XMVectorSubtract(XMVectorAdd(vb, XMVector3Cross(wb, rb)), XMVectorAdd(va, XMVector3Cross(wa, ra)));
+				};
+
+				const float maxFriction = manifold.Friction*point.NormalImpulse;
+				for (int t = 0; t < 2; ++t)
+				{
+					const float lambda = -point.TangentMass[t]*Dot(relativeVelocity(), tangents[t]);
+					const float accumulated = std::max(-maxFriction, std::min(point.TangentImpulse[t] + lambda, maxFriction));
+					apply(XMVectorScale(tangents[t], accumulated - point.TangentImpulse[t]));
+					point.TangentImpulse[t] = accumulated;
+				}
+
+				const float lambda = point.NormalMass*(point.Bias - Dot(relativeVelocity(), normal));
+				const float accumulated = std::max(point.NormalImpulse + lambda, 0.0f);
+				apply(XMVectorScale(normal, accumulated - point.NormalImpulse));
+				point.NormalImpulse = accumulated;
+			}
+
+			if (&a != &ground)
+			{
+				XMStoreFloat3(&a.LinearVelocity, va);
+				XMStoreFloat3(&a.AngularVelocity, wa);
+			}
+			if (&b != &ground)
+			{
+				XMStoreFloat3(&b.LinearVelocity, vb);
+				XMStoreFloat3(&b.AngularVelocity, wb);
+			}
+		}
+	}
+
+	// Integrate the positions and let the island sleep once all of it has been at rest.
+	const float linearDamping = 1.0f / (1.0f + h*mSettings.LinearDamping);
+	const float angularDamping = 1.0f / (1.0f + h*mSettings.AngularDamping);
+	const float linearSleepSq = mSettings.SleepLinearSpeed*mSettings.SleepLinearSpeed;
+	const float angularSleepSq = mSettings.SleepAngularSpeed*mSettings.SleepAngularSpeed;
+	float minSleepTime = FLT_MAX;
+
+	for (int k = 0; k < bodyCount; ++k)
+	{
+		Body& body = mBodies[bodies[k]];
+		const XMVECTOR v = XMVectorScale(XMLoadFloat3(&body.LinearVelocity), linearDamping);
+		const XMVECTOR w = XMVectorScale(XMLoadFloat3(&body.AngularVelocity), angularDamping);
+		XMStoreFloat3(&body.LinearVelocity, v);
+		XMStoreFloat3(&body.AngularVelocity, w);
+
+		XMStoreFloat3(&body.Position, XMVectorMultiplyAdd(v, XMVectorReplicate(h), XMLoadFloat3(&body.Position)));
+
+		// q += h/2 * (w, 0) * q.
+		const XMVECTOR q = XMLoadFloat4(&body.Orientation);
+		const XMVECTOR spin = XMQuaternionMultiply(q, XMVectorSetW(w, 0.0f));
+		XMStoreFloat4(&body.Orientation, XMQuaternionNormalize(XMVectorMultiplyAdd(spin, XMVectorReplicate(0.5f*h), q)));
+		mMoved[bodies[k]] = 1;
+
+		if (Dot(v, v) > linearSleepSq || Dot(w, w) > angularSleepSq)
+			body.SleepTime = 0.0f;
+		else
+			body.SleepTime += h;
+		minSleepTime = std::min(minSleepTime, body.SleepTime);
+	}
+
+	if (mSettings.AllowSleeping && minSleepTime >= mSettings.TimeToSleep)
+	{
+		for (int k = 0; k < bodyCount; ++k)
+		{
+			Body& body = mBodies[bodies[k]];
+			body.Awake = false;
+			body.LinearVelocity = XMFLOAT3(0.0f, 0.0f, 0.0f);
+			body.AngularVelocity = XMFLOAT3(0.0f, 0.0f, 0.0f);
+		}
+	}
+}
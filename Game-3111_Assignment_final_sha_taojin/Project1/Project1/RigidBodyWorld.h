@@ -0,0 +1,242 @@
+//***************************************************************************************
+// RigidBodyWorld.h
+//
+// Rigid bodies for the demo's crates and props.  Boxes, spheres and capsules collide
+// with each other, with static boxes (the maze walls) and with a Heightmap as terrain.
+// Each fixed step runs a sweep-and-prune broadphase over the x extents, a narrowphase
+// (SAT with face clipping for box-box, GJK closest points for capsule-box, closed forms
+// for the round shapes), groups the awake bodies into islands through their contacts and
+// solves the islands in parallel with sequential impulses, warm-started from the
+// previous step.  Islands whose bodies stay slow for TimeToSleep go to sleep and cost
+// nothing until something touches them.
+//***************************************************************************************
+
+#pragma once
+
+#include <DirectXMath.h>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+class Heightmap;
+
+enum class RigidShapeType : int
+{
+	Box = 0,
+	Sphere,
+
+	// A segment of 2*HalfHeight along the body's y axis, swept by Radius.
+	Capsule
+};
+
+struct RigidShape
+{
+	RigidShapeType Type = RigidShapeType::Box;
+	DirectX::XMFLOAT3 HalfExtents = { 0.5f, 0.5f, 0.5f };
+	float Radius = 0.5f;
+	float HalfHeight = 0.5f;
+
+	static RigidShape Box(const DirectX::XMFLOAT3& halfExtents);
+	static RigidShape Sphere(float radius);
+	static RigidShape Capsule(float radius, float halfHeight);
+};
+
+struct RigidBodyDesc
+{
+	RigidShape Shape;
+	DirectX::XMFLOAT3 Position = { 0.0f, 0.0f, 0.0f };
+	DirectX::XMFLOAT4 Orientation = { 0.0f, 0.0f, 0.0f, 1.0f };
+	DirectX::XMFLOAT3 LinearVelocity = { 0.0f, 0.0f, 0.0f };
+	DirectX::XMFLOAT3 AngularVelocity = { 0.0f, 0.0f, 0.0f };
+
+	// 0 makes the body static.
+	float Mass = 1.0f;
+
+	float Friction = 0.6f;
+	float Restitution = 0.1f;
+};
+
+struct RigidBodySettings
+{
+	DirectX::XMFLOAT3 Gravity = { 0.0f, -9.8f, 0.0f };
+
+	// Update advances in steps of TimeStep, at most MaxSubSteps per call; time beyond
+	// that is dropped so a hitch does not stall the frame further.
+	float TimeStep = 1.0f / 60.0f;
+	int MaxSubSteps = 4;
+
+	int VelocityIterations = 8;
+
+	// Fraction of the penetration beyond Slop corrected per step.
+	float Baumgarte = 0.2f;
+	float Slop = 0.01f;
+
+	float LinearDamping = 0.02f;
+	float AngularDamping = 0.05f;
+
+	// A body is at rest below these speeds; an island sleeps once all of its bodies
+	// have been at rest for TimeToSleep seconds.
+	bool AllowSleeping = true;
+	float SleepLinearSpeed = 0.08f;
+	float SleepAngularSpeed = 0.1f;
+	float TimeToSleep = 0.5f;
+};
+
+struct RigidBodyStats
+{
+	int ActiveBodies = 0;
+	int Pairs = 0;
+	int Manifolds = 0;
+	int Contacts = 0;
+	int Islands = 0;
+	int Steps = 0;
+};
+
+class RigidBodyWorld
+{
+public:
+	// Items per task of the parallel broadphase sweep and narrowphase.
+	static const int ChunkSize = 256;
+
+	RigidBodyWorld() = default;
+	RigidBodyWorld(const RigidBodyWorld& rhs) = delete;
+	RigidBodyWorld& operator=(const RigidBodyWorld& rhs) = delete;
+	~RigidBodyWorld() = default;
+
+	RigidBodySettings& Settings() { return mSettings; }
+
+	// Returns the index of the new body.  Dynamic bodies start awake.
+	int AddBody(const RigidBodyDesc& desc);
+
+	// A static, axis-aligned box, e.g. a maze wall.
+	int AddStaticBox(const DirectX::XMFLOAT3& center, const DirectX::XMFLOAT3& halfExtents);
+
+	// Ground the bodies rest on; it must outlive the world.  nullptr removes it.
+	void SetTerrain(const Heightmap* terrain) { mTerrain = terrain; }
+
+	// Advances by dt in fixed steps.
+	void Update(float dt);
+
+	// One step of h seconds.
+	void Step(float h);
+
+	int BodyCount()const { return (int)mBodies.size(); }
+	bool IsStatic(int body)const { return mBodies[body].InvMass == 0.0f; }
+	bool IsAwake(int body)const { return mBodies[body].Awake; }
+
+	// True if the body moved during the last Update.
+	bool Moved(int body)const { return mMoved[body] != 0; }
+
+	const RigidShape& Shape(int body)const { return mBodies[body].Shape; }
+	DirectX::XMFLOAT3 Position(int body)const { return mBodies[body].Position; }
+	DirectX::XMFLOAT4 Orientation(int body)const { return mBodies[body].Orientation; }
+
+	// Rotation and translation of the body.
+	DirectX::XMMATRIX XM_CALLCONV Transform(int body)const;
+
+	// Wakes the body and adds impulse at its center of mass.
+	void ApplyImpulse(int body, const DirectX::XMFLOAT3& impulse);
+
+	const RigidBodyStats& Stats()const { return mStats; }
+
+private:
+	struct Body
+	{
+		RigidShape Shape;
+
+		DirectX::XMFLOAT3 Position = { 0.0f, 0.0f, 0.0f };
+		float InvMass = 0.0f;
+		DirectX::XMFLOAT4 Orientation = { 0.0f, 0.0f, 0.0f, 1.0f };
+		DirectX::XMFLOAT3 LinearVelocity = { 0.0f, 0.0f, 0.0f };
+		float Friction = 0.6f;
+		DirectX::XMFLOAT3 AngularVelocity = { 0.0f, 0.0f, 0.0f };
+		float Restitution = 0.1f;
+
+		// Principal inverse inertia, and its world-space tensor for the current step.
+		DirectX::XMFLOAT3 InvInertiaLocal = { 0.0f, 0.0f, 0.0f };
+		DirectX::XMFLOAT3X3 InvInertiaWorld = {};
+
+		DirectX::XMFLOAT3 AabbMin = { 0.0f, 0.0f, 0.0f };
+		DirectX::XMFLOAT3 AabbMax = { 0.0f, 0.0f, 0.0f };
+
+		float SleepTime = 0.0f;
+		bool Awake = false;
+	};
+
+	struct ContactPoint
+	{
+		// Midpoint of the overlap in world space, and the point relative to body A's
+		// frame, which matches it with last step's contact for warm starting.
+		DirectX::XMFLOAT3 Position = { 0.0f, 0.0f, 0.0f };
+		float Depth = 0.0f;
+		DirectX::XMFLOAT3 LocalA = { 0.0f, 0.0f, 0.0f };
+
+		float NormalImpulse = 0.0f;
+		float TangentImpulse[2] = { 0.0f, 0.0f };
+
+		// Solver data.
+		DirectX::XMFLOAT3 RA = { 0.0f, 0.0f, 0.0f };
+		DirectX::XMFLOAT3 RB = { 0.0f, 0.0f, 0.0f };
+		float NormalMass = 0.0f;
+		float TangentMass[2] = { 0.0f, 0.0f };
+		float Bias = 0.0f;
+	};
+
+	// Up to four contacts between two bodies, or a body and the terrain (B = -1), with
+	// the normal pointing from A to B.
+	struct Manifold
+	{
+		int A = 0;
+		int B = -1;
+		int Count = 0;
+		DirectX::XMFLOAT3 Normal = { 0.0f, 1.0f, 0.0f };
+		DirectX::XMFLOAT3 Tangent[2] = {};
+		float Friction = 0.0f;
+		float Restitution = 0.0f;
+		ContactPoint Points[4];
+
+		std::uint64_t Key()const { return ((std::uint64_t)(std::uint32_t)A << 32) | (std::uint32_t)B; }
+	};
+
+	typedef std::pair<int, int> BodyPair;
+
+	void UpdateBodyBounds(Body& body)const;
+	void FindPairs();
+	void Collide(int a, int b, Manifold& manifold)const;
+	void CollideTerrain(int a, Manifold& manifold)const;
+	void WarmStart(Manifold& manifold)const;
+	void BuildIslands();
+	void SolveIsland(int island, float h);
+	int FindRoot(int body);
+
+private:
+	RigidBodySettings mSettings;
+	const Heightmap* mTerrain = nullptr;
+	std::vector<Body> mBodies;
+	std::vector<std::uint8_t> mMoved;
+
+	float mAccumulator = 0.0f;
+
+	// Bodies by the minimum x of their bounds, kept sorted across steps.
+	std::vector<int> mSortedBodies;
+	std::vector<std::vector<BodyPair>> mChunkPairs;
+	std::vector<BodyPair> mPairs;
+
+	std::vector<int> mAwakeBodies;
+	std::vector<Manifold> mManifolds;
+
+	// Last step's manifolds and their keys, sorted, for warm starting.
+	std::vector<Manifold> mPreviousManifolds;
+	std::vector<std::pair<std::uint64_t, int>> mPreviousKeys;
+
+	// Union-find over the awake bodies, then each island's bodies and manifolds as
+	// ranges of mIslandBodies/mIslandManifolds.
+	std::vector<int> mIslandParent;
+	std::vector<int> mIslandOf;
+	std::vector<int> mIslandBodyStart;
+	std::vector<int> mIslandBodies;
+	std::vector<int> mIslandManifoldStart;
+	std::vector<int> mIslandManifolds;
+
+	RigidBodyStats mStats;
+};
@@ -0,0 +1,683 @@
+#include "SceneFile.h"
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+using namespace DirectX;
+
+namespace
+{
+	const char SceneMagic[4] = { 'S', 'C', 'N', 'B' };
+	const std::uint32_t SceneVersion = 3;
+
+	// Compiled layout: this header, then the items, colliders, meshes and strings at the
+	// given offsets, each 16-byte aligned.
+	struct SceneFileHeader
+	{
+		char Magic[4];
+		std::uint32_t Version;
+		std::uint64_t SourceHash;
+		std::uint32_t ItemCount;
+		std::uint32_t ColliderCount;
+		std::uint32_t StringBytes;
+		std::uint32_t MeshCount;
+		std::uint64_t ItemOffset;
+		std::uint64_t ColliderOffset;
+		std::uint64_t StringOffset;
+		std::uint64_t MeshOffset;
+	};
+
+	static_assert(sizeof(SceneFileHeader) == 64, "SceneFileHeader is stored as is");
+	static_assert(sizeof(SceneItem) == 160, "SceneItem is stored as is");
+	static_assert(sizeof(SceneCollider) == 24, "SceneCollider is stored as is");
+	static_assert(sizeof(SceneMesh) == 8, "SceneMesh is stored as is");
+
+	const int MaxLineTokens = 64;
+
+	// A token is a view into the text; nothing is copied until a name is interned.
+	struct Token
+	{
+		const char* Text;
+		int Length;
+		bool Quoted;
+
+		bool Is(const char* keyword)const
+		{
+			return !Quoted && (int)std::strlen(keyword) == Length && std::memcmp(Text, keyword, Length) == 0;
+		}
+	};
+
+	bool IsDigit(char c)
+	{
+		return c >= '0' && c <= '9';
+	}
+
+	bool IsDelimiter(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '#' || c == '"';
+	}
+
+	// Splits the line at p into tokens and returns the start of the next line.  Sets
+	// error for an unterminated string or too many tokens.
+	const char* TokenizeLine(const char* p, const char* end, Token* tokens, int& count, const char*& error)
+	{
+		count = 0;
+		error = nullptr;
+		while (p < end && *p != '\n')
+		{
+			const char c = *p;
+			if (c == ' ' || c == '\t' || c == '\r')
+			{
+				++p;
+				continue;
+			}
+
+			if (c == '#')
+			{
+				while (p < end && *p != '\n')
+					++p;
+				break;
+			}
+
+			Token token;
+			if (c == '"')
+			{
+				const char* close = p + 1;
+				while (close < end && *close != '"' && *close != '\n')
+					++close;
+				if (close == end || *close != '"')
+				{
+					error = "unterminated string";
+					p = close;
+					break;
+				}
+				token = { p + 1, (int)(close - p - 1), true };
+				p = close + 1;
+			}
+			else
+			{
+				const char* start = p;
+				while (p < end && !IsDelimiter(*p))
+					++p;
+				token = { start, (int)(p - start), false };
+			}
+
+			if (count == MaxLineTokens)
+			{
+				error = "too many tokens on the line";
+				while (p < end && *p != '\n')
+					++p;
+				break;
+			}
+			tokens[count++] = token;
+		}
+
+		return p < end ? p + 1 : end;
+	}
+
+	// [+-]digits[.digits][(e|E)[+-]digits] covering the whole token.  Scans the characters
+	// in place; the project builds as C++14, so std::from_chars is not available.
+	bool ParseFloat(const Token& token, float& value)
+	{
+		const char* p = token.Text;
+		const char* end = p + token.Length;
+		if (token.Quoted)
+			return false;
+
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+'))
+			negative = *p++ == '-';
+
+		double mantissa = 0.0;
+		int exponent = 0;
+		int digits = 0;
+		for (; p < end && IsDigit(*p); ++p, ++digits)
+			mantissa = mantissa*10.0 + (*p - '0');
+		if (p < end && *p == '.')
+		{
+			for (++p; p < end && IsDigit(*p); ++p, ++digits, --exponent)
+				mantissa = mantissa*10.0 + (*p - '0');
+		}
+		if (digits == 0)
+			return false;
+
+		if (p < end && (*p == 'e' || *p == 'E'))
+		{
+			++p;
+			bool negativeExponent = false;
+			if (p < end && (*p == '-' || *p == '+'))
+				negativeExponent = *p++ == '-';
+
+			int e = 0;
+			int exponentDigits = 0;
+			for (; p < end && IsDigit(*p) && e < 1000; ++p, ++exponentDigits)
+				e = e*10 + (*p - '0');
+			if (exponentDigits == 0)
+				return false;
+			exponent += negativeExponent ? -e : e;
+		}
+		if (p != end)
+			return false;
+
+		const double magnitude = exponent != 0 ? mantissa*std::pow(10.0, exponent) : mantissa;
+		value = (float)(negative ? -magnitude : magnitude);
+		return true;
+	}
+
+	bool ParseCount(const Token& token, int& value)
+	{
+		float f;
+		if (!ParseFloat(token, f) || f < 0.0f || f > 1e6f || f != std::floor(f))
+			return false;
+		value = (int)f;
+		return true;
+	}
+
+	// The fields of an entity, or the defaults of a group's or maze's items.
+	struct SceneFields
+	{
+		std::uint32_t Geometry = 0;
+		std::uint32_t DrawArg = 0;
+		std::uint32_t Material = 0;
+		std::uint32_t Layer = 0;
+		float Position[3] = { 0.0f, 0.0f, 0.0f };
+		float Scale[3] = { 1.0f, 1.0f, 1.0f };
+		float Rotation[3] = { 0.0f, 0.0f, 0.0f };
+		float TexScale[3] = { 1.0f, 1.0f, 1.0f };
+		float TexOffset[3] = { 0.0f, 0.0f, 0.0f };
+		float Cell[2] = { 0.0f, 0.0f };
+		SceneTopology Topology = SceneTopology::Triangles;
+		bool Collide = false;
+		bool Static = false;
+	};
+
+	template<typename T>
+	void WriteAt(std::ofstream& fout, std::uint64_t offset, const T* data, std::size_t count)
+	{
+		static const char zeros[16] = {};
+		const std::uint64_t position = (std::uint64_t)fout.tellp();
+		fout.write(zeros, (std::streamsize)(offset - position));
+		if (count > 0)
+			fout.write(reinterpret_cast<const char*>(data), (std::streamsize)(count*sizeof(T)));
+	}
+
+	std::uint64_t Align16(std::uint64_t offset)
+	{
+		return (offset + 15) & ~(std::uint64_t)15;
+	}
+}
+
+std::uint64_t SceneFile::HashText(const char* text, std::size_t size)
+{
+	// FNV-1a.
+	std::uint64_t hash = 14695981039346656037ull;
+	for (std::size_t i = 0; i < size; ++i)
+	{
+		hash ^= (std::uint8_t)text[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+void SceneFile::Clear()
+{
+	mBinary.Close();
+	mOwnedItems.clear();
+	mOwnedColliders.clear();
+	mOwnedMeshes.clear();
+	mOwnedStrings.clear();
+	mInterned.clear();
+
+	mItems = nullptr;
+	mItemCount = 0;
+	mColliders = nullptr;
+	mColliderCount = 0;
+	mMeshes = nullptr;
+	mMeshCount = 0;
+	mStrings = "";
+	mStringBytes = 0;
+	mSourceHash = 0;
+}
+
+void SceneFile::UseOwnedData()
+{
+	mItems = mOwnedItems.data();
+	mItemCount = (std::uint32_t)mOwnedItems.size();
+	mColliders = mOwnedColliders.data();
+	mColliderCount = (std::uint32_t)mOwnedColliders.size();
+	mMeshes = mOwnedMeshes.data();
+	mMeshCount = (std::uint32_t)mOwnedMeshes.size();
+	mStrings = mOwnedStrings.data();
+	mStringBytes = (std::uint32_t)mOwnedStrings.size();
+}
+
+std::uint32_t SceneFile::Intern(const char* s, std::size_t length)
+{
+	// Scenes name a few dozen distinct things, so a scan beats hashing.
+	for (std::uint32_t offset : mInterned)
+	{
+		const char* interned = mOwnedStrings.data() + offset;
+		if (std::strncmp(interned, s, length) == 0 && interned[length] == '\0')
+			return offset;
+	}
+
+	const std::uint32_t offset = (std::uint32_t)mOwnedStrings.size();
+	mOwnedStrings.insert(mOwnedStrings.end(), s, s + length);
+	mOwnedStrings.push_back('\0');
+	mInterned.push_back(offset);
+	return offset;
+}
+
+int SceneFile::FindItem(const char* name)const
+{
+	for (std::uint32_t i = 0; i < mItemCount; ++i)
+	{
+		if (std::strcmp(String(mItems[i].Name), name) == 0)
+			return (int)i;
+	}
+	return -1;
+}
+
+bool SceneFile::ParseText(const char* text, std::size_t size)
+{
+	Clear();
+	mError.clear();
+	mSourceHash = HashText(text, size);
+
+	// Offset 0 is the empty string, which marks a field as unset.
+	mOwnedStrings.push_back('\0');
+
+	int line = 0;
+	Token tokens[MaxLineTokens];
+	int tokenCount = 0;
+
+	auto fail = [&](const char* message)
+	{
+		Clear();
+		mError = "line " + std::to_string(line) + ": " + message;
+		return false;
+	};
+
+	auto intern = [&](const Token& token)
+	{
+		return Intern(token.Text, (std::size_t)token.Length);
+	};
+
+	// Reads the fields in tokens[first, tokenCount); returns an error message or nullptr.
+	auto parseFields = [&](int first, SceneFields& fields) -> const char*
+	{
+		int k = first;
+		auto numbers = [&](int n, float* out)
+		{
+			if (k + n > tokenCount)
+				return false;
+			for (int i = 0; i < n; ++i)
+			{
+				if (!ParseFloat(tokens[k + i], out[i]))
+					return false;
+			}
+			k += n;
+			return true;
+		};
+
+		while (k < tokenCount)
+		{
+			const Token& field = tokens[k++];
+			if (field.Is("geo"))
+			{
+				if (k + 2 > tokenCount)
+					return "geo expects a geometry and a draw arg";
+				fields.Geometry = intern(tokens[k]);
+				fields.DrawArg = intern(tokens[k + 1]);
+				k += 2;
+			}
+			else if (field.Is("mat") || field.Is("layer"))
+			{
+				if (k + 1 > tokenCount)
+					return "mat and layer expect a name";
+				(field.Is("mat") ? fields.Material : fields.Layer) = intern(tokens[k++]);
+			}
+			else if (field.Is("pos"))
+			{
+				if (!numbers(3, fields.Position))
+					return "pos expects 3 numbers";
+			}
+			else if (field.Is("scale"))
+			{
+				if (!numbers(3, fields.Scale))
+					return "scale expects 3 numbers";
+			}
+			else if (field.Is("rot"))
+			{
+				if (!numbers(3, fields.Rotation))
+					return "rot expects pitch, yaw and roll in degrees";
+			}
+			else if (field.Is("tex_scale"))
+			{
+				if (!numbers(3, fields.TexScale))
+					return "tex_scale expects 3 numbers";
+			}
+			else if (field.Is("tex_offset"))
+			{
+				if (!numbers(3, fields.TexOffset))
+					return "tex_offset expects 3 numbers";
+			}
+			else if (field.Is("cell"))
+			{
+				if (!numbers(2, fields.Cell))
+					return "cell expects 2 numbers";
+			}
+			else if (field.Is("points"))
+			{
+				fields.Topology = SceneTopology::Points;
+			}
+			else if (field.Is("collide"))
+			{
+				fields.Collide = true;
+			}
+			else if (field.Is("static"))
+			{
+				fields.Static = true;
+			}
+			else
+			{
+				return "unknown field";
+			}
+		}
+		return nullptr;
+	};
+
+	auto complete = [](const SceneFields& fields)
+	{
+		return fields.Geometry != 0 && fields.DrawArg != 0 && fields.Material != 0 && fields.Layer != 0;
+	};
+
+	auto emit = [&](const SceneFields& fields, std::uint32_t name, float x, float y, float z)
+	{
+		const XMMATRIX world = XMMatrixScaling(fields.Scale[0], fields.Scale[1], fields.Scale[2]) *
+			XMMatrixRotationRollPitchYaw(XMConvertToRadians(fields.Rotation[0]),
+				XMConvertToRadians(fields.Rotation[1]), XMConvertToRadians(fields.Rotation[2])) *
+			XMMatrixTranslation(x, y, z);
+
+		SceneItem item = {};
+		XMStoreFloat4x4(&item.World, world);
+		XMStoreFloat4x4(&item.TexTransform,
+			XMMatrixScaling(fields.TexScale[0], fields.TexScale[1], fields.TexScale[2]) *
+			XMMatrixTranslation(fields.TexOffset[0], fields.TexOffset[1], fields.TexOffset[2]));
+		item.Name = name;
+		item.Geometry = fields.Geometry;
+		item.DrawArg = fields.DrawArg;
+		item.Material = fields.Material;
+		item.Layer = fields.Layer;
+		item.Topology = fields.Topology;
+		item.Static = fields.Static ? 1 : 0;
+		mOwnedItems.push_back(item);
+
+		if (fields.Collide)
+		{
+			// Bounds of the unit cube the item's mesh is sized from.
+			const XMVECTOR extent = XMVectorScale(XMVectorAdd(XMVectorAdd(XMVectorAbs(world.r[0]),
+				XMVectorAbs(world.r[1])), XMVectorAbs(world.r[2])), 0.5f);
+			SceneCollider collider;
+			XMStoreFloat3(&collider.Min, XMVectorSubtract(world.r[3], extent));
+			XMStoreFloat3(&collider.Max, XMVectorAdd(world.r[3], extent));
+			mOwnedColliders.push_back(collider);
+		}
+	};
+
+	enum class Block { None, Group, Maze };
+	Block block = Block::None;
+	SceneFields blockFields;
+	std::uint32_t blockName = 0;
+	int mazeRow = 0;
+
+	const char* p = text;
+	const char* const end = text + size;
+	while (p < end)
+	{
+		++line;
+		const char* tokenError = nullptr;
+		p = TokenizeLine(p, end, tokens, tokenCount, tokenError);
+		if (tokenError != nullptr)
+			return fail(tokenError);
+		if (tokenCount == 0)
+			continue;
+
+		const Token& keyword = tokens[0];
+		if (block == Block::None && keyword.Is("mesh"))
+		{
+			if (tokenCount != 3 || tokens[1].Quoted || !tokens[2].Quoted || tokens[2].Length == 0)
+				return fail("mesh expects a geometry name and a quoted file");
+			const std::uint32_t geometry = intern(tokens[1]);
+			for (const SceneMesh& mesh : mOwnedMeshes)
+			{
+				if (mesh.Geometry == geometry)
+					return fail("the geometry is already imported");
+			}
+			mOwnedMeshes.push_back({ geometry, intern(tokens[2]) });
+		}
+		else if (block == Block::None)
+		{
+			const bool entity = keyword.Is("entity");
+			const bool group = keyword.Is("group");
+			if (!entity && !group && !keyword.Is("maze"))
+				return fail("expected entity, group, maze or mesh");
+			if (tokenCount < 2)
+				return fail("expected a name");
+
+			SceneFields fields;
+			if (const char* error = parseFields(2, fields))
+				return fail(error);
+
+			const std::uint32_t name = intern(tokens[1]);
+			if (entity)
+			{
+				if (!complete(fields))
+					return fail("an entity needs geo, mat and layer");
+				emit(fields, name, fields.Position[0], fields.Position[1], fields.Position[2]);
+			}
+			else
+			{
+				if (!group && (fields.Cell[0] <= 0.0f || fields.Cell[1] <= 0.0f))
+					return fail("a maze needs a positive cell size");
+				block = group ? Block::Group : Block::Maze;
+				blockFields = fields;
+				blockName = name;
+				mazeRow = 0;
+			}
+		}
+		else if (keyword.Is("end"))
+		{
+			if (tokenCount != 1)
+				return fail("unexpected tokens after end");
+			block = Block::None;
+		}
+		else if (block == Block::Group && keyword.Is("at"))
+		{
+			SceneFields fields = blockFields;
+			for (int i = 0; i < 3; ++i)
+			{
+				if (i + 1 >= tokenCount || !ParseFloat(tokens[i + 1], fields.Position[i]))
+					return fail("at expects 3 numbers");
+			}
+			if (const char* error = parseFields(4, fields))
+				return fail(error);
+			if (!complete(fields))
+				return fail("a group item needs geo, mat and layer");
+			emit(fields, blockName, fields.Position[0], fields.Position[1], fields.Position[2]);
+		}
+		else if (block == Block::Group && keyword.Is("grid"))
+		{
+			int counts[3];
+			float step[3];
+			if (tokenCount != 7 || !ParseCount(tokens[1], counts[0]) || !ParseCount(tokens[2], counts[1]) ||
+				!ParseCount(tokens[3], counts[2]) || !ParseFloat(tokens[4], step[0]) || !ParseFloat(tokens[5], step[1]) ||
+				!ParseFloat(tokens[6], step[2]))
+				return fail("grid expects 3 counts and 3 steps");
+			if (!complete(blockFields))
+				return fail("a group item needs geo, mat and layer");
+
+			const float* origin = blockFields.Position;
+			for (int z = 0; z < counts[2]; ++z)
+			{
+				for (int y = 0; y < counts[1]; ++y)
+				{
+					for (int x = 0; x < counts[0]; ++x)
+						emit(blockFields, blockName, origin[0] + x*step[0], origin[1] + y*step[1], origin[2] + z*step[2]);
+				}
+			}
+		}
+		else if (block == Block::Maze && keyword.Is("row"))
+		{
+			if (tokenCount != 2 || !tokens[1].Quoted)
+				return fail("row expects one quoted string");
+			if (!complete(blockFields))
+				return fail("a maze needs geo, mat and layer");
+
+			const Token& row = tokens[1];
+			const float* origin = blockFields.Position;
+			for (int i = 0; i < row.Length; ++i)
+			{
+				if (row.Text[i] == '#')
+					emit(blockFields, blockName, origin[0] + i*blockFields.Cell[0], origin[1], origin[2] - mazeRow*blockFields.Cell[1]);
+			}
+			++mazeRow;
+		}
+		else
+		{
+			return fail(block == Block::Group ? "expected at, grid or end" : "expected row or end");
+		}
+	}
+
+	if (block != Block::None)
+		return fail("missing end");
+
+	UseOwnedData();
+	return true;
+}
+
+bool SceneFile::LoadText(const std::wstring& filename)
+{
+	MappedFile file;
+	if (!file.Open(filename))
+	{
+		Clear();
+		mError = "cannot open the scene";
+		return false;
+	}
+	return ParseText(reinterpret_cast<const char*>(file.Data()), file.Size());
+}
+
+bool SceneFile::LoadBinary(const std::wstring& filename)
+{
+	Clear();
+	if (!mBinary.Open(filename) || mBinary.Size() < sizeof(SceneFileHeader))
+	{
+		Clear();
+		return false;
+	}
+
+	SceneFileHeader header;
+	std::memcpy(&header, mBinary.Data(), sizeof(header));
+
+	const std::uint64_t size = mBinary.Size();
+	auto fits = [size](std::uint64_t offset, std::uint64_t bytes)
+	{
+		return offset % 16 == 0 && offset <= size && bytes <= size - offset;
+	};
+
+	const std::uint8_t* data = mBinary.Data();
+	if (std::memcmp(header.Magic, SceneMagic, sizeof(SceneMagic)) != 0 || header.Version != SceneVersion ||
+		!fits(header.ItemOffset, (std::uint64_t)header.ItemCount*sizeof(SceneItem)) ||
+		!fits(header.ColliderOffset, (std::uint64_t)header.ColliderCount*sizeof(SceneCollider)) ||
+		!fits(header.MeshOffset, (std::uint64_t)header.MeshCount*sizeof(SceneMesh)) ||
+		!fits(header.StringOffset, header.StringBytes) || header.StringBytes == 0 ||
+		data[header.StringOffset + header.StringBytes - 1] != '\0')
+	{
+		Clear();
+		return false;
+	}
+
+	mItems = reinterpret_cast<const SceneItem*>(data + header.ItemOffset);
+	mItemCount = header.ItemCount;
+	mColliders = reinterpret_cast<const SceneCollider*>(data + header.ColliderOffset);
+	mColliderCount = header.ColliderCount;
+	mMeshes = reinterpret_cast<const SceneMesh*>(data + header.MeshOffset);
+	mMeshCount = header.MeshCount;
+	mStrings = reinterpret_cast<const char*>(data + header.StringOffset);
+	mStringBytes = header.StringBytes;
+	mSourceHash = header.SourceHash;
+
+	// The strings end in a terminator, so any offset inside them is a valid string.
+	for (std::uint32_t i = 0; i < mItemCount; ++i)
+	{
+		const SceneItem& item = mItems[i];
+		if (item.Name >= mStringBytes || item.Geometry >= mStringBytes || item.DrawArg >= mStringBytes ||
+			item.Material >= mStringBytes || item.Layer >= mStringBytes)
+		{
+			Clear();
+			return false;
+		}
+	}
+	for (std::uint32_t i = 0; i < mMeshCount; ++i)
+	{
+		if (mMeshes[i].Geometry >= mStringBytes || mMeshes[i].File >= mStringBytes)
+		{
+			Clear();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool SceneFile::SaveBinary(const std::wstring& filename)const
+{
+	std::ofstream fout(std::string(filename.begin(), filename.end()), std::ios::binary);
+	if (!fout)
+		return false;
+
+	SceneFileHeader header = {};
+	std::memcpy(header.Magic, SceneMagic, sizeof(SceneMagic));
+	header.Version = SceneVersion;
+	header.SourceHash = mSourceHash;
+	header.ItemCount = mItemCount;
+	header.ColliderCount = mColliderCount;
+	header.StringBytes = mStringBytes;
+	header.MeshCount = mMeshCount;
+	header.ItemOffset = Align16(sizeof(SceneFileHeader));
+	header.ColliderOffset = Align16(header.ItemOffset + (std::uint64_t)mItemCount*sizeof(SceneItem));
+	header.MeshOffset = Align16(header.ColliderOffset + (std::uint64_t)mColliderCount*sizeof(SceneCollider));
+	header.StringOffset = Align16(header.MeshOffset + (std::uint64_t)mMeshCount*sizeof(SceneMesh));
+
+	fout.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	WriteAt(fout, header.ItemOffset, mItems, mItemCount);
+	WriteAt(fout, header.ColliderOffset, mColliders, mColliderCount);
+	WriteAt(fout, header.MeshOffset, mMeshes, mMeshCount);
+	WriteAt(fout, header.StringOffset, mStrings, mStringBytes);
+	return (bool)fout;
+}
+
+bool SceneFile::Load(const std::wstring& textFile, const std::wstring& binaryFile)
+{
+	MappedFile text;
+	if (!text.Open(textFile))
+	{
+		// A compiled scene can ship without its text.
+		if (LoadBinary(binaryFile))
+			return true;
+		mError = "cannot open the scene";
+		return false;
+	}
+
+	const char* source = reinterpret_cast<const char*>(text.Data());
+	if (LoadBinary(binaryFile) && mSourceHash == HashText(source, text.Size()))
+		return true;
+
+	if (!ParseText(source, text.Size()))
+		return false;
+
+	// Best effort: the parsed scene is used either way.
+	SaveBinary(binaryFile);
+	return true;
+}
@@ -0,0 +1,150 @@
+//***************************************************************************************
+// SceneFile.h
+//
+// The demo's static scene content as data.  A text scene lists render items by name of
+// geometry, draw arg, material and render layer, either one at a time or as instancing
+// groups and maze layers, and is flattened on load into one SceneItem (world and texture
+// transforms already composed) per render item, plus the boxes of the items marked as
+// colliders.  The flattened form is written as a compiled binary that is memory mapped and
+// used in place, so a scene whose text has not changed loads without parsing.
+//
+// Text format, one statement per line, '#' starts a comment outside quotes:
+//
+//   entity <name> <fields>            one item
+//   group <name> <fields>             items sharing the fields, one per 'at' or 'grid'
+//     at x y z [<fields>]             line until 'end'; 'at' sets pos, 'grid nx ny nz
+//     grid nx ny nz dx dy dz          dx dy dz' repeats the group's pos on a lattice
+//   end
+//   maze <name> <fields> cell cx cz   one item per '#' of the rows until 'end'; column i
+//     row "#  ####"                   of row j is at pos + (i*cx, 0, -j*cz)
+//   end
+//   mesh <geometry> "<file>"          a geometry the app imports (see MeshImporter.h)
+//                                     from file, relative to the scene; its draw args
+//                                     are the file's submesh names
+//
+// Fields: geo <geometry> <drawarg>, mat <material>, layer <render layer>, pos x y z,
+// scale x y z, rot pitch yaw roll (degrees), tex_scale x y z, tex_offset x y z, points
+// (point list topology), collide (the item's bounds become a collider) and static (the
+// item never moves, so the app may merge it into a static batch).  World is
+// scale * rot * pos, the texture transform tex_scale * tex_offset.
+//***************************************************************************************
+
+#pragma once
+
+#include <DirectXMath.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "MappedFile.h"
+
+enum class SceneTopology : std::uint32_t
+{
+	Triangles = 0,
+	Points
+};
+
+// One render item.  The name, geometry, draw arg, material and layer are offsets of
+// null-terminated strings, see SceneFile::String.
+struct SceneItem
+{
+	DirectX::XMFLOAT4X4 World;
+	DirectX::XMFLOAT4X4 TexTransform;
+	std::uint32_t Name;
+	std::uint32_t Geometry;
+	std::uint32_t DrawArg;
+	std::uint32_t Material;
+	std::uint32_t Layer;
+	SceneTopology Topology;
+	std::uint32_t Static;   // 1 for an item marked 'static'.
+	std::uint32_t Reserved;
+};
+
+// A geometry imported from a model file.  Both are string offsets.
+struct SceneMesh
+{
+	std::uint32_t Geometry;
+	std::uint32_t File;
+};
+
+// World bounds of an item marked 'collide'.
+struct SceneCollider
+{
+	DirectX::XMFLOAT3 Min;
+	DirectX::XMFLOAT3 Max;
+};
+
+class SceneFile
+{
+public:
+	SceneFile() = default;
+	SceneFile(const SceneFile& rhs) = delete;
+	SceneFile& operator=(const SceneFile& rhs) = delete;
+	~SceneFile() = default;
+
+	// Loads textFile through its compiled form: binaryFile is used if it was compiled
+	// from the same text, else the text is parsed and binaryFile rewritten.  Returns
+	// false if the text cannot be read or parsed, see Error.
+	bool Load(const std::wstring& textFile, const std::wstring& binaryFile);
+
+	// Parses a text scene.
+	bool LoadText(const std::wstring& filename);
+	bool ParseText(const char* text, std::size_t size);
+
+	// Maps a compiled scene and uses it in place.  Returns false if the file is missing,
+	// truncated or of another version.
+	bool LoadBinary(const std::wstring& filename);
+	bool SaveBinary(const std::wstring& filename)const;
+
+	int ItemCount()const { return (int)mItemCount; }
+	const SceneItem& Item(int i)const { return mItems[i]; }
+
+	int ColliderCount()const { return (int)mColliderCount; }
+	const SceneCollider& Collider(int i)const { return mColliders[i]; }
+
+	// In statement order; the app builds these geometries before the items.
+	int MeshCount()const { return (int)mMeshCount; }
+	const SceneMesh& Mesh(int i)const { return mMeshes[i]; }
+
+	const char* String(std::uint32_t offset)const { return mStrings + offset; }
+
+	// Index of the first item named name, or -1.
+	int FindItem(const char* name)const;
+
+	// Hash of the text the scene was parsed or compiled from.
+	std::uint64_t SourceHash()const { return mSourceHash; }
+
+	// "line N: ..." for the last text that failed to parse.
+	const std::string& Error()const { return mError; }
+
+	static std::uint64_t HashText(const char* text, std::size_t size);
+
+private:
+	void Clear();
+	void UseOwnedData();
+
+	// Interns a string and returns its offset; equal strings share one copy.
+	std::uint32_t Intern(const char* s, std::size_t length);
+
+private:
+	// Views of either the owned vectors (parsed text) or mBinary (compiled scene).
+	const SceneItem* mItems = nullptr;
+	std::uint32_t mItemCount = 0;
+	const SceneCollider* mColliders = nullptr;
+	std::uint32_t mColliderCount = 0;
+	const SceneMesh* mMeshes = nullptr;
+	std::uint32_t mMeshCount = 0;
+	const char* mStrings = "";
+	std::uint32_t mStringBytes = 0;
+	std::uint64_t mSourceHash = 0;
+
+	MappedFile mBinary;
+
+	std::vector<SceneItem> mOwnedItems;
+	std::vector<SceneCollider> mOwnedColliders;
+	std::vector<SceneMesh> mOwnedMeshes;
+	std::vector<char> mOwnedStrings;
+	std::vector<std::uint32_t> mInterned;
+
+	std::string mError;
+};
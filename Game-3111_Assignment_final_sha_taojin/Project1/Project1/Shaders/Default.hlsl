@@ -22,6 +22,12 @@
 
 Texture2D    gDiffuseMap : register(t0);
 
+#ifdef CLUSTERED_LIGHTING
+StructuredBuffer<Light> gClusterLights       : register(t1);
+StructuredBuffer<uint2> gClusterRanges       : register(t2);
+StructuredBuffer<uint>  gClusterLightIndices : register(t3);
+#endif
+
 
 SamplerState gsamPointWrap        : register(s0);
 SamplerState gsamPointClamp       : register(s1);
@@ -66,6 +72,15 @@ cbuffer cbPass : register(b1)
     // indices [NUM_DIR_LIGHTS+NUM_POINT_LIGHTS, NUM_DIR_LIGHTS+NUM_POINT_LIGHT+NUM_SPOT_LIGHTS)
     // are spot lights for a maximum of MaxLights per object.
     Light gLights[MaxLights];
+
+    // Clustered lights: (tiles x, tiles y, slices z, point light count) and
+    // the log depth to slice mapping.
+    uint4 gClusterDims;
+    float4 gClusterZParams;
+
+    // Irradiance of the environment cube map as order 2 SH, one float4 per
+    // coefficient to keep the array packing identical on both sides.
+    float4 gAmbientSH[9];
 };
 
 cbuffer cbMaterial : register(b2)
@@ -81,6 +96,9 @@ struct VertexIn
 	float3 PosL    : POSITION;
     float3 NormalL : NORMAL;
 	float2 TexC    : TEXCOORD;
+#ifdef BAKED_LIGHTING
+    float4 BakedLight : COLOR;
+#endif
 };
 
 struct VertexOut
@@ -89,6 +107,9 @@ struct VertexOut
     float3 PosW    : POSITION;
     float3 NormalW : NORMAL;
 	float2 TexC    : TEXCOORD;
+#ifdef BAKED_LIGHTING
+    float4 BakedLight : COLOR;
+#endif
 };
 
 VertexOut VS(VertexIn vin)
@@ -109,6 +130,10 @@ VertexOut VS(VertexIn vin)
 	float4 texC = mul(float4(vin.TexC, 0.0f, 1.0f), gTexTransform);
 	vout.TexC = mul(texC, gMatTransform).xy;
 
+#ifdef BAKED_LIGHTING
+    vout.BakedLight = vin.BakedLight;
+#endif
+
     return vout;
 }
 
@@ -131,16 +156,30 @@ float4 PS(VertexOut pin) : SV_Target
 	float distToEye = length(toEyeW);
 	toEyeW /= distToEye; // normalize
 
-    // Light terms.
-    float4 ambient = gAmbientLight*diffuseAlbedo;
-
     const float shininess = 1.0f - gRoughness;
     Material mat = { diffuseAlbedo, gFresnelR0, shininess };
+
+#ifdef BAKED_LIGHTING
+    // Ambient occlusion, shadows and the directional lights were baked per vertex
+    // (see LightBaker.h), so the static light is a single multiply.
+    float4 litColor = float4(diffuseAlbedo.rgb * pin.BakedLight.rgb, 0.0f);
+#else
+    // Light terms.
+    float4 ambient = float4(EvaluateSH9(gAmbientSH, pin.NormalW), 1.0f)*diffuseAlbedo;
+
     float3 shadowFactor = 1.0f;
     float4 directLight = ComputeLighting(gLights, mat, pin.PosW,
         pin.NormalW, toEyeW, shadowFactor);
 
     float4 litColor = ambient + directLight;
+#endif
+
+#ifdef CLUSTERED_LIGHTING
+    float viewZ = mul(float4(pin.PosW, 1.0f), gView).z;
+    litColor.rgb += ComputeClusteredLighting(gClusterLights, gClusterRanges, gClusterLightIndices,
+        gClusterDims, gClusterZParams, pin.PosH.xy * gInvRenderTargetSize, viewZ,
+        mat, pin.PosW, pin.NormalW, toEyeW);
+#endif
 
 #ifdef FOG
 	float fogAmount = saturate((distToEye - gFogStart) / gFogRange);
@@ -167,4 +167,54 @@ float4 ComputeLighting(Light gLights[MaxLights], Material mat,
     return float4(result, 0.0f);
 }
 
+//---------------------------------------------------------------------------------------
+// Evaluates order 2 RGB spherical harmonics in direction n (unit length).  The basis
+// order matches SH9 in SphericalHarmonics.h; only .rgb of each coefficient is used.
+//---------------------------------------------------------------------------------------
+float3 EvaluateSH9(float4 sh[9], float3 n)
+{
+    float3 result = sh[0].rgb * 0.282095f;
+    result += sh[1].rgb * (0.488603f * n.y);
+    result += sh[2].rgb * (0.488603f * n.z);
+    result += sh[3].rgb * (0.488603f * n.x);
+    result += sh[4].rgb * (1.092548f * n.x * n.y);
+    result += sh[5].rgb * (1.092548f * n.y * n.z);
+    result += sh[6].rgb * (0.315392f * (3.0f * n.z * n.z - 1.0f));
+    result += sh[7].rgb * (1.092548f * n.x * n.z);
+    result += sh[8].rgb * (0.546274f * (n.x * n.x - n.y * n.y));
+
+    return max(result, 0.0f);
+}
+
+#ifdef CLUSTERED_LIGHTING
+//---------------------------------------------------------------------------------------
+// Evaluates the point and spot lights binned into the pixel's cluster on the CPU
+// (see LightClusters.h).  lights holds clusterDims.w point lights followed by the
+// spot lights; clusterRanges holds an (offset, count) into lightIndices per cluster.
+//---------------------------------------------------------------------------------------
+float3 ComputeClusteredLighting(StructuredBuffer<Light> lights,
+                                StructuredBuffer<uint2> clusterRanges,
+                                StructuredBuffer<uint> lightIndices,
+                                uint4 clusterDims, float4 clusterZParams,
+                                float2 screenUV, float viewZ, Material mat,
+                                float3 pos, float3 normal, float3 toEye)
+{
+    uint3 cluster;
+    cluster.xy = min(uint2(screenUV * clusterDims.xy), clusterDims.xy - 1);
+    cluster.z = (uint)clamp(log(viewZ)*clusterZParams.x - clusterZParams.y, 0.0f, clusterDims.z - 1.0f);
 
+    uint2 range = clusterRanges[(cluster.z*clusterDims.y + cluster.y)*clusterDims.x + cluster.x];
+
+    float3 result = 0.0f;
+    for(uint i = 0; i < range.y; ++i)
+    {
+        uint index = lightIndices[range.x + i];
+        if(index < clusterDims.w)
+            result += ComputePointLight(lights[index], mat, pos, normal, toEye);
+        else
+            result += ComputeSpotLight(lights[index], mat, pos, normal, toEye);
+    }
+
+    return result;
+}
+#endif
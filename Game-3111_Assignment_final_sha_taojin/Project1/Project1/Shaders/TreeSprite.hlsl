@@ -67,6 +67,15 @@ cbuffer cbPass : register(b1)
     // indices [NUM_DIR_LIGHTS+NUM_POINT_LIGHTS, NUM_DIR_LIGHTS+NUM_POINT_LIGHT+NUM_SPOT_LIGHTS)
     // are spot lights for a maximum of MaxLights per object.
     Light gLights[MaxLights];
+
+    // Clustered lights: (tiles x, tiles y, slices z, point light count) and
+    // the log depth to slice mapping.
+    uint4 gClusterDims;
+    float4 gClusterZParams;
+
+    // Irradiance of the environment cube map as order 2 SH, one float4 per
+    // coefficient to keep the array packing identical on both sides.
+    float4 gAmbientSH[9];
 };
 
 cbuffer cbMaterial : register(b2)
@@ -170,8 +179,14 @@ void GS(point VertexOut gin[1], //PrimitiveType InputVertexType InputName[NumEle
 //step6
 float4 PS(GeoOut pin) : SV_Target
 {
+#ifdef PARTICLES
+    // Particles are round blobs in the material colour that fade towards the rim.
+    float2 d = 2.0f*pin.TexC - 1.0f;
+    float4 diffuseAlbedo = float4(gDiffuseAlbedo.rgb, gDiffuseAlbedo.a*saturate(1.0f - dot(d, d)));
+#else
 	float3 uvw = float3(pin.TexC, pin.PrimID%3);
     float4 diffuseAlbedo = gTreeMapArray.Sample(gsamAnisotropicWrap, uvw) * gDiffuseAlbedo;
+#endif
 
     //using dynamic indexing
     //float4 diffuseAlbedo = gTreeMapArray[pin.PrimID % 3].Sample(gsamAnisotropicWrap, pin.TexC) * gDiffuseAlbedo;
@@ -0,0 +1,462 @@
+#include "Skinning.h"
+#include "CpuFeatures.h"
+#include "ParallelFor.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <immintrin.h>
+
+#if defined(_MSC_VER)
+#define SKIN_AVX2_TARGET
+#else
+#define SKIN_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+
+using namespace DirectX;
+
+const int SkinnedMesh::BatchSize;
+
+namespace
+{
+	bool gAllowAvx2 = true;
+
+	// Writes a batch of skinned attributes, held as eight lanes per component, to whole
+	// vertices.  The destination may be write-combined, so each vertex is written once in
+	// order.
+	void WriteBatch(const float (&lanes)[8][SkinnedMesh::BatchSize], int count, SkinnedVertex* out)
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			SkinnedVertex v;
+			v.Pos = XMFLOAT3(lanes[0][i], lanes[1][i], lanes[2][i]);
+			v.Normal = XMFLOAT3(lanes[3][i], lanes[4][i], lanes[5][i]);
+			v.TexC = XMFLOAT2(lanes[6][i], lanes[7][i]);
+			out[i] = v;
+		}
+	}
+
+	// a*b + c*d + e*f, without relying on FMA.
+	SKIN_AVX2_TARGET inline __m256 Dot3(__m256 a, __m256 b, __m256 c, __m256 d, __m256 e, __m256 f)
+	{
+		return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a, b), _mm256_mul_ps(c, d)), _mm256_mul_ps(e, f));
+	}
+
+	// Scales (x, y, z) to unit length; zero vectors stay zero.
+	SKIN_AVX2_TARGET inline void Normalize3(__m256& x, __m256& y, __m256& z)
+	{
+		const __m256 lengthSq = Dot3(x, x, y, y, z, z);
+		const __m256 invLength = _mm256_div_ps(_mm256_set1_ps(1.0f),
+			_mm256_sqrt_ps(_mm256_max_ps(lengthSq, _mm256_set1_ps(1e-12f))));
+		x = _mm256_mul_ps(x, invLength);
+		y = _mm256_mul_ps(y, invLength);
+		z = _mm256_mul_ps(z, invLength);
+	}
+
+	// v + 2*r.xyz x (r.xyz x v + r.w*v): v rotated by the unit quaternion r.
+	SKIN_AVX2_TARGET inline void Rotate(const __m256 (&r)[4], __m256& x, __m256& y, __m256& z)
+	{
+		const __m256 two = _mm256_set1_ps(2.0f);
+
+		const __m256 tx = _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(r[1], z), _mm256_mul_ps(r[2], y)), _mm256_mul_ps(r[3], x));
+		const __m256 ty = _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(r[2], x), _mm256_mul_ps(r[0], z)), _mm256_mul_ps(r[3], y));
+		const __m256 tz = _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(r[0], y), _mm256_mul_ps(r[1], x)), _mm256_mul_ps(r[3], z));
+
+		x = _mm256_add_ps(x, _mm256_mul_ps(two, _mm256_sub_ps(_mm256_mul_ps(r[1], tz), _mm256_mul_ps(r[2], ty))));
+		y = _mm256_add_ps(y, _mm256_mul_ps(two, _mm256_sub_ps(_mm256_mul_ps(r[2], tx), _mm256_mul_ps(r[0], tz))));
+		z = _mm256_add_ps(z, _mm256_mul_ps(two, _mm256_sub_ps(_mm256_mul_ps(r[0], ty), _mm256_mul_ps(r[1], tx))));
+	}
+
+	// v rotated by the unit quaternion r, in XMVECTOR form.
+	XMVECTOR RotateScalar(FXMVECTOR r, FXMVECTOR v)
+	{
+		const XMVECTOR t = XMVectorMultiplyAdd(XMVectorSplatW(r), v, XMVector3Cross(r, v));
+		return XMVectorMultiplyAdd(XMVectorReplicate(2.0f), XMVector3Cross(r, t), v);
+	}
+}
+
+int SkinPaletteStride(SkinningMethod method)
+{
+	return method == SkinningMethod::LinearBlend ? 12 : 8;
+}
+
+void BuildSkinPalette(const Skeleton& skeleton, const XMFLOAT4X4* model, SkinningMethod method, float* palette)
+{
+	const int stride = SkinPaletteStride(method);
+
+	for (int j = 0; j < skeleton.JointCount(); ++j)
+	{
+		const XMMATRIX skin = XMLoadFloat4x4(&skeleton.InverseBind[j]) * XMLoadFloat4x4(&model[j]);
+		float* entry = palette + (std::size_t)j*stride;
+
+		if (method == SkinningMethod::LinearBlend)
+		{
+			// The first three columns, so x' = dot(column0, (x, y, z, 1)) and so on.
+			const XMMATRIX columns = XMMatrixTranspose(skin);
+			XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(entry + 0), columns.r[0]);
+			XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(entry + 4), columns.r[1]);
+			XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(entry + 8), columns.r[2]);
+		}
+		else
+		{
+			XMVECTOR scale, rotation, translation;
+			XMMatrixDecompose(&scale, &rotation, &translation, skin);
+
+			// dual = 0.5 * (t, 0) * rotation.
+			const XMVECTOR dualXyz = XMVectorScale(XMVectorMultiplyAdd(translation, XMVectorSplatW(rotation),
+				XMVector3Cross(translation, rotation)), 0.5f);
+			const float dualW = -0.5f*XMVectorGetX(XMVector3Dot(translation, rotation));
+
+			XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(entry + 0), rotation);
+			XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(entry + 4), XMVectorSetW(dualXyz, dualW));
+		}
+	}
+}
+
+bool SkinnedMesh::Create(const std::vector<SkinnedBindVertex>& vertices, const std::vector<std::uint32_t>& indices,
+	int jointCount)
+{
+	mVertexCount = (int)vertices.size();
+	mPaddedCount = (mVertexCount + BatchSize - 1) / BatchSize * BatchSize;
+	mJointCount = jointCount;
+	mIndices = indices;
+
+	// The padding vertices have no weight, so the kernels skin them to zero.
+	mStreams.assign((std::size_t)StreamCount*mPaddedCount, 0.0f);
+	mJoints.assign((std::size_t)4*mPaddedCount, 0);
+
+	for (int i = 0; i < mVertexCount; ++i)
+	{
+		const SkinnedBindVertex& v = vertices[i];
+
+		float weightSum = 0.0f;
+		for (int k = 0; k < 4; ++k)
+		{
+			if (v.Joints[k] < 0 || v.Joints[k] >= jointCount)
+				return false;
+			weightSum += v.Weights[k];
+		}
+		const float invWeightSum = weightSum > 0.0f ? 1.0f / weightSum : 0.0f;
+
+		mStreams[(std::size_t)PosX*mPaddedCount + i] = v.Pos.x;
+		mStreams[(std::size_t)PosY*mPaddedCount + i] = v.Pos.y;
+		mStreams[(std::size_t)PosZ*mPaddedCount + i] = v.Pos.z;
+		mStreams[(std::size_t)NormX*mPaddedCount + i] = v.Normal.x;
+		mStreams[(std::size_t)NormY*mPaddedCount + i] = v.Normal.y;
+		mStreams[(std::size_t)NormZ*mPaddedCount + i] = v.Normal.z;
+		mStreams[(std::size_t)TexU*mPaddedCount + i] = v.TexC.x;
+		mStreams[(std::size_t)TexV*mPaddedCount + i] = v.TexC.y;
+
+		for (int k = 0; k < 4; ++k)
+		{
+			mStreams[(std::size_t)(Weight0 + k)*mPaddedCount + i] = v.Weights[k] * invWeightSum;
+			mJoints[(std::size_t)k*mPaddedCount + i] = v.Joints[k];
+		}
+	}
+
+	return true;
+}
+
+bool SkinnedMesh::UsesAvx2()
+{
+	static const bool avx2 = CpuSupportsAvx2();
+	return avx2 && gAllowAvx2;
+}
+
+void SkinnedMesh::SetAllowAvx2(bool allow)
+{
+	gAllowAvx2 = allow;
+}
+
+void SkinnedMesh::Skin(const float* palette, SkinningMethod method, SkinnedVertex* out)const
+{
+	if (UsesAvx2())
+	{
+		if (method == SkinningMethod::LinearBlend)
+			SkinLinearBlendAvx2(palette, out);
+		else
+			SkinDualQuaternionAvx2(palette, out);
+	}
+	else
+	{
+		if (method == SkinningMethod::LinearBlend)
+			SkinLinearBlendScalar(palette, 0, mVertexCount, out);
+		else
+			SkinDualQuaternionScalar(palette, 0, mVertexCount, out);
+	}
+}
+
+void SkinnedMesh::SkinLinearBlendScalar(const float* palette, int begin, int end, SkinnedVertex* out)const
+{
+	for (int i = begin; i < end; ++i)
+	{
+		XMVECTOR c0 = XMVectorZero();
+		XMVECTOR c1 = XMVectorZero();
+		XMVECTOR c2 = XMVectorZero();
+		for (int k = 0; k < 4; ++k)
+		{
+			const float weight = StreamData(Weight0 + k)[i];
+			if (weight == 0.0f)
+				continue;
+
+			const float* entry = palette + (std::size_t)JointData(k)[i]*12;
+			const XMVECTOR w = XMVectorReplicate(weight);
+			c0 = XMVectorMultiplyAdd(w, XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(entry + 0)), c0);
+			c1 = XMVectorMultiplyAdd(w, XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(entry + 4)), c1);
+			c2 = XMVectorMultiplyAdd(w, XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(entry + 8)), c2);
+		}
+
+		const XMVECTOR p = XMVectorSet(StreamData(PosX)[i], StreamData(PosY)[i], StreamData(PosZ)[i], 1.0f);
+		const XMVECTOR n = XMVectorSet(StreamData(NormX)[i], StreamData(NormY)[i], StreamData(NormZ)[i], 0.0f);
+
+		SkinnedVertex v;
+		v.Pos = XMFLOAT3(XMVectorGetX(XMVector4Dot(c0, p)), XMVectorGetX(XMVector4Dot(c1, p)), XMVectorGetX(XMVector4Dot(c2, p)));
+		XMStoreFloat3(&v.Normal, XMVector3Normalize(XMVectorSet(XMVectorGetX(XMVector4Dot(c0, n)),
+			XMVectorGetX(XMVector4Dot(c1, n)), XMVectorGetX(XMVector4Dot(c2, n)), 0.0f)));
+		v.TexC = XMFLOAT2(StreamData(TexU)[i], StreamData(TexV)[i]);
+		out[i - begin] = v;
+	}
+}
+
+void SkinnedMesh::SkinDualQuaternionScalar(const float* palette, int begin, int end, SkinnedVertex* out)const
+{
+	for (int i = begin; i < end; ++i)
+	{
+		XMVECTOR real = XMVectorZero();
+		XMVECTOR dual = XMVectorZero();
+		XMVECTOR pivot = XMVectorZero();
+		for (int k = 0; k < 4; ++k)
+		{
+			float weight = StreamData(Weight0 + k)[i];
+			if (weight == 0.0f)
+				continue;
+
+			const float* entry = palette + (std::size_t)JointData(k)[i]*8;
+			const XMVECTOR r = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(entry + 0));
+			const XMVECTOR d = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(entry + 4));
+
+			// Blend every joint in the hemisphere of the first one.
+			if (k == 0)
+				pivot = r;
+			else if (XMVectorGetX(XMVector4Dot(pivot, r)) < 0.0f)
+				weight = -weight;
+
+			const XMVECTOR w = XMVectorReplicate(weight);
+			real = XMVectorMultiplyAdd(w, r, real);
+			dual = XMVectorMultiplyAdd(w, d, dual);
+		}
+
+		const XMVECTOR invLength = XMVectorReciprocalSqrt(XMVectorMax(XMVector4LengthSq(real), XMVectorReplicate(1e-12f)));
+		real = XMVectorMultiply(real, invLength);
+		dual = XMVectorMultiply(dual, invLength);
+
+		// Translation 2*(r.w*d.xyz - d.w*r.xyz + r.xyz x d.xyz).
+		XMVECTOR translation = XMVectorMultiply(XMVectorSplatW(real), dual);
+		translation = XMVectorNegativeMultiplySubtract(XMVectorSplatW(dual), real, translation);
+		translation = XMVectorScale(XMVectorAdd(translation, XMVector3Cross(real, dual)), 2.0f);
+
+		const XMVECTOR p = XMVectorSet(StreamData(PosX)[i], StreamData(PosY)[i], StreamData(PosZ)[i], 0.0f);
+		const XMVECTOR n = XMVectorSet(StreamData(NormX)[i], StreamData(NormY)[i], StreamData(NormZ)[i], 0.0f);
+
+		SkinnedVertex v;
+		XMStoreFloat3(&v.Pos, XMVectorAdd(RotateScalar(real, p), translation));
+		XMStoreFloat3(&v.Normal, XMVector3Normalize(RotateScalar(real, n)));
+		v.TexC = XMFLOAT2(StreamData(TexU)[i], StreamData(TexV)[i]);
+		out[i - begin] = v;
+	}
+}
+
+SKIN_AVX2_TARGET void SkinnedMesh::SkinLinearBlendAvx2(const float* palette, SkinnedVertex* out)const
+{
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256i stride = _mm256_set1_epi32(12);
+
+	alignas(32) float lanes[8][BatchSize];
+
+	for (int base = 0; base < mPaddedCount; base += BatchSize)
+	{
+		// The blended matrix columns, eight vertices at a time.
+		__m256 m[12];
+		for (int e = 0; e < 12; ++e)
+			m[e] = zero;
+
+		for (int k = 0; k < 4; ++k)
+		{
+			const __m256 w = _mm256_loadu_ps(StreamData(Weight0 + k) + base);
+
+			// Most vertices have fewer than four influences; skip the gathers of the unused.
+			if (_mm256_movemask_ps(_mm256_cmp_ps(w, zero, _CMP_NEQ_OQ)) == 0)
+				continue;
+
+			const __m256i offset = _mm256_mullo_epi32(
+				_mm256_loadu_si256(reinterpret_cast<const __m256i*>(JointData(k) + base)), stride);
+			for (int e = 0; e < 12; ++e)
+				m[e] = _mm256_add_ps(m[e], _mm256_mul_ps(w, _mm256_i32gather_ps(palette + e, offset, 4)));
+		}
+
+		const __m256 px = _mm256_loadu_ps(StreamData(PosX) + base);
+		const __m256 py = _mm256_loadu_ps(StreamData(PosY) + base);
+		const __m256 pz = _mm256_loadu_ps(StreamData(PosZ) + base);
+		const __m256 nx = _mm256_loadu_ps(StreamData(NormX) + base);
+		const __m256 ny = _mm256_loadu_ps(StreamData(NormY) + base);
+		const __m256 nz = _mm256_loadu_ps(StreamData(NormZ) + base);
+
+		__m256 tnx = Dot3(m[0], nx, m[1], ny, m[2], nz);
+		__m256 tny = Dot3(m[4], nx, m[5], ny, m[6], nz);
+		__m256 tnz = Dot3(m[8], nx, m[9], ny, m[10], nz);
+		Normalize3(tnx, tny, tnz);
+
+		_mm256_store_ps(lanes[0], _mm256_add_ps(Dot3(m[0], px, m[1], py, m[2], pz), m[3]));
+		_mm256_store_ps(lanes[1], _mm256_add_ps(Dot3(m[4], px, m[5], py, m[6], pz), m[7]));
+		_mm256_store_ps(lanes[2], _mm256_add_ps(Dot3(m[8], px, m[9], py, m[10], pz), m[11]));
+		_mm256_store_ps(lanes[3], tnx);
+		_mm256_store_ps(lanes[4], tny);
+		_mm256_store_ps(lanes[5], tnz);
+		_mm256_store_ps(lanes[6], _mm256_loadu_ps(StreamData(TexU) + base));
+		_mm256_store_ps(lanes[7], _mm256_loadu_ps(StreamData(TexV) + base));
+
+		WriteBatch(lanes, std::min(BatchSize, mVertexCount - base), out + base);
+	}
+}
+
+SKIN_AVX2_TARGET void SkinnedMesh::SkinDualQuaternionAvx2(const float* palette, SkinnedVertex* out)const
+{
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 signBit = _mm256_set1_ps(-0.0f);
+	const __m256 two = _mm256_set1_ps(2.0f);
+	const __m256i stride = _mm256_set1_epi32(8);
+
+	alignas(32) float lanes[8][BatchSize];
+
+	for (int base = 0; base < mPaddedCount; base += BatchSize)
+	{
+		__m256 real[4] = { zero, zero, zero, zero };
+		__m256 dual[4] = { zero, zero, zero, zero };
+		__m256 pivot[4] = { zero, zero, zero, zero };
+
+		for (int k = 0; k < 4; ++k)
+		{
+			__m256 w = _mm256_loadu_ps(StreamData(Weight0 + k) + base);
+			if (_mm256_movemask_ps(_mm256_cmp_ps(w, zero, _CMP_NEQ_OQ)) == 0)
+				continue;
+
+			const __m256i offset = _mm256_mullo_epi32(
+				_mm256_loadu_si256(reinterpret_cast<const __m256i*>(JointData(k) + base)), stride);
+
+			__m256 r[4];
+			for (int e = 0; e < 4; ++e)
+				r[e] = _mm256_i32gather_ps(palette + e, offset, 4);
+
+			// Blend every joint in the hemisphere of the first one.
+			if (k == 0)
+			{
+				for (int e = 0; e < 4; ++e)
+					pivot[e] = r[e];
+			}
+			else
+			{
+				const __m256 cosAngle = _mm256_add_ps(Dot3(pivot[0], r[0], pivot[1], r[1], pivot[2], r[2]),
+					_mm256_mul_ps(pivot[3], r[3]));
+				w = _mm256_xor_ps(w, _mm256_and_ps(_mm256_cmp_ps(cosAngle, zero, _CMP_LT_OQ), signBit));
+			}
+
+			for (int e = 0; e < 4; ++e)
+			{
+				real[e] = _mm256_add_ps(real[e], _mm256_mul_ps(w, r[e]));
+				dual[e] = _mm256_add_ps(dual[e], _mm256_mul_ps(w, _mm256_i32gather_ps(palette + 4 + e, offset, 4)));
+			}
+		}
+
+		const __m256 lengthSq = _mm256_add_ps(Dot3(real[0], real[0], real[1], real[1], real[2], real[2]),
+			_mm256_mul_ps(real[3], real[3]));
+		const __m256 invLength = _mm256_div_ps(_mm256_set1_ps(1.0f),
+			_mm256_sqrt_ps(_mm256_max_ps(lengthSq, _mm256_set1_ps(1e-12f))));
+		for (int e = 0; e < 4; ++e)
+		{
+			real[e] = _mm256_mul_ps(real[e], invLength);
+			dual[e] = _mm256_mul_ps(dual[e], invLength);
+		}
+
+		// Translation 2*(r.w*d.xyz - d.w*r.xyz + r.xyz x d.xyz).
+		const __m256 tx = _mm256_mul_ps(two, _mm256_add_ps(
+			_mm256_sub_ps(_mm256_mul_ps(real[3], dual[0]), _mm256_mul_ps(dual[3], real[0])),
+			_mm256_sub_ps(_mm256_mul_ps(real[1], dual[2]), _mm256_mul_ps(real[2], dual[1]))));
+		const __m256 ty = _mm256_mul_ps(two, _mm256_add_ps(
+			_mm256_sub_ps(_mm256_mul_ps(real[3], dual[1]), _mm256_mul_ps(dual[3], real[1])),
+			_mm256_sub_ps(_mm256_mul_ps(real[2], dual[0]), _mm256_mul_ps(real[0], dual[2]))));
+		const __m256 tz = _mm256_mul_ps(two, _mm256_add_ps(
+			_mm256_sub_ps(_mm256_mul_ps(real[3], dual[2]), _mm256_mul_ps(dual[3], real[2])),
+			_mm256_sub_ps(_mm256_mul_ps(real[0], dual[1]), _mm256_mul_ps(real[1], dual[0]))));
+
+		__m256 px = _mm256_loadu_ps(StreamData(PosX) + base);
+		__m256 py = _mm256_loadu_ps(StreamData(PosY) + base);
+		__m256 pz = _mm256_loadu_ps(StreamData(PosZ) + base);
+		__m256 nx = _mm256_loadu_ps(StreamData(NormX) + base);
+		__m256 ny = _mm256_loadu_ps(StreamData(NormY) + base);
+		__m256 nz = _mm256_loadu_ps(StreamData(NormZ) + base);
+		Rotate(real, px, py, pz);
+		Rotate(real, nx, ny, nz);
+		Normalize3(nx, ny, nz);
+
+		_mm256_store_ps(lanes[0], _mm256_add_ps(px, tx));
+		_mm256_store_ps(lanes[1], _mm256_add_ps(py, ty));
+		_mm256_store_ps(lanes[2], _mm256_add_ps(pz, tz));
+		_mm256_store_ps(lanes[3], nx);
+		_mm256_store_ps(lanes[4], ny);
+		_mm256_store_ps(lanes[5], nz);
+		_mm256_store_ps(lanes[6], _mm256_loadu_ps(StreamData(TexU) + base));
+		_mm256_store_ps(lanes[7], _mm256_loadu_ps(StreamData(TexV) + base));
+
+		WriteBatch(lanes, std::min(BatchSize, mVertexCount - base), out + base);
+	}
+}
+
+bool SkinnedCrowd::Create(const Skeleton& skeleton, const SkinnedMesh& mesh, const std::vector<AnimationClip>& clips,
+	int characterCount)
+{
+	if (clips.empty() || mesh.JointCount() != skeleton.JointCount() ||
+		(int)skeleton.InverseBind.size() != skeleton.JointCount())
+		return false;
+
+	for (const AnimationClip& clip : clips)
+	{
+		if (clip.JointCount() != skeleton.JointCount())
+			return false;
+	}
+
+	mSkeleton = skeleton;
+	mMesh = mesh;
+	mClips = clips;
+	mCharacters.assign(characterCount, CrowdCharacter());
+	return true;
+}
+
+void SkinnedCrowd::Animate(float dt)
+{
+	for (CrowdCharacter& character : mCharacters)
+	{
+		// Keep the time within the clip so it does not lose precision over a long session.
+		const float duration = mClips[character.Clip].Duration();
+		character.Time = std::fmod(character.Time + dt*character.Speed, duration);
+		if (character.Time < 0.0f)
+			character.Time += duration;
+	}
+}
+
+void SkinnedCrowd::Skin(SkinnedVertex* out)const
+{
+	const int vertexCount = mMesh.VertexCount();
+
+	ParallelFor(0, CharacterCount(), [&](int c)
+	{
+		const CrowdCharacter& character = mCharacters[c];
+
+		LocalPose pose;
+		XMFLOAT4X4 model[MaxJoints];
+		alignas(32) float palette[MaxJoints * 12];
+
+		mClips[character.Clip].Sample(character.Time, mInterpolation, pose);
+		LocalToModel(mSkeleton, pose, XMLoadFloat4x4(&character.World), model);
+		BuildSkinPalette(mSkeleton, model, mMethod, palette);
+		mMesh.Skin(palette, mMethod, out + (std::size_t)c*vertexCount);
+	});
+}
@@ -0,0 +1,167 @@
+//***************************************************************************************
+// Skinning.h
+//
+// CPU skinning of an animated crowd.  A SkinnedMesh keeps its bind-pose vertices and up
+// to four joint influences each as structure-of-arrays, padded to eight vertices, so
+// linear-blend and dual-quaternion skinning run eight vertices per AVX2 register (with
+// an XMVECTOR path on CPUs without it).  SkinnedCrowd samples every character's clip,
+// propagates the pose and skins the mesh straight into a vertex stream, in parallel
+// across the characters.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "../../Common/MathHelper.h"
+#include "Animation.h"
+
+// One vertex of the skinned stream, laid out like Vertex (FrameResource.h) so the
+// standard input layout and the software rasterizer read it.
+struct SkinnedVertex
+{
+	DirectX::XMFLOAT3 Pos;
+	DirectX::XMFLOAT3 Normal;
+	DirectX::XMFLOAT2 TexC;
+};
+
+// A bind-pose vertex with up to four influences; unused ones have zero weight.
+struct SkinnedBindVertex
+{
+	DirectX::XMFLOAT3 Pos = { 0.0f, 0.0f, 0.0f };
+	DirectX::XMFLOAT3 Normal = { 0.0f, 1.0f, 0.0f };
+	DirectX::XMFLOAT2 TexC = { 0.0f, 0.0f };
+	int Joints[4] = { 0, 0, 0, 0 };
+	float Weights[4] = { 1.0f, 0.0f, 0.0f, 0.0f };
+};
+
+enum class SkinningMethod : int
+{
+	// Blends the joint matrices; cheap, but twisted joints lose volume.
+	LinearBlend = 0,
+
+	// Blends the joints as dual quaternions; keeps the volume, rigid joints only.
+	DualQuaternion
+};
+
+// Floats per joint in a skin palette.
+int SkinPaletteStride(SkinningMethod method);
+
+// Turns the model-space pose into the palette the skinning kernels read: the columns of
+// InverseBind[j]*model[j] for linear blend, its rotation and translation as a unit dual
+// quaternion (real xyzw, dual xyzw) otherwise.
+void BuildSkinPalette(const Skeleton& skeleton, const DirectX::XMFLOAT4X4* model, SkinningMethod method,
+	float* palette);
+
+class SkinnedMesh
+{
+public:
+	// Vertices per SIMD batch; the streams are padded to a multiple of it.
+	static const int BatchSize = 8;
+
+	// Copies the vertices into streams and normalizes their weights.  Returns false if an
+	// influence refers to a joint outside [0, jointCount).
+	bool Create(const std::vector<SkinnedBindVertex>& vertices, const std::vector<std::uint32_t>& indices,
+		int jointCount);
+
+	int VertexCount()const { return mVertexCount; }
+	int JointCount()const { return mJointCount; }
+	const std::vector<std::uint32_t>& Indices()const { return mIndices; }
+
+	// Writes the VertexCount skinned vertices to out.
+	void Skin(const float* palette, SkinningMethod method, SkinnedVertex* out)const;
+
+	// True if Skin uses AVX2.  SetAllowAvx2(false) forces the XMVECTOR path, e.g. to
+	// compare the two.
+	static bool UsesAvx2();
+	static void SetAllowAvx2(bool allow);
+
+private:
+	enum Stream : int
+	{
+		PosX = 0,
+		PosY,
+		PosZ,
+		NormX,
+		NormY,
+		NormZ,
+		TexU,
+		TexV,
+		Weight0,
+		Weight1,
+		Weight2,
+		Weight3,
+		StreamCount
+	};
+
+	const float* StreamData(int stream)const { return &mStreams[(std::size_t)stream*mPaddedCount]; }
+	const std::int32_t* JointData(int influence)const { return &mJoints[(std::size_t)influence*mPaddedCount]; }
+
+	void SkinLinearBlendScalar(const float* palette, int begin, int end, SkinnedVertex* out)const;
+	void SkinDualQuaternionScalar(const float* palette, int begin, int end, SkinnedVertex* out)const;
+	void SkinLinearBlendAvx2(const float* palette, SkinnedVertex* out)const;
+	void SkinDualQuaternionAvx2(const float* palette, SkinnedVertex* out)const;
+
+private:
+	int mVertexCount = 0;
+	int mPaddedCount = 0;
+	int mJointCount = 0;
+
+	std::vector<float> mStreams;
+	std::vector<std::int32_t> mJoints;
+	std::vector<std::uint32_t> mIndices;
+};
+
+struct CrowdCharacter
+{
+	DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
+	int Clip = 0;
+
+	// Clip time in seconds and its rate of advance.
+	float Time = 0.0f;
+	float Speed = 1.0f;
+};
+
+class SkinnedCrowd
+{
+public:
+	SkinnedCrowd() = default;
+	SkinnedCrowd(const SkinnedCrowd& rhs) = delete;
+	SkinnedCrowd& operator=(const SkinnedCrowd& rhs) = delete;
+	~SkinnedCrowd() = default;
+
+	// characterCount copies of mesh, all at the origin playing clip 0.  Returns false if
+	// the mesh, clips and skeleton do not have the same joints.
+	bool Create(const Skeleton& skeleton, const SkinnedMesh& mesh, const std::vector<AnimationClip>& clips,
+		int characterCount);
+
+	int CharacterCount()const { return (int)mCharacters.size(); }
+	CrowdCharacter& Character(int index) { return mCharacters[index]; }
+
+	const SkinnedMesh& Mesh()const { return mMesh; }
+
+	// Vertices of every character, back to back: character c starts at c*Mesh().VertexCount().
+	int VertexCount()const { return CharacterCount()*mMesh.VertexCount(); }
+
+	SkinningMethod Method()const { return mMethod; }
+	void SetMethod(SkinningMethod method) { mMethod = method; }
+
+	ClipInterpolation Interpolation()const { return mInterpolation; }
+	void SetInterpolation(ClipInterpolation interpolation) { mInterpolation = interpolation; }
+
+	// Advances every character's clip time by dt*Speed.
+	void Animate(float dt);
+
+	// Poses every character and writes its world-space vertices to out, which may be
+	// write-combined upload memory.
+	void Skin(SkinnedVertex* out)const;
+
+private:
+	Skeleton mSkeleton;
+	SkinnedMesh mMesh;
+	std::vector<AnimationClip> mClips;
+	std::vector<CrowdCharacter> mCharacters;
+
+	SkinningMethod mMethod = SkinningMethod::LinearBlend;
+	ClipInterpolation mInterpolation = ClipInterpolation::Nlerp;
+};
@@ -0,0 +1,778 @@
+#include "SoftwareRasterizer.h"
+#include "ImageFile.h"
+#include "LightingUtil.h"
+#include "ParallelFor.h"
+#include <climits>
+#include <cmath>
+
+using namespace DirectX;
+
+const int SoftwareRasterizer::TileSize;
+const int SoftwareRasterizer::AttrCount;
+const int SoftwareRasterizer::AttrPosW;
+const int SoftwareRasterizer::AttrNormalW;
+const int SoftwareRasterizer::AttrTexC;
+const int SoftwareRasterizer::AttrBakedLight;
+
+namespace
+{
+	// The shaders are compiled with the default NUM_DIR_LIGHTS.
+	const int NumDirLights = 3;
+
+	// Triangles are clipped against |x|, |y| <= GuardBand*w; everything in between is
+	// left to the scissor of the tile loops.
+	const float GuardBand = 8.0f;
+
+	// Vertex positions snap to 1/256 pixel like the D3D rasterizer's subpixel grid.
+	const double SubpixelScale = 256.0;
+
+	const int PrimitiveGrain = 256;
+
+	// Plane p of the clip volume evaluated at v; inside where >= 0.
+	float ClipDistance(const XMFLOAT4& v, int p)
+	{
+		switch (p)
+		{
+		case 0: return v.z;
+		case 1: return v.w - v.z;
+		case 2: return GuardBand*v.w + v.x;
+		case 3: return GuardBand*v.w - v.x;
+		case 4: return GuardBand*v.w + v.y;
+		default: return GuardBand*v.w - v.y;
+		}
+	}
+}
+
+void SoftwareRasterizer::Resize(int width, int height)
+{
+	mWidth = std::max(width, 1);
+	mHeight = std::max(height, 1);
+
+	// Rows are padded so the four pixel groups never run past the end of a row.
+	mStride = (mWidth + 3) & ~3;
+	mTilesX = (mWidth + TileSize - 1) / TileSize;
+	mTilesY = (mHeight + TileSize - 1) / TileSize;
+
+	mColor.assign((size_t)mStride*mHeight, XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f));
+	mDepth.assign((size_t)mStride*mHeight, 1.0f);
+	mBins.clear();
+	mBinGroups = 0;
+}
+
+void SoftwareRasterizer::BeginFrame(const PassConstants& pass, const LightClusterGrid* clusters)
+{
+	mPass = pass;
+	mClusters = clusters;
+
+	// The pass constants hold the matrices transposed for HLSL.
+	XMStoreFloat4x4(&mViewProj, XMMatrixTranspose(XMLoadFloat4x4(&pass.ViewProj)));
+	XMStoreFloat4x4(&mView, XMMatrixTranspose(XMLoadFloat4x4(&pass.View)));
+
+	for (int i = 0; i < 9; ++i)
+		mAmbientSH.C[i] = XMFLOAT3(pass.AmbientSH[i].x, pass.AmbientSH[i].y, pass.AmbientSH[i].z);
+}
+
+void SoftwareRasterizer::Clear(const XMFLOAT4& color)
+{
+	std::fill(mColor.begin(), mColor.end(), color);
+	std::fill(mDepth.begin(), mDepth.end(), 1.0f);
+}
+
+std::uint32_t SoftwareRasterizer::ReadIndex(const SoftwareDrawItem& item, std::uint32_t k)
+{
+	if (item.Index32)
+		return static_cast<const std::uint32_t*>(item.Indices)[k];
+	return static_cast<const std::uint16_t*>(item.Indices)[k];
+}
+
+void SoftwareRasterizer::Draw(SoftwarePipeline pipeline, const std::vector<SoftwareDrawItem>& items)
+{
+	if (items.empty() || mColor.empty())
+		return;
+
+	mPipeline = pipeline;
+	mItems = &items;
+	SetupItems(items);
+
+	std::vector<std::uint32_t> primStart(items.size() + 1, 0);
+	if (pipeline == SoftwarePipeline::TreeSprites)
+	{
+		// One point per index, expanded to a quad as the geometry shader does.
+		for (size_t i = 0; i < items.size(); ++i)
+			primStart[i + 1] = primStart[i] + items[i].IndexCount;
+
+		SetupPrimitives(primStart, [&](int item, std::uint32_t k, std::vector<Triangle>& out)
+		{
+			ExpandSprite(items[item], item, k, out);
+		});
+	}
+	else
+	{
+		ShadeVertices(items);
+
+		for (size_t i = 0; i < items.size(); ++i)
+			primStart[i + 1] = primStart[i] + items[i].IndexCount / 3;
+
+		SetupPrimitives(primStart, [&](int item, std::uint32_t t, std::vector<Triangle>& out)
+		{
+			const SoftwareDrawItem& ri = items[item];
+			const ClipVertex* v[3];
+			for (int j = 0; j < 3; ++j)
+			{
+				std::uint32_t index = ri.BaseVertexLocation + ReadIndex(ri, ri.StartIndexLocation + 3 * t + j);
+				v[j] = &mClipVertices[mVertexStart[item] + (index - mFirstVertex[item])];
+			}
+			ClipAndSetup(v, item, t, out);
+		});
+	}
+
+	BinTriangles();
+	ParallelFor(0, mTilesX*mTilesY, [&](int tile) { RasterTile(tile); });
+
+	mItems = nullptr;
+}
+
+void SoftwareRasterizer::SetupItems(const std::vector<SoftwareDrawItem>& items)
+{
+	mItemStates.resize(items.size());
+	for (size_t i = 0; i < items.size(); ++i)
+	{
+		const SoftwareDrawItem& ri = items[i];
+		ItemState& state = mItemStates[i];
+
+		state.World = ri.World;
+
+		// The vertex shader applies the object's then the material's texture transform.
+		XMMATRIX texTransform = XMLoadFloat4x4(&ri.TexTransform);
+		XMMATRIX matTransform = ri.Mat != nullptr ? XMLoadFloat4x4(&ri.Mat->MatTransform) : XMMatrixIdentity();
+		XMStoreFloat4x4(&state.TexMatTransform, XMMatrixMultiply(texTransform, matTransform));
+
+		state.Vertices = static_cast<const std::uint8_t*>(ri.Vertices);
+		state.VertexByteStride = ri.VertexByteStride;
+		state.BakedLight = ri.BakedLight;
+	}
+}
+
+void SoftwareRasterizer::ShadeVertices(const std::vector<SoftwareDrawItem>& items)
+{
+	// Each item's referenced vertex range is shaded once into mClipVertices.
+	mVertexStart.assign(items.size() + 1, 0);
+	mFirstVertex.assign(items.size(), 0);
+	for (size_t i = 0; i < items.size(); ++i)
+	{
+		const SoftwareDrawItem& ri = items[i];
+		std::uint32_t first = UINT_MAX;
+		std::uint32_t last = 0;
+		for (std::uint32_t k = 0; k < ri.IndexCount; ++k)
+		{
+			std::uint32_t index = ri.BaseVertexLocation + ReadIndex(ri, ri.StartIndexLocation + k);
+			first = std::min(first, index);
+			last = std::max(last, index);
+		}
+
+		mFirstVertex[i] = ri.IndexCount > 0 ? first : 0;
+		mVertexStart[i + 1] = mVertexStart[i] + (ri.IndexCount > 0 ? last - first + 1 : 0);
+	}
+
+	mClipVertices.resize(mVertexStart.back());
+	ParallelForRange((int)mClipVertices.size(), 1024, [&](int begin, int end)
+	{
+		size_t item = std::upper_bound(mVertexStart.begin(), mVertexStart.end(), (std::uint32_t)begin) - mVertexStart.begin() - 1;
+		for (std::uint32_t v = begin; v < (std::uint32_t)end; ++v)
+		{
+			while (v >= mVertexStart[item + 1])
+				++item;
+			ShadeVertex(mItemStates[item], mFirstVertex[item] + (v - mVertexStart[item]), mClipVertices[v]);
+		}
+	});
+}
+
+void SoftwareRasterizer::ShadeVertex(const ItemState& state, std::uint32_t v, ClipVertex& out)const
+{
+	const Vertex& vin = *reinterpret_cast<const Vertex*>(state.Vertices + (size_t)v*state.VertexByteStride);
+
+	// Transform to world space.  Like the shader this assumes no nonuniform scaling.
+	XMMATRIX world = XMLoadFloat4x4(&state.World);
+	XMVECTOR posW = XMVector3Transform(XMLoadFloat3(&vin.Pos), world);
+	XMVECTOR normalW = XMVector3TransformNormal(XMLoadFloat3(&vin.Normal), world);
+
+	XMVECTOR posH = XMVector4Transform(XMVectorSetW(posW, 1.0f), XMLoadFloat4x4(&mViewProj));
+
+	XMVECTOR texC = XMVector4Transform(XMVectorSet(vin.TexC.x, vin.TexC.y, 0.0f, 1.0f),
+		XMLoadFloat4x4(&state.TexMatTransform));
+
+	XMStoreFloat4(&out.PosH, posH);
+	XMStoreFloat3(reinterpret_cast<XMFLOAT3*>(&out.Attr[AttrPosW]), posW);
+	XMStoreFloat3(reinterpret_cast<XMFLOAT3*>(&out.Attr[AttrNormalW]), normalW);
+	XMStoreFloat2(reinterpret_cast<XMFLOAT2*>(&out.Attr[AttrTexC]), texC);
+
+	XMFLOAT4 baked(0.0f, 0.0f, 0.0f, 0.0f);
+	if (state.BakedLight != nullptr)
+		baked = state.BakedLight[v];
+	out.Attr[AttrBakedLight + 0] = baked.x;
+	out.Attr[AttrBakedLight + 1] = baked.y;
+	out.Attr[AttrBakedLight + 2] = baked.z;
+	out.Attr[AttrBakedLight + 3] = baked.w;
+}
+
+template<typename Setup>
+void SoftwareRasterizer::SetupPrimitives(const std::vector<std::uint32_t>& primStart, const Setup& setup)
+{
+	const int primCount = (int)primStart.back();
+	const int chunkCount = (primCount + PrimitiveGrain - 1) / PrimitiveGrain;
+	if (mChunkTriangles.size() < (size_t)chunkCount)
+		mChunkTriangles.resize(chunkCount);
+
+	ParallelFor(0, chunkCount, [&](int chunk)
+	{
+		std::vector<Triangle>& out = mChunkTriangles[chunk];
+		out.clear();
+
+		const std::uint32_t begin = chunk*PrimitiveGrain;
+		const std::uint32_t end = std::min(begin + PrimitiveGrain, (std::uint32_t)primCount);
+		size_t item = std::upper_bound(primStart.begin(), primStart.end(), begin) - primStart.begin() - 1;
+		for (std::uint32_t p = begin; p < end; ++p)
+		{
+			while (p >= primStart[item + 1])
+				++item;
+			setup((int)item, p - primStart[item], out);
+		}
+	});
+
+	mTriangles.clear();
+	for (int chunk = 0; chunk < chunkCount; ++chunk)
+		mTriangles.insert(mTriangles.end(), mChunkTriangles[chunk].begin(), mChunkTriangles[chunk].end());
+}
+
+void SoftwareRasterizer::ExpandSprite(const SoftwareDrawItem& item, int itemIndex, std::uint32_t k, std::vector<Triangle>& out)const
+{
+	const ItemState& state = mItemStates[itemIndex];
+	const std::uint32_t index = item.BaseVertexLocation + ReadIndex(item, item.StartIndexLocation + k);
+	const std::uint8_t* vertex = state.Vertices + (size_t)index*state.VertexByteStride;
+
+	// Tree sprite vertices are a center followed by a size.
+	const XMFLOAT3 center = *reinterpret_cast<const XMFLOAT3*>(vertex);
+	const XMFLOAT2 size = *reinterpret_cast<const XMFLOAT2*>(vertex + sizeof(XMFLOAT3));
+
+	// Billboard aligned with the y-axis and facing the eye.
+	XMVECTOR c = XMLoadFloat3(&center);
+	XMVECTOR up = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+	XMVECTOR look = XMVectorSubtract(XMLoadFloat3(&mPass.EyePosW), c);
+	look = XMVector3Normalize(XMVectorSetY(look, 0.0f));
+	XMVECTOR right = XMVector3Cross(up, look);
+
+	XMVECTOR halfWidth = XMVectorScale(right, 0.5f*size.x);
+	XMVECTOR halfHeight = XMVectorScale(up, 0.5f*size.y);
+
+	const XMVECTOR corners[4] =
+	{
+		XMVectorSubtract(XMVectorAdd(c, halfWidth), halfHeight),
+		XMVectorAdd(XMVectorAdd(c, halfWidth), halfHeight),
+		XMVectorSubtract(XMVectorSubtract(c, halfWidth), halfHeight),
+		XMVectorAdd(XMVectorSubtract(c, halfWidth), halfHeight)
+	};
+	const XMFLOAT2 texC[4] =
+	{
+		XMFLOAT2(0.0f, 1.0f),
+		XMFLOAT2(0.0f, 0.0f),
+		XMFLOAT2(1.0f, 1.0f),
+		XMFLOAT2(1.0f, 0.0f)
+	};
+
+	ClipVertex quad[4] = {};
+	for (int i = 0; i < 4; ++i)
+	{
+		XMVECTOR posW = XMVectorSetW(corners[i], 1.0f);
+		XMStoreFloat4(&quad[i].PosH, XMVector4Transform(posW, XMLoadFloat4x4(&mViewProj)));
+		XMStoreFloat3(reinterpret_cast<XMFLOAT3*>(&quad[i].Attr[AttrPosW]), posW);
+		XMStoreFloat3(reinterpret_cast<XMFLOAT3*>(&quad[i].Attr[AttrNormalW]), look);
+		quad[i].Attr[AttrTexC + 0] = texC[i].x;
+		quad[i].Attr[AttrTexC + 1] = texC[i].y;
+	}
+
+	// The strip's two triangles.
+	const ClipVertex* t0[3] = { &quad[0], &quad[1], &quad[2] };
+	const ClipVertex* t1[3] = { &quad[1], &quad[3], &quad[2] };
+	ClipAndSetup(t0, itemIndex, k, out);
+	ClipAndSetup(t1, itemIndex, k, out);
+}
+
+void SoftwareRasterizer::ClipAndSetup(const ClipVertex* const v[3], int item, std::uint32_t primID, std::vector<Triangle>& out)const
+{
+	int outsideAll = 0x3F;
+	int outsideAny = 0;
+	for (int i = 0; i < 3; ++i)
+	{
+		int outside = 0;
+		for (int p = 0; p < 6; ++p)
+		{
+			if (ClipDistance(v[i]->PosH, p) < 0.0f)
+				outside |= 1 << p;
+		}
+		outsideAll &= outside;
+		outsideAny |= outside;
+	}
+
+	if (outsideAll != 0)
+		return;
+
+	Triangle tri;
+	if (outsideAny == 0)
+	{
+		if (SetupTriangle(*v[0], *v[1], *v[2], item, primID, tri))
+			out.push_back(tri);
+		return;
+	}
+
+	// Sutherland-Hodgman against the planes the triangle crosses.
+	ClipVertex buffers[2][9];
+	int count = 3;
+	for (int i = 0; i < 3; ++i)
+		buffers[0][i] = *v[i];
+
+	int src = 0;
+	for (int p = 0; p < 6 && count >= 3; ++p)
+	{
+		if ((outsideAny & (1 << p)) == 0)
+			continue;
+
+		const ClipVertex* in = buffers[src];
+		ClipVertex* result = buffers[src ^ 1];
+		int n = 0;
+		for (int i = 0; i < count; ++i)
+		{
+			const ClipVertex& a = in[i];
+			const ClipVertex& b = in[(i + 1) % count];
+			float da = ClipDistance(a.PosH, p);
+			float db = ClipDistance(b.PosH, p);
+
+			if (da >= 0.0f)
+				result[n++] = a;
+
+			if ((da >= 0.0f) != (db >= 0.0f))
+			{
+				float t = da / (da - db);
+				ClipVertex& c = result[n++];
+				XMStoreFloat4(&c.PosH, XMVectorLerp(XMLoadFloat4(&a.PosH), XMLoadFloat4(&b.PosH), t));
+				for (int k = 0; k < AttrCount; ++k)
+					c.Attr[k] = a.Attr[k] + t*(b.Attr[k] - a.Attr[k]);
+			}
+		}
+
+		count = n;
+		src ^= 1;
+	}
+
+	for (int i = 1; i + 1 < count; ++i)
+	{
+		if (SetupTriangle(buffers[src][0], buffers[src][i], buffers[src][i + 1], item, primID, tri))
+			out.push_back(tri);
+	}
+}
+
+bool SoftwareRasterizer::SetupTriangle(const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2,
+	int item, std::uint32_t primID, Triangle& tri)const
+{
+	const ClipVertex* v[3] = { &v0, &v1, &v2 };
+
+	double sx[3], sy[3];
+	for (int i = 0; i < 3; ++i)
+	{
+		const XMFLOAT4& p = v[i]->PosH;
+		tri.InvW[i] = 1.0f / p.w;
+		tri.Z[i] = p.z*tri.InvW[i];
+
+		double x = (0.5 + 0.5*p.x*tri.InvW[i])*mWidth;
+		double y = (0.5 - 0.5*p.y*tri.InvW[i])*mHeight;
+		sx[i] = std::floor(x*SubpixelScale + 0.5) / SubpixelScale;
+		sy[i] = std::floor(y*SubpixelScale + 0.5) / SubpixelScale;
+	}
+
+	// Positive for clockwise triangles in screen space, which are front facing.
+	double area = (sy[2] - sy[0])*(sx[1] - sx[0]) - (sx[2] - sx[0])*(sy[1] - sy[0]);
+	if (area == 0.0)
+		return false;
+
+	int order[3] = { 0, 1, 2 };
+	if (area < 0.0)
+	{
+		const bool cullBack = mPipeline == SoftwarePipeline::Opaque ||
+			mPipeline == SoftwarePipeline::OpaqueBaked ||
+			mPipeline == SoftwarePipeline::Transparent;
+		if (cullBack)
+			return false;
+
+		std::swap(order[1], order[2]);
+		area = -area;
+	}
+
+	float invW[3], z[3];
+	for (int i = 0; i < 3; ++i)
+	{
+		invW[i] = tri.InvW[order[i]];
+		z[i] = tri.Z[order[i]];
+	}
+
+	for (int i = 0; i < 3; ++i)
+	{
+		const int a = order[(i + 1) % 3];
+		const int b = order[(i + 2) % 3];
+
+		// Evaluate the edge from its lower (y, x) endpoint and flip the sign as needed.
+		const bool flip = sy[b] < sy[a] || (sy[b] == sy[a] && sx[b] < sx[a]);
+		const int p = flip ? b : a;
+		const int q = flip ? a : b;
+		const double dx = sx[q] - sx[p];
+		const double dy = sy[q] - sy[p];
+		const double sign = flip ? -1.0 : 1.0;
+		tri.A[i] = -dy*sign;
+		tri.B[i] = dx*sign;
+		tri.C[i] = (sx[p]*dy - sy[p]*dx)*sign;
+
+		// Top edges run right along a horizontal line and left edges run up.
+		const double edgeDx = sx[b] - sx[a];
+		const double edgeDy = sy[b] - sy[a];
+		tri.TopLeft[i] = edgeDy < 0.0 || (edgeDy == 0.0 && edgeDx > 0.0) ? 0xFFFFFFFFu : 0u;
+
+		tri.InvW[i] = invW[i];
+		tri.Z[i] = z[i];
+		for (int k = 0; k < AttrCount; ++k)
+			tri.Attr[i][k] = v[order[i]]->Attr[k] * invW[i];
+	}
+
+	tri.InvArea = (float)(1.0 / area);
+
+	// Screen space gradients of u/w, v/w and 1/w for the texture LOD.
+	for (int g = 0; g < 6; ++g)
+		tri.TexGrad[g] = 0.0f;
+	for (int i = 0; i < 3; ++i)
+	{
+		const float dbdx = (float)tri.A[i] * tri.InvArea;
+		const float dbdy = (float)tri.B[i] * tri.InvArea;
+		tri.TexGrad[0] += dbdx*tri.Attr[i][AttrTexC + 0];
+		tri.TexGrad[1] += dbdy*tri.Attr[i][AttrTexC + 0];
+		tri.TexGrad[2] += dbdx*tri.Attr[i][AttrTexC + 1];
+		tri.TexGrad[3] += dbdy*tri.Attr[i][AttrTexC + 1];
+		tri.TexGrad[4] += dbdx*tri.InvW[i];
+		tri.TexGrad[5] += dbdy*tri.InvW[i];
+	}
+
+	const double minX = std::min(std::min(sx[0], sx[1]), sx[2]);
+	const double maxX = std::max(std::max(sx[0], sx[1]), sx[2]);
+	const double minY = std::min(std::min(sy[0], sy[1]), sy[2]);
+	const double maxY = std::max(std::max(sy[0], sy[1]), sy[2]);
+	tri.MinX = std::max((int)std::floor(minX), 0);
+	tri.MinY = std::max((int)std::floor(minY), 0);
+	tri.MaxX = std::min((int)std::ceil(maxX), mWidth - 1);
+	tri.MaxY = std::min((int)std::ceil(maxY), mHeight - 1);
+	if (tri.MinX > tri.MaxX || tri.MinY > tri.MaxY)
+		return false;
+
+	tri.Item = item;
+	tri.PrimID = primID;
+	return true;
+}
+
+void SoftwareRasterizer::BinTriangles()
+{
+	const int tileCount = mTilesX*mTilesY;
+	const int triCount = (int)mTriangles.size();
+
+	for (int g = 0; g < mBinGroups*tileCount; ++g)
+		mBins[g].clear();
+
+	mBinGroups = std::max(std::min(WorkerCount(), (triCount + PrimitiveGrain - 1) / PrimitiveGrain), 1);
+	if (mBins.size() < (size_t)(mBinGroups*tileCount))
+		mBins.resize((size_t)mBinGroups*tileCount);
+
+	ParallelFor(0, mBinGroups, [&](int group)
+	{
+		std::vector<std::uint32_t>* bins = &mBins[(size_t)group*tileCount];
+		const int begin = (int)((long long)triCount*group / mBinGroups);
+		const int end = (int)((long long)triCount*(group + 1) / mBinGroups);
+
+		for (int t = begin; t < end; ++t)
+		{
+			const Triangle& tri = mTriangles[t];
+			for (int ty = tri.MinY / TileSize; ty <= tri.MaxY / TileSize; ++ty)
+			{
+				for (int tx = tri.MinX / TileSize; tx <= tri.MaxX / TileSize; ++tx)
+				{
+					// Skip tiles entirely outside an edge: test the corner where the
+					// edge function is largest.
+					const double x0 = tx*TileSize, x1 = x0 + TileSize;
+					const double y0 = ty*TileSize, y1 = y0 + TileSize;
+					bool outside = false;
+					for (int i = 0; i < 3 && !outside; ++i)
+					{
+						double e = tri.A[i] * (tri.A[i] > 0.0 ? x1 : x0) + tri.B[i] * (tri.B[i] > 0.0 ? y1 : y0) + tri.C[i];
+						outside = e < 0.0;
+					}
+
+					if (!outside)
+						bins[ty*mTilesX + tx].push_back((std::uint32_t)t);
+				}
+			}
+		}
+	});
+}
+
+void SoftwareRasterizer::RasterTile(int tile)
+{
+	const int tileCount = mTilesX*mTilesY;
+	const int x0 = (tile % mTilesX)*TileSize;
+	const int y0 = (tile / mTilesX)*TileSize;
+	const int x1 = std::min(x0 + TileSize, mWidth);
+	const int y1 = std::min(y0 + TileSize, mHeight);
+
+	// Groups hold consecutive triangle ranges, so this is submission order.
+	for (int group = 0; group < mBinGroups; ++group)
+	{
+		for (std::uint32_t t : mBins[(size_t)group*tileCount + tile])
+			RasterTriangle(mTriangles[t], x0, y0, x1, y1);
+	}
+}
+
+void SoftwareRasterizer::RasterTriangle(const Triangle& tri, int tileX0, int tileY0, int tileX1, int tileY1)
+{
+	const int xMin = std::max(tri.MinX, tileX0);
+	const int xMax = std::min(tri.MaxX, tileX1 - 1);
+	const int yMin = std::max(tri.MinY, tileY0);
+	const int yMax = std::min(tri.MaxY, tileY1 - 1);
+	if (xMin > xMax || yMin > yMax)
+		return;
+
+	const XMVECTOR laneIndex = XMVectorSet(0.0f, 1.0f, 2.0f, 3.0f);
+	const XMVECTOR zero = XMVectorZero();
+
+	XMVECTOR laneStep[3], topLeft[3];
+	for (int i = 0; i < 3; ++i)
+	{
+		laneStep[i] = XMVectorScale(laneIndex, (float)tri.A[i]);
+		topLeft[i] = XMVectorSetInt(tri.TopLeft[i], tri.TopLeft[i], tri.TopLeft[i], tri.TopLeft[i]);
+	}
+
+	const XMVECTOR invArea = XMVectorReplicate(tri.InvArea);
+	const XMVECTOR z0 = XMVectorReplicate(tri.Z[0]);
+	const XMVECTOR z1 = XMVectorReplicate(tri.Z[1]);
+	const XMVECTOR z2 = XMVectorReplicate(tri.Z[2]);
+	const XMVECTOR w0 = XMVectorReplicate(tri.InvW[0]);
+	const XMVECTOR w1 = XMVectorReplicate(tri.InvW[1]);
+	const XMVECTOR w2 = XMVectorReplicate(tri.InvW[2]);
+
+	const bool blend = mPipeline == SoftwarePipeline::Transparent;
+
+	// Tiles start on a multiple of four, so the groups stay inside the padded rows.
+	const int xStart = xMin & ~3;
+
+	for (int y = yMin; y <= yMax; ++y)
+	{
+		const double py = y + 0.5;
+		float* depthRow = &mDepth[(size_t)y*mStride];
+		XMFLOAT4* colorRow = &mColor[(size_t)y*mStride];
+
+		for (int x = xStart; x <= xMax; x += 4)
+		{
+			const double px = x + 0.5;
+
+			// Lanes left of xMin or right of xMax belong to other tiles or triangles' bounds.
+			std::uint32_t lanes[4];
+			for (int k = 0; k < 4; ++k)
+				lanes[k] = (x + k >= xMin && x + k <= xMax) ? 0xFFFFFFFFu : 0u;
+			XMVECTOR mask = XMVectorSetInt(lanes[0], lanes[1], lanes[2], lanes[3]);
+
+			// Each group starts from an exact edge value, so shared edges agree bit for bit.
+			XMVECTOR e[3];
+			for (int i = 0; i < 3; ++i)
+			{
+				e[i] = XMVectorAdd(XMVectorReplicate((float)(tri.A[i] * px + tri.B[i] * py + tri.C[i])), laneStep[i]);
+				XMVECTOR inside = XMVectorOrInt(XMVectorGreater(e[i], zero),
+					XMVectorAndInt(XMVectorEqual(e[i], zero), topLeft[i]));
+				mask = XMVectorAndInt(mask, inside);
+			}
+
+			if (XMVector4EqualInt(mask, zero))
+				continue;
+
+			const XMVECTOR b0 = XMVectorMultiply(e[0], invArea);
+			const XMVECTOR b1 = XMVectorMultiply(e[1], invArea);
+			const XMVECTOR b2 = XMVectorMultiply(e[2], invArea);
+
+			// Depth test (LESS) against the four pixels.
+			XMVECTOR z = XMVectorMultiplyAdd(b0, z0, XMVectorMultiplyAdd(b1, z1, XMVectorMultiply(b2, z2)));
+			XMVECTOR depth = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&depthRow[x]));
+			mask = XMVectorAndInt(mask, XMVectorLess(z, depth));
+			if (XMVector4EqualInt(mask, zero))
+				continue;
+
+			// Perspective correct attributes: interpolate attr/w and 1/w, then divide.
+			XMVECTOR q = XMVectorMultiplyAdd(b0, w0, XMVectorMultiplyAdd(b1, w1, XMVectorMultiply(b2, w2)));
+			XMVECTOR w = XMVectorReciprocal(q);
+
+			XMFLOAT4 attr[AttrCount];
+			for (int a = 0; a < AttrCount; ++a)
+			{
+				XMVECTOR value = XMVectorMultiplyAdd(b0, XMVectorReplicate(tri.Attr[0][a]),
+					XMVectorMultiplyAdd(b1, XMVectorReplicate(tri.Attr[1][a]),
+						XMVectorMultiply(b2, XMVectorReplicate(tri.Attr[2][a]))));
+				XMStoreFloat4(&attr[a], XMVectorMultiply(value, w));
+			}
+
+			std::uint32_t laneMask[4];
+			XMFLOAT4 zs, qs;
+			XMStoreInt4(laneMask, mask);
+			XMStoreFloat4(&zs, z);
+			XMStoreFloat4(&qs, q);
+
+			for (int k = 0; k < 4; ++k)
+			{
+				if (laneMask[k] == 0)
+					continue;
+
+				float pixelAttr[AttrCount];
+				for (int a = 0; a < AttrCount; ++a)
+					pixelAttr[a] = (&attr[a].x)[k];
+
+				// d(u)/dx = (d(u/w)/dx - u*d(1/w)/dx) / (1/w), and likewise for the rest.
+				const float invQ = 1.0f / (&qs.x)[k];
+				const float u = pixelAttr[AttrTexC + 0];
+				const float v = pixelAttr[AttrTexC + 1];
+				const float texGrad[4] =
+				{
+					(tri.TexGrad[0] - u*tri.TexGrad[4])*invQ,
+					(tri.TexGrad[2] - v*tri.TexGrad[4])*invQ,
+					(tri.TexGrad[1] - u*tri.TexGrad[5])*invQ,
+					(tri.TexGrad[3] - v*tri.TexGrad[5])*invQ
+				};
+
+				XMVECTOR color;
+				if (!ShadePixel(tri, pixelAttr, texGrad, x + k + 0.5f, y + 0.5f, color))
+					continue;
+
+				// The back buffer is UNORM, so the shader output is clamped before blending.
+				color = XMVectorSaturate(color);
+				if (blend)
+				{
+					XMVECTOR dst = XMLoadFloat4(&colorRow[x + k]);
+					XMVECTOR alpha = XMVectorSplatW(color);
+					XMVECTOR rgb = XMVectorLerp(dst, color, XMVectorGetX(alpha));
+					color = XMVectorSelect(rgb, color, g_XMSelect0001);
+				}
+
+				XMStoreFloat4(&colorRow[x + k], color);
+				depthRow[x + k] = (&zs.x)[k];
+			}
+		}
+	}
+}
+
+bool SoftwareRasterizer::ShadePixel(const Triangle& tri, const float attr[AttrCount], const float texGrad[4],
+	float screenX, float screenY, XMVECTOR& color)const
+{
+	const SoftwareDrawItem& item = (*mItems)[tri.Item];
+	const bool sprite = mPipeline == SoftwarePipeline::TreeSprites;
+
+	// Sample the diffuse map; the tree sprites pick their array slice by primitive.
+	XMVECTOR diffuseAlbedo = XMVectorSplatOne();
+	if (item.DiffuseMap != nullptr)
+	{
+		int slice = sprite ? (int)(tri.PrimID % 3) : 0;
+		diffuseAlbedo = item.DiffuseMap->Sample(attr[AttrTexC], attr[AttrTexC + 1], slice,
+			texGrad[0], texGrad[1], texGrad[2], texGrad[3]);
+	}
+	if (item.Mat != nullptr)
+		diffuseAlbedo = XMVectorMultiply(diffuseAlbedo, XMLoadFloat4(&item.Mat->DiffuseAlbedo));
+
+	const float alpha = XMVectorGetW(diffuseAlbedo);
+	const bool alphaTest = sprite || mPipeline == SoftwarePipeline::AlphaTested;
+	if (alphaTest && alpha - 0.1f < 0.0f)
+		return false;
+
+	XMVECTOR posW = XMVectorSet(attr[AttrPosW], attr[AttrPosW + 1], attr[AttrPosW + 2], 1.0f);
+	XMVECTOR normalW = XMVector3Normalize(XMVectorSet(attr[AttrNormalW], attr[AttrNormalW + 1], attr[AttrNormalW + 2], 0.0f));
+
+	XMVECTOR toEyeW = XMVectorSubtract(XMLoadFloat3(&mPass.EyePosW), posW);
+	const float distToEye = XMVectorGetX(XMVector3Length(toEyeW));
+	toEyeW = XMVectorScale(toEyeW, 1.0f / distToEye);
+
+	LightingUtil::SurfaceMaterial mat;
+	XMStoreFloat4(&mat.DiffuseAlbedo, diffuseAlbedo);
+	if (item.Mat != nullptr)
+	{
+		mat.FresnelR0 = item.Mat->FresnelR0;
+		mat.Shininess = 1.0f - item.Mat->Roughness;
+	}
+
+	XMVECTOR litColor;
+	if (mPipeline == SoftwarePipeline::OpaqueBaked)
+	{
+		XMVECTOR baked = XMVectorSet(attr[AttrBakedLight], attr[AttrBakedLight + 1], attr[AttrBakedLight + 2], 0.0f);
+		litColor = XMVectorSetW(XMVectorMultiply(diffuseAlbedo, baked), 0.0f);
+	}
+	else
+	{
+		XMVECTOR ambient;
+		if (sprite)
+		{
+			ambient = XMVectorMultiply(XMLoadFloat4(&mPass.AmbientLight), diffuseAlbedo);
+		}
+		else
+		{
+			XMFLOAT3 sh = mAmbientSH.Evaluate(normalW);
+			ambient = XMVectorMultiply(XMVectorSet(sh.x, sh.y, sh.z, 1.0f), diffuseAlbedo);
+		}
+
+		XMVECTOR directLight = LightingUtil::ComputeLighting(mPass.Lights, NumDirLights, 0, 0,
+			mat, posW, normalW, toEyeW, nullptr);
+		litColor = XMVectorAdd(ambient, directLight);
+	}
+
+	if (!sprite && mClusters != nullptr && !mClusters->ClusterRanges().empty())
+	{
+		const float viewZ = XMVectorGetZ(XMVector3Transform(posW, XMLoadFloat4x4(&mView)));
+		const std::uint32_t* indices = mClusters->LightIndices().empty() ? nullptr : mClusters->LightIndices().data();
+		XMVECTOR clustered = LightingUtil::ComputeClusteredLighting(mClusters->Lights().data(),
+			mClusters->ClusterRanges().data(), indices, mPass.ClusterDims, mPass.ClusterZParams,
+			screenX / mWidth, screenY / mHeight, viewZ, mat, posW, normalW, toEyeW);
+		litColor = XMVectorAdd(litColor, clustered);
+	}
+
+	float fogAmount = (distToEye - mPass.gFogStart) / mPass.gFogRange;
+	fogAmount = std::min(std::max(fogAmount, 0.0f), 1.0f);
+	litColor = XMVectorLerp(litColor, XMLoadFloat4(&mPass.FogColor), fogAmount);
+
+	// Common convention to take alpha from diffuse albedo.
+	color = XMVectorSetW(litColor, alpha);
+	return true;
+}
+
+void SoftwareRasterizer::Blur(float sigma, int blurCount)
+{
+	if (mColor.empty())
+		return;
+
+	mBlurFilter.Execute(mColor.data(), mWidth, mHeight, mStride, sigma, blurCount);
+}
+
+void SoftwareRasterizer::ReadPixels(std::vector<std::uint8_t>& rgba)const
+{
+	rgba.resize((size_t)mWidth*mHeight * 4);
+	ParallelFor(0, mHeight, [&](int y)
+	{
+		const XMFLOAT4* src = &mColor[(size_t)y*mStride];
+		std::uint8_t* dst = &rgba[(size_t)y*mWidth * 4];
+		for (int x = 0; x < mWidth; ++x)
+		{
+			const float c[4] = { src[x].x, src[x].y, src[x].z, src[x].w };
+			for (int k = 0; k < 4; ++k)
+				dst[4 * x + k] = (std::uint8_t)(std::min(std::max(c[k], 0.0f), 1.0f)*255.0f + 0.5f);
+		}
+	});
+}
+
+bool SoftwareRasterizer::SaveImage(const std::wstring& filename)const
+{
+	std::vector<std::uint8_t> rgba;
+	ReadPixels(rgba);
+	return ImageFile::Save(filename, mWidth, mHeight, rgba.data());
+}
@@ -0,0 +1,212 @@
+//***************************************************************************************
+// SoftwareRasterizer.h
+//
+// CPU rendering backend for the tree billboards demo.  It draws the same render items,
+// materials, pass constants and textures as the D3D12 path and ports Default.hlsl and
+// TreeSprite.hlsl (lighting, clustered lights, fog, alpha test and the billboard
+// geometry shader), so frames can be rendered and compared without a GPU.
+//
+// Each Draw sets up triangles across workers, bins them into screen tiles and lets one
+// worker rasterize each tile in submission order, so no two threads touch a pixel and
+// blending stays ordered.  Edge functions, depth and attribute interpolation run four
+// pixels at a time; interpolation is perspective correct.
+//***************************************************************************************
+
+#pragma once
+
+#include "CpuBlurFilter.h"
+#include "LightClusters.h"
+#include "RenderTypes.h"
+#include "SoftwareTexture.h"
+#include "SphericalHarmonics.h"
+#include <cstdint>
+#include <vector>
+
+// The pipeline state objects of the demo.
+enum class SoftwarePipeline : int
+{
+	Opaque = 0,   // Default.hlsl, back faces culled.
+	OpaqueBaked,  // Default.hlsl with BAKED_LIGHTING.
+	AlphaTested,  // Default.hlsl with ALPHA_TEST, no culling.
+	TreeSprites,  // TreeSprite.hlsl: points expanded to camera facing quads, ALPHA_TEST.
+	Transparent   // Default.hlsl, alpha blended.
+};
+
+// The render layers in the order the demo draws them, with their pipelines.  Particles
+// have no software pipeline.
+struct SoftwarePass
+{
+	RenderLayer Layer;
+	SoftwarePipeline Pipeline;
+};
+
+const SoftwarePass SoftwarePasses[] =
+{
+	{ RenderLayer::Opaque, SoftwarePipeline::Opaque },
+	{ RenderLayer::OpaqueBaked, SoftwarePipeline::OpaqueBaked },
+	{ RenderLayer::AlphaTested, SoftwarePipeline::AlphaTested },
+	{ RenderLayer::AlphaTestedTreeSprites, SoftwarePipeline::TreeSprites },
+	{ RenderLayer::Transparent, SoftwarePipeline::Transparent }
+};
+
+// The parts of a render item the rasterizer reads.
+struct SoftwareDrawItem
+{
+	DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
+	DirectX::XMFLOAT4X4 TexTransform = MathHelper::Identity4x4();
+
+	const Material* Mat = nullptr;
+	const SoftwareTexture* DiffuseMap = nullptr;
+
+	// VertexByteStride bytes per vertex: a Vertex, or for the tree sprites a center
+	// followed by a size.  Indices are 32-bit if Index32 is set, 16-bit otherwise.
+	const void* Vertices = nullptr;
+	std::uint32_t VertexByteStride = 0;
+	const void* Indices = nullptr;
+	bool Index32 = false;
+
+	std::uint32_t IndexCount = 0;
+	std::uint32_t StartIndexLocation = 0;
+	int BaseVertexLocation = 0;
+
+	// Baked light color of each vertex, indexed like Vertices, for OpaqueBaked; null
+	// for items lit dynamically.
+	const DirectX::XMFLOAT4* BakedLight = nullptr;
+};
+
+class SoftwareRasterizer
+{
+public:
+	static const int TileSize = 32;
+
+	SoftwareRasterizer() = default;
+	SoftwareRasterizer(const SoftwareRasterizer& rhs) = delete;
+	SoftwareRasterizer& operator=(const SoftwareRasterizer& rhs) = delete;
+	~SoftwareRasterizer() = default;
+
+	void Resize(int width, int height);
+	int Width()const { return mWidth; }
+	int Height()const { return mHeight; }
+
+	// Pass constants for the following draws.  clusters holds the buffers behind
+	// pass.ClusterDims and may be null to skip clustered lighting.
+	void BeginFrame(const PassConstants& pass, const LightClusterGrid* clusters);
+
+	// Clears color to the given value and depth to 1.
+	void Clear(const DirectX::XMFLOAT4& color);
+
+	void Draw(SoftwarePipeline pipeline, const std::vector<SoftwareDrawItem>& items);
+
+	// Post-process: blurs the color buffer like the Blur.hlsl compute passes.
+	void Blur(float sigma, int blurCount);
+
+	// The color buffer as 8-bit RGBA, top row first.
+	void ReadPixels(std::vector<std::uint8_t>& rgba)const;
+
+	// Writes the color buffer as PNG, or PPM for a .ppm extension.
+	bool SaveImage(const std::wstring& filename)const;
+
+private:
+	// PosW, NormalW, TexC and the baked light color, in that order.
+	static const int AttrCount = 12;
+	static const int AttrPosW = 0;
+	static const int AttrNormalW = 3;
+	static const int AttrTexC = 6;
+	static const int AttrBakedLight = 8;
+
+	struct ClipVertex
+	{
+		DirectX::XMFLOAT4 PosH;
+		float Attr[AttrCount];
+	};
+
+	struct Triangle
+	{
+		// Edge i is opposite vertex i: E_i(x, y) = A*x + B*y + C, positive inside.  Both
+		// triangles sharing an edge evaluate it with the same numbers up to sign, and
+		// only top-left edges own the pixels where E_i == 0, so meshes are watertight.
+		double A[3];
+		double B[3];
+		double C[3];
+		std::uint32_t TopLeft[3];
+		float InvArea;
+
+		float Z[3];
+		float InvW[3];
+		float Attr[3][AttrCount]; // Divided by w.
+
+		// d(u/w)/dx, d(u/w)/dy, d(v/w)/dx, d(v/w)/dy, d(1/w)/dx, d(1/w)/dy.
+		float TexGrad[6];
+
+		int MinX, MinY, MaxX, MaxY;
+		int Item;
+		std::uint32_t PrimID;
+	};
+
+	struct ItemState
+	{
+		DirectX::XMFLOAT4X4 World;
+		DirectX::XMFLOAT4X4 TexMatTransform;
+		const std::uint8_t* Vertices;
+		std::uint32_t VertexByteStride;
+		const DirectX::XMFLOAT4* BakedLight;
+	};
+
+	static std::uint32_t ReadIndex(const SoftwareDrawItem& item, std::uint32_t k);
+
+	void SetupItems(const std::vector<SoftwareDrawItem>& items);
+	void ShadeVertices(const std::vector<SoftwareDrawItem>& items);
+	void ShadeVertex(const ItemState& state, std::uint32_t v, ClipVertex& out)const;
+
+	// Runs setup(item, localPrim, out) for every primitive of every item across the
+	// workers and gathers the triangles in submission order.
+	template<typename Setup>
+	void SetupPrimitives(const std::vector<std::uint32_t>& primStart, const Setup& setup);
+
+	void ExpandSprite(const SoftwareDrawItem& item, int itemIndex, std::uint32_t k, std::vector<Triangle>& out)const;
+
+	void ClipAndSetup(const ClipVertex* const v[3], int item, std::uint32_t primID, std::vector<Triangle>& out)const;
+	bool SetupTriangle(const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2,
+		int item, std::uint32_t primID, Triangle& tri)const;
+
+	void BinTriangles();
+	void RasterTile(int tile);
+	void RasterTriangle(const Triangle& tri, int tileX0, int tileY0, int tileX1, int tileY1);
+
+	// Runs the pixel shader of the current pipeline.  Returns false if the pixel is clipped.
+	bool ShadePixel(const Triangle& tri, const float attr[AttrCount], const float texGrad[4],
+		float screenX, float screenY, DirectX::XMVECTOR& color)const;
+
+private:
+	int mWidth = 0;
+	int mHeight = 0;
+	int mStride = 0;
+	int mTilesX = 0;
+	int mTilesY = 0;
+
+	std::vector<DirectX::XMFLOAT4> mColor;
+	std::vector<float> mDepth;
+
+	CpuBlurFilter mBlurFilter;
+
+	// Frame state.
+	PassConstants mPass;
+	DirectX::XMFLOAT4X4 mViewProj = MathHelper::Identity4x4();
+	DirectX::XMFLOAT4X4 mView = MathHelper::Identity4x4();
+	SH9 mAmbientSH = {};
+	const LightClusterGrid* mClusters = nullptr;
+
+	// Draw state.
+	SoftwarePipeline mPipeline = SoftwarePipeline::Opaque;
+	const std::vector<SoftwareDrawItem>* mItems = nullptr;
+	std::vector<ItemState> mItemStates;
+	std::vector<std::uint32_t> mVertexStart;
+	std::vector<std::uint32_t> mFirstVertex;
+	std::vector<ClipVertex> mClipVertices;
+	std::vector<std::vector<Triangle>> mChunkTriangles;
+	std::vector<Triangle> mTriangles;
+
+	// mBinGroups groups of per-tile triangle lists, filled from consecutive triangle ranges.
+	std::vector<std::vector<std::uint32_t>> mBins;
+	int mBinGroups = 0;
+};
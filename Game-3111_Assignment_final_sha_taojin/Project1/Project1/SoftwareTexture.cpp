@@ -0,0 +1,294 @@
+#include "SoftwareTexture.h"
+#include "MappedFile.h"
+#include "ParallelFor.h"
+#include <algorithm>
+#include <cmath>
+#include <DirectXPackedVector.h>
+
+using namespace DirectX;
+using namespace DirectX::PackedVector;
+
+namespace
+{
+	std::uint32_t PackRGBA(std::uint32_t r, std::uint32_t g, std::uint32_t b, std::uint32_t a)
+	{
+		return r | (g << 8) | (b << 16) | (a << 24);
+	}
+
+	void Unpack565(std::uint16_t c, std::uint32_t rgb[3])
+	{
+		std::uint32_t r = (c >> 11) & 31;
+		std::uint32_t g = (c >> 5) & 63;
+		std::uint32_t b = c & 31;
+		rgb[0] = (r << 3) | (r >> 2);
+		rgb[1] = (g << 2) | (g >> 4);
+		rgb[2] = (b << 3) | (b >> 2);
+	}
+
+	// Decodes the 8 byte colour half of a BC1/BC2/BC3 block.  BC1 blocks with c0 <= c1
+	// use the three colour mode with transparent black; BC2 and BC3 never do.
+	void DecodeColorBlock(const std::uint8_t* block, bool allowThreeColor, std::uint32_t out[16])
+	{
+		const std::uint16_t c0 = (std::uint16_t)(block[0] | (block[1] << 8));
+		const std::uint16_t c1 = (std::uint16_t)(block[2] | (block[3] << 8));
+
+		std::uint32_t p[4][4];
+		Unpack565(c0, p[0]);
+		Unpack565(c1, p[1]);
+		p[0][3] = p[1][3] = p[2][3] = p[3][3] = 255;
+
+		if (c0 > c1 || !allowThreeColor)
+		{
+			for (int c = 0; c < 3; ++c)
+			{
+				p[2][c] = (2 * p[0][c] + p[1][c] + 1) / 3;
+				p[3][c] = (p[0][c] + 2 * p[1][c] + 1) / 3;
+			}
+		}
+		else
+		{
+			for (int c = 0; c < 3; ++c)
+			{
+				p[2][c] = (p[0][c] + p[1][c]) / 2;
+				p[3][c] = 0;
+			}
+			p[3][3] = 0;
+		}
+
+		const std::uint32_t bits = block[4] | (block[5] << 8) | (block[6] << 16) | ((std::uint32_t)block[7] << 24);
+		for (int k = 0; k < 16; ++k)
+		{
+			const std::uint32_t* c = p[(bits >> (2 * k)) & 3];
+			out[k] = PackRGBA(c[0], c[1], c[2], c[3]);
+		}
+	}
+
+	void SetAlpha(std::uint32_t& texel, std::uint32_t alpha)
+	{
+		texel = (texel & 0x00FFFFFFu) | (alpha << 24);
+	}
+
+	void DecodeBC2Alpha(const std::uint8_t* block, std::uint32_t out[16])
+	{
+		for (int k = 0; k < 16; ++k)
+		{
+			std::uint32_t a = (block[k / 2] >> (4 * (k & 1))) & 15;
+			SetAlpha(out[k], a * 17);
+		}
+	}
+
+	void DecodeBC3Alpha(const std::uint8_t* block, std::uint32_t out[16])
+	{
+		std::uint32_t a[8];
+		a[0] = block[0];
+		a[1] = block[1];
+		if (a[0] > a[1])
+		{
+			for (int i = 1; i < 7; ++i)
+				a[i + 1] = ((7 - i)*a[0] + i*a[1] + 3) / 7;
+		}
+		else
+		{
+			for (int i = 1; i < 5; ++i)
+				a[i + 1] = ((5 - i)*a[0] + i*a[1] + 2) / 5;
+			a[6] = 0;
+			a[7] = 255;
+		}
+
+		std::uint64_t bits = 0;
+		for (int i = 0; i < 6; ++i)
+			bits |= (std::uint64_t)block[2 + i] << (8 * i);
+
+		for (int k = 0; k < 16; ++k)
+			SetAlpha(out[k], a[(bits >> (3 * k)) & 7]);
+	}
+
+	float Wrap(float t)
+	{
+		return std::isfinite(t) ? t - std::floor(t) : 0.0f;
+	}
+}
+
+bool SoftwareTexture::Load(const std::wstring& filename)
+{
+	MappedFile file;
+	if (!file.Open(filename))
+		return false;
+
+	DDSLayout layout;
+	if (ParseDDSLayout(file.Data(), file.Size(), 0, layout) != DDSLayoutResult::Ok)
+		return false;
+
+	return Decode(layout, file.Data());
+}
+
+bool SoftwareTexture::Decode(const DDSLayout& dds, const std::uint8_t* ddsData)
+{
+	enum class Layout { BC1, BC2, BC3, RGBA, BGRA, BGRX };
+
+	Layout layout;
+	switch (dds.Format)
+	{
+	case DXGI_FORMAT_BC1_UNORM:
+	case DXGI_FORMAT_BC1_UNORM_SRGB:
+		layout = Layout::BC1;
+		break;
+	case DXGI_FORMAT_BC2_UNORM:
+	case DXGI_FORMAT_BC2_UNORM_SRGB:
+		layout = Layout::BC2;
+		break;
+	case DXGI_FORMAT_BC3_UNORM:
+	case DXGI_FORMAT_BC3_UNORM_SRGB:
+		layout = Layout::BC3;
+		break;
+	case DXGI_FORMAT_R8G8B8A8_UNORM:
+	case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+		layout = Layout::RGBA;
+		break;
+	case DXGI_FORMAT_B8G8R8A8_UNORM:
+	case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+		layout = Layout::BGRA;
+		break;
+	case DXGI_FORMAT_B8G8R8X8_UNORM:
+	case DXGI_FORMAT_B8G8R8X8_UNORM_SRGB:
+		layout = Layout::BGRX;
+		break;
+	default:
+		return false;
+	}
+
+	const int width = (int)dds.Width;
+	const int height = (int)dds.Height;
+	const int mipCount = (int)dds.MipCount;
+	const int arraySize = (int)dds.ArraySize;
+	if (width <= 0 || height <= 0 || mipCount <= 0 || arraySize <= 0 ||
+		dds.Subresources.size() < (size_t)mipCount*arraySize)
+	{
+		return false;
+	}
+
+	mWidth = width;
+	mHeight = height;
+	mMipCount = mipCount;
+	mArraySize = arraySize;
+	mMips.assign((size_t)mipCount*arraySize, Mip());
+
+	ParallelFor(0, (int)mMips.size(), [&](int index)
+	{
+		const DDSSubresource& sub = dds.Subresources[index];
+		const std::uint8_t* src = ddsData + sub.Offset;
+		const int level = index % mipCount;
+
+		Mip& mip = mMips[index];
+		mip.Width = std::max(width >> level, 1);
+		mip.Height = std::max(height >> level, 1);
+		mip.Texels.resize((size_t)mip.Width*mip.Height);
+
+		if (layout == Layout::BC1 || layout == Layout::BC2 || layout == Layout::BC3)
+		{
+			const int blockBytes = layout == Layout::BC1 ? 8 : 16;
+			std::uint32_t block[16];
+
+			for (int by = 0; by < (mip.Height + 3) / 4; ++by)
+			{
+				const std::uint8_t* row = src + (size_t)by*sub.RowPitch;
+				for (int bx = 0; bx < (mip.Width + 3) / 4; ++bx)
+				{
+					const std::uint8_t* b = row + (size_t)bx*blockBytes;
+					if (layout == Layout::BC1)
+					{
+						DecodeColorBlock(b, true, block);
+					}
+					else
+					{
+						DecodeColorBlock(b + 8, false, block);
+						if (layout == Layout::BC2)
+							DecodeBC2Alpha(b, block);
+						else
+							DecodeBC3Alpha(b, block);
+					}
+
+					// Blocks of the 1x1 and 2x2 mips hang over the edge.
+					for (int k = 0; k < 16; ++k)
+					{
+						int x = 4 * bx + (k & 3);
+						int y = 4 * by + (k >> 2);
+						if (x < mip.Width && y < mip.Height)
+							mip.Texels[(size_t)y*mip.Width + x] = block[k];
+					}
+				}
+			}
+		}
+		else
+		{
+			for (int y = 0; y < mip.Height; ++y)
+			{
+				const std::uint8_t* row = src + (size_t)y*sub.RowPitch;
+				for (int x = 0; x < mip.Width; ++x)
+				{
+					const std::uint8_t* p = row + 4 * x;
+					std::uint32_t texel = layout == Layout::RGBA ?
+						PackRGBA(p[0], p[1], p[2], p[3]) :
+						PackRGBA(p[2], p[1], p[0], layout == Layout::BGRA ? p[3] : 255);
+					mip.Texels[(size_t)y*mip.Width + x] = texel;
+				}
+			}
+		}
+	});
+
+	return true;
+}
+
+XMVECTOR XM_CALLCONV SoftwareTexture::SampleBilinear(const Mip& mip, float u, float v)const
+{
+	float x = Wrap(u)*mip.Width - 0.5f;
+	float y = Wrap(v)*mip.Height - 0.5f;
+	float x0f = std::floor(x);
+	float y0f = std::floor(y);
+	float fx = x - x0f;
+	float fy = y - y0f;
+
+	int x0 = (int)x0f;
+	int y0 = (int)y0f;
+	int x1 = x0 + 1;
+	int y1 = y0 + 1;
+	if (x0 < 0) x0 += mip.Width;
+	if (y0 < 0) y0 += mip.Height;
+	if (x1 >= mip.Width) x1 -= mip.Width;
+	if (y1 >= mip.Height) y1 -= mip.Height;
+
+	const std::uint32_t* texels = mip.Texels.data();
+	XMVECTOR c00 = XMLoadUByteN4(reinterpret_cast<const XMUBYTEN4*>(&texels[(size_t)y0*mip.Width + x0]));
+	XMVECTOR c10 = XMLoadUByteN4(reinterpret_cast<const XMUBYTEN4*>(&texels[(size_t)y0*mip.Width + x1]));
+	XMVECTOR c01 = XMLoadUByteN4(reinterpret_cast<const XMUBYTEN4*>(&texels[(size_t)y1*mip.Width + x0]));
+	XMVECTOR c11 = XMLoadUByteN4(reinterpret_cast<const XMUBYTEN4*>(&texels[(size_t)y1*mip.Width + x1]));
+
+	return XMVectorLerp(XMVectorLerp(c00, c10, fx), XMVectorLerp(c01, c11, fx), fy);
+}
+
+XMVECTOR XM_CALLCONV SoftwareTexture::Sample(float u, float v, int slice,
+	float dudx, float dvdx, float dudy, float dvdy)const
+{
+	if (mMips.empty())
+		return XMVectorSplatOne();
+
+	slice = std::min(std::max(slice, 0), mArraySize - 1);
+	const Mip* mips = &mMips[(size_t)slice*mMipCount];
+
+	// Footprint of the pixel in texels along the longer screen axis.
+	const float w = (float)mWidth;
+	const float h = (float)mHeight;
+	float lenSqX = dudx*dudx*w*w + dvdx*dvdx*h*h;
+	float lenSqY = dudy*dudy*w*w + dvdy*dvdy*h*h;
+	float lod = 0.5f*std::log2(std::max(std::max(lenSqX, lenSqY), 1e-12f));
+	lod = std::min(std::max(lod, 0.0f), (float)(mMipCount - 1));
+
+	const int level = (int)lod;
+	const float frac = lod - level;
+
+	XMVECTOR color = SampleBilinear(mips[level], u, v);
+	if (frac > 0.0f && level + 1 < mMipCount)
+		color = XMVectorLerp(color, SampleBilinear(mips[level + 1], u, v), frac);
+
+	return color;
+}
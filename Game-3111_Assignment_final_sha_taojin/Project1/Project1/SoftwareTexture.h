@@ -0,0 +1,62 @@
+//***************************************************************************************
+// SoftwareTexture.h
+//
+// System memory copy of a DDS texture for the software rasterizer.  Every mip of every
+// array slice is decoded to RGBA8 at load (BC1, BC2, BC3 and the 32-bit RGBA/BGRA
+// formats) and sampled trilinearly with wrap addressing, which stands in for the
+// anisotropic wrap sampler the shaders use.
+//***************************************************************************************
+
+#pragma once
+
+#include "../../Common/DDSLayout.h"
+#include <DirectXMath.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class SoftwareTexture
+{
+public:
+	SoftwareTexture() = default;
+	SoftwareTexture(const SoftwareTexture& rhs) = delete;
+	SoftwareTexture& operator=(const SoftwareTexture& rhs) = delete;
+	~SoftwareTexture() = default;
+
+	bool Load(const std::wstring& filename);
+
+	// Decodes the subresources of a DDS file in memory, as ParseDDSLayout found them
+	// (MipCount mips of slice 0, then slice 1, ...).  Returns false for unsupported formats.
+	bool Decode(const DirectX::DDSLayout& layout, const std::uint8_t* ddsData);
+
+	int Width()const { return mWidth; }
+	int Height()const { return mHeight; }
+	int MipCount()const { return mMipCount; }
+	int ArraySize()const { return mArraySize; }
+
+	// Samples slice at (u, v).  The screen space derivatives of (u, v) select the mip
+	// level the same way the GPU does.
+	DirectX::XMVECTOR XM_CALLCONV Sample(float u, float v, int slice,
+		float dudx, float dvdx, float dudy, float dvdy)const;
+
+private:
+	struct Mip
+	{
+		int Width = 0;
+		int Height = 0;
+
+		// Packed RGBA8, R in the low byte.
+		std::vector<std::uint32_t> Texels;
+	};
+
+	DirectX::XMVECTOR XM_CALLCONV SampleBilinear(const Mip& mip, float u, float v)const;
+
+private:
+	int mWidth = 0;
+	int mHeight = 0;
+	int mMipCount = 0;
+	int mArraySize = 0;
+
+	// slice*mMipCount + mip.
+	std::vector<Mip> mMips;
+};
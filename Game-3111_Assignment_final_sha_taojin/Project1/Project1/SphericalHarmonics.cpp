@@ -0,0 +1,258 @@
+#include "SphericalHarmonics.h"
+#include "ParallelFor.h"
+#include <algorithm>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+	const float Y0 = 0.282095f;
+	const float Y1 = 0.488603f;
+	const float Y2 = 1.092548f;
+	const float Y20 = 0.315392f;
+	const float Y22 = 0.546274f;
+
+	// Per row: 9 coefficients x RGB, then the solid angle weight.
+	const int RowSumCount = 28;
+
+	// Direction of texel (u, v) in [-1, 1] on each face: major axis + u*uAxis + v*vAxis.
+	struct FaceBasis
+	{
+		float Major[3];
+		float U[3];
+		float V[3];
+	};
+
+	const FaceBasis gFaceBases[6] =
+	{
+		{ {  1.0f,  0.0f,  0.0f }, {  0.0f, 0.0f, -1.0f }, { 0.0f, -1.0f,  0.0f } }, // +X
+		{ { -1.0f,  0.0f,  0.0f }, {  0.0f, 0.0f,  1.0f }, { 0.0f, -1.0f,  0.0f } }, // -X
+		{ {  0.0f,  1.0f,  0.0f }, {  1.0f, 0.0f,  0.0f }, { 0.0f,  0.0f,  1.0f } }, // +Y
+		{ {  0.0f, -1.0f,  0.0f }, {  1.0f, 0.0f,  0.0f }, { 0.0f,  0.0f, -1.0f } }, // -Y
+		{ {  0.0f,  0.0f,  1.0f }, {  1.0f, 0.0f,  0.0f }, { 0.0f, -1.0f,  0.0f } }, // +Z
+		{ {  0.0f,  0.0f, -1.0f }, { -1.0f, 0.0f,  0.0f }, { 0.0f, -1.0f,  0.0f } }, // -Z
+	};
+
+	void Unpack565(std::uint16_t c, float rgb[3])
+	{
+		rgb[0] = ((c >> 11) & 31) / 31.0f;
+		rgb[1] = ((c >> 5) & 63) / 63.0f;
+		rgb[2] = (c & 31) / 31.0f;
+	}
+
+	// Decodes row y of a face into planar r, g, b.
+	void DecodeRow(CubemapSH::TexelFormat format, const CubemapSH::Face& face, int size, int y,
+		float* r, float* g, float* b)
+	{
+		if (format == CubemapSH::TexelFormat::BC1)
+		{
+			const std::uint8_t* blocks = face.Data + (size_t)(y / 4)*face.RowPitch;
+			const int rowInBlock = y % 4;
+
+			for (int bx = 0; bx < size / 4; ++bx)
+			{
+				const std::uint8_t* block = blocks + 8 * bx;
+				const std::uint16_t c0 = (std::uint16_t)(block[0] | (block[1] << 8));
+				const std::uint16_t c1 = (std::uint16_t)(block[2] | (block[3] << 8));
+
+				float palette[4][3];
+				Unpack565(c0, palette[0]);
+				Unpack565(c1, palette[1]);
+				for (int c = 0; c < 3; ++c)
+				{
+					if (c0 > c1)
+					{
+						palette[2][c] = (2.0f*palette[0][c] + palette[1][c]) / 3.0f;
+						palette[3][c] = (palette[0][c] + 2.0f*palette[1][c]) / 3.0f;
+					}
+					else
+					{
+						// Three colour mode; index 3 is transparent black.
+						palette[2][c] = 0.5f*(palette[0][c] + palette[1][c]);
+						palette[3][c] = 0.0f;
+					}
+				}
+
+				const std::uint8_t bits = block[4 + rowInBlock];
+				for (int k = 0; k < 4; ++k)
+				{
+					const int index = (bits >> (2 * k)) & 3;
+					r[4 * bx + k] = palette[index][0];
+					g[4 * bx + k] = palette[index][1];
+					b[4 * bx + k] = palette[index][2];
+				}
+			}
+		}
+		else
+		{
+			const std::uint8_t* texels = face.Data + (size_t)y*face.RowPitch;
+			const bool bgra = format == CubemapSH::TexelFormat::B8G8R8A8;
+
+			for (int x = 0; x < size; ++x)
+			{
+				const std::uint8_t* p = texels + 4 * x;
+				r[x] = p[bgra ? 2 : 0] / 255.0f;
+				g[x] = p[1] / 255.0f;
+				b[x] = p[bgra ? 0 : 2] / 255.0f;
+			}
+		}
+	}
+
+	float HorizontalSum(FXMVECTOR v)
+	{
+		XMFLOAT4 f;
+		XMStoreFloat4(&f, v);
+		return (f.x + f.y) + (f.z + f.w);
+	}
+}
+
+SH9 SH9::Constant(const XMFLOAT3& value)
+{
+	SH9 sh = {};
+	sh.C[0] = XMFLOAT3(value.x / Y0, value.y / Y0, value.z / Y0);
+	return sh;
+}
+
+XMFLOAT3 SH9::Evaluate(FXMVECTOR n)const
+{
+	XMFLOAT3 d;
+	XMStoreFloat3(&d, n);
+
+	const float basis[9] =
+	{
+		Y0,
+		Y1*d.y,
+		Y1*d.z,
+		Y1*d.x,
+		Y2*d.x*d.y,
+		Y2*d.y*d.z,
+		Y20*(3.0f*d.z*d.z - 1.0f),
+		Y2*d.x*d.z,
+		Y22*(d.x*d.x - d.y*d.y)
+	};
+
+	XMVECTOR result = XMVectorZero();
+	for (int i = 0; i < 9; ++i)
+		result = XMVectorMultiplyAdd(XMLoadFloat3(&C[i]), XMVectorReplicate(basis[i]), result);
+
+	XMFLOAT3 value;
+	XMStoreFloat3(&value, XMVectorMax(result, XMVectorZero()));
+	return value;
+}
+
+XMFLOAT3 SH9::Average()const
+{
+	return XMFLOAT3(C[0].x*Y0, C[0].y*Y0, C[0].z*Y0);
+}
+
+SH9 SH9::RadianceToIrradiance()const
+{
+	// Cosine lobe band factors (pi, 2pi/3, pi/4) divided by pi.
+	const float band[9] = { 1.0f, 2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f };
+
+	SH9 result;
+	for (int i = 0; i < 9; ++i)
+		XMStoreFloat3(&result.C[i], XMVectorScale(XMLoadFloat3(&C[i]), band[i]));
+	return result;
+}
+
+bool CubemapSH::Project(TexelFormat format, const Face faces[6], int size, SH9& out)
+{
+	if (size < 4 || size % 4 != 0)
+		return false;
+
+	const int rowCount = 6 * size;
+	std::vector<float> rowSums((size_t)rowCount*RowSumCount);
+
+	ParallelForRange(rowCount, 16, [&](int begin, int end)
+	{
+		std::vector<float> r(size), g(size), b(size);
+		const float invSize = 1.0f / size;
+		const XMVECTOR laneOffsets = XMVectorSet(0.5f, 1.5f, 2.5f, 3.5f);
+
+		for (int row = begin; row < end; ++row)
+		{
+			const int f = row / size;
+			const int y = row % size;
+			const FaceBasis& basis = gFaceBases[f];
+
+			DecodeRow(format, faces[f], size, y, r.data(), g.data(), b.data());
+
+			const float v = 2.0f*(y + 0.5f)*invSize - 1.0f;
+
+			XMVECTOR acc[27];
+			for (XMVECTOR& a : acc)
+				a = XMVectorZero();
+			XMVECTOR weightSum = XMVectorZero();
+
+			for (int x = 0; x < size; x += 4)
+			{
+				XMVECTOR u = XMVectorSubtract(XMVectorScale(XMVectorAdd(XMVectorReplicate((float)x), laneOffsets), 2.0f*invSize),
+					XMVectorSplatOne());
+
+				// Unnormalized direction, one lane per texel.
+				XMVECTOR dx = XMVectorMultiplyAdd(u, XMVectorReplicate(basis.U[0]), XMVectorReplicate(basis.Major[0] + v*basis.V[0]));
+				XMVECTOR dy = XMVectorMultiplyAdd(u, XMVectorReplicate(basis.U[1]), XMVectorReplicate(basis.Major[1] + v*basis.V[1]));
+				XMVECTOR dz = XMVectorMultiplyAdd(u, XMVectorReplicate(basis.U[2]), XMVectorReplicate(basis.Major[2] + v*basis.V[2]));
+
+				// |d|^2 = 1 + u^2 + v^2; the texel solid angle is proportional to |d|^-3.
+				XMVECTOR lenSq = XMVectorMultiplyAdd(dx, dx, XMVectorMultiplyAdd(dy, dy, XMVectorMultiply(dz, dz)));
+				XMVECTOR invLen = XMVectorReciprocalSqrt(lenSq);
+				XMVECTOR weight = XMVectorMultiply(invLen, XMVectorMultiply(invLen, invLen));
+				weightSum = XMVectorAdd(weightSum, weight);
+
+				dx = XMVectorMultiply(dx, invLen);
+				dy = XMVectorMultiply(dy, invLen);
+				dz = XMVectorMultiply(dz, invLen);
+
+				const XMVECTOR Ylm[9] =
+				{
+					XMVectorReplicate(Y0),
+					XMVectorScale(dy, Y1),
+					XMVectorScale(dz, Y1),
+					XMVectorScale(dx, Y1),
+					XMVectorScale(XMVectorMultiply(dx, dy), Y2),
+					XMVectorScale(XMVectorMultiply(dy, dz), Y2),
+					XMVectorScale(XMVectorSubtract(XMVectorScale(XMVectorMultiply(dz, dz), 3.0f), XMVectorSplatOne()), Y20),
+					XMVectorScale(XMVectorMultiply(dx, dz), Y2),
+					XMVectorScale(XMVectorSubtract(XMVectorMultiply(dx, dx), XMVectorMultiply(dy, dy)), Y22)
+				};
+
+				const XMVECTOR wr = XMVectorMultiply(weight, XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&r[x])));
+				const XMVECTOR wg = XMVectorMultiply(weight, XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&g[x])));
+				const XMVECTOR wb = XMVectorMultiply(weight, XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&b[x])));
+
+				for (int i = 0; i < 9; ++i)
+				{
+					acc[3 * i + 0] = XMVectorMultiplyAdd(Ylm[i], wr, acc[3 * i + 0]);
+					acc[3 * i + 1] = XMVectorMultiplyAdd(Ylm[i], wg, acc[3 * i + 1]);
+					acc[3 * i + 2] = XMVectorMultiplyAdd(Ylm[i], wb, acc[3 * i + 2]);
+				}
+			}
+
+			float* sums = &rowSums[(size_t)row*RowSumCount];
+			for (int i = 0; i < 27; ++i)
+				sums[i] = HorizontalSum(acc[i]);
+			sums[27] = HorizontalSum(weightSum);
+		}
+	});
+
+	// Reduce the rows in a fixed order so the result does not depend on scheduling.
+	double totals[RowSumCount] = {};
+	for (int row = 0; row < rowCount; ++row)
+	{
+		for (int i = 0; i < RowSumCount; ++i)
+			totals[i] += rowSums[(size_t)row*RowSumCount + i];
+	}
+
+	// Normalize so the weights integrate to the full sphere.
+	const double scale = 4.0*XM_PI / totals[27];
+	for (int i = 0; i < 9; ++i)
+	{
+		out.C[i] = XMFLOAT3((float)(totals[3 * i] * scale), (float)(totals[3 * i + 1] * scale),
+			(float)(totals[3 * i + 2] * scale));
+	}
+
+	return true;
+}
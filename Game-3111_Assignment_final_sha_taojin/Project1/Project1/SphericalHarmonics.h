@@ -0,0 +1,57 @@
+//***************************************************************************************
+// SphericalHarmonics.h
+//
+// Order 2 (9 coefficient) RGB spherical harmonics and a CPU cube map projector.  The
+// ambient light of a scene is the irradiance SH of its environment cube map, which the
+// shaders evaluate per normal with EvaluateSH9 (LightingUtil.hlsl).
+//
+// Projection weights each texel by its solid angle, runs four texels at a time with
+// DirectXMath vectors and spreads the face rows across worker threads.
+//***************************************************************************************
+
+#pragma once
+
+#include <DirectXMath.h>
+#include <cstddef>
+#include <cstdint>
+
+struct SH9
+{
+	// Basis order: Y00, Y1-1, Y10, Y11, Y2-2, Y2-1, Y20, Y21, Y22 with x, y, z of the
+	// direction in world space.
+	DirectX::XMFLOAT3 C[9];
+
+	// The SH of a constant function with the given value.
+	static SH9 Constant(const DirectX::XMFLOAT3& value);
+
+	DirectX::XMFLOAT3 Evaluate(DirectX::FXMVECTOR n)const;
+
+	// Mean value over the sphere.
+	DirectX::XMFLOAT3 Average()const;
+
+	// Convolves radiance with the clamped cosine lobe and divides by pi, so Evaluate(n)
+	// gives the ambient light reaching a surface with normal n.
+	SH9 RadianceToIrradiance()const;
+};
+
+class CubemapSH
+{
+public:
+	enum class TexelFormat
+	{
+		BC1,
+		R8G8B8A8,
+		B8G8R8A8
+	};
+
+	struct Face
+	{
+		const std::uint8_t* Data;
+		std::size_t RowPitch;
+	};
+
+	// Projects the radiance of a size x size cube map to SH.  faces are in D3D order
+	// (+X, -X, +Y, -Y, +Z, -Z).  size must be a multiple of 4.  Returns false on
+	// unsupported input.
+	static bool Project(TexelFormat format, const Face faces[6], int size, SH9& out);
+};
@@ -0,0 +1,297 @@
+#include "StaticBatches.h"
+#include "ParallelFor.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace DirectX;
+
+namespace
+{
+	// What the first pass learns about a source.
+	struct SourceInfo
+	{
+		std::uint32_t FirstVertex = 0;
+		std::uint32_t VertexCount = 0;
+		XMFLOAT3 BoundsMin = { FLT_MAX, FLT_MAX, FLT_MAX };
+		XMFLOAT3 BoundsMax = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+		std::int64_t CellX = 0;
+		std::int64_t CellZ = 0;
+		bool Batched = false;
+
+		// Where the second pass writes it.
+		std::uint32_t OutVertex = 0;
+		std::uint32_t OutIndex = 0;
+		std::uint32_t ChunkFirstVertex = 0;
+	};
+
+	std::uint32_t SourceIndex(const StaticBatchSource& source, std::uint32_t k)
+	{
+		const std::uint32_t i = source.StartIndexLocation + k;
+		const std::uint32_t index = source.Indices32 ? static_cast<const std::uint32_t*>(source.Indices)[i] :
+			static_cast<const std::uint16_t*>(source.Indices)[i];
+		return (std::uint32_t)((std::int64_t)index + source.BaseVertexLocation);
+	}
+}
+
+std::uint32_t StaticBatches::SourceOfTriangle(std::uint32_t chunk, std::uint32_t triangle)const
+{
+	const StaticBatchChunk& c = Chunks[chunk];
+	const std::uint32_t index = c.FirstIndex + 3*triangle;
+
+	// The last part starting at or before the index.
+	const StaticBatchPart* first = Parts.data() + c.FirstPart;
+	const StaticBatchPart* last = first + c.PartCount;
+	const StaticBatchPart* part = std::upper_bound(first, last, index,
+		[](std::uint32_t i, const StaticBatchPart& p) { return i < p.FirstIndex; });
+	return (part - 1)->Source;
+}
+
+void BuildStaticBatches(const StaticBatchDesc& desc, const StaticBatchSource* sources, std::uint32_t sourceCount,
+	StaticBatches& batches)
+{
+	batches.Vertices.clear();
+	batches.Indices.clear();
+	batches.Chunks.clear();
+	batches.Parts.clear();
+	batches.Unbatched.clear();
+
+	const std::uint32_t maxChunkVertices = std::min<std::uint32_t>(std::max<std::uint32_t>(desc.MaxChunkVertices, 3), 65536);
+	const float chunkSize = desc.ChunkSize > 0.0f ? desc.ChunkSize : FLT_MAX;
+
+	// Vertex range and world bounds of every source.
+	std::vector<SourceInfo> infos(sourceCount);
+	ParallelFor(0, (int)sourceCount, [&](int s)
+	{
+		const StaticBatchSource& source = sources[s];
+		SourceInfo& info = infos[s];
+		if (source.IndexCount == 0 || source.IndexCount % 3 != 0)
+			return;
+
+		std::uint32_t first = UINT32_MAX;
+		std::uint32_t last = 0;
+		for (std::uint32_t k = 0; k < source.IndexCount; ++k)
+		{
+			const std::uint32_t v = SourceIndex(source, k);
+			first = std::min(first, v);
+			last = std::max(last, v);
+		}
+		info.FirstVertex = first;
+		info.VertexCount = last - first + 1;
+		if (info.VertexCount > maxChunkVertices)
+			return;
+
+		const XMMATRIX world = XMLoadFloat4x4(&source.World);
+		XMVECTOR lo = XMVectorReplicate(FLT_MAX);
+		XMVECTOR hi = XMVectorReplicate(-FLT_MAX);
+		for (std::uint32_t v = first; v <= last; ++v)
+		{
+			const XMVECTOR p = XMVector3TransformCoord(XMLoadFloat3(&source.Vertices[v].Pos), world);
+			lo = XMVectorMin(lo, p);
+			hi = XMVectorMax(hi, p);
+		}
+		XMStoreFloat3(&info.BoundsMin, lo);
+		XMStoreFloat3(&info.BoundsMax, hi);
+
+		info.CellX = (std::int64_t)std::floor(0.5f*(info.BoundsMin.x + info.BoundsMax.x) / chunkSize);
+		info.CellZ = (std::int64_t)std::floor(0.5f*(info.BoundsMin.z + info.BoundsMax.z) / chunkSize);
+		info.Batched = true;
+	});
+
+	// Sources by key, then cell, then their own order.
+	std::vector<std::uint32_t> order;
+	order.reserve(sourceCount);
+	for (std::uint32_t s = 0; s < sourceCount; ++s)
+	{
+		if (infos[s].Batched)
+			order.push_back(s);
+		else
+			batches.Unbatched.push_back(s);
+	}
+	std::sort(order.begin(), order.end(), [&](std::uint32_t a, std::uint32_t b)
+	{
+		if (sources[a].Key != sources[b].Key)
+			return sources[a].Key < sources[b].Key;
+		if (infos[a].CellX != infos[b].CellX)
+			return infos[a].CellX < infos[b].CellX;
+		if (infos[a].CellZ != infos[b].CellZ)
+			return infos[a].CellZ < infos[b].CellZ;
+		return a < b;
+	});
+
+	// Lay the chunks out.
+	std::uint32_t vertexCount = 0;
+	std::uint32_t indexCount = 0;
+	for (size_t n = 0; n < order.size(); ++n)
+	{
+		const std::uint32_t s = order[n];
+		SourceInfo& info = infos[s];
+
+		bool newChunk = batches.Chunks.empty();
+		if (!newChunk)
+		{
+			const StaticBatchChunk& chunk = batches.Chunks.back();
+			const SourceInfo& previous = infos[order[n - 1]];
+			newChunk = chunk.Key != sources[s].Key || previous.CellX != info.CellX || previous.CellZ != info.CellZ ||
+				chunk.VertexCount + info.VertexCount > maxChunkVertices;
+		}
+		if (newChunk)
+		{
+			StaticBatchChunk chunk;
+			chunk.Key = sources[s].Key;
+			chunk.FirstVertex = vertexCount;
+			chunk.FirstIndex = indexCount;
+			chunk.FirstPart = (std::uint32_t)batches.Parts.size();
+			chunk.BoundsMin = info.BoundsMin;
+			chunk.BoundsMax = info.BoundsMax;
+			batches.Chunks.push_back(chunk);
+		}
+
+		StaticBatchChunk& chunk = batches.Chunks.back();
+		XMStoreFloat3(&chunk.BoundsMin, XMVectorMin(XMLoadFloat3(&chunk.BoundsMin), XMLoadFloat3(&info.BoundsMin)));
+		XMStoreFloat3(&chunk.BoundsMax, XMVectorMax(XMLoadFloat3(&chunk.BoundsMax), XMLoadFloat3(&info.BoundsMax)));
+
+		StaticBatchPart part;
+		part.Source = s;
+		part.FirstIndex = indexCount;
+		part.IndexCount = sources[s].IndexCount;
+		batches.Parts.push_back(part);
+
+		info.OutVertex = vertexCount;
+		info.OutIndex = indexCount;
+		info.ChunkFirstVertex = chunk.FirstVertex;
+		chunk.VertexCount += info.VertexCount;
+		chunk.IndexCount += sources[s].IndexCount;
+		chunk.PartCount++;
+		vertexCount += info.VertexCount;
+		indexCount += sources[s].IndexCount;
+	}
+
+	// Move every source into place.  Normals go through the inverse transpose; a world
+	// matrix that mirrors flips the triangles back to their winding.
+	batches.Vertices.resize(vertexCount);
+	batches.Indices.resize(indexCount);
+	ParallelFor(0, (int)order.size(), [&](int n)
+	{
+		const std::uint32_t s = order[n];
+		const StaticBatchSource& source = sources[s];
+		const SourceInfo& info = infos[s];
+
+		XMMATRIX world = XMLoadFloat4x4(&source.World);
+		XMMATRIX linear = world;
+		linear.r[3] = XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
+		XMVECTOR determinant;
+		const XMMATRIX normalMatrix = XMMatrixTranspose(XMMatrixInverse(&determinant, linear));
+		const XMMATRIX texTransform = XMLoadFloat4x4(&source.TexTransform);
+
+		StaticBatchVertex* out = &batches.Vertices[info.OutVertex];
+		for (std::uint32_t v = 0; v < info.VertexCount; ++v)
+		{
+			const StaticBatchVertex& in = source.Vertices[info.FirstVertex + v];
+			XMStoreFloat3(&out[v].Pos, XMVector3TransformCoord(XMLoadFloat3(&in.Pos), world));
+			XMStoreFloat3(&out[v].Normal, XMVector3Normalize(XMVector3TransformNormal(XMLoadFloat3(&in.Normal), normalMatrix)));
+			XMStoreFloat2(&out[v].TexC, XMVector2Transform(XMLoadFloat2(&in.TexC), texTransform));
+		}
+
+		const bool mirrored = XMVectorGetX(determinant) < 0.0f;
+		const std::uint32_t rebase = info.OutVertex - info.ChunkFirstVertex - info.FirstVertex;
+		std::uint16_t* indices = &batches.Indices[info.OutIndex];
+		for (std::uint32_t k = 0; k < source.IndexCount; k += 3)
+		{
+			indices[k] = (std::uint16_t)(SourceIndex(source, k) + rebase);
+			indices[k + 1] = (std::uint16_t)(SourceIndex(source, mirrored ? k + 2 : k + 1) + rebase);
+			indices[k + 2] = (std::uint16_t)(SourceIndex(source, mirrored ? k + 1 : k + 2) + rebase);
+		}
+	});
+}
+
+bool StaticChunkVisible(const StaticBatchChunk& chunk, const XMFLOAT4 planes[6])
+{
+	// The corner of the box furthest along each plane's normal.
+	for (int k = 0; k < 6; ++k)
+	{
+		const XMFLOAT4& plane = planes[k];
+		const float x = plane.x >= 0.0f ? chunk.BoundsMax.x : chunk.BoundsMin.x;
+		const float y = plane.y >= 0.0f ? chunk.BoundsMax.y : chunk.BoundsMin.y;
+		const float z = plane.z >= 0.0f ? chunk.BoundsMax.z : chunk.BoundsMin.z;
+		if (plane.x*x + plane.y*y + plane.z*z + plane.w < 0.0f)
+			return false;
+	}
+	return true;
+}
+
+bool PickStaticBatches(const StaticBatches& batches, FXMVECTOR origin, FXMVECTOR direction, StaticBatchHit& hit)
+{
+	XMFLOAT3 o, d;
+	XMStoreFloat3(&o, origin);
+	XMStoreFloat3(&d, direction);
+	const float oa[3] = { o.x, o.y, o.z };
+	const float da[3] = { d.x, d.y, d.z };
+
+	bool found = false;
+	float nearest = FLT_MAX;
+	for (std::uint32_t c = 0; c < (std::uint32_t)batches.Chunks.size(); ++c)
+	{
+		const StaticBatchChunk& chunk = batches.Chunks[c];
+
+		// Slabs.
+		const float lo[3] = { chunk.BoundsMin.x, chunk.BoundsMin.y, chunk.BoundsMin.z };
+		const float hi[3] = { chunk.BoundsMax.x, chunk.BoundsMax.y, chunk.BoundsMax.z };
+		float tMin = 0.0f;
+		float tMax = nearest;
+		for (int axis = 0; axis < 3 && tMin <= tMax; ++axis)
+		{
+			if (std::fabs(da[axis]) < 1e-12f)
+			{
+				if (oa[axis] < lo[axis] || oa[axis] > hi[axis])
+					tMax = -1.0f;
+				continue;
+			}
+			float t0 = (lo[axis] - oa[axis]) / da[axis];
+			float t1 = (hi[axis] - oa[axis]) / da[axis];
+			if (t0 > t1)
+				std::swap(t0, t1);
+			tMin = std::max(tMin, t0);
+			tMax = std::min(tMax, t1);
+		}
+		if (tMin > tMax)
+			continue;
+
+		// Moller-Trumbore on every triangle.
+		const StaticBatchVertex* vertices = &batches.Vertices[chunk.FirstVertex];
+		const std::uint16_t* indices = &batches.Indices[chunk.FirstIndex];
+		for (std::uint32_t t = 0; t < chunk.IndexCount / 3; ++t)
+		{
+			const XMVECTOR p0 = XMLoadFloat3(&vertices[indices[3*t]].Pos);
+			const XMVECTOR e1 = XMVectorSubtract(XMLoadFloat3(&vertices[indices[3*t + 1]].Pos), p0);
+			const XMVECTOR e2 = XMVectorSubtract(XMLoadFloat3(&vertices[indices[3*t + 2]].Pos), p0);
+			const XMVECTOR pv = XMVector3Cross(direction, e2);
+			const float det = XMVectorGetX(XMVector3Dot(e1, pv));
+			if (std::fabs(det) < 1e-12f)
+				continue;
+
+			const float invDet = 1.0f / det;
+			const XMVECTOR tv = XMVectorSubtract(origin, p0);
+			const float u = XMVectorGetX(XMVector3Dot(tv, pv))*invDet;
+			if (u < 0.0f || u > 1.0f)
+				continue;
+			const XMVECTOR qv = XMVector3Cross(tv, e1);
+			const float v = XMVectorGetX(XMVector3Dot(direction, qv))*invDet;
+			if (v < 0.0f || u + v > 1.0f)
+				continue;
+			const float distance = XMVectorGetX(XMVector3Dot(e2, qv))*invDet;
+			if (distance < 0.0f || distance >= nearest)
+				continue;
+
+			nearest = distance;
+			hit.Chunk = c;
+			hit.Triangle = t;
+			hit.Distance = distance;
+			found = true;
+		}
+	}
+
+	if (found)
+		hit.Source = batches.SourceOfTriangle(hit.Chunk, hit.Triangle);
+	return found;
+}
@@ -0,0 +1,120 @@
+//***************************************************************************************
+// StaticBatches.h
+//
+// Merges render items that never move into a few large meshes.  Each source item's
+// vertices are moved to world space (positions, normals and texture coordinates through
+// the item's texture transform), so a merged mesh draws with identity transforms and one
+// draw covers every item of a material.  The merged triangles are split into chunks by
+// square cells on the xz plane, so a chunk can still be culled against the frustum, and
+// every chunk remembers which source item each of its triangles came from, for picking.
+//
+// Sources are grouped by key (the app's material and render layer) and cell; a group that
+// would pass MaxChunkVertices continues in a new chunk.  Chunk indices are 16-bit and
+// count from the chunk's first vertex, which is the draw's base vertex.  The transforms
+// run in parallel over the sources; the layout depends only on the input.
+//***************************************************************************************
+
+#pragma once
+
+#include <DirectXMath.h>
+#include <cstdint>
+#include <vector>
+
+// The demo's Vertex layout.
+struct StaticBatchVertex
+{
+	DirectX::XMFLOAT3 Pos;
+	DirectX::XMFLOAT3 Normal;
+	DirectX::XMFLOAT2 TexC;
+};
+
+struct StaticBatchSource
+{
+	// The source geometry's vertices, and its indices, 16 or 32 bits each.
+	const StaticBatchVertex* Vertices = nullptr;
+	const void* Indices = nullptr;
+	bool Indices32 = false;
+
+	// The item's part of the geometry, as DrawIndexedInstanced takes it.  Triangle lists
+	// only.
+	std::uint32_t IndexCount = 0;
+	std::uint32_t StartIndexLocation = 0;
+	std::int32_t BaseVertexLocation = 0;
+
+	DirectX::XMFLOAT4X4 World = { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f };
+	DirectX::XMFLOAT4X4 TexTransform = { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f };
+
+	// Sources with equal keys are merged.
+	std::uint32_t Key = 0;
+};
+
+struct StaticBatchDesc
+{
+	// Side of the cells on the xz plane; a source goes to the cell of its bounds' center.
+	float ChunkSize = 32.0f;
+
+	// At most 65536, as chunk indices are 16-bit.
+	std::uint32_t MaxChunkVertices = 65536;
+};
+
+struct StaticBatchChunk
+{
+	std::uint32_t Key = 0;
+
+	// Into StaticBatches::Vertices, Indices and Parts.
+	std::uint32_t FirstVertex = 0;
+	std::uint32_t VertexCount = 0;
+	std::uint32_t FirstIndex = 0;
+	std::uint32_t IndexCount = 0;
+	std::uint32_t FirstPart = 0;
+	std::uint32_t PartCount = 0;
+
+	// World space bounds of the chunk's vertices.
+	DirectX::XMFLOAT3 BoundsMin = { 0.0f, 0.0f, 0.0f };
+	DirectX::XMFLOAT3 BoundsMax = { 0.0f, 0.0f, 0.0f };
+};
+
+// The indices one source contributed to a chunk.
+struct StaticBatchPart
+{
+	std::uint32_t Source = 0;
+	std::uint32_t FirstIndex = 0;   // Into StaticBatches::Indices.
+	std::uint32_t IndexCount = 0;
+};
+
+struct StaticBatches
+{
+	std::vector<StaticBatchVertex> Vertices;
+	std::vector<std::uint16_t> Indices;
+	std::vector<StaticBatchChunk> Chunks;
+
+	// Chunk after chunk, each chunk's parts in index order.
+	std::vector<StaticBatchPart> Parts;
+
+	// Sources left out: no triangles, or more vertices than fit one chunk.  The app draws
+	// these as before.
+	std::vector<std::uint32_t> Unbatched;
+
+	// Source of triangle t of the chunk, counted from the chunk's FirstIndex.
+	std::uint32_t SourceOfTriangle(std::uint32_t chunk, std::uint32_t triangle)const;
+};
+
+void BuildStaticBatches(const StaticBatchDesc& desc, const StaticBatchSource* sources, std::uint32_t sourceCount,
+	StaticBatches& batches);
+
+// False if the chunk's bounds are outside one of the planes.  A point p is inside plane k
+// when dot(planes[k].xyz, p) + planes[k].w >= 0, as in MeshletCullView.
+bool StaticChunkVisible(const StaticBatchChunk& chunk, const DirectX::XMFLOAT4 planes[6]);
+
+struct StaticBatchHit
+{
+	std::uint32_t Source = 0;
+	std::uint32_t Chunk = 0;
+	std::uint32_t Triangle = 0;   // Within the chunk.
+	float Distance = 0.0f;        // Along the ray, in units of the direction's length.
+};
+
+// The nearest triangle the ray from origin along direction hits, either side.  Chunks
+// whose bounds the ray misses are skipped.  Returns false if nothing is hit.
+bool PickStaticBatches(const StaticBatches& batches, DirectX::FXMVECTOR origin, DirectX::FXMVECTOR direction,
+	StaticBatchHit& hit);
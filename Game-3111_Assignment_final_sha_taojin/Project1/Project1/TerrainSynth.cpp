@@ -0,0 +1,444 @@
+#include "TerrainSynth.h"
+#include "ParallelFor.h"
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+
+using namespace DirectX;
+
+namespace
+{
+	// Small xorshift generator; each tile gets its own so erosion is deterministic
+	// regardless of how the tiles are scheduled.
+	struct XorShift32
+	{
+		std::uint32_t State;
+
+		explicit XorShift32(std::uint32_t seed) : State(seed != 0 ? seed : 0x9E3779B9u) {}
+
+		std::uint32_t Next()
+		{
+			State ^= State << 13;
+			State ^= State >> 17;
+			State ^= State << 5;
+			return State;
+		}
+
+		// Returns a float in [0, 1).
+		float NextFloat()
+		{
+			return (Next() >> 8) * (1.0f / 16777216.0f);
+		}
+	};
+
+	std::uint32_t HashCombine(std::uint32_t a, std::uint32_t b)
+	{
+		a ^= b + 0x9E3779B9u + (a << 6) + (a >> 2);
+		a *= 0x85EBCA6Bu;
+		return a ^ (a >> 13);
+	}
+
+	inline XMVECTOR XM_CALLCONV Mod289(FXMVECTOR v)
+	{
+		const XMVECTOR k289 = XMVectorReplicate(289.0f);
+		const XMVECTOR kInv289 = XMVectorReplicate(1.0f / 289.0f);
+		return XMVectorNegativeMultiplySubtract(XMVectorFloor(XMVectorMultiply(v, kInv289)), k289, v);
+	}
+
+	// ((34v + 1) v) mod 289 -- a permutation polynomial, so no lookup table is needed
+	// and the hash stays entirely in vector registers.
+	inline XMVECTOR XM_CALLCONV Permute(FXMVECTOR v)
+	{
+		XMVECTOR t = XMVectorMultiplyAdd(v, XMVectorReplicate(34.0f), XMVectorReplicate(1.0f));
+		return Mod289(XMVectorMultiply(t, v));
+	}
+
+	// Radial falloff times gradient dot product for one simplex corner.
+	inline XMVECTOR XM_CALLCONV CornerContribution(FXMVECTOR hash, FXMVECTOR x, FXMVECTOR y)
+	{
+		const XMVECTOR half = XMVectorReplicate(0.5f);
+		const XMVECTOR one = XMVectorReplicate(1.0f);
+
+		XMVECTOR m = XMVectorMax(XMVectorSubtract(half,
+			XMVectorMultiplyAdd(x, x, XMVectorMultiply(y, y))), XMVectorZero());
+		m = XMVectorMultiply(m, m);
+		m = XMVectorMultiply(m, m);
+
+		// Map the hash to a gradient on a diamond and normalise it approximately.
+		XMVECTOR p = XMVectorMultiply(hash, XMVectorReplicate(1.0f / 41.0f));
+		XMVECTOR gx = XMVectorSubtract(XMVectorScale(XMVectorSubtract(p, XMVectorFloor(p)), 2.0f), one);
+		XMVECTOR h = XMVectorSubtract(XMVectorAbs(gx), half);
+		XMVECTOR a0 = XMVectorSubtract(gx, XMVectorFloor(XMVectorAdd(gx, half)));
+
+		XMVECTOR norm = XMVectorNegativeMultiplySubtract(
+			XMVectorReplicate(0.85373472095314f),
+			XMVectorMultiplyAdd(a0, a0, XMVectorMultiply(h, h)),
+			XMVectorReplicate(1.79284291400159f));
+		m = XMVectorMultiply(m, norm);
+
+		XMVECTOR g = XMVectorMultiplyAdd(a0, x, XMVectorMultiply(h, y));
+		return XMVectorMultiply(m, g);
+	}
+}
+
+TerrainSynth::TerrainSynth(const TerrainSynthDesc& desc)
+	: mDesc(desc)
+{
+	assert(mDesc.Rows >= 2 && mDesc.Cols >= 2);
+
+	XorShift32 rng(mDesc.Seed);
+	const int offsetCount = std::max(mDesc.Octaves, mDesc.WarpOctaves);
+	mOctaveOffsets.resize(offsetCount);
+	for (auto& o : mOctaveOffsets)
+	{
+		o.x = 200.0f * rng.NextFloat() - 100.0f;
+		o.y = 200.0f * rng.NextFloat() - 100.0f;
+	}
+
+	// Cone shaped erosion brush, weights sum to one.
+	const int r = std::max(mDesc.ErosionRadius, 1);
+	float weightSum = 0.0f;
+	for (int y = -r; y <= r; ++y)
+	{
+		for (int x = -r; x <= r; ++x)
+		{
+			float d = sqrtf((float)(x*x + y*y));
+			if (d < r)
+			{
+				BrushTap tap = { x, y, 1.0f - d / r };
+				weightSum += tap.Weight;
+				mBrush.push_back(tap);
+			}
+		}
+	}
+	for (auto& tap : mBrush)
+		tap.Weight /= weightSum;
+}
+
+XMVECTOR XM_CALLCONV TerrainSynth::Simplex4(FXMVECTOR x, FXMVECTOR y)
+{
+	// Skew/unskew factors for 2D: F2 = (sqrt(3)-1)/2, G2 = (3-sqrt(3))/6.
+	const XMVECTOR F2 = XMVectorReplicate(0.366025403784439f);
+	const XMVECTOR G2 = XMVectorReplicate(0.211324865405187f);
+	const XMVECTOR G2x2MinusOne = XMVectorReplicate(-0.577350269189626f);
+	const XMVECTOR zero = XMVectorZero();
+	const XMVECTOR one = XMVectorReplicate(1.0f);
+
+	// First corner.
+	XMVECTOR s = XMVectorMultiply(XMVectorAdd(x, y), F2);
+	XMVECTOR ix = XMVectorFloor(XMVectorAdd(x, s));
+	XMVECTOR iy = XMVectorFloor(XMVectorAdd(y, s));
+	XMVECTOR t = XMVectorMultiply(XMVectorAdd(ix, iy), G2);
+	XMVECTOR x0 = XMVectorAdd(XMVectorSubtract(x, ix), t);
+	XMVECTOR y0 = XMVectorAdd(XMVectorSubtract(y, iy), t);
+
+	// Middle corner is (1,0) in the lower triangle and (0,1) in the upper one.
+	XMVECTOR lower = XMVectorGreater(x0, y0);
+	XMVECTOR i1x = XMVectorSelect(zero, one, lower);
+	XMVECTOR i1y = XMVectorSubtract(one, i1x);
+
+	XMVECTOR x1 = XMVectorSubtract(XMVectorAdd(x0, G2), i1x);
+	XMVECTOR y1 = XMVectorSubtract(XMVectorAdd(y0, G2), i1y);
+	XMVECTOR x2 = XMVectorAdd(x0, G2x2MinusOne);
+	XMVECTOR y2 = XMVectorAdd(y0, G2x2MinusOne);
+
+	// Hash the three corners.
+	ix = Mod289(ix);
+	iy = Mod289(iy);
+	XMVECTOR p0 = Permute(XMVectorAdd(Permute(iy), ix));
+	XMVECTOR p1 = Permute(XMVectorAdd(XMVectorAdd(Permute(XMVectorAdd(iy, i1y)), ix), i1x));
+	XMVECTOR p2 = Permute(XMVectorAdd(XMVectorAdd(Permute(XMVectorAdd(iy, one)), ix), one));
+
+	XMVECTOR n = CornerContribution(p0, x0, y0);
+	n = XMVectorAdd(n, CornerContribution(p1, x1, y1));
+	n = XMVectorAdd(n, CornerContribution(p2, x2, y2));
+
+	// Scale the result to cover [-1, 1].
+	return XMVectorScale(n, 130.0f);
+}
+
+XMVECTOR XM_CALLCONV TerrainSynth::Fbm4(FXMVECTOR x, FXMVECTOR y, int octaves)const
+{
+	XMVECTOR sum = XMVectorZero();
+	float amplitude = 1.0f;
+	float frequency = 1.0f;
+	float amplitudeSum = 0.0f;
+
+	octaves = std::min(octaves, (int)mOctaveOffsets.size());
+	for (int o = 0; o < octaves; ++o)
+	{
+		XMVECTOR ox = XMVectorAdd(XMVectorScale(x, frequency), XMVectorReplicate(mOctaveOffsets[o].x));
+		XMVECTOR oy = XMVectorAdd(XMVectorScale(y, frequency), XMVectorReplicate(mOctaveOffsets[o].y));
+		sum = XMVectorMultiplyAdd(Simplex4(ox, oy), XMVectorReplicate(amplitude), sum);
+
+		amplitudeSum += amplitude;
+		amplitude *= mDesc.Gain;
+		frequency *= mDesc.Lacunarity;
+	}
+
+	return amplitudeSum > 0.0f ? XMVectorScale(sum, 1.0f / amplitudeSum) : sum;
+}
+
+void TerrainSynth::GenerateNoise(std::vector<float>& heights)const
+{
+	const int m = mDesc.Rows;
+	const int n = mDesc.Cols;
+	heights.resize((size_t)m*n);
+
+	const float dx = mDesc.Width / (n - 1);
+	const float dz = mDesc.Depth / (m - 1);
+	const float halfWidth = 0.5f*mDesc.Width;
+	const float halfDepth = 0.5f*mDesc.Depth;
+	const bool warp = mDesc.WarpStrength != 0.0f && mDesc.WarpOctaves > 0;
+
+	const XMVECTOR laneOffsets = XMVectorSet(0.0f, 1.0f, 2.0f, 3.0f);
+	const XMVECTOR frequency = XMVectorReplicate(mDesc.Frequency);
+	const XMVECTOR warpFrequency = XMVectorReplicate(mDesc.WarpFrequency);
+	const XMVECTOR warpStrength = XMVectorReplicate(mDesc.WarpStrength);
+
+	ParallelFor(0, m, [&](int i)
+	{
+		const XMVECTOR z = XMVectorReplicate(halfDepth - i*dz);
+		float* row = &heights[(size_t)i*n];
+
+		for (int j = 0; j < n; j += 4)
+		{
+			XMVECTOR x = XMVectorMultiplyAdd(XMVectorAdd(XMVectorReplicate((float)j), laneOffsets),
+				XMVectorReplicate(dx), XMVectorReplicate(-halfWidth));
+			XMVECTOR px = x;
+			XMVECTOR pz = z;
+
+			if (warp)
+			{
+				// Offset the lookup by a second, lower frequency noise field.
+				XMVECTOR wx = XMVectorMultiply(x, warpFrequency);
+				XMVECTOR wz = XMVectorMultiply(z, warpFrequency);
+				XMVECTOR qx = Fbm4(XMVectorAdd(wx, XMVectorReplicate(5.2f)), XMVectorAdd(wz, XMVectorReplicate(1.3f)), mDesc.WarpOctaves);
+				XMVECTOR qz = Fbm4(XMVectorAdd(wx, XMVectorReplicate(9.7f)), XMVectorAdd(wz, XMVectorReplicate(2.8f)), mDesc.WarpOctaves);
+				px = XMVectorMultiplyAdd(qx, warpStrength, px);
+				pz = XMVectorMultiplyAdd(qz, warpStrength, pz);
+			}
+
+			XMVECTOR h = Fbm4(XMVectorMultiply(px, frequency), XMVectorMultiply(pz, frequency), mDesc.Octaves);
+			h = XMVectorMultiplyAdd(h, XMVectorReplicate(mDesc.Amplitude), XMVectorReplicate(mDesc.BaseHeight));
+
+			XMFLOAT4 out;
+			XMStoreFloat4(&out, h);
+			const float lanes[4] = { out.x, out.y, out.z, out.w };
+			const int count = std::min(4, n - j);
+			for (int k = 0; k < count; ++k)
+				row[j + k] = lanes[k];
+		}
+	});
+}
+
+std::uint64_t TerrainSynth::Erode(std::vector<float>& heights)const
+{
+	const int m = mDesc.Rows;
+	const int n = mDesc.Cols;
+	assert(heights.size() == (size_t)m*n);
+
+	if (mDesc.DropletCount <= 0)
+		return 0;
+
+	const int tileSize = std::max(mDesc.TileSize, 8);
+	const int halo = std::min(mDesc.DropletLifetime + mDesc.ErosionRadius + 1, tileSize / 2);
+	const int tilesX = (n + tileSize - 1) / tileSize;
+	const int tilesY = (m + tileSize - 1) / tileSize;
+	const double totalCells = (double)m*n;
+
+	std::uint64_t dropletTotal = 0;
+
+	// Tiles with the same (x&1, y&1) parity are at least one tile apart, so with the halo
+	// clamped to half a tile their regions never overlap and they can run concurrently.
+	for (int phase = 0; phase < 4; ++phase)
+	{
+		std::vector<std::pair<int, int>> tiles;
+		for (int ty = phase >> 1; ty < tilesY; ty += 2)
+			for (int tx = phase & 1; tx < tilesX; tx += 2)
+				tiles.push_back({ tx, ty });
+
+		std::vector<int> counts(tiles.size());
+
+		ParallelFor(0, (int)tiles.size(), [&](int t)
+		{
+			const int tx = tiles[t].first;
+			const int ty = tiles[t].second;
+
+			const int x0 = tx*tileSize;
+			const int y0 = ty*tileSize;
+			const int x1 = std::min(x0 + tileSize, n);
+			const int y1 = std::min(y0 + tileSize, m);
+
+			const int rx0 = std::max(x0 - halo, 0);
+			const int ry0 = std::max(y0 - halo, 0);
+			const int rx1 = std::min(x1 + halo, n);
+			const int ry1 = std::min(y1 + halo, m);
+			const int regionCols = rx1 - rx0;
+			const int regionRows = ry1 - ry0;
+
+			// Pull the tile and its halo (the neighbours' current heights) into a local copy.
+			std::vector<float> region((size_t)regionCols*regionRows);
+			for (int y = 0; y < regionRows; ++y)
+			{
+				std::copy_n(&heights[(size_t)(ry0 + y)*n + rx0], regionCols, &region[(size_t)y*regionCols]);
+			}
+
+			// Droplets are spawned in proportion to the tile area.
+			const int count = (int)(mDesc.DropletCount * ((double)(x1 - x0)*(y1 - y0) / totalCells) + 0.5);
+			counts[t] = count;
+
+			std::uint32_t seed = HashCombine(HashCombine(mDesc.Seed, (std::uint32_t)tx), (std::uint32_t)ty);
+			ErodeRegion(region.data(), regionCols, regionRows,
+				x0 - rx0, y0 - ry0, x1 - rx0, y1 - ry0, count, seed);
+
+			// Push the tile and its halo back, including what the droplets moved into the neighbours.
+			for (int y = 0; y < regionRows; ++y)
+			{
+				std::copy_n(&region[(size_t)y*regionCols], regionCols, &heights[(size_t)(ry0 + y)*n + rx0]);
+			}
+		});
+
+		for (int c : counts)
+			dropletTotal += c;
+	}
+
+	return dropletTotal;
+}
+
+void TerrainSynth::ErodeRegion(float* region, int regionCols, int regionRows,
+	int spawnX0, int spawnY0, int spawnX1, int spawnY1,
+	int count, std::uint32_t seed)const
+{
+	// Keep droplets far enough from the region edge that the brush stays inside it.
+	const int margin = std::max(mDesc.ErosionRadius, 1) + 1;
+	const float minPos = (float)margin;
+	const float maxX = (float)(regionCols - margin - 1);
+	const float maxY = (float)(regionRows - margin - 1);
+	if (maxX <= minPos || maxY <= minPos)
+		return;
+
+	const float sx0 = std::max((float)spawnX0, minPos);
+	const float sy0 = std::max((float)spawnY0, minPos);
+	const float sx1 = std::min((float)spawnX1, maxX);
+	const float sy1 = std::min((float)spawnY1, maxY);
+	if (sx1 <= sx0 || sy1 <= sy0)
+		return;
+
+	// Bilinear height and gradient at a position in cell coordinates.
+	auto heightAndGradient = [&](float px, float py, float& gx, float& gy)
+	{
+		const int cx = (int)px;
+		const int cy = (int)py;
+		const float u = px - cx;
+		const float v = py - cy;
+
+		const float* r = &region[(size_t)cy*regionCols + cx];
+		const float hNW = r[0];
+		const float hNE = r[1];
+		const float hSW = r[regionCols];
+		const float hSE = r[regionCols + 1];
+
+		gx = (hNE - hNW)*(1.0f - v) + (hSE - hSW)*v;
+		gy = (hSW - hNW)*(1.0f - u) + (hSE - hNE)*u;
+		return hNW*(1.0f - u)*(1.0f - v) + hNE*u*(1.0f - v) + hSW*(1.0f - u)*v + hSE*u*v;
+	};
+
+	XorShift32 rng(seed);
+
+	for (int d = 0; d < count; ++d)
+	{
+		float posX = sx0 + rng.NextFloat()*(sx1 - sx0);
+		float posY = sy0 + rng.NextFloat()*(sy1 - sy0);
+		float dirX = 0.0f;
+		float dirY = 0.0f;
+		float speed = 1.0f;
+		float water = 1.0f;
+		float sediment = 0.0f;
+
+		for (int life = 0; life < mDesc.DropletLifetime; ++life)
+		{
+			const int cx = (int)posX;
+			const int cy = (int)posY;
+			const float u = posX - cx;
+			const float v = posY - cy;
+
+			float gx, gy;
+			const float h = heightAndGradient(posX, posY, gx, gy);
+
+			// Blend the previous direction with the downhill direction.
+			dirX = dirX*mDesc.Inertia - gx*(1.0f - mDesc.Inertia);
+			dirY = dirY*mDesc.Inertia - gy*(1.0f - mDesc.Inertia);
+			const float len = sqrtf(dirX*dirX + dirY*dirY);
+			if (len < 1e-6f)
+				break;
+			dirX /= len;
+			dirY /= len;
+
+			posX += dirX;
+			posY += dirY;
+			if (posX < minPos || posX > maxX || posY < minPos || posY > maxY)
+				break;
+
+			float ngx, ngy;
+			const float deltaH = heightAndGradient(posX, posY, ngx, ngy) - h;
+
+			const float capacity = std::max(-deltaH*speed*water*mDesc.SedimentCapacity, mDesc.MinSedimentCapacity);
+
+			if (sediment > capacity || deltaH > 0.0f)
+			{
+				// Uphill: fill the pit behind us.  Over capacity: drop the excess.
+				const float amount = deltaH > 0.0f ? std::min(deltaH, sediment) : (sediment - capacity)*mDesc.DepositSpeed;
+				sediment -= amount;
+
+				float* r = &region[(size_t)cy*regionCols + cx];
+				r[0] += amount*(1.0f - u)*(1.0f - v);
+				r[1] += amount*u*(1.0f - v);
+				r[regionCols] += amount*(1.0f - u)*v;
+				r[regionCols + 1] += amount*u*v;
+			}
+			else
+			{
+				// Never dig deeper than the drop we just made.
+				const float amount = std::min((capacity - sediment)*mDesc.ErodeSpeed, -deltaH);
+				for (const BrushTap& tap : mBrush)
+				{
+					region[(size_t)(cy + tap.OffsetY)*regionCols + cx + tap.OffsetX] -= amount*tap.Weight;
+				}
+				sediment += amount;
+			}
+
+			speed = sqrtf(std::max(speed*speed - deltaH*mDesc.Gravity, 0.0f));
+			water *= 1.0f - mDesc.EvaporateSpeed;
+		}
+	}
+}
+
+void TerrainSynth::Generate(Heightmap& out, TerrainSynthStats* stats)
+{
+	using Clock = std::chrono::steady_clock;
+
+	std::vector<float> heights;
+
+	auto t0 = Clock::now();
+	GenerateNoise(heights);
+	auto t1 = Clock::now();
+	std::uint64_t droplets = Erode(heights);
+	auto t2 = Clock::now();
+
+	out.Resize(mDesc.Rows, mDesc.Cols, mDesc.Width, mDesc.Depth);
+	out.SetHeights(std::move(heights));
+
+	if (stats != nullptr)
+	{
+		const bool warp = mDesc.WarpStrength != 0.0f && mDesc.WarpOctaves > 0;
+		const std::uint64_t samples = (std::uint64_t)mDesc.Rows*mDesc.Cols;
+
+		stats->NoiseSeconds = std::chrono::duration<double>(t1 - t0).count();
+		stats->ErosionSeconds = std::chrono::duration<double>(t2 - t1).count();
+		stats->Samples = samples;
+		stats->NoiseEvaluations = samples*(mDesc.Octaves + (warp ? 2 * mDesc.WarpOctaves : 0));
+		stats->Droplets = droplets;
+	}
+}
@@ -0,0 +1,117 @@
+//***************************************************************************************
+// TerrainSynth.h
+//
+// Procedural terrain generator.  Heights come from fractal (fBm) simplex noise, optionally
+// domain warped, followed by a particle based hydraulic erosion pass.  The result is
+// written into a Heightmap so land geometry and collision can consume it directly.
+//
+// Noise is evaluated four samples at a time with DirectXMath vectors and rows are spread
+// across worker threads.  Erosion runs tile by tile: tiles are processed in four
+// checkerboard phases, each tile simulates its droplets on a private copy of the tile plus
+// a halo of its neighbours, and the halo changes are written back after the phase.
+//***************************************************************************************
+
+#pragma once
+
+#include "Heightmap.h"
+#include <cstdint>
+#include <vector>
+
+struct TerrainSynthDesc
+{
+	// Output grid, laid out like GeometryGenerator::CreateGrid.
+	int Rows = 257;
+	int Cols = 257;
+	float Width = 120.0f;
+	float Depth = 120.0f;
+
+	std::uint32_t Seed = 1337;
+
+	// fBm noise.  Frequency is in cycles per world unit.
+	int Octaves = 6;
+	float Frequency = 0.015f;
+	float Lacunarity = 2.0f;
+	float Gain = 0.5f;
+	float Amplitude = 20.0f;
+	float BaseHeight = 0.0f;
+
+	// Domain warping: p' = p + WarpStrength*fbm2(p*WarpFrequency).  0 disables it.
+	float WarpStrength = 10.0f;
+	float WarpFrequency = 0.01f;
+	int WarpOctaves = 3;
+
+	// Hydraulic erosion.  0 droplets disables it.
+	int DropletCount = 70000;
+	int DropletLifetime = 30;
+	int ErosionRadius = 3;
+	float Inertia = 0.05f;
+	float SedimentCapacity = 4.0f;
+	float MinSedimentCapacity = 0.01f;
+	float ErodeSpeed = 0.3f;
+	float DepositSpeed = 0.3f;
+	float EvaporateSpeed = 0.01f;
+	float Gravity = 4.0f;
+
+	// Erosion tile size in cells.  The halo is DropletLifetime + ErosionRadius + 1 cells
+	// and is clamped to half a tile so tiles in the same phase never overlap.
+	int TileSize = 64;
+};
+
+struct TerrainSynthStats
+{
+	double NoiseSeconds = 0.0;
+	double ErosionSeconds = 0.0;
+
+	// Heightfield samples produced and individual noise evaluations behind them.
+	std::uint64_t Samples = 0;
+	std::uint64_t NoiseEvaluations = 0;
+	std::uint64_t Droplets = 0;
+
+	double SamplesPerSecond()const { return NoiseSeconds > 0.0 ? Samples / NoiseSeconds : 0.0; }
+	double DropletsPerSecond()const { return ErosionSeconds > 0.0 ? Droplets / ErosionSeconds : 0.0; }
+};
+
+class TerrainSynth
+{
+public:
+	explicit TerrainSynth(const TerrainSynthDesc& desc);
+	TerrainSynth(const TerrainSynth& rhs) = delete;
+	TerrainSynth& operator=(const TerrainSynth& rhs) = delete;
+	~TerrainSynth() = default;
+
+	// Generates the noise field, erodes it and stores it in out (resized to the desc grid).
+	void Generate(Heightmap& out, TerrainSynthStats* stats = nullptr);
+
+	// The two stages on their own.  heights is row-major Rows x Cols.
+	void GenerateNoise(std::vector<float>& heights)const;
+	std::uint64_t Erode(std::vector<float>& heights)const;
+
+	// 2D simplex noise in [-1, 1] for four (x, y) pairs.
+	static DirectX::XMVECTOR XM_CALLCONV Simplex4(DirectX::FXMVECTOR x, DirectX::FXMVECTOR y);
+
+	// Fractal sum of Simplex4 octaves.
+	DirectX::XMVECTOR XM_CALLCONV Fbm4(DirectX::FXMVECTOR x, DirectX::FXMVECTOR y, int octaves)const;
+
+	const TerrainSynthDesc& Desc()const { return mDesc; }
+
+private:
+	struct BrushTap
+	{
+		int OffsetX;
+		int OffsetY;
+		float Weight;
+	};
+
+	// Simulates count droplets on a local region of the grid.
+	void ErodeRegion(float* region, int regionCols, int regionRows,
+		int spawnX0, int spawnY0, int spawnX1, int spawnY1,
+		int count, std::uint32_t seed)const;
+
+private:
+	TerrainSynthDesc mDesc;
+
+	// Per-octave offsets so the octaves do not line up at the origin.
+	std::vector<DirectX::XMFLOAT2> mOctaveOffsets;
+
+	std::vector<BrushTap> mBrush;
+};
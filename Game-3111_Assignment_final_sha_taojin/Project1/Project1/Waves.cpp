@@ -3,10 +3,10 @@
 //***************************************************************************************
 
 #include "Waves.h"
-#include <ppl.h>
+#include "ParallelFor.h"
 #include <algorithm>
-#include <vector>
 #include <cassert>
+#include <new>
 
 using namespace DirectX;
 
@@ -27,10 +27,15 @@ Waves::Waves(int m, int n, float dx, float dt, float speed, float damping)
     mK2 = (4.0f - 8.0f*e) / d;
     mK3 = (2.0f*e) / d;
 
-    mPrevSolution.resize(m*n);
-    mCurrSolution.resize(m*n);
-    mNormals.resize(m*n);
-    mTangentX.resize(m*n);
+    // Each grid starts on a cache line so the rows ParallelFor hands out do not share one.
+    const std::size_t gridBytes = ((std::size_t)m*n*sizeof(XMFLOAT3) + 63) & ~(std::size_t)63;
+    if (!mArena.Create("waves", 4*gridBytes + 64, MemoryArena::LargePages))
+        throw std::bad_alloc();
+
+    mPrevSolution = static_cast<XMFLOAT3*>(mArena.Allocate(gridBytes, 64));
+    mCurrSolution = static_cast<XMFLOAT3*>(mArena.Allocate(gridBytes, 64));
+    mNormals = static_cast<XMFLOAT3*>(mArena.Allocate(gridBytes, 64));
+    mTangentX = static_cast<XMFLOAT3*>(mArena.Allocate(gridBytes, 64));
 
     // Generate grid vertices in system memory.
 
@@ -85,6 +90,28 @@ float Waves::Depth()const
 	return mNumRows*mSpatialStep;
 }
 
+bool Waves::Height(float x, float z, float& height)const
+{
+	// Inverse of the grid layout in the constructor: x_j = -halfWidth + j*dx, z_i = halfDepth - i*dx.
+	const float invDx = 1.0f / mSpatialStep;
+	const float fj = (x + 0.5f*(mNumCols - 1)*mSpatialStep)*invDx;
+	const float fi = (0.5f*(mNumRows - 1)*mSpatialStep - z)*invDx;
+	if (fi < 0.0f || fj < 0.0f || fi > (float)(mNumRows - 1) || fj > (float)(mNumCols - 1))
+		return false;
+
+	const int i = std::min((int)fi, mNumRows - 2);
+	const int j = std::min((int)fj, mNumCols - 2);
+	const float t = fi - i;
+	const float s = fj - j;
+
+	const float h00 = mCurrSolution[i*mNumCols + j].y;
+	const float h01 = mCurrSolution[i*mNumCols + j + 1].y;
+	const float h10 = mCurrSolution[(i + 1)*mNumCols + j].y;
+	const float h11 = mCurrSolution[(i + 1)*mNumCols + j + 1].y;
+	height = (1.0f - t)*((1.0f - s)*h00 + s*h01) + t*((1.0f - s)*h10 + s*h11);
+	return true;
+}
+
 void Waves::Update(float dt)
 {
 	static float t = 0;
@@ -96,7 +123,7 @@ void Waves::Update(float dt)
 	if( t >= mTimeStep )
 	{
 		// Only update interior points; we use zero boundary conditions.
-		concurrency::parallel_for(1, mNumRows - 1, [this](int i)
+		ParallelFor(1, mNumRows - 1, [this](int i)
 		//for(int i = 1; i < mNumRows-1; ++i)
 		{
 			for(int j = 1; j < mNumCols-1; ++j)
@@ -130,7 +157,7 @@ void Waves::Update(float dt)
 		//
 		// Compute normals using finite difference scheme.
 		//
-		concurrency::parallel_for(1, mNumRows - 1, [this](int i)
+		ParallelFor(1, mNumRows - 1, [this](int i)
 		//for(int i = 1; i < mNumRows - 1; ++i)
 		{
 			for(int j = 1; j < mNumCols-1; ++j)
@@ -168,5 +195,11 @@ void Waves::Disturb(int i, int j, float magnitude)
 	mCurrSolution[i*mNumCols+j-1].y   += halfMag;
 	mCurrSolution[(i+1)*mNumCols+j].y += halfMag;
 	mCurrSolution[(i-1)*mNumCols+j].y += halfMag;
+
+	DisturbEvent& e = mDisturbEvents[mDisturbEventCount % MaxDisturbEvents];
+	e.X = mCurrSolution[i*mNumCols+j].x;
+	e.Z = mCurrSolution[i*mNumCols+j].z;
+	e.Magnitude = magnitude;
+	++mDisturbEventCount;
 }
 	
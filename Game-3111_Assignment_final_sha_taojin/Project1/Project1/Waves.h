@@ -9,8 +9,9 @@
 #ifndef WAVES_H
 #define WAVES_H
 
-#include <vector>
 #include <DirectXMath.h>
+#include <cstdint>
+#include "MemoryArena.h"
 
 class Waves
 {
@@ -36,9 +37,26 @@ public:
 	// Returns the unit tangent vector at the ith grid point in the local x-axis direction.
     const DirectX::XMFLOAT3& TangentX(int i)const { return mTangentX[i]; }
 
+	// Bilinearly filtered water height at local (x, z).  Returns false outside the grid.
+	bool Height(float x, float z, float& height)const;
+
 	void Update(float dt);
 	void Disturb(int i, int j, float magnitude);
 
+	// A Disturb call, at the local (x, z) of the disturbed grid point.
+	struct DisturbEvent
+	{
+		float X = 0.0f;
+		float Z = 0.0f;
+		float Magnitude = 0.0f;
+	};
+
+	// Only the most recent MaxDisturbEvents calls are kept.  A listener remembers the
+	// DisturbEventCount it has seen and reads the events after it with GetDisturbEvent.
+	static const int MaxDisturbEvents = 64;
+	std::uint64_t DisturbEventCount()const { return mDisturbEventCount; }
+	const DisturbEvent& GetDisturbEvent(std::uint64_t k)const { return mDisturbEvents[k % MaxDisturbEvents]; }
+
 private:
     int mNumRows = 0;
     int mNumCols = 0;
@@ -54,10 +72,15 @@ private:
     float mTimeStep = 0.0f;
     float mSpatialStep = 0.0f;
 
-    std::vector<DirectX::XMFLOAT3> mPrevSolution;
-    std::vector<DirectX::XMFLOAT3> mCurrSolution;
-    std::vector<DirectX::XMFLOAT3> mNormals;
-    std::vector<DirectX::XMFLOAT3> mTangentX;
+    // The four grids live in one arena, on large pages when the grid is big enough.
+    MemoryArena mArena;
+    DirectX::XMFLOAT3* mPrevSolution = nullptr;
+    DirectX::XMFLOAT3* mCurrSolution = nullptr;
+    DirectX::XMFLOAT3* mNormals = nullptr;
+    DirectX::XMFLOAT3* mTangentX = nullptr;
+
+    DisturbEvent mDisturbEvents[MaxDisturbEvents];
+    std::uint64_t mDisturbEventCount = 0;
 };
 
 #endif // WAVES_H
\ No newline at end of file
@@ -14,8 +14,33 @@
 #include "../../Common/UploadBuffer.h"
 #include "../../Common/GeometryGenerator.h"
 #include "../../Common/Camera.h"
+#include "AllocationTracker.h"
+#include "ClothSystem.h"
+#include "DemoScene.h"
+#include "FrameCapture.h"
 #include "FrameResource.h"
+#include "FrameScheduler.h"
+#include "Humanoid.h"
+#include "InitGraph.h"
+#include "MappedFile.h"
+#include "MeshImporter.h"
+#include "Meshlets.h"
+#include "MemoryArena.h"
+#include "ParticleSystem.h"
+#include "RigidBodyWorld.h"
+#include "SceneFile.h"
+#include "../../Common/RenderStats.h"
+#include "FrameUpdate.h"
 #include "Waves.h"
+#include "Heightmap.h"
+#include "LightClusters.h"
+#include "LightBaker.h"
+#include "SphericalHarmonics.h"
+#include "SoftwareRasterizer.h"
+#include "StaticBatches.h"
+#include "ParallelFor.h"
+#include <chrono>
+#include <mutex>
 
 using Microsoft::WRL::ComPtr;
 using namespace DirectX;
@@ -26,48 +51,47 @@ using namespace DirectX::PackedVector;
 
 const int gNumFrameResources = 3;
 
-// Lightweight structure stores parameters to draw a shape.  This will
-// vary from app-to-app.
-struct RenderItem
+// Phases of a frame whose heap allocations are counted separately.
+enum class FramePhase : int
 {
-	RenderItem() = default;
-
-	// World matrix of the shape that describes the object's local space
-	// relative to the world space, which defines the position, orientation,
-	// and scale of the object in the world.
-	XMFLOAT4X4 World = MathHelper::Identity4x4();
-
-	XMFLOAT4X4 TexTransform = MathHelper::Identity4x4();
-
-	// Dirty flag indicating the object data has changed and we need to update the constant buffer.
-	// Because we have an object cbuffer for each FrameResource, we have to apply the
-	// update to each FrameResource.  Thus, when we modify obect data we should set 
-	// NumFramesDirty = gNumFrameResources so that each frame resource gets the update.
-	int NumFramesDirty = gNumFrameResources;
+	Input = 0,
+	Camera,
+	Animate,
+	Physics,
+	ObjectCBs,
+	MaterialCBs,
+	LightClusters,
+	PassCB,
+	Meshlets,
+	StaticBatches,
+	Waves,
+	Particles,
+	Cloth,
+	Skinning,
+	Draw,
+	Count
+};
 
-	// Index into GPU constant buffer corresponding to the ObjectCB for this render item.
-	UINT ObjCBIndex = -1;
+const char* const gFramePhaseNames[(int)FramePhase::Count] =
+{
+	"input", "camera", "animate", "physics", "object cbs", "material cbs", "light clusters", "pass cb", "meshlets", "static batches", "waves", "particles", "cloth", "skinning", "draw"
+};
 
-	Material* Mat = nullptr;
-	MeshGeometry* Geo = nullptr;
+// Frames allowed to allocate while scratch buffers grow; after that every allocation
+// in the frame loop is reported.
+const std::uint64_t gAllocationWarmupFrames = 120;
 
-	// Primitive topology.
-	D3D12_PRIMITIVE_TOPOLOGY PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+// Milliseconds per frame the frame scheduler may spend on maintenance tasks.
+const double gMaintenanceBudgetMs = 2.0;
 
-	// DrawIndexedInstanced parameters.
-	UINT IndexCount = 0;
-	UINT StartIndexLocation = 0;
-	int BaseVertexLocation = 0;
-};
+// Occlusion rays per vertex of the startup light bake.  The frame scheduler then rebakes
+// with the full LightBakeDesc count, this many vertices per slice.
+const int gStartupBakeAoRays = 8;
+const size_t gRefineBakeSliceVertices = 256;
 
-enum class RenderLayer : int
-{
-	Opaque = 0,
-	Transparent,
-	AlphaTested,
-	AlphaTestedTreeSprites,
-	Count
-};
+// How far above or below its rest height a wave vertex may get; the water's meshlet
+// bounds are built from the flat grid and grown by this much.
+const float gWavesMeshletMargin = 2.0f;
 
 class TreeBillboardsApp : public D3DApp
 {
@@ -83,6 +107,9 @@ private:
 	virtual void OnResize()override;
 	virtual void Update(const GameTimer& gt)override;
 	virtual void Draw(const GameTimer& gt)override;
+	void DrawFrame();
+	void SetLayerPipelineState(RenderLayer layer);
+	virtual const wchar_t* CaptionOverlay()override;
 
 	virtual void OnMouseDown(WPARAM btnState, int x, int y)override;
 	virtual void OnMouseUp(WPARAM btnState, int x, int y)override;
@@ -95,6 +122,15 @@ private:
 	void UpdateMaterialCBs(const GameTimer& gt);
 	void UpdateMainPassCB(const GameTimer& gt);
 	void UpdateWaves(const GameTimer& gt);
+	void UpdateParticles(const GameTimer& gt);
+	void UpdateCloth(const GameTimer& gt);
+	void UpdateCrowd(const GameTimer& gt);
+	void UpdatePhysics(const GameTimer& gt);
+	void UpdateLightClusters(const GameTimer& gt);
+	void UpdateMeshletCulling(const GameTimer& gt);
+	void UpdateStaticBatchCulling(const GameTimer& gt);
+	void PickStaticItem(int x, int y);
+	void UploadRefinedLighting();
 
 	bool CheckCollision();
 
@@ -106,17 +142,38 @@ private:
 	void BuildWavesGeometry();
 	void BuildBoxGeometry();
 	void BuildTreeSpritesGeometry();
+	void BuildParticleSystem();
+	void BuildParticlesGeometry();
+	void BuildClothSystem();
+	void BuildClothGeometry();
+	void BuildCrowd();
+	void BuildCrowdGeometry();
+	void BuildCapsuleGeometry();
+	void BuildMeshletCulling();
+	void BuildStaticBatchGeometry();
+
+	// The build steps run as InitGraph tasks; these give them the command list and the
+	// geometry table one at a time.
+	ComPtr<ID3D12Resource> CreateDefaultBuffer(const void* initData, UINT64 byteSize, ComPtr<ID3D12Resource>& uploadBuffer);
+	void AddGeometry(std::unique_ptr<MeshGeometry> geo);
+	std::unique_ptr<MeshGeometry> CreateGeometry(const DemoMesh& mesh);
+	void BuildPhysicsWorld();
 	void BuildPSOs();
 	void BuildFrameResources();
 	void BuildMaterials();
 	void BuildRenderItems();
+	void BuildLights();
+	void BuildAmbientSH();
+	void BakeStaticLighting();
+	bool RefineStaticLighting();
+	const SoftwareTexture* GetSoftwareTexture(int srvHeapIndex);
+	void RenderSoftwareFrame(const std::wstring& filename);
+	void ToggleFrameCapture();
+	void CaptureFrame();
 	void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems);
 
 	std::array<const CD3DX12_STATIC_SAMPLER_DESC, 6> GetStaticSamplers();
 
-	float GetHillsHeight(float x, float z)const;
-	XMFLOAT3 GetHillsNormal(float x, float z)const;
-
 private:
 
 	std::vector<std::unique_ptr<FrameResource>> mFrameResources;
@@ -136,9 +193,21 @@ private:
 	std::unordered_map<std::string, ComPtr<ID3D12PipelineState>> mPSOs;
 
 	std::vector<D3D12_INPUT_ELEMENT_DESC> mStdInputLayout;
+	std::vector<D3D12_INPUT_ELEMENT_DESC> mBakedInputLayout;
 	std::vector<D3D12_INPUT_ELEMENT_DESC> mTreeSpriteInputLayout;
 
 	RenderItem* mWavesRitem = nullptr;
+	RenderItem* mLandRitem = nullptr;
+
+	// One point-list item per particle pool, drawing that pool's part of ParticleVB.
+	std::vector<RenderItem*> mParticleRitems;
+
+	// Geometry of every flag; its vertex buffer is the current frame's ClothVB.
+	MeshGeometry* mClothGeo = nullptr;
+
+	// Every crowd character's skinned mesh; its vertex buffer is the current frame's
+	// SkinnedVB.
+	MeshGeometry* mCrowdGeo = nullptr;
 
 	// List of all the render items.
 	std::vector<std::unique_ptr<RenderItem>> mAllRitems;
@@ -146,10 +215,141 @@ private:
 	// Render items divided by PSO.
 	std::vector<RenderItem*> mRitemLayer[(int)RenderLayer::Count];
 
+	// PSO of each render layer, so Draw does not look them up by name.
+	ID3D12PipelineState* mLayerPSOs[(int)RenderLayer::Count] = {};
+
+	// Signaled when the GPU reaches the fence of the frame resource Update waits for.
+	HANDLE mFenceEvent = nullptr;
+
+	// Heap allocations per frame and phase; steady-state frames should make none.
+	AllocationFrameCounter mFrameAllocations;
+	int mPhaseAllocationTags[(int)FramePhase::Count];
+	std::uint64_t mLastAllocationReport = 0;
+
 	std::unique_ptr<Waves> mWaves;
 
+	// Baked land heights/normals; replaces evaluating the hills function per query.
+	Heightmap mHeightmap;
+
+	// Splashes, snow and sparks.  They collide with the land as drawn (flat, see
+	// BuildLandGeometry) and with the waves, whose disturbances throw up the splashes.
+	ParticleSystem mParticles;
+	Heightmap mParticleGround;
+
+	// Two rows of flags along the south edge of the land, waving in the wind.
+	ClothSystem mCloth;
+
+	// Rows of characters north of the flags, walking or idling.  K switches between
+	// linear-blend and dual-quaternion skinning.
+	HumanoidAsset mHumanoid;
+	SkinnedCrowd mCrowd;
+	bool mSkinningKeyDown = false;
+
+	// Crates, balls and capsules dropped into the open east side of the maze, colliding
+	// with each other, the walls and the land.  Each body's render item follows it.
+	RigidBodyWorld mPhysics;
+	std::vector<BodyRenderItem> mBodyRitems;
+
+	// When enabled (toggle with G) the camera walks at a fixed height above the heightmap.
+	bool mGroundFollow = false;
+	bool mGroundFollowKeyDown = false;
+	float mEyeHeight = 2.0f;
 	std::vector<std::pair<XMVECTOR, XMVECTOR>> MazeWalls;
 
+	// Directional lights, ambient and the point and spot lights of the clusters.
+	DemoLighting mLighting;
+
+	// The vertices of one geometry with baked lighting, kept so the bake can be refined.
+	struct BakedGeometry : DemoBakedGeometry
+	{
+		MeshGeometry* Geo = nullptr;
+	};
+
+	// The startup bake is quick and coarse; a maintenance task rebakes it a slice at a
+	// time and UploadRefinedLighting copies each geometry's colors to the GPU when done.
+	LightBaker mLightBaker;
+	LightBakeDesc mBakeDesc;
+	std::vector<BakedGeometry> mBakedGeometries;
+	size_t mRefineGeometry = 0;
+	size_t mRefineRun = 0;
+	size_t mRefineVertex = 0;
+	std::vector<MeshGeometry*> mRefinedLightingUploads;
+
+	// Work spread over frames within gMaintenanceBudgetMs, run at the end of Update.
+	FrameScheduler mScheduler;
+
+	// Render items drawn from the meshlets of their geometry.  UpdateMeshletCulling writes
+	// the triangles of the meshlets that may be visible to the frame's MeshletIB and points
+	// the item's IndexBufferOverride there; the geometry keeps its own index buffer.  N
+	// turns the culling off, which draws the item from the geometry's buffer again.
+	struct MeshletCulledItem
+	{
+		RenderItem* Item = nullptr;
+		MeshletMesh Meshlets;
+
+		// The item's indices in its geometry's own index buffer.
+		const std::uint16_t* Indices = nullptr;
+		UINT IndexCount = 0;
+		UINT StartIndexLocation = 0;
+	};
+	std::vector<MeshletCulledItem> mMeshletItems;
+	std::vector<std::uint16_t> mMeshletIndices;
+	MeshletCullStats mMeshletStats;
+	bool mMeshletCulling = true;
+	bool mMeshletCullingKeyDown = false;
+
+	// Scene items marked static, merged by material and layer into the chunks of
+	// staticBatchGeo; each chunk is drawn by one item (see RenderItem::StaticChunk).
+	// UpdateStaticBatchCulling leaves the chunks outside the frustum out of mDrawLayer,
+	// the lists Draw uses.  B turns the culling off.  A right click names the static item
+	// under the cursor; batch sources index mStaticSceneItems.
+	struct StaticSceneItem
+	{
+		RenderItem* Item = nullptr;
+		int Layer = 0;
+		std::string Name;
+	};
+	std::vector<StaticSceneItem> mStaticSceneItems;
+	StaticBatches mStaticBatches;
+	std::vector<std::uint8_t> mStaticChunkVisible;
+	UINT mVisibleStaticChunks = 0;
+	bool mStaticBatchCulling = true;
+	bool mStaticBatchCullingKeyDown = false;
+	std::vector<RenderItem*> mDrawLayer[(int)RenderLayer::Count];
+
+	// Point and spot lights culled into a view-space cluster grid every frame (toggle with L).
+	LightClusterGrid mLightClusters;
+	bool mClusteredLights = true;
+	bool mClusteredLightsKeyDown = false;
+
+	// CPU renderer for reference frames (capture with P).  Textures are decoded on first
+	// use and indexed like the SRV heap.
+	SoftwareRasterizer mSoftwareRasterizer;
+	std::vector<std::unique_ptr<SoftwareTexture>> mSoftwareTextures;
+	bool mSoftwareCaptureKeyDown = false;
+
+	// C starts and stops writing every frame's CPU output to FrameCapture.trace, for
+	// Tools replay.
+	FrameCapture mFrameCapture;
+	bool mFrameCaptureKeyDown = false;
+
+	// M writes the memory accounting dump and the frame scheduler report to the
+	// debugger output.
+	bool mMemoryDumpKeyDown = false;
+
+	// O toggles the draw and upload counters in the window caption.
+	bool mStatsOverlay = false;
+	bool mStatsOverlayKeyDown = false;
+	wchar_t mStatsOverlayText[256] = {};
+
+	// Held by the build steps while they record on mCommandList or add a geometry.
+	std::mutex mInitLock;
+
+	// From construction, window and device creation included, to the first Present.
+	// Written to the debugger output with the init graph's report.
+	std::chrono::steady_clock::time_point mStartTime = std::chrono::steady_clock::now();
+	double mTimeToFirstFrame = 0.0;
+	std::string mInitReport;
 
 	PassConstants mMainPassCB;
 
@@ -196,12 +396,20 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
 TreeBillboardsApp::TreeBillboardsApp(HINSTANCE hInstance)
 	: D3DApp(hInstance)
 {
+	for (int i = 0; i < (int)FramePhase::Count; ++i)
+		mPhaseAllocationTags[i] = AllocationTracker::RegisterTag(gFramePhaseNames[i]);
 }
 
 TreeBillboardsApp::~TreeBillboardsApp()
 {
 	if (md3dDevice != nullptr)
 		FlushCommandQueue();
+
+	if (mFenceEvent != nullptr)
+		CloseHandle(mFenceEvent);
+
+	// High-water marks, for sizing the arenas.
+	::OutputDebugStringA(MemoryArena::ReportAll().c_str());
 }
 
 bool TreeBillboardsApp::Initialize()
@@ -216,20 +424,60 @@ bool TreeBillboardsApp::Initialize()
 	// so we have to query this information.
 	mCbvSrvDescriptorSize = md3dDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
 
-	mWaves = std::make_unique<Waves>(128, 128, 1.0f, 0.03f, 4.0f, 0.2f);
-
-	LoadTextures();
-	BuildRootSignature();
-	BuildDescriptorHeaps();
-	BuildShadersAndInputLayouts();
-	BuildLandGeometry();
-	BuildWavesGeometry();
-	BuildBoxGeometry();
-	BuildTreeSpritesGeometry();
-	BuildMaterials();
-	BuildRenderItems();
-	BuildFrameResources();
-	BuildPSOs();
+	mFenceEvent = CreateEventEx(nullptr, nullptr, false, EVENT_ALL_ACCESS);
+
+	mWaves = BuildDemoWaves();
+
+	// The build steps as a graph: texture reads, shader compiles, geometry generation
+	// and PSO creation overlap on the workers.  Recording on the command list is
+	// serialized by mInitLock, and the steps that draw from rand() stay on this thread
+	// in their old order (the CRT's rand state is per thread).
+	InitGraph graph;
+	const auto heightmap = graph.Add("Heightmap", [this]()
+	{
+		BuildDemoHeightmap(mHeightmap);
+	});
+	const auto textures = graph.Add("LoadTextures", [this]() { LoadTextures(); });
+	const auto rootSignature = graph.Add("BuildRootSignature", [this]() { BuildRootSignature(); });
+	graph.Add("BuildDescriptorHeaps", [this]() { BuildDescriptorHeaps(); }, { textures });
+	const auto shaders = graph.Add("BuildShadersAndInputLayouts", [this]() { BuildShadersAndInputLayouts(); });
+	const auto land = graph.Add("BuildLandGeometry", [this]() { BuildLandGeometry(); }, { heightmap });
+	const auto waves = graph.Add("BuildWavesGeometry", [this]() { BuildWavesGeometry(); });
+	const auto box = graph.Add("BuildBoxGeometry", [this]() { BuildBoxGeometry(); });
+	const auto treeSprites = graph.Add("BuildTreeSpritesGeometry", [this]() { BuildTreeSpritesGeometry(); },
+		{ heightmap }, InitLane::Caller);
+	const auto particles = graph.Add("BuildParticleSystem", [this]() { BuildParticleSystem(); });
+	const auto particlesGeo = graph.Add("BuildParticlesGeometry", [this]() { BuildParticlesGeometry(); }, { particles });
+	const auto cloth = graph.Add("BuildClothSystem", [this]() { BuildClothSystem(); });
+	const auto clothGeo = graph.Add("BuildClothGeometry", [this]() { BuildClothGeometry(); }, { cloth });
+	const auto crowd = graph.Add("BuildCrowd", [this]() { BuildCrowd(); }, {}, InitLane::Caller);
+	const auto crowdGeo = graph.Add("BuildCrowdGeometry", [this]() { BuildCrowdGeometry(); }, { crowd });
+	const auto capsule = graph.Add("BuildCapsuleGeometry", [this]() { BuildCapsuleGeometry(); });
+	const auto materials = graph.Add("BuildMaterials", [this]() { BuildMaterials(); });
+	const auto renderItems = graph.Add("BuildRenderItems", [this]() { BuildRenderItems(); },
+		{ land, waves, box, treeSprites, particlesGeo, clothGeo, crowdGeo, capsule, materials });
+	const auto staticBatches = graph.Add("BuildStaticBatchGeometry", [this]() { BuildStaticBatchGeometry(); },
+		{ renderItems });
+	const auto physics = graph.Add("BuildPhysicsWorld", [this]() { BuildPhysicsWorld(); },
+		{ staticBatches }, InitLane::Caller);
+	const auto lights = graph.Add("BuildLights", [this]() { BuildLights(); }, {}, InitLane::Caller);
+	const auto ambientSH = graph.Add("BuildAmbientSH", [this]() { BuildAmbientSH(); });
+	graph.Add("BakeStaticLighting", [this]() { BakeStaticLighting(); }, { staticBatches, lights, ambientSH });
+	const auto meshlets = graph.Add("BuildMeshletCulling", [this]() { BuildMeshletCulling(); }, { renderItems });
+	graph.Add("BuildFrameResources", [this]() { BuildFrameResources(); }, { physics, meshlets });
+	graph.Add("BuildPSOs", [this]() { BuildPSOs(); }, { rootSignature, shaders });
+	graph.Run();
+	mInitReport = graph.Report();
+
+	mScheduler.SetBudget(gMaintenanceBudgetMs);
+	if (!mBakedGeometries.empty())
+	{
+		FrameTaskDesc refine;
+		refine.Name = "RefineStaticLighting";
+		refine.SliceMilliseconds = 1.0;
+		refine.DeadlineMilliseconds = 20000.0;
+		mScheduler.Add(refine, [this]() { return RefineStaticLighting(); });
+	}
 
 	// Execute the initialization commands.
 	ThrowIfFailed(mCommandList->Close());
@@ -251,14 +499,21 @@ void TreeBillboardsApp::OnResize()
 	XMStoreFloat4x4(&mProj, P);*/
 
 	mCamera.SetLens(0.25f * MathHelper::Pi, AspectRatio(), 1.0f, 1000.0f);
+	mLightClusters.SetProjection(0.25f * MathHelper::Pi, AspectRatio(), 1.0f, 1000.0f);
 
 	mCamera.SetPosition(-55.0f, 2.5f, -40.0f);
 }
 
 void TreeBillboardsApp::Update(const GameTimer& gt)
 {
-	OnKeyboardInput(gt);
-	UpdateCamera(gt);
+	{
+		AllocationScope scope(mPhaseAllocationTags[(int)FramePhase::Input]);
+		OnKeyboardInput(gt);
+	}
+	{
+		AllocationScope scope(mPhaseAllocationTags[(int)FramePhase::Camera]);
+		UpdateCamera(gt);
+	}
 
 	// Cycle through the circular frame resource array.
 	mCurrFrameResourceIndex = (mCurrFrameResourceIndex + 1) % gNumFrameResources;
@@ -268,20 +523,106 @@ void TreeBillboardsApp::Update(const GameTimer& gt)
 	// If not, wait until the GPU has completed commands up to this fence point.
 	if (mCurrFrameResource->Fence != 0 && mFence->GetCompletedValue() < mCurrFrameResource->Fence)
 	{
-		HANDLE eventHandle = CreateEventEx(nullptr, nullptr, false, EVENT_ALL_ACCESS);
-		ThrowIfFailed(mFence->SetEventOnCompletion(mCurrFrameResource->Fence, eventHandle));
-		WaitForSingleObject(eventHandle, INFINITE);
-		CloseHandle(eventHandle);
+		ThrowIfFailed(mFence->SetEventOnCompletion(mCurrFrameResource->Fence, mFenceEvent));
+		WaitForSingleObject(mFenceEvent, INFINITE);
 	}
 
-	AnimateMaterials(gt);
-	UpdateObjectCBs(gt);
-	UpdateMaterialCBs(gt);
-	UpdateMainPassCB(gt);
-	UpdateWaves(gt);
+	{
+		AllocationScope scope(mPhaseAllocationTags[(int)FramePhase::Animate]);
+		AnimateMaterials(gt);
+	}
+	{
+		AllocationScope scope(mPhaseAllocationTags[(int)FramePhase::Physics]);
+		UpdatePhysics(gt);
+	}
+	{
+		AllocationScope scope(mPhaseAllocationTags[(int)FramePhase::ObjectCBs]);
+		UpdateObjectCBs(gt);
+	}
+	{
+		AllocationScope scope(mPhaseAllocationTags[(int)FramePhase::MaterialCBs]);
+		UpdateMaterialCBs(gt);
+	}
+	{
+		AllocationScope scope(mPhaseAllocationTags[(int)FramePhase::LightClusters]);
+		UpdateLightClusters(gt);
+	}
+	{
+		AllocationScope scope(mPhaseAllocationTags[(int)FramePhase::PassCB]);
+		UpdateMainPassCB(gt);
+	}
+	{
+		AllocationScope scope(mPhaseAllocationTags[(int)FramePhase::Meshlets]);
+		UpdateMeshletCulling(gt);
+	}
+	{
+		AllocationScope scope(mPhaseAllocationTags[(int)FramePhase::StaticBatches]);
+		UpdateStaticBatchCulling(gt);
+	}
+	{
+		AllocationScope scope(mPhaseAllocationTags[(int)FramePhase::Waves]);
+		UpdateWaves(gt);
+	}
+	{
+		AllocationScope scope(mPhaseAllocationTags[(int)FramePhase::Particles]);
+		UpdateParticles(gt);
+	}
+	{
+		AllocationScope scope(mPhaseAllocationTags[(int)FramePhase::Cloth]);
+		UpdateCloth(gt);
+	}
+	{
+		AllocationScope scope(mPhaseAllocationTags[(int)FramePhase::Skinning]);
+		UpdateCrowd(gt);
+	}
+	{
+		// Maintenance slices may allocate (the light baker does); the budget bounds
+		// them instead.
+		AllocationScope scope(AllocationTracker::IgnoredTag);
+		mScheduler.RunFrame();
+	}
 }
 
 void TreeBillboardsApp::Draw(const GameTimer& gt)
+{
+	{
+		AllocationScope scope(mPhaseAllocationTags[(int)FramePhase::Draw]);
+		DrawFrame();
+	}
+
+	if (mTimeToFirstFrame == 0.0)
+	{
+		AllocationScope scope(AllocationTracker::IgnoredTag);
+		mTimeToFirstFrame = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - mStartTime).count();
+
+		char line[64];
+		sprintf_s(line, "Time to first frame: %.1f ms\n", mTimeToFirstFrame);
+		::OutputDebugStringA((mInitReport + line).c_str());
+	}
+
+	if (mFrameCapture.IsCapturing())
+	{
+		AllocationScope scope(AllocationTracker::IgnoredTag);
+		CaptureFrame();
+	}
+
+	// The frame ends here.  The command list holds copies of everything it recorded, so
+	// the transient data in the frame arenas can go.
+	ResetFrameArenas();
+	RenderStats::EndFrame();
+
+	// Report steady-state frames that allocated, at most every couple of seconds.
+	mFrameAllocations.EndFrame();
+	if (!mFrameAllocations.CheckZeroAllocations(gAllocationWarmupFrames) &&
+		mFrameAllocations.FrameIndex() - mLastAllocationReport >= 120)
+	{
+		AllocationScope scope(AllocationTracker::IgnoredTag);
+		::OutputDebugStringA(mFrameAllocations.Report().c_str());
+		mLastAllocationReport = mFrameAllocations.FrameIndex();
+	}
+}
+
+void TreeBillboardsApp::DrawFrame()
 {
 	auto cmdListAlloc = mCurrFrameResource->CmdListAlloc;
 
@@ -291,7 +632,7 @@ void TreeBillboardsApp::Draw(const GameTimer& gt)
 
 	// A command list can be reset after it has been added to the command queue via ExecuteCommandList.
 	// Reusing the command list reuses memory.
-	ThrowIfFailed(mCommandList->Reset(cmdListAlloc.Get(), mPSOs["opaque"].Get()));
+	ThrowIfFailed(mCommandList->Reset(cmdListAlloc.Get(), mLayerPSOs[(int)RenderLayer::Opaque]));
 
 	mCommandList->RSSetViewports(1, &mScreenViewport);
 	mCommandList->RSSetScissorRects(1, &mScissorRect);
@@ -312,19 +653,36 @@ void TreeBillboardsApp::Draw(const GameTimer& gt)
 
 	mCommandList->SetGraphicsRootSignature(mRootSignature.Get());
 
+	UploadRefinedLighting();
+
 	auto passCB = mCurrFrameResource->PassCB->Resource();
 	mCommandList->SetGraphicsRootConstantBufferView(2, passCB->GetGPUVirtualAddress());
 
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Opaque]);
+	mCommandList->SetGraphicsRootShaderResourceView(4, mCurrFrameResource->ClusterLights->Resource()->GetGPUVirtualAddress());
+	mCommandList->SetGraphicsRootShaderResourceView(5, mCurrFrameResource->ClusterRanges->Resource()->GetGPUVirtualAddress());
+	mCommandList->SetGraphicsRootShaderResourceView(6, mCurrFrameResource->ClusterLightIndices->Resource()->GetGPUVirtualAddress());
+
+	// The Reset above bound the opaque PSO.
+	RenderStats::AddStateChange(StateChange::PipelineState);
+	RenderStats::AddStateChange(StateChange::RootCbv);
+	RenderStats::AddStateChange(StateChange::RootSrv, 3);
+
+	DrawRenderItems(mCommandList.Get(), mDrawLayer[(int)RenderLayer::Opaque]);
 
-	mCommandList->SetPipelineState(mPSOs["alphaTested"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::AlphaTested]);
+	SetLayerPipelineState(RenderLayer::OpaqueBaked);
+	DrawRenderItems(mCommandList.Get(), mDrawLayer[(int)RenderLayer::OpaqueBaked]);
 
-	mCommandList->SetPipelineState(mPSOs["treeSprites"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::AlphaTestedTreeSprites]);
+	SetLayerPipelineState(RenderLayer::AlphaTested);
+	DrawRenderItems(mCommandList.Get(), mDrawLayer[(int)RenderLayer::AlphaTested]);
 
-	mCommandList->SetPipelineState(mPSOs["transparent"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Transparent]);
+	SetLayerPipelineState(RenderLayer::AlphaTestedTreeSprites);
+	DrawRenderItems(mCommandList.Get(), mDrawLayer[(int)RenderLayer::AlphaTestedTreeSprites]);
+
+	SetLayerPipelineState(RenderLayer::Particles);
+	DrawRenderItems(mCommandList.Get(), mDrawLayer[(int)RenderLayer::Particles]);
+
+	SetLayerPipelineState(RenderLayer::Transparent);
+	DrawRenderItems(mCommandList.Get(), mDrawLayer[(int)RenderLayer::Transparent]);
 
 
 
@@ -354,11 +712,36 @@ void TreeBillboardsApp::Draw(const GameTimer& gt)
 
 }
 
+void TreeBillboardsApp::SetLayerPipelineState(RenderLayer layer)
+{
+	mCommandList->SetPipelineState(mLayerPSOs[(int)layer]);
+	RenderStats::AddStateChange(StateChange::PipelineState);
+}
+
+const wchar_t* TreeBillboardsApp::CaptionOverlay()
+{
+	if (!mStatsOverlay)
+		return nullptr;
+
+	const RenderStatsFrame& stats = RenderStats::LastFrame();
+	const FrameSchedulerStats& maintenance = mScheduler.Stats();
+	swprintf_s(mStatsOverlayText, L"   draws: %llu   tris: %llu   state changes: %llu   upload KB: %.1f   first frame: %.0f ms   maintenance: %.2f ms (%llu over)   meshlets: %u/%u   static chunks: %u/%u",
+		(unsigned long long)stats.Draws, (unsigned long long)stats.Triangles,
+		(unsigned long long)stats.TotalStateChanges(), stats.TotalUploadBytes() / 1024.0, mTimeToFirstFrame,
+		maintenance.LastMilliseconds, (unsigned long long)maintenance.OverrunFrames,
+		mMeshletStats.Meshlets - mMeshletStats.FrustumCulled - mMeshletStats.ConeCulled, mMeshletStats.Meshlets,
+		mVisibleStaticChunks, (UINT)mStaticBatches.Chunks.size());
+	return mStatsOverlayText;
+}
+
 void TreeBillboardsApp::OnMouseDown(WPARAM btnState, int x, int y)
 {
 	mLastMousePos.x = x;
 	mLastMousePos.y = y;
 
+	if ((btnState & MK_RBUTTON) != 0)
+		PickStaticItem(x, y);
+
 	SetCapture(mhMainWnd);
 }
 
@@ -433,6 +816,85 @@ void TreeBillboardsApp::OnKeyboardInput(const GameTimer& gt)
 		mCamera.Strafe(10.0f * dt);
 	}
 
+	// Toggle ground follow on the key press, not while the key is held.
+	bool groundFollowKeyDown = (GetAsyncKeyState('G') & 0x8000) != 0;
+	if (groundFollowKeyDown && !mGroundFollowKeyDown)
+	{
+		mGroundFollow = !mGroundFollow;
+	}
+	mGroundFollowKeyDown = groundFollowKeyDown;
+
+	bool clusteredLightsKeyDown = (GetAsyncKeyState('L') & 0x8000) != 0;
+	if (clusteredLightsKeyDown && !mClusteredLightsKeyDown)
+	{
+		mClusteredLights = !mClusteredLights;
+	}
+	mClusteredLightsKeyDown = clusteredLightsKeyDown;
+
+	bool softwareCaptureKeyDown = (GetAsyncKeyState('P') & 0x8000) != 0;
+	if (softwareCaptureKeyDown && !mSoftwareCaptureKeyDown)
+	{
+		AllocationScope scope(AllocationTracker::IgnoredTag);
+		RenderSoftwareFrame(L"SoftwareFrame.png");
+
+		// The counters of the frame the capture reproduces.
+		if (!RenderStats::Write(RenderStats::LastFrame(), L"SoftwareFrame.stats.txt"))
+			::OutputDebugStringA("Could not write the frame stats.\n");
+	}
+	mSoftwareCaptureKeyDown = softwareCaptureKeyDown;
+
+	bool frameCaptureKeyDown = (GetAsyncKeyState('C') & 0x8000) != 0;
+	if (frameCaptureKeyDown && !mFrameCaptureKeyDown)
+	{
+		AllocationScope scope(AllocationTracker::IgnoredTag);
+		ToggleFrameCapture();
+	}
+	mFrameCaptureKeyDown = frameCaptureKeyDown;
+
+	bool memoryDumpKeyDown = (GetAsyncKeyState('M') & 0x8000) != 0;
+	if (memoryDumpKeyDown && !mMemoryDumpKeyDown)
+	{
+		AllocationScope scope(AllocationTracker::IgnoredTag);
+		::OutputDebugStringA(MemoryAccounting::Dump().c_str());
+		::OutputDebugStringA(mScheduler.Report().c_str());
+	}
+	mMemoryDumpKeyDown = memoryDumpKeyDown;
+
+	bool statsOverlayKeyDown = (GetAsyncKeyState('O') & 0x8000) != 0;
+	if (statsOverlayKeyDown && !mStatsOverlayKeyDown)
+	{
+		mStatsOverlay = !mStatsOverlay;
+	}
+	mStatsOverlayKeyDown = statsOverlayKeyDown;
+
+	bool skinningKeyDown = (GetAsyncKeyState('K') & 0x8000) != 0;
+	if (skinningKeyDown && !mSkinningKeyDown)
+	{
+		mCrowd.SetMethod(mCrowd.Method() == SkinningMethod::LinearBlend ?
+			SkinningMethod::DualQuaternion : SkinningMethod::LinearBlend);
+	}
+	mSkinningKeyDown = skinningKeyDown;
+
+	bool meshletCullingKeyDown = (GetAsyncKeyState('N') & 0x8000) != 0;
+	if (meshletCullingKeyDown && !mMeshletCullingKeyDown)
+	{
+		mMeshletCulling = !mMeshletCulling;
+	}
+	mMeshletCullingKeyDown = meshletCullingKeyDown;
+
+	bool staticBatchCullingKeyDown = (GetAsyncKeyState('B') & 0x8000) != 0;
+	if (staticBatchCullingKeyDown && !mStaticBatchCullingKeyDown)
+	{
+		mStaticBatchCulling = !mStaticBatchCulling;
+	}
+	mStaticBatchCullingKeyDown = staticBatchCullingKeyDown;
+
+	if (mGroundFollow)
+	{
+		XMFLOAT3 p = mCamera.GetPosition3f();
+		mCamera.SetPosition(p.x, mHeightmap.Height(p.x, p.z) + mEyeHeight, p.z);
+	}
+
 	if (CheckCollision())
 	{
 		mCamera.SetPosition(XMVectorGetX(camera_pos), XMVectorGetY(camera_pos), XMVectorGetZ(camera_pos));
@@ -482,7 +944,7 @@ void TreeBillboardsApp::UpdateCamera(const GameTimer& gt)
 void TreeBillboardsApp::AnimateMaterials(const GameTimer& gt)
 {
 	// Scroll the water material texture coordinates.
-	auto waterMat = mMaterials["water"].get();
+	auto waterMat = mWavesRitem->Mat;
 
 	float& tu = waterMat->MatTransform(3, 0);
 	float& tv = waterMat->MatTransform(3, 1);
@@ -505,87 +967,146 @@ void TreeBillboardsApp::AnimateMaterials(const GameTimer& gt)
 
 void TreeBillboardsApp::UpdateObjectCBs(const GameTimer& gt)
 {
-	auto currObjectCB = mCurrFrameResource->ObjectCB.get();
-	for (auto& e : mAllRitems)
-	{
-		// Only update the cbuffer data if the constants have changed.  
-		// This needs to be tracked per frame resource.
-		if (e->NumFramesDirty > 0)
-		{
-			XMMATRIX world = XMLoadFloat4x4(&e->World);
-			XMMATRIX texTransform = XMLoadFloat4x4(&e->TexTransform);
+	UpdateObjectConstants(mAllRitems, *mCurrFrameResource->ObjectCB);
+}
+
+void TreeBillboardsApp::UpdateMaterialCBs(const GameTimer& gt)
+{
+	UpdateMaterialConstants(mMaterials, *mCurrFrameResource->MaterialCB);
+}
 
-			ObjectConstants objConstants;
-			XMStoreFloat4x4(&objConstants.World, XMMatrixTranspose(world));
-			XMStoreFloat4x4(&objConstants.TexTransform, XMMatrixTranspose(texTransform));
+void TreeBillboardsApp::UpdateMainPassCB(const GameTimer& gt)
+{
+	SetDemoPassConstants(mCamera, mClientWidth, mClientHeight, mLighting, mLightClusters, mMainPassCB);
+	mMainPassCB.TotalTime = gt.TotalTime();
+	mMainPassCB.DeltaTime = gt.DeltaTime();
 
-			currObjectCB->CopyData(e->ObjCBIndex, objConstants);
+	auto currPassCB = mCurrFrameResource->PassCB.get();
+	currPassCB->CopyData(0, mMainPassCB);
+	currPassCB->CountUploads(1, 1);
+}
 
-			// Next FrameResource need to be updated too.
-			e->NumFramesDirty--;
-		}
+void TreeBillboardsApp::UpdateLightClusters(const GameTimer& gt)
+{
+	if (mClusteredLights)
+	{
+		mLightClusters.Build(mCamera.GetView(),
+			mLighting.PointLights.data(), (UINT)mLighting.PointLights.size(),
+			mLighting.SpotLights.data(), (UINT)mLighting.SpotLights.size());
+	}
+	else
+	{
+		mLightClusters.Build(mCamera.GetView(), nullptr, 0, nullptr, 0);
+	}
+
+	const auto& lights = mLightClusters.Lights();
+	const auto& ranges = mLightClusters.ClusterRanges();
+	const auto& indices = mLightClusters.LightIndices();
+
+	if (!lights.empty())
+	{
+		mCurrFrameResource->ClusterLights->CopyData(0, lights.data(), (int)lights.size());
+		mCurrFrameResource->ClusterLights->CountUploads(1, (int)lights.size());
+	}
+	mCurrFrameResource->ClusterRanges->CopyData(0, ranges.data(), (int)ranges.size());
+	mCurrFrameResource->ClusterRanges->CountUploads(1, (int)ranges.size());
+	if (!indices.empty())
+	{
+		mCurrFrameResource->ClusterLightIndices->CopyData(0, indices.data(), (int)indices.size());
+		mCurrFrameResource->ClusterLightIndices->CountUploads(1, (int)indices.size());
 	}
 }
 
-void TreeBillboardsApp::UpdateMaterialCBs(const GameTimer& gt)
+void TreeBillboardsApp::UpdateMeshletCulling(const GameTimer& gt)
 {
-	auto currMaterialCB = mCurrFrameResource->MaterialCB.get();
-	for (auto& e : mMaterials)
+	mMeshletStats = MeshletCullStats();
+	if (mMeshletItems.empty())
+		return;
+
+	auto meshletIB = mCurrFrameResource->MeshletIB.get();
+	D3D12_INDEX_BUFFER_VIEW meshletIBView;
+	meshletIBView.BufferLocation = meshletIB->Resource()->GetGPUVirtualAddress();
+	meshletIBView.Format = DXGI_FORMAT_R16_UINT;
+	meshletIBView.SizeInBytes = (UINT)meshletIB->ByteSize();
+	const XMMATRIX viewProj = XMMatrixMultiply(mCamera.GetView(), mCamera.GetProj());
+	const XMVECTOR eye = mCamera.GetPosition();
+
+	UINT offset = 0;
+	int copies = 0;
+	int copiedIndices = 0;
+	for (MeshletCulledItem& culled : mMeshletItems)
 	{
-		// Only update the cbuffer data if the constants have changed.  If the cbuffer
-		// data changes, it needs to be updated for each FrameResource.
-		Material* mat = e.second.get();
-		if (mat->NumFramesDirty > 0)
+		RenderItem* ri = culled.Item;
+		if (mMeshletCulling)
+		{
+			const MeshletCullView view = MakeMeshletCullView(XMLoadFloat4x4(&ri->World), viewProj, eye);
+			const UINT count = CullMeshlets(culled.Meshlets, view, mMeshletIndices.data(), &mMeshletStats);
+			meshletIB->CopyData((int)offset, mMeshletIndices.data(), (int)count);
+			++copies;
+			copiedIndices += (int)count;
+
+			ri->IndexBufferOverride = meshletIBView;
+			ri->IndexCount = count;
+			ri->StartIndexLocation = offset;
+		}
+		else
 		{
-			XMMATRIX matTransform = XMLoadFloat4x4(&mat->MatTransform);
+			// Every triangle, from the geometry's own index buffer.
+			ri->IndexBufferOverride = D3D12_INDEX_BUFFER_VIEW();
+			ri->IndexCount = culled.IndexCount;
+			ri->StartIndexLocation = culled.StartIndexLocation;
+		}
+		offset += culled.IndexCount;
+	}
+	meshletIB->CountUploads(copies, copiedIndices);
+}
 
-			MaterialConstants matConstants;
-			matConstants.DiffuseAlbedo = mat->DiffuseAlbedo;
-			matConstants.FresnelR0 = mat->FresnelR0;
-			matConstants.Roughness = mat->Roughness;
-			XMStoreFloat4x4(&matConstants.MatTransform, XMMatrixTranspose(matTransform));
+void TreeBillboardsApp::UpdateStaticBatchCulling(const GameTimer& gt)
+{
+	// The chunks are in world space, so one view serves them all.
+	const MeshletCullView view = MakeMeshletCullView(XMMatrixIdentity(),
+		XMMatrixMultiply(mCamera.GetView(), mCamera.GetProj()), mCamera.GetPosition());
 
-			currMaterialCB->CopyData(mat->MatCBIndex, matConstants);
+	mVisibleStaticChunks = 0;
+	for (size_t c = 0; c < mStaticBatches.Chunks.size(); ++c)
+	{
+		const bool visible = !mStaticBatchCulling || StaticChunkVisible(mStaticBatches.Chunks[c], view.Planes);
+		mStaticChunkVisible[c] = visible ? 1 : 0;
+		mVisibleStaticChunks += visible ? 1 : 0;
+	}
 
-			// Next FrameResource need to be updated too.
-			mat->NumFramesDirty--;
+	// The lists keep their capacity, so this only allocates while they grow.
+	for (int layer = 0; layer < (int)RenderLayer::Count; ++layer)
+	{
+		mDrawLayer[layer].clear();
+		for (RenderItem* ri : mRitemLayer[layer])
+		{
+			if (ri->StaticChunk < 0 || mStaticChunkVisible[ri->StaticChunk])
+				mDrawLayer[layer].push_back(ri);
 		}
 	}
 }
 
-void TreeBillboardsApp::UpdateMainPassCB(const GameTimer& gt)
+void TreeBillboardsApp::PickStaticItem(int x, int y)
 {
-	XMMATRIX view = mCamera.GetView();
-	XMMATRIX proj = mCamera.GetProj();
-
-	XMMATRIX viewProj = XMMatrixMultiply(view, proj);
-	XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(view), view);
-	XMMATRIX invProj = XMMatrixInverse(&XMMatrixDeterminant(proj), proj);
-	XMMATRIX invViewProj = XMMatrixInverse(&XMMatrixDeterminant(viewProj), viewProj);
-
-	XMStoreFloat4x4(&mMainPassCB.View, XMMatrixTranspose(view));
-	XMStoreFloat4x4(&mMainPassCB.InvView, XMMatrixTranspose(invView));
-	XMStoreFloat4x4(&mMainPassCB.Proj, XMMatrixTranspose(proj));
-	XMStoreFloat4x4(&mMainPassCB.InvProj, XMMatrixTranspose(invProj));
-	XMStoreFloat4x4(&mMainPassCB.ViewProj, XMMatrixTranspose(viewProj));
-	XMStoreFloat4x4(&mMainPassCB.InvViewProj, XMMatrixTranspose(invViewProj));
-	mMainPassCB.EyePosW = mCamera.GetPosition3f();
-	mMainPassCB.RenderTargetSize = XMFLOAT2((float)mClientWidth, (float)mClientHeight);
-	mMainPassCB.InvRenderTargetSize = XMFLOAT2(1.0f / mClientWidth, 1.0f / mClientHeight);
-	mMainPassCB.NearZ = 1.0f;
-	mMainPassCB.FarZ = 1000.0f;
-	mMainPassCB.TotalTime = gt.TotalTime();
-	mMainPassCB.DeltaTime = gt.DeltaTime();
-	mMainPassCB.AmbientLight = { 0.25f, 0.25f, 0.35f, 1.0f };
-	mMainPassCB.Lights[0].Direction = { 0.57735f, -0.57735f, 0.57735f };
-	mMainPassCB.Lights[0].Strength = { 0.6f, 0.6f, 0.6f };
-	mMainPassCB.Lights[1].Direction = { -0.57735f, -0.57735f, 0.57735f };
-	mMainPassCB.Lights[1].Strength = { 0.3f, 0.3f, 0.3f };
-	mMainPassCB.Lights[2].Direction = { 0.0f, -0.707f, -0.707f };
-	mMainPassCB.Lights[2].Strength = { 0.15f, 0.15f, 0.15f };
-
-	auto currPassCB = mCurrFrameResource->PassCB.get();
-	currPassCB->CopyData(0, mMainPassCB);
+	// The ray through the pixel in view space, then in world space.
+	const XMFLOAT4X4 proj = mCamera.GetProj4x4f();
+	const float vx = (+2.0f * x / mClientWidth - 1.0f) / proj(0, 0);
+	const float vy = (-2.0f * y / mClientHeight + 1.0f) / proj(1, 1);
+
+	const XMMATRIX view = mCamera.GetView();
+	XMVECTOR det = XMMatrixDeterminant(view);
+	const XMMATRIX invView = XMMatrixInverse(&det, view);
+	const XMVECTOR origin = XMVector3TransformCoord(XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f), invView);
+	const XMVECTOR direction = XMVector3Normalize(XMVector3TransformNormal(XMVectorSet(vx, vy, 1.0f, 0.0f), invView));
+
+	StaticBatchHit hit;
+	if (!PickStaticBatches(mStaticBatches, origin, direction, hit))
+		return;
+
+	char line[128];
+	sprintf_s(line, "Picked %s, %.1f units away\n", mStaticSceneItems[hit.Source].Name.c_str(), hit.Distance);
+	::OutputDebugStringA(line);
 }
 
 void TreeBillboardsApp::UpdateWaves(const GameTimer& gt)
@@ -609,109 +1130,160 @@ void TreeBillboardsApp::UpdateWaves(const GameTimer& gt)
 
 	// Update the wave vertex buffer with the new solution.
 	auto currWavesVB = mCurrFrameResource->WavesVB.get();
-	for (int i = 0; i < mWaves->VertexCount(); ++i)
+	UpdateWavesVertices(*mWaves, *currWavesVB);
+
+	// Set the dynamic VB of the wave renderitem to the current frame VB.
+	mWavesRitem->Geo->VertexBufferGPU = currWavesVB->Resource();
+}
+
+void TreeBillboardsApp::UpdateParticles(const GameTimer& gt)
+{
+	ParticleColliders colliders;
+	colliders.Terrain = &mParticleGround;
+	colliders.Water = mWaves.get();
+	mParticles.Update(gt.DeltaTime(), colliders);
+
+	auto currParticleVB = mCurrFrameResource->ParticleVB.get();
+	UpdateParticleVertices(mParticles, *currParticleVB);
+
+	// The pools are packed back to back, so each item draws its pool's live range.
+	mParticleRitems[0]->Geo->VertexBufferGPU = currParticleVB->Resource();
+	for (int pool = 0; pool < mParticles.PoolCount(); ++pool)
 	{
-		Vertex v;
+		mParticleRitems[pool]->BaseVertexLocation = mParticles.StreamOffset(pool);
+		mParticleRitems[pool]->IndexCount = (UINT)mParticles.LiveCount(pool);
+	}
+}
 
-		v.Pos = mWaves->Position(i);
-		v.Normal = mWaves->Normal(i);
+void TreeBillboardsApp::UpdateCloth(const GameTimer& gt)
+{
+	mCloth.Update(gt.DeltaTime());
+
+	// The vertices go straight into the current frame's mapped VB.
+	auto currClothVB = mCurrFrameResource->ClothVB.get();
+	UpdateClothVertices(mCloth, *currClothVB);
+
+	mClothGeo->VertexBufferGPU = currClothVB->Resource();
+}
 
-		// Derive tex-coords from position by 
-		// mapping [-w/2,w/2] --> [0,1]
-		v.TexC.x = 0.5f + v.Pos.x / mWaves->Width();
-		v.TexC.y = 0.5f - v.Pos.z / mWaves->Depth();
+void TreeBillboardsApp::UpdateCrowd(const GameTimer& gt)
+{
+	const float dt = gt.DeltaTime();
 
-		currWavesVB->CopyData(i, v);
+	// Walkers move along their facing (+z of their world matrix) and wrap around at the
+	// edges of the land.
+	for (int c = 0; c < mCrowd.CharacterCount(); ++c)
+	{
+		CrowdCharacter& character = mCrowd.Character(c);
+		if (character.Clip != HumanoidWalk)
+			continue;
+
+		const float step = mHumanoid.WalkSpeed*character.Speed*dt;
+		character.World._41 += character.World._31*step;
+		character.World._43 += character.World._33*step;
+		if (character.World._41 > 46.0f)
+			character.World._41 -= 92.0f;
+		else if (character.World._41 < -46.0f)
+			character.World._41 += 92.0f;
 	}
 
-	// Set the dynamic VB of the wave renderitem to the current frame VB.
-	mWavesRitem->Geo->VertexBufferGPU = currWavesVB->Resource();
+	mCrowd.Animate(dt);
+
+	// The vertices go straight into the current frame's mapped VB.
+	auto currSkinnedVB = mCurrFrameResource->SkinnedVB.get();
+	UpdateSkinnedVertices(mCrowd, *currSkinnedVB);
+
+	mCrowdGeo->VertexBufferGPU = currSkinnedVB->Resource();
+}
+
+void TreeBillboardsApp::UpdatePhysics(const GameTimer& gt)
+{
+	mPhysics.Update(gt.DeltaTime());
+
+	// Bodies that moved get new world matrices, picked up by UpdateObjectCBs.
+	UpdateBodyRenderItems(mPhysics, mBodyRitems);
+}
+
+ComPtr<ID3D12Resource> TreeBillboardsApp::CreateDefaultBuffer(const void* initData, UINT64 byteSize,
+	ComPtr<ID3D12Resource>& uploadBuffer)
+{
+	std::lock_guard<std::mutex> lock(mInitLock);
+	return d3dUtil::CreateDefaultBuffer(md3dDevice.Get(), mCommandList.Get(), initData, byteSize, uploadBuffer);
+}
+
+void TreeBillboardsApp::AddGeometry(std::unique_ptr<MeshGeometry> geo)
+{
+	std::lock_guard<std::mutex> lock(mInitLock);
+	const std::string name = geo->Name;
+	mGeometries[name] = std::move(geo);
+}
+
+std::unique_ptr<MeshGeometry> TreeBillboardsApp::CreateGeometry(const DemoMesh& mesh)
+{
+	const UINT vbByteSize = mesh.VertexCount * mesh.VertexByteStride;
+	const UINT ibByteSize = (UINT)mesh.Indices.size();
+
+	auto geo = std::make_unique<MeshGeometry>();
+	geo->Name = mesh.Name;
+
+	// Without vertices the vertex buffer is set dynamically.
+	if (!mesh.Vertices.empty())
+	{
+		ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
+		CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), mesh.Vertices.data(), vbByteSize);
+
+		geo->VertexBufferGPU = CreateDefaultBuffer(mesh.Vertices.data(), vbByteSize, geo->VertexBufferUploader);
+	}
+
+	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
+	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), mesh.Indices.data(), ibByteSize);
+
+	geo->IndexBufferGPU = CreateDefaultBuffer(mesh.Indices.data(), ibByteSize, geo->IndexBufferUploader);
+
+	geo->VertexByteStride = mesh.VertexByteStride;
+	geo->VertexBufferByteSize = vbByteSize;
+	geo->IndexFormat = mesh.Index32 ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT;
+	geo->IndexBufferByteSize = ibByteSize;
+
+	for (const auto& arg : mesh.DrawArgs)
+	{
+		SubmeshGeometry submesh;
+		submesh.IndexCount = arg.second.IndexCount;
+		submesh.StartIndexLocation = arg.second.StartIndexLocation;
+		submesh.BaseVertexLocation = arg.second.BaseVertexLocation;
+		submesh.Bounds = arg.second.Bounds;
+		geo->DrawArgs[arg.first] = submesh;
+	}
+
+	return geo;
 }
 
 void TreeBillboardsApp::LoadTextures()
 {
-	//A2
-	auto grassTex = std::make_unique<Texture>();
-	grassTex->Name = "grassTex";
-	grassTex->Filename = L"../../Textures/grass.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), grassTex->Filename.c_str(),
-		grassTex->Resource, grassTex->UploadHeap));
-
-	auto waterTex = std::make_unique<Texture>();
-	waterTex->Name = "waterTex";
-	waterTex->Filename = L"../../Textures/water1.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), waterTex->Filename.c_str(),
-		waterTex->Resource, waterTex->UploadHeap));
-
-	auto fenceTex = std::make_unique<Texture>();
-	fenceTex->Name = "fenceTex";
-	fenceTex->Filename = L"../../Textures/WireFence.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), fenceTex->Filename.c_str(),
-		fenceTex->Resource, fenceTex->UploadHeap));
-
-
-	auto iceTex = std::make_unique<Texture>();
-	iceTex->Name = "iceTex";
-	iceTex->Filename = L"../../Textures/ice.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), iceTex->Filename.c_str(),
-		iceTex->Resource, iceTex->UploadHeap));
-
-	auto bricksTex = std::make_unique<Texture>();
-	bricksTex->Name = "bricksTex";
-	bricksTex->Filename = L"../../Textures/bricks.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), bricksTex->Filename.c_str(),
-		bricksTex->Resource, bricksTex->UploadHeap));
-
-	auto testcolorTex = std::make_unique<Texture>();
-	testcolorTex->Name = "testcolorTex";
-	testcolorTex->Filename = L"../../Textures/testcolor.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), testcolorTex->Filename.c_str(),
-		testcolorTex->Resource, testcolorTex->UploadHeap));
-
-	auto doorTex = std::make_unique<Texture>();
-	doorTex->Name = "doorTex";
-	doorTex->Filename = L"../../Textures/door.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), doorTex->Filename.c_str(),
-		doorTex->Resource, doorTex->UploadHeap));
-
-	auto wallsTex = std::make_unique<Texture>();
-	wallsTex->Name = "wallsTex";
-	wallsTex->Filename = L"../../Textures/walls.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), wallsTex->Filename.c_str(),
-		wallsTex->Resource, wallsTex->UploadHeap));
-
-	auto checkboardTex = std::make_unique<Texture>();
-	checkboardTex->Name = "checkboardTex";
-	checkboardTex->Filename = L"../../Textures/checkboard.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), checkboardTex->Filename.c_str(),
-		checkboardTex->Resource, checkboardTex->UploadHeap));
-
-	auto treeArrayTex = std::make_unique<Texture>();
-	treeArrayTex->Name = "treeArrayTex";
-	treeArrayTex->Filename = L"../../Textures/treeArray.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), treeArrayTex->Filename.c_str(),
-		treeArrayTex->Resource, treeArrayTex->UploadHeap));
-
-	mTextures[grassTex->Name] = std::move(grassTex);
-	mTextures[waterTex->Name] = std::move(waterTex);
-	mTextures[fenceTex->Name] = std::move(fenceTex);
-	mTextures[iceTex->Name] = std::move(iceTex);
-	mTextures[bricksTex->Name] = std::move(bricksTex);
-	mTextures[testcolorTex->Name] = std::move(testcolorTex);
-	mTextures[doorTex->Name] = std::move(doorTex);
-	mTextures[wallsTex->Name] = std::move(wallsTex);
-	mTextures[checkboardTex->Name] = std::move(checkboardTex);
-	mTextures[treeArrayTex->Name] = std::move(treeArrayTex);
+	// The files are read in parallel; creating a texture records its upload, so that
+	// part takes the command list in turn.
+	std::vector<std::unique_ptr<Texture>> loaded(DemoTextureCount);
+	ParallelFor(0, DemoTextureCount, [&](int i)
+	{
+		auto tex = std::make_unique<Texture>();
+		tex->Name = gDemoTextures[i].Name;
+		tex->Filename = L"../../Textures/" + AnsiToWString(gDemoTextures[i].File) + L".dds";
+
+		MappedFile file;
+		if (!file.Open(tex->Filename))
+			ThrowIfFailed(HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND));
+
+		{
+			std::lock_guard<std::mutex> lock(mInitLock);
+			ThrowIfFailed(DirectX::CreateDDSTextureFromMemory12(md3dDevice.Get(),
+				mCommandList.Get(), file.Data(), file.Size(),
+				tex->Resource, tex->UploadHeap));
+		}
+		loaded[i] = std::move(tex);
+	});
+
+	for (auto& tex : loaded)
+		mTextures[tex->Name] = std::move(tex);
 }
 
 void TreeBillboardsApp::BuildRootSignature()
@@ -720,7 +1292,7 @@ void TreeBillboardsApp::BuildRootSignature()
 	texTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0);
 
 	// Root parameter can be a table, root descriptor or root constants.
-	CD3DX12_ROOT_PARAMETER slotRootParameter[4];
+	CD3DX12_ROOT_PARAMETER slotRootParameter[7];
 
 	// Perfomance TIP: Order from most frequent to least frequent.
 	slotRootParameter[0].InitAsDescriptorTable(1, &texTable, D3D12_SHADER_VISIBILITY_PIXEL);
@@ -728,10 +1300,15 @@ void TreeBillboardsApp::BuildRootSignature()
 	slotRootParameter[2].InitAsConstantBufferView(1);
 	slotRootParameter[3].InitAsConstantBufferView(2);
 
+	// Clustered light list, cluster ranges and light indices.
+	slotRootParameter[4].InitAsShaderResourceView(1, 0, D3D12_SHADER_VISIBILITY_PIXEL);
+	slotRootParameter[5].InitAsShaderResourceView(2, 0, D3D12_SHADER_VISIBILITY_PIXEL);
+	slotRootParameter[6].InitAsShaderResourceView(3, 0, D3D12_SHADER_VISIBILITY_PIXEL);
+
 	auto staticSamplers = GetStaticSamplers();
 
 	// A root signature is an array of root parameters.
-	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(4, slotRootParameter,
+	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(7, slotRootParameter,
 		(UINT)staticSamplers.size(), staticSamplers.data(),
 		D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
 
@@ -760,7 +1337,7 @@ void TreeBillboardsApp::BuildDescriptorHeaps()
 	// Create the SRV heap.
 	//
 	D3D12_DESCRIPTOR_HEAP_DESC srvHeapDesc = {};
-	srvHeapDesc.NumDescriptors = 10;
+	srvHeapDesc.NumDescriptors = 19;
 	srvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
 	srvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
 	ThrowIfFailed(md3dDevice->CreateDescriptorHeap(&srvHeapDesc, IID_PPV_ARGS(&mSrvDescriptorHeap)));
@@ -853,6 +1430,34 @@ void TreeBillboardsApp::BuildDescriptorHeaps()
 	srvDesc.Texture2DArray.FirstArraySlice = 0;
 	srvDesc.Texture2DArray.ArraySize = treeArrayTex->GetDesc().DepthOrArraySize;
 	md3dDevice->CreateShaderResourceView(treeArrayTex.Get(), &srvDesc, hDescriptor);
+
+	// The flags, after the tree array.
+	const char* const flagTextures[] = { "usFlagTex", "ukFlagTex", "canadaFlagTex" };
+	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+	srvDesc.Texture2D.MostDetailedMip = 0;
+	srvDesc.Texture2D.MipLevels = -1;
+	srvDesc.Texture2D.PlaneSlice = 0;
+	srvDesc.Texture2D.ResourceMinLODClamp = 0.0f;
+	for (const char* name : flagTextures)
+	{
+		// next descriptor
+		hDescriptor.Offset(1, mCbvSrvDescriptorSize);
+
+		auto flagTex = mTextures[name]->Resource;
+		srvDesc.Format = flagTex->GetDesc().Format;
+		md3dDevice->CreateShaderResourceView(flagTex.Get(), &srvDesc, hDescriptor);
+	}
+
+	// Then the character parts and the crates.
+	const char* const characterTextures[] = { "headTex", "upBodyTex", "jacketTex", "pantsTex", "crate01Tex", "crate02Tex" };
+	for (const char* name : characterTextures)
+	{
+		hDescriptor.Offset(1, mCbvSrvDescriptorSize);
+
+		auto characterTex = mTextures[name]->Resource;
+		srvDesc.Format = characterTex->GetDesc().Format;
+		md3dDevice->CreateShaderResourceView(characterTex.Get(), &srvDesc, hDescriptor);
+	}
 }
 
 void TreeBillboardsApp::BuildShadersAndInputLayouts()
@@ -860,6 +1465,15 @@ void TreeBillboardsApp::BuildShadersAndInputLayouts()
 	const D3D_SHADER_MACRO defines[] =
 	{
 		"FOG", "1",
+		"CLUSTERED_LIGHTING", "1",
+		NULL, NULL
+	};
+
+	const D3D_SHADER_MACRO bakedDefines[] =
+	{
+		"FOG", "1",
+		"CLUSTERED_LIGHTING", "1",
+		"BAKED_LIGHTING", "1",
 		NULL, NULL
 	};
 
@@ -867,16 +1481,51 @@ void TreeBillboardsApp::BuildShadersAndInputLayouts()
 	{
 		"FOG", "1",
 		"ALPHA_TEST", "1",
+		"CLUSTERED_LIGHTING", "1",
+		NULL, NULL
+	};
+
+	const D3D_SHADER_MACRO particleDefines[] =
+	{
+		"FOG", "1",
+		"ALPHA_TEST", "1",
+		"CLUSTERED_LIGHTING", "1",
+		"PARTICLES", "1",
 		NULL, NULL
 	};
 
-	mShaders["standardVS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", nullptr, "VS", "vs_5_1");
-	mShaders["opaquePS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", defines, "PS", "ps_5_1");
-	mShaders["alphaTestedPS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", alphaTestDefines, "PS", "ps_5_1");
+	struct ShaderDesc
+	{
+		const char* Name;
+		const wchar_t* Filename;
+		const D3D_SHADER_MACRO* Defines;
+		const char* EntryPoint;
+		const char* Target;
+	};
+
+	const ShaderDesc shaders[] =
+	{
+		{ "standardVS", L"Shaders\\Default.hlsl", nullptr, "VS", "vs_5_1" },
+		{ "opaquePS", L"Shaders\\Default.hlsl", defines, "PS", "ps_5_1" },
+		{ "bakedVS", L"Shaders\\Default.hlsl", bakedDefines, "VS", "vs_5_1" },
+		{ "bakedPS", L"Shaders\\Default.hlsl", bakedDefines, "PS", "ps_5_1" },
+		{ "alphaTestedPS", L"Shaders\\Default.hlsl", alphaTestDefines, "PS", "ps_5_1" },
+
+		{ "treeSpriteVS", L"Shaders\\TreeSprite.hlsl", nullptr, "VS", "vs_5_1" },
+		{ "treeSpriteGS", L"Shaders\\TreeSprite.hlsl", nullptr, "GS", "gs_5_1" },
+		{ "treeSpritePS", L"Shaders\\TreeSprite.hlsl", alphaTestDefines, "PS", "ps_5_1" },
+		{ "particlePS", L"Shaders\\TreeSprite.hlsl", particleDefines, "PS", "ps_5_1" }
+	};
+	const int shaderCount = (int)_countof(shaders);
 
-	mShaders["treeSpriteVS"] = d3dUtil::CompileShader(L"Shaders\\TreeSprite.hlsl", nullptr, "VS", "vs_5_1");
-	mShaders["treeSpriteGS"] = d3dUtil::CompileShader(L"Shaders\\TreeSprite.hlsl", nullptr, "GS", "gs_5_1");
-	mShaders["treeSpritePS"] = d3dUtil::CompileShader(L"Shaders\\TreeSprite.hlsl", alphaTestDefines, "PS", "ps_5_1");
+	// The compiles are independent; the longest one bounds the step.
+	std::vector<ComPtr<ID3DBlob>> compiled(shaderCount);
+	ParallelFor(0, shaderCount, [&](int i)
+	{
+		compiled[i] = d3dUtil::CompileShader(shaders[i].Filename, shaders[i].Defines, shaders[i].EntryPoint, shaders[i].Target);
+	});
+	for (int i = 0; i < shaderCount; ++i)
+		mShaders[shaders[i].Name] = compiled[i];
 
 	mStdInputLayout =
 	{
@@ -885,6 +1534,10 @@ void TreeBillboardsApp::BuildShadersAndInputLayouts()
 		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 24, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 	};
 
+	// Baked lighting comes from the geometry's color stream in slot 1.
+	mBakedInputLayout = mStdInputLayout;
+	mBakedInputLayout.push_back({ "COLOR", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 });
+
 	mTreeSpriteInputLayout =
 	{
 		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
@@ -894,401 +1547,213 @@ void TreeBillboardsApp::BuildShadersAndInputLayouts()
 
 void TreeBillboardsApp::BuildLandGeometry()
 {
-	GeometryGenerator geoGen;
-	//ground size and location
-	GeometryGenerator::MeshData grid = geoGen.CreateGrid(120.0f, 120.0f, 50, 50);
-
-
-	// Extract the vertex elements we are interested and apply the height function to
-	// each vertex.  In addition, color the vertices based on their height so we have
-	// sandy looking beaches, grassy low hills, and snow mountain peaks.
-	//
-
-	std::vector<Vertex> vertices(grid.Vertices.size());
-	for (size_t i = 0; i < grid.Vertices.size(); ++i)
-	{
-		auto& p = grid.Vertices[i].Position;
-		vertices[i].Pos = p;
-		vertices[i].Pos.y = 0.5;/*GetHillsHeight(p.x, p.z);*/
-		vertices[i].Normal = GetHillsNormal(p.x, p.z);
-		vertices[i].TexC = grid.Vertices[i].TexC;
-	}
-
-
-	const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
-
-	std::vector<std::uint16_t> indices = grid.GetIndices16();
-	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
-
-	auto geo = std::make_unique<MeshGeometry>();
-	geo->Name = "landGeo";
-
-	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
-
-	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
-
-	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
-
-	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
-
-	geo->VertexByteStride = sizeof(Vertex);
-	geo->VertexBufferByteSize = vbByteSize;
-	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
-	geo->IndexBufferByteSize = ibByteSize;
-
-	SubmeshGeometry submesh;
-	submesh.IndexCount = (UINT)indices.size();
-	submesh.StartIndexLocation = 0;
-	submesh.BaseVertexLocation = 0;
-
-	geo->DrawArgs["grid"] = submesh;
-
-	mGeometries["landGeo"] = std::move(geo);
+	AddGeometry(CreateGeometry(BuildLandMesh(mHeightmap)));
 }
 
 void TreeBillboardsApp::BuildWavesGeometry()
 {
-	std::vector<std::uint16_t> indices(3 * mWaves->TriangleCount()); // 3 indices per face
-	assert(mWaves->VertexCount() < 0x0000ffff);
-
-	// Iterate over each quad.
-	int m = mWaves->RowCount();
-	int n = mWaves->ColumnCount();
-	int k = 0;
-	for (int i = 0; i < m - 1; ++i)
-	{
-		for (int j = 0; j < n - 1; ++j)
-		{
-			indices[k] = i * n + j;
-			indices[k + 1] = i * n + j + 1;
-			indices[k + 2] = (i + 1) * n + j;
-
-			indices[k + 3] = (i + 1) * n + j;
-			indices[k + 4] = i * n + j + 1;
-			indices[k + 5] = (i + 1) * n + j + 1;
-
-			k += 6; // next quad
-		}
-	}
-
-	UINT vbByteSize = mWaves->VertexCount() * sizeof(Vertex);
-	UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
-
-	auto geo = std::make_unique<MeshGeometry>();
-	geo->Name = "waterGeo";
-
-	// Set dynamically.
-	geo->VertexBufferCPU = nullptr;
-	geo->VertexBufferGPU = nullptr;
-
-	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
-
-	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
-
-	geo->VertexByteStride = sizeof(Vertex);
-	geo->VertexBufferByteSize = vbByteSize;
-	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
-	geo->IndexBufferByteSize = ibByteSize;
-
-	SubmeshGeometry submesh;
-	submesh.IndexCount = (UINT)indices.size();
-	submesh.StartIndexLocation = 0;
-	submesh.BaseVertexLocation = 0;
-
-	geo->DrawArgs["grid"] = submesh;
-
-	mGeometries["waterGeo"] = std::move(geo);
+	AddGeometry(CreateGeometry(BuildWavesMesh(*mWaves)));
 }
 
 void TreeBillboardsApp::BuildBoxGeometry()
 {
-	GeometryGenerator geoGen;
-	GeometryGenerator::MeshData box = geoGen.CreateBox(1.0f, 1.0f, 1.0f, 0);//box
-	GeometryGenerator::MeshData sphere = geoGen.CreateSphere(0.5f, 20, 20);//ball
-	GeometryGenerator::MeshData cylinder = geoGen.CreateCylinder(0.5f, 0.3f, 3.0f, 20, 20);//Cylinder
-	GeometryGenerator::MeshData cone = geoGen.CreateCone(0.5f, 1.0f, 20, 20);
-	GeometryGenerator::MeshData Pyramid_flat_head = geoGen.CreatePyramid_flat_head(1.5f, 2.0f, 1.0f, 0);
-	GeometryGenerator::MeshData Pyramid_pointed_head = geoGen.CreatePyramid_pointed_head(1.5f, 0.5f, 0);
-	GeometryGenerator::MeshData wedge = geoGen.CreateWedge(1.0, 1.0f, 1.0, 3);
-	GeometryGenerator::MeshData pointed_cylinder = geoGen.Createpointed_cylinder(5.0f, 5.0f, 1);
-
-
-	// Vertex Cache
-	UINT boxVertexOffset = 0;
-	UINT sphereVertexOffset = boxVertexOffset + (UINT)box.Vertices.size();
-	UINT cylinderVertexOffset = sphereVertexOffset + (UINT)sphere.Vertices.size();
-	UINT coneVertexOffset = cylinderVertexOffset + (UINT)cylinder.Vertices.size();
-	UINT Pyramid_flat_headVertexOffset = coneVertexOffset + (UINT)cone.Vertices.size();
-	UINT Pyramid_pointed_headVertexOffset = Pyramid_flat_headVertexOffset + (UINT)Pyramid_flat_head.Vertices.size();
-	UINT wedgeVertexOffset = Pyramid_pointed_headVertexOffset + (UINT)Pyramid_pointed_head.Vertices.size();
-	UINT pointed_cylinderVertexOffset = wedgeVertexOffset + (UINT)wedge.Vertices.size();
-	
-
-
-	//Index Cache
-	UINT boxIndexOffset = 0;
-	UINT sphereIndexOffset = boxIndexOffset + (UINT)box.Indices32.size();
-	UINT cylinderIndexOffset = sphereIndexOffset + (UINT)sphere.Indices32.size();
-	UINT coneIndexOffset = cylinderIndexOffset + (UINT)cylinder.Indices32.size();
-	UINT Pyramid_flat_headIndexOffset = coneIndexOffset + (UINT)cone.Indices32.size();
-	UINT Pyramid_pointed_headIndexOffset = Pyramid_flat_headIndexOffset + (UINT)Pyramid_flat_head.Indices32.size();
-	UINT wedgeIndexOffset = Pyramid_pointed_headIndexOffset + (UINT)Pyramid_pointed_head.Indices32.size();
-	UINT pointed_cylinderIndexOffset = wedgeIndexOffset + (UINT)wedge.Indices32.size();
-	UINT gateIndexOffset = pointed_cylinderIndexOffset + (UINT)pointed_cylinder.Indices32.size();
-
-	SubmeshGeometry boxSubmesh;
-	boxSubmesh.IndexCount = (UINT)box.Indices32.size();
-	boxSubmesh.StartIndexLocation = boxIndexOffset;
-	boxSubmesh.BaseVertexLocation = boxVertexOffset;
-
-	SubmeshGeometry sphereSubmesh;
-	sphereSubmesh.IndexCount = (UINT)sphere.Indices32.size();
-	sphereSubmesh.StartIndexLocation = sphereIndexOffset;
-	sphereSubmesh.BaseVertexLocation = sphereVertexOffset;
-
-	SubmeshGeometry cylinderSubmesh;
-	cylinderSubmesh.IndexCount = (UINT)cylinder.Indices32.size();
-	cylinderSubmesh.StartIndexLocation = cylinderIndexOffset;
-	cylinderSubmesh.BaseVertexLocation = cylinderVertexOffset;
-
-	SubmeshGeometry coneSubmesh;
-	coneSubmesh.IndexCount = (UINT)cone.Indices32.size();
-	coneSubmesh.StartIndexLocation = coneIndexOffset;
-	coneSubmesh.BaseVertexLocation = coneVertexOffset;
-
-	SubmeshGeometry Pyramid_flat_headSubmesh;
-	Pyramid_flat_headSubmesh.IndexCount = (UINT)Pyramid_flat_head.Indices32.size();
-	Pyramid_flat_headSubmesh.StartIndexLocation = Pyramid_flat_headIndexOffset;
-	Pyramid_flat_headSubmesh.BaseVertexLocation = Pyramid_flat_headVertexOffset;
-
-	SubmeshGeometry Pyramid_pointed_headSubmesh;
-	Pyramid_pointed_headSubmesh.IndexCount = (UINT)Pyramid_pointed_head.Indices32.size();
-	Pyramid_pointed_headSubmesh.StartIndexLocation = Pyramid_pointed_headIndexOffset;
-	Pyramid_pointed_headSubmesh.BaseVertexLocation = Pyramid_pointed_headVertexOffset;
-
-	SubmeshGeometry wedgeSubmesh;
-	wedgeSubmesh.IndexCount = (UINT)wedge.Indices32.size();
-	wedgeSubmesh.StartIndexLocation = wedgeIndexOffset;
-	wedgeSubmesh.BaseVertexLocation = wedgeVertexOffset;
+	AddGeometry(CreateGeometry(BuildShapesMesh()));
+}
 
-	SubmeshGeometry pointed_cylinderSubmesh;
-	pointed_cylinderSubmesh.IndexCount = (UINT)pointed_cylinder.Indices32.size();
-	pointed_cylinderSubmesh.StartIndexLocation = pointed_cylinderIndexOffset;
-	pointed_cylinderSubmesh.BaseVertexLocation = pointed_cylinderVertexOffset;
+void TreeBillboardsApp::BuildTreeSpritesGeometry()
+{
+	AddGeometry(CreateGeometry(BuildTreeSpritesMesh()));
+}
 
+void TreeBillboardsApp::BuildParticleSystem()
+{
+	// The land is drawn flat at y = 0.5 (BuildLandGeometry).
+	mParticleGround.Resize(2, 2, 120.0f, 120.0f);
+	mParticleGround.SetHeights(std::vector<float>(4, 0.5f));
+
+	std::vector<ParticlePoolDesc> pools(3);
+
+	pools[0].Name = "splash";
+	pools[0].Capacity = 64 * 1024;
+	pools[0].Drag = 0.5f;
+	pools[0].StartSize = 0.25f;
+	pools[0].EndSize = 0.1f;
+
+	pools[1].Name = "snow";
+	pools[1].Capacity = 256 * 1024;
+	pools[1].Gravity = -0.6f;
+	pools[1].Drag = 0.3f;
+	pools[1].StartSize = 0.15f;
+	pools[1].EndSize = 0.15f;
+
+	pools[2].Name = "sparks";
+	pools[2].Capacity = 32 * 1024;
+	pools[2].Drag = 0.2f;
+	pools[2].Collision = ParticleCollision::Bounce;
+	pools[2].Restitution = 0.4f;
+	pools[2].Friction = 0.7f;
+	pools[2].StartSize = 0.2f;
+	pools[2].EndSize = 0.02f;
+
+	if (!mParticles.Create(pools))
+		throw std::bad_alloc();
+
+	// Waves::Disturb throws up a splash from the water.
+	ParticleSplashEmitter splash;
+	splash.Pool = 0;
+	splash.ParticlesPerUnit = 1500.0f;
+	mParticles.SetSplashEmitter(splash);
+
+	// Snow over the whole land.
+	ParticleEmitter snow;
+	snow.Pool = 1;
+	snow.Position = XMFLOAT3(0.0f, 35.0f, 0.0f);
+	snow.Extents = XMFLOAT3(60.0f, 5.0f, 60.0f);
+	snow.Velocity = XMFLOAT3(0.5f, -1.0f, 0.0f);
+	snow.VelocitySpread = XMFLOAT3(0.5f, 0.3f, 0.5f);
+	snow.MinLife = 20.0f;
+	snow.MaxLife = 30.0f;
+	snow.Rate = 8000.0f;
+	mParticles.AddEmitter(snow);
+
+	// Sparks from the top of the first tower.
+	ParticleEmitter sparks;
+	sparks.Pool = 2;
+	sparks.Position = XMFLOAT3(50.0f, 18.0f, 15.0f);
+	sparks.Extents = XMFLOAT3(0.2f, 0.2f, 0.2f);
+	sparks.Velocity = XMFLOAT3(0.0f, 6.0f, 0.0f);
+	sparks.VelocitySpread = XMFLOAT3(3.0f, 2.0f, 3.0f);
+	sparks.MinLife = 1.5f;
+	sparks.MaxLife = 3.0f;
+	sparks.Rate = 2000.0f;
+	mParticles.AddEmitter(sparks);
+}
 
-	auto totalVertexCount =
-		box.Vertices.size() +
-		sphere.Vertices.size() +
-		cylinder.Vertices.size() +
-		cone.Vertices.size() +
-		Pyramid_flat_head.Vertices.size() +
-		Pyramid_pointed_head.Vertices.size() +
-		wedge.Vertices.size() +
-		pointed_cylinder.Vertices.size()
-		;
+void TreeBillboardsApp::BuildParticlesGeometry()
+{
+	// The vertices are streamed into ParticleVB every frame; the index buffer just counts
+	// up, so a pool's item draws IndexCount points from BaseVertexLocation.
+	const UINT capacity = (UINT)mParticles.Capacity();
+	std::vector<std::uint32_t> indices(capacity);
+	for (UINT i = 0; i < capacity; ++i)
+		indices[i] = i;
+
+	DemoMesh mesh;
+	mesh.Name = "particlesGeo";
+	mesh.VertexByteStride = sizeof(ParticleVertex);
+	mesh.VertexCount = capacity;
+	mesh.SetIndices(indices.data(), indices.size());
+	mesh.DrawArgs["points"].IndexCount = capacity;
+
+	AddGeometry(CreateGeometry(mesh));
+}
 
+void TreeBillboardsApp::BuildClothSystem()
+{
+	if (!BuildDemoFlags(mCloth))
+		throw std::bad_alloc();
+}
 
-	std::vector<Vertex> vertices(totalVertexCount);
+void TreeBillboardsApp::BuildClothGeometry()
+{
+	auto geo = CreateGeometry(BuildClothMesh(mCloth));
+	mClothGeo = geo.get();
+	AddGeometry(std::move(geo));
+}
 
-	UINT k = 0;
-	for (size_t i = 0; i < box.Vertices.size(); ++i, ++k)
-	{
-		auto& p = box.Vertices[i].Position;
-		vertices[k].Pos = p;
-		vertices[k].Normal = box.Vertices[i].Normal;
-		vertices[k].TexC = box.Vertices[i].TexC;
-	}
-	for (size_t i = 0; i < sphere.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = sphere.Vertices[i].Position;
-		vertices[k].Normal = sphere.Vertices[i].Normal;
-		vertices[k].TexC = sphere.Vertices[i].TexC;
-	}
+void TreeBillboardsApp::BuildCrowd()
+{
+	if (!BuildDemoCrowd(mHumanoid, mCrowd))
+		throw std::bad_alloc();
+}
 
-	for (size_t i = 0; i < cylinder.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = cylinder.Vertices[i].Position;
-		vertices[k].Normal = cylinder.Vertices[i].Normal;
-		vertices[k].TexC = cylinder.Vertices[i].TexC;
-		
-	}
-	for (size_t i = 0; i < cone.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = cone.Vertices[i].Position;
-		vertices[k].Normal = cone.Vertices[i].Normal;
-		vertices[k].TexC = cone.Vertices[i].TexC;
-		
-	}
-	
-	for (size_t i = 0; i < wedge.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = wedge.Vertices[i].Position;
-		vertices[k].Normal = wedge.Vertices[i].Normal;
-		vertices[k].TexC = wedge.Vertices[i].TexC;
-		
-	}
+void TreeBillboardsApp::BuildCrowdGeometry()
+{
+	auto geo = CreateGeometry(BuildCrowdMesh(mHumanoid, mCrowd));
+	mCrowdGeo = geo.get();
+	AddGeometry(std::move(geo));
+}
 
-	for (size_t i = 0; i < Pyramid_flat_head.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = Pyramid_flat_head.Vertices[i].Position;
-		vertices[k].Normal = Pyramid_flat_head.Vertices[i].Normal;
-		vertices[k].TexC = Pyramid_flat_head.Vertices[i].TexC;
-	}
-	for (size_t i = 0; i < Pyramid_pointed_head.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = Pyramid_pointed_head.Vertices[i].Position;
-		vertices[k].Normal = Pyramid_flat_head.Vertices[i].Normal;
-		vertices[k].TexC = Pyramid_flat_head.Vertices[i].TexC;
-	}
+void TreeBillboardsApp::BuildCapsuleGeometry()
+{
+	AddGeometry(CreateGeometry(BuildCapsuleMesh()));
+}
 
-	for (size_t i = 0; i < pointed_cylinder.Vertices.size(); ++i, ++k)
+void TreeBillboardsApp::BuildPhysicsWorld()
+{
+	// The maze walls are static boxes, the flat land (mParticleGround) the terrain.
+	for (const auto& bounds : MazeWalls)
 	{
-		vertices[k].Pos = pointed_cylinder.Vertices[i].Position;
-		vertices[k].Normal = pointed_cylinder.Vertices[i].Normal;
-		vertices[k].TexC = pointed_cylinder.Vertices[i].TexC;
+		XMFLOAT3 center, halfExtents;
+		XMStoreFloat3(&center, 0.5f*(bounds.first + bounds.second));
+		XMStoreFloat3(&halfExtents, 0.5f*(bounds.second - bounds.first));
+		mPhysics.AddStaticBox(center, halfExtents);
 	}
+	mPhysics.SetTerrain(&mParticleGround);
 
-	
-
-
-
-
-
-
-	std::vector<std::uint16_t> indices;
-	indices.insert(indices.end(), std::begin(box.GetIndices16()), std::end(box.GetIndices16()));
-	indices.insert(indices.end(), std::begin(sphere.GetIndices16()), std::end(sphere.GetIndices16()));
-	indices.insert(indices.end(), std::begin(cylinder.GetIndices16()), std::end(cylinder.GetIndices16()));
-	indices.insert(indices.end(), std::begin(cone.GetIndices16()), std::end(cone.GetIndices16()));
-	indices.insert(indices.end(), std::begin(Pyramid_flat_head.GetIndices16()), std::end(Pyramid_flat_head.GetIndices16()));
-	indices.insert(indices.end(), std::begin(Pyramid_pointed_head.GetIndices16()), std::end(Pyramid_pointed_head.GetIndices16()));
-	indices.insert(indices.end(), std::begin(wedge.GetIndices16()), std::end(wedge.GetIndices16()));
-	indices.insert(indices.end(), std::begin(pointed_cylinder.GetIndices16()), std::end(pointed_cylinder.GetIndices16()));
-	
-
-
-	const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
-
-
-	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
-
-	auto geo = std::make_unique<MeshGeometry>();
-	geo->Name = "boxGeo";
-
-	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
-
-	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
-
-	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
-
-	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
-
-	geo->VertexByteStride = sizeof(Vertex);
-	geo->VertexBufferByteSize = vbByteSize;
-	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
-	geo->IndexBufferByteSize = ibByteSize;
-
-	//SubmeshGeometry submesh;
-	//submesh.IndexCount = (UINT)indices.size();
-	//submesh.StartIndexLocation = 0;
-	//submesh.BaseVertexLocation = 0; 
-
-	geo->DrawArgs["box"] = boxSubmesh;
-	geo->DrawArgs["sphere"] = sphereSubmesh;
-	geo->DrawArgs["cylinder"] = cylinderSubmesh;
-	geo->DrawArgs["cone"] = coneSubmesh;
-	geo->DrawArgs["Pyramid_flat_head"] = Pyramid_flat_headSubmesh;
-	geo->DrawArgs["Pyramid_pointed_head"] = Pyramid_pointed_headSubmesh;
-	geo->DrawArgs["wedge"] = wedgeSubmesh;
-	geo->DrawArgs["pointed_cylinder"] = pointed_cylinderSubmesh;
-
-
-	mGeometries[geo->Name] = std::move(geo);
-}
-
-void TreeBillboardsApp::BuildTreeSpritesGeometry()
-{
-	//A2
-	//step5
-	struct TreeSpriteVertex
+	// Adds a body and the render item that follows it, scaling the unit mesh of drawArg.
+	auto addBody = [&](const RigidBodyDesc& desc, const XMFLOAT3& scale, const char* material,
+		const char* geometry, const char* drawArg)
 	{
-		XMFLOAT3 Pos;
-		XMFLOAT2 Size;
+		auto ritem = std::make_unique<RenderItem>();
+		ritem->ObjCBIndex = (UINT)mAllRitems.size();
+		ritem->Mat = mMaterials[material].get();
+		ritem->Geo = mGeometries[geometry].get();
+		ritem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+		ritem->IndexCount = ritem->Geo->DrawArgs[drawArg].IndexCount;
+		ritem->StartIndexLocation = ritem->Geo->DrawArgs[drawArg].StartIndexLocation;
+		ritem->BaseVertexLocation = ritem->Geo->DrawArgs[drawArg].BaseVertexLocation;
+
+		BodyRenderItem bodyRitem;
+		bodyRitem.Body = mPhysics.AddBody(desc);
+		bodyRitem.Scale = scale;
+		bodyRitem.Item = ritem.get();
+		XMStoreFloat4x4(&ritem->World, XMMatrixScaling(scale.x, scale.y, scale.z) * mPhysics.Transform(bodyRitem.Body));
+		mBodyRitems.push_back(bodyRitem);
+
+		mRitemLayer[(int)RenderLayer::Opaque].push_back(ritem.get());
+		mAllRitems.push_back(std::move(ritem));
 	};
 
-	static const int treeCount = 20;
-	std::array<TreeSpriteVertex, 20> vertices;
-	for (UINT i = 0; i < treeCount; ++i)
+	// Three layers of crates over a 12x12 grid, randomly sized and turned so they
+	// tumble into a pile.
+	const int gridSize = 12;
+	for (int layer = 0; layer < 3; ++layer)
 	{
-		float x = MathHelper::RandF(-40.0f, 40.0f);
-		float z = MathHelper::RandF(-50.0f, -40.0f);
-		float y = GetHillsHeight(x, z);
-
-		// Move tree slightly above land height.
-		y = 9.5f;
-		if (i <= 10)
-		{
-			vertices[i].Pos = XMFLOAT3(x, y, z);
-			vertices[i].Size = XMFLOAT2(20.0f, 20.0f);
-		}
-
-		else if (10 < i && i <= 20)
+		for (int row = 0; row < gridSize; ++row)
 		{
-			vertices[i].Pos = XMFLOAT3(x, y, -z);
-			vertices[i].Size = XMFLOAT2(20.0f, 20.0f);
+			for (int column = 0; column < gridSize; ++column)
+			{
+				const float size = MathHelper::RandF(0.8f, 1.4f);
+
+				RigidBodyDesc desc;
+				desc.Shape = RigidShape::Box(XMFLOAT3(0.5f*size, 0.5f*size, 0.5f*size));
+				desc.Position = XMFLOAT3(22.0f + 2.2f*column + MathHelper::RandF(-0.3f, 0.3f),
+					12.0f + 3.0f*layer + MathHelper::RandF(0.0f, 1.0f), -14.0f + 2.2f*row + MathHelper::RandF(-0.3f, 0.3f));
+				XMStoreFloat4(&desc.Orientation, XMQuaternionRotationRollPitchYaw(MathHelper::RandF(0.0f, XM_PI),
+					MathHelper::RandF(0.0f, XM_PI), MathHelper::RandF(0.0f, XM_PI)));
+				desc.Mass = size*size*size*20.0f;
+				addBody(desc, XMFLOAT3(size, size, size), (row + column + layer) % 2 == 0 ? "crate01" : "crate02", "boxGeo", "box");
+			}
 		}
 	}
 
-
-
-	std::array<std::uint16_t, 20> indices =
+	// Balls and capsules dropped on top.
+	for (int k = 0; k < 96; ++k)
 	{
-		0, 1, 2, 3, 4, 5, 6, 7,
-		8, 9, 10, 11, 12, 13, 14, 15,16,17,18,19
-	};
-
-	const UINT vbByteSize = (UINT)vertices.size() * sizeof(TreeSpriteVertex);
-	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
-
-	auto geo = std::make_unique<MeshGeometry>();
-	geo->Name = "treeSpritesGeo";
-
-	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
-
-	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
-
-	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
-
-	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
-
-	geo->VertexByteStride = sizeof(TreeSpriteVertex);
-	geo->VertexBufferByteSize = vbByteSize;
-	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
-	geo->IndexBufferByteSize = ibByteSize;
-
-	SubmeshGeometry submesh;
-	submesh.IndexCount = (UINT)indices.size();
-	submesh.StartIndexLocation = 0;
-	submesh.BaseVertexLocation = 0;
-
-	geo->DrawArgs["points"] = submesh;
-
-	mGeometries["treeSpritesGeo"] = std::move(geo);
+		const bool ball = k % 2 == 0;
+		const float size = MathHelper::RandF(0.6f, 1.2f);
+
+		RigidBodyDesc desc;
+		desc.Shape = ball ? RigidShape::Sphere(0.5f*size) : RigidShape::Capsule(0.5f*size, 0.5f*size);
+		desc.Position = XMFLOAT3(MathHelper::RandF(23.0f, 47.0f), MathHelper::RandF(22.0f, 30.0f), MathHelper::RandF(-13.0f, 11.0f));
+		XMStoreFloat4(&desc.Orientation, XMQuaternionRotationRollPitchYaw(MathHelper::RandF(0.0f, XM_PI),
+			MathHelper::RandF(0.0f, XM_PI), 0.0f));
+		desc.Mass = size*size*size*10.0f;
+		desc.Restitution = ball ? 0.4f : 0.1f;
+		addBody(desc, XMFLOAT3(size, size, size), ball ? "testcolor" : "checkboard",
+			ball ? "boxGeo" : "capsuleGeo", ball ? "sphere" : "capsule");
+	}
 }
 
 void TreeBillboardsApp::BuildPSOs()
@@ -1328,6 +1793,23 @@ void TreeBillboardsApp::BuildPSOs()
 	opaquePsoDesc.DSVFormat = mDepthStencilFormat;
 	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&opaquePsoDesc, IID_PPV_ARGS(&mPSOs["opaque"])));
 
+	//
+	// PSO for opaque objects with baked lighting.
+	//
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC bakedPsoDesc = opaquePsoDesc;
+	bakedPsoDesc.InputLayout = { mBakedInputLayout.data(), (UINT)mBakedInputLayout.size() };
+	bakedPsoDesc.VS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["bakedVS"]->GetBufferPointer()),
+		mShaders["bakedVS"]->GetBufferSize()
+	};
+	bakedPsoDesc.PS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["bakedPS"]->GetBufferPointer()),
+		mShaders["bakedPS"]->GetBufferSize()
+	};
+	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&bakedPsoDesc, IID_PPV_ARGS(&mPSOs["opaqueBaked"])));
+
 	//
 	// PSO for transparent objects
 	//
@@ -1389,509 +1871,588 @@ void TreeBillboardsApp::BuildPSOs()
 	treeSpritePsoDesc.RasterizerState.CullMode = D3D12_CULL_MODE_NONE;
 
 	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&treeSpritePsoDesc, IID_PPV_ARGS(&mPSOs["treeSprites"])));
+
+	//
+	// PSO for particles: the tree sprite billboards with a round, untextured sprite.
+	//
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC particlePsoDesc = treeSpritePsoDesc;
+	particlePsoDesc.PS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["particlePS"]->GetBufferPointer()),
+		mShaders["particlePS"]->GetBufferSize()
+	};
+	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&particlePsoDesc, IID_PPV_ARGS(&mPSOs["particles"])));
+
+	mLayerPSOs[(int)RenderLayer::Opaque] = mPSOs["opaque"].Get();
+	mLayerPSOs[(int)RenderLayer::OpaqueBaked] = mPSOs["opaqueBaked"].Get();
+	mLayerPSOs[(int)RenderLayer::AlphaTested] = mPSOs["alphaTested"].Get();
+	mLayerPSOs[(int)RenderLayer::AlphaTestedTreeSprites] = mPSOs["treeSprites"].Get();
+	mLayerPSOs[(int)RenderLayer::Particles] = mPSOs["particles"].Get();
+	mLayerPSOs[(int)RenderLayer::Transparent] = mPSOs["transparent"].Get();
 }
 
 void TreeBillboardsApp::BuildFrameResources()
 {
+	UINT meshletIndexCount = 0;
+	for (const MeshletCulledItem& culled : mMeshletItems)
+		meshletIndexCount += culled.IndexCount;
+
 	for (int i = 0; i < gNumFrameResources; ++i)
 	{
 		mFrameResources.push_back(std::make_unique<FrameResource>(md3dDevice.Get(),
-			1, (UINT)mAllRitems.size(), (UINT)mMaterials.size(), mWaves->VertexCount()));
+			1, (UINT)mAllRitems.size(), (UINT)mMaterials.size(), mWaves->VertexCount(), (UINT)mParticles.Capacity(),
+			(UINT)mCloth.VertexCount(), (UINT)mCrowd.VertexCount(), meshletIndexCount));
 	}
 }
 
 void TreeBillboardsApp::BuildMaterials()
 {
-	int i = 0;
-	auto grass = std::make_unique<Material>();
-	grass->Name = "grass";
-	grass->MatCBIndex = i;
-	grass->DiffuseSrvHeapIndex = i;
-	grass->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-	grass->FresnelR0 = XMFLOAT3(0.01f, 0.01f, 0.01f);
-	grass->Roughness = 0.125f;
-	i++;
-	// This is not a good water material definition, but we do not have all the rendering
-	// tools we need (transparency, environment reflection), so we fake it for now.
-	auto water = std::make_unique<Material>();
-	water->Name = "water";
-	water->MatCBIndex = i;
-	water->DiffuseSrvHeapIndex = i;
-	water->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 0.5f);
-	water->FresnelR0 = XMFLOAT3(0.1f, 0.1f, 0.1f);
-	water->Roughness = 0.0f;
-	i++;
-	auto wirefence = std::make_unique<Material>();
-	wirefence->Name = "wirefence";
-	wirefence->MatCBIndex = i;
-	wirefence->DiffuseSrvHeapIndex = i;
-	wirefence->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-	wirefence->FresnelR0 = XMFLOAT3(0.02f, 0.02f, 0.02f);
-	wirefence->Roughness = 0.25f;
-	i++;
-	
+	BuildDemoMaterials(mMaterials);
+}
 
-	/// <summary>
-	/// 
-	/// </summary>
-	auto ice = std::make_unique<Material>();
-	ice->Name = "ice";
-	ice->MatCBIndex = i;
-	ice->DiffuseSrvHeapIndex = i;
-	ice->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-	ice->FresnelR0 = XMFLOAT3(0.02f, 0.02f, 0.02f);
-	ice->Roughness = 0.2f;
-	i++;
+void TreeBillboardsApp::BuildRenderItems()
+{
+	UINT objIndex = 0;
 
-	auto bricks = std::make_unique<Material>();
-	bricks->Name = "bricks";
-	bricks->MatCBIndex = i;
-	bricks->DiffuseSrvHeapIndex = i;
-	bricks->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-	bricks->FresnelR0 = XMFLOAT3(0.02f, 0.02f, 0.02f);
-	bricks->Roughness = 0.2f;
-	i++;
+	// The static content (water, land, castle, maze, trees and flag poles) is data; see
+	// Scenes/TreeBillboards.scene.  The compiled copy next to it is used while the text
+	// is unchanged.
+	const std::wstring sceneFile = L"../../Scenes/TreeBillboards.scene";
+	auto sceneError = [&](const std::string& message)
+	{
+		::OutputDebugStringA(("TreeBillboards.scene: " + message + "\n").c_str());
+		throw DxException(E_FAIL, L"BuildRenderItems", sceneFile, __LINE__);
+	};
 
+	SceneFile scene;
+	std::vector<DemoMesh> models;
+	std::string error;
+	if (!LoadDemoScene(sceneFile, L"../../Scenes/TreeBillboards.sceneb", scene, models, error))
+		sceneError(error);
+	for (const DemoMesh& model : models)
+		AddGeometry(CreateGeometry(model));
 
-	auto testcolor = std::make_unique<Material>();
-	testcolor->Name = "testcolor";
-	testcolor->MatCBIndex = i;
-	testcolor->DiffuseSrvHeapIndex = i;
-	testcolor->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-	testcolor->FresnelR0 = XMFLOAT3(0.02f, 0.02f, 0.02f);
-	testcolor->Roughness = 0.2f;
-	i++;
+	const size_t firstSceneItem = mAllRitems.size();
+	for (int i = 0; i < scene.ItemCount(); ++i)
+	{
+		const SceneItem& item = scene.Item(i);
 
+		const int layer = (int)FindRenderLayer(scene.String(item.Layer));
+		auto geo = mGeometries.find(scene.String(item.Geometry));
+		auto mat = mMaterials.find(scene.String(item.Material));
+		if (layer == (int)RenderLayer::Count || geo == mGeometries.end() || mat == mMaterials.end() ||
+			geo->second->DrawArgs.count(scene.String(item.DrawArg)) == 0)
+		{
+			sceneError(std::string("item ") + scene.String(item.Name) +
+				" names an unknown geometry, draw arg, material or layer");
+		}
 
-	auto door = std::make_unique<Material>();
-	door->Name = "door";
-	door->MatCBIndex = i;
-	door->DiffuseSrvHeapIndex = i;
-	door->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-	door->FresnelR0 = XMFLOAT3(0.02f, 0.02f, 0.02f);
-	door->Roughness = 0.2f;
-	i++;
+		const SubmeshGeometry& submesh = geo->second->DrawArgs[scene.String(item.DrawArg)];
+		auto ritem = std::make_unique<RenderItem>();
+		ritem->World = item.World;
+		ritem->TexTransform = item.TexTransform;
+		ritem->ObjCBIndex = objIndex++;
+		ritem->Mat = mat->second.get();
+		ritem->Geo = geo->second.get();
+		ritem->PrimitiveType = item.Topology == SceneTopology::Points ?
+			D3D_PRIMITIVE_TOPOLOGY_POINTLIST : D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+		ritem->IndexCount = submesh.IndexCount;
+		ritem->StartIndexLocation = submesh.StartIndexLocation;
+		ritem->BaseVertexLocation = submesh.BaseVertexLocation;
+		mRitemLayer[layer].push_back(ritem.get());
+		if (item.Static && item.Topology == SceneTopology::Triangles)
+			mStaticSceneItems.push_back({ ritem.get(), layer, scene.String(item.Name) });
+		mAllRitems.push_back(std::move(ritem));
+	}
 
+	const int wavesItem = scene.FindItem("waves");
+	if (wavesItem < 0)
+		sceneError("no item named waves");
+	mWavesRitem = mAllRitems[firstSceneItem + wavesItem].get();
 
-	auto walls = std::make_unique<Material>();
-	walls->Name = "walls";
-	walls->MatCBIndex = i;
-	walls->DiffuseSrvHeapIndex = i;
-	walls->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-	walls->FresnelR0 = XMFLOAT3(0.02f, 0.02f, 0.02f);
-	walls->Roughness = 0.2f;
-	i++;
+	// Meshlet culled when the scene has it, see BuildMeshletCulling.
+	const int landItem = scene.FindItem("land");
+	if (landItem >= 0)
+		mLandRitem = mAllRitems[firstSceneItem + landItem].get();
 
-	auto checkboard = std::make_unique<Material>();
-	checkboard->Name = "checkboard";
-	checkboard->MatCBIndex = i;
-	checkboard->DiffuseSrvHeapIndex = i;
-	checkboard->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-	checkboard->FresnelR0 = XMFLOAT3(0.02f, 0.02f, 0.02f);
-	checkboard->Roughness = 0.2f;
-	i++;
+	// The items marked 'collide' are the maze walls.
+	for (int i = 0; i < scene.ColliderCount(); ++i)
+	{
+		const SceneCollider& collider = scene.Collider(i);
+		MazeWalls.push_back({ XMVectorSetW(XMLoadFloat3(&collider.Min), 1.0f), XMVectorSetW(XMLoadFloat3(&collider.Max), 1.0f) });
+	}
 
+	// One item per pool, in the order BuildParticleSystem creates them.
+	const char* const particleMaterials[] = { "splashParticle", "snowParticle", "sparkParticle" };
+	for (int pool = 0; pool < mParticles.PoolCount(); ++pool)
+	{
+		auto particleRitem = std::make_unique<RenderItem>();
+		particleRitem->World = MathHelper::Identity4x4();
+		particleRitem->ObjCBIndex = objIndex++;
+		particleRitem->Mat = mMaterials[particleMaterials[pool]].get();
+		particleRitem->Geo = mGeometries["particlesGeo"].get();
+		particleRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_POINTLIST;
+
+		mParticleRitems.push_back(particleRitem.get());
+		mRitemLayer[(int)RenderLayer::Particles].push_back(particleRitem.get());
+		mAllRitems.push_back(std::move(particleRitem));
+	}
 
+	// The flags; their poles are in the scene.  The cloth is two-sided, so it goes with
+	// the alpha-tested items, which are drawn without culling.
+	for (int flag = 0; flag < mCloth.FlagCount(); ++flag)
+	{
+		auto flagRitem = std::make_unique<RenderItem>();
+		flagRitem->World = MathHelper::Identity4x4();
+		flagRitem->ObjCBIndex = objIndex++;
+		flagRitem->Mat = mMaterials[gDemoFlagMaterials[flag % 3]].get();
+		flagRitem->Geo = mClothGeo;
+		flagRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+		flagRitem->IndexCount = (UINT)mCloth.FlagIndexCount(flag);
+		flagRitem->StartIndexLocation = (UINT)mCloth.FlagFirstIndex(flag);
+		flagRitem->BaseVertexLocation = mCloth.FlagFirstVertex(flag);
+		mRitemLayer[(int)RenderLayer::AlphaTested].push_back(flagRitem.get());
+		mAllRitems.push_back(std::move(flagRitem));
+	}
 
+	// The crowd, one item per part.  The skinned vertices are already in world space.
+	for (int part = 0; part < HumanoidPartCount; ++part)
+	{
+		auto crowdRitem = std::make_unique<RenderItem>();
+		crowdRitem->World = MathHelper::Identity4x4();
+		crowdRitem->ObjCBIndex = objIndex++;
+		crowdRitem->Mat = mMaterials[gDemoCrowdMaterials[part]].get();
+		crowdRitem->Geo = mCrowdGeo;
+		crowdRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+		crowdRitem->IndexCount = mCrowdGeo->DrawArgs[gDemoCrowdParts[part]].IndexCount;
+		crowdRitem->StartIndexLocation = mCrowdGeo->DrawArgs[gDemoCrowdParts[part]].StartIndexLocation;
+		crowdRitem->BaseVertexLocation = mCrowdGeo->DrawArgs[gDemoCrowdParts[part]].BaseVertexLocation;
+		mRitemLayer[(int)RenderLayer::Opaque].push_back(crowdRitem.get());
+		mAllRitems.push_back(std::move(crowdRitem));
+	}
+}
 
 
+void TreeBillboardsApp::BuildStaticBatchGeometry()
+{
+	static_assert(sizeof(StaticBatchVertex) == sizeof(Vertex), "the merged vertices are copied into the vertex buffer as is");
 
+	if (mStaticSceneItems.empty())
+		return;
 
+	// One key per material and layer, so a chunk draws with its sources' material and PSO.
+	std::vector<std::pair<Material*, int>> keys;
+	std::vector<StaticBatchSource> sources(mStaticSceneItems.size());
+	for (size_t i = 0; i < mStaticSceneItems.size(); ++i)
+	{
+		const RenderItem* ri = mStaticSceneItems[i].Item;
+		const std::pair<Material*, int> key(ri->Mat, mStaticSceneItems[i].Layer);
+		auto k = std::find(keys.begin(), keys.end(), key);
+		if (k == keys.end())
+			k = keys.insert(keys.end(), key);
+
+		StaticBatchSource& source = sources[i];
+		source.Vertices = reinterpret_cast<const StaticBatchVertex*>(ri->Geo->VertexBufferCPU->GetBufferPointer());
+		source.Indices = ri->Geo->IndexBufferCPU->GetBufferPointer();
+		source.Indices32 = ri->Geo->IndexFormat == DXGI_FORMAT_R32_UINT;
+		source.IndexCount = ri->IndexCount;
+		source.StartIndexLocation = ri->StartIndexLocation;
+		source.BaseVertexLocation = ri->BaseVertexLocation;
+		source.World = ri->World;
+		source.TexTransform = ri->TexTransform;
+		source.Key = (std::uint32_t)(k - keys.begin());
+	}
 
+	// Tools' batches command checks the merged triangles against their sources.
+	BuildStaticBatches(StaticBatchDesc(), sources.data(), (std::uint32_t)sources.size(), mStaticBatches);
+	if (mStaticBatches.Chunks.empty())
+		return;
 
+	const UINT vbByteSize = (UINT)mStaticBatches.Vertices.size() * sizeof(Vertex);
+	const UINT ibByteSize = (UINT)mStaticBatches.Indices.size() * sizeof(std::uint16_t);
 
+	auto geo = std::make_unique<MeshGeometry>();
+	geo->Name = "staticBatchGeo";
 
+	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
+	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), mStaticBatches.Vertices.data(), vbByteSize);
 
-	auto treeSprites = std::make_unique<Material>();
-	treeSprites->Name = "treeSprites";
-	treeSprites->MatCBIndex = i;
-	treeSprites->DiffuseSrvHeapIndex = i;
-	treeSprites->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-	treeSprites->FresnelR0 = XMFLOAT3(0.01f, 0.01f, 0.01f);
-	treeSprites->Roughness = 0.125f;
+	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
+	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), mStaticBatches.Indices.data(), ibByteSize);
 
+	geo->VertexBufferGPU = CreateDefaultBuffer(mStaticBatches.Vertices.data(), vbByteSize, geo->VertexBufferUploader);
 
+	geo->IndexBufferGPU = CreateDefaultBuffer(mStaticBatches.Indices.data(), ibByteSize, geo->IndexBufferUploader);
 
-	mMaterials["grass"] = std::move(grass);
-	mMaterials["water"] = std::move(water);
-	mMaterials["wirefence"] = std::move(wirefence);
-	mMaterials["ice"] = std::move(ice);
-	mMaterials["bricks"] = std::move(bricks);
-	mMaterials["testcolor"] = std::move(testcolor);
-	mMaterials["door"] = std::move(door);
-	mMaterials["walls"] = std::move(walls);
-	mMaterials["checkboard"] = std::move(checkboard);
-	mMaterials["treeSprites"] = std::move(treeSprites);
+	geo->VertexByteStride = sizeof(Vertex);
+	geo->VertexBufferByteSize = vbByteSize;
+	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
+	geo->IndexBufferByteSize = ibByteSize;
 
+	// One draw arg and one render item per chunk.  The chunk's indices count from its
+	// first vertex.
+	for (size_t c = 0; c < mStaticBatches.Chunks.size(); ++c)
+	{
+		const StaticBatchChunk& chunk = mStaticBatches.Chunks[c];
+
+		SubmeshGeometry submesh;
+		submesh.IndexCount = chunk.IndexCount;
+		submesh.StartIndexLocation = chunk.FirstIndex;
+		submesh.BaseVertexLocation = (INT)chunk.FirstVertex;
+		const XMVECTOR lo = XMLoadFloat3(&chunk.BoundsMin);
+		const XMVECTOR hi = XMLoadFloat3(&chunk.BoundsMax);
+		XMStoreFloat3(&submesh.Bounds.Center, 0.5f*(lo + hi));
+		XMStoreFloat3(&submesh.Bounds.Extents, 0.5f*(hi - lo));
+		geo->DrawArgs["chunk" + std::to_string(c)] = submesh;
+
+		auto ritem = std::make_unique<RenderItem>();
+		ritem->ObjCBIndex = (UINT)mAllRitems.size();
+		ritem->Mat = keys[chunk.Key].first;
+		ritem->Geo = geo.get();
+		ritem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+		ritem->IndexCount = submesh.IndexCount;
+		ritem->StartIndexLocation = submesh.StartIndexLocation;
+		ritem->BaseVertexLocation = submesh.BaseVertexLocation;
+		ritem->StaticChunk = (int)c;
+		mRitemLayer[keys[chunk.Key].second].push_back(ritem.get());
+		mAllRitems.push_back(std::move(ritem));
+	}
+	mStaticChunkVisible.assign(mStaticBatches.Chunks.size(), 1);
+
+	// The batched items stay in mAllRitems but are no longer drawn.
+	std::vector<RenderItem*> batched;
+	std::vector<bool> unbatched(mStaticSceneItems.size(), false);
+	for (std::uint32_t s : mStaticBatches.Unbatched)
+		unbatched[s] = true;
+	for (size_t i = 0; i < mStaticSceneItems.size(); ++i)
+	{
+		if (!unbatched[i])
+			batched.push_back(mStaticSceneItems[i].Item);
+	}
+	std::sort(batched.begin(), batched.end());
+	for (auto& layer : mRitemLayer)
+	{
+		layer.erase(std::remove_if(layer.begin(), layer.end(), [&batched](RenderItem* ri)
+		{
+			return std::binary_search(batched.begin(), batched.end(), ri);
+		}), layer.end());
+	}
 
+	AddGeometry(std::move(geo));
 }
 
-void TreeBillboardsApp::BuildRenderItems()
+void TreeBillboardsApp::BuildMeshletCulling()
 {
-	UINT objIndex = 0;
-	auto wavesRitem = std::make_unique<RenderItem>();
-	wavesRitem->World = MathHelper::Identity4x4();
-	XMStoreFloat4x4(&wavesRitem->TexTransform, XMMatrixScaling(5.0f, 5.0f, 1.0f));
-	wavesRitem->ObjCBIndex = objIndex++;
-	wavesRitem->Mat = mMaterials["water"].get();
-	wavesRitem->Geo = mGeometries["waterGeo"].get();
-	wavesRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	wavesRitem->IndexCount = wavesRitem->Geo->DrawArgs["grid"].IndexCount;
-	wavesRitem->StartIndexLocation = wavesRitem->Geo->DrawArgs["grid"].StartIndexLocation;
-	wavesRitem->BaseVertexLocation = wavesRitem->Geo->DrawArgs["grid"].BaseVertexLocation;
-
-	mWavesRitem = wavesRitem.get();
-
-	mRitemLayer[(int)RenderLayer::Transparent].push_back(wavesRitem.get());
-
-	auto gridRitem = std::make_unique<RenderItem>();
-	gridRitem->World = MathHelper::Identity4x4();
-	XMStoreFloat4x4(&gridRitem->TexTransform, XMMatrixScaling(5.0f, 5.0f, 1.0f)*XMMatrixTranslation(0.5f, 0.5f, 0.5f));
-	gridRitem->ObjCBIndex = objIndex++;
-	gridRitem->Mat = mMaterials["grass"].get();
-	gridRitem->Geo = mGeometries["landGeo"].get();
-	gridRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	gridRitem->IndexCount = gridRitem->Geo->DrawArgs["grid"].IndexCount;
-	gridRitem->StartIndexLocation = gridRitem->Geo->DrawArgs["grid"].StartIndexLocation;
-	gridRitem->BaseVertexLocation = gridRitem->Geo->DrawArgs["grid"].BaseVertexLocation;
-
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(gridRitem.get());
-
-	/*auto boxRitem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&boxRitem->World, XMMatrixTranslation(3.0f, 2.0f, -9.0f));
-	boxRitem->ObjCBIndex = objIndex++;
-	boxRitem->Mat = mMaterials["wirefence"].get();
-	boxRitem->Geo = mGeometries["boxGeo"].get();
-	boxRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	boxRitem->IndexCount = boxRitem->Geo->DrawArgs["box"].IndexCount;
-	boxRitem->StartIndexLocation = boxRitem->Geo->DrawArgs["box"].StartIndexLocation;
-	boxRitem->BaseVertexLocation = boxRitem->Geo->DrawArgs["box"].BaseVertexLocation;
-
-	mRitemLayer[(int)RenderLayer::AlphaTested].push_back(boxRitem.get());*/
-
-
-	////////
-	///
-	/////////
-	//whole buildig movie
-	float CX = 35.0f;
-	float CZ = 0.0f;
-
-	float dx[4] = { 15.0f+ CX,15.0f + CX, -15.0f + CX, -15.0f + CX }, dz[4] = { 15.0f+ CZ, -15.0f + CZ, -15.0f + CZ, 15.0f + CZ };
-	for (int i = 0; i < 4; ++i)
-	{
-
-		auto tower_base = std::make_unique<RenderItem>();
-		XMStoreFloat4x4(&tower_base->World, XMMatrixScaling(5.0f, 5.0f,5.0f) * XMMatrixTranslation(dx[i], 4.0f, dz[i]));
-		tower_base->ObjCBIndex = objIndex++;
-		tower_base->Mat = mMaterials["bricks"].get();
-		tower_base->Geo = mGeometries["boxGeo"].get();
-		tower_base->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		tower_base->IndexCount = tower_base->Geo->DrawArgs["cylinder"].IndexCount;
-		tower_base->StartIndexLocation = tower_base->Geo->DrawArgs["cylinder"].StartIndexLocation;
-		tower_base->BaseVertexLocation = tower_base->Geo->DrawArgs["cylinder"].BaseVertexLocation;
-		mRitemLayer[(int)RenderLayer::AlphaTested].push_back(tower_base.get());
-
-		auto tower_middle = std::make_unique<RenderItem>();
-		XMStoreFloat4x4(&tower_middle->World, XMMatrixScaling(5.0f, 5.0f, 5.0f) * XMMatrixTranslation(dx[i], 10.0f, dz[i]));
-		tower_middle->ObjCBIndex = objIndex++;
-		tower_middle->Mat = mMaterials["wirefence"].get();
-		tower_middle->Geo = mGeometries["boxGeo"].get();
-		tower_middle->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		tower_middle->IndexCount = tower_middle->Geo->DrawArgs["Pyramid_flat_head"].IndexCount;
-		tower_middle->StartIndexLocation = tower_middle->Geo->DrawArgs["Pyramid_flat_head"].StartIndexLocation;
-		tower_middle->BaseVertexLocation = tower_middle->Geo->DrawArgs["Pyramid_flat_head"].BaseVertexLocation;
-		mRitemLayer[(int)RenderLayer::AlphaTested].push_back(tower_middle.get());
-
-		auto tower_top = std::make_unique<RenderItem>();
-		XMStoreFloat4x4(&tower_top->World, XMMatrixScaling(3.5f, 3.5f, 3.5f)*XMMatrixTranslation(dx[i], 15.0f, dz[i]));
-		tower_top->ObjCBIndex = objIndex++;
-		tower_top->Mat = mMaterials["ice"].get();
-		tower_top->Geo = mGeometries["boxGeo"].get();
-		tower_top->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		tower_top->IndexCount = tower_top->Geo->DrawArgs["cone"].IndexCount;
-		tower_top->StartIndexLocation = tower_top->Geo->DrawArgs["cone"].StartIndexLocation;
-		tower_top->BaseVertexLocation = tower_top->Geo->DrawArgs["cone"].BaseVertexLocation;
-		mRitemLayer[(int)RenderLayer::AlphaTested].push_back(tower_top.get());
-
-		mAllRitems.push_back(std::move(tower_base));
-		mAllRitems.push_back(std::move(tower_middle));
-		mAllRitems.push_back(std::move(tower_top));
-	}
-
-
-	//wall fence
-	float CL_fence = 35.0f;
-	float obj_loaction[4] = { 30.0f/2,30.0f/2, -30.0f/2, -30.0f/2 };
-
-	for (int i = 0; i < 4; ++i)
-	{
-
-		/*auto wall_obj_1 = std::make_unique<RenderItem>();
-		XMStoreFloat4x4(&wall_obj_1->World, XMMatrixTranslation(obj_loaction[i], 3.0f, 7.0f));
-		wall_obj_1->ObjCBIndex = objIndex++;
-		wall_obj_1->Mat = mMaterials["testcolor"].get();
-		wall_obj_1->Geo = mGeometries["boxGeo"].get();
-		wall_obj_1->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		wall_obj_1->IndexCount = wall_obj_1->Geo->DrawArgs["wedge"].IndexCount;
-		wall_obj_1->StartIndexLocation = wall_obj_1->Geo->DrawArgs["wedge"].StartIndexLocation;
-		wall_obj_1->BaseVertexLocation = wall_obj_1->Geo->DrawArgs["wedge"].BaseVertexLocation;
-		mRitemLayer[(int)RenderLayer::AlphaTested].push_back(wall_obj_1.get());
-
-		auto wall_obj_2 = std::make_unique<RenderItem>();
-		XMStoreFloat4x4(&wall_obj_2->World, XMMatrixTranslation(obj_loaction[i], 3.0f, -7.0f));
-		wall_obj_2->ObjCBIndex = objIndex++;
-		wall_obj_2->Mat = mMaterials["testcolor"].get();
-		wall_obj_2->Geo = mGeometries["boxGeo"].get();
-		wall_obj_2->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		wall_obj_2->IndexCount = wall_obj_2->Geo->DrawArgs["Pyramid_pointed_head"].IndexCount;
-		wall_obj_2->StartIndexLocation = wall_obj_2->Geo->DrawArgs["Pyramid_pointed_head"].StartIndexLocation;
-		wall_obj_2->BaseVertexLocation = wall_obj_2->Geo->DrawArgs["Pyramid_pointed_head"].BaseVertexLocation;
-		mRitemLayer[(int)RenderLayer::AlphaTested].push_back(wall_obj_2.get());*/
-
-		auto wall_obj_3 = std::make_unique<RenderItem>();
-		XMStoreFloat4x4(&wall_obj_3->World, XMMatrixScaling(2, 2, 2) * XMMatrixTranslation(-7.0f+ CL_fence, 8.0f, obj_loaction[i]));
-		wall_obj_3->ObjCBIndex = objIndex++;
-		wall_obj_3->Mat = mMaterials["wirefence"].get();
-		wall_obj_3->Geo = mGeometries["boxGeo"].get();
-		wall_obj_3->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		wall_obj_3->IndexCount = wall_obj_3->Geo->DrawArgs["box"].IndexCount;
-		wall_obj_3->StartIndexLocation = wall_obj_3->Geo->DrawArgs["box"].StartIndexLocation;
-		wall_obj_3->BaseVertexLocation = wall_obj_3->Geo->DrawArgs["box"].BaseVertexLocation;
-		mRitemLayer[(int)RenderLayer::AlphaTested].push_back(wall_obj_3.get());
-
-		auto wall_obj_4 = std::make_unique<RenderItem>();
-		XMStoreFloat4x4(&wall_obj_4->World, XMMatrixScaling(2, 2, 2) * XMMatrixTranslation(7.0f + CL_fence, 8.0f, obj_loaction[i]));
-		wall_obj_4->ObjCBIndex = objIndex++;
-		wall_obj_4->Mat = mMaterials["wirefence"].get();
-		wall_obj_4->Geo = mGeometries["boxGeo"].get();
-		wall_obj_4->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		wall_obj_4->IndexCount = wall_obj_4->Geo->DrawArgs["box"].IndexCount;
-		wall_obj_4->StartIndexLocation = wall_obj_4->Geo->DrawArgs["box"].StartIndexLocation;
-		wall_obj_4->BaseVertexLocation = wall_obj_4->Geo->DrawArgs["box"].BaseVertexLocation;
-		mRitemLayer[(int)RenderLayer::AlphaTested].push_back(wall_obj_4.get());
-
-
-		/*mAllRitems.push_back(std::move(wall_obj_1));
-		mAllRitems.push_back(std::move(wall_obj_2));*/
-		mAllRitems.push_back(std::move(wall_obj_3));
-		mAllRitems.push_back(std::move(wall_obj_4));
-
-	}
-
-
-	float CL_wall = 35.0f;
-
-	auto wall_one = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&wall_one->World, XMMatrixScaling(30.0f, 7.0f, 3.0f) * XMMatrixTranslation(0.0+ CL_wall, 4.0, 15.0));
-	wall_one->ObjCBIndex = objIndex++;
-	wall_one->Mat = mMaterials["bricks"].get();
-	wall_one->Geo = mGeometries["boxGeo"].get();
-	wall_one->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	wall_one->IndexCount = wall_one->Geo->DrawArgs["box"].IndexCount;
-	wall_one->StartIndexLocation = wall_one->Geo->DrawArgs["box"].StartIndexLocation;
-	wall_one->BaseVertexLocation = wall_one->Geo->DrawArgs["box"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::AlphaTested].push_back(wall_one.get());
-
-	auto wall_two = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&wall_two->World, XMMatrixScaling(30.0f, 7.0f, 3.0f)* XMMatrixTranslation(0.0 + CL_wall, 4.0, -15.0));
-	wall_two->ObjCBIndex = objIndex++;
-	wall_two->Mat = mMaterials["bricks"].get();
-	wall_two->Geo = mGeometries["boxGeo"].get();
-	wall_two->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	wall_two->IndexCount = wall_two->Geo->DrawArgs["box"].IndexCount;
-	wall_two->StartIndexLocation = wall_two->Geo->DrawArgs["box"].StartIndexLocation;
-	wall_two->BaseVertexLocation = wall_two->Geo->DrawArgs["box"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::AlphaTested].push_back(wall_two.get());
-
-	auto wall_three = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&wall_three->World, XMMatrixScaling(30.0f, 7.0f, 3.0f)* XMMatrixRotationY(XM_PIDIV2) * XMMatrixTranslation(15.0f + CL_wall, 4.0f, 0.0));
-	wall_three->ObjCBIndex = objIndex++;
-	wall_three->Mat = mMaterials["bricks"].get();
-	wall_three->Geo = mGeometries["boxGeo"].get();
-	wall_three->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	wall_three->IndexCount = wall_three->Geo->DrawArgs["box"].IndexCount;
-	wall_three->StartIndexLocation = wall_three->Geo->DrawArgs["box"].StartIndexLocation;
-	wall_three->BaseVertexLocation = wall_three->Geo->DrawArgs["box"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::AlphaTested].push_back(wall_three.get());
-
-	auto wall_four = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&wall_four->World, XMMatrixScaling(30.0f, 7.0f, 3.0f)* XMMatrixRotationY(XM_PIDIV2) * XMMatrixTranslation(-15.0f + CL_wall, 4.0f, 0.0f));
-	wall_four->ObjCBIndex = objIndex++;
-	wall_four->Mat = mMaterials["bricks"].get();
-	wall_four->Geo = mGeometries["boxGeo"].get();
-	wall_four->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	wall_four->IndexCount = wall_four->Geo->DrawArgs["box"].IndexCount;
-	wall_four->StartIndexLocation = wall_four->Geo->DrawArgs["box"].StartIndexLocation;
-	wall_four->BaseVertexLocation = wall_four->Geo->DrawArgs["box"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::AlphaTested].push_back(wall_four.get());
-
-
-	auto base_building = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&base_building->World, XMMatrixScaling(5/2, 5/2, 5/2)* XMMatrixTranslation(0.0f+CL_wall, 5.0f, 0.0f));
-	base_building->ObjCBIndex = objIndex++;
-	base_building->Mat = mMaterials["testcolor"].get();
-	base_building->Geo = mGeometries["boxGeo"].get();
-	base_building->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	base_building->IndexCount = base_building->Geo->DrawArgs["pointed_cylinder"].IndexCount;
-	base_building->StartIndexLocation = base_building->Geo->DrawArgs["pointed_cylinder"].StartIndexLocation;
-	base_building->BaseVertexLocation = base_building->Geo->DrawArgs["pointed_cylinder"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::AlphaTested].push_back(base_building.get());
-
-	auto baseRitem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&baseRitem->World, XMMatrixScaling(15.0f, 10.0f, 15.0f)* XMMatrixTranslation(0.0f + CL_wall, 0.0f, 0.0f));
-	baseRitem->ObjCBIndex = objIndex++;
-	baseRitem->Mat = mMaterials["checkboard"].get();
-	baseRitem->Geo = mGeometries["boxGeo"].get();
-	baseRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	baseRitem->IndexCount = baseRitem->Geo->DrawArgs["sphere"].IndexCount;
-	baseRitem->StartIndexLocation = baseRitem->Geo->DrawArgs["sphere"].StartIndexLocation;
-	baseRitem->BaseVertexLocation = baseRitem->Geo->DrawArgs["sphere"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::AlphaTested].push_back(baseRitem.get());
-
-
-	auto gateRitem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&gateRitem->World, XMMatrixScaling(4.0f, 5.0f, 12.0f) * XMMatrixTranslation(20.0, 3.0f, 0.0));
-	gateRitem->ObjCBIndex = objIndex++;
-	gateRitem->Mat = mMaterials["door"].get();
-	gateRitem->Geo = mGeometries["boxGeo"].get();
-	gateRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	gateRitem->IndexCount = gateRitem->Geo->DrawArgs["box"].IndexCount;
-	gateRitem->StartIndexLocation = gateRitem->Geo->DrawArgs["box"].StartIndexLocation;
-	gateRitem->BaseVertexLocation = gateRitem->Geo->DrawArgs["box"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::AlphaTested].push_back(gateRitem.get());
-
-
-	const std::vector<std::string> maze_data{
-		//i guess its looks not right... but it works meow meow moew````
-	   "#############################",
-	   "#     #               # #   #",
-	   "#  #  # ########   ##   # # #",
-	   "# #####        #####  ### # #",
-	   "#  #      #  ###   #      # #",
-	   "#  #   #  #  #              #",
-	   "## #   #  #  ####           #",
-	   "#      ####  #  #           #",
-	   "#  #   #        #           #",
-	   "#  #   ####  ####           #",
-	   "# ######     #              #",
-	   "#  #       #####            #",
-	   "# ######   #                #",
-	   "#  #   #   #  #####         #",
-	   "## # # #####      #    #    #",
-	   "#  # # #   ###  # #    #    #",
-	   "     #   #      #      #    #",
-	   " ############################",
+	// The land and the water are the large grids; at any time most of their triangles
+	// are outside the frustum or face away.
+	auto addItem = [this](RenderItem* ri, const void* positions, UINT stride, UINT vertexCount,
+		const MeshletBuildDesc& desc)
+	{
+		const MeshGeometry* geo = ri->Geo;
+		assert(geo->IndexFormat == DXGI_FORMAT_R16_UINT && ri->BaseVertexLocation == 0);
+
+		mMeshletItems.emplace_back();
+		MeshletCulledItem& culled = mMeshletItems.back();
+		culled.Item = ri;
+		culled.Indices = reinterpret_cast<const std::uint16_t*>(geo->IndexBufferCPU->GetBufferPointer()) +
+			ri->StartIndexLocation;
+		culled.IndexCount = ri->IndexCount;
+		culled.StartIndexLocation = ri->StartIndexLocation;
+		BuildMeshlets(desc, positions, stride, vertexCount, culled.Indices, culled.IndexCount, culled.Meshlets);
+
+		if (mMeshletIndices.size() < culled.IndexCount)
+			mMeshletIndices.resize(culled.IndexCount);
 	};
 
-	XMVECTOR maze_offset = XMVectorSet(-55.0f, -3.0f, 35.0f, 0.0);
-	XMVECTOR box_min = XMVectorSet(-0.5f, -0.5f, -0.5f, 1.0);
-	XMVECTOR box_max = XMVectorSet(0.5f, 0.5f, 0.5f, 1.0);
-	for (int j = 0; j < maze_data.size(); ++j)
+	if (mLandRitem != nullptr)
 	{
-		for (int i = 0; i < maze_data[j].size(); ++i)
+		const MeshGeometry* geo = mLandRitem->Geo;
+		addItem(mLandRitem, geo->VertexBufferCPU->GetBufferPointer(), geo->VertexByteStride,
+			geo->VertexBufferByteSize / geo->VertexByteStride, MeshletBuildDesc());
+	}
+
+	// The waves move their vertices up and down and change their normals, so the water's
+	// meshlets are built from the flat grid they start as and get no normal cones.
+	MeshletBuildDesc wavesDesc;
+	wavesDesc.BoundsMargin = gWavesMeshletMargin;
+	wavesDesc.NormalCones = false;
+	addItem(mWavesRitem, &mWaves->Position(0), sizeof(XMFLOAT3), (UINT)mWaves->VertexCount(), wavesDesc);
+}
+
+void TreeBillboardsApp::BuildLights()
+{
+	BuildDemoLights(mLighting);
+}
+
+void TreeBillboardsApp::BuildAmbientSH()
+{
+	// Without the cube map the ambient stays constant.
+	BuildDemoAmbientSH(L"../../Textures/grasscube1024.dds", mLighting);
+}
+
+void TreeBillboardsApp::BakeStaticLighting()
+{
+	// The maze walls are the only occluders; the land and the walls receive baked light.
+	for (const auto& bounds : MazeWalls)
+		mLightBaker.AddOccluder(bounds.first, bounds.second);
+
+	mBakeDesc.Lights = mLighting.DirLights.data();
+	mBakeDesc.NumDirLights = (int)mLighting.DirLights.size();
+	mBakeDesc.AmbientLight = mLighting.AmbientLight;
+	mBakeDesc.AmbientSH = &mLighting.AmbientSH;
+
+	// Startup bakes with fewer occlusion rays; RefineStaticLighting bakes with mBakeDesc.
+	LightBakeDesc startupDesc = mBakeDesc;
+	startupDesc.AoRayCount = gStartupBakeAoRays;
+
+	// One color buffer per geometry, holding a block for each baked item.
+	std::unordered_map<MeshGeometry*, std::vector<RenderItem*>> itemsByGeo;
+	for (auto ri : mRitemLayer[(int)RenderLayer::OpaqueBaked])
+		itemsByGeo[ri->Geo].push_back(ri);
+
+	std::vector<DemoBakeItem> bakeItems;
+	for (auto& entry : itemsByGeo)
+	{
+		MeshGeometry* geo = entry.first;
+		const std::vector<RenderItem*>& items = entry.second;
+		assert(geo->IndexFormat == DXGI_FORMAT_R16_UINT);
+
+		bakeItems.resize(items.size());
+		for (size_t n = 0; n < items.size(); ++n)
 		{
-			if (maze_data[j][i] == '#')
-			{
-				XMVECTOR wall_pos = XMVectorSet(i * 4.0f, 4.0f, -j * 4.0f, 0.0);
-				wall_pos = wall_pos + maze_offset;
-
-				XMMATRIX trans = XMMatrixTranslation(XMVectorGetX(wall_pos), XMVectorGetY(wall_pos),
-					XMVectorGetZ(wall_pos));
-				XMMATRIX scale = XMMatrixScaling(4.0f, 10.0f, 4.0f);
-				//XMMATRIX rotat = XMMatrixRotationY(XM_PIDIV2);
-				XMMATRIX mat = scale * trans;
-					//* rotat;
-
-				std::pair<XMVECTOR, XMVECTOR> bounds = {
-					XMVector4Transform(box_min, mat), XMVector4Transform(box_max, mat)
-				};
-				MazeWalls.push_back(bounds);
-
-				auto mazeRitem = std::make_unique<RenderItem>();
-
-				XMStoreFloat4x4(&mazeRitem->World, mat);
-				mazeRitem->ObjCBIndex = objIndex++;
-				mazeRitem->Mat = mMaterials["bricks"].get();
-				mazeRitem->Geo = mGeometries["boxGeo"].get();
-				mazeRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-				mazeRitem->IndexCount = mazeRitem->Geo->DrawArgs["box"].IndexCount;
-				mazeRitem->StartIndexLocation = mazeRitem->Geo->DrawArgs["box"].StartIndexLocation;
-				mazeRitem->BaseVertexLocation = mazeRitem->Geo->DrawArgs["box"].BaseVertexLocation;
-				mRitemLayer[(int)RenderLayer::Opaque].push_back(mazeRitem.get());
-				mAllRitems.push_back(std::move(mazeRitem));
-			}
+			bakeItems[n].World = items[n]->World;
+			bakeItems[n].Mat = items[n]->Mat;
+			bakeItems[n].IndexCount = items[n]->IndexCount;
+			bakeItems[n].StartIndexLocation = items[n]->StartIndexLocation;
+			bakeItems[n].BaseVertexLocation = items[n]->BaseVertexLocation;
 		}
-	}
 
+		mBakedGeometries.emplace_back();
+		BakedGeometry& baked = mBakedGeometries.back();
+		baked.Geo = geo;
+		BakeDemoGeometry(mLightBaker, startupDesc,
+			reinterpret_cast<const Vertex*>(geo->VertexBufferCPU->GetBufferPointer()),
+			reinterpret_cast<const std::uint16_t*>(geo->IndexBufferCPU->GetBufferPointer()),
+			bakeItems, baked);
+		for (size_t n = 0; n < items.size(); ++n)
+			items[n]->BakedLightOffset = bakeItems[n].BakedLightOffset;
 
+		const std::vector<XMFLOAT4>& colors = baked.Colors;
+		const UINT colorByteSize = (UINT)(colors.size() * sizeof(XMFLOAT4));
 
+		ThrowIfFailed(D3DCreateBlob(colorByteSize, &geo->ColorBufferCPU));
+		CopyMemory(geo->ColorBufferCPU->GetBufferPointer(), colors.data(), colorByteSize);
 
-	//////
-	//
-	/////
+		geo->ColorBufferGPU = CreateDefaultBuffer(colors.data(), colorByteSize, geo->ColorBufferUploader);
+
+		geo->ColorByteStride = sizeof(XMFLOAT4);
+		geo->ColorBufferByteSize = colorByteSize;
+	}
+
+	mRefinedLightingUploads.reserve(mBakedGeometries.size());
+}
+
+bool TreeBillboardsApp::RefineStaticLighting()
+{
+	// One slice rebakes up to gRefineBakeSliceVertices vertices of the current run.
+	BakedGeometry& baked = mBakedGeometries[mRefineGeometry];
+	const BakedGeometry::Run& run = baked.Runs[mRefineRun];
+	mRefineVertex = std::max(mRefineVertex, run.Start);
 
+	const size_t end = std::min(run.End, mRefineVertex + gRefineBakeSliceVertices);
+	mLightBaker.Bake(mBakeDesc, run.Mat, &baked.Positions[mRefineVertex], &baked.Normals[mRefineVertex],
+		end - mRefineVertex, &baked.Colors[mRefineVertex]);
+	mRefineVertex = end;
 
+	if (end < run.End)
+		return false;
 
-	auto treeSpritesRitem = std::make_unique<RenderItem>();
-	treeSpritesRitem->World = MathHelper::Identity4x4();
-	treeSpritesRitem->ObjCBIndex = objIndex++;
-	treeSpritesRitem->Mat = mMaterials["treeSprites"].get();
-	treeSpritesRitem->Geo = mGeometries["treeSpritesGeo"].get();
-	//step2
-	treeSpritesRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_POINTLIST;
-	treeSpritesRitem->IndexCount = treeSpritesRitem->Geo->DrawArgs["points"].IndexCount;
-	treeSpritesRitem->StartIndexLocation = treeSpritesRitem->Geo->DrawArgs["points"].StartIndexLocation;
-	treeSpritesRitem->BaseVertexLocation = treeSpritesRitem->Geo->DrawArgs["points"].BaseVertexLocation;
+	mRefineVertex = 0;
+	if (++mRefineRun < baked.Runs.size())
+		return false;
 
-	mRitemLayer[(int)RenderLayer::AlphaTestedTreeSprites].push_back(treeSpritesRitem.get());
+	// The geometry is done: the software rasterizer sees the new colors now, the GPU
+	// from the next frame on.
+	CopyMemory(baked.Geo->ColorBufferCPU->GetBufferPointer(), baked.Colors.data(), baked.Geo->ColorBufferByteSize);
+	mRefinedLightingUploads.push_back(baked.Geo);
 
-	mAllRitems.push_back(std::move(wavesRitem));
-	mAllRitems.push_back(std::move(gridRitem));
-	//mAllRitems.push_back(std::move(boxRitem));
-	mAllRitems.push_back(std::move(gateRitem));
-	mAllRitems.push_back(std::move(baseRitem));
-	mAllRitems.push_back(std::move(base_building));
-	mAllRitems.push_back(std::move(wall_one));
-	mAllRitems.push_back(std::move(wall_two));
-	mAllRitems.push_back(std::move(wall_three));
-	mAllRitems.push_back(std::move(wall_four));
-	mAllRitems.push_back(std::move(treeSpritesRitem));
+	mRefineRun = 0;
+	if (++mRefineGeometry < mBakedGeometries.size())
+		return false;
+
+	mRefineGeometry = 0;
+	return true;
 }
 
+void TreeBillboardsApp::UploadRefinedLighting()
+{
+	// The copy goes through the uploader of the startup bake, which the GPU finished
+	// with long ago, and is ordered after the earlier frames that read the old colors.
+	for (MeshGeometry* geo : mRefinedLightingUploads)
+	{
+		D3D12_SUBRESOURCE_DATA data = {};
+		data.pData = geo->ColorBufferCPU->GetBufferPointer();
+		data.RowPitch = geo->ColorBufferByteSize;
+		data.SlicePitch = data.RowPitch;
+
+		const CD3DX12_RESOURCE_BARRIER toCopyDest = CD3DX12_RESOURCE_BARRIER::Transition(geo->ColorBufferGPU.Get(),
+			D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_COPY_DEST);
+		mCommandList->ResourceBarrier(1, &toCopyDest);
+		UpdateSubresources<1>(mCommandList.Get(), geo->ColorBufferGPU.Get(), geo->ColorBufferUploader.Get(), 0, 0, 1, &data);
+		const CD3DX12_RESOURCE_BARRIER toGenericRead = CD3DX12_RESOURCE_BARRIER::Transition(geo->ColorBufferGPU.Get(),
+			D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_GENERIC_READ);
+		mCommandList->ResourceBarrier(1, &toGenericRead);
+
+		RenderStats::AddUpload(UploadKind::Other, geo->ColorBufferByteSize);
+	}
+	mRefinedLightingUploads.clear();
+}
 
-void TreeBillboardsApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems)
+const SoftwareTexture* TreeBillboardsApp::GetSoftwareTexture(int srvHeapIndex)
 {
-	UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
-	UINT matCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(MaterialConstants));
+	if (srvHeapIndex < 0 || srvHeapIndex >= DemoTextureCount)
+		return nullptr;
 
-	auto objectCB = mCurrFrameResource->ObjectCB->Resource();
-	auto matCB = mCurrFrameResource->MaterialCB->Resource();
+	if (mSoftwareTextures.empty())
+		mSoftwareTextures.resize(DemoTextureCount);
 
-	// For each render item...
-	for (size_t i = 0; i < ritems.size(); ++i)
+	auto& tex = mSoftwareTextures[srvHeapIndex];
+	if (tex == nullptr)
 	{
-		auto ri = ritems[i];
+		tex = std::make_unique<SoftwareTexture>();
+		if (!tex->Load(mTextures[gDemoTextures[srvHeapIndex].Name]->Filename))
+		{
+			::OutputDebugStringA((std::string("Software rasterizer cannot decode ") + gDemoTextures[srvHeapIndex].Name + "\n").c_str());
+		}
+	}
 
-		cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
-		cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
-		//step3
-		cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
+	return tex.get();
+}
 
-		CD3DX12_GPU_DESCRIPTOR_HANDLE tex(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
-		tex.Offset(ri->Mat->DiffuseSrvHeapIndex, mCbvSrvDescriptorSize);
+void TreeBillboardsApp::RenderSoftwareFrame(const std::wstring& filename)
+{
+	// The waves' vertex buffer only exists on the GPU; rebuild it as UpdateWaves does.
+	std::vector<Vertex> wavesVertices(mWaves->VertexCount());
+	WriteWavesVertices(*mWaves, wavesVertices.data());
+
+	// Same for the cloth.
+	std::vector<ClothVertex> clothVertices(mCloth.VertexCount());
+	mCloth.WriteVertices(0, mCloth.VertexCount(), clothVertices.data());
 
-		D3D12_GPU_VIRTUAL_ADDRESS objCBAddress = objectCB->GetGPUVirtualAddress() + ri->ObjCBIndex * objCBByteSize;
-		D3D12_GPU_VIRTUAL_ADDRESS matCBAddress = matCB->GetGPUVirtualAddress() + ri->Mat->MatCBIndex * matCBByteSize;
+	// And the crowd, skinned as in UpdateCrowd.
+	std::vector<SkinnedVertex> skinnedVertices(mCrowd.VertexCount());
+	mCrowd.Skin(skinnedVertices.data());
 
-		cmdList->SetGraphicsRootDescriptorTable(0, tex);
-		cmdList->SetGraphicsRootConstantBufferView(1, objCBAddress);
-		cmdList->SetGraphicsRootConstantBufferView(3, matCBAddress);
+	mSoftwareRasterizer.Resize(mClientWidth, mClientHeight);
+	mSoftwareRasterizer.BeginFrame(mMainPassCB, mClusteredLights ? &mLightClusters : nullptr);
+	mSoftwareRasterizer.Clear(mMainPassCB.FogColor);
 
-		cmdList->DrawIndexedInstanced(ri->IndexCount, 1, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
+	std::vector<SoftwareDrawItem> items;
+	for (const SoftwarePass& pass : SoftwarePasses)
+	{
+		items.clear();
+		for (const RenderItem* ri : mRitemLayer[(int)pass.Layer])
+		{
+			const MeshGeometry* geo = ri->Geo;
+
+			SoftwareDrawItem item;
+			item.World = ri->World;
+			item.TexTransform = ri->TexTransform;
+			item.Mat = ri->Mat;
+			item.DiffuseMap = GetSoftwareTexture(ri->Mat->DiffuseSrvHeapIndex);
+			item.VertexByteStride = geo->VertexByteStride;
+			if (ri == mWavesRitem)
+				item.Vertices = wavesVertices.data();
+			else if (geo == mClothGeo)
+				item.Vertices = clothVertices.data();
+			else if (geo == mCrowdGeo)
+				item.Vertices = skinnedVertices.data();
+			else
+				item.Vertices = geo->VertexBufferCPU->GetBufferPointer();
+			item.Indices = geo->IndexBufferCPU->GetBufferPointer();
+			item.Index32 = geo->IndexFormat == DXGI_FORMAT_R32_UINT;
+			// Once Update has culled, the meshlet items' ranges are in its frame's MeshletIB.
+			if (mCurrFrameResource != nullptr && mCurrFrameResource->MeshletIB != nullptr &&
+				ri->IndexBufferOverride.SizeInBytes != 0 &&
+				ri->IndexBufferOverride.BufferLocation == mCurrFrameResource->MeshletIB->Resource()->GetGPUVirtualAddress())
+			{
+				item.Indices = mCurrFrameResource->MeshletIB->MappedBytes();
+			}
+			item.IndexCount = ri->IndexCount;
+			item.StartIndexLocation = ri->StartIndexLocation;
+			item.BaseVertexLocation = ri->BaseVertexLocation;
+			if (ri->BakedLightOffset >= 0 && geo->ColorBufferCPU != nullptr)
+				item.BakedLight = reinterpret_cast<const XMFLOAT4*>(geo->ColorBufferCPU->GetBufferPointer()) + ri->BakedLightOffset;
+			items.push_back(item);
+		}
+
+		mSoftwareRasterizer.Draw(pass.Pipeline, items);
 	}
 
-	
+	if (!mSoftwareRasterizer.SaveImage(filename))
+	{
+		::OutputDebugStringA("Software rasterizer could not write the frame.\n");
+	}
+}
+
+void TreeBillboardsApp::ToggleFrameCapture()
+{
+	if (mFrameCapture.IsCapturing())
+	{
+		const bool ok = mFrameCapture.End();
+		char line[128];
+		sprintf_s(line, "Frame capture: %d frames, %.1f KiB%s\n", mFrameCapture.FrameCount(),
+			mFrameCapture.Bytes() / 1024.0, ok ? "" : ", write failed");
+		::OutputDebugStringA(line);
+		return;
+	}
+
+	std::vector<std::wstring> textures;
+	for (const DemoTexture& texture : gDemoTextures)
+		textures.push_back(mTextures[texture.Name]->Filename);
+	if (!mFrameCapture.Begin(L"FrameCapture.trace", textures))
+	{
+		::OutputDebugStringA("Cannot create FrameCapture.trace.\n");
+		return;
+	}
+
+	// Geometry whose vertex buffer Update points at a frame resource buffer.
+	mFrameCapture.SetDynamicGeometry(mWavesRitem->Geo, CaptureBuffer::WavesVB);
+	mFrameCapture.SetDynamicGeometry(mGeometries["particlesGeo"].get(), CaptureBuffer::ParticleVB);
+	mFrameCapture.SetDynamicGeometry(mClothGeo, CaptureBuffer::ClothVB);
+	mFrameCapture.SetDynamicGeometry(mCrowdGeo, CaptureBuffer::SkinnedVB);
+
+	// And the items whose indices it writes to the frame's MeshletIB.
+	for (const MeshletCulledItem& culled : mMeshletItems)
+		mFrameCapture.SetDynamicIndices(culled.Item, CaptureBuffer::MeshletIB);
+}
+
+void TreeBillboardsApp::CaptureFrame()
+{
+	// Same layers and order as DrawFrame.
+	const RenderLayer layers[] =
+	{
+		RenderLayer::Opaque, RenderLayer::OpaqueBaked, RenderLayer::AlphaTested,
+		RenderLayer::AlphaTestedTreeSprites, RenderLayer::Particles, RenderLayer::Transparent
+	};
+	for (RenderLayer layer : layers)
+		mFrameCapture.AddDraws(layer, mDrawLayer[(int)layer]);
+
+	mFrameCapture.EndFrame((std::uint32_t)mFrameAllocations.FrameIndex(), *mCurrFrameResource);
+}
+
+void TreeBillboardsApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems)
+{
+	// The list lives in the frame arena until Draw resets it.
+	const DrawCommand* drawList = BuildDrawList(ritems,
+		mCurrFrameResource->ObjectCB->Resource()->GetGPUVirtualAddress(),
+		mCurrFrameResource->MaterialCB->Resource()->GetGPUVirtualAddress(),
+		ThreadFrameArena());
+	if (drawList == nullptr)
+		return;
+
+	SubmitDrawList(cmdList, drawList, ritems.size(),
+		mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart(), mCbvSrvDescriptorSize);
 }
 
 std::array<const CD3DX12_STATIC_SAMPLER_DESC, 6> TreeBillboardsApp::GetStaticSamplers()
@@ -1950,22 +2511,3 @@ std::array<const CD3DX12_STATIC_SAMPLER_DESC, 6> TreeBillboardsApp::GetStaticSam
 		linearWrap, linearClamp,
 		anisotropicWrap, anisotropicClamp };
 }
-
-float TreeBillboardsApp::GetHillsHeight(float x, float z)const
-{
-	return 0.3f * (z * sinf(0.1f * x) + x * cosf(0.1f * z));
-}
-
-XMFLOAT3 TreeBillboardsApp::GetHillsNormal(float x, float z)const
-{
-	// n = (-df/dx, 1, -df/dz)
-	XMFLOAT3 n(
-		-0.03f * z * cosf(0.1f * x) - 0.3f * cosf(0.1f * z),
-		1.0f,
-		-0.3f * sinf(0.1f * x) + 0.03f * x * sinf(0.1f * z));
-
-	XMVECTOR unitNormal = XMVector3Normalize(XMLoadFloat3(&n));
-	XMStoreFloat3(&n, unitNormal);
-
-	return n;
-}
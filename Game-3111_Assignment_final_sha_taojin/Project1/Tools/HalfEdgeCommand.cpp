@@ -0,0 +1,287 @@
+//***************************************************************************************
+// HalfEdgeCommand.cpp
+//
+// Builds the half-edge mesh of a generated mesh (a sphere by default) or a model file and
+// checks it: twins point back and share the edge, rotation around each vertex visits
+// every outgoing half-edge once, and the Euler characteristic is the one of the shape.
+// Then it subdivides with both schemes, checking the counts of the result, that the new
+// positions stay inside the old bounds, and that the normals are unit length (and point
+// outward on a sphere).  Prints the counts and the build and subdivision times next to
+// GeometryGenerator::Subdivide.  Returns 1 if a check fails.
+//***************************************************************************************
+
+#include "ToolCommands.h"
+#include "../Project1/HalfEdgeMesh.h"
+#include "../Project1/MeshImporter.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+using namespace DirectX;
+
+namespace
+{
+	// Euler characteristic of the generated shapes: closed ones are spheres, the grid a
+	// disk.  INT32_MIN for a model file, which could be anything.
+	const int UnknownEuler = -0x7fffffff - 1;
+
+	bool LoadTestMesh(const std::string& name, int size, GeometryGenerator::MeshData& data, int& euler)
+	{
+		GeometryGenerator geoGen;
+		euler = 2;
+		if (name == "sphere")
+			data = geoGen.CreateSphere(10.0f, size, size);
+		else if (name == "geosphere")
+			data = geoGen.CreateGeosphere(10.0f, 3);
+		else if (name == "box")
+			data = geoGen.CreateBox(10.0f, 10.0f, 10.0f, 2);
+		else if (name == "grid")
+		{
+			data = geoGen.CreateGrid(120.0f, 120.0f, size, size);
+			euler = 1;
+		}
+		else
+		{
+			MeshImporter importer;
+			ImportedMesh imported;
+			if (!importer.Import(std::wstring(name.begin(), name.end()), imported))
+			{
+				std::fprintf(stderr, "%s: %s\n", name.c_str(), importer.Error().c_str());
+				return false;
+			}
+			data.Vertices.resize(imported.Vertices.size());
+			for (size_t i = 0; i < imported.Vertices.size(); ++i)
+			{
+				data.Vertices[i].Position = imported.Vertices[i].Pos;
+				data.Vertices[i].TexC = imported.Vertices[i].TexC;
+			}
+			data.Indices32 = imported.Indices;
+			euler = UnknownEuler;
+		}
+		return true;
+	}
+
+	double MsSince(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	int EulerCharacteristic(const HalfEdgeMesh& mesh)
+	{
+		return (int)mesh.VertexCount() - (int)mesh.EdgeCount() + (int)mesh.FaceCount();
+	}
+
+	void PrintCounts(const char* label, const HalfEdgeMesh& mesh)
+	{
+		std::printf("  %-14s %8u vertices %8u edges %8u faces, %u boundary and %u non-manifold edges\n", label,
+			mesh.VertexCount(), mesh.EdgeCount(), mesh.FaceCount(), mesh.BoundaryEdgeCount(), mesh.NonManifoldEdgeCount());
+	}
+}
+
+int RunHalfEdgeCommand(const ToolArgs& args)
+{
+	const std::string name = args.GetString("mesh", "sphere");
+	const int size = std::max(args.GetInt("size", 20), 3);
+	const int levels = std::max(args.GetInt("levels", 2), 1);
+	const float weld = args.GetFloat("weld", 1e-5f);
+	const float eps = 1e-3f;
+
+	int failures = 0;
+	auto fail = [&](const char* what, const char* label)
+	{
+		if (failures++ < 10)
+			std::printf("  %s: %s\n", label, what);
+	};
+
+	GeometryGenerator::MeshData data;
+	int euler = 0;
+	if (!LoadTestMesh(name, size, data, euler))
+		return 1;
+
+	HalfEdgeMesh base;
+	auto buildStart = std::chrono::steady_clock::now();
+	if (!base.Build(data, weld))
+	{
+		std::fprintf(stderr, "%s: %s\n", name.c_str(), base.Error().c_str());
+		return 1;
+	}
+	const double buildMs = MsSince(buildStart);
+
+	std::printf("halfedge %s: %zu vertices, %zu triangles before welding\n", name.c_str(),
+		data.Vertices.size(), data.Indices32.size() / 3);
+	PrintCounts("built", base);
+
+	// Connectivity: twins, edges, rotations and the shape as a whole.
+	auto checkConnectivity = [&](const HalfEdgeMesh& mesh, const char* label)
+	{
+		const std::vector<HalfEdgeMesh::HalfEdge>& halfEdges = mesh.HalfEdges();
+		for (std::uint32_t h = 0; h < mesh.HalfEdgeCount(); ++h)
+		{
+			const std::uint32_t twin = halfEdges[h].Twin;
+			if (mesh.Next(mesh.Prev(h)) != h || halfEdges[mesh.Next(h)].Face != halfEdges[h].Face)
+				fail("next and previous half-edges disagree", label);
+			if (twin == HalfEdgeMesh::Invalid)
+				continue;
+			if (halfEdges[twin].Twin != h || halfEdges[twin].Origin != mesh.Dest(h) || halfEdges[twin].Edge != halfEdges[h].Edge)
+				fail("twin does not point back along the same edge", label);
+		}
+
+		std::uint32_t boundary = 0;
+		for (std::uint32_t e = 0; e < mesh.EdgeCount(); ++e)
+		{
+			if (halfEdges[mesh.EdgeHalfEdge(e)].Edge != e)
+				fail("edge numbering does not match its half-edge", label);
+			boundary += mesh.IsBoundaryEdge(e);
+		}
+		if (boundary != mesh.BoundaryEdgeCount())
+			fail("boundary edge count is off", label);
+
+		if (mesh.NonManifoldEdgeCount() == 0)
+		{
+			std::vector<std::uint32_t> visits(mesh.HalfEdgeCount(), 0);
+			for (std::uint32_t v = 0; v < mesh.VertexCount(); ++v)
+			{
+				mesh.ForEachOutgoing(v, [&](std::uint32_t h)
+				{
+					if (halfEdges[h].Origin != v)
+						fail("rotation left the vertex", label);
+					++visits[h];
+				});
+			}
+			if (std::any_of(visits.begin(), visits.end(), [](std::uint32_t n) { return n != 1; }))
+				fail("rotation does not visit each outgoing half-edge once", label);
+			if (euler != UnknownEuler && EulerCharacteristic(mesh) != euler)
+				fail("Euler characteristic is wrong for the shape", label);
+		}
+	};
+
+	// Positions: the schemes take averages, so nothing leaves the old bounds.  Normals are
+	// unit length and, on a sphere, point away from its center.
+	auto checkGeometry = [&](const HalfEdgeMesh& mesh, const HalfEdgeMesh& before, const char* label)
+	{
+		XMVECTOR lo = XMVectorReplicate(1e30f);
+		XMVECTOR hi = XMVectorReplicate(-1e30f);
+		for (const XMFLOAT3& p : before.Positions())
+		{
+			lo = XMVectorMin(lo, XMLoadFloat3(&p));
+			hi = XMVectorMax(hi, XMLoadFloat3(&p));
+		}
+		lo = XMVectorSubtract(lo, XMVectorReplicate(eps));
+		hi = XMVectorAdd(hi, XMVectorReplicate(eps));
+
+		const bool sphere = name == "sphere" || name == "geosphere";
+		for (std::uint32_t v = 0; v < mesh.VertexCount(); ++v)
+		{
+			const XMVECTOR p = XMLoadFloat3(&mesh.Positions()[v]);
+			const XMVECTOR n = XMLoadFloat3(&mesh.Normals()[v]);
+			if (!XMVector3GreaterOrEqual(p, lo) || !XMVector3LessOrEqual(p, hi))
+				fail("vertex moved outside the old bounds", label);
+			if (std::fabs(XMVectorGetX(XMVector3Length(n)) - 1.0f) > eps)
+				fail("normal is not unit length", label);
+			if (sphere && XMVectorGetX(XMVector3Dot(n, p)) <= 0.0f)
+				fail("normal points into the sphere", label);
+		}
+	};
+
+	checkConnectivity(base, "built");
+	checkGeometry(base, base, "built");
+
+	// Round trip through a triangle list: the same vertices and shape come back.
+	{
+		const GeometryGenerator::MeshData triangles = base.ToMeshData();
+		HalfEdgeMesh rebuilt;
+		if (!rebuilt.Build(triangles, weld) || rebuilt.VertexCount() != base.VertexCount() ||
+			EulerCharacteristic(rebuilt) != EulerCharacteristic(base))
+		{
+			fail("mesh data does not build back into the same mesh", "round trip");
+		}
+	}
+
+	bool allTriangles = true;
+	for (std::uint32_t f = 0; f < base.FaceCount(); ++f)
+		allTriangles = allTriangles && base.FaceSize(f) == 3;
+
+	// Loop: V' = V + E, E' = 2E + 3F, F' = 4F, and each boundary edge splits in two.
+	double loopMs = 0.0;
+	if (allTriangles)
+	{
+		HalfEdgeMesh current = base;
+		for (int level = 0; level < levels; ++level)
+		{
+			HalfEdgeMesh next;
+			const auto start = std::chrono::steady_clock::now();
+			if (!current.SubdivideLoop(next))
+			{
+				std::fprintf(stderr, "loop: %s\n", next.Error().c_str());
+				return 1;
+			}
+			loopMs += MsSince(start);
+
+			if (next.VertexCount() != current.VertexCount() + current.EdgeCount() ||
+				next.EdgeCount() != 2*current.EdgeCount() + 3*current.FaceCount() ||
+				next.FaceCount() != 4*current.FaceCount() ||
+				next.BoundaryEdgeCount() != 2*current.BoundaryEdgeCount())
+			{
+				fail("counts after subdividing are wrong", "loop");
+			}
+			checkConnectivity(next, "loop");
+			checkGeometry(next, current, "loop");
+			current = std::move(next);
+		}
+		PrintCounts("loop", current);
+	}
+	else
+	{
+		std::printf("  loop: skipped, the mesh has faces that are not triangles\n");
+	}
+
+	// Catmull-Clark: V' = V + E + F, E' = 2E + H, F' = H.
+	double catmullClarkMs = 0.0;
+	{
+		HalfEdgeMesh current = base;
+		for (int level = 0; level < levels; ++level)
+		{
+			HalfEdgeMesh next;
+			const auto start = std::chrono::steady_clock::now();
+			current.SubdivideCatmullClark(next);
+			catmullClarkMs += MsSince(start);
+
+			if (next.VertexCount() != current.VertexCount() + current.EdgeCount() + current.FaceCount() ||
+				next.EdgeCount() != 2*current.EdgeCount() + current.HalfEdgeCount() ||
+				next.FaceCount() != current.HalfEdgeCount() ||
+				next.BoundaryEdgeCount() != 2*current.BoundaryEdgeCount())
+			{
+				fail("counts after subdividing are wrong", "catmull-clark");
+			}
+			checkConnectivity(next, "catmull-clark");
+			checkGeometry(next, current, "catmull-clark");
+			current = std::move(next);
+		}
+		PrintCounts("catmull-clark", current);
+	}
+
+	// GeometryGenerator's midpoint split, which neither shares nor smooths vertices.
+	double midpointMs = 0.0;
+	{
+		GeometryGenerator geoGen;
+		GeometryGenerator::MeshData midpoint = data;
+		const auto start = std::chrono::steady_clock::now();
+		for (int level = 0; level < levels; ++level)
+			geoGen.Subdivide(midpoint);
+		midpointMs = MsSince(start);
+		std::printf("  %-14s %8zu vertices %15s%8zu faces\n", "midpoint", midpoint.Vertices.size(), "", midpoint.Indices32.size() / 3);
+	}
+
+	std::printf("  build:         %10.3f ms\n", buildMs);
+	std::printf("  loop:          %10.3f ms for %d levels\n", loopMs, allTriangles ? levels : 0);
+	std::printf("  catmull-clark: %10.3f ms for %d levels\n", catmullClarkMs, levels);
+	std::printf("  midpoint:      %10.3f ms for %d levels\n", midpointMs, levels);
+
+	if (failures > 0)
+	{
+		std::printf("  %d checks failed\n", failures);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,200 @@
+//***************************************************************************************
+// MemoryCommand.cpp
+//
+// Checks the memory accounting against scenes whose sizes are known up front: frame
+// resources and upload buffers created without a device, geometry with CPU copies of
+// known size, and with --gpu a few resources on a real device.  Prints expected and
+// accounted bytes per check and returns 1 if any differ, so CI can run it headless.
+//***************************************************************************************
+
+#include "ToolCommands.h"
+#include "../Project1/FrameResource.h"
+#include "../../Common/GeometryGenerator.h"
+#include <algorithm>
+#include <cstdio>
+
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+	struct MemoryCheck
+	{
+		int Failures = 0;
+
+		void Expect(const char* what, std::uint64_t accounted, std::uint64_t expected)
+		{
+			const bool ok = accounted == expected;
+			std::printf("  %-44s %12llu %12llu  %s\n", what, (unsigned long long)accounted,
+				(unsigned long long)expected, ok ? "ok" : "MISMATCH");
+			if (!ok)
+				++Failures;
+		}
+
+		void ExpectTrue(const char* what, bool condition)
+		{
+			std::printf("  %-70s %s\n", what, condition ? "ok" : "FAILED");
+			if (!condition)
+				++Failures;
+		}
+	};
+
+	std::uint64_t Bytes(const MemorySummary& summary, MemoryCategory category, MemoryResidency residency)
+	{
+		return summary.Bytes[(int)category][(int)residency];
+	}
+
+	// Box geometry with system memory copies of the vertices and indices, like the demo
+	// keeps before and after uploading.
+	std::unique_ptr<MeshGeometry> MakeBoxGeometry(const std::string& name, std::uint64_t& cpuBytes)
+	{
+		GeometryGenerator geoGen;
+		GeometryGenerator::MeshData box = geoGen.CreateBox(1.0f, 1.0f, 1.0f, 3);
+		std::vector<std::uint16_t> indices = box.GetIndices16();
+
+		auto geo = std::make_unique<MeshGeometry>();
+		geo->Name = name;
+		geo->VertexByteStride = sizeof(Vertex);
+		geo->VertexBufferByteSize = (UINT)(box.Vertices.size()*sizeof(Vertex));
+		geo->IndexBufferByteSize = (UINT)(indices.size()*sizeof(std::uint16_t));
+
+		ThrowIfFailed(D3DCreateBlob(geo->VertexBufferByteSize, &geo->VertexBufferCPU));
+		ThrowIfFailed(D3DCreateBlob(geo->IndexBufferByteSize, &geo->IndexBufferCPU));
+		cpuBytes = geo->VertexBufferByteSize + geo->IndexBufferByteSize;
+		return geo;
+	}
+
+	void CheckHeadlessScene(const ToolArgs& args, MemoryCheck& check)
+	{
+		const UINT objectCount = (UINT)std::max(args.GetInt("objects", 5000), 1);
+		const UINT materialCount = (UINT)std::max(args.GetInt("materials", 64), 1);
+		const UINT wavesSize = (UINT)std::max(args.GetInt("waves", 128), 2);
+		const UINT wavesVertices = wavesSize*wavesSize;
+		const int geometryCount = std::max(args.GetInt("geometries", 8), 0);
+
+		const MemorySummary before = MemoryAccounting::Summarize();
+		check.Expect("nothing tracked before the scene", before.Total(), 0);
+
+		std::vector<std::unique_ptr<FrameResource>> frameResources;
+		for (int i = 0; i < gNumFrameResources; ++i)
+		{
+			frameResources.push_back(std::make_unique<FrameResource>(nullptr,
+				1, objectCount, materialCount, wavesVertices));
+		}
+
+		const std::uint64_t frameResourceBytes =
+			d3dUtil::CalcConstantBufferByteSize(sizeof(PassConstants)) +
+			(std::uint64_t)materialCount*d3dUtil::CalcConstantBufferByteSize(sizeof(MaterialConstants)) +
+			(std::uint64_t)objectCount*d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants)) +
+			LightClusterGrid::MaxClusterLights*sizeof(Light) +
+			LightClusterGrid::ClusterCount*sizeof(DirectX::XMUINT2) +
+			LightClusterGrid::MaxLightIndices*sizeof(UINT) +
+			(std::uint64_t)wavesVertices*sizeof(Vertex);
+
+		std::uint64_t geometryBytes = 0;
+		std::vector<std::unique_ptr<MeshGeometry>> geometries;
+		for (int i = 0; i < geometryCount; ++i)
+		{
+			std::uint64_t bytes = 0;
+			geometries.push_back(MakeBoxGeometry("box" + std::to_string(i), bytes));
+			geometryBytes += bytes;
+		}
+
+		UploadBuffer<ObjectConstants> instances(nullptr, 100, true);
+		UploadBuffer<Vertex> particles(nullptr, 1000, false);
+
+		// Textures without a device hold nothing but must not break the walk.
+		Texture texture;
+		texture.Name = "unloaded";
+
+		const MemorySummary scene = MemoryAccounting::Summarize();
+		check.Expect("frame resources, system memory", Bytes(scene, MemoryCategory::FrameResource, MemoryResidency::System),
+			gNumFrameResources*frameResourceBytes);
+		check.Expect("geometry CPU copies", Bytes(scene, MemoryCategory::Geometry, MemoryResidency::System), geometryBytes);
+		check.Expect("standalone upload buffers", Bytes(scene, MemoryCategory::UploadBuffer, MemoryResidency::System),
+			100 * d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants)) + 1000 * sizeof(Vertex));
+		check.Expect("textures", scene.Total(MemoryCategory::Texture), 0);
+		check.Expect("GPU heaps without a device",
+			scene.Total(MemoryResidency::UploadHeap) + scene.Total(MemoryResidency::DefaultHeap), 0);
+
+		std::vector<MemoryEntry> entries;
+		MemoryAccounting::Collect(entries);
+		int boxEntries = 0;
+		for (const MemoryEntry& e : entries)
+		{
+			if (e.Category == MemoryCategory::Geometry && e.Asset.compare(0, 3, "box") == 0)
+				++boxEntries;
+		}
+		check.Expect("geometry entries tagged with their asset", (std::uint64_t)boxEntries, 2 * (std::uint64_t)geometryCount);
+
+		if (args.Has("dump"))
+			std::printf("\n%s\n", MemoryAccounting::Dump().c_str());
+
+		// Dropping half the frame resources and a geometry must show up immediately.
+		frameResources.resize(1);
+		std::uint64_t droppedBytes = 0;
+		if (!geometries.empty())
+		{
+			droppedBytes = geometries.back()->VertexBufferCPU->GetBufferSize() + geometries.back()->IndexBufferCPU->GetBufferSize();
+			geometries.pop_back();
+		}
+		const MemorySummary partial = MemoryAccounting::Summarize();
+		check.Expect("after releasing frame resources", Bytes(partial, MemoryCategory::FrameResource, MemoryResidency::System),
+			frameResourceBytes);
+		check.Expect("after releasing one geometry", Bytes(partial, MemoryCategory::Geometry, MemoryResidency::System),
+			geometryBytes - droppedBytes);
+	}
+
+	void CheckDeviceScene(MemoryCheck& check)
+	{
+		ComPtr<ID3D12Device> device;
+		if (FAILED(D3D12CreateDevice(nullptr, D3D_FEATURE_LEVEL_11_0, IID_PPV_ARGS(&device))))
+		{
+			std::printf("  no D3D12 device; skipping the GPU checks\n");
+			return;
+		}
+
+		const MemorySummary before = MemoryAccounting::Summarize();
+
+		// Committed buffers are placed on 64 KB boundaries.
+		UploadBuffer<ObjectConstants> objectCB(device.Get(), 10, true);
+		const std::uint64_t objectCBBytes = MemoryAccounting::ResourceBytes(objectCB.Resource());
+		check.ExpectTrue("upload buffer rounded up to 64 KB",
+			objectCBBytes >= objectCB.ByteSize() && objectCBBytes % (64 * 1024) == 0);
+
+		Texture texture;
+		texture.Name = "checker";
+		const CD3DX12_HEAP_PROPERTIES defaultHeap(D3D12_HEAP_TYPE_DEFAULT);
+		const CD3DX12_RESOURCE_DESC texDesc = CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R8G8B8A8_UNORM, 256, 256, 1, 1);
+		ThrowIfFailed(device->CreateCommittedResource(&defaultHeap, D3D12_HEAP_FLAG_NONE, &texDesc,
+			D3D12_RESOURCE_STATE_COMMON, nullptr, IID_PPV_ARGS(&texture.Resource)));
+		const std::uint64_t textureBytes = device->GetResourceAllocationInfo(0, 1, &texDesc).SizeInBytes;
+
+		const MemorySummary scene = MemoryAccounting::Summarize();
+		check.Expect("upload buffer, upload heap",
+			Bytes(scene, MemoryCategory::UploadBuffer, MemoryResidency::UploadHeap) -
+			Bytes(before, MemoryCategory::UploadBuffer, MemoryResidency::UploadHeap), objectCBBytes);
+		check.Expect("texture, default heap", Bytes(scene, MemoryCategory::Texture, MemoryResidency::DefaultHeap), textureBytes);
+		check.ExpectTrue("texture at least its texel size", textureBytes >= 256 * 256 * 4);
+	}
+}
+
+int RunMemoryCommand(const ToolArgs& args)
+{
+	MemoryCheck check;
+
+	std::printf("  %-44s %12s %12s\n", "memory accounting", "accounted", "expected");
+	CheckHeadlessScene(args, check);
+
+	if (args.Has("gpu"))
+		CheckDeviceScene(check);
+
+	check.Expect("nothing tracked after the scene", MemoryAccounting::Summarize().Total(), 0);
+
+	if (check.Failures != 0)
+	{
+		std::printf("%d accounting checks failed\n", check.Failures);
+		return 1;
+	}
+	std::printf("all accounting checks passed\n");
+	return 0;
+}
@@ -0,0 +1,251 @@
+//***************************************************************************************
+// MeshletCommand.cpp
+//
+// Builds the meshlets of a generated mesh (the land grid by default) or a model file and
+// checks them: every triangle lands in exactly one meshlet, the limits hold, the local
+// indices are in range and the spheres contain their vertices.  Then it culls from random
+// views and checks each rejection against the triangles themselves: a meshlet outside
+// the frustum has every vertex outside one plane, one rejected by its cone has every
+// triangle facing away from the eye.  Prints the meshlet counts, the share of triangles
+// culled and the build and cull times.  Returns 1 if a check fails.
+//***************************************************************************************
+
+#include "ToolCommands.h"
+#include "../Project1/Meshlets.h"
+#include "../Project1/MeshImporter.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+using namespace DirectX;
+
+namespace
+{
+	struct TestMesh
+	{
+		std::vector<XMFLOAT3> Positions;
+		std::vector<std::uint32_t> Indices;
+	};
+
+	bool LoadTestMesh(const std::string& name, int size, TestMesh& mesh)
+	{
+		GeometryGenerator geoGen;
+		GeometryGenerator::MeshData data;
+		if (name == "grid")
+			data = geoGen.CreateGrid(120.0f, 120.0f, size, size);
+		else if (name == "sphere")
+			data = geoGen.CreateSphere(10.0f, size, size);
+		else if (name == "geosphere")
+			data = geoGen.CreateGeosphere(10.0f, 4);
+		else if (name == "box")
+			data = geoGen.CreateBox(10.0f, 10.0f, 10.0f, 4);
+		else
+		{
+			MeshImporter importer;
+			ImportedMesh imported;
+			if (!importer.Import(std::wstring(name.begin(), name.end()), imported))
+			{
+				std::fprintf(stderr, "%s: %s\n", name.c_str(), importer.Error().c_str());
+				return false;
+			}
+			for (const MeshVertex& v : imported.Vertices)
+				mesh.Positions.push_back(v.Pos);
+			mesh.Indices = imported.Indices;
+			return true;
+		}
+
+		for (const GeometryGenerator::Vertex& v : data.Vertices)
+			mesh.Positions.push_back(v.Position);
+		mesh.Indices = data.Indices32;
+		return true;
+	}
+
+	std::array<std::uint32_t, 3> CanonicalTriangle(std::uint32_t a, std::uint32_t b, std::uint32_t c)
+	{
+		// Rotated so the smallest index is first, which keeps the winding.
+		if (b < a && b <= c)
+			return { b, c, a };
+		if (c < a && c < b)
+			return { c, a, b };
+		return { a, b, c };
+	}
+}
+
+int RunMeshletCommand(const ToolArgs& args)
+{
+	const std::string name = args.GetString("mesh", "grid");
+	const int size = std::max(args.GetInt("size", 50), 3);
+	const int views = std::max(args.GetInt("views", 200), 1);
+	const float eps = 1e-3f;
+
+	MeshletBuildDesc desc;
+	desc.MaxVertices = (std::uint32_t)std::min(std::max(args.GetInt("max-vertices", 64), 3), 254);
+	desc.MaxTriangles = (std::uint32_t)std::max(args.GetInt("max-triangles", 124), 1);
+
+	TestMesh test;
+	if (!LoadTestMesh(name, size, test))
+		return 1;
+	const std::uint32_t triangleCount = (std::uint32_t)test.Indices.size() / 3;
+
+	MeshletMesh mesh;
+	const auto buildStart = std::chrono::steady_clock::now();
+	BuildMeshlets(desc, test.Positions.data(), sizeof(XMFLOAT3), (std::uint32_t)test.Positions.size(),
+		test.Indices.data(), (std::uint32_t)test.Indices.size(), mesh);
+	const double buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - buildStart).count();
+
+	int failures = 0;
+	auto fail = [&](const char* what, size_t meshlet)
+	{
+		if (failures++ < 10)
+			std::printf("  meshlet %zu: %s\n", meshlet, what);
+	};
+
+	// Structure: limits, local indices, spheres, and the triangles as a whole.
+	std::vector<std::array<std::uint32_t, 3>> built;
+	size_t coneCount = 0;
+	for (size_t m = 0; m < mesh.Meshlets.size(); ++m)
+	{
+		const Meshlet& meshlet = mesh.Meshlets[m];
+		const MeshletBounds& bounds = mesh.Bounds[m];
+		if (meshlet.VertexCount > desc.MaxVertices || meshlet.TriangleCount > desc.MaxTriangles ||
+			meshlet.TriangleCount == 0)
+		{
+			fail("over the limits or empty", m);
+		}
+		if (bounds.ConeCutoff < 1.0f)
+			++coneCount;
+
+		for (std::uint32_t k = 0; k < meshlet.VertexCount; ++k)
+		{
+			const XMVECTOR p = XMLoadFloat3(&test.Positions[mesh.Vertices[meshlet.VertexOffset + k]]);
+			if (XMVectorGetX(XMVector3Length(XMVectorSubtract(p, XMLoadFloat3(&bounds.Center)))) > bounds.Radius + eps)
+				fail("vertex outside the sphere", m);
+		}
+
+		for (std::uint32_t t = 0; t < meshlet.TriangleCount; ++t)
+		{
+			std::uint32_t v[3];
+			for (int k = 0; k < 3; ++k)
+			{
+				const std::uint8_t local = mesh.Triangles[(meshlet.TriangleOffset + t)*3 + k];
+				if (local >= meshlet.VertexCount)
+				{
+					fail("local index out of range", m);
+					v[k] = 0;
+				}
+				else
+				{
+					v[k] = mesh.Vertices[meshlet.VertexOffset + local];
+				}
+			}
+			built.push_back(CanonicalTriangle(v[0], v[1], v[2]));
+		}
+	}
+
+	std::vector<std::array<std::uint32_t, 3>> source;
+	for (std::uint32_t t = 0; t < triangleCount; ++t)
+		source.push_back(CanonicalTriangle(test.Indices[3*t], test.Indices[3*t + 1], test.Indices[3*t + 2]));
+	std::sort(built.begin(), built.end());
+	std::sort(source.begin(), source.end());
+	if (built != source)
+		fail("the meshlets' triangles differ from the mesh's", 0);
+
+	// Culling from random views around the mesh, each rejection checked per vertex.
+	XMVECTOR lo = XMVectorReplicate(1e30f);
+	XMVECTOR hi = XMVectorReplicate(-1e30f);
+	for (const XMFLOAT3& p : test.Positions)
+	{
+		lo = XMVectorMin(lo, XMLoadFloat3(&p));
+		hi = XMVectorMax(hi, XMLoadFloat3(&p));
+	}
+	const XMVECTOR center = XMVectorScale(XMVectorAdd(lo, hi), 0.5f);
+	const float extent = std::max(XMVectorGetX(XMVector3Length(XMVectorSubtract(hi, lo))), 1.0f);
+
+	std::mt19937 rng((unsigned)args.GetInt("seed", 1));
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	std::vector<std::uint32_t> compacted(mesh.IndexCount());
+	MeshletCullStats totals;
+	double cullMs = 0.0;
+
+	for (int i = 0; i < views; ++i)
+	{
+		const XMVECTOR eye = XMVectorAdd(center, XMVectorSet(unit(rng)*extent, unit(rng)*extent*0.5f, unit(rng)*extent, 0.0f));
+		const XMVECTOR target = XMVectorAdd(center, XMVectorSet(unit(rng)*extent*0.5f, 0.0f, unit(rng)*extent*0.5f, 0.0f));
+		if (XMVectorGetX(XMVector3LengthSq(XMVectorSubtract(target, eye))) < 1e-4f)
+			continue;
+		const XMMATRIX view = XMMatrixLookAtLH(eye, target, XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+		const XMMATRIX proj = XMMatrixPerspectiveFovLH(0.25f*XM_PI, 16.0f / 9.0f, 1.0f, extent*4.0f);
+		const MeshletCullView cullView = MakeMeshletCullView(XMMatrixIdentity(), XMMatrixMultiply(view, proj), eye);
+
+		const auto cullStart = std::chrono::steady_clock::now();
+		MeshletCullStats stats;
+		const std::uint32_t written = CullMeshlets(mesh, cullView, compacted.data(), &stats);
+		cullMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - cullStart).count();
+		totals.Add(stats);
+		if (written != stats.Triangles*3)
+			fail("compacted index count does not match the kept triangles", 0);
+
+		for (size_t m = 0; m < mesh.Meshlets.size(); ++m)
+		{
+			bool coneCulled = false;
+			if (MeshletVisible(mesh.Bounds[m], cullView, &coneCulled))
+				continue;
+
+			const Meshlet& meshlet = mesh.Meshlets[m];
+			auto position = [&](std::uint32_t t, int k)
+			{
+				const std::uint8_t local = mesh.Triangles[(meshlet.TriangleOffset + t)*3 + k];
+				return XMLoadFloat3(&test.Positions[mesh.Vertices[meshlet.VertexOffset + local]]);
+			};
+
+			if (coneCulled)
+			{
+				for (std::uint32_t t = 0; t < meshlet.TriangleCount; ++t)
+				{
+					const XMVECTOR p0 = position(t, 0);
+					const XMVECTOR n = XMVector3Cross(XMVectorSubtract(position(t, 1), p0), XMVectorSubtract(position(t, 2), p0));
+					if (XMVectorGetX(XMVector3Dot(XMVectorSubtract(p0, eye), n)) < -eps*XMVectorGetX(XMVector3Length(n)))
+						fail("cone culled a triangle that faces the eye", m);
+				}
+				continue;
+			}
+
+			bool outside = false;
+			for (int k = 0; k < 6 && !outside; ++k)
+			{
+				const XMVECTOR plane = XMLoadFloat4(&cullView.Planes[k]);
+				outside = true;
+				for (std::uint32_t v = 0; v < meshlet.VertexCount && outside; ++v)
+				{
+					const XMVECTOR p = XMLoadFloat3(&test.Positions[mesh.Vertices[meshlet.VertexOffset + v]]);
+					outside = XMVectorGetX(XMPlaneDotCoord(plane, p)) < eps;
+				}
+			}
+			if (!outside)
+				fail("frustum culled a meshlet with a vertex inside every plane", m);
+		}
+	}
+
+	size_t vertexRefs = mesh.Vertices.size();
+	std::printf("meshlets %s: %zu vertices, %u triangles\n", name.c_str(), test.Positions.size(), triangleCount);
+	std::printf("  %zu meshlets (max %u vertices, %u triangles), %.1f triangles and %.2f vertex refs per vertex on average\n",
+		mesh.Meshlets.size(), desc.MaxVertices, desc.MaxTriangles,
+		mesh.Meshlets.empty() ? 0.0 : (double)triangleCount / mesh.Meshlets.size(),
+		test.Positions.empty() ? 0.0 : (double)vertexRefs / test.Positions.size());
+	std::printf("  %zu meshlets have a usable normal cone\n", coneCount);
+	std::printf("  %d views: %.1f%% of meshlets outside the frustum, %.1f%% back-facing, %.1f%% of triangles kept\n",
+		views, 100.0*totals.FrustumCulled / std::max<std::uint32_t>(totals.Meshlets, 1),
+		100.0*totals.ConeCulled / std::max<std::uint32_t>(totals.Meshlets, 1),
+		100.0*totals.Triangles / std::max<double>((double)triangleCount*views, 1.0));
+	std::printf("  build:         %10.3f ms\n", buildMs);
+	std::printf("  cull:          %10.3f ms per view\n", cullMs / views);
+
+	if (failures > 0)
+	{
+		std::printf("  %d checks failed\n", failures);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,314 @@
+//***************************************************************************************
+// RenderCommand.cpp
+//
+// Builds the tree billboards scene from Scenes/TreeBillboards.scene with the demo's own
+// builders (DemoScene.h) and draws it with the software rasterizer, so reference images
+// can be rendered and compared on machines without Direct3D.  The frame is the demo's
+// first: waves flat, flags and crowd at rest, no particles or physics bodies, static
+// items drawn one by one, and the static lighting baked at full quality.
+//
+// rand() is seeded with --seed before the trees, the crowd and the lanterns draw from it
+// (in that order).  The C runtimes differ in rand(), so golden images are only
+// comparable between runs on the same platform.
+//***************************************************************************************
+
+#include "ToolCommands.h"
+#include "../../Common/Camera.h"
+#include "../Project1/DemoScene.h"
+#include "../Project1/LightBaker.h"
+#include "../Project1/LightClusters.h"
+#include "../Project1/SoftwareRasterizer.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace DirectX;
+
+namespace
+{
+	bool ParseFloat3(const std::string& text, XMFLOAT3& out)
+	{
+		return std::sscanf(text.c_str(), "%f,%f,%f", &out.x, &out.y, &out.z) == 3;
+	}
+
+	double MillisecondsSince(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	SoftwareDrawItem MakeDrawItem(const DemoMesh& mesh, const void* vertices, const Material* mat,
+		std::uint32_t indexCount, std::uint32_t startIndexLocation, int baseVertexLocation)
+	{
+		SoftwareDrawItem item;
+		item.Mat = mat;
+		item.Vertices = vertices;
+		item.VertexByteStride = mesh.VertexByteStride;
+		item.Indices = mesh.Indices.data();
+		item.Index32 = mesh.Index32;
+		item.IndexCount = indexCount;
+		item.StartIndexLocation = startIndexLocation;
+		item.BaseVertexLocation = baseVertexLocation;
+		return item;
+	}
+}
+
+int RunRenderCommand(const ToolArgs& args)
+{
+	const std::string sceneFile = args.GetString("scene", "../../Scenes/TreeBillboards.scene");
+	const std::string textureDir = args.GetString("textures", "../../Textures");
+	const std::string out = args.GetString("out", "TreeBillboards.png");
+	const int width = std::max(args.GetInt("width", 800), 1);
+	const int height = std::max(args.GetInt("height", 600), 1);
+
+	// Where the demo starts, looking down +z.
+	XMFLOAT3 eye(-55.0f, 2.5f, -40.0f);
+	XMFLOAT3 target(0.0f, 0.0f, 0.0f);
+	if ((args.Has("eye") && !ParseFloat3(args.GetString("eye", ""), eye)) ||
+		(args.Has("target") && !ParseFloat3(args.GetString("target", ""), target)))
+	{
+		std::fprintf(stderr, "--eye and --target take x,y,z\n");
+		return 1;
+	}
+
+	std::srand((unsigned)args.GetInt("seed", 1));
+	const auto buildStart = std::chrono::steady_clock::now();
+
+	// The demo's systems and geometry, keyed by the names the scene refers to.
+	Heightmap heightmap;
+	BuildDemoHeightmap(heightmap);
+	std::unique_ptr<Waves> waves = BuildDemoWaves();
+	ClothSystem cloth;
+	HumanoidAsset humanoid;
+	SkinnedCrowd crowd;
+	if (!BuildDemoFlags(cloth))
+	{
+		std::fprintf(stderr, "Cannot create the flags\n");
+		return 1;
+	}
+
+	std::unordered_map<std::string, DemoMesh> meshes;
+	auto addMesh = [&meshes](DemoMesh mesh)
+	{
+		const std::string name = mesh.Name;
+		meshes[name] = std::move(mesh);
+	};
+	addMesh(BuildLandMesh(heightmap));
+	addMesh(BuildWavesMesh(*waves));
+	addMesh(BuildShapesMesh());
+	addMesh(BuildTreeSpritesMesh());
+	if (!BuildDemoCrowd(humanoid, crowd))
+	{
+		std::fprintf(stderr, "Cannot create the crowd\n");
+		return 1;
+	}
+	addMesh(BuildCapsuleMesh());
+	addMesh(BuildClothMesh(cloth));
+	addMesh(BuildCrowdMesh(humanoid, crowd));
+
+	std::unordered_map<std::string, std::unique_ptr<Material>> materials;
+	BuildDemoMaterials(materials);
+
+	DemoLighting lighting;
+	BuildDemoLights(lighting);
+	const std::string cubeMapFile = textureDir + "/grasscube1024.dds";
+	if (!BuildDemoAmbientSH(std::wstring(cubeMapFile.begin(), cubeMapFile.end()), lighting))
+		std::fprintf(stderr, "Cannot read %s; the ambient light is constant\n", cubeMapFile.c_str());
+
+	const std::wstring wideSceneFile(sceneFile.begin(), sceneFile.end());
+	SceneFile scene;
+	std::vector<DemoMesh> models;
+	std::string error;
+	if (!LoadDemoScene(wideSceneFile, wideSceneFile + L"b", scene, models, error))
+	{
+		std::fprintf(stderr, "%s: %s\n", sceneFile.c_str(), error.c_str());
+		return 1;
+	}
+	for (DemoMesh& model : models)
+		addMesh(std::move(model));
+
+	// The demo streams these vertices every frame; its first frame draws them at rest.
+	std::vector<Vertex> wavesVertices(waves->VertexCount());
+	WriteWavesVertices(*waves, wavesVertices.data());
+	std::vector<ClothVertex> clothVertices(cloth.VertexCount());
+	cloth.WriteVertices(0, cloth.VertexCount(), clothVertices.data());
+	std::vector<SkinnedVertex> skinnedVertices(crowd.VertexCount());
+	crowd.Skin(skinnedVertices.data());
+
+	const DemoMesh& wavesMesh = meshes["waterGeo"];
+	const DemoMesh& clothMesh = meshes["clothGeo"];
+	const DemoMesh& crowdMesh = meshes["crowdGeo"];
+
+	// Textures are decoded once, indexed like gDemoTextures.
+	std::vector<std::unique_ptr<SoftwareTexture>> textures(DemoTextureCount);
+	auto diffuseMap = [&](const Material* mat) -> const SoftwareTexture*
+	{
+		if (mat->DiffuseSrvHeapIndex < 0 || mat->DiffuseSrvHeapIndex >= DemoTextureCount)
+			return nullptr;
+
+		auto& tex = textures[mat->DiffuseSrvHeapIndex];
+		if (tex == nullptr)
+		{
+			const std::string file = textureDir + "/" + gDemoTextures[mat->DiffuseSrvHeapIndex].File + ".dds";
+			tex = std::make_unique<SoftwareTexture>();
+			if (!tex->Load(std::wstring(file.begin(), file.end())))
+				std::fprintf(stderr, "Cannot decode %s\n", file.c_str());
+		}
+		return tex.get();
+	};
+
+	// The scene's items, then the flags and the crowd, as the demo's BuildRenderItems
+	// adds them.  itemMeshes keeps the geometry of each item for the bake.
+	std::vector<SoftwareDrawItem> layers[(int)RenderLayer::Count];
+	std::vector<const DemoMesh*> itemMeshes[(int)RenderLayer::Count];
+	for (int i = 0; i < scene.ItemCount(); ++i)
+	{
+		const SceneItem& sceneItem = scene.Item(i);
+
+		const RenderLayer layer = FindRenderLayer(scene.String(sceneItem.Layer));
+		auto mesh = meshes.find(scene.String(sceneItem.Geometry));
+		auto mat = materials.find(scene.String(sceneItem.Material));
+		if (layer == RenderLayer::Count || mesh == meshes.end() || mat == materials.end() ||
+			mesh->second.DrawArgs.count(scene.String(sceneItem.DrawArg)) == 0)
+		{
+			std::fprintf(stderr, "%s: item %s names an unknown geometry, draw arg, material or layer\n",
+				sceneFile.c_str(), scene.String(sceneItem.Name));
+			return 1;
+		}
+
+		const DemoMesh& geo = mesh->second;
+		const DemoSubmesh& submesh = geo.DrawArgs.at(scene.String(sceneItem.DrawArg));
+		SoftwareDrawItem item = MakeDrawItem(geo, &geo == &wavesMesh ? (const void*)wavesVertices.data() : geo.Vertices.data(),
+			mat->second.get(), submesh.IndexCount, submesh.StartIndexLocation, submesh.BaseVertexLocation);
+		item.World = sceneItem.World;
+		item.TexTransform = sceneItem.TexTransform;
+		layers[(int)layer].push_back(item);
+		itemMeshes[(int)layer].push_back(&geo);
+	}
+
+	for (int flag = 0; flag < cloth.FlagCount(); ++flag)
+	{
+		layers[(int)RenderLayer::AlphaTested].push_back(MakeDrawItem(clothMesh, clothVertices.data(),
+			materials[gDemoFlagMaterials[flag % 3]].get(), (std::uint32_t)cloth.FlagIndexCount(flag),
+			(std::uint32_t)cloth.FlagFirstIndex(flag), cloth.FlagFirstVertex(flag)));
+		itemMeshes[(int)RenderLayer::AlphaTested].push_back(&clothMesh);
+	}
+
+	for (int part = 0; part < HumanoidPartCount; ++part)
+	{
+		const DemoSubmesh& submesh = crowdMesh.DrawArgs.at(gDemoCrowdParts[part]);
+		layers[(int)RenderLayer::Opaque].push_back(MakeDrawItem(crowdMesh, skinnedVertices.data(),
+			materials[gDemoCrowdMaterials[part]].get(), submesh.IndexCount, submesh.StartIndexLocation,
+			submesh.BaseVertexLocation));
+		itemMeshes[(int)RenderLayer::Opaque].push_back(&crowdMesh);
+	}
+
+	for (auto& layer : layers)
+	{
+		for (SoftwareDrawItem& item : layer)
+			item.DiffuseMap = diffuseMap(item.Mat);
+	}
+	const double buildMs = MillisecondsSince(buildStart);
+
+	// Bake the baked layer per geometry, in the order the geometries first appear, with
+	// the collide items as occluders.
+	const auto bakeStart = std::chrono::steady_clock::now();
+	LightBaker baker;
+	for (int i = 0; i < scene.ColliderCount(); ++i)
+	{
+		const SceneCollider& collider = scene.Collider(i);
+		baker.AddOccluder(XMVectorSetW(XMLoadFloat3(&collider.Min), 1.0f), XMVectorSetW(XMLoadFloat3(&collider.Max), 1.0f));
+	}
+
+	LightBakeDesc bakeDesc;
+	bakeDesc.Lights = lighting.DirLights.data();
+	bakeDesc.NumDirLights = (int)lighting.DirLights.size();
+	bakeDesc.AmbientLight = lighting.AmbientLight;
+	bakeDesc.AmbientSH = &lighting.AmbientSH;
+
+	std::vector<SoftwareDrawItem>& bakedLayer = layers[(int)RenderLayer::OpaqueBaked];
+	const std::vector<const DemoMesh*>& bakedMeshes = itemMeshes[(int)RenderLayer::OpaqueBaked];
+	std::vector<const DemoMesh*> bakedGeometries;
+	for (const DemoMesh* mesh : bakedMeshes)
+	{
+		if (std::find(bakedGeometries.begin(), bakedGeometries.end(), mesh) == bakedGeometries.end())
+			bakedGeometries.push_back(mesh);
+	}
+
+	std::vector<DemoBakedGeometry> baked(bakedGeometries.size());
+	std::vector<DemoBakeItem> bakeItems;
+	std::vector<size_t> bakeItemSources;
+	for (size_t g = 0; g < bakedGeometries.size(); ++g)
+	{
+		const DemoMesh* mesh = bakedGeometries[g];
+		if (mesh->Index32 || mesh->Vertices.empty())
+		{
+			std::fprintf(stderr, "%s: baked items need a static geometry with 16-bit indices\n", mesh->Name.c_str());
+			return 1;
+		}
+
+		bakeItems.clear();
+		bakeItemSources.clear();
+		for (size_t i = 0; i < bakedLayer.size(); ++i)
+		{
+			if (bakedMeshes[i] != mesh)
+				continue;
+
+			DemoBakeItem bakeItem;
+			bakeItem.World = bakedLayer[i].World;
+			bakeItem.Mat = bakedLayer[i].Mat;
+			bakeItem.IndexCount = bakedLayer[i].IndexCount;
+			bakeItem.StartIndexLocation = bakedLayer[i].StartIndexLocation;
+			bakeItem.BaseVertexLocation = bakedLayer[i].BaseVertexLocation;
+			bakeItems.push_back(bakeItem);
+			bakeItemSources.push_back(i);
+		}
+
+		BakeDemoGeometry(baker, bakeDesc, reinterpret_cast<const Vertex*>(mesh->Vertices.data()),
+			reinterpret_cast<const std::uint16_t*>(mesh->Indices.data()), bakeItems, baked[g]);
+		for (size_t k = 0; k < bakeItems.size(); ++k)
+			bakedLayer[bakeItemSources[k]].BakedLight = baked[g].Colors.data() + bakeItems[k].BakedLightOffset;
+	}
+	const double bakeMs = MillisecondsSince(bakeStart);
+
+	// The camera, the light clusters and the pass constants, as in the demo's Update.
+	Camera camera;
+	camera.SetLens(0.25f*MathHelper::Pi, (float)width / height, 1.0f, 1000.0f);
+	if (args.Has("target"))
+		camera.LookAt(eye, target, XMFLOAT3(0.0f, 1.0f, 0.0f));
+	else
+		camera.SetPosition(eye);
+	camera.UpdateViewMatrix();
+
+	LightClusterGrid clusters;
+	clusters.SetProjection(camera.GetFovY(), camera.GetAspect(), camera.GetNearZ(), camera.GetFarZ());
+	clusters.Build(camera.GetView(),
+		lighting.PointLights.data(), (std::uint32_t)lighting.PointLights.size(),
+		lighting.SpotLights.data(), (std::uint32_t)lighting.SpotLights.size());
+
+	PassConstants pass;
+	SetDemoPassConstants(camera, width, height, lighting, clusters, pass);
+
+	const auto renderStart = std::chrono::steady_clock::now();
+	SoftwareRasterizer rasterizer;
+	rasterizer.Resize(width, height);
+	rasterizer.BeginFrame(pass, &clusters);
+	rasterizer.Clear(pass.FogColor);
+	size_t drawn = 0;
+	for (const SoftwarePass& softwarePass : SoftwarePasses)
+	{
+		rasterizer.Draw(softwarePass.Pipeline, layers[(int)softwarePass.Layer]);
+		drawn += layers[(int)softwarePass.Layer].size();
+	}
+	const double renderMs = MillisecondsSince(renderStart);
+
+	if (!rasterizer.SaveImage(std::wstring(out.begin(), out.end())))
+	{
+		std::fprintf(stderr, "Failed to write %s\n", out.c_str());
+		return 1;
+	}
+
+	std::printf("%s: %d x %d, %zu items, build %.1f ms, bake %.1f ms, render %.1f ms\n",
+		out.c_str(), width, height, drawn, buildMs, bakeMs, renderMs);
+	return 0;
+}
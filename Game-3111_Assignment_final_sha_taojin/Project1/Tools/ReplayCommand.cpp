@@ -0,0 +1,534 @@
+//***************************************************************************************
+// ReplayCommand.cpp
+//
+// Re-executes a frame trace written by FrameCapture (C in the demo).  Every frame's draws
+// are checked against the captured buffers: each draw's object and material constants
+// must exist, its index range must lie inside its geometry and its vertex source must
+// have been captured.  The null device then executes the draws without a device,
+// counting the draws and state changes SubmitDrawList would record in RenderStats.
+// --backend software also renders each frame with the software rasterizer from the
+// captured constants, vertices and light clusters, and --out-dir writes the images.
+// --against steps a second trace alongside and reports, per frame, the buffer elements
+// and draws that differ and, with the software backend, the pixels.
+// Returns 1 if a trace is malformed, a draw is invalid or the traces differ.
+//
+// Nothing here depends on Direct3D, so traces captured on Windows replay on Linux (see
+// CMakeLists.txt).
+//***************************************************************************************
+
+#include "ToolCommands.h"
+#include "../Project1/FrameTrace.h"
+#include "../Project1/SoftwareRasterizer.h"
+#include "../../Common/RenderStats.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+using namespace DirectX;
+
+namespace
+{
+	// What replaying one trace needs besides the trace itself.
+	struct ReplayState
+	{
+		std::string Name;
+		FrameTrace Trace;
+
+		// Software backend.  The materials are rebuilt from the captured constants every
+		// frame.
+		std::vector<std::unique_ptr<Material>> Materials;
+		std::wstring TextureDir;
+		std::vector<std::unique_ptr<SoftwareTexture>> Textures;
+		SoftwareRasterizer Rasterizer;
+		LightClusterGrid Clusters;
+		std::vector<std::uint8_t> Pixels;
+
+		int Draws = 0;
+		std::uint64_t Triangles = 0;
+		std::uint64_t StateChanges = 0;
+		std::uint64_t ChangedBytes[(int)CaptureBuffer::Count] = {};
+		double ReplaySeconds = 0.0;
+		double RenderSeconds = 0.0;
+	};
+
+	const char* const gLayerNames[(int)RenderLayer::Count] =
+	{
+		"Opaque", "OpaqueBaked", "Transparent", "AlphaTested", "AlphaTestedTreeSprites", "Particles"
+	};
+
+	// Checks every draw of the frame against the captured data; prints the first few
+	// problems and returns their count.
+	int ValidateFrame(const ReplayState& state, int maxReports)
+	{
+		const FrameTrace& trace = state.Trace;
+		int problems = 0;
+		auto report = [&](size_t draw, const char* what)
+		{
+			if (problems++ < maxReports)
+				std::printf("  %s frame %u draw %zu: %s\n", state.Name.c_str(), trace.Frame(), draw, what);
+		};
+
+		if (trace.Element(CaptureBuffer::PassCB, 0) == nullptr)
+			report(0, "no pass constants");
+
+		for (size_t i = 0; i < trace.Draws().size(); ++i)
+		{
+			const CaptureDraw& draw = trace.Draws()[i];
+			const CaptureGeometry& geo = trace.Geometry(draw.Geometry);
+
+			if (trace.Element(CaptureBuffer::ObjectCB, draw.ObjCBIndex) == nullptr)
+				report(i, "object constants out of range");
+			if (trace.Element(CaptureBuffer::MaterialCB, draw.MatCBIndex) == nullptr)
+				report(i, "material constants out of range");
+			if (draw.IndexSource == (std::uint32_t)CaptureBuffer::Count)
+			{
+				if ((std::uint64_t)draw.StartIndexLocation + draw.IndexCount > geo.IndexBufferByteSize / geo.IndexByteSize())
+					report(i, "index range outside the geometry");
+			}
+			else
+			{
+				const CaptureBuffer indices = (CaptureBuffer)draw.IndexSource;
+				if (trace.ElementByteSize(indices) != geo.IndexByteSize())
+					report(i, "dynamic index buffer not captured or of another format");
+				else if ((std::uint64_t)draw.StartIndexLocation + draw.IndexCount > trace.Buffer(indices).size() / geo.IndexByteSize())
+					report(i, "index range outside the dynamic index buffer");
+			}
+			if (draw.BakedLightOffset >= 0 &&
+				(std::uint64_t)draw.BakedLightOffset*geo.ColorByteStride >= geo.ColorBufferByteSize)
+			{
+				report(i, "baked light offset outside the color buffer");
+			}
+			if (draw.VertexSource != (std::uint32_t)CaptureBuffer::Count &&
+				trace.Buffer((CaptureBuffer)draw.VertexSource).empty())
+			{
+				report(i, "dynamic vertex buffer not captured");
+			}
+		}
+		return problems;
+	}
+
+	// The null device: executes the draws as DrawFrame and SubmitDrawList record them,
+	// without a device.  A change of layer sets its pipeline state; every draw sets its
+	// vertex buffers (two for baked items), index buffer, topology, texture table and two
+	// constant buffers.
+	void ReplayFrame(ReplayState& state)
+	{
+		const FrameTrace& trace = state.Trace;
+		const auto start = std::chrono::steady_clock::now();
+
+		const std::vector<CaptureDraw>& draws = trace.Draws();
+		std::uint32_t layer = (std::uint32_t)RenderLayer::Count;
+		for (const CaptureDraw& draw : draws)
+		{
+			if (draw.Layer != layer)
+			{
+				RenderStats::AddStateChange(StateChange::PipelineState);
+				layer = draw.Layer;
+			}
+			RenderStats::AddStateChange(StateChange::VertexBuffer, draw.BakedLightOffset >= 0 ? 2 : 1);
+			RenderStats::AddStateChange(StateChange::IndexBuffer);
+			RenderStats::AddStateChange(StateChange::Topology);
+			RenderStats::AddStateChange(StateChange::DescriptorTable);
+			RenderStats::AddStateChange(StateChange::RootCbv, 2);
+			RenderStats::AddDraw(draw.IndexCount, 1, (int)draw.PrimitiveType);
+			state.Triangles += draw.PrimitiveType == CaptureTopologyTriangleList ? draw.IndexCount / 3 : 0;
+		}
+		RenderStats::EndFrame();
+		state.StateChanges += RenderStats::LastFrame().TotalStateChanges();
+
+		state.Draws += (int)draws.size();
+		for (int b = 0; b < (int)CaptureBuffer::Count; ++b)
+			state.ChangedBytes[b] += trace.ChangedBytes((CaptureBuffer)b);
+		state.ReplaySeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	const SoftwareTexture* GetTexture(ReplayState& state, int srvHeapIndex)
+	{
+		const std::vector<std::wstring>& files = state.Trace.Textures();
+		if (srvHeapIndex < 0 || srvHeapIndex >= (int)files.size() || files[srvHeapIndex].empty())
+			return nullptr;
+
+		if (state.Textures.size() < files.size())
+			state.Textures.resize(files.size());
+		auto& tex = state.Textures[srvHeapIndex];
+		if (tex == nullptr)
+		{
+			// The trace has the app's paths; --textures points them at another directory.
+			std::wstring file = files[srvHeapIndex];
+			if (!state.TextureDir.empty())
+				file = state.TextureDir + L"/" + file.substr(file.find_last_of(L"/\\") + 1);
+
+			tex = std::make_unique<SoftwareTexture>();
+			if (!tex->Load(file))
+				std::fprintf(stderr, "Cannot decode %s\n", std::string(file.begin(), file.end()).c_str());
+		}
+		return tex.get();
+	}
+
+	// The software backend: renders the frame from the captured buffers as
+	// RenderSoftwareFrame renders the demo's state.  Particles have no software pipeline.
+	bool RenderFrame(ReplayState& state)
+	{
+		const FrameTrace& trace = state.Trace;
+		const PassConstants* pass = static_cast<const PassConstants*>(trace.Element(CaptureBuffer::PassCB, 0));
+		if (pass == nullptr || pass->RenderTargetSize.x < 1.0f || pass->RenderTargetSize.y < 1.0f)
+			return false;
+
+		const auto start = std::chrono::steady_clock::now();
+
+		// The cluster buffers as uploaded, whole: the ranges only reference the lights
+		// and indices written this frame.
+		const std::vector<std::uint8_t>& lights = trace.Buffer(CaptureBuffer::ClusterLights);
+		const std::vector<std::uint8_t>& ranges = trace.Buffer(CaptureBuffer::ClusterRanges);
+		const std::vector<std::uint8_t>& indices = trace.Buffer(CaptureBuffer::ClusterLightIndices);
+		const bool clusters = ranges.size() >= LightClusterGrid::ClusterCount*sizeof(XMUINT2);
+		if (clusters)
+		{
+			state.Clusters.SetLists(reinterpret_cast<const Light*>(lights.data()), (std::uint32_t)(lights.size() / sizeof(Light)),
+				pass->ClusterDims.w, reinterpret_cast<const XMUINT2*>(ranges.data()),
+				reinterpret_cast<const std::uint32_t*>(indices.data()), (std::uint32_t)(indices.size() / sizeof(std::uint32_t)));
+		}
+
+		state.Rasterizer.Resize((int)pass->RenderTargetSize.x, (int)pass->RenderTargetSize.y);
+		state.Rasterizer.BeginFrame(*pass, clusters ? &state.Clusters : nullptr);
+		state.Rasterizer.Clear(pass->FogColor);
+
+		// The captured constants are transposed for HLSL.
+		for (const CaptureDraw& draw : trace.Draws())
+		{
+			const MaterialConstants* constants =
+				static_cast<const MaterialConstants*>(trace.Element(CaptureBuffer::MaterialCB, draw.MatCBIndex));
+			if (draw.MatCBIndex >= state.Materials.size())
+				state.Materials.resize(draw.MatCBIndex + 1);
+			auto& material = state.Materials[draw.MatCBIndex];
+			if (material == nullptr)
+				material = std::make_unique<Material>();
+			Material& mat = *material;
+			mat.MatCBIndex = (int)draw.MatCBIndex;
+			mat.DiffuseSrvHeapIndex = draw.DiffuseSrvHeapIndex;
+			mat.DiffuseAlbedo = constants->DiffuseAlbedo;
+			mat.FresnelR0 = constants->FresnelR0;
+			mat.Roughness = constants->Roughness;
+			XMStoreFloat4x4(&mat.MatTransform, XMMatrixTranspose(XMLoadFloat4x4(&constants->MatTransform)));
+		}
+
+		std::vector<SoftwareDrawItem> items;
+		const std::vector<CaptureDraw>& draws = trace.Draws();
+		for (size_t first = 0; first < draws.size();)
+		{
+			// Consecutive draws of a layer share its pipeline state.
+			const RenderLayer layer = (RenderLayer)draws[first].Layer;
+			size_t last = first;
+			while (last < draws.size() && draws[last].Layer == draws[first].Layer)
+				++last;
+
+			SoftwarePipeline pipeline = SoftwarePipeline::Opaque;
+			bool supported = true;
+			switch (layer)
+			{
+			case RenderLayer::Opaque: pipeline = SoftwarePipeline::Opaque; break;
+			case RenderLayer::OpaqueBaked: pipeline = SoftwarePipeline::OpaqueBaked; break;
+			case RenderLayer::AlphaTested: pipeline = SoftwarePipeline::AlphaTested; break;
+			case RenderLayer::AlphaTestedTreeSprites: pipeline = SoftwarePipeline::TreeSprites; break;
+			case RenderLayer::Transparent: pipeline = SoftwarePipeline::Transparent; break;
+			default: supported = false; break;
+			}
+
+			items.clear();
+			for (size_t i = first; i < last && supported; ++i)
+			{
+				// Static geometry without a CPU copy of its buffers cannot be drawn.
+				const CaptureDraw& draw = draws[i];
+				const CaptureGeometry& geo = trace.Geometry(draw.Geometry);
+				const bool dynamicVertices = draw.VertexSource != (std::uint32_t)CaptureBuffer::Count;
+				const bool dynamicIndices = draw.IndexSource != (std::uint32_t)CaptureBuffer::Count;
+				if ((!dynamicVertices && geo.Vertices.empty()) || (!dynamicIndices && geo.Indices.empty()))
+					continue;
+
+				const ObjectConstants* object =
+					static_cast<const ObjectConstants*>(trace.Element(CaptureBuffer::ObjectCB, draw.ObjCBIndex));
+
+				SoftwareDrawItem item;
+				XMStoreFloat4x4(&item.World, XMMatrixTranspose(XMLoadFloat4x4(&object->World)));
+				XMStoreFloat4x4(&item.TexTransform, XMMatrixTranspose(XMLoadFloat4x4(&object->TexTransform)));
+				item.Mat = state.Materials[draw.MatCBIndex].get();
+				item.DiffuseMap = GetTexture(state, draw.DiffuseSrvHeapIndex);
+				item.Vertices = dynamicVertices ? trace.Buffer((CaptureBuffer)draw.VertexSource).data() : geo.Vertices.data();
+				item.VertexByteStride = geo.VertexByteStride;
+				item.Indices = dynamicIndices ? trace.Buffer((CaptureBuffer)draw.IndexSource).data() : geo.Indices.data();
+				item.Index32 = geo.IndexFormat == CaptureIndexFormat32;
+				item.IndexCount = draw.IndexCount;
+				item.StartIndexLocation = draw.StartIndexLocation;
+				item.BaseVertexLocation = draw.BaseVertexLocation;
+				if (draw.BakedLightOffset >= 0 && !geo.Colors.empty())
+					item.BakedLight = reinterpret_cast<const XMFLOAT4*>(geo.Colors.data()) + draw.BakedLightOffset;
+				items.push_back(item);
+			}
+			if (!items.empty())
+				state.Rasterizer.Draw(pipeline, items);
+
+			first = last;
+		}
+
+		state.Rasterizer.ReadPixels(state.Pixels);
+		state.RenderSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		return true;
+	}
+
+	// Reports the elements of one buffer that differ between the traces.
+	int DiffBuffer(const FrameTrace& a, const FrameTrace& b, CaptureBuffer buffer, int maxReports)
+	{
+		const std::vector<std::uint8_t>& x = a.Buffer(buffer);
+		const std::vector<std::uint8_t>& y = b.Buffer(buffer);
+		if (x.size() != y.size() || a.ElementByteSize(buffer) != b.ElementByteSize(buffer))
+		{
+			if (maxReports > 0)
+			{
+				std::printf("  frame %u %s: %zu bytes against %zu\n", a.Frame(), CaptureBufferName(buffer),
+					x.size(), y.size());
+			}
+			return 1;
+		}
+
+		const size_t stride = std::max<size_t>(a.ElementByteSize(buffer), 1);
+		size_t differing = 0;
+		size_t firstElement = 0;
+		for (size_t offset = 0; offset < x.size(); offset += stride)
+		{
+			const size_t bytes = std::min(stride, x.size() - offset);
+			if (std::memcmp(x.data() + offset, y.data() + offset, bytes) != 0)
+			{
+				if (differing++ == 0)
+					firstElement = offset / stride;
+			}
+		}
+
+		if (differing > 0 && maxReports > 0)
+		{
+			std::printf("  frame %u %s: %zu elements differ, first %zu\n", a.Frame(), CaptureBufferName(buffer),
+				differing, firstElement);
+		}
+		return differing > 0 ? 1 : 0;
+	}
+
+	// Reports the first draws that differ between the traces and which of their fields.
+	int DiffDraws(const FrameTrace& a, const FrameTrace& b, int maxReports)
+	{
+		const std::vector<CaptureDraw>& x = a.Draws();
+		const std::vector<CaptureDraw>& y = b.Draws();
+		int reports = 0;
+		if (x.size() != y.size() && reports++ < maxReports)
+			std::printf("  frame %u: %zu draws against %zu\n", a.Frame(), x.size(), y.size());
+
+		for (size_t i = 0; i < std::min(x.size(), y.size()); ++i)
+		{
+			const CaptureDraw& p = x[i];
+			const CaptureDraw& q = y[i];
+			std::string fields;
+			auto field = [&fields](bool same, const char* name)
+			{
+				if (!same)
+					fields += std::string(fields.empty() ? "" : ", ") + name;
+			};
+			field(p.Layer == q.Layer, "layer");
+			field(a.Geometry(p.Geometry).Name == b.Geometry(q.Geometry).Name, "geometry");
+			field(p.PrimitiveType == q.PrimitiveType, "topology");
+			field(p.ObjCBIndex == q.ObjCBIndex, "object");
+			field(p.MatCBIndex == q.MatCBIndex, "material");
+			field(p.DiffuseSrvHeapIndex == q.DiffuseSrvHeapIndex, "texture");
+			field(p.IndexCount == q.IndexCount && p.StartIndexLocation == q.StartIndexLocation &&
+				p.BaseVertexLocation == q.BaseVertexLocation, "index range");
+			field(p.BakedLightOffset == q.BakedLightOffset, "baked light");
+			field(p.VertexSource == q.VertexSource, "vertex source");
+			field(p.IndexSource == q.IndexSource, "index source");
+
+			if (!fields.empty() && reports++ < maxReports)
+			{
+				std::printf("  frame %u draw %zu (%s, %s): %s differ\n", a.Frame(), i,
+					gLayerNames[p.Layer], a.Geometry(p.Geometry).Name.c_str(), fields.c_str());
+			}
+		}
+		return reports;
+	}
+
+	// Counts the pixels with a channel more than tolerance apart.
+	int DiffPixels(const ReplayState& a, const ReplayState& b, int tolerance, int maxReports)
+	{
+		if (a.Pixels.size() != b.Pixels.size())
+		{
+			if (maxReports > 0)
+				std::printf("  frame %u: render targets differ in size\n", a.Trace.Frame());
+			return 1;
+		}
+
+		size_t differing = 0;
+		int maxDelta = 0;
+		for (size_t p = 0; p < a.Pixels.size(); p += 4)
+		{
+			int delta = 0;
+			for (int c = 0; c < 4; ++c)
+				delta = std::max(delta, std::abs((int)a.Pixels[p + c] - (int)b.Pixels[p + c]));
+			maxDelta = std::max(maxDelta, delta);
+			differing += delta > tolerance ? 1 : 0;
+		}
+
+		if (differing > 0 && maxReports > 0)
+		{
+			std::printf("  frame %u: %zu of %zu pixels differ, by up to %d\n", a.Trace.Frame(),
+				differing, a.Pixels.size() / 4, maxDelta);
+		}
+		return differing > 0 ? 1 : 0;
+	}
+
+	bool SaveFrame(const ReplayState& state, const std::string& dir, const char* suffix)
+	{
+		char name[64];
+		std::snprintf(name, sizeof(name), "/frame%05u%s.png", state.Trace.Frame(), suffix);
+		const std::string file = dir + name;
+		return state.Rasterizer.SaveImage(std::wstring(file.begin(), file.end()));
+	}
+
+	void PrintSummary(const ReplayState& state, int frames, bool software)
+	{
+		const int n = std::max(frames, 1);
+		std::printf("%s: %d frames, %.1f draws, %.0f triangles and %.1f state changes per frame, replay %.3f ms per frame",
+			state.Name.c_str(), frames, (double)state.Draws / n, (double)state.Triangles / n,
+			(double)state.StateChanges / n, state.ReplaySeconds*1000.0 / n);
+		if (software)
+			std::printf(", render %.2f ms per frame", state.RenderSeconds*1000.0 / n);
+		std::printf("\n  %-20s %12s\n", "buffer", "KiB/frame");
+		for (int b = 0; b < (int)CaptureBuffer::Count; ++b)
+		{
+			if (!state.Trace.Buffer((CaptureBuffer)b).empty())
+				std::printf("  %-20s %12.2f\n", CaptureBufferName((CaptureBuffer)b), state.ChangedBytes[b] / 1024.0 / n);
+		}
+	}
+}
+
+int RunReplayCommand(const ToolArgs& args)
+{
+	const std::string in = args.GetString("in", "FrameCapture.trace");
+	const std::string against = args.GetString("against", "");
+	const std::string backend = args.GetString("backend", "null");
+	const std::string outDir = args.GetString("out-dir", "");
+	const std::string textureDir = args.GetString("textures", "");
+	const int tolerance = std::max(args.GetInt("tolerance", 0), 0);
+	const int maxReports = std::max(args.GetInt("max-reports", 10), 0);
+
+	if (backend != "null" && backend != "software")
+	{
+		std::fprintf(stderr, "Unknown backend '%s'; use null or software.\n", backend.c_str());
+		return 1;
+	}
+	const bool software = backend == "software";
+
+	std::unique_ptr<ReplayState> states[2];
+	const std::string files[2] = { in, against };
+	const int traceCount = against.empty() ? 1 : 2;
+	for (int t = 0; t < traceCount; ++t)
+	{
+		states[t] = std::make_unique<ReplayState>();
+		states[t]->Name = files[t];
+		states[t]->TextureDir.assign(textureDir.begin(), textureDir.end());
+		if (!states[t]->Trace.Open(std::wstring(files[t].begin(), files[t].end())))
+		{
+			std::fprintf(stderr, "%s: %s\n", files[t].c_str(), states[t]->Trace.Error().c_str());
+			return 1;
+		}
+	}
+
+	int frames = 0;
+	int invalid = 0;
+	int differingFrames = 0;
+	int reportsLeft = maxReports;
+	for (;;)
+	{
+		bool more[2] = { false, false };
+		for (int t = 0; t < traceCount; ++t)
+		{
+			ReplayState& state = *states[t];
+			more[t] = state.Trace.NextFrame();
+			if (!state.Trace.Error().empty())
+			{
+				std::fprintf(stderr, "%s: %s\n", state.Name.c_str(), state.Trace.Error().c_str());
+				return 1;
+			}
+		}
+		if (!more[0] || (traceCount == 2 && !more[1]))
+		{
+			if (traceCount == 2 && more[0] != more[1])
+			{
+				std::printf("  %s has more frames\n", more[0] ? in.c_str() : against.c_str());
+				++differingFrames;
+			}
+			break;
+		}
+
+		bool valid = true;
+		for (int t = 0; t < traceCount; ++t)
+		{
+			const int problems = ValidateFrame(*states[t], reportsLeft);
+			reportsLeft = std::max(reportsLeft - problems, 0);
+			invalid += problems;
+			valid = valid && problems == 0;
+			if (problems == 0)
+				ReplayFrame(*states[t]);
+		}
+
+		bool rendered = false;
+		if (software && valid)
+		{
+			rendered = true;
+			for (int t = 0; t < traceCount; ++t)
+			{
+				if (!RenderFrame(*states[t]))
+				{
+					std::printf("  %s frame %u has no render target size\n", states[t]->Name.c_str(), states[t]->Trace.Frame());
+					rendered = false;
+				}
+			}
+		}
+
+		if (traceCount == 2)
+		{
+			const FrameTrace& a = states[0]->Trace;
+			const FrameTrace& b = states[1]->Trace;
+			int differences = 0;
+			for (int buffer = 0; buffer < (int)CaptureBuffer::Count; ++buffer)
+				differences += DiffBuffer(a, b, (CaptureBuffer)buffer, reportsLeft - differences);
+			differences += DiffDraws(a, b, std::max(reportsLeft - differences, 0));
+			if (rendered)
+				differences += DiffPixels(*states[0], *states[1], tolerance, std::max(reportsLeft - differences, 0));
+			reportsLeft = std::max(reportsLeft - differences, 0);
+
+			if (differences > 0)
+			{
+				++differingFrames;
+				if (rendered && !outDir.empty())
+				{
+					SaveFrame(*states[0], outDir, "a");
+					SaveFrame(*states[1], outDir, "b");
+				}
+			}
+		}
+		else if (rendered && !outDir.empty() && !SaveFrame(*states[0], outDir, ""))
+		{
+			std::fprintf(stderr, "Cannot write to %s\n", outDir.c_str());
+			return 1;
+		}
+
+		++frames;
+	}
+
+	for (int t = 0; t < traceCount; ++t)
+		PrintSummary(*states[t], frames, software);
+	if (invalid > 0)
+		std::printf("  %d invalid draws\n", invalid);
+	if (traceCount == 2)
+		std::printf("  %d of %d frames differ\n", differingFrames, frames);
+
+	return invalid == 0 && differingFrames == 0 ? 0 : 1;
+}
@@ -0,0 +1,122 @@
+//***************************************************************************************
+// SceneCommand.cpp
+//
+// Compiles a text scene (see SceneFile.h) to its binary form, reads the binary back and
+// checks it matches the parsed scene item for item, and reports how long parsing the
+// text and mapping the binary take.  Returns 1 if the text does not parse or the binary
+// does not round trip, so CI can run it over every scene.
+//***************************************************************************************
+
+#include "ToolCommands.h"
+#include "../Project1/MappedFile.h"
+#include "../Project1/SceneFile.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+	// Best of repeats runs of load, in microseconds.
+	template<typename Func>
+	double BestMicroseconds(int repeats, const Func& load)
+	{
+		double best = 1e30;
+		for (int r = 0; r < repeats; ++r)
+		{
+			const auto start = std::chrono::steady_clock::now();
+			load();
+			best = std::min(best, std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+		}
+		return best;
+	}
+
+	bool SameItem(const SceneFile& a, const SceneItem& x, const SceneFile& b, const SceneItem& y)
+	{
+		return std::memcmp(&x.World, &y.World, sizeof(x.World)) == 0 &&
+			std::memcmp(&x.TexTransform, &y.TexTransform, sizeof(x.TexTransform)) == 0 &&
+			x.Topology == y.Topology && x.Static == y.Static &&
+			std::strcmp(a.String(x.Name), b.String(y.Name)) == 0 &&
+			std::strcmp(a.String(x.Geometry), b.String(y.Geometry)) == 0 &&
+			std::strcmp(a.String(x.DrawArg), b.String(y.DrawArg)) == 0 &&
+			std::strcmp(a.String(x.Material), b.String(y.Material)) == 0 &&
+			std::strcmp(a.String(x.Layer), b.String(y.Layer)) == 0;
+	}
+}
+
+int RunSceneCommand(const ToolArgs& args)
+{
+	const std::string in = args.GetString("in", "../../Scenes/TreeBillboards.scene");
+	std::string out = args.GetString("out", "");
+	if (out.empty())
+		out = in + "b";
+	const int repeats = std::max(args.GetInt("repeats", 100), 1);
+
+	const std::wstring textFile(in.begin(), in.end());
+	const std::wstring binaryFile(out.begin(), out.end());
+
+	MappedFile text;
+	if (!text.Open(textFile))
+	{
+		std::fprintf(stderr, "Cannot open %s\n", in.c_str());
+		return 1;
+	}
+
+	SceneFile parsed;
+	if (!parsed.ParseText(reinterpret_cast<const char*>(text.Data()), text.Size()))
+	{
+		std::fprintf(stderr, "%s: %s\n", in.c_str(), parsed.Error().c_str());
+		return 1;
+	}
+	if (!parsed.SaveBinary(binaryFile))
+	{
+		std::fprintf(stderr, "Failed to write %s\n", out.c_str());
+		return 1;
+	}
+
+	SceneFile compiled;
+	if (!compiled.LoadBinary(binaryFile))
+	{
+		std::fprintf(stderr, "%s does not load back\n", out.c_str());
+		return 1;
+	}
+
+	int mismatches = 0;
+	if (compiled.ItemCount() != parsed.ItemCount() || compiled.ColliderCount() != parsed.ColliderCount() ||
+		compiled.MeshCount() != parsed.MeshCount() || compiled.SourceHash() != parsed.SourceHash())
+	{
+		++mismatches;
+	}
+	else
+	{
+		for (int i = 0; i < parsed.ItemCount(); ++i)
+			mismatches += SameItem(parsed, parsed.Item(i), compiled, compiled.Item(i)) ? 0 : 1;
+		for (int i = 0; i < parsed.ColliderCount(); ++i)
+			mismatches += std::memcmp(&parsed.Collider(i), &compiled.Collider(i), sizeof(SceneCollider)) == 0 ? 0 : 1;
+		for (int i = 0; i < parsed.MeshCount(); ++i)
+		{
+			const SceneMesh& x = parsed.Mesh(i);
+			const SceneMesh& y = compiled.Mesh(i);
+			mismatches += std::strcmp(parsed.String(x.Geometry), compiled.String(y.Geometry)) == 0 &&
+				std::strcmp(parsed.String(x.File), compiled.String(y.File)) == 0 ? 0 : 1;
+		}
+	}
+
+	std::printf("scene %s: %d items, %d colliders, %d meshes, %zu bytes of text\n",
+		in.c_str(), parsed.ItemCount(), parsed.ColliderCount(), parsed.MeshCount(), text.Size());
+
+	SceneFile scene;
+	const double parseUs = BestMicroseconds(repeats, [&]()
+	{
+		scene.ParseText(reinterpret_cast<const char*>(text.Data()), text.Size());
+	});
+	const double loadUs = BestMicroseconds(repeats, [&]()
+	{
+		scene.LoadBinary(binaryFile);
+	});
+	std::printf("  parse text:    %10.1f us\n", parseUs);
+	std::printf("  map compiled:  %10.1f us  (%s)\n", loadUs, out.c_str());
+	std::printf("  round trip:    %s\n", mismatches == 0 ? "ok" : "MISMATCH");
+
+	return mismatches == 0 ? 0 : 1;
+}
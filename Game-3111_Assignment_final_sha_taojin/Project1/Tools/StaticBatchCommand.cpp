@@ -0,0 +1,358 @@
+//***************************************************************************************
+// StaticBatchCommand.cpp
+//
+// Batches the static items of a scene (TreeBillboards.scene by default) the way the demo
+// does at load, with the demo's box geometry shapes and the scene's model files, and
+// checks the result: every batched triangle is its source triangle moved to world space
+// in the same winding, chunks stay within their vertex limit and bounds, and the triangle
+// to source mapping agrees with the parts.  Random rays are picked against the batches
+// and against the source triangles one by one, which must find the same distance, and a
+// culled chunk must have every vertex outside one frustum plane.  Prints the draws before
+// and after batching and the build time.  Returns 1 if a check fails.
+//***************************************************************************************
+
+#include "ToolCommands.h"
+#include "../../Common/GeometryGenerator.h"
+#include "../Project1/MappedFile.h"
+#include "../Project1/MeshImporter.h"
+#include "../Project1/Meshlets.h"
+#include "../Project1/SceneFile.h"
+#include "../Project1/StaticBatches.h"
+#include <algorithm>
+#include <chrono>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <random>
+
+using namespace DirectX;
+
+namespace
+{
+	// A geometry's vertices and indices, and its draw args as index ranges.
+	struct TestGeometry
+	{
+		std::vector<StaticBatchVertex> Vertices;
+		std::vector<std::uint32_t> Indices;
+		std::map<std::string, std::pair<std::uint32_t, std::uint32_t>> DrawArgs;
+
+		void Add(const std::string& name, const GeometryGenerator::MeshData& mesh)
+		{
+			const std::uint32_t baseVertex = (std::uint32_t)Vertices.size();
+			DrawArgs[name] = { (std::uint32_t)Indices.size(), (std::uint32_t)mesh.Indices32.size() };
+			for (const GeometryGenerator::Vertex& v : mesh.Vertices)
+				Vertices.push_back({ v.Position, v.Normal, v.TexC });
+			for (std::uint32_t i : mesh.Indices32)
+				Indices.push_back(baseVertex + i);
+		}
+	};
+
+	// The shapes of the demo's BuildBoxGeometry.
+	TestGeometry BoxGeometry()
+	{
+		GeometryGenerator geoGen;
+		TestGeometry geo;
+		geo.Add("box", geoGen.CreateBox(1.0f, 1.0f, 1.0f, 0));
+		geo.Add("sphere", geoGen.CreateSphere(0.5f, 20, 20));
+		geo.Add("cylinder", geoGen.CreateCylinder(0.5f, 0.3f, 3.0f, 20, 20));
+		geo.Add("cone", geoGen.CreateCone(0.5f, 1.0f, 20, 20));
+		geo.Add("Pyramid_flat_head", geoGen.CreatePyramid_flat_head(1.5f, 2.0f, 1.0f, 0));
+		geo.Add("Pyramid_pointed_head", geoGen.CreatePyramid_pointed_head(1.5f, 0.5f, 0));
+		geo.Add("wedge", geoGen.CreateWedge(1.0, 1.0f, 1.0, 3));
+		geo.Add("pointed_cylinder", geoGen.Createpointed_cylinder(5.0f, 5.0f, 1));
+		return geo;
+	}
+
+	double MsSince(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// Distance along the ray to the triangle, or FLT_MAX.
+	float RayTriangle(FXMVECTOR origin, FXMVECTOR direction, FXMVECTOR p0, GXMVECTOR p1, HXMVECTOR p2)
+	{
+		const XMVECTOR e1 = XMVectorSubtract(p1, p0);
+		const XMVECTOR e2 = XMVectorSubtract(p2, p0);
+		const XMVECTOR pv = XMVector3Cross(direction, e2);
+		const float det = XMVectorGetX(XMVector3Dot(e1, pv));
+		if (std::fabs(det) < 1e-12f)
+			return FLT_MAX;
+		const XMVECTOR tv = XMVectorSubtract(origin, p0);
+		const float u = XMVectorGetX(XMVector3Dot(tv, pv)) / det;
+		const XMVECTOR qv = XMVector3Cross(tv, e1);
+		const float v = XMVectorGetX(XMVector3Dot(direction, qv)) / det;
+		const float t = XMVectorGetX(XMVector3Dot(e2, qv)) / det;
+		return u < 0.0f || v < 0.0f || u + v > 1.0f || t < 0.0f ? FLT_MAX : t;
+	}
+}
+
+int RunStaticBatchCommand(const ToolArgs& args)
+{
+	const std::string in = args.GetString("in", "../../Scenes/TreeBillboards.scene");
+	const int rays = std::max(args.GetInt("rays", 500), 0);
+	const int views = std::max(args.GetInt("views", 100), 0);
+	const float eps = 1e-3f;
+
+	StaticBatchDesc desc;
+	desc.ChunkSize = args.GetFloat("chunk", desc.ChunkSize);
+	desc.MaxChunkVertices = (std::uint32_t)std::max(args.GetInt("max-vertices", (int)desc.MaxChunkVertices), 3);
+
+	MappedFile text;
+	if (!text.Open(std::wstring(in.begin(), in.end())))
+	{
+		std::fprintf(stderr, "Cannot open %s\n", in.c_str());
+		return 1;
+	}
+	SceneFile scene;
+	if (!scene.ParseText(reinterpret_cast<const char*>(text.Data()), text.Size()))
+	{
+		std::fprintf(stderr, "%s: %s\n", in.c_str(), scene.Error().c_str());
+		return 1;
+	}
+
+	// The geometries: the demo's shapes, and the model files next to the scene.
+	std::map<std::string, TestGeometry> geometries;
+	geometries["boxGeo"] = BoxGeometry();
+	const std::string sceneDir = in.substr(0, in.find_last_of("/\\") + 1);
+	for (int i = 0; i < scene.MeshCount(); ++i)
+	{
+		const std::string file = sceneDir + scene.String(scene.Mesh(i).File);
+		MeshImporter importer;
+		ImportedMesh mesh;
+		if (!importer.Import(std::wstring(file.begin(), file.end()), mesh))
+		{
+			std::printf("  %s: %s, its items are skipped\n", file.c_str(), importer.Error().c_str());
+			continue;
+		}
+		TestGeometry& geo = geometries[scene.String(scene.Mesh(i).Geometry)];
+		for (const MeshVertex& v : mesh.Vertices)
+			geo.Vertices.push_back({ v.Pos, v.Normal, v.TexC });
+		geo.Indices = mesh.Indices;
+		for (const ImportedSubmesh& part : mesh.Submeshes)
+			geo.DrawArgs[part.Name] = { part.StartIndex, part.IndexCount };
+	}
+
+	// The static triangle items, keyed by material and layer as the demo does.
+	std::vector<StaticBatchSource> sources;
+	std::map<std::string, std::uint32_t> keys;
+	int staticItems = 0;
+	for (int i = 0; i < scene.ItemCount(); ++i)
+	{
+		const SceneItem& item = scene.Item(i);
+		if (!item.Static || item.Topology != SceneTopology::Triangles)
+			continue;
+		++staticItems;
+
+		auto geo = geometries.find(scene.String(item.Geometry));
+		if (geo == geometries.end() || geo->second.DrawArgs.count(scene.String(item.DrawArg)) == 0)
+			continue;
+		const auto& range = geo->second.DrawArgs[scene.String(item.DrawArg)];
+
+		const std::string keyName = std::string(scene.String(item.Material)) + "/" + scene.String(item.Layer);
+		auto key = keys.insert({ keyName, (std::uint32_t)keys.size() }).first;
+
+		StaticBatchSource source;
+		source.Vertices = geo->second.Vertices.data();
+		source.Indices = geo->second.Indices.data();
+		source.Indices32 = true;
+		source.StartIndexLocation = range.first;
+		source.IndexCount = range.second;
+		source.World = item.World;
+		source.TexTransform = item.TexTransform;
+		source.Key = key->second;
+		sources.push_back(source);
+	}
+
+	StaticBatches batches;
+	const auto buildStart = std::chrono::steady_clock::now();
+	BuildStaticBatches(desc, sources.data(), (std::uint32_t)sources.size(), batches);
+	const double buildMs = MsSince(buildStart);
+
+	int failures = 0;
+	auto fail = [&](const char* what, size_t chunk)
+	{
+		if (failures++ < 10)
+			std::printf("  chunk %zu: %s\n", chunk, what);
+	};
+
+	// Every batched triangle against its source triangle.
+	std::vector<int> batchedTriangles(sources.size(), 0);
+	for (size_t c = 0; c < batches.Chunks.size(); ++c)
+	{
+		const StaticBatchChunk& chunk = batches.Chunks[c];
+		if (chunk.VertexCount > std::min<std::uint32_t>(desc.MaxChunkVertices, 65536))
+			fail("over the vertex limit", c);
+
+		for (std::uint32_t v = chunk.FirstVertex; v < chunk.FirstVertex + chunk.VertexCount; ++v)
+		{
+			const XMVECTOR p = XMLoadFloat3(&batches.Vertices[v].Pos);
+			if (!XMVector3GreaterOrEqual(p, XMVectorSubtract(XMLoadFloat3(&chunk.BoundsMin), XMVectorReplicate(eps))) ||
+				!XMVector3LessOrEqual(p, XMVectorAdd(XMLoadFloat3(&chunk.BoundsMax), XMVectorReplicate(eps))))
+			{
+				fail("vertex outside the bounds", c);
+			}
+		}
+
+		for (std::uint32_t p = chunk.FirstPart; p < chunk.FirstPart + chunk.PartCount; ++p)
+		{
+			const StaticBatchPart& part = batches.Parts[p];
+			const StaticBatchSource& source = sources[part.Source];
+			if (sources[part.Source].Key != chunk.Key)
+				fail("source of another key", c);
+
+			const XMMATRIX world = XMLoadFloat4x4(&source.World);
+			const bool mirrored = XMVectorGetX(XMMatrixDeterminant(world)) < 0.0f;
+			const std::uint32_t* sourceIndices = static_cast<const std::uint32_t*>(source.Indices) + source.StartIndexLocation;
+			for (std::uint32_t k = 0; k < part.IndexCount; k += 3)
+			{
+				const std::uint32_t triangle = (part.FirstIndex - chunk.FirstIndex + k) / 3;
+				if (batches.SourceOfTriangle((std::uint32_t)c, triangle) != part.Source)
+					fail("triangle maps to the wrong source", c);
+
+				XMVECTOR batched[3];
+				XMVECTOR expected[3];
+				for (int corner = 0; corner < 3; ++corner)
+				{
+					const std::uint32_t index = batches.Indices[part.FirstIndex + k + corner];
+					if (index >= chunk.VertexCount)
+					{
+						fail("index past the chunk's vertices", c);
+						batched[corner] = XMVectorZero();
+					}
+					else
+					{
+						batched[corner] = XMLoadFloat3(&batches.Vertices[chunk.FirstVertex + index].Pos);
+					}
+					expected[corner] = XMVector3TransformCoord(XMLoadFloat3(&source.Vertices[sourceIndices[k + corner]].Pos), world);
+				}
+				if (mirrored)
+					std::swap(expected[1], expected[2]);
+
+				for (int corner = 0; corner < 3; ++corner)
+				{
+					if (XMVectorGetX(XMVector3Length(XMVectorSubtract(batched[corner], expected[corner]))) > eps)
+						fail("triangle differs from its source in world space", c);
+				}
+				++batchedTriangles[part.Source];
+			}
+		}
+	}
+	for (std::uint32_t s : batches.Unbatched)
+		batchedTriangles[s] = (int)(sources[s].IndexCount / 3);
+	for (size_t s = 0; s < sources.size(); ++s)
+	{
+		if (batchedTriangles[s] != (int)(sources[s].IndexCount / 3))
+			fail("a source's triangles are missing or repeated", 0);
+	}
+
+	// Picking against the source triangles one by one.
+	XMVECTOR lo = XMVectorReplicate(FLT_MAX);
+	XMVECTOR hi = XMVectorReplicate(-FLT_MAX);
+	for (const StaticBatchChunk& chunk : batches.Chunks)
+	{
+		lo = XMVectorMin(lo, XMLoadFloat3(&chunk.BoundsMin));
+		hi = XMVectorMax(hi, XMLoadFloat3(&chunk.BoundsMax));
+	}
+	const XMVECTOR center = XMVectorScale(XMVectorAdd(lo, hi), 0.5f);
+	const XMVECTOR extent = XMVectorSubtract(hi, lo);
+
+	std::mt19937 rng((unsigned)args.GetInt("seed", 1));
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	auto randomPoint = [&](float spread)
+	{
+		return XMVectorAdd(center, XMVectorMultiply(extent, XMVectorSet(unit(rng)*spread, unit(rng)*spread, unit(rng)*spread, 0.0f)));
+	};
+
+	int hits = 0;
+	double pickMs = 0.0;
+	std::vector<float> sourceNearest(sources.size());
+	for (int r = 0; r < rays && !batches.Chunks.empty(); ++r)
+	{
+		const XMVECTOR origin = randomPoint(1.0f);
+		const XMVECTOR direction = XMVector3Normalize(XMVectorSubtract(randomPoint(0.5f), origin));
+
+		const auto pickStart = std::chrono::steady_clock::now();
+		StaticBatchHit hit;
+		const bool picked = PickStaticBatches(batches, origin, direction, hit);
+		pickMs += MsSince(pickStart);
+
+		// Nearest per source: sources can share a face (the maze walls), so the pick may
+		// return either.
+		float nearest = FLT_MAX;
+		std::fill(sourceNearest.begin(), sourceNearest.end(), FLT_MAX);
+		for (const StaticBatchPart& part : batches.Parts)
+		{
+			const StaticBatchSource& source = sources[part.Source];
+			const XMMATRIX world = XMLoadFloat4x4(&source.World);
+			const std::uint32_t* sourceIndices = static_cast<const std::uint32_t*>(source.Indices) + source.StartIndexLocation;
+			for (std::uint32_t k = 0; k < source.IndexCount; k += 3)
+			{
+				const float t = RayTriangle(origin, direction,
+					XMVector3TransformCoord(XMLoadFloat3(&source.Vertices[sourceIndices[k]].Pos), world),
+					XMVector3TransformCoord(XMLoadFloat3(&source.Vertices[sourceIndices[k + 1]].Pos), world),
+					XMVector3TransformCoord(XMLoadFloat3(&source.Vertices[sourceIndices[k + 2]].Pos), world));
+				nearest = std::min(nearest, t);
+				sourceNearest[part.Source] = std::min(sourceNearest[part.Source], t);
+			}
+		}
+
+		hits += picked;
+		if (picked != (nearest < FLT_MAX))
+			fail("pick disagrees with the sources on whether the ray hits", hit.Chunk);
+		else if (picked && std::fabs(hit.Distance - nearest) > eps*std::max(1.0f, nearest))
+			fail("pick found another distance than the sources", hit.Chunk);
+		else if (picked && std::fabs(hit.Distance - sourceNearest[hit.Source]) > eps*std::max(1.0f, nearest))
+			fail("pick returned a source the ray does not hit there", hit.Chunk);
+	}
+
+	// Culling from random views: a culled chunk has every vertex outside one plane.
+	int culled = 0;
+	for (int i = 0; i < views && !batches.Chunks.empty(); ++i)
+	{
+		const XMVECTOR eye = randomPoint(0.75f);
+		const XMVECTOR target = randomPoint(0.5f);
+		if (XMVectorGetX(XMVector3LengthSq(XMVectorSubtract(target, eye))) < 1e-4f)
+			continue;
+		const XMMATRIX view = XMMatrixLookAtLH(eye, target, XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+		const XMMATRIX proj = XMMatrixPerspectiveFovLH(0.25f*XM_PI, 16.0f / 9.0f, 1.0f, 1000.0f);
+		const MeshletCullView cullView = MakeMeshletCullView(XMMatrixIdentity(), XMMatrixMultiply(view, proj), eye);
+
+		for (size_t c = 0; c < batches.Chunks.size(); ++c)
+		{
+			const StaticBatchChunk& chunk = batches.Chunks[c];
+			if (StaticChunkVisible(chunk, cullView.Planes))
+				continue;
+			++culled;
+
+			bool outside = false;
+			for (int k = 0; k < 6 && !outside; ++k)
+			{
+				const XMVECTOR plane = XMLoadFloat4(&cullView.Planes[k]);
+				outside = true;
+				for (std::uint32_t v = chunk.FirstVertex; v < chunk.FirstVertex + chunk.VertexCount && outside; ++v)
+					outside = XMVectorGetX(XMPlaneDotCoord(plane, XMLoadFloat3(&batches.Vertices[v].Pos))) < eps;
+			}
+			if (!outside)
+				fail("culled with a vertex inside every plane", c);
+		}
+	}
+
+	std::printf("batches %s: %d static items, %zu batched in %zu keys\n", in.c_str(), staticItems,
+		sources.size() - batches.Unbatched.size(), keys.size());
+	std::printf("  %zu draws become %zu chunk draws (chunk size %.1f), %zu vertices, %zu indices\n",
+		sources.size() - batches.Unbatched.size(), batches.Chunks.size(), desc.ChunkSize,
+		batches.Vertices.size(), batches.Indices.size());
+	std::printf("  %d of %d rays hit, %.1f%% of chunks culled over %d views\n", hits, rays,
+		100.0*culled / std::max<double>((double)batches.Chunks.size()*views, 1.0), views);
+	std::printf("  build:         %10.3f ms\n", buildMs);
+	std::printf("  pick:          %10.3f ms per ray\n", rays > 0 ? pickMs / rays : 0.0);
+
+	if (failures > 0)
+	{
+		std::printf("  %d checks failed\n", failures);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,497 @@
+//***************************************************************************************
+// StressCommand.cpp
+//
+// Synthesizes a scene at production scale (tens of thousands of render items) and runs
+// the demo's per-frame CPU work on it for a number of frames against a null device:
+// the frame resources are created without a device, so their upload buffers live in
+// system memory and the draw lists are built but never recorded.  Reports the time of
+// each phase per frame, the memory the scene and frame resources hold and the heap
+// allocations each phase makes per frame; --assert-zero-alloc fails the run if a frame
+// after the warmup allocates.  The upload counters of RenderStats give the bytes each
+// kind of buffer receives per frame.
+//***************************************************************************************
+
+#include "ToolCommands.h"
+#include "../Project1/AllocationTracker.h"
+#include "../Project1/FrameUpdate.h"
+#include "../Project1/ParallelFor.h"
+#include "../../Common/GeometryGenerator.h"
+#include "../../Common/RenderStats.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <psapi.h>
+
+#pragma comment(lib, "psapi.lib")
+
+using namespace DirectX;
+
+namespace
+{
+	struct StressDesc
+	{
+		int RenderItems = 50000;
+		int Materials = 256;
+		int MazeSize = 32;          // Cells per side; about 40% of them are walls.
+		int TreeSprites = 16384;
+		int TreeSpritesPerItem = 256;
+		int Movers = 5000;          // Render items whose world matrix changes every frame.
+		int WavesSize = 128;        // Rows and columns of the waves grid.
+		int Frames = 300;
+		unsigned Seed = 1;
+	};
+
+	enum StressPhase
+	{
+		PhaseAnimate = 0,
+		PhaseObjectCBs,
+		PhaseMaterialCBs,
+		PhaseWaves,
+		PhaseDrawLists,
+		PhaseCount
+	};
+
+	const char* const gPhaseNames[PhaseCount] =
+	{
+		"animate", "object cbs", "material cbs", "waves", "draw lists"
+	};
+
+	struct Mover
+	{
+		RenderItem* Item;
+		XMFLOAT3 Center;
+		float Radius;
+		float Speed;
+		float Phase;
+	};
+
+	struct StressScene
+	{
+		std::unordered_map<std::string, std::unique_ptr<MeshGeometry>> Geometries;
+		std::unordered_map<std::string, std::unique_ptr<Material>> Materials;
+		std::vector<Material*> MaterialList;
+		std::vector<std::unique_ptr<RenderItem>> AllRitems;
+		std::vector<RenderItem*> RitemLayer[(int)RenderLayer::Count];
+		std::vector<Mover> Movers;
+		std::unique_ptr<Waves> WaveSim;
+		RenderItem* WavesRitem = nullptr;
+	};
+
+	// Geometry without GPU buffers; only the counts the draw list reads are filled in.
+	void AddShape(MeshGeometry& geo, const std::string& name, const GeometryGenerator::MeshData& mesh)
+	{
+		SubmeshGeometry submesh;
+		submesh.IndexCount = (UINT)mesh.Indices32.size();
+		submesh.StartIndexLocation = geo.IndexBufferByteSize / sizeof(std::uint16_t);
+		submesh.BaseVertexLocation = geo.VertexBufferByteSize / sizeof(Vertex);
+		geo.DrawArgs[name] = submesh;
+
+		geo.VertexBufferByteSize += (UINT)(mesh.Vertices.size()*sizeof(Vertex));
+		geo.IndexBufferByteSize += (UINT)(mesh.Indices32.size()*sizeof(std::uint16_t));
+	}
+
+	std::unique_ptr<MeshGeometry> MakeGeometry(const std::string& name, UINT vertexStride)
+	{
+		auto geo = std::make_unique<MeshGeometry>();
+		geo->Name = name;
+		geo->VertexByteStride = vertexStride;
+		geo->IndexFormat = DXGI_FORMAT_R16_UINT;
+		return geo;
+	}
+
+	RenderItem* AddItem(StressScene& scene, RenderLayer layer, MeshGeometry* geo, const std::string& submesh,
+		Material* mat, const XMMATRIX& world)
+	{
+		auto ritem = std::make_unique<RenderItem>();
+		XMStoreFloat4x4(&ritem->World, world);
+		ritem->ObjCBIndex = (UINT)scene.AllRitems.size();
+		ritem->Mat = mat;
+		ritem->Geo = geo;
+		ritem->IndexCount = geo->DrawArgs[submesh].IndexCount;
+		ritem->StartIndexLocation = geo->DrawArgs[submesh].StartIndexLocation;
+		ritem->BaseVertexLocation = geo->DrawArgs[submesh].BaseVertexLocation;
+
+		RenderItem* result = ritem.get();
+		scene.RitemLayer[(int)layer].push_back(result);
+		scene.AllRitems.push_back(std::move(ritem));
+		return result;
+	}
+
+	void BuildStressScene(const StressDesc& desc, StressScene& scene)
+	{
+		std::mt19937 rng(desc.Seed);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		const float extent = 500.0f;
+
+		// Shapes like the demo's boxGeo/shapeGeo, the waves grid and the tree points.
+		GeometryGenerator geoGen;
+		auto shapes = MakeGeometry("shapeGeo", sizeof(Vertex));
+		AddShape(*shapes, "box", geoGen.CreateBox(1.0f, 1.0f, 1.0f, 0));
+		AddShape(*shapes, "sphere", geoGen.CreateSphere(0.5f, 20, 20));
+		AddShape(*shapes, "cylinder", geoGen.CreateCylinder(0.5f, 0.3f, 3.0f, 20, 20));
+		AddShape(*shapes, "cone", geoGen.CreateCone(0.5f, 1.0f, 20, 20));
+		const std::string shapeNames[] = { "box", "sphere", "cylinder", "cone" };
+
+		auto maze = MakeGeometry("boxGeo", sizeof(Vertex));
+		AddShape(*maze, "box", geoGen.CreateBox(1.0f, 1.0f, 1.0f, 0));
+		maze->ColorByteStride = sizeof(std::uint32_t);
+
+		scene.WaveSim = std::make_unique<Waves>(desc.WavesSize, desc.WavesSize, 1.0f, 0.03f, 4.0f, 0.2f);
+		auto water = MakeGeometry("waterGeo", sizeof(Vertex));
+		SubmeshGeometry waterGrid;
+		waterGrid.IndexCount = 3 * scene.WaveSim->TriangleCount();
+		water->DrawArgs["grid"] = waterGrid;
+		water->VertexBufferByteSize = (UINT)(scene.WaveSim->VertexCount()*sizeof(Vertex));
+		water->IndexFormat = DXGI_FORMAT_R32_UINT;
+		water->IndexBufferByteSize = (UINT)(waterGrid.IndexCount*sizeof(std::uint32_t));
+
+		auto trees = MakeGeometry("treeSpritesGeo", sizeof(XMFLOAT3) + sizeof(XMFLOAT2));
+		trees->VertexBufferByteSize = (UINT)desc.TreeSprites*trees->VertexByteStride;
+		trees->IndexBufferByteSize = (UINT)(desc.TreeSprites*sizeof(std::uint16_t));
+
+		// Materials; the first one scrolls every frame like the demo's water.
+		for (int i = 0; i < std::max(desc.Materials, 1); ++i)
+		{
+			auto mat = std::make_unique<Material>();
+			mat->Name = "material" + std::to_string(i);
+			mat->MatCBIndex = i;
+			mat->DiffuseSrvHeapIndex = i % 16;
+			mat->DiffuseAlbedo = XMFLOAT4(unit(rng), unit(rng), unit(rng), 1.0f);
+			mat->Roughness = unit(rng);
+			scene.MaterialList.push_back(mat.get());
+			scene.Materials[mat->Name] = std::move(mat);
+		}
+		auto randomMaterial = [&]() { return scene.MaterialList[rng() % scene.MaterialList.size()]; };
+
+		// Maze walls are baked boxes, one color per box vertex.
+		const int boxVertices = (int)(maze->VertexBufferByteSize / sizeof(Vertex));
+		int bakedVertices = 0;
+		for (int j = 0; j < desc.MazeSize; ++j)
+		{
+			for (int i = 0; i < desc.MazeSize; ++i)
+			{
+				if (unit(rng) >= 0.4f)
+					continue;
+
+				XMMATRIX world = XMMatrixScaling(5.0f, 6.0f, 5.0f)*
+					XMMatrixTranslation(5.0f*(i - 0.5f*desc.MazeSize), 3.0f, 5.0f*(j - 0.5f*desc.MazeSize));
+				RenderItem* wall = AddItem(scene, RenderLayer::OpaqueBaked, maze.get(), "box", randomMaterial(), world);
+				wall->BakedLightOffset = bakedVertices;
+				bakedVertices += boxVertices;
+			}
+		}
+		maze->ColorBufferByteSize = (UINT)bakedVertices*maze->ColorByteStride;
+
+		// Generic props spread over the layers roughly like a level: mostly opaque, some
+		// alpha tested foliage, a few transparent items.
+		for (int i = 0; i < desc.RenderItems; ++i)
+		{
+			const float r = unit(rng);
+			const RenderLayer layer = r < 0.8f ? RenderLayer::Opaque :
+				r < 0.95f ? RenderLayer::AlphaTested : RenderLayer::Transparent;
+
+			const float scale = 0.5f + 2.0f*unit(rng);
+			XMMATRIX world = XMMatrixScaling(scale, scale, scale)*
+				XMMatrixRotationY(XM_2PI*unit(rng))*
+				XMMatrixTranslation(extent*(unit(rng) - 0.5f), 5.0f*unit(rng), extent*(unit(rng) - 0.5f));
+			AddItem(scene, layer, shapes.get(), shapeNames[rng() % 4], randomMaterial(), world);
+		}
+
+		// Movers orbit their start position, so they are dirty every frame.
+		const int moverCount = std::min(desc.Movers, desc.RenderItems);
+		for (int i = 0; i < moverCount; ++i)
+		{
+			RenderItem* item = scene.AllRitems[scene.AllRitems.size() - desc.RenderItems + i].get();
+
+			Mover mover;
+			mover.Item = item;
+			mover.Center = XMFLOAT3(item->World(3, 0), item->World(3, 1), item->World(3, 2));
+			mover.Radius = 1.0f + 4.0f*unit(rng);
+			mover.Speed = 0.5f + 2.0f*unit(rng);
+			mover.Phase = XM_2PI*unit(rng);
+			scene.Movers.push_back(mover);
+		}
+
+		// Tree sprites are point lists, split into items like terrain chunks.
+		const int perItem = std::max(desc.TreeSpritesPerItem, 1);
+		for (int first = 0; first < desc.TreeSprites; first += perItem)
+		{
+			SubmeshGeometry chunk;
+			chunk.IndexCount = (UINT)std::min(perItem, desc.TreeSprites - first);
+			chunk.StartIndexLocation = (UINT)first;
+			trees->DrawArgs["chunk" + std::to_string(first / perItem)] = chunk;
+
+			RenderItem* item = AddItem(scene, RenderLayer::AlphaTestedTreeSprites, trees.get(),
+				"chunk" + std::to_string(first / perItem), randomMaterial(), XMMatrixIdentity());
+			item->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_POINTLIST;
+		}
+
+		scene.WavesRitem = AddItem(scene, RenderLayer::Transparent, water.get(), "grid",
+			scene.MaterialList[0], XMMatrixIdentity());
+
+		scene.Geometries[shapes->Name] = std::move(shapes);
+		scene.Geometries[maze->Name] = std::move(maze);
+		scene.Geometries[water->Name] = std::move(water);
+		scene.Geometries[trees->Name] = std::move(trees);
+	}
+
+	void AnimateScene(StressScene& scene, float totalTime, float dt)
+	{
+		for (const Mover& m : scene.Movers)
+		{
+			const float angle = m.Phase + m.Speed*totalTime;
+			m.Item->World(3, 0) = m.Center.x + m.Radius*std::cos(angle);
+			m.Item->World(3, 2) = m.Center.z + m.Radius*std::sin(angle);
+			m.Item->NumFramesDirty = gNumFrameResources;
+		}
+
+		// Scroll the first material like AnimateMaterials scrolls the water.
+		Material* water = scene.MaterialList[0];
+		float& tu = water->MatTransform(3, 0);
+		float& tv = water->MatTransform(3, 1);
+		tu += 0.1f*dt;
+		tv += 0.02f*dt;
+		if (tu >= 1.0f)
+			tu -= 1.0f;
+		if (tv >= 1.0f)
+			tv -= 1.0f;
+		water->NumFramesDirty = gNumFrameResources;
+	}
+
+	size_t ProcessWorkingSet(size_t* peak)
+	{
+		PROCESS_MEMORY_COUNTERS counters = {};
+		counters.cb = sizeof(counters);
+		if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+			return 0;
+		if (peak != nullptr)
+			*peak = counters.PeakWorkingSetSize;
+		return counters.WorkingSetSize;
+	}
+
+	double MiB(size_t bytes)
+	{
+		return bytes / (1024.0*1024.0);
+	}
+}
+
+int RunStressCommand(const ToolArgs& args)
+{
+	StressDesc desc;
+	desc.RenderItems = std::max(args.GetInt("items", desc.RenderItems), 0);
+	desc.Materials = std::max(args.GetInt("materials", desc.Materials), 1);
+	desc.MazeSize = std::max(args.GetInt("maze", desc.MazeSize), 0);
+	desc.TreeSprites = std::max(args.GetInt("trees", desc.TreeSprites), 0);
+	desc.Movers = std::max(args.GetInt("movers", desc.Movers), 0);
+	desc.WavesSize = std::max(args.GetInt("waves", desc.WavesSize), 8);
+	desc.Frames = std::max(args.GetInt("frames", desc.Frames), 1);
+	desc.Seed = (unsigned)args.GetInt("seed", (int)desc.Seed);
+	const bool assertZeroAlloc = args.Has("assert-zero-alloc");
+	const int warmupFrames = std::max(args.GetInt("warmup", 10), 0);
+
+	int phaseTags[PhaseCount];
+	for (int p = 0; p < PhaseCount; ++p)
+		phaseTags[p] = AllocationTracker::RegisterTag(gPhaseNames[p]);
+
+	const size_t workingSetBefore = ProcessWorkingSet(nullptr);
+
+	auto setupStart = std::chrono::steady_clock::now();
+
+	StressScene scene;
+	BuildStressScene(desc, scene);
+
+	const UINT objectCount = (UINT)scene.AllRitems.size();
+	const UINT materialCount = (UINT)scene.MaterialList.size();
+	std::vector<std::unique_ptr<FrameResource>> frameResources;
+	for (int i = 0; i < gNumFrameResources; ++i)
+	{
+		frameResources.push_back(std::make_unique<FrameResource>(nullptr,
+			1, objectCount, materialCount, (UINT)scene.WaveSim->VertexCount()));
+	}
+
+	const double setupSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - setupStart).count();
+	const size_t workingSetScene = ProcessWorkingSet(nullptr);
+
+	std::printf("stress: %u render items (%d movers), %u materials, %d tree sprites, waves %dx%d, %d frames, %d workers\n",
+		objectCount, (int)scene.Movers.size(), materialCount, desc.TreeSprites,
+		desc.WavesSize, desc.WavesSize, desc.Frames, WorkerCount());
+	for (int layer = 0; layer < (int)RenderLayer::Count; ++layer)
+		std::printf("  layer %d: %zu items\n", layer, scene.RitemLayer[layer].size());
+	std::printf("  setup %.2f ms\n", setupSeconds*1000.0);
+
+	// Per phase: total and worst frame.
+	double phaseTotal[PhaseCount] = {};
+	double phaseMax[PhaseCount] = {};
+	double frameMax = 0.0;
+
+	// Per phase: allocations after the warmup, and the first frame that allocated.
+	AllocationFrameCounter frameAllocations;
+	std::uint64_t phaseAllocations[PhaseCount] = {};
+	std::string firstViolation;
+
+	// Upload bytes and copies per kind, summed over all frames.
+	RenderStatsFrame uploadTotals;
+
+	// Sample call stacks only in the frame loop; setup allocates far too often.
+	AllocationTracker::SetSampleInterval((std::uint32_t)std::max(args.GetInt("sample-interval", 1), 0));
+
+	const float dt = 1.0f / 60.0f;
+	float totalTime = 0.0f;
+	float wavesBase = 0.0f;
+	std::mt19937 rng(desc.Seed + 1);
+
+	for (int frame = 0; frame < desc.Frames; ++frame)
+	{
+		FrameResource* currFrameResource = frameResources[frame % gNumFrameResources].get();
+		totalTime += dt;
+
+		double phaseSeconds[PhaseCount] = {};
+		auto mark = std::chrono::steady_clock::now();
+		auto lap = [&](StressPhase phase)
+		{
+			auto now = std::chrono::steady_clock::now();
+			phaseSeconds[phase] = std::chrono::duration<double>(now - mark).count();
+			mark = now;
+		};
+
+		{
+			AllocationScope scope(phaseTags[PhaseAnimate]);
+			AnimateScene(scene, totalTime, dt);
+		}
+		lap(PhaseAnimate);
+
+		{
+			AllocationScope scope(phaseTags[PhaseObjectCBs]);
+			UpdateObjectConstants(scene.AllRitems, *currFrameResource->ObjectCB);
+		}
+		lap(PhaseObjectCBs);
+
+		{
+			AllocationScope scope(phaseTags[PhaseMaterialCBs]);
+			UpdateMaterialConstants(scene.Materials, *currFrameResource->MaterialCB);
+		}
+		lap(PhaseMaterialCBs);
+
+		{
+			AllocationScope scope(phaseTags[PhaseWaves]);
+
+			// Every quarter second, generate a random wave.
+			if (totalTime - wavesBase >= 0.25f)
+			{
+				wavesBase += 0.25f;
+				std::uniform_int_distribution<int> row(4, scene.WaveSim->RowCount() - 5);
+				std::uniform_int_distribution<int> col(4, scene.WaveSim->ColumnCount() - 5);
+				std::uniform_real_distribution<float> magnitude(0.2f, 0.5f);
+				scene.WaveSim->Disturb(row(rng), col(rng), magnitude(rng));
+			}
+			scene.WaveSim->Update(dt);
+			UpdateWavesVertices(*scene.WaveSim, *currFrameResource->WavesVB);
+		}
+		lap(PhaseWaves);
+
+		{
+			AllocationScope scope(phaseTags[PhaseDrawLists]);
+			for (int layer = 0; layer < (int)RenderLayer::Count; ++layer)
+				BuildDrawList(scene.RitemLayer[layer], 0, 0, ThreadFrameArena());
+		}
+		lap(PhaseDrawLists);
+
+		ResetFrameArenas();
+
+		RenderStats::EndFrame();
+		const RenderStatsFrame& stats = RenderStats::LastFrame();
+		for (int k = 0; k < (int)UploadKind::Count; ++k)
+		{
+			uploadTotals.UploadBytes[k] += stats.UploadBytes[k];
+			uploadTotals.UploadCopies[k] += stats.UploadCopies[k];
+		}
+
+		frameAllocations.EndFrame();
+		if (frame >= warmupFrames)
+		{
+			for (int p = 0; p < PhaseCount; ++p)
+				phaseAllocations[p] += frameAllocations.Frame(phaseTags[p]).Allocations;
+		}
+		if (firstViolation.empty() && !frameAllocations.CheckZeroAllocations((std::uint64_t)warmupFrames))
+		{
+			AllocationScope scope(AllocationTracker::IgnoredTag);
+			firstViolation = frameAllocations.Report();
+		}
+
+		double frameSeconds = 0.0;
+		for (int p = 0; p < PhaseCount; ++p)
+		{
+			phaseTotal[p] += phaseSeconds[p];
+			phaseMax[p] = std::max(phaseMax[p], phaseSeconds[p]);
+			frameSeconds += phaseSeconds[p];
+		}
+		frameMax = std::max(frameMax, frameSeconds);
+	}
+
+	// Memory each phase works on.
+	size_t frameResourceBytes = 0;
+	for (const auto& fr : frameResources)
+	{
+		frameResourceBytes += (size_t)(fr->PassCB->ByteSize() + fr->ObjectCB->ByteSize() +
+			fr->MaterialCB->ByteSize() + fr->WavesVB->ByteSize() + fr->ClusterLights->ByteSize() +
+			fr->ClusterRanges->ByteSize() + fr->ClusterLightIndices->ByteSize());
+	}
+	const size_t drawListBytes = ThreadFrameArena().HighWaterMark();
+
+	const size_t phaseBytes[PhaseCount] =
+	{
+		scene.Movers.size()*sizeof(Mover),
+		scene.AllRitems.size()*sizeof(RenderItem) +
+			gNumFrameResources*(size_t)frameResources[0]->ObjectCB->ByteSize(),
+		scene.MaterialList.size()*sizeof(Material) +
+			gNumFrameResources*(size_t)frameResources[0]->MaterialCB->ByteSize(),
+		4 * (size_t)scene.WaveSim->VertexCount()*sizeof(XMFLOAT3) +
+			gNumFrameResources*(size_t)frameResources[0]->WavesVB->ByteSize(),
+		drawListBytes
+	};
+
+	double totalSeconds = 0.0;
+	for (int p = 0; p < PhaseCount; ++p)
+		totalSeconds += phaseTotal[p];
+
+	// Allocations per frame are averaged over the frames after the warmup.
+	const int measuredFrames = std::max(desc.Frames - warmupFrames, 1);
+
+	std::printf("  %-14s %10s %10s %10s %12s\n", "phase", "mean ms", "max ms", "MiB", "allocs/frame");
+	for (int p = 0; p < PhaseCount; ++p)
+	{
+		std::printf("  %-14s %10.3f %10.3f %10.2f %12.2f\n", gPhaseNames[p],
+			phaseTotal[p] * 1000.0 / desc.Frames, phaseMax[p] * 1000.0, MiB(phaseBytes[p]),
+			(double)phaseAllocations[p] / measuredFrames);
+	}
+	std::printf("  %-14s %10.3f %10.3f\n", "frame", totalSeconds*1000.0 / desc.Frames, frameMax*1000.0);
+
+	std::printf("  %-20s %10s %12s\n", "upload", "KiB/frame", "copies/frame");
+	for (int k = 0; k < (int)UploadKind::Count; ++k)
+	{
+		if (uploadTotals.UploadCopies[k] == 0)
+			continue;
+		std::printf("  %-20s %10.2f %12.1f\n", RenderStats::UploadKindName((UploadKind)k),
+			uploadTotals.UploadBytes[k] / 1024.0 / desc.Frames, (double)uploadTotals.UploadCopies[k] / desc.Frames);
+	}
+	std::printf("  %-20s %10.2f\n", "total", uploadTotals.TotalUploadBytes() / 1024.0 / desc.Frames);
+
+	size_t peakWorkingSet = 0;
+	const size_t workingSetAfter = ProcessWorkingSet(&peakWorkingSet);
+	std::printf("  frame resources %.2f MiB (%d in flight), draw lists %.2f MiB\n",
+		MiB(frameResourceBytes), gNumFrameResources, MiB(drawListBytes));
+	std::printf("  working set %.2f MiB before setup, %.2f MiB after setup, %.2f MiB after %d frames (peak %.2f MiB)\n",
+		MiB(workingSetBefore), MiB(workingSetScene), MiB(workingSetAfter), desc.Frames, MiB(peakWorkingSet));
+	std::printf("%s", MemoryArena::ReportAll().c_str());
+
+	if (!firstViolation.empty())
+	{
+		std::printf("  heap allocations after %d warmup frames:\n%s", warmupFrames, firstViolation.c_str());
+		if (assertZeroAlloc)
+			return 1;
+	}
+
+	return 0;
+}
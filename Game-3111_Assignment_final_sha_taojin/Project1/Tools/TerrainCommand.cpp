@@ -0,0 +1,57 @@
+//***************************************************************************************
+// TerrainCommand.cpp
+//
+// Synthesizes a terrain headlessly and reports the generator throughput.  With --out the
+// result is written as 16-bit RAW that Heightmap::LoadRaw16 reads back.
+//***************************************************************************************
+
+#include "ToolCommands.h"
+#include "../Project1/TerrainSynth.h"
+#include "../Project1/ParallelFor.h"
+#include <algorithm>
+#include <cstdio>
+
+int RunTerrainCommand(const ToolArgs& args)
+{
+	TerrainSynthDesc desc;
+	desc.Rows = desc.Cols = std::max(args.GetInt("size", desc.Rows), 2);
+	desc.Seed = (std::uint32_t)args.GetInt("seed", (int)desc.Seed);
+	desc.Octaves = args.GetInt("octaves", desc.Octaves);
+	desc.DropletCount = args.GetInt("droplets", desc.DropletCount);
+	desc.TileSize = args.GetInt("tile", desc.TileSize);
+	if (args.Has("no-warp"))
+		desc.WarpStrength = 0.0f;
+
+	TerrainSynth synth(desc);
+	Heightmap heightmap;
+	TerrainSynthStats stats;
+	synth.Generate(heightmap, &stats);
+
+	const auto& heights = heightmap.Heights();
+	auto minMax = std::minmax_element(heights.begin(), heights.end());
+	const float minHeight = *minMax.first;
+	const float maxHeight = *minMax.second;
+
+	std::printf("terrain %dx%d, %d octaves, warp %s, %d workers\n",
+		desc.Rows, desc.Cols, desc.Octaves, desc.WarpStrength != 0.0f ? "on" : "off", WorkerCount());
+	std::printf("  noise:   %8.2f ms  %12.0f samples/s  (%llu noise evaluations)\n",
+		stats.NoiseSeconds*1000.0, stats.SamplesPerSecond(), (unsigned long long)stats.NoiseEvaluations);
+	std::printf("  erosion: %8.2f ms  %12.0f droplets/s (%llu droplets)\n",
+		stats.ErosionSeconds*1000.0, stats.DropletsPerSecond(), (unsigned long long)stats.Droplets);
+	std::printf("  height range [%.3f, %.3f]\n", minHeight, maxHeight);
+
+	std::string out = args.GetString("out", "");
+	if (!out.empty())
+	{
+		const float scale = std::max(maxHeight - minHeight, 1e-6f);
+		if (!heightmap.SaveRaw16(std::wstring(out.begin(), out.end()), scale, minHeight))
+		{
+			std::fprintf(stderr, "Failed to write %s\n", out.c_str());
+			return 1;
+		}
+		std::printf("  wrote %s (LoadRaw16(..., %d, %d, %.4f, %.4f))\n",
+			out.c_str(), desc.Rows, desc.Cols, scale, minHeight);
+	}
+
+	return 0;
+}
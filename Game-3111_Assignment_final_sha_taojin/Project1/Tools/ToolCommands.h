@@ -0,0 +1,67 @@
+//***************************************************************************************
+// ToolCommands.h
+//
+// Headless command line front end for the engine's CPU modules.  Each command lives in
+// its own translation unit and is registered in the table in ToolsMain.cpp.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstdlib>
+#include <string>
+#include <unordered_map>
+
+// "--name value" style arguments following the command name.  A flag without a value
+// is stored as "1".
+class ToolArgs
+{
+public:
+	ToolArgs(int argc, char* argv[])
+	{
+		for (int i = 0; i < argc; ++i)
+		{
+			std::string arg = argv[i];
+			if (arg.size() < 3 || arg.compare(0, 2, "--") != 0)
+				continue;
+
+			std::string value = "1";
+			if (i + 1 < argc && std::string(argv[i + 1]).compare(0, 2, "--") != 0)
+				value = argv[++i];
+			mValues[arg.substr(2)] = value;
+		}
+	}
+
+	bool Has(const std::string& name)const { return mValues.count(name) != 0; }
+
+	std::string GetString(const std::string& name, const std::string& defaultValue)const
+	{
+		auto it = mValues.find(name);
+		return it != mValues.end() ? it->second : defaultValue;
+	}
+
+	int GetInt(const std::string& name, int defaultValue)const
+	{
+		auto it = mValues.find(name);
+		return it != mValues.end() ? std::atoi(it->second.c_str()) : defaultValue;
+	}
+
+	float GetFloat(const std::string& name, float defaultValue)const
+	{
+		auto it = mValues.find(name);
+		return it != mValues.end() ? (float)std::atof(it->second.c_str()) : defaultValue;
+	}
+
+private:
+	std::unordered_map<std::string, std::string> mValues;
+};
+
+int RunTerrainCommand(const ToolArgs& args);
+int RunStressCommand(const ToolArgs& args);
+int RunMemoryCommand(const ToolArgs& args);
+int RunSceneCommand(const ToolArgs& args);
+int RunMeshCommand(const ToolArgs& args);
+int RunReplayCommand(const ToolArgs& args);
+int RunMeshletCommand(const ToolArgs& args);
+int RunHalfEdgeCommand(const ToolArgs& args);
+int RunStaticBatchCommand(const ToolArgs& args);
+int RunRenderCommand(const ToolArgs& args);
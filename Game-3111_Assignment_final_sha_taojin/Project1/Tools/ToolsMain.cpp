@@ -0,0 +1,68 @@
+//***************************************************************************************
+// ToolsMain.cpp
+//
+// Usage: Tools <command> [--option value ...]
+//
+// stress and memory drive the Direct3D frame resources and only build on Windows; the
+// other commands build everywhere (see CMakeLists.txt).
+//***************************************************************************************
+
+#include "ToolCommands.h"
+#include "../../Common/ShadingTypes.h"
+#include <cstdio>
+#include <cstring>
+
+// The demo keeps three frames in flight; so do the stress loop and the memory command.
+const int gNumFrameResources = 3;
+
+namespace
+{
+	struct ToolCommand
+	{
+		const char* Name;
+		const char* Usage;
+		int(*Run)(const ToolArgs& args);
+	};
+
+	const ToolCommand gCommands[] =
+	{
+		{ "terrain", "terrain [--size N] [--seed N] [--droplets N] [--tile N] [--no-warp] [--out file.r16]", RunTerrainCommand },
+#if defined(_WIN32)
+		{ "stress", "stress [--items N] [--materials N] [--maze N] [--trees N] [--movers N] [--waves N] [--frames N] [--seed N] [--warmup N] [--sample-interval N] [--assert-zero-alloc]", RunStressCommand },
+		{ "memory", "memory [--objects N] [--materials N] [--waves N] [--geometries N] [--gpu] [--dump]", RunMemoryCommand },
+#endif
+		{ "scene", "scene [--in file.scene] [--out file.sceneb] [--repeats N]", RunSceneCommand },
+		{ "mesh", "mesh [--in file.obj|.glb|.gltf] [--scale S] [--right-handed] [--repeats N]", RunMeshCommand },
+		{ "replay", "replay [--in file.trace] [--against file.trace] [--backend null|software] [--out-dir dir] [--textures dir] [--tolerance N] [--max-reports N]", RunReplayCommand },
+		{ "meshlets", "meshlets [--mesh grid|sphere|geosphere|box|file.obj] [--size N] [--max-vertices N] [--max-triangles N] [--views N] [--seed N]", RunMeshletCommand },
+		{ "halfedge", "halfedge [--mesh sphere|geosphere|box|grid|file.obj] [--size N] [--levels N] [--weld D]", RunHalfEdgeCommand },
+		{ "batches", "batches [--in file.scene] [--chunk S] [--max-vertices N] [--rays N] [--views N] [--seed N]", RunStaticBatchCommand },
+		{ "render", "render [--scene file.scene] [--textures dir] [--width N] [--height N] [--eye x,y,z] [--target x,y,z] [--seed N] [--out file.png]", RunRenderCommand },
+	};
+
+	void PrintUsage()
+	{
+		std::printf("Usage: Tools <command> [options]\n\nCommands:\n");
+		for (const auto& c : gCommands)
+			std::printf("  %s\n", c.Usage);
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2)
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	for (const auto& c : gCommands)
+	{
+		if (std::strcmp(argv[1], c.Name) == 0)
+			return c.Run(ToolArgs(argc - 2, argv + 2));
+	}
+
+	std::fprintf(stderr, "Unknown command '%s'.\n\n", argv[1]);
+	PrintUsage();
+	return 1;
+}